@@ -100,6 +100,8 @@ int ASIHub::ClearComPort(void)
    */
 int ASIHub::QueryCommandUnterminatedResponse(const char *command, const long timeoutMs, unsigned long reply_length)
 {
+   MMThreadGuard g(threadLock_);
+   InvalidateStatusCache();
    RETURN_ON_MM_ERROR ( ClearComPort() );
    RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command, "\r") );
    serialCommand_ = command;
@@ -127,6 +129,8 @@ int ASIHub::QueryCommandUnterminatedResponse(const char *command, const long tim
 // Note that the property SerialResponse property will only show the first 1023 characters of the controller's reply.
 int ASIHub::QueryCommandLongReply(const char *command, const char *replyTerminator)
 {
+   MMThreadGuard g(threadLock_);
+   InvalidateStatusCache();
    RETURN_ON_MM_ERROR ( ClearComPort() );
    RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command, "\r") );
    serialCommand_ = command;
@@ -150,6 +154,7 @@ int ASIHub::QueryCommandLongReply(const char *command, const char *replyTerminat
 int ASIHub::QueryCommand(const char *command, const char *replyTerminator, const long delayMs)
 {
    MMThreadGuard g(threadLock_);
+   InvalidateStatusCache();
    RETURN_ON_MM_ERROR ( ClearComPort() );
    RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command, "\r") );
    serialCommand_ = command;
@@ -158,6 +163,15 @@ int ASIHub::QueryCommand(const char *command, const char *replyTerminator, const
    return DEVICE_OK;
 }
 
+int ASIHub::QueryCommandPrivate(const string &command, string &answer)
+{
+   MMThreadGuard g(threadLock_);
+   RETURN_ON_MM_ERROR ( ClearComPort() );
+   RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command.c_str(), "\r") );
+   RETURN_ON_MM_ERROR ( GetSerialAnswer(port_.c_str(), g_SerialTerminatorDefault, answer) );
+   return DEVICE_OK;
+}
+
 int ASIHub::QueryCommandVerify(const char *command, const char *expectedReplyPrefix, const char *replyTerminator, const long delayMs)
 {
    RETURN_ON_MM_ERROR ( QueryCommand(command, replyTerminator, delayMs) );
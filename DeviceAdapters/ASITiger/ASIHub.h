@@ -33,6 +33,18 @@
 
 using namespace std;
 
+////////////////////////////////////////////////////////////////
+// Devices whose status is served from the hub's status cache
+// implement this so the hub can tell them when a move has
+// finished.  Called from the hub's polling thread.
+////////////////////////////////////////////////////////////////
+class ASIStatusListener
+{
+public:
+   virtual ~ASIStatusListener() { }
+   virtual void OnMoveFinished() = 0;
+};
+
 ////////////////////////////////////////////////////////////////
 // *********** generic ASI comm class *************************
 // implements a "hub" device with communication abilities
@@ -137,6 +149,16 @@ public:
 
    bool UpdatingSharedProperties() { return updatingSharedProperties_; }
 
+   // Axis status cache filled by a background poller (see CTigerCommHub).
+   // The defaults here mean "no cache", in which case devices query the
+   // controller directly.  GetCachedAxisStatus() returns false if the
+   // cached value is missing, too old, or predates the last command sent.
+   // Axes are polled per card (cardAddress is the peripheral's addressChar_), since the
+   //   order of replies to a multi-axis query is not guaranteed across cards.
+   virtual void RegisterStatusAxis(const string& /*axisLetter*/, const string& /*cardAddress*/, ASIStatusListener* /*listener*/) { }
+   virtual void UnRegisterStatusListener(ASIStatusListener* /*listener*/) { }
+   virtual bool GetCachedAxisStatus(const string& /*axisLetter*/, bool& /*busy*/, double& /*position*/) { return false; }
+
    int UpdateSharedProperties(string addressChar, string propName, string value);
 
    // action/property handlers
@@ -149,6 +171,12 @@ public:
    int OnSerialCommandOnlySendChanged(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 protected:
+   // called with the serial lock held before every command sent on behalf of a device
+   virtual void InvalidateStatusCache() { }
+
+   // like QueryCommand but leaves LastSerialAnswer() alone, for use off the core's thread
+   int QueryCommandPrivate(const string &command, string &answer);
+
    string port_;         // port to use for communication
 
 private:
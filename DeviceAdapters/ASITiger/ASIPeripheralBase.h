@@ -66,6 +66,9 @@ public:
       string str(deviceLabel);
       if (hub_) {
          hub_->UnRegisterPeripheral(str);
+         ASIStatusListener* listener = dynamic_cast<ASIStatusListener*>(this);
+         if (listener)
+            hub_->UnRegisterStatusListener(listener);
       }
       return (ASIBase<TDeviceBase, UConcreteDevice>::Shutdown());
    }
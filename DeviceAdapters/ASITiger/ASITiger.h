@@ -182,6 +182,8 @@ const char* const g_SerialCommandOnlySendChangedPropertyName = "OnlySendSerialCo
 const char* const g_SerialCommandRepeatDurationPropertyName = "SerialCommandRepeatDuration(s)";
 const char* const g_SerialCommandRepeatPeriodPropertyName = "SerialCommandRepeatPeriod(ms)";
 const char* const g_SerialComPortPropertyName = "SerialComPort";
+const char* const g_StatusPollPeriodPropertyName = "StatusPollingPeriod(ms)";
+const char* const g_StatusMaxAgePropertyName = "StatusCacheMaxAge(ms)";
 
 // motorized stage property names (XY and Z)
 const char* const g_StepSizeXPropertyName = "StepSizeX(um)";
@@ -33,6 +33,8 @@
 #include "ModuleInterface.h"
 #include <iostream>
 #include <assert.h>
+#include <algorithm>
+#include <map>
 #include <vector>
 
 using namespace std;
@@ -41,9 +43,29 @@ using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
 // CTigerHub implementation
 //
-CTigerCommHub::CTigerCommHub()
+CTigerCommHub::CTigerCommHub() :
+   statusPoller_(NULL),
+   statusPollPeriodMs_(0),
+   statusMaxAgeMs_(100),
+   sampleValid_(false),
+   commandCount_(0),
+   notifyingListener_(NULL),
+   pollFailed_(false)
 {
    CreateProperty(MM::g_Keyword_Name, g_TigerCommHubName, MM::String, true);
+   statusPoller_ = new CTigerStatusPoller(this);
+}
+
+CTigerCommHub::~CTigerCommHub()
+{
+   Shutdown();
+   delete statusPoller_;
+}
+
+int CTigerCommHub::Shutdown()
+{
+   statusPoller_->Stop();
+   return ASIHub::Shutdown();
 }
 
 int CTigerCommHub::Initialize()
@@ -100,6 +122,16 @@ int CTigerCommHub::Initialize()
    }
    RETURN_ON_MM_ERROR ( CreateProperty(g_AxisLetterPropertyName, command.str().c_str(), MM::String, true) );
 
+   // background status polling, off by default; when on, stage Busy() and position queries
+   //   are answered from a cache refreshed by one multi-axis RS and W query per period
+   // CPropertyAction is bound to ASIHub here, so name the action type explicitly
+   MM::ActionFunctor* pAct = new MM::Action<CTigerCommHub> (this, &CTigerCommHub::OnStatusPollPeriod);
+   RETURN_ON_MM_ERROR ( CreateProperty(g_StatusPollPeriodPropertyName, "0", MM::Integer, false, pAct) );
+   RETURN_ON_MM_ERROR ( SetPropertyLimits(g_StatusPollPeriodPropertyName, 0, 1000) );
+   pAct = new MM::Action<CTigerCommHub> (this, &CTigerCommHub::OnStatusMaxAge);
+   RETURN_ON_MM_ERROR ( CreateProperty(g_StatusMaxAgePropertyName, "100", MM::Integer, false, pAct) );
+   RETURN_ON_MM_ERROR ( SetPropertyLimits(g_StatusMaxAgePropertyName, 0, 10000) );
+
    // if we made it this far everything looks good
    initialized_ = true;
    return DEVICE_OK;
@@ -403,3 +435,315 @@ bool CTigerCommHub::Busy()
    // define the hub to never be busy, i.e. it can always accept a new command or query
    return false;
 }
+
+void CTigerCommHub::RegisterStatusAxis(const string& axisLetter, const string& cardAddress, ASIStatusListener* listener)
+{
+   MMThreadGuard g(cacheLock_);
+   if (find(statusAxes_.begin(), statusAxes_.end(), axisLetter) == statusAxes_.end())
+   {
+      statusAxes_.push_back(axisLetter);
+      axisStatus_[axisLetter] = AxisStatus();
+   }
+   axisCards_[axisLetter] = cardAddress;
+   statusListeners_.insert(make_pair(listener, axisLetter));
+}
+
+void CTigerCommHub::UnRegisterStatusListener(ASIStatusListener* listener)
+{
+   // the poller notifies without holding a lock, so wait until it is done with this listener
+   //   (it checks registration right before each call); on the poller's own thread the
+   //   listener is necessarily unregistering from within its notification
+   for (;;)
+   {
+      {
+         MMThreadGuard g(cacheLock_);
+         statusListeners_.erase(listener);
+         if (notifyingListener_ != listener || notifyingThread_ == std::this_thread::get_id())
+            break;
+      }
+      CDeviceUtils::SleepMs(1);
+   }
+   MMThreadGuard g(cacheLock_);
+   statusAxes_.clear();
+   for (multimap<ASIStatusListener*, string>::iterator it = statusListeners_.begin(); it != statusListeners_.end(); ++it)
+   {
+      if (find(statusAxes_.begin(), statusAxes_.end(), it->second) == statusAxes_.end())
+         statusAxes_.push_back(it->second);
+   }
+   for (map<string, AxisStatus>::iterator it = axisStatus_.begin(); it != axisStatus_.end(); )
+   {
+      if (find(statusAxes_.begin(), statusAxes_.end(), it->first) == statusAxes_.end())
+      {
+         axisCards_.erase(it->first);
+         axisStatus_.erase(it++);
+      }
+      else
+         ++it;
+   }
+}
+
+bool CTigerCommHub::GetCachedAxisStatus(const string& axisLetter, bool& busy, double& position)
+{
+   MMThreadGuard g(cacheLock_);
+   map<string, AxisStatus>::const_iterator it = axisStatus_.find(axisLetter);
+   if (it == axisStatus_.end() || !it->second.polled)
+      return false;
+   // listeners reporting a finished move must not fall back to the serial port from our thread
+   if (!(notifyingListener_ != NULL && notifyingThread_ == std::this_thread::get_id()))
+   {
+      if (statusPollPeriodMs_ <= 0 || !sampleValid_)
+         return false;
+      if ((GetCurrentMMTime() - sampleTime_) > MM::MMTime::fromMs((double)statusMaxAgeMs_))
+         return false;
+   }
+   busy = it->second.busy;
+   position = it->second.position;
+   return true;
+}
+
+void CTigerCommHub::InvalidateStatusCache()
+{
+   // called with the serial lock held, so any poll that reads commandCount_ after this
+   //   necessarily sends its query after this command has completed
+   MMThreadGuard g(cacheLock_);
+   ++commandCount_;
+   sampleValid_ = false;
+}
+
+int CTigerCommHub::PollAxisStatus()
+{
+   vector<ASIStatusListener*> finished;
+   int ret = QueryAxisStatus(finished);
+   if (ret != DEVICE_OK)
+   {
+      if (!pollFailed_)
+         LogMessageCode(ret, true);
+      pollFailed_ = true;
+      return ret;
+   }
+   pollFailed_ = false;
+
+   // tell the core about finished moves so it doesn't have to poll Busy(); no lock is held
+   //   during the call, which goes on into the core
+   for (vector<ASIStatusListener*>::iterator it = finished.begin(); it != finished.end(); ++it)
+   {
+      {
+         MMThreadGuard g(cacheLock_);
+         if (statusListeners_.count(*it) == 0)  // unregistered meanwhile
+            continue;
+         notifyingListener_ = *it;
+         notifyingThread_ = std::this_thread::get_id();
+      }
+      (*it)->OnMoveFinished();
+      MMThreadGuard g(cacheLock_);
+      notifyingListener_ = NULL;
+   }
+   return DEVICE_OK;
+}
+
+long CTigerCommHub::GetStatusPollPeriodMs()
+{
+   MMThreadGuard g(cacheLock_);
+   return statusPollPeriodMs_;
+}
+
+int CTigerCommHub::QueryAxisStatus(vector<ASIStatusListener*>& finished)
+{
+   // group the axes by card, keeping the query order within each card
+   vector<vector<string> > cardAxes;
+   unsigned long commandCount;
+   {
+      MMThreadGuard g(cacheLock_);
+      vector<string> cards;
+      for (unsigned int i=0; i<statusAxes_.size(); ++i)
+      {
+         const string& card = axisCards_[statusAxes_[i]];
+         vector<string>::iterator it = find(cards.begin(), cards.end(), card);
+         if (it == cards.end())
+         {
+            cards.push_back(card);
+            cardAxes.push_back(vector<string>());
+            it = cards.end() - 1;
+         }
+         cardAxes[it - cards.begin()].push_back(statusAxes_[i]);
+      }
+      commandCount = commandCount_;
+   }
+   if (cardAxes.empty())
+      return DEVICE_OK;
+
+   MM::MMTime sampleTime = GetCurrentMMTime();
+   vector<string> axes;
+   vector<bool> busy;
+   vector<double> position;
+   for (unsigned int c=0; c<cardAxes.size(); ++c)
+   {
+      RETURN_ON_MM_ERROR ( QueryCardAxisStatus(cardAxes[c], busy, position) );
+      axes.insert(axes.end(), cardAxes[c].begin(), cardAxes[c].end());
+   }
+
+   MMThreadGuard g(cacheLock_);
+   map<ASIStatusListener*, bool> wasBusy;
+   for (multimap<ASIStatusListener*, string>::iterator it = statusListeners_.begin(); it != statusListeners_.end(); ++it)
+   {
+      map<string, AxisStatus>::const_iterator axis = axisStatus_.find(it->second);
+      wasBusy[it->first] = wasBusy[it->first] || (axis != axisStatus_.end() && axis->second.busy);
+   }
+   for (unsigned int i=0; i<axes.size(); ++i)
+   {
+      map<string, AxisStatus>::iterator axis = axisStatus_.find(axes[i]);
+      if (axis == axisStatus_.end())  // unregistered while we were querying
+         continue;
+      axis->second.busy = busy[i];
+      axis->second.position = position[i];
+      axis->second.polled = true;
+   }
+   sampleTime_ = sampleTime;
+   sampleValid_ = (commandCount == commandCount_);
+
+   // a listener's move is finished when none of its axes are busy any more
+   for (map<ASIStatusListener*, bool>::iterator it = wasBusy.begin(); it != wasBusy.end(); ++it)
+   {
+      if (!it->second)
+         continue;
+      bool nowBusy = false;
+      pair<multimap<ASIStatusListener*, string>::iterator, multimap<ASIStatusListener*, string>::iterator> range =
+            statusListeners_.equal_range(it->first);
+      for (multimap<ASIStatusListener*, string>::iterator axis = range.first; axis != range.second; ++axis)
+      {
+         nowBusy = nowBusy || axisStatus_[axis->second].busy;
+      }
+      if (!nowBusy)
+         finished.push_back(it->first);
+   }
+   return DEVICE_OK;
+}
+
+// Appends the busy state and position of axes, all of which must be on the same card:
+//   only then are the replies to the multi-axis queries in the order requested
+int CTigerCommHub::QueryCardAxisStatus(const vector<string>& axes, vector<bool>& busy, vector<double>& position)
+{
+   ostringstream statusCommand; statusCommand << "RS";
+   ostringstream whereCommand; whereCommand << "W";
+   for (unsigned int i=0; i<axes.size(); ++i)
+   {
+      statusCommand << " " << axes[i] << "?";
+      whereCommand << " " << axes[i];
+   }
+   string answer;
+
+   // reply is :A followed by B (busy) or N (not busy) for each axis
+   RETURN_ON_MM_ERROR ( QueryCommandPrivate(statusCommand.str(), answer) );
+   if (answer.compare(0, 2, ":A") != 0)
+      return ERR_UNRECOGNIZED_ANSWER;
+   vector<bool> cardBusy;
+   for (string::size_type i=2; i<answer.length(); ++i)
+   {
+      if (answer[i] == 'B' || answer[i] == 'N')
+         cardBusy.push_back(answer[i] == 'B');
+   }
+   if (cardBusy.size() != axes.size())
+      return ERR_UNRECOGNIZED_ANSWER;
+
+   // reply is :A followed by the position of each axis
+   RETURN_ON_MM_ERROR ( QueryCommandPrivate(whereCommand.str(), answer) );
+   vector<string> tokens;
+   CDeviceUtils::Tokenize(answer, tokens, " ");
+   if (tokens.size() != axes.size() + 1 || tokens[0].compare(":A") != 0)
+      return ERR_UNRECOGNIZED_ANSWER;
+
+   busy.insert(busy.end(), cardBusy.begin(), cardBusy.end());
+   for (unsigned int i=0; i<axes.size(); ++i)
+      position.push_back(atof(tokens[i+1].c_str()));
+   return DEVICE_OK;
+}
+
+int CTigerCommHub::OnStatusPollPeriod(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(GetStatusPollPeriodMs());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long tmp;
+      pProp->Get(tmp);
+      {
+         MMThreadGuard g(cacheLock_);
+         statusPollPeriodMs_ = tmp;
+         if (tmp <= 0)
+            sampleValid_ = false;
+      }
+      if (tmp > 0)
+         statusPoller_->Start();
+      else
+         statusPoller_->Stop();
+   }
+   return DEVICE_OK;
+}
+
+int CTigerCommHub::OnStatusMaxAge(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      MMThreadGuard g(cacheLock_);
+      pProp->Set(statusMaxAgeMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long tmp;
+      pProp->Get(tmp);
+      MMThreadGuard g(cacheLock_);
+      statusMaxAgeMs_ = tmp;
+   }
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CTigerStatusPoller implementation
+//
+void CTigerStatusPoller::Start()
+{
+   {
+      MMThreadGuard g(stopLock_);
+      if (!stop_)
+         return;
+      stop_ = false;
+   }
+   activate();
+}
+
+void CTigerStatusPoller::Stop()
+{
+   {
+      MMThreadGuard g(stopLock_);
+      if (stop_)
+         return;
+      stop_ = true;
+   }
+   wait();
+}
+
+bool CTigerStatusPoller::IsRunning()
+{
+   MMThreadGuard g(stopLock_);
+   return !stop_;
+}
+
+int CTigerStatusPoller::svc()
+{
+   while (IsRunning())
+   {
+      hub_->PollAxisStatus();  // on failure the cache just goes stale and devices query directly
+      // sleep in short slices so that Stop() doesn't have to wait out a long period
+      long remaining = hub_->GetStatusPollPeriodMs();
+      while (remaining > 0 && IsRunning())
+      {
+         long slice = min(remaining, 10L);
+         CDeviceUtils::SleepMs(slice);
+         remaining -= slice;
+      }
+   }
+   return 0;
+}
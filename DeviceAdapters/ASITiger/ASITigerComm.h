@@ -28,6 +28,31 @@
 #include "ASIHub.h"
 #include "MMDevice.h"
 #include "DeviceBase.h"
+#include "DeviceThreads.h"
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CTigerCommHub;
+
+// background thread that periodically refreshes the hub's axis status cache
+class CTigerStatusPoller : public MMDeviceThreadBase
+{
+public:
+   CTigerStatusPoller(CTigerCommHub* hub) : hub_(hub), stop_(true) { }
+   ~CTigerStatusPoller() { Stop(); }
+
+   void Start();
+   void Stop();
+   bool IsRunning();
+   int svc();
+
+private:
+   CTigerCommHub* hub_;
+   bool stop_;
+   MMThreadLock stopLock_;
+};
 
 
 ///////////////////////////////////////////////////////
@@ -48,10 +73,11 @@ class CTigerCommHub : public ASIHub
 {
 public:
    CTigerCommHub();
-   ~CTigerCommHub() { }
+   ~CTigerCommHub();
 
    // Device API
    int Initialize();
+   int Shutdown();
    bool Busy();
 
    // Hub API
@@ -59,8 +85,49 @@ public:
    MM::DeviceDetectionStatus DetectDevice();
    int DetectInstalledDevices();
 
+   // status cache (see ASIHub)
+   void RegisterStatusAxis(const string& axisLetter, const string& cardAddress, ASIStatusListener* listener);
+   void UnRegisterStatusListener(ASIStatusListener* listener);
+   bool GetCachedAxisStatus(const string& axisLetter, bool& busy, double& position);
+
+   // one status/position query for all registered axes, called by the poller
+   int PollAxisStatus();
+   long GetStatusPollPeriodMs();
+
+   // action/property handlers
+   int OnStatusPollPeriod(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStatusMaxAge    (MM::PropertyBase* pProp, MM::ActionType eAct);
+
+protected:
+   void InvalidateStatusCache();
+
 private:
    int TalkToTiger();
+   int QueryAxisStatus(vector<ASIStatusListener*>& finished);
+   int QueryCardAxisStatus(const vector<string>& axes, vector<bool>& busy, vector<double>& position);
+
+   struct AxisStatus
+   {
+      AxisStatus() : polled(false), busy(false), position(0.0) { }
+      bool polled;
+      bool busy;
+      double position;  // in controller units, as reported by the W command
+   };
+
+   CTigerStatusPoller* statusPoller_;
+   MMThreadLock cacheLock_;     // guards everything below
+   long statusPollPeriodMs_;    // 0 disables the poller
+   long statusMaxAgeMs_;        // cached values older than this are not used
+   vector<string> statusAxes_;  // polled axis letters, in query order
+   map<string, string> axisCards_;  // card address of each polled axis
+   multimap<ASIStatusListener*, string> statusListeners_;
+   map<string, AxisStatus> axisStatus_;
+   MM::MMTime sampleTime_;      // when the cached values were queried
+   bool sampleValid_;           // false until polled or if a command was sent since
+   unsigned long commandCount_; // bumped every time a device sends a command
+   ASIStatusListener* notifyingListener_;  // listener being notified, called without any lock held
+   std::thread::id notifyingThread_;       // may read the cache regardless of age while notifying
+   bool pollFailed_;            // only log the first of a run of failed polls
 };
 
 
@@ -466,6 +466,14 @@ int CXYStage::Initialize()
    SetPropertyLimits(g_VectorYPropertyName, maxSpeedY*-1 , maxSpeedY);
    UpdateProperty(g_VectorYPropertyName);
 
+   // let the hub answer Busy() and position queries from its status cache when polling
+   //   is enabled there; the multi-axis query needs RS <axis>? so firmware 2.7 or newer
+   if (FirmwareVersionAtLeast(2.7))
+   {
+      hub_->RegisterStatusAxis(axisLetterX_, addressChar_, this);
+      hub_->RegisterStatusAxis(axisLetterY_, addressChar_, this);
+   }
+
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -495,6 +503,15 @@ int CXYStage::getMinMaxSpeed(string axisLetter, double& minSpeed, double& maxSpe
 
 int CXYStage::GetPositionSteps(long& x, long& y)
 {
+   bool busyX, busyY;
+   double posX, posY;
+   if (hub_->GetCachedAxisStatus(axisLetterX_, busyX, posX) && hub_->GetCachedAxisStatus(axisLetterY_, busyY, posY))
+   {
+      x = (long)(posX/unitMultX_/stepSizeXUm_);
+      y = (long)(posY/unitMultY_/stepSizeYUm_);
+      return DEVICE_OK;
+   }
+
    ostringstream command; command.str("");
    command << "W " << axisLetterX_;
    RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
@@ -598,6 +615,11 @@ int CXYStage::Stop()
 
 bool CXYStage::Busy()
 {
+   bool busyX, busyY;
+   double pos;
+   if (hub_->GetCachedAxisStatus(axisLetterX_, busyX, pos) && hub_->GetCachedAxisStatus(axisLetterY_, busyY, pos))
+      return (busyX || busyY);
+
    ostringstream command; command.str("");
    if (FirmwareVersionAtLeast(2.7)) // can use more accurate RS <axis>?
    {
@@ -637,6 +659,14 @@ bool CXYStage::Busy()
    }
 }
 
+void CXYStage::OnMoveFinished()
+{
+   // called on the hub's polling thread, where GetPositionSteps() is always served from the cache
+   double x, y;
+   if (GetPositionUm(x, y) == DEVICE_OK)
+      OnXYStagePositionChanged(x, y);
+}
+
 int CXYStage::SetOrigin()
 {
    ostringstream command; command.str("");
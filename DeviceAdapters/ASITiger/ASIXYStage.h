@@ -29,7 +29,7 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 
-class CXYStage : public ASIPeripheralBase<CXYStageBase, CXYStage>
+class CXYStage : public ASIPeripheralBase<CXYStageBase, CXYStage>, public ASIStatusListener
 {
 public:
    CXYStage(const char* name);
@@ -40,6 +40,9 @@ public:
    int Initialize();
    bool Busy();
 
+   // ASIStatusListener
+   void OnMoveFinished();
+
    // XYStage API
    // -----------
    int Stop();
@@ -405,12 +405,26 @@ int CZStage::Initialize()
    SetPropertyLimits(g_VectorPropertyName, maxSpeed*-1, maxSpeed);
    UpdateProperty(g_VectorPropertyName);
 
+   // let the hub answer Busy() and position queries from its status cache when polling
+   //   is enabled there; the multi-axis query needs RS <axis>? so firmware 2.7 or newer
+   if (FirmwareVersionAtLeast(2.7))
+   {
+      hub_->RegisterStatusAxis(axisLetter_, addressChar_, this);
+   }
+
    initialized_ = true;
    return DEVICE_OK;
 }
 
 int CZStage::GetPositionUm(double& pos)
 {
+   bool busy;
+   if (hub_->GetCachedAxisStatus(axisLetter_, busy, pos))
+   {
+      pos = pos/unitMult_;
+      return DEVICE_OK;
+   }
+
    ostringstream command; command.str("");
    command << "W " << axisLetter_;
    RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
@@ -428,6 +442,14 @@ int CZStage::SetPositionUm(double pos)
 
 int CZStage::GetPositionSteps(long& steps)
 {
+   bool busy;
+   double pos;
+   if (hub_->GetCachedAxisStatus(axisLetter_, busy, pos))
+   {
+      steps = (long)(pos/unitMult_/stepSizeUm_);
+      return DEVICE_OK;
+   }
+
    ostringstream command; command.str("");
    command << "W " << axisLetter_;
    RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
@@ -494,6 +516,12 @@ bool CZStage::Busy()
    {
       return false;
    }
+   bool busy;
+   double pos;
+   if (hub_->GetCachedAxisStatus(axisLetter_, busy, pos))
+   {
+      return busy;
+   }
    if (FirmwareVersionAtLeast(2.7)) // can use more accurate RS <axis>?
    {
       command << "RS " << axisLetter_ << "?";
@@ -516,6 +544,14 @@ bool CZStage::Busy()
    }
 }
 
+void CZStage::OnMoveFinished()
+{
+   // called on the hub's polling thread, where GetPositionUm() is always served from the cache
+   double pos;
+   if (GetPositionUm(pos) == DEVICE_OK)
+      OnStagePositionChanged(pos);
+}
+
 int CZStage::SetOrigin()
 {
    ostringstream command; command.str("");
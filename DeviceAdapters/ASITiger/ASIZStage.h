@@ -29,7 +29,7 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 
-class CZStage : public ASIPeripheralBase<CStageBase, CZStage>
+class CZStage : public ASIPeripheralBase<CStageBase, CZStage>, public ASIStatusListener
 {
 public:
    CZStage(const char* name);
@@ -40,6 +40,9 @@ public:
    int Initialize();
    bool Busy();
 
+   // ASIStatusListener
+   void OnMoveFinished();
+
    // ZStage API
    // -----------
    int Stop();
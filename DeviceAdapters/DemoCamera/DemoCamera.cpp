@@ -31,7 +31,13 @@
 #include <algorithm>
 #include "WriteCompactTiffRGB.h"
 #include <iostream>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
+#include <mutex>
+#include <random>
+#include <thread>
 
 
 
@@ -198,6 +204,79 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
    delete pDevice;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// NoiseBandWorkers implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+* Persistent threads that fill bands of large noise frames, so that no
+* threads are started per frame. Threads are started on first need and
+* stopped when the camera is destroyed.
+*/
+class NoiseBandWorkers
+{
+public:
+   NoiseBandWorkers() : pending_(0), stopping_(false) {}
+
+   ~NoiseBandWorkers()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopping_ = true;
+      }
+      wake_.notify_all();
+      for (size_t i = 0; i < threads_.size(); ++i)
+         threads_[i].join();
+   }
+
+   // Runs all tasks, the first one on the calling thread, and waits for them
+   void Run(const std::vector<std::function<void()> >& tasks)
+   {
+      if (tasks.empty())
+         return;
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         while (threads_.size() + 1 < tasks.size())
+            threads_.push_back(std::thread(&NoiseBandWorkers::WorkerLoop, this));
+         queue_.insert(queue_.end(), tasks.begin() + 1, tasks.end());
+         pending_ += tasks.size() - 1;
+      }
+      wake_.notify_all();
+
+      tasks[0]();
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] { return pending_ == 0; });
+   }
+
+private:
+   void WorkerLoop()
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;)
+      {
+         wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+         if (queue_.empty())
+            return;
+         std::function<void()> task = queue_.front();
+         queue_.pop_front();
+         lock.unlock();
+         task();
+         lock.lock();
+         if (--pending_ == 0)
+            done_.notify_all();
+      }
+   }
+
+   std::mutex mutex_;
+   std::condition_variable wake_;
+   std::condition_variable done_;
+   std::deque<std::function<void()> > queue_;
+   std::vector<std::thread> threads_;
+   size_t pending_;
+   bool stopping_;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // CDemoCamera implementation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -243,11 +322,13 @@ CDemoCamera::CDemoCamera() :
    supportsMultiROI_(false),
    multiROIFillValue_(0),
    nComponents_(1),
+   pixelType_(g_PixelType_8bit),
    mode_(MODE_ARTIFICIAL_WAVES),
    imgManpl_(0),
    pcf_(1.0),
    photonFlux_(50.0),
-   readNoise_(2.5)
+   readNoise_(2.5),
+   shotNoiseTablePhotons_(-1.0)
 {
    memset(testProperty_,0,sizeof(testProperty_));
 
@@ -1447,6 +1528,7 @@ int CDemoCamera::OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct)
             bitDepth_ = 8;
             ret = ERR_UNKNOWN_MODE;
          }
+         pProp->Get(pixelType_);
       }
       break;
    case MM::BeforeGet:
@@ -2057,7 +2139,7 @@ void CDemoCamera::GenerateEmptyImage(ImgBuffer& img)
 *
 * Options:
 * 1. a spatial sine wave.
-* 2. Gaussian noise
+* 2. Offset plus shot and read noise
 */
 void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
 {
@@ -2072,9 +2154,8 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       {
          offset = 100;
       }
-	   double readNoiseDN = readNoise_ / pcf_;
-      AddBackgroundAndNoise(img, offset, readNoiseDN);
-      AddSignal (img, photonFlux_, exp, pcf_);
+      double readNoiseDN = readNoise_ / pcf_;
+      AddShotAndReadNoise(img, offset, photonFlux_ * exp, readNoiseDN);
       if (imgManpl_ != 0)
       {
          imgManpl_->ChangePixels(img);
@@ -2087,10 +2168,11 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
          return;
    }
 
-	//std::string pixelType;
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-   std::string pixelType(buf);
+   const std::string& pixelType = pixelType_;
+   const bool is8bit = pixelType.compare(g_PixelType_8bit) == 0;
+   const bool is16bit = pixelType.compare(g_PixelType_16bit) == 0;
+   const bool is32bit = pixelType.compare(g_PixelType_32bit) == 0 ||
+         pixelType.compare(g_PixelType_32bitRGB) == 0;
 
 	if (img.Height() == 0 || img.Width() == 0 || img.Depth() == 0)
       return;
@@ -2103,12 +2185,25 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
    double dLinePhase = 0.0;
    const double dAmp = exp;
    double cLinePhaseInc = 2.0 * lSinePeriod / 4.0 / img.Height();
+   unsigned j, k;
    if (shouldRotateImages_) {
       // Adjust the angle of the sin wave pattern based on how many images
       // we've taken, to increase the period (i.e. time between repeat images).
       cLinePhaseInc *= (((int) dPhase_ / 6) % 24) - 12;
    }
 
+   // The wave is sin(rowPhase + colPhase[k]). Expanding it as
+   // sin(rowPhase)*cos(colPhase[k]) + cos(rowPhase)*sin(colPhase[k]) lets us
+   // evaluate the trigonometric functions once per row and column instead of
+   // once per pixel, and leaves a loop the compiler can vectorize.
+   std::vector<double> colSin(imgWidth), colCos(imgWidth);
+   for (k = 0; k < imgWidth; k++)
+   {
+      double colPhase = (2.0 * lSinePeriod * k) / lPeriod;
+      colSin[k] = sin(colPhase);
+      colCos[k] = cos(colPhase);
+   }
+
    static bool debugRGB = false;
 #ifdef TIFFDEMO
 	debugRGB = true;
@@ -2129,22 +2224,22 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
 	if( saturatePixels_)
 		pixelsToSaturate = (long)(0.5 + fractionOfPixelsToDropOrSaturate_*img.Height()*imgWidth);
 
-   unsigned j, k;
-   if (pixelType.compare(g_PixelType_8bit) == 0)
+   if (is8bit)
    {
       double pedestal = 127 * exp / 100.0 * GetBinning() * GetBinning();
       unsigned char* pBuf = const_cast<unsigned char*>(img.GetPixels());
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = dAmp * sin(dPhase_ + dLinePhase);
+         const double rowCos = dAmp * cos(dPhase_ + dLinePhase);
+         unsigned char* pRow = pBuf + imgWidth*j;
          for (k=0; k<imgWidth; k++)
          {
-            long lIndex = imgWidth*j + k;
-            unsigned char val = (unsigned char) (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod))));
-            if (val > maxDrawnVal) {
-                maxDrawnVal = val;
-            }
-            *(pBuf + lIndex) = val;
+            double wave = rowSin * colCos[k] + rowCos * colSin[k];
+            pRow[k] = (unsigned char) (g_IntensityFactor_ * min(255.0, pedestal + wave));
          }
+         for (k=0; k<imgWidth; k++)
+            maxDrawnVal = max(maxDrawnVal, (double) pRow[k]);
          dLinePhase += cLinePhaseInc;
       }
 	   for(int snoise = 0; snoise < pixelsToSaturate; ++snoise)
@@ -2162,22 +2257,23 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
 		}
 
    }
-   else if (pixelType.compare(g_PixelType_16bit) == 0)
+   else if (is16bit)
    {
       double pedestal = maxValue/2 * exp / 100.0 * GetBinning() * GetBinning();
       double dAmp16 = dAmp * maxValue/255.0; // scale to behave like 8-bit
       unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = dAmp16 * sin(dPhase_ + dLinePhase);
+         const double rowCos = dAmp16 * cos(dPhase_ + dLinePhase);
+         unsigned short* pRow = pBuf + imgWidth*j;
          for (k=0; k<imgWidth; k++)
          {
-            long lIndex = imgWidth*j + k;
-            unsigned short val = (unsigned short) (g_IntensityFactor_ * min((double)maxValue, pedestal + dAmp16 * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod)));
-            if (val > maxDrawnVal) {
-                maxDrawnVal = val;
-            }
-            *(pBuf + lIndex) = val;
+            double wave = rowSin * colCos[k] + rowCos * colSin[k];
+            pRow[k] = (unsigned short) (g_IntensityFactor_ * min((double)maxValue, pedestal + wave));
          }
+         for (k=0; k<imgWidth; k++)
+            maxDrawnVal = max(maxDrawnVal, (double) pRow[k]);
          dLinePhase += cLinePhaseInc;
       }         
 	   for(int snoise = 0; snoise < pixelsToSaturate; ++snoise)
@@ -2204,10 +2300,12 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       // static unsigned int j2;
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = dAmp * sin(dPhase_ + dLinePhase);
+         const double rowCos = dAmp * cos(dPhase_ + dLinePhase);
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            double value =  (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod))));
+            double value =  (g_IntensityFactor_ * min(255.0, (pedestal + rowSin * colCos[k] + rowCos * colSin[k])));
             if (value > maxDrawnVal) {
                 maxDrawnVal = value;
             }
@@ -2272,19 +2370,24 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       for (j=0; j<img.Height(); j++)
       {
          unsigned char theBytes[4];
+         double rowSin[3], rowCos[3];
+         for (int c = 0; c < 3; c++)
+         {
+            rowSin[c] = dAmp * sin(dPhase_ + dLinePhase * (1 << c));
+            rowCos[c] = dAmp * cos(dPhase_ + dLinePhase * (1 << c));
+         }
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            double factor = (2.0 * lSinePeriod * k) / lPeriod;
-            unsigned char value0 =   (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + factor)));
+            unsigned char value0 =   (unsigned char) min(255.0, (pedestal + rowSin[0] * colCos[k] + rowCos[0] * colSin[k]));
             theBytes[0] = value0;
             if( NULL != pTmpBuffer)
                pTmp2[1] = value0;
-            unsigned char value1 =   (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase*2 + factor)));
+            unsigned char value1 =   (unsigned char) min(255.0, (pedestal + rowSin[1] * colCos[k] + rowCos[1] * colSin[k]));
             theBytes[1] = value1;
             if( NULL != pTmpBuffer)
                pTmp2[2] = value1;
-            unsigned char value2 = (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase*4 + factor)));
+            unsigned char value2 = (unsigned char) min(255.0, (pedestal + rowSin[2] * colCos[k] + rowCos[2] * colSin[k]));
             theBytes[2] = value2;
 
             if( NULL != pTmpBuffer){
@@ -2325,12 +2428,18 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       unsigned long long * pBuf = (unsigned long long*) rawBuf;
       for (j=0; j<img.Height(); j++)
       {
+         double rowSin[3], rowCos[3];
+         for (int c = 0; c < 3; c++)
+         {
+            rowSin[c] = dAmp16 * sin(dPhase_ + dLinePhase * (1 << c));
+            rowCos[c] = dAmp16 * cos(dPhase_ + dLinePhase * (1 << c));
+         }
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            unsigned long long value0 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod)));
-            unsigned long long value1 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase*2 + (2.0 * lSinePeriod * k) / lPeriod)));
-            unsigned long long value2 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase*4 + (2.0 * lSinePeriod * k) / lPeriod)));
+            unsigned long long value0 = (unsigned short) min(maxPixelValue, (pedestal + rowSin[0] * colCos[k] + rowCos[0] * colSin[k]));
+            unsigned long long value1 = (unsigned short) min(maxPixelValue, (pedestal + rowSin[1] * colCos[k] + rowCos[1] * colSin[k]));
+            unsigned long long value2 = (unsigned short) min(maxPixelValue, (pedestal + rowSin[2] * colCos[k] + rowCos[2] * colSin[k]));
             unsigned long long tval = value0+(value1<<16)+(value2<<32);
             if (tval > maxDrawnVal) {
                 maxDrawnVal = static_cast<double>(tval);
@@ -2362,14 +2471,13 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
                 for (int y = yBase; y < yBase + 20; ++y) {
                     long lIndex = imgWidth*y + x;
 
-                    if (pixelType.compare(g_PixelType_8bit) == 0) {
+                    if (is8bit) {
                         *((unsigned char*) rawBuf + lIndex) = 0;
                     }
-                    else if (pixelType.compare(g_PixelType_16bit) == 0) {
+                    else if (is16bit) {
                         *((unsigned short*) rawBuf + lIndex) = 0;
                     }
-                    else if (pixelType.compare(g_PixelType_32bit) == 0 ||
-                             pixelType.compare(g_PixelType_32bitRGB) == 0) {
+                    else if (is32bit) {
                         *((unsigned int*) rawBuf + lIndex) = 0;
                     }
                 }
@@ -2390,14 +2498,13 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
                 // Draw one pixel at a time of the segment.
                 for (int pixNum = 0; pixNum < 8 * (xStep + 1); ++pixNum) {
                     long lIndex = imgWidth * (yStart + pixNum * yStep) + (xStart + pixNum * xStep);
-                    if (pixelType.compare(g_PixelType_8bit) == 0) {
+                    if (is8bit) {
                         *((unsigned char*) rawBuf + lIndex) = static_cast<unsigned char>(maxDrawnVal);
                     }
-                    else if (pixelType.compare(g_PixelType_16bit) == 0) {
+                    else if (is16bit) {
                         *((unsigned short*) rawBuf + lIndex) = static_cast<unsigned short>(maxDrawnVal);
                     }
-                    else if (pixelType.compare(g_PixelType_32bit) == 0 ||
-                             pixelType.compare(g_PixelType_32bitRGB) == 0) {
+                    else if (is32bit) {
                         *((unsigned int*) rawBuf + lIndex) = static_cast<unsigned int>(maxDrawnVal);
                     }
                 }
@@ -2434,16 +2541,15 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
             {
                // Blank the pixel.
                long lIndex = imgWidth * j + i;
-               if (pixelType.compare(g_PixelType_8bit) == 0)
+               if (is8bit)
                {
                   *((unsigned char*) rawBuf + lIndex) = static_cast<unsigned char>(multiROIFillValue_);
                }
-               else if (pixelType.compare(g_PixelType_16bit) == 0)
+               else if (is16bit)
                {
                   *((unsigned short*) rawBuf + lIndex) = static_cast<unsigned short>(multiROIFillValue_);
                }
-               else if (pixelType.compare(g_PixelType_32bit) == 0 ||
-                        pixelType.compare(g_PixelType_32bitRGB) == 0)
+               else if (is32bit)
                {
                   *((unsigned int*) rawBuf + lIndex) = static_cast<unsigned int>(multiROIFillValue_);
                }
@@ -2539,131 +2645,146 @@ void CDemoCamera::TestResourceLocking(const bool recurse)
       TestResourceLocking(false);
 }
 
-/**
-* Generate an image with offset plus noise
-*/
-void CDemoCamera::AddBackgroundAndNoise(ImgBuffer& img, double mean, double stdDev)
-{ 
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
+namespace {
 
-   int maxValue = 1 << GetBitDepth();
-   long nrPixels = img.Width() * img.Height();
-   if (pixelType.compare(g_PixelType_8bit) == 0)
+// Noise is drawn from tables of samples rather than computed per pixel. Each
+// run of pixels reads two tables at random offsets and adds the windows, each
+// scaled, so the per-pixel work is a couple of loads and multiply-adds that
+// the compiler vectorizes.
+const unsigned g_NoiseTableSize = 1 << 16;
+const unsigned g_NoiseRunLength = 1024;
+// Frames smaller than this are generated on the calling thread only
+const long g_MinPixelsPerNoiseBand = 1 << 18;
+
+// Standard normal samples
+const std::vector<float>& GaussTable()
+{
+   static const std::vector<float> table = []
    {
-      unsigned char* pBuf = (unsigned char*) const_cast<unsigned char*>(img.GetPixels());
-      for (long i = 0; i < nrPixels; i++) 
+      std::mt19937 gen(5489u);
+      std::normal_distribution<float> dist(0.0f, 1.0f);
+      std::vector<float> t(g_NoiseTableSize);
+      for (unsigned i = 0; i < g_NoiseTableSize; ++i)
+         t[i] = dist(gen);
+      return t;
+   }();
+   return table;
+}
+
+// xorshift32; only used to pick table offsets, once per run of pixels
+inline uint32_t NextRandom(uint32_t& state)
+{
+   state ^= state << 13;
+   state ^= state >> 17;
+   state ^= state << 5;
+   return state;
+}
+
+template <typename T>
+void AddNoiseBand(T* pBuf, long begin, long end, float mean,
+      const float* table1, float scale1, const float* table2, float scale2,
+      float maxValue, uint32_t seed)
+{
+   uint32_t state = seed | 1;
+   for (long i = begin; i < end; i += g_NoiseRunLength)
+   {
+      const long n = std::min<long>(g_NoiseRunLength, end - i);
+      const float* w1 = table1 + NextRandom(state) % (g_NoiseTableSize - g_NoiseRunLength);
+      const float* w2 = table2 + NextRandom(state) % (g_NoiseTableSize - g_NoiseRunLength);
+      T* p = pBuf + i;
+      for (long k = 0; k < n; ++k)
       {
-         double value = GaussDistributedValue(mean, stdDev);
-         if (value < 0) 
-         {
-            value = 0;
-         }
-         else if (value > maxValue)
-         {
-            value = maxValue;
-         }
-         *(pBuf + i) = (unsigned char) value;
+         float value = mean + scale1 * w1[k] + scale2 * w2[k];
+         p[k] = static_cast<T>(std::min(std::max(value, 0.0f), maxValue));
       }
    }
-   else if (pixelType.compare(g_PixelType_16bit) == 0)
+}
+
+// Splits large frames into bands that are filled concurrently
+template <typename T>
+void AddNoiseBands(NoiseBandWorkers& workers, T* pBuf, long nrPixels,
+      float mean, const float* table1, float scale1,
+      const float* table2, float scale2, float maxValue, uint32_t seed)
+{
+   long nrBands = std::min<long>(std::max(1u, std::thread::hardware_concurrency()),
+         nrPixels / g_MinPixelsPerNoiseBand);
+   if (nrBands <= 1)
    {
-      unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
-      for (long i = 0; i < nrPixels; i++) 
+      AddNoiseBand(pBuf, 0, nrPixels, mean, table1, scale1, table2, scale2,
+            maxValue, seed);
+      return;
+   }
+
+   long bandSize = (nrPixels / nrBands + g_NoiseRunLength - 1) / g_NoiseRunLength * g_NoiseRunLength;
+   std::vector<std::function<void()> > bands;
+   for (long begin = 0; begin < nrPixels; begin += bandSize)
+   {
+      long end = std::min(begin + bandSize, nrPixels);
+      uint32_t bandSeed = begin == 0 ? seed : seed ^ (uint32_t)(begin * 2654435761u);
+      bands.push_back([=]
       {
-         double value = GaussDistributedValue(mean, stdDev);
-         if (value < 0) 
-         {
-            value = 0;
-         }
-         else if (value > maxValue)
-         {
-            value = maxValue;
-         }
-         *(pBuf + i) = (unsigned short) value;
-      }
+         AddNoiseBand(pBuf, begin, end, mean, table1, scale1, table2, scale2,
+               maxValue, bandSeed);
+      });
    }
+   workers.Run(bands);
 }
 
+} // anonymous namespace
 
 /**
-* Adds signal to an image
-* Assume a homogenuous illumination
-* Calculates the signal for each pixel individually as:
-* photon flux * exposure time / conversion factor
-* Assumes QE of 100%
+* Sets every pixel to the offset plus the signal of the given mean number of
+* photons (at 100% QE), with Poisson distributed shot noise and Gaussian
+* read noise, clipped to the bit depth.
+* Only 8 and 16 bit grayscale images are supported.
 */
-void CDemoCamera::AddSignal(ImgBuffer& img, double photonFlux, double exp, double cf)
-{ 
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
-
-   int maxValue = (1 << GetBitDepth()) -1;
+void CDemoCamera::AddShotAndReadNoise(ImgBuffer& img, double offset,
+      double photons, double readNoiseDN)
+{
+   float maxValue = (float)((1 << GetBitDepth()) - 1);
    long nrPixels = img.Width() * img.Height();
-   double photons = photonFlux * exp;
-   double shotNoise = sqrt(photons);
-   double digitalValue = photons / cf;
-   double shotNoiseDigital = shotNoise / cf;
-   if (pixelType.compare(g_PixelType_8bit) == 0)
+   float mean = (float)(offset + std::max(0.0, photons) / pcf_);
+   const float* shotNoise = ShotNoiseTable(photons).data();
+   const float* readNoise = GaussTable().data();
+   // Seed from rand() so that srand() keeps the output reproducible
+   uint32_t seed = (uint32_t)rand() * 2654435761u + (uint32_t)rand();
+   if (!noiseWorkers_)
+      noiseWorkers_.reset(new NoiseBandWorkers());
+   if (pixelType_.compare(g_PixelType_8bit) == 0)
    {
-      unsigned char* pBuf = (unsigned char*) const_cast<unsigned char*>(img.GetPixels());
-      for (long i = 0; i < nrPixels; i++) 
-      {
-         double value = *(pBuf + i) + GaussDistributedValue(digitalValue, shotNoiseDigital);
-         if (value < 0) 
-         {
-            value = 0;
-         }
-         else if (value > maxValue)
-         {
-            value = maxValue;
-         }
-         *(pBuf + i) =  (unsigned char) value;
-      }
+      AddNoiseBands(*noiseWorkers_, img.GetPixelsRW(), nrPixels, mean,
+            shotNoise, (float)(1.0 / pcf_), readNoise, (float)readNoiseDN,
+            maxValue, seed);
    }
-   else if (pixelType.compare(g_PixelType_16bit) == 0)
+   else if (pixelType_.compare(g_PixelType_16bit) == 0)
    {
-      unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
-      for (long i = 0; i < nrPixels; i++) 
-      {
-         double value = *(pBuf + i) + GaussDistributedValue(digitalValue, shotNoiseDigital);
-         if (value < 0) 
-         {
-            value = 0;
-         }
-         else if (value > maxValue)
-         {
-            value = maxValue;
-         }
-         *(pBuf + i) = (unsigned short) value;
-      }
+      AddNoiseBands(*noiseWorkers_,
+            reinterpret_cast<unsigned short*>(img.GetPixelsRW()), nrPixels, mean,
+            shotNoise, (float)(1.0 / pcf_), readNoise, (float)readNoiseDN,
+            maxValue, seed);
    }
 }
 
-
 /**
- * Uses Marsaglia polar method to generate Gaussian distributed value.  
- * Then distributes this around mean with the desired std
- */
-double CDemoCamera::GaussDistributedValue(double mean, double std)
+* Returns Poisson distributed photon counts for the given mean, minus the
+* mean. The table is only recomputed when the mean (exposure or photon flux)
+* changes.
+*/
+const std::vector<float>& CDemoCamera::ShotNoiseTable(double photons)
 {
-   double s = 2;
-   double u = 1; // incosequential, but avoid potantial use of uninitialized value
-   double v;
-   double halfRandMax = (double) RAND_MAX / 2.0;
-   while (s >= 1 || s <= 0) 
+   if (photons != shotNoiseTablePhotons_)
    {
-      // get random values between -1 and 1
-      u = (double) rand() / halfRandMax - 1.0;
-      v = (double) rand() / halfRandMax - 1.0;
-      s = u * u + v * v;
+      shotNoiseTable_.assign(g_NoiseTableSize, 0.0f);
+      if (photons > 0.0)
+      {
+         std::mt19937 gen(5489u);
+         std::poisson_distribution<long long> dist(photons);
+         for (unsigned i = 0; i < g_NoiseTableSize; ++i)
+            shotNoiseTable_[i] = (float)((double)dist(gen) - photons);
+      }
+      shotNoiseTablePhotons_ = photons;
    }
-   double tmp = sqrt( -2 * log(s) / s);
-   double x = u * tmp;
-
-   return mean + std * x;
+   return shotNoiseTable_;
 }
 
 int CDemoCamera::RegisterImgManipulatorCallBack(ImgManipulator* imgManpl)
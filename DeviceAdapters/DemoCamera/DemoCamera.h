@@ -38,6 +38,8 @@
 #include <algorithm>
 #include <stdint.h>
 #include <future>
+#include <memory>
+#include <vector>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -113,6 +115,7 @@ private:
 //////////////////////////////////////////////////////////////////////////////
 
 class MySequenceThread;
+class NoiseBandWorkers;
 
 class CDemoCamera : public CCameraBase<CDemoCamera>  
 {
@@ -205,12 +208,6 @@ public:
    int OnReadNoise(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnCrash(MM::PropertyBase* pProp, MM::ActionType eAct);
 
-   // Special public DemoCamera methods
-   void AddBackgroundAndNoise(ImgBuffer& img, double mean, double stdDev);
-   void AddSignal(ImgBuffer& img, double photonFlux, double exp, double cf);
-   // this function replace normal_distribution in C++11
-   double GaussDistributedValue(double mean, double std);
-
    int RegisterImgManipulatorCallBack(ImgManipulator* imgManpl);
    long GetCCDXSize() { return cameraCCDXSize_; }
    long GetCCDYSize() { return cameraCCDYSize_; }
@@ -221,6 +218,9 @@ private:
    void TestResourceLocking(const bool);
    void GenerateEmptyImage(ImgBuffer& img);
    void GenerateSyntheticImage(ImgBuffer& img, double exp);
+   void AddShotAndReadNoise(ImgBuffer& img, double offset, double photons,
+         double readNoiseDN);
+   const std::vector<float>& ShotNoiseTable(double photons);
    bool GenerateColorTestPattern(ImgBuffer& img);
    int ResizeImageBuffer();
 
@@ -275,6 +275,7 @@ private:
    MMThreadLock asyncFollowerLock_;
    friend class MySequenceThread;
    int nComponents_;
+   std::string pixelType_; // cached value of the PixelType property
    MySequenceThread * thd_;
    std::future<void> fut_;
    int mode_;
@@ -282,6 +283,9 @@ private:
    double pcf_;
    double photonFlux_;
    double readNoise_;
+   std::unique_ptr<NoiseBandWorkers> noiseWorkers_;
+   std::vector<float> shotNoiseTable_; // see ShotNoiseTable()
+   double shotNoiseTablePhotons_;
 };
 
 class MySequenceThread : public MMDeviceThreadBase
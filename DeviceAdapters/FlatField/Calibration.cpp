@@ -0,0 +1,252 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Calibration.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Dark and flat calibration frames and the per-pixel
+//                correction data derived from them.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "Calibration.h"
+
+#include "CorrectionKernels.h"
+#include "TiffStack.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+std::string AverageFrame::Load(const std::string& path)
+{
+   TiffStack stack;
+   std::string err = stack.Open(path);
+   if (!err.empty())
+      return err;
+   if (stack.GetBytesPerPixel() != 1 && stack.GetBytesPerPixel() != 2)
+      return "Calibration stacks must have 8- or 16-bit pixels";
+
+   const std::size_t n = (std::size_t)stack.GetWidth() * stack.GetHeight();
+   const unsigned long frames = stack.GetFrameCount();
+   std::vector<double> sum(n, 0.0);
+   std::vector<unsigned char> frame;
+   for (unsigned long f = 0; f < frames; ++f)
+   {
+      err = stack.ReadFrame(f, frame);
+      if (!err.empty())
+         return err;
+      const unsigned char* src = frame.data();
+      if (stack.GetBytesPerPixel() == 1)
+      {
+         for (std::size_t i = 0; i < n; ++i)
+            sum[i] += src[i];
+      }
+      else
+      {
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            unsigned short v;
+            std::memcpy(&v, src + 2 * i, 2);
+            if (stack.NeedsByteSwap())
+               v = (unsigned short)((v << 8) | (v >> 8));
+            sum[i] += v;
+         }
+      }
+   }
+
+   width = stack.GetWidth();
+   height = stack.GetHeight();
+   bytesPerPixel = stack.GetBytesPerPixel();
+   pixels.resize(n);
+   for (std::size_t i = 0; i < n; ++i)
+      pixels[i] = (float)(sum[i] / frames);
+   return std::string();
+}
+
+
+std::shared_ptr<const Calibration> Calibration::Build(const AverageFrame& dark,
+      const AverageFrame& flat, const CalibrationSettings& settings,
+      std::string& error)
+{
+   error.clear();
+   const bool useDark = settings.subtractDark && !dark.IsEmpty();
+   const bool useFlat = settings.applyFlat && !flat.IsEmpty();
+   const bool findHot = settings.hotPixelThreshold > 0 && !dark.IsEmpty();
+   if (!useDark && !useFlat && !findHot)
+      return std::shared_ptr<const Calibration>();
+
+   if (!dark.IsEmpty() && !flat.IsEmpty() &&
+         (dark.width != flat.width || dark.height != flat.height ||
+          dark.bytesPerPixel != flat.bytesPerPixel))
+   {
+      error = "The dark and flat stacks differ in image size or pixel type";
+      return std::shared_ptr<const Calibration>();
+   }
+
+   const AverageFrame& geometry = dark.IsEmpty() ? flat : dark;
+   std::shared_ptr<Calibration> cal = std::make_shared<Calibration>();
+   cal->width_ = geometry.width;
+   cal->height_ = geometry.height;
+   cal->bytesPerPixel_ = geometry.bytesPerPixel;
+   cal->subtract_ = useDark;
+
+   const std::size_t n = (std::size_t)cal->width_ * cal->height_;
+   const float maxValue = cal->bytesPerPixel_ == 1 ? 255.0f : 65535.0f;
+   cal->dark_.assign(n * cal->bytesPerPixel_, 0);
+   if (useDark)
+   {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+         const float v = std::min(maxValue, std::floor(dark.pixels[i] + 0.5f));
+         if (cal->bytesPerPixel_ == 1)
+            cal->dark_[i] = (unsigned char)v;
+         else
+            reinterpret_cast<unsigned short*>(cal->dark_.data())[i] = (unsigned short)v;
+      }
+   }
+
+   std::vector<bool> defective(n, false);
+   if (findHot)
+   {
+      std::vector<float> sorted(dark.pixels);
+      std::nth_element(sorted.begin(), sorted.begin() + n / 2, sorted.end());
+      const float limit = sorted[n / 2] + settings.hotPixelThreshold;
+      for (std::size_t i = 0; i < n; ++i)
+         defective[i] = dark.pixels[i] > limit;
+   }
+
+   if (useFlat)
+   {
+      // The flat's signal is measured above the dark level whenever there
+      // is a dark frame, even if the images are not dark-subtracted
+      std::vector<double> signal(n);
+      double total = 0.0;
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+         signal[i] = flat.pixels[i] - (dark.IsEmpty() ? 0.0f : dark.pixels[i]);
+         if (signal[i] > 0.0 && !defective[i])
+         {
+            total += signal[i];
+            ++count;
+         }
+      }
+      if (count == 0)
+      {
+         error = "The flat stack has no signal above the dark level";
+         return std::shared_ptr<const Calibration>();
+      }
+
+      // Normalized to the mean, so that the corrected image keeps its level.
+      // Pixels whose gain is out of range are treated as defective.
+      const double mean = total / count;
+      cal->gain_.resize(n);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+         const double gain = signal[i] > 0.0 ?
+            std::floor(mean / signal[i] * CorrectionKernels::UnityGain + 0.5) : 0.0;
+         if (gain <= 0.0 || gain > 65535.0)
+         {
+            defective[i] = true;
+            cal->gain_[i] = CorrectionKernels::UnityGain;
+         }
+         else
+         {
+            cal->gain_[i] = (unsigned short)gain;
+         }
+      }
+   }
+
+   const unsigned w = cal->width_;
+   for (std::size_t i = 0; i < n; ++i)
+   {
+      if (!defective[i])
+         continue;
+      const std::size_t rowStart = i - i % w;
+      HotPixel hot;
+      hot.index = (uint32_t)i;
+      hot.left = 0;
+      hot.right = 0;
+      for (std::size_t j = i; j > rowStart; --j)
+      {
+         if (!defective[j - 1])
+         {
+            hot.left = (int32_t)(j - 1) - (int32_t)i;
+            break;
+         }
+      }
+      for (std::size_t j = i + 1; j < rowStart + w; ++j)
+      {
+         if (!defective[j])
+         {
+            hot.right = (int32_t)(j - i);
+            break;
+         }
+      }
+      cal->hotPixels_.push_back(hot);
+   }
+
+   if (!useDark && !useFlat && cal->hotPixels_.empty())
+      return std::shared_ptr<const Calibration>();
+   return cal;
+}
+
+
+void Calibration::Apply(unsigned char* image, unsigned firstRow,
+      unsigned endRow) const
+{
+   const std::size_t begin = (std::size_t)firstRow * width_;
+   const std::size_t end = (std::size_t)endRow * width_;
+   const unsigned short* gain = gain_.empty() ? 0 : gain_.data() + begin;
+   const bool arithmetic = subtract_ || gain;
+
+   if (bytesPerPixel_ == 1)
+   {
+      if (arithmetic)
+         CorrectionKernels::Correct8(image + begin, dark_.data() + begin, gain,
+               end - begin);
+      ReplaceHotPixels(image, begin, end);
+   }
+   else
+   {
+      unsigned short* pixels = reinterpret_cast<unsigned short*>(image);
+      const unsigned short* dark =
+         reinterpret_cast<const unsigned short*>(dark_.data());
+      if (arithmetic)
+         CorrectionKernels::Correct16(pixels + begin, dark + begin, gain,
+               end - begin);
+      ReplaceHotPixels(pixels, begin, end);
+   }
+}
+
+
+template <typename T>
+void Calibration::ReplaceHotPixels(T* image, std::size_t begin,
+      std::size_t end) const
+{
+   std::vector<HotPixel>::const_iterator it = std::lower_bound(
+         hotPixels_.begin(), hotPixels_.end(), begin,
+         [](const HotPixel& hot, std::size_t index) { return hot.index < index; });
+   for (; it != hotPixels_.end() && it->index < end; ++it)
+   {
+      T* p = image + it->index;
+      if (it->left && it->right)
+         *p = (T)(((unsigned)p[it->left] + p[it->right] + 1) / 2);
+      else if (it->left)
+         *p = p[it->left];
+      else if (it->right)
+         *p = p[it->right];
+   }
+}
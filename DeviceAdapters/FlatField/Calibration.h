@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Calibration.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Dark and flat calibration frames and the per-pixel
+//                correction data derived from them.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Pixel-wise mean of the frames of a calibration stack
+struct AverageFrame
+{
+   unsigned width;
+   unsigned height;
+   unsigned bytesPerPixel;
+   std::vector<float> pixels;
+
+   AverageFrame() : width(0), height(0), bytesPerPixel(0) {}
+
+   bool IsEmpty() const { return pixels.empty(); }
+
+   // Reads an uncompressed 8- or 16-bit grayscale TIFF stack. Returns an
+   // empty string on success, otherwise an error description.
+   std::string Load(const std::string& path);
+};
+
+struct CalibrationSettings
+{
+   bool subtractDark;
+   bool applyFlat;
+   // Pixels whose dark level exceeds the median by more than this are
+   // replaced by their neighbors; 0 disables the detection
+   unsigned hotPixelThreshold;
+};
+
+// Correction data for one image size and pixel type; immutable once built
+class Calibration
+{
+public:
+   // Returns null (and an empty error) if there is nothing to correct, or if
+   // the frames are unusable (with an error description).
+   static std::shared_ptr<const Calibration> Build(const AverageFrame& dark,
+         const AverageFrame& flat, const CalibrationSettings& settings,
+         std::string& error);
+
+   unsigned GetWidth() const { return width_; }
+   unsigned GetHeight() const { return height_; }
+   unsigned GetBytesPerPixel() const { return bytesPerPixel_; }
+   std::size_t GetHotPixelCount() const { return hotPixels_.size(); }
+
+   // Corrects rows [firstRow, endRow) of an image of the calibrated size.
+   // Hot pixels are replaced from their own row, so disjoint row ranges can
+   // be corrected concurrently.
+   void Apply(unsigned char* image, unsigned firstRow, unsigned endRow) const;
+
+private:
+   // Offsets (in pixels, within the row) of the nearest good neighbors; 0 if
+   // there is none on that side
+   struct HotPixel
+   {
+      uint32_t index;
+      int32_t left;
+      int32_t right;
+   };
+
+   template <typename T>
+   void ReplaceHotPixels(T* image, std::size_t begin, std::size_t end) const;
+
+   unsigned width_;
+   unsigned height_;
+   unsigned bytesPerPixel_;
+   bool subtract_;
+   std::vector<unsigned char> dark_; // Zeros if not subtracting
+   std::vector<unsigned short> gain_; // Empty if not flat-fielding
+   std::vector<HotPixel> hotPixels_; // In order of index
+};
@@ -0,0 +1,275 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CorrectionKernels.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Dark subtraction and flat-field gain kernels for 8- and
+//                16-bit images, with SIMD implementations selected at run
+//                time (through MMDevice's PixelConversion).
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "CorrectionKernels.h"
+
+#include "PixelConversion.h"
+
+#include <limits>
+
+// As in PixelConversion, the SIMD kernels are compiled for their instruction
+// set individually, so that the adapter runs on any x86 CPU
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define FLATFIELD_X86
+#  define FLATFIELD_TARGET(isa)
+#  include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+   (defined(__x86_64__) || defined(__i386__))
+#  define FLATFIELD_X86
+#  define FLATFIELD_TARGET(isa) __attribute__((target(isa)))
+#  include <immintrin.h>
+#endif
+
+
+namespace CorrectionKernels
+{
+
+namespace
+{
+
+using PixelConversion::InstructionSet;
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar implementation (also used for the tails of the SIMD kernels)
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void Correct_Scalar(T* pixels, const T* dark, const unsigned short* gain,
+      std::size_t nPixels)
+{
+   if (!gain)
+   {
+      for (std::size_t i = 0; i < nPixels; ++i)
+         pixels[i] = pixels[i] > dark[i] ? static_cast<T>(pixels[i] - dark[i]) : 0;
+      return;
+   }
+
+   const unsigned maxValue = std::numeric_limits<T>::max();
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      const unsigned d = pixels[i] > dark[i] ? pixels[i] - dark[i] : 0;
+      const unsigned q = (d * gain[i]) >> GainFractionBits;
+      pixels[i] = static_cast<T>(q < maxValue ? q : maxValue);
+   }
+}
+
+
+#ifdef FLATFIELD_X86
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE2
+///////////////////////////////////////////////////////////////////////////////
+
+FLATFIELD_TARGET("sse2")
+inline __m128i Load128(const void* p)
+{
+   return _mm_loadu_si128(static_cast<const __m128i*>(p));
+}
+
+FLATFIELD_TARGET("sse2")
+inline void Store128(void* p, __m128i v)
+{
+   _mm_storeu_si128(static_cast<__m128i*>(p), v);
+}
+
+// (d * g) >> GainFractionBits, saturated to 16 bits. The full 32-bit product
+// is split across mullo (low half) and mulhi (high half).
+FLATFIELD_TARGET("sse2")
+inline __m128i ApplyGain_SSE2(__m128i d, __m128i g)
+{
+   const __m128i lo = _mm_mullo_epi16(d, g);
+   const __m128i hi = _mm_mulhi_epu16(d, g);
+   const __m128i q = _mm_or_si128(_mm_srli_epi16(lo, GainFractionBits),
+         _mm_slli_epi16(hi, 16 - GainFractionBits));
+   const __m128i fits = _mm_cmpeq_epi16(_mm_srli_epi16(hi, GainFractionBits),
+         _mm_setzero_si128());
+   return _mm_or_si128(q, _mm_andnot_si128(fits, _mm_set1_epi16(-1)));
+}
+
+FLATFIELD_TARGET("sse2")
+void Correct16_SSE2(unsigned short* pixels, const unsigned short* dark,
+      const unsigned short* gain, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   if (gain)
+   {
+      for (; i + 8 <= nPixels; i += 8)
+      {
+         const __m128i d = _mm_subs_epu16(Load128(pixels + i), Load128(dark + i));
+         Store128(pixels + i, ApplyGain_SSE2(d, Load128(gain + i)));
+      }
+   }
+   else
+   {
+      for (; i + 8 <= nPixels; i += 8)
+         Store128(pixels + i, _mm_subs_epu16(Load128(pixels + i), Load128(dark + i)));
+   }
+   Correct_Scalar(pixels + i, dark + i, gain ? gain + i : 0, nPixels - i);
+}
+
+FLATFIELD_TARGET("sse2")
+void Correct8_SSE2(unsigned char* pixels, const unsigned char* dark,
+      const unsigned short* gain, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   if (gain)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      for (; i + 16 <= nPixels; i += 16)
+      {
+         const __m128i d = _mm_subs_epu8(Load128(pixels + i), Load128(dark + i));
+         // Products of 8-bit values fit in 12 bits after the shift, so the
+         // unsigned pack does the saturation
+         const __m128i lo = ApplyGain_SSE2(_mm_unpacklo_epi8(d, zero), Load128(gain + i));
+         const __m128i hi = ApplyGain_SSE2(_mm_unpackhi_epi8(d, zero), Load128(gain + i + 8));
+         Store128(pixels + i, _mm_packus_epi16(lo, hi));
+      }
+   }
+   else
+   {
+      for (; i + 16 <= nPixels; i += 16)
+         Store128(pixels + i, _mm_subs_epu8(Load128(pixels + i), Load128(dark + i)));
+   }
+   Correct_Scalar(pixels + i, dark + i, gain ? gain + i : 0, nPixels - i);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AVX2
+///////////////////////////////////////////////////////////////////////////////
+
+FLATFIELD_TARGET("avx2")
+inline __m256i Load256(const void* p)
+{
+   return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+
+FLATFIELD_TARGET("avx2")
+inline void Store256(void* p, __m256i v)
+{
+   _mm256_storeu_si256(static_cast<__m256i*>(p), v);
+}
+
+FLATFIELD_TARGET("avx2")
+inline __m256i ApplyGain_AVX2(__m256i d, __m256i g)
+{
+   const __m256i lo = _mm256_mullo_epi16(d, g);
+   const __m256i hi = _mm256_mulhi_epu16(d, g);
+   const __m256i q = _mm256_or_si256(_mm256_srli_epi16(lo, GainFractionBits),
+         _mm256_slli_epi16(hi, 16 - GainFractionBits));
+   const __m256i fits = _mm256_cmpeq_epi16(
+         _mm256_srli_epi16(hi, GainFractionBits), _mm256_setzero_si256());
+   return _mm256_or_si256(q, _mm256_andnot_si256(fits, _mm256_set1_epi16(-1)));
+}
+
+FLATFIELD_TARGET("avx2")
+void Correct16_AVX2(unsigned short* pixels, const unsigned short* dark,
+      const unsigned short* gain, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   if (gain)
+   {
+      for (; i + 16 <= nPixels; i += 16)
+      {
+         const __m256i d = _mm256_subs_epu16(Load256(pixels + i), Load256(dark + i));
+         Store256(pixels + i, ApplyGain_AVX2(d, Load256(gain + i)));
+      }
+   }
+   else
+   {
+      for (; i + 16 <= nPixels; i += 16)
+         Store256(pixels + i, _mm256_subs_epu16(Load256(pixels + i), Load256(dark + i)));
+   }
+   Correct16_SSE2(pixels + i, dark + i, gain ? gain + i : 0, nPixels - i);
+}
+
+FLATFIELD_TARGET("avx2")
+void Correct8_AVX2(unsigned char* pixels, const unsigned char* dark,
+      const unsigned short* gain, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   if (gain)
+   {
+      for (; i + 32 <= nPixels; i += 32)
+      {
+         const __m256i d = _mm256_subs_epu8(Load256(pixels + i), Load256(dark + i));
+         const __m256i lo = ApplyGain_AVX2(
+               _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d)), Load256(gain + i));
+         const __m256i hi = ApplyGain_AVX2(
+               _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1)), Load256(gain + i + 16));
+         // The pack works within 128-bit halves; restore the pixel order
+         Store256(pixels + i, _mm256_permute4x64_epi64(
+                  _mm256_packus_epi16(lo, hi), 0xD8));
+      }
+   }
+   else
+   {
+      for (; i + 32 <= nPixels; i += 32)
+         Store256(pixels + i, _mm256_subs_epu8(Load256(pixels + i), Load256(dark + i)));
+   }
+   Correct8_SSE2(pixels + i, dark + i, gain ? gain + i : 0, nPixels - i);
+}
+
+#endif // FLATFIELD_X86
+
+} // anonymous namespace
+
+
+void Correct8(unsigned char* pixels, const unsigned char* dark,
+      const unsigned short* gain, std::size_t nPixels)
+{
+#ifdef FLATFIELD_X86
+   const InstructionSet isa = PixelConversion::GetInstructionSet();
+   if (isa >= PixelConversion::InstructionSetAVX2)
+      return Correct8_AVX2(pixels, dark, gain, nPixels);
+   if (isa >= PixelConversion::InstructionSetSSE2)
+      return Correct8_SSE2(pixels, dark, gain, nPixels);
+#endif
+   Correct_Scalar(pixels, dark, gain, nPixels);
+}
+
+void Correct16(unsigned short* pixels, const unsigned short* dark,
+      const unsigned short* gain, std::size_t nPixels)
+{
+#ifdef FLATFIELD_X86
+   const InstructionSet isa = PixelConversion::GetInstructionSet();
+   if (isa >= PixelConversion::InstructionSetAVX2)
+      return Correct16_AVX2(pixels, dark, gain, nPixels);
+   if (isa >= PixelConversion::InstructionSetSSE2)
+      return Correct16_SSE2(pixels, dark, gain, nPixels);
+#endif
+   Correct_Scalar(pixels, dark, gain, nPixels);
+}
+
+const char* GetInstructionSetName()
+{
+   InstructionSet isa = PixelConversion::GetInstructionSet();
+#ifdef FLATFIELD_X86
+   if (isa == PixelConversion::InstructionSetSSSE3)
+      isa = PixelConversion::InstructionSetSSE2; // No SSSE3 kernels
+#else
+   isa = PixelConversion::InstructionSetScalar;
+#endif
+   return PixelConversion::GetInstructionSetName(isa);
+}
+
+} // namespace CorrectionKernels
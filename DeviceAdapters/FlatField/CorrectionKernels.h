@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CorrectionKernels.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Dark subtraction and flat-field gain kernels for 8- and
+//                16-bit images, with SIMD implementations selected at run
+//                time (through MMDevice's PixelConversion).
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+
+namespace CorrectionKernels
+{
+
+// Gains are unsigned fixed-point numbers with this many fractional bits, so
+// they range from 0 to just under 16
+const unsigned GainFractionBits = 12;
+const unsigned short UnityGain = 1 << GainFractionBits;
+
+// For each pixel: p = min(max, (max(p - dark, 0) * gain) >> GainFractionBits),
+// where max is the largest value of the pixel type. Without gains (null),
+// only the dark frame is subtracted. All implementations give identical
+// results.
+void Correct8(unsigned char* pixels, const unsigned char* dark,
+      const unsigned short* gain, std::size_t nPixels);
+void Correct16(unsigned short* pixels, const unsigned short* dark,
+      const unsigned short* gain, std::size_t nPixels);
+
+// Name of the instruction set used by the kernels
+const char* GetInstructionSetName();
+
+} // namespace CorrectionKernels
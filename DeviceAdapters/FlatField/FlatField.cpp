@@ -0,0 +1,375 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FlatField.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image processor applying dark subtraction, flat-field
+//                normalization and hot pixel replacement to every image,
+//                using calibration stacks loaded from disk.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FlatField.h"
+
+#include "CorrectionKernels.h"
+#include "ModuleInterface.h"
+#include "TaskSet_FlatField.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+#include <utility>
+
+const char* g_FlatFieldName = "FlatFieldCorrection";
+
+const char* g_Prop_DarkFile = "DarkFile";
+const char* g_Prop_FlatFile = "FlatFile";
+const char* g_Prop_SubtractDark = "SubtractDark";
+const char* g_Prop_ApplyFlat = "ApplyFlatField";
+const char* g_Prop_HotPixelThreshold = "HotPixelThreshold";
+const char* g_Prop_HotPixelCount = "HotPixelCount";
+const char* g_Prop_CalibrationSize = "CalibrationImageSize";
+const char* g_Prop_InstructionSet = "InstructionSet";
+const char* g_Prop_Threads = "Threads";
+
+const char* g_Yes = "Yes";
+const char* g_No = "No";
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Exported MMDevice API
+///////////////////////////////////////////////////////////////////////////////
+
+MODULE_API void InitializeModuleData()
+{
+   RegisterDevice(g_FlatFieldName, MM::ImageProcessorDevice,
+         "Dark subtraction, flat-field and hot pixel correction");
+}
+
+MODULE_API MM::Device* CreateDevice(const char* deviceName)
+{
+   if (deviceName == 0)
+      return 0;
+   if (strcmp(deviceName, g_FlatFieldName) == 0)
+      return new FlatFieldCorrection();
+   return 0;
+}
+
+MODULE_API void DeleteDevice(MM::Device* pDevice)
+{
+   delete pDevice;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FlatFieldCorrection implementation
+///////////////////////////////////////////////////////////////////////////////
+
+FlatFieldCorrection::FlatFieldCorrection() :
+   initialized_(false)
+{
+   settings_.subtractDark = true;
+   settings_.applyFlat = true;
+   settings_.hotPixelThreshold = 0;
+
+   InitializeDefaultErrorMessages();
+   SetErrorText(ERR_FLATFIELD_LOAD_FAILED, "Failed to load the calibration stack");
+   SetErrorText(ERR_FLATFIELD_INVALID_CALIBRATION, "The calibration stacks cannot be used");
+   SetErrorText(ERR_FLATFIELD_SIZE_MISMATCH,
+         "The image size or pixel type differs from the calibration stacks");
+}
+
+FlatFieldCorrection::~FlatFieldCorrection()
+{
+   Shutdown();
+}
+
+void FlatFieldCorrection::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_FlatFieldName);
+}
+
+int FlatFieldCorrection::Initialize()
+{
+   if (initialized_)
+      return DEVICE_OK;
+
+   pool_ = std::make_shared<ThreadPool>();
+   idleTasks_.emplace_back(new TaskSet_FlatField(pool_));
+
+   // Uncompressed TIFF stacks (e.g. as saved by Micro-Manager); the frames
+   // of each stack are averaged. Empty to clear.
+   CPropertyAction* pAct = new CPropertyAction(this, &FlatFieldCorrection::OnDarkFile);
+   int ret = CreateStringProperty(g_Prop_DarkFile, "", false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &FlatFieldCorrection::OnFlatFile);
+   ret = CreateStringProperty(g_Prop_FlatFile, "", false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &FlatFieldCorrection::OnSubtractDark);
+   ret = CreateStringProperty(g_Prop_SubtractDark, g_Yes, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue(g_Prop_SubtractDark, g_Yes);
+   AddAllowedValue(g_Prop_SubtractDark, g_No);
+
+   pAct = new CPropertyAction(this, &FlatFieldCorrection::OnApplyFlat);
+   ret = CreateStringProperty(g_Prop_ApplyFlat, g_Yes, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue(g_Prop_ApplyFlat, g_Yes);
+   AddAllowedValue(g_Prop_ApplyFlat, g_No);
+
+   // Dark level above the median that makes a pixel hot; 0 disables hot
+   // pixel replacement. Pixels without usable flat-field signal are always
+   // replaced when flat-fielding.
+   pAct = new CPropertyAction(this, &FlatFieldCorrection::OnHotPixelThreshold);
+   ret = CreateIntegerProperty(g_Prop_HotPixelThreshold, 0, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_Prop_HotPixelThreshold, 0, 65535);
+
+   pAct = new CPropertyAction(this, &FlatFieldCorrection::OnHotPixelCount);
+   ret = CreateIntegerProperty(g_Prop_HotPixelCount, 0, true, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &FlatFieldCorrection::OnCalibrationSize);
+   ret = CreateStringProperty(g_Prop_CalibrationSize, "", true, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   ret = CreateStringProperty(g_Prop_InstructionSet,
+         CorrectionKernels::GetInstructionSetName(), true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   ret = CreateIntegerProperty(g_Prop_Threads, (long)pool_->GetSize(), true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::Shutdown()
+{
+   if (!initialized_)
+      return DEVICE_OK;
+
+   {
+      // Task sets in use keep the pool alive until they are released
+      std::lock_guard<std::mutex> lock(tasksMutex_);
+      idleTasks_.clear();
+      pool_.reset();
+   }
+   {
+      std::lock_guard<std::mutex> lock(calibrationMutex_);
+      calibration_.reset();
+   }
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::Process(unsigned char* buffer, unsigned width,
+      unsigned height, unsigned byteDepth)
+{
+   std::shared_ptr<const Calibration> calibration = GetCalibration();
+   if (!calibration)
+      return DEVICE_OK;
+
+   if (width != calibration->GetWidth() || height != calibration->GetHeight() ||
+         byteDepth != calibration->GetBytesPerPixel())
+      return ERR_FLATFIELD_SIZE_MISMATCH;
+
+   std::unique_ptr<TaskSet_FlatField> tasks = AcquireTasks();
+   if (!tasks)
+      return DEVICE_NOT_CONNECTED;
+   tasks->Correct(buffer, *calibration);
+   ReleaseTasks(std::move(tasks));
+   return DEVICE_OK;
+}
+
+std::shared_ptr<const Calibration> FlatFieldCorrection::GetCalibration()
+{
+   std::lock_guard<std::mutex> lock(calibrationMutex_);
+   return calibration_;
+}
+
+// Returns an idle task set, or a new one if all are in use; null after
+// Shutdown()
+std::unique_ptr<TaskSet_FlatField> FlatFieldCorrection::AcquireTasks()
+{
+   std::lock_guard<std::mutex> lock(tasksMutex_);
+   if (!pool_)
+      return std::unique_ptr<TaskSet_FlatField>();
+   if (idleTasks_.empty())
+      return std::unique_ptr<TaskSet_FlatField>(new TaskSet_FlatField(pool_));
+   std::unique_ptr<TaskSet_FlatField> tasks = std::move(idleTasks_.back());
+   idleTasks_.pop_back();
+   return tasks;
+}
+
+void FlatFieldCorrection::ReleaseTasks(std::unique_ptr<TaskSet_FlatField> tasks)
+{
+   std::lock_guard<std::mutex> lock(tasksMutex_);
+   if (pool_)
+      idleTasks_.push_back(std::move(tasks));
+}
+
+// Rebuilds the correction data after a change of stacks or settings; images
+// pass through unchanged if it fails
+int FlatFieldCorrection::UpdateCalibration()
+{
+   std::string err;
+   std::shared_ptr<const Calibration> calibration =
+      Calibration::Build(dark_, flat_, settings_, err);
+   {
+      std::lock_guard<std::mutex> lock(calibrationMutex_);
+      calibration_ = calibration;
+   }
+
+   if (!err.empty())
+   {
+      SetErrorText(ERR_FLATFIELD_INVALID_CALIBRATION, err.c_str());
+      return ERR_FLATFIELD_INVALID_CALIBRATION;
+   }
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int FlatFieldCorrection::OnFile(MM::PropertyBase* pProp, MM::ActionType eAct,
+      std::string& path, AverageFrame& frame)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(path.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string newPath;
+      pProp->Get(newPath);
+      AverageFrame loaded;
+      if (!newPath.empty())
+      {
+         const std::string err = loaded.Load(newPath);
+         if (!err.empty())
+         {
+            pProp->Set(path.c_str());
+            SetErrorText(ERR_FLATFIELD_LOAD_FAILED,
+                  ("Failed to load calibration stack " + newPath + ": " + err).c_str());
+            return ERR_FLATFIELD_LOAD_FAILED;
+         }
+      }
+      path = newPath;
+      frame.pixels.swap(loaded.pixels);
+      frame.width = loaded.width;
+      frame.height = loaded.height;
+      frame.bytesPerPixel = loaded.bytesPerPixel;
+      return UpdateCalibration();
+   }
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::OnDarkFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   return OnFile(pProp, eAct, darkFile_, dark_);
+}
+
+int FlatFieldCorrection::OnFlatFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   return OnFile(pProp, eAct, flatFile_, flat_);
+}
+
+int FlatFieldCorrection::OnSubtractDark(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(settings_.subtractDark ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      settings_.subtractDark = (value == g_Yes);
+      return UpdateCalibration();
+   }
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::OnApplyFlat(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(settings_.applyFlat ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      settings_.applyFlat = (value == g_Yes);
+      return UpdateCalibration();
+   }
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::OnHotPixelThreshold(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)settings_.hotPixelThreshold);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long value;
+      pProp->Get(value);
+      settings_.hotPixelThreshold = (unsigned)value;
+      return UpdateCalibration();
+   }
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::OnHotPixelCount(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::shared_ptr<const Calibration> calibration = GetCalibration();
+      pProp->Set((long)(calibration ? calibration->GetHotPixelCount() : 0));
+   }
+   return DEVICE_OK;
+}
+
+int FlatFieldCorrection::OnCalibrationSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::shared_ptr<const Calibration> calibration = GetCalibration();
+      std::string size;
+      if (calibration)
+      {
+         size = CDeviceUtils::ConvertToString((long)calibration->GetWidth());
+         size += "x";
+         size += CDeviceUtils::ConvertToString((long)calibration->GetHeight());
+         size += calibration->GetBytesPerPixel() == 1 ? " 8bit" : " 16bit";
+      }
+      pProp->Set(size.c_str());
+   }
+   return DEVICE_OK;
+}
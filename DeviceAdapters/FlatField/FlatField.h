@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FlatField.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image processor applying dark subtraction, flat-field
+//                normalization and hot pixel replacement to every image,
+//                using calibration stacks loaded from disk.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "DeviceBase.h"
+#include "Calibration.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define ERR_FLATFIELD_LOAD_FAILED          102
+#define ERR_FLATFIELD_INVALID_CALIBRATION  103
+#define ERR_FLATFIELD_SIZE_MISMATCH        104
+
+class TaskSet_FlatField;
+class ThreadPool;
+
+class FlatFieldCorrection : public CImageProcessorBase<FlatFieldCorrection>
+{
+public:
+   FlatFieldCorrection();
+   ~FlatFieldCorrection();
+
+   // MMDevice API
+   int Initialize();
+   int Shutdown();
+   void GetName(char* name) const;
+   bool Busy() { return false; }
+
+   // MMImageProcessor API
+   int Process(unsigned char* buffer, unsigned width, unsigned height,
+         unsigned byteDepth);
+
+   // Action handlers
+   int OnDarkFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFlatFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSubtractDark(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnApplyFlat(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHotPixelThreshold(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnHotPixelCount(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnCalibrationSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   int OnFile(MM::PropertyBase* pProp, MM::ActionType eAct,
+         std::string& path, AverageFrame& frame);
+   int UpdateCalibration();
+   std::shared_ptr<const Calibration> GetCalibration();
+   std::unique_ptr<TaskSet_FlatField> AcquireTasks();
+   void ReleaseTasks(std::unique_ptr<TaskSet_FlatField> tasks);
+
+   bool initialized_;
+   std::string darkFile_;
+   std::string flatFile_;
+   AverageFrame dark_;
+   AverageFrame flat_;
+   CalibrationSettings settings_;
+
+   std::mutex calibrationMutex_;
+   std::shared_ptr<const Calibration> calibration_; // Null: pass through
+
+   // A task set corrects one image at a time; concurrent Process calls each
+   // check out their own, all sharing the pool
+   std::mutex tasksMutex_;
+   std::shared_ptr<ThreadPool> pool_;
+   std::vector<std::unique_ptr<TaskSet_FlatField> > idleTasks_;
+};
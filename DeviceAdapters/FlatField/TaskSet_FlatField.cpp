@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TaskSet_FlatField.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Applies the flat-field calibration to horizontal strips of
+//                an image in parallel on the thread pool.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TaskSet_FlatField.h"
+
+#include "Calibration.h"
+
+#include <algorithm>
+#include <cassert>
+
+TaskSet_FlatField::ATask::ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount)
+    : Task(semDone, taskIndex, totalTaskCount)
+{
+}
+
+void TaskSet_FlatField::ATask::SetUp(unsigned char* image, const Calibration* calibration, size_t usedTaskCount)
+{
+    image_ = image;
+    calibration_ = calibration;
+    usedTaskCount_ = usedTaskCount;
+}
+
+void TaskSet_FlatField::ATask::Execute()
+{
+    if (taskIndex_ >= usedTaskCount_)
+        return;
+
+    const size_t height = calibration_->GetHeight();
+    const unsigned firstRow = static_cast<unsigned>(height * taskIndex_ / usedTaskCount_);
+    const unsigned endRow = static_cast<unsigned>(height * (taskIndex_ + 1) / usedTaskCount_);
+    calibration_->Apply(image_, firstRow, endRow);
+}
+
+TaskSet_FlatField::TaskSet_FlatField(std::shared_ptr<ThreadPool> pool)
+    : TaskSet(pool)
+{
+    CreateTasks<ATask>();
+}
+
+void TaskSet_FlatField::SetUp(unsigned char* image, const Calibration& calibration)
+{
+    assert(image);
+
+    // Correct small frames directly without threading, otherwise add one
+    // task for each 1MB, as for memory copies
+    const size_t bytes = static_cast<size_t>(calibration.GetWidth()) *
+        calibration.GetHeight() * calibration.GetBytesPerPixel();
+    usedTaskCount_ = std::min<size_t>(1 + bytes / 1000000, tasks_.size());
+    usedTaskCount_ = std::min<size_t>(usedTaskCount_, calibration.GetHeight());
+    if (usedTaskCount_ <= 1)
+    {
+        usedTaskCount_ = 1;
+        calibration.Apply(image, 0, calibration.GetHeight());
+        return;
+    }
+
+    for (Task* task : tasks_)
+        static_cast<ATask*>(task)->SetUp(image, &calibration, usedTaskCount_);
+}
+
+void TaskSet_FlatField::Execute()
+{
+    if (usedTaskCount_ == 1)
+        return; // Already done in SetUp, nothing to execute
+
+    TaskSet::Execute();
+}
+
+void TaskSet_FlatField::Wait()
+{
+    if (usedTaskCount_ == 1)
+        return; // Already done in SetUp, nothing to wait for
+
+    semaphore_->Wait(usedTaskCount_);
+}
+
+void TaskSet_FlatField::Correct(unsigned char* image, const Calibration& calibration)
+{
+    SetUp(image, calibration);
+    Execute();
+    Wait();
+}
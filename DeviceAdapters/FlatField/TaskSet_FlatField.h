@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TaskSet_FlatField.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Applies the flat-field calibration to horizontal strips of
+//                an image in parallel on the thread pool.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "TaskSet.h"
+
+class Calibration;
+
+class TaskSet_FlatField : public TaskSet
+{
+private:
+    class ATask : public Task
+    {
+    public:
+        explicit ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount);
+
+        void SetUp(unsigned char* image, const Calibration* calibration, size_t usedTaskCount);
+
+        virtual void Execute() override;
+
+    private:
+        unsigned char* image_{ nullptr };
+        const Calibration* calibration_{ nullptr };
+    };
+
+public:
+    explicit TaskSet_FlatField(std::shared_ptr<ThreadPool> pool);
+
+    void SetUp(unsigned char* image, const Calibration& calibration);
+
+    virtual void Execute() override;
+    virtual void Wait() override;
+
+    // Helper blocking method calling SetUp, Execute and Wait
+    void Correct(unsigned char* image, const Calibration& calibration);
+};
@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TiffStack.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Frame-by-frame reader for the uncompressed grayscale TIFF
+//                stacks used as calibration data.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TiffStack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+namespace {
+
+enum {
+   TIFF_TAG_IMAGEWIDTH = 256,
+   TIFF_TAG_IMAGELENGTH = 257,
+   TIFF_TAG_BITSPERSAMPLE = 258,
+   TIFF_TAG_COMPRESSION = 259,
+   TIFF_TAG_STRIPOFFSETS = 273,
+   TIFF_TAG_SAMPLESPERPIXEL = 277,
+   TIFF_TAG_STRIPBYTECOUNTS = 279,
+};
+
+enum {
+   TIFF_TYPE_SHORT = 3,
+   TIFF_TYPE_LONG = 4,
+};
+
+bool HostIsBigEndian()
+{
+   const unsigned short probe = 1;
+   return *reinterpret_cast<const unsigned char*>(&probe) == 0;
+}
+
+} // anonymous namespace
+
+
+TiffStack::TiffStack() :
+   size_(0),
+   bigEndian_(false),
+   width_(0),
+   height_(0),
+   bytesPerPixel_(0),
+   swapBytes_(false)
+{
+}
+
+
+std::string TiffStack::Open(const std::string& path)
+{
+   frameStrips_.clear();
+   file_.close();
+   file_.clear();
+   file_.open(path.c_str(), std::ios::in | std::ios::binary);
+   if (!file_)
+      return "Cannot open " + path;
+   file_.seekg(0, std::ios::end);
+   size_ = (std::size_t)file_.tellg();
+
+   std::string err = Parse();
+   if (!err.empty())
+   {
+      frameStrips_.clear();
+      file_.close();
+   }
+   return err;
+}
+
+
+std::string TiffStack::Parse()
+{
+   unsigned char header[8];
+   if (!ReadAt(0, header, sizeof(header)))
+      return "Not a TIFF file";
+   if (header[0] == 'I' && header[1] == 'I')
+      bigEndian_ = false;
+   else if (header[0] == 'M' && header[1] == 'M')
+      bigEndian_ = true;
+   else
+      return "Not a TIFF file";
+   if (U16(header + 2) == 43)
+      return "BigTIFF is not supported";
+   if (U16(header + 2) != 42)
+      return "Not a TIFF file";
+
+   std::size_t ifd = U32(header + 4);
+   std::set<std::size_t> visited;
+   std::vector<unsigned char> entries;
+   while (ifd != 0)
+   {
+      if (!visited.insert(ifd).second)
+         return "Corrupt IFD chain (loop)";
+      unsigned char count[2];
+      if (!ReadAt(ifd, count, 2))
+         return "Corrupt IFD offset";
+      const unsigned nEntries = U16(count);
+      entries.resize(nEntries * 12 + 4);
+      if (!ReadAt(ifd + 2, entries.data(), entries.size()))
+         return "Corrupt IFD";
+
+      unsigned long width = 0, height = 0, bits = 8, compression = 1, samples = 1;
+      std::vector<unsigned long> offsets, byteCounts, values;
+      for (unsigned i = 0; i < nEntries; ++i)
+      {
+         const unsigned char* entry = entries.data() + i * 12;
+         const unsigned tag = U16(entry);
+         switch (tag)
+         {
+            case TIFF_TAG_IMAGEWIDTH:
+            case TIFF_TAG_IMAGELENGTH:
+            case TIFF_TAG_BITSPERSAMPLE:
+            case TIFF_TAG_COMPRESSION:
+            case TIFF_TAG_SAMPLESPERPIXEL:
+               if (!Values(entry, values) || values.empty())
+                  return "Corrupt TIFF tag";
+               if (tag == TIFF_TAG_IMAGEWIDTH) width = values[0];
+               else if (tag == TIFF_TAG_IMAGELENGTH) height = values[0];
+               else if (tag == TIFF_TAG_BITSPERSAMPLE) bits = values[0];
+               else if (tag == TIFF_TAG_COMPRESSION) compression = values[0];
+               else samples = values[0];
+               break;
+            case TIFF_TAG_STRIPOFFSETS:
+               if (!Values(entry, offsets))
+                  return "Corrupt strip table";
+               break;
+            case TIFF_TAG_STRIPBYTECOUNTS:
+               if (!Values(entry, byteCounts))
+                  return "Corrupt strip table";
+               break;
+         }
+      }
+
+      if (compression != 1)
+         return "Compressed TIFF is not supported";
+      if (samples != 1 || (bits != 8 && bits != 16))
+         return "Only 8- and 16-bit grayscale TIFF is supported";
+      if (width == 0 || height == 0 || offsets.empty() ||
+            offsets.size() != byteCounts.size())
+         return "Missing required TIFF tags";
+
+      if (frameStrips_.empty())
+      {
+         width_ = width;
+         height_ = height;
+         bytesPerPixel_ = bits / 8;
+      }
+      else if (width != width_ || height != height_ || bits / 8 != bytesPerPixel_)
+      {
+         return "All pages must have the same size and pixel type";
+      }
+
+      const std::size_t frameBytes = (std::size_t)width_ * height_ * bytesPerPixel_;
+      StripList strips;
+      std::size_t total = 0;
+      for (std::size_t s = 0; s < offsets.size() && total < frameBytes; ++s)
+      {
+         if (offsets[s] > size_ || byteCounts[s] > size_ - offsets[s])
+            return "Truncated image data";
+         const std::size_t count = std::min<std::size_t>(byteCounts[s], frameBytes - total);
+         strips.push_back(std::make_pair((std::size_t)offsets[s], count));
+         total += count;
+      }
+      if (total < frameBytes)
+         return "Truncated image data";
+      frameStrips_.push_back(strips);
+
+      ifd = U32(entries.data() + nEntries * 12);
+   }
+
+   if (frameStrips_.empty())
+      return "No images found";
+   swapBytes_ = bytesPerPixel_ > 1 && bigEndian_ != HostIsBigEndian();
+   return std::string();
+}
+
+
+std::string TiffStack::ReadFrame(unsigned long frame,
+      std::vector<unsigned char>& pixels)
+{
+   if (frame >= frameStrips_.size())
+      return "Frame index out of range";
+   pixels.resize((std::size_t)width_ * height_ * bytesPerPixel_);
+   std::size_t pos = 0;
+   const StripList& strips = frameStrips_[frame];
+   for (StripList::const_iterator it = strips.begin(); it != strips.end(); ++it)
+   {
+      if (!ReadAt(it->first, pixels.data() + pos, it->second))
+         return "Failed to read image data";
+      pos += it->second;
+   }
+   return std::string();
+}
+
+
+bool TiffStack::ReadAt(std::size_t offset, void* dst, std::size_t len)
+{
+   if (offset > size_ || len > size_ - offset)
+      return false;
+   file_.clear();
+   file_.seekg((std::streamoff)offset);
+   file_.read(static_cast<char*>(dst), (std::streamsize)len);
+   return (std::size_t)file_.gcount() == len;
+}
+
+
+unsigned TiffStack::U16(const unsigned char* p) const
+{
+   return bigEndian_ ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+
+unsigned long TiffStack::U32(const unsigned char* p) const
+{
+   if (bigEndian_)
+      return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+   return ((unsigned long)p[3] << 24) | ((unsigned long)p[2] << 16) | ((unsigned long)p[1] << 8) | p[0];
+}
+
+
+// Reads the value array of an IFD entry (SHORT or LONG)
+bool TiffStack::Values(const unsigned char* entry, std::vector<unsigned long>& values)
+{
+   const unsigned type = U16(entry + 2);
+   const unsigned long count = U32(entry + 4);
+   const std::size_t elemSize = (type == TIFF_TYPE_SHORT) ? 2 : (type == TIFF_TYPE_LONG) ? 4 : 0;
+   if (elemSize == 0 || count > size_ / elemSize)
+      return false;
+
+   std::vector<unsigned char> raw(count * elemSize);
+   if (raw.size() <= 4)
+      std::memcpy(raw.data(), entry + 8, raw.size());
+   else if (!ReadAt(U32(entry + 8), raw.data(), raw.size()))
+      return false;
+
+   values.resize(count);
+   for (unsigned long i = 0; i < count; ++i)
+      values[i] = (elemSize == 2) ? U16(&raw[i * 2]) : U32(&raw[i * 4]);
+   return true;
+}
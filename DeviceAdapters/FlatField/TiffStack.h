@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TiffStack.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Frame-by-frame reader for the uncompressed grayscale TIFF
+//                stacks used as calibration data.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class TiffStack
+{
+public:
+   TiffStack();
+
+   // Returns an empty string on success, otherwise an error description.
+   // On error, the stack is left empty.
+   std::string Open(const std::string& path);
+
+   unsigned long GetFrameCount() const { return (unsigned long)frameStrips_.size(); }
+   unsigned GetWidth() const { return width_; }
+   unsigned GetHeight() const { return height_; }
+   unsigned GetBytesPerPixel() const { return bytesPerPixel_; }
+
+   // True if the stored byte order differs from the host's
+   bool NeedsByteSwap() const { return swapBytes_; }
+
+   // Reads the pixels of a frame in file byte order; pixels is resized to
+   // width * height * bytesPerPixel. Frames are only held one at a time.
+   std::string ReadFrame(unsigned long frame, std::vector<unsigned char>& pixels);
+
+private:
+   typedef std::vector<std::pair<std::size_t, std::size_t> > StripList;
+
+   std::string Parse();
+
+   bool ReadAt(std::size_t offset, void* dst, std::size_t len);
+   unsigned U16(const unsigned char* p) const;
+   unsigned long U32(const unsigned char* p) const;
+   bool Values(const unsigned char* entry, std::vector<unsigned long>& values);
+
+   std::ifstream file_;
+   std::size_t size_;
+   bool bigEndian_;
+
+   unsigned width_;
+   unsigned height_;
+   unsigned bytesPerPixel_;
+   bool swapBytes_;
+   std::vector<StripList> frameStrips_; // (offset, byte count) per strip
+};
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include "Calibration.h"
+#include "CorrectionKernels.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+AverageFrame Frame(unsigned width, unsigned height, unsigned bytesPerPixel,
+      float value)
+{
+   AverageFrame frame;
+   frame.width = width;
+   frame.height = height;
+   frame.bytesPerPixel = bytesPerPixel;
+   frame.pixels.assign(static_cast<std::size_t>(width) * height, value);
+   return frame;
+}
+
+CalibrationSettings Settings(bool subtractDark, bool applyFlat,
+      unsigned hotPixelThreshold)
+{
+   CalibrationSettings settings;
+   settings.subtractDark = subtractDark;
+   settings.applyFlat = applyFlat;
+   settings.hotPixelThreshold = hotPixelThreshold;
+   return settings;
+}
+
+} // anonymous namespace
+
+
+TEST(CalibrationTests, NothingToCorrect)
+{
+   std::string error;
+   EXPECT_FALSE(Calibration::Build(AverageFrame(), AverageFrame(),
+            Settings(true, true, 10), error));
+   EXPECT_TRUE(error.empty());
+
+   // A dark frame without hot pixels and without subtraction
+   EXPECT_FALSE(Calibration::Build(Frame(8, 2, 2, 100.0f), AverageFrame(),
+            Settings(false, true, 10), error));
+   EXPECT_TRUE(error.empty());
+}
+
+TEST(CalibrationTests, SizeMismatch)
+{
+   std::string error;
+   EXPECT_FALSE(Calibration::Build(Frame(8, 4, 2, 100.0f),
+            Frame(8, 3, 2, 1000.0f), Settings(true, true, 0), error));
+   EXPECT_FALSE(error.empty());
+
+   EXPECT_FALSE(Calibration::Build(Frame(8, 4, 2, 100.0f),
+            Frame(8, 4, 1, 200.0f), Settings(true, true, 0), error));
+   EXPECT_FALSE(error.empty());
+}
+
+TEST(CalibrationTests, FlatWithoutSignal)
+{
+   std::string error;
+   EXPECT_FALSE(Calibration::Build(Frame(8, 4, 2, 100.0f),
+            Frame(8, 4, 2, 100.0f), Settings(true, true, 0), error));
+   EXPECT_FALSE(error.empty());
+}
+
+TEST(CalibrationTests, GainIsNormalizedToMean)
+{
+   // Alternating flat response of 100 and 200 above a dark level of 50
+   const unsigned width = 40, height = 3;
+   AverageFrame dark = Frame(width, height, 2, 50.0f);
+   AverageFrame flat = Frame(width, height, 2, 0.0f);
+   for (std::size_t i = 0; i < flat.pixels.size(); ++i)
+      flat.pixels[i] = i % 2 ? 250.0f : 150.0f;
+
+   std::string error;
+   std::shared_ptr<const Calibration> cal = Calibration::Build(dark, flat,
+         Settings(true, true, 0), error);
+   ASSERT_TRUE(cal) << error;
+   EXPECT_EQ(width, cal->GetWidth());
+   EXPECT_EQ(height, cal->GetHeight());
+   EXPECT_EQ(2u, cal->GetBytesPerPixel());
+   EXPECT_EQ(0u, cal->GetHotPixelCount());
+
+   // An image of the flat comes out uniform at the mean signal
+   std::vector<unsigned short> image(flat.pixels.begin(), flat.pixels.end());
+   cal->Apply(reinterpret_cast<unsigned char*>(image.data()), 0, height);
+   for (std::size_t i = 0; i < image.size(); ++i)
+      ASSERT_EQ(150, image[i]) << "i = " << i;
+}
+
+TEST(CalibrationTests, RowRangesAreIndependent)
+{
+   const unsigned width = 16, height = 4;
+   AverageFrame dark = Frame(width, height, 2, 10.0f);
+   std::string error;
+   std::shared_ptr<const Calibration> cal = Calibration::Build(dark,
+         AverageFrame(), Settings(true, false, 0), error);
+   ASSERT_TRUE(cal) << error;
+
+   std::vector<unsigned short> image(width * height, 30);
+   cal->Apply(reinterpret_cast<unsigned char*>(image.data()), 1, 3);
+   for (unsigned y = 0; y < height; ++y)
+   {
+      const unsigned short expected = (y == 1 || y == 2) ? 20 : 30;
+      for (unsigned x = 0; x < width; ++x)
+         ASSERT_EQ(expected, image[y * width + x]) << x << ", " << y;
+   }
+}
+
+TEST(CalibrationTests, HotPixelsReplacedFromRowNeighbors)
+{
+   // Hot pixels at both row edges, alone in the middle, and as a pair
+   const unsigned width = 12, height = 2;
+   AverageFrame dark = Frame(width, height, 1, 10.0f);
+   const unsigned hot[] = { 0, 3, 6, 7, width - 1, width };
+   for (unsigned i : hot)
+      dark.pixels[i] = 200.0f;
+
+   std::string error;
+   std::shared_ptr<const Calibration> cal = Calibration::Build(dark,
+         AverageFrame(), Settings(true, false, 50), error);
+   ASSERT_TRUE(cal) << error;
+   EXPECT_EQ(6u, cal->GetHotPixelCount());
+
+   // After subtraction, each good pixel holds twice its column
+   std::vector<unsigned char> image(width * height);
+   for (std::size_t i = 0; i < image.size(); ++i)
+      image[i] = static_cast<unsigned char>(dark.pixels[i] + 2 * (i % width));
+   cal->Apply(image.data(), 0, height);
+
+   EXPECT_EQ(2, image[0]); // Right neighbor only
+   EXPECT_EQ(6, image[3]); // Mean of 4 and 8
+   EXPECT_EQ(13, image[6]); // Mean of the nearest good pixels, 10 and 16
+   EXPECT_EQ(13, image[7]);
+   EXPECT_EQ(20, image[width - 1]); // Left neighbor only
+   EXPECT_EQ(2, image[width]); // Not taken from the previous row
+   EXPECT_EQ(10, image[5]);
+   EXPECT_EQ(4, image[width + 2]);
+}
+
+TEST(CalibrationTests, UnusableFlatPixelsAreReplaced)
+{
+   const unsigned width = 8, height = 1;
+   AverageFrame flat = Frame(width, height, 2, 1000.0f);
+   flat.pixels[4] = 0.0f; // No signal
+   std::string error;
+   std::shared_ptr<const Calibration> cal = Calibration::Build(AverageFrame(),
+         flat, Settings(true, true, 0), error);
+   ASSERT_TRUE(cal) << error;
+   EXPECT_EQ(1u, cal->GetHotPixelCount());
+
+   std::vector<unsigned short> image(width, 500);
+   image[4] = 0;
+   cal->Apply(reinterpret_cast<unsigned char*>(image.data()), 0, height);
+   EXPECT_EQ(std::vector<unsigned short>(width, 500), image);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include "CorrectionKernels.h"
+#include "PixelConversion.h"
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace PixelConversion;
+
+
+namespace
+{
+
+// Sizes around the SIMD block lengths, to exercise the scalar tails
+const std::size_t testSizes[] = { 0, 1, 2, 7, 8, 9, 15, 16, 17, 31, 32, 33,
+   47, 63, 64, 65, 100, 1001 };
+
+template <typename T>
+std::vector<T> RandomValues(std::size_t n, unsigned maxValue, unsigned seed)
+{
+   std::mt19937 gen(seed);
+   std::uniform_int_distribution<unsigned> dist(0, maxValue);
+   std::vector<T> v(n);
+   for (auto& x : v)
+      x = static_cast<T>(dist(gen));
+   return v;
+}
+
+// Runs the test body at each instruction set; those not supported by this
+// CPU pass trivially
+class CorrectionKernelsTests : public ::testing::TestWithParam<InstructionSet>
+{
+protected:
+   void TearDown() override
+   {
+      SetInstructionSetLimit(InstructionSetAVX2);
+   }
+
+   // Corrects with the scalar code and with the instruction set under test.
+   // Gains span the full fixed-point range, so that many products saturate.
+   template <typename T, typename Func>
+   void CompareWithScalar(Func correct, unsigned maxValue, bool withGain)
+   {
+      if (GetParam() > GetSupportedInstructionSet())
+         return;
+      for (std::size_t n : testSizes)
+      {
+         const std::vector<T> pixels = RandomValues<T>(n, maxValue, unsigned(n));
+         const std::vector<T> dark = RandomValues<T>(n, maxValue / 4, unsigned(n) + 1);
+         const std::vector<unsigned short> gain =
+            RandomValues<unsigned short>(n, 65535, unsigned(n) + 2);
+
+         // Sentinel values catch writes past the end
+         std::vector<T> expected(pixels);
+         expected.push_back(T(0x5A));
+         std::vector<T> actual(expected);
+
+         SetInstructionSetLimit(InstructionSetScalar);
+         correct(expected.data(), dark.data(), withGain ? gain.data() : 0, n);
+         SetInstructionSetLimit(GetParam());
+         correct(actual.data(), dark.data(), withGain ? gain.data() : 0, n);
+         ASSERT_EQ(expected, actual) << "n = " << n;
+      }
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_P(CorrectionKernelsTests, Correct8)
+{
+   CompareWithScalar<unsigned char>(CorrectionKernels::Correct8, 255, true);
+}
+
+TEST_P(CorrectionKernelsTests, Correct8WithoutGain)
+{
+   CompareWithScalar<unsigned char>(CorrectionKernels::Correct8, 255, false);
+}
+
+TEST_P(CorrectionKernelsTests, Correct16)
+{
+   CompareWithScalar<unsigned short>(CorrectionKernels::Correct16, 65535, true);
+}
+
+TEST_P(CorrectionKernelsTests, Correct16WithoutGain)
+{
+   CompareWithScalar<unsigned short>(CorrectionKernels::Correct16, 65535, false);
+}
+
+TEST_P(CorrectionKernelsTests, Saturation)
+{
+   if (GetParam() > GetSupportedInstructionSet())
+      return;
+   SetInstructionSetLimit(GetParam());
+
+   const std::size_t n = 65;
+   std::vector<unsigned short> pixels16(n, 60000);
+   std::vector<unsigned short> dark16(n, 1000);
+   std::vector<unsigned short> gain(n, 2 * CorrectionKernels::UnityGain);
+   gain[n - 1] = CorrectionKernels::UnityGain / 2;
+   CorrectionKernels::Correct16(pixels16.data(), dark16.data(), gain.data(), n);
+   EXPECT_EQ(65535, pixels16[0]);
+   EXPECT_EQ(65535, pixels16[n - 2]);
+   EXPECT_EQ(29500, pixels16[n - 1]);
+
+   std::vector<unsigned char> pixels8(n, 200);
+   std::vector<unsigned char> dark8(n, 10);
+   dark8[1] = 250; // Below the dark level
+   CorrectionKernels::Correct8(pixels8.data(), dark8.data(), gain.data(), n);
+   EXPECT_EQ(255, pixels8[0]);
+   EXPECT_EQ(0, pixels8[1]);
+   EXPECT_EQ(95, pixels8[n - 1]);
+}
+
+TEST_P(CorrectionKernelsTests, UnityGainOnlySubtracts)
+{
+   if (GetParam() > GetSupportedInstructionSet())
+      return;
+   SetInstructionSetLimit(GetParam());
+
+   const std::size_t n = 33;
+   std::vector<unsigned short> pixels = RandomValues<unsigned short>(n, 65535, 7);
+   std::vector<unsigned short> dark = RandomValues<unsigned short>(n, 65535, 8);
+   std::vector<unsigned short> gain(n, CorrectionKernels::UnityGain);
+   std::vector<unsigned short> expected(n);
+   for (std::size_t i = 0; i < n; ++i)
+      expected[i] = pixels[i] > dark[i] ? pixels[i] - dark[i] : 0;
+   CorrectionKernels::Correct16(pixels.data(), dark.data(), gain.data(), n);
+   EXPECT_EQ(expected, pixels);
+}
+
+INSTANTIATE_TEST_CASE_P(AllInstructionSets, CorrectionKernelsTests,
+   ::testing::Values(InstructionSetScalar, InstructionSetSSE2,
+      InstructionSetSSSE3, InstructionSetAVX2),
+   [](const ::testing::TestParamInfo<InstructionSet>& info)
+   { return std::string(GetInstructionSetName(info.param)); });
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
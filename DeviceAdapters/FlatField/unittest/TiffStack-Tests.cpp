@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include "TiffStack.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+const char* const testFile = "TiffStack-Tests.tif";
+
+// Little-endian writer for hand-made TIFF files
+class TiffBuilder
+{
+public:
+   std::vector<unsigned char> bytes;
+
+   void U16(unsigned v)
+   {
+      bytes.push_back((unsigned char)(v & 0xff));
+      bytes.push_back((unsigned char)(v >> 8));
+   }
+
+   void U32(unsigned long v)
+   {
+      U16(v & 0xffff);
+      U16(v >> 16);
+   }
+
+   void PutU32(std::size_t offset, unsigned long v)
+   {
+      for (int i = 0; i < 4; ++i)
+         bytes[offset + i] = (unsigned char)(v >> (8 * i));
+   }
+
+   // IFD entry with one SHORT or LONG value
+   void Entry(unsigned tag, unsigned type, unsigned long value)
+   {
+      U16(tag);
+      U16(type);
+      U32(1);
+      if (type == 3)
+      {
+         U16(value);
+         U16(0);
+      }
+      else
+      {
+         U32(value);
+      }
+   }
+};
+
+// A 16-bit stack of frames filled with their index plus one. Returns the
+// offset of the last IFD's next-IFD pointer.
+std::size_t BuildStack(TiffBuilder& tiff, unsigned width, unsigned height,
+      unsigned frames, unsigned compression = 1)
+{
+   tiff.bytes.clear();
+   tiff.U16(0x4949); // "II"
+   tiff.U16(42);
+   tiff.U32(0);
+   std::size_t nextPointer = 4;
+   for (unsigned f = 0; f < frames; ++f)
+   {
+      const std::size_t dataOffset = tiff.bytes.size();
+      for (unsigned i = 0; i < width * height; ++i)
+         tiff.U16(f + 1);
+      tiff.PutU32(nextPointer, (unsigned long)tiff.bytes.size());
+      tiff.U16(7);
+      tiff.Entry(256, 3, width);
+      tiff.Entry(257, 3, height);
+      tiff.Entry(258, 3, 16);
+      tiff.Entry(259, 3, compression);
+      tiff.Entry(273, 4, (unsigned long)dataOffset);
+      tiff.Entry(277, 3, 1);
+      tiff.Entry(279, 4, width * height * 2);
+      nextPointer = tiff.bytes.size();
+      tiff.U32(0);
+   }
+   return nextPointer;
+}
+
+class TiffStackTests : public ::testing::Test
+{
+protected:
+   TiffBuilder tiff;
+
+   void TearDown() override
+   {
+      std::remove(testFile);
+   }
+
+   std::string Open(TiffStack& stack, std::size_t length = std::string::npos)
+   {
+      if (length > tiff.bytes.size())
+         length = tiff.bytes.size();
+      {
+         std::ofstream out(testFile, std::ios::out | std::ios::binary);
+         out.write(reinterpret_cast<const char*>(tiff.bytes.data()),
+               (std::streamsize)length);
+      }
+      return stack.Open(testFile);
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(TiffStackTests, ReadsFrames)
+{
+   BuildStack(tiff, 5, 3, 2);
+   TiffStack stack;
+   ASSERT_EQ("", Open(stack));
+   EXPECT_EQ(2u, stack.GetFrameCount());
+   EXPECT_EQ(5u, stack.GetWidth());
+   EXPECT_EQ(3u, stack.GetHeight());
+   EXPECT_EQ(2u, stack.GetBytesPerPixel());
+
+   std::vector<unsigned char> pixels;
+   ASSERT_EQ("", stack.ReadFrame(1, pixels));
+   ASSERT_EQ(5u * 3 * 2, pixels.size());
+   EXPECT_EQ(2, pixels[0]);
+   EXPECT_EQ(0, pixels[1]);
+   EXPECT_NE("", stack.ReadFrame(2, pixels));
+}
+
+TEST_F(TiffStackTests, MissingFile)
+{
+   TiffStack stack;
+   EXPECT_NE("", stack.Open("no-such-file.tif"));
+   EXPECT_EQ(0u, stack.GetFrameCount());
+}
+
+TEST_F(TiffStackTests, TruncatedImageData)
+{
+   BuildStack(tiff, 5, 3, 1);
+   // Claim more data than the file holds
+   tiff.PutU32(8 + 30 + 2 + 6 * 12 + 8, 1000);
+   TiffStack stack;
+   EXPECT_NE("", Open(stack));
+   EXPECT_EQ(0u, stack.GetFrameCount());
+}
+
+TEST_F(TiffStackTests, TruncatedFile)
+{
+   BuildStack(tiff, 5, 3, 2);
+   TiffStack stack;
+   for (std::size_t length = 0; length < tiff.bytes.size(); ++length)
+   {
+      EXPECT_NE("", Open(stack, length)) << "length = " << length;
+      EXPECT_EQ(0u, stack.GetFrameCount());
+   }
+}
+
+TEST_F(TiffStackTests, LoopingIFDChain)
+{
+   const std::size_t nextPointer = BuildStack(tiff, 4, 4, 2);
+   // Point the last IFD back at the first
+   tiff.PutU32(nextPointer, 8 + 32);
+   TiffStack stack;
+   EXPECT_NE("", Open(stack));
+   EXPECT_EQ(0u, stack.GetFrameCount());
+
+   // A single IFD pointing at itself
+   const std::size_t selfPointer = BuildStack(tiff, 4, 4, 1);
+   tiff.PutU32(selfPointer, 8 + 32);
+   EXPECT_NE("", Open(stack));
+}
+
+TEST_F(TiffStackTests, CompressedIsRejected)
+{
+   BuildStack(tiff, 4, 4, 1, 5); // LZW
+   TiffStack stack;
+   EXPECT_NE("", Open(stack));
+   EXPECT_EQ(0u, stack.GetFrameCount());
+}
+
+TEST_F(TiffStackTests, BigTIFFIsRejected)
+{
+   tiff.U16(0x4949);
+   tiff.U16(43);
+   tiff.U16(8);
+   tiff.U16(0);
+   tiff.U32(16);
+   tiff.U32(0);
+   TiffStack stack;
+   EXPECT_EQ("BigTIFF is not supported", Open(stack));
+}
+
+TEST_F(TiffStackTests, NotATiff)
+{
+   tiff.bytes.assign(64, 'x');
+   TiffStack stack;
+   EXPECT_NE("", Open(stack));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,465 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AccumulationKernels.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Kernels accumulating 8- and 16-bit frames into sums,
+//                maxima and running averages, with SIMD implementations
+//                selected at run time (through MMDevice's PixelConversion).
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AccumulationKernels.h"
+
+#include "PixelConversion.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// As in PixelConversion, the SIMD kernels are compiled for their instruction
+// set individually, so that the adapter runs on any x86 CPU
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define ACCUMULATOR_X86
+#  define ACCUMULATOR_TARGET(isa)
+#  include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+   (defined(__x86_64__) || defined(__i386__))
+#  define ACCUMULATOR_X86
+#  define ACCUMULATOR_TARGET(isa) __attribute__((target(isa)))
+#  include <immintrin.h>
+#endif
+
+
+namespace AccumulationKernels
+{
+
+namespace
+{
+
+using PixelConversion::InstructionSet;
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar implementation (also used for the tails of the SIMD kernels)
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void Add_Scalar(uint32_t* sum, const T* pixels, std::size_t nPixels)
+{
+   for (std::size_t i = 0; i < nPixels; ++i)
+      sum[i] += pixels[i];
+}
+
+template <typename T>
+void Divide_Scalar(T* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels)
+{
+   for (std::size_t i = 0; i < nPixels; ++i)
+      pixels[i] = static_cast<T>((sum[i] + count / 2) / count);
+}
+
+template <typename T>
+void Max_Scalar(T* maximum, const T* pixels, std::size_t nPixels)
+{
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      if (pixels[i] > maximum[i])
+         maximum[i] = pixels[i];
+   }
+}
+
+template <typename T>
+void Blend_Scalar(float* average, const T* pixels, float weight,
+      std::size_t nPixels)
+{
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      const float difference = static_cast<float>(pixels[i]) - average[i];
+      average[i] = average[i] + weight * difference;
+   }
+}
+
+// Rounds half to even, like the SIMD conversions
+template <typename T>
+void Round_Scalar(T* pixels, const float* average, std::size_t nPixels)
+{
+   const long maxValue = std::numeric_limits<T>::max();
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      const long v = std::lrint(average[i]);
+      pixels[i] = static_cast<T>(v < 0 ? 0 : (v > maxValue ? maxValue : v));
+   }
+}
+
+
+#ifdef ACCUMULATOR_X86
+
+// Multiplier for dividing by count (>= 2) with a multiplication and a shift
+// by 32 bits; exact for dividends below 2^24, which holds for sums of up to
+// MaxSumFrames 16-bit pixels
+inline uint32_t Reciprocal(unsigned count)
+{
+   return 0xFFFFFFFFu / count + 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE2
+///////////////////////////////////////////////////////////////////////////////
+
+// Loads 4 pixels as 32-bit integers
+ACCUMULATOR_TARGET("sse2")
+inline __m128i Load4_SSE2(const uint8_t* p)
+{
+   int32_t bytes;
+   std::memcpy(&bytes, p, 4);
+   const __m128i zero = _mm_setzero_si128();
+   return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+}
+
+ACCUMULATOR_TARGET("sse2")
+inline __m128i Load4_SSE2(const uint16_t* p)
+{
+   return _mm_unpacklo_epi16(
+         _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+// Stores 4 32-bit integers as pixels, saturated to the pixel range
+ACCUMULATOR_TARGET("sse2")
+inline void Store4_SSE2(uint8_t* p, __m128i v)
+{
+   const __m128i words = _mm_packs_epi32(v, v);
+   const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+   std::memcpy(p, &bytes, 4);
+}
+
+// SSE2 has no unsigned 32-to-16-bit pack; pack with a signed bias instead
+ACCUMULATOR_TARGET("sse2")
+inline void Store4_SSE2(uint16_t* p, __m128i v)
+{
+   const __m128i bias = _mm_set1_epi32(0x8000);
+   const __m128i words = _mm_packs_epi32(_mm_sub_epi32(v, bias), _mm_setzero_si128());
+   _mm_storel_epi64(reinterpret_cast<__m128i*>(p),
+         _mm_xor_si128(words, _mm_set1_epi16(-0x8000)));
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("sse2")
+void Add_SSE2(uint32_t* sum, const T* pixels, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 4 <= nPixels; i += 4)
+   {
+      __m128i* s = reinterpret_cast<__m128i*>(sum + i);
+      _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), Load4_SSE2(pixels + i)));
+   }
+   Add_Scalar(sum + i, pixels + i, nPixels - i);
+}
+
+// (x * m) >> 32 for each unsigned 32-bit lane; the multiply handles the even
+// lanes, so the odd ones are shifted down first
+ACCUMULATOR_TARGET("sse2")
+inline __m128i MulHigh_SSE2(__m128i x, __m128i m)
+{
+   const __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, m), 32);
+   const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), m);
+   return _mm_or_si128(even,
+         _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("sse2")
+void Divide_SSE2(T* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels)
+{
+   std::size_t i = 0;
+   if (count >= 2)
+   {
+      const __m128i m = _mm_set1_epi32(static_cast<int>(Reciprocal(count)));
+      const __m128i half = _mm_set1_epi32(static_cast<int>(count / 2));
+      for (; i + 4 <= nPixels; i += 4)
+      {
+         const __m128i s = _mm_add_epi32(
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + i)), half);
+         Store4_SSE2(pixels + i, MulHigh_SSE2(s, m));
+      }
+   }
+   Divide_Scalar(pixels + i, sum + i, count, nPixels - i);
+}
+
+ACCUMULATOR_TARGET("sse2")
+void Max_SSE2(uint8_t* maximum, const uint8_t* pixels, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 16 <= nPixels; i += 16)
+   {
+      __m128i* m = reinterpret_cast<__m128i*>(maximum + i);
+      const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+      _mm_storeu_si128(m, _mm_max_epu8(_mm_loadu_si128(m), p));
+   }
+   Max_Scalar(maximum + i, pixels + i, nPixels - i);
+}
+
+// SSE2 has no unsigned 16-bit maximum: max(a, b) = (a -sat b) + b
+ACCUMULATOR_TARGET("sse2")
+void Max_SSE2(uint16_t* maximum, const uint16_t* pixels, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+   {
+      __m128i* m = reinterpret_cast<__m128i*>(maximum + i);
+      const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+      _mm_storeu_si128(m, _mm_add_epi16(_mm_subs_epu16(_mm_loadu_si128(m), p), p));
+   }
+   Max_Scalar(maximum + i, pixels + i, nPixels - i);
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("sse2")
+void Blend_SSE2(float* average, const T* pixels, float weight,
+      std::size_t nPixels)
+{
+   const __m128 w = _mm_set1_ps(weight);
+   std::size_t i = 0;
+   for (; i + 4 <= nPixels; i += 4)
+   {
+      const __m128 a = _mm_loadu_ps(average + i);
+      const __m128 difference = _mm_sub_ps(_mm_cvtepi32_ps(Load4_SSE2(pixels + i)), a);
+      _mm_storeu_ps(average + i, _mm_add_ps(a, _mm_mul_ps(w, difference)));
+   }
+   Blend_Scalar(average + i, pixels + i, weight, nPixels - i);
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("sse2")
+void Round_SSE2(T* pixels, const float* average, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 4 <= nPixels; i += 4)
+      Store4_SSE2(pixels + i, _mm_cvtps_epi32(_mm_loadu_ps(average + i)));
+   Round_Scalar(pixels + i, average + i, nPixels - i);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AVX2
+///////////////////////////////////////////////////////////////////////////////
+
+// Loads 8 pixels as 32-bit integers
+ACCUMULATOR_TARGET("avx2")
+inline __m256i Load8_AVX2(const uint8_t* p)
+{
+   return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+ACCUMULATOR_TARGET("avx2")
+inline __m256i Load8_AVX2(const uint16_t* p)
+{
+   return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// Stores 8 32-bit integers as pixels, saturated to the pixel range
+ACCUMULATOR_TARGET("avx2")
+inline void Store8_AVX2(uint8_t* p, __m256i v)
+{
+   const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v),
+         _mm256_extracti128_si256(v, 1));
+   _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(words, words));
+}
+
+ACCUMULATOR_TARGET("avx2")
+inline void Store8_AVX2(uint16_t* p, __m256i v)
+{
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packus_epi32(
+            _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("avx2")
+void Add_AVX2(uint32_t* sum, const T* pixels, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+   {
+      __m256i* s = reinterpret_cast<__m256i*>(sum + i);
+      _mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), Load8_AVX2(pixels + i)));
+   }
+   Add_SSE2(sum + i, pixels + i, nPixels - i);
+}
+
+ACCUMULATOR_TARGET("avx2")
+inline __m256i MulHigh_AVX2(__m256i x, __m256i m)
+{
+   const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, m), 32);
+   const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+   return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("avx2")
+void Divide_AVX2(T* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels)
+{
+   std::size_t i = 0;
+   if (count >= 2)
+   {
+      const __m256i m = _mm256_set1_epi32(static_cast<int>(Reciprocal(count)));
+      const __m256i half = _mm256_set1_epi32(static_cast<int>(count / 2));
+      for (; i + 8 <= nPixels; i += 8)
+      {
+         const __m256i s = _mm256_add_epi32(
+               _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sum + i)), half);
+         Store8_AVX2(pixels + i, MulHigh_AVX2(s, m));
+      }
+   }
+   Divide_SSE2(pixels + i, sum + i, count, nPixels - i);
+}
+
+ACCUMULATOR_TARGET("avx2")
+void Max_AVX2(uint8_t* maximum, const uint8_t* pixels, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 32 <= nPixels; i += 32)
+   {
+      __m256i* m = reinterpret_cast<__m256i*>(maximum + i);
+      const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+      _mm256_storeu_si256(m, _mm256_max_epu8(_mm256_loadu_si256(m), p));
+   }
+   Max_SSE2(maximum + i, pixels + i, nPixels - i);
+}
+
+ACCUMULATOR_TARGET("avx2")
+void Max_AVX2(uint16_t* maximum, const uint16_t* pixels, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 16 <= nPixels; i += 16)
+   {
+      __m256i* m = reinterpret_cast<__m256i*>(maximum + i);
+      const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+      _mm256_storeu_si256(m, _mm256_max_epu16(_mm256_loadu_si256(m), p));
+   }
+   Max_SSE2(maximum + i, pixels + i, nPixels - i);
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("avx2")
+void Blend_AVX2(float* average, const T* pixels, float weight,
+      std::size_t nPixels)
+{
+   const __m256 w = _mm256_set1_ps(weight);
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+   {
+      const __m256 a = _mm256_loadu_ps(average + i);
+      const __m256 difference = _mm256_sub_ps(_mm256_cvtepi32_ps(Load8_AVX2(pixels + i)), a);
+      _mm256_storeu_ps(average + i, _mm256_add_ps(a, _mm256_mul_ps(w, difference)));
+   }
+   Blend_SSE2(average + i, pixels + i, weight, nPixels - i);
+}
+
+template <typename T>
+ACCUMULATOR_TARGET("avx2")
+void Round_AVX2(T* pixels, const float* average, std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+      Store8_AVX2(pixels + i, _mm256_cvtps_epi32(_mm256_loadu_ps(average + i)));
+   Round_SSE2(pixels + i, average + i, nPixels - i);
+}
+
+#endif // ACCUMULATOR_X86
+
+} // anonymous namespace
+
+
+#ifdef ACCUMULATOR_X86
+#  define ACCUMULATOR_DISPATCH(kernel, ...) \
+   do { \
+      const InstructionSet isa = PixelConversion::GetInstructionSet(); \
+      if (isa >= PixelConversion::InstructionSetAVX2) \
+         return kernel##_AVX2(__VA_ARGS__); \
+      if (isa >= PixelConversion::InstructionSetSSE2) \
+         return kernel##_SSE2(__VA_ARGS__); \
+      return kernel##_Scalar(__VA_ARGS__); \
+   } while (0)
+#else
+#  define ACCUMULATOR_DISPATCH(kernel, ...) return kernel##_Scalar(__VA_ARGS__)
+#endif
+
+void Add8(uint32_t* sum, const uint8_t* pixels, std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Add, sum, pixels, nPixels);
+}
+
+void Add16(uint32_t* sum, const uint16_t* pixels, std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Add, sum, pixels, nPixels);
+}
+
+void Divide8(uint8_t* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Divide, pixels, sum, count, nPixels);
+}
+
+void Divide16(uint16_t* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Divide, pixels, sum, count, nPixels);
+}
+
+void Max8(uint8_t* maximum, const uint8_t* pixels, std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Max, maximum, pixels, nPixels);
+}
+
+void Max16(uint16_t* maximum, const uint16_t* pixels, std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Max, maximum, pixels, nPixels);
+}
+
+void Blend8(float* average, const uint8_t* pixels, float weight,
+      std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Blend, average, pixels, weight, nPixels);
+}
+
+void Blend16(float* average, const uint16_t* pixels, float weight,
+      std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Blend, average, pixels, weight, nPixels);
+}
+
+void Round8(uint8_t* pixels, const float* average, std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Round, pixels, average, nPixels);
+}
+
+void Round16(uint16_t* pixels, const float* average, std::size_t nPixels)
+{
+   ACCUMULATOR_DISPATCH(Round, pixels, average, nPixels);
+}
+
+const char* GetInstructionSetName()
+{
+   InstructionSet isa = PixelConversion::GetInstructionSet();
+#ifdef ACCUMULATOR_X86
+   if (isa == PixelConversion::InstructionSetSSSE3)
+      isa = PixelConversion::InstructionSetSSE2; // No SSSE3 kernels
+#else
+   isa = PixelConversion::InstructionSetScalar;
+#endif
+   return PixelConversion::GetInstructionSetName(isa);
+}
+
+} // namespace AccumulationKernels
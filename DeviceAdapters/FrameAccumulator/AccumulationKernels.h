@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AccumulationKernels.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Kernels accumulating 8- and 16-bit frames into sums,
+//                maxima and running averages, with SIMD implementations
+//                selected at run time (through MMDevice's PixelConversion).
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// All implementations of a kernel give identical results
+namespace AccumulationKernels
+{
+
+// Sums of at most this many frames can be divided exactly
+const unsigned MaxSumFrames = 256;
+
+// sum[i] += pixels[i]
+void Add8(uint32_t* sum, const uint8_t* pixels, std::size_t nPixels);
+void Add16(uint32_t* sum, const uint16_t* pixels, std::size_t nPixels);
+
+// pixels[i] = round(sum[i] / count), for 1 <= count <= MaxSumFrames
+void Divide8(uint8_t* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels);
+void Divide16(uint16_t* pixels, const uint32_t* sum, unsigned count,
+      std::size_t nPixels);
+
+// maximum[i] = max(maximum[i], pixels[i])
+void Max8(uint8_t* maximum, const uint8_t* pixels, std::size_t nPixels);
+void Max16(uint16_t* maximum, const uint16_t* pixels, std::size_t nPixels);
+
+// average[i] += weight * (pixels[i] - average[i])
+void Blend8(float* average, const uint8_t* pixels, float weight,
+      std::size_t nPixels);
+void Blend16(float* average, const uint16_t* pixels, float weight,
+      std::size_t nPixels);
+
+// pixels[i] = round(average[i]), for averages within the pixel range
+void Round8(uint8_t* pixels, const float* average, std::size_t nPixels);
+void Round16(uint16_t* pixels, const float* average, std::size_t nPixels);
+
+// Name of the instruction set used by the kernels
+const char* GetInstructionSetName();
+
+} // namespace AccumulationKernels
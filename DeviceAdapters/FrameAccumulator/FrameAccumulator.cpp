@@ -0,0 +1,390 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameAccumulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image processor combining consecutive frames by averaging,
+//                running (exponential or Kalman) averaging or maximum
+//                projection, inserting one result per N frames.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameAccumulator.h"
+
+#include "AccumulationKernels.h"
+#include "ModuleInterface.h"
+
+#include <algorithm>
+#include <cstring>
+
+const char* g_FrameAccumulatorName = "FrameAccumulator";
+
+const char* g_Prop_Mode = "Mode";
+const char* g_Prop_Frames = "Frames";
+const char* g_Prop_OutputInterval = "OutputInterval";
+const char* g_Prop_KalmanGain = "KalmanGain";
+const char* g_Prop_AccumulatedFrames = "AccumulatedFrames";
+const char* g_Prop_InstructionSet = "InstructionSet";
+
+const char* g_Mode_Mean = "Mean";
+const char* g_Mode_Max = "Maximum projection";
+const char* g_Mode_RunningAverage = "Running average";
+const char* g_Mode_Kalman = "Kalman";
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Exported MMDevice API
+///////////////////////////////////////////////////////////////////////////////
+
+MODULE_API void InitializeModuleData()
+{
+   RegisterDevice(g_FrameAccumulatorName, MM::ImageProcessorDevice,
+         "Frame averaging and maximum projection");
+}
+
+MODULE_API MM::Device* CreateDevice(const char* deviceName)
+{
+   if (deviceName == 0)
+      return 0;
+   if (strcmp(deviceName, g_FrameAccumulatorName) == 0)
+      return new FrameAccumulator();
+   return 0;
+}
+
+MODULE_API void DeleteDevice(MM::Device* pDevice)
+{
+   delete pDevice;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FrameAccumulator implementation
+///////////////////////////////////////////////////////////////////////////////
+
+FrameAccumulator::FrameAccumulator() :
+   initialized_(false),
+   mode_(ModeMean),
+   frames_(4),
+   outputInterval_(1),
+   kalmanGain_(0.8),
+   width_(0),
+   height_(0),
+   byteDepth_(0),
+   count_(0),
+   sinceOutput_(0)
+{
+   InitializeDefaultErrorMessages();
+}
+
+FrameAccumulator::~FrameAccumulator()
+{
+   Shutdown();
+}
+
+void FrameAccumulator::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_FrameAccumulatorName);
+}
+
+int FrameAccumulator::Initialize()
+{
+   if (initialized_)
+      return DEVICE_OK;
+
+   CPropertyAction* pAct = new CPropertyAction(this, &FrameAccumulator::OnMode);
+   int ret = CreateStringProperty(g_Prop_Mode, g_Mode_Mean, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue(g_Prop_Mode, g_Mode_Mean);
+   AddAllowedValue(g_Prop_Mode, g_Mode_Max);
+   AddAllowedValue(g_Prop_Mode, g_Mode_RunningAverage);
+   AddAllowedValue(g_Prop_Mode, g_Mode_Kalman);
+
+   // Mean and maximum projection: frames combined into each inserted frame.
+   // Running average: time constant, in frames.
+   pAct = new CPropertyAction(this, &FrameAccumulator::OnFrames);
+   ret = CreateIntegerProperty(g_Prop_Frames, frames_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_Prop_Frames, 1, AccumulationKernels::MaxSumFrames);
+
+   // Running and Kalman averages are inserted once per this many frames
+   pAct = new CPropertyAction(this, &FrameAccumulator::OnOutputInterval);
+   ret = CreateIntegerProperty(g_Prop_OutputInterval, outputInterval_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_Prop_OutputInterval, 1, 1000);
+
+   // Weight of the prediction in the Kalman filter (as in ImageJ's Kalman
+   // stack filter); the average converges to an exponential one with weight
+   // 1 - KalmanGain for new frames
+   pAct = new CPropertyAction(this, &FrameAccumulator::OnKalmanGain);
+   ret = CreateFloatProperty(g_Prop_KalmanGain, kalmanGain_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_Prop_KalmanGain, 0.0, 1.0);
+
+   pAct = new CPropertyAction(this, &FrameAccumulator::OnAccumulatedFrames);
+   ret = CreateIntegerProperty(g_Prop_AccumulatedFrames, 0, true, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   ret = CreateStringProperty(g_Prop_InstructionSet,
+         AccumulationKernels::GetInstructionSetName(), true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int FrameAccumulator::Shutdown()
+{
+   if (!initialized_)
+      return DEVICE_OK;
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   Reset();
+   sum_.clear();
+   max_.clear();
+   average_.clear();
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+// Called with every frame, in order. Frames that only go into the
+// accumulator are left unchanged and not inserted; the frame completing an
+// accumulation is replaced by the result (keeping its metadata).
+int FrameAccumulator::Process(unsigned char* buffer, unsigned width,
+      unsigned height, unsigned byteDepth)
+{
+   // RGB frames are accumulated per 8-bit component
+   const unsigned bytesPerPixel = byteDepth == 4 ? 1 : byteDepth;
+   if (bytesPerPixel != 1 && bytesPerPixel != 2)
+      return DEVICE_UNSUPPORTED_DATA_FORMAT;
+   const std::size_t nPixels = std::size_t(width) * height * byteDepth / bytesPerPixel;
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (width != width_ || height != height_ || byteDepth != byteDepth_)
+   {
+      Reset();
+      width_ = width;
+      height_ = height;
+      byteDepth_ = byteDepth;
+   }
+
+   bool complete;
+   switch (mode_)
+   {
+      case ModeMean:
+         complete = AccumulateSum(buffer, nPixels, bytesPerPixel);
+         break;
+      case ModeMax:
+         complete = AccumulateMax(buffer, nPixels, bytesPerPixel);
+         break;
+      default:
+         complete = AccumulateRunning(buffer, nPixels, bytesPerPixel);
+         break;
+   }
+   return complete ? DEVICE_OK : DEVICE_IMAGE_CONSUMED;
+}
+
+// Frames left over from an earlier sequence are not combined with new ones
+int FrameAccumulator::SequenceStarting()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   Reset();
+   return DEVICE_OK;
+}
+
+// Starts a new accumulation with the next frame; requires mutex_
+void FrameAccumulator::Reset()
+{
+   count_ = 0;
+   sinceOutput_ = 0;
+}
+
+bool FrameAccumulator::AccumulateSum(unsigned char* buffer,
+      std::size_t nPixels, unsigned bytesPerPixel)
+{
+   if (count_ == 0)
+      sum_.assign(nPixels, 0);
+   if (bytesPerPixel == 1)
+      AccumulationKernels::Add8(sum_.data(), buffer, nPixels);
+   else
+      AccumulationKernels::Add16(sum_.data(),
+            reinterpret_cast<const uint16_t*>(buffer), nPixels);
+   if (++count_ < frames_)
+      return false;
+
+   if (bytesPerPixel == 1)
+      AccumulationKernels::Divide8(buffer, sum_.data(), count_, nPixels);
+   else
+      AccumulationKernels::Divide16(reinterpret_cast<uint16_t*>(buffer),
+            sum_.data(), count_, nPixels);
+   count_ = 0;
+   return true;
+}
+
+bool FrameAccumulator::AccumulateMax(unsigned char* buffer,
+      std::size_t nPixels, unsigned bytesPerPixel)
+{
+   const std::size_t bytes = nPixels * bytesPerPixel;
+   if (count_ == 0)
+      max_.assign(buffer, buffer + bytes);
+   else if (bytesPerPixel == 1)
+      AccumulationKernels::Max8(max_.data(), buffer, nPixels);
+   else
+      AccumulationKernels::Max16(reinterpret_cast<uint16_t*>(max_.data()),
+            reinterpret_cast<const uint16_t*>(buffer), nPixels);
+   if (++count_ < frames_)
+      return false;
+
+   std::memcpy(buffer, max_.data(), bytes);
+   count_ = 0;
+   return true;
+}
+
+// The running average starts as a cumulative one, so that the first frames
+// are not weighted down. Both averages are updated with every frame, and
+// inserted once per output interval.
+bool FrameAccumulator::AccumulateRunning(unsigned char* buffer,
+      std::size_t nPixels, unsigned bytesPerPixel)
+{
+   float weight = 1.0f;
+   if (count_ > 0)
+   {
+      const double cumulative = 1.0 / (count_ + 1);
+      if (mode_ == ModeKalman)
+         weight = (float)(std::min)(1.0, 1.0 - kalmanGain_ + cumulative);
+      else
+         weight = (float)(std::max)(1.0 / frames_, cumulative);
+   }
+   if (count_ == 0)
+      average_.assign(nPixels, 0.0f);
+
+   if (bytesPerPixel == 1)
+      AccumulationKernels::Blend8(average_.data(), buffer, weight, nPixels);
+   else
+      AccumulationKernels::Blend16(average_.data(),
+            reinterpret_cast<const uint16_t*>(buffer), weight, nPixels);
+   if (count_ < AccumulationKernels::MaxSumFrames)
+      ++count_;
+   if (++sinceOutput_ < outputInterval_)
+      return false;
+
+   if (bytesPerPixel == 1)
+      AccumulationKernels::Round8(buffer, average_.data(), nPixels);
+   else
+      AccumulationKernels::Round16(reinterpret_cast<uint16_t*>(buffer),
+            average_.data(), nPixels);
+   sinceOutput_ = 0;
+   return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int FrameAccumulator::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      switch (mode_)
+      {
+         case ModeMean: pProp->Set(g_Mode_Mean); break;
+         case ModeMax: pProp->Set(g_Mode_Max); break;
+         case ModeRunningAverage: pProp->Set(g_Mode_RunningAverage); break;
+         case ModeKalman: pProp->Set(g_Mode_Kalman); break;
+      }
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (value == g_Mode_Max)
+         mode_ = ModeMax;
+      else if (value == g_Mode_RunningAverage)
+         mode_ = ModeRunningAverage;
+      else if (value == g_Mode_Kalman)
+         mode_ = ModeKalman;
+      else
+         mode_ = ModeMean;
+      Reset();
+   }
+   return DEVICE_OK;
+}
+
+int FrameAccumulator::OnFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)frames_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long value;
+      pProp->Get(value);
+      std::lock_guard<std::mutex> lock(mutex_);
+      frames_ = (unsigned)value;
+      Reset();
+   }
+   return DEVICE_OK;
+}
+
+int FrameAccumulator::OnOutputInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)outputInterval_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long value;
+      pProp->Get(value);
+      std::lock_guard<std::mutex> lock(mutex_);
+      outputInterval_ = (unsigned)value;
+      sinceOutput_ = 0;
+   }
+   return DEVICE_OK;
+}
+
+int FrameAccumulator::OnKalmanGain(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(kalmanGain_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double value;
+      pProp->Get(value);
+      std::lock_guard<std::mutex> lock(mutex_);
+      kalmanGain_ = value;
+   }
+   return DEVICE_OK;
+}
+
+int FrameAccumulator::OnAccumulatedFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pProp->Set((long)count_);
+   }
+   return DEVICE_OK;
+}
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameAccumulator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image processor combining consecutive frames by averaging,
+//                running (exponential or Kalman) averaging or maximum
+//                projection, inserting one result per N frames.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "DeviceBase.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class FrameAccumulator : public CImageProcessorBase<FrameAccumulator>
+{
+public:
+   FrameAccumulator();
+   ~FrameAccumulator();
+
+   // MMDevice API
+   int Initialize();
+   int Shutdown();
+   void GetName(char* name) const;
+   bool Busy() { return false; }
+
+   // MMImageProcessor API
+   // Returns DEVICE_IMAGE_CONSUMED for the frames that are only accumulated
+   int Process(unsigned char* buffer, unsigned width, unsigned height,
+         unsigned byteDepth);
+   // A snapped image is passed through, the accumulation left untouched
+   int ProcessSnap(unsigned char*, unsigned, unsigned, unsigned)
+   { return DEVICE_OK; }
+   int SequenceStarting();
+
+   // Action handlers
+   int OnMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnOutputInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnKalmanGain(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnAccumulatedFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   enum Mode
+   {
+      ModeMean,
+      ModeMax,
+      ModeRunningAverage,
+      ModeKalman
+   };
+
+   void Reset();
+   bool AccumulateSum(unsigned char* buffer, std::size_t nPixels,
+         unsigned bytesPerPixel);
+   bool AccumulateMax(unsigned char* buffer, std::size_t nPixels,
+         unsigned bytesPerPixel);
+   bool AccumulateRunning(unsigned char* buffer, std::size_t nPixels,
+         unsigned bytesPerPixel);
+
+   bool initialized_;
+
+   std::mutex mutex_; // Settings and accumulation state
+   Mode mode_;
+   unsigned frames_;
+   unsigned outputInterval_;
+   double kalmanGain_;
+
+   unsigned width_;
+   unsigned height_;
+   unsigned byteDepth_;
+   unsigned count_; // Frames in the accumulator
+   unsigned sinceOutput_; // Frames since the last inserted running average
+   std::vector<uint32_t> sum_;
+   std::vector<unsigned char> max_;
+   std::vector<float> average_;
+};
@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+
+#include "AccumulationKernels.h"
+#include "PixelConversion.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace PixelConversion;
+
+
+namespace
+{
+
+// Sizes around the SIMD block lengths, to exercise the scalar tails
+const std::size_t testSizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31,
+   32, 33, 63, 64, 65, 100, 1001 };
+
+template <typename T>
+std::vector<T> RandomValues(std::size_t n, uint32_t maxValue, unsigned seed)
+{
+   std::mt19937 gen(seed);
+   std::uniform_int_distribution<uint32_t> dist(0, maxValue);
+   std::vector<T> v(n);
+   for (auto& x : v)
+      x = static_cast<T>(dist(gen));
+   return v;
+}
+
+// Sums of count frames of at most maxValue: random ones, plus the full sum
+// and those next to each rounding boundary
+std::vector<uint32_t> TestSums(unsigned count, uint32_t maxValue)
+{
+   const uint32_t fullSum = count * maxValue;
+   std::vector<uint32_t> sums = RandomValues<uint32_t>(61, fullSum, count);
+   sums.push_back(0);
+   sums.push_back(fullSum);
+   for (uint32_t q = maxValue - 2; q < maxValue; ++q)
+   {
+      const uint32_t boundary = q * count + (count + 1) / 2;
+      sums.push_back(boundary - 1);
+      sums.push_back(boundary);
+   }
+   return sums;
+}
+
+// Runs the test body at each instruction set; those not supported by this
+// CPU pass trivially
+class AccumulationKernelsTests : public ::testing::TestWithParam<InstructionSet>
+{
+protected:
+   void TearDown() override
+   {
+      SetInstructionSetLimit(InstructionSetAVX2);
+   }
+
+   bool Supported() const
+   {
+      return GetParam() <= GetSupportedInstructionSet();
+   }
+
+   // Runs kernel(output, n) with the scalar code and with the instruction
+   // set under test, on outputs that start as a copy of initial
+   template <typename T, typename Func>
+   void CompareWithScalar(const std::vector<T>& initial, std::size_t n,
+         Func kernel)
+   {
+      // Sentinel values catch writes past the end
+      std::vector<T> expected(initial.begin(), initial.begin() + n);
+      expected.push_back(T(0x5A));
+      std::vector<T> actual(expected);
+
+      SetInstructionSetLimit(InstructionSetScalar);
+      kernel(expected.data(), n);
+      SetInstructionSetLimit(GetParam());
+      kernel(actual.data(), n);
+      ASSERT_EQ(expected, actual) << "n = " << n;
+   }
+
+   template <typename T, typename Func>
+   void CompareAdd(Func add, uint32_t maxValue)
+   {
+      for (std::size_t n : testSizes)
+      {
+         const std::vector<uint32_t> sum =
+            RandomValues<uint32_t>(n, 255 * maxValue, unsigned(n));
+         const std::vector<T> pixels = RandomValues<T>(n, maxValue, unsigned(n) + 1);
+         CompareWithScalar(sum, n, [&](uint32_t* s, std::size_t len)
+               { add(s, pixels.data(), len); });
+      }
+   }
+
+   template <typename T, typename Func>
+   void CompareDivide(Func divide, uint32_t maxValue)
+   {
+      for (unsigned count = 1; count <= AccumulationKernels::MaxSumFrames; ++count)
+      {
+         const std::vector<uint32_t> sums = TestSums(count, maxValue);
+         const std::vector<T> initial(sums.size());
+         std::vector<T> expected(sums.size());
+         for (std::size_t i = 0; i < sums.size(); ++i)
+            expected[i] = static_cast<T>((sums[i] + count / 2) / count);
+
+         SetInstructionSetLimit(GetParam());
+         std::vector<T> actual(sums.size());
+         divide(actual.data(), sums.data(), count, sums.size());
+         ASSERT_EQ(expected, actual) << "count = " << count;
+
+         for (std::size_t n : testSizes)
+         {
+            if (n > sums.size())
+               break;
+            CompareWithScalar(initial, n, [&](T* p, std::size_t len)
+                  { divide(p, sums.data(), count, len); });
+         }
+      }
+   }
+
+   template <typename T, typename Func>
+   void CompareMax(Func max, uint32_t maxValue)
+   {
+      for (std::size_t n : testSizes)
+      {
+         const std::vector<T> maximum = RandomValues<T>(n, maxValue, unsigned(n));
+         const std::vector<T> pixels = RandomValues<T>(n, maxValue, unsigned(n) + 1);
+         CompareWithScalar(maximum, n, [&](T* m, std::size_t len)
+               { max(m, pixels.data(), len); });
+      }
+   }
+
+   template <typename T, typename Func>
+   void CompareBlend(Func blend, uint32_t maxValue)
+   {
+      const float weights[] = { 1.0f, 0.5f, 0.2f, 1.0f / 3, 0.01f };
+      for (float weight : weights)
+      {
+         for (std::size_t n : testSizes)
+         {
+            const std::vector<T> start = RandomValues<T>(n, maxValue, unsigned(n));
+            const std::vector<float> average(start.begin(), start.end());
+            const std::vector<T> pixels = RandomValues<T>(n, maxValue, unsigned(n) + 1);
+            CompareWithScalar(average, n, [&](float* a, std::size_t len)
+                  { blend(a, pixels.data(), weight, len); });
+         }
+      }
+   }
+
+   template <typename T, typename Func>
+   void CompareRound(Func round, uint32_t maxValue)
+   {
+      for (std::size_t n : testSizes)
+      {
+         // Quarter steps, so that half of the values are ties or near them
+         const std::vector<uint32_t> quarters =
+            RandomValues<uint32_t>(n, 4 * maxValue, unsigned(n));
+         std::vector<float> average(n);
+         for (std::size_t i = 0; i < n; ++i)
+            average[i] = quarters[i] / 4.0f;
+         const std::vector<T> initial(n);
+         CompareWithScalar(initial, n, [&](T* p, std::size_t len)
+               { round(p, average.data(), len); });
+      }
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_P(AccumulationKernelsTests, Add8)
+{
+   if (Supported())
+      CompareAdd<uint8_t>(AccumulationKernels::Add8, 255);
+}
+
+TEST_P(AccumulationKernelsTests, Add16)
+{
+   if (Supported())
+      CompareAdd<uint16_t>(AccumulationKernels::Add16, 65535);
+}
+
+TEST_P(AccumulationKernelsTests, Divide8)
+{
+   if (Supported())
+      CompareDivide<uint8_t>(AccumulationKernels::Divide8, 255);
+}
+
+TEST_P(AccumulationKernelsTests, Divide16)
+{
+   if (Supported())
+      CompareDivide<uint16_t>(AccumulationKernels::Divide16, 65535);
+}
+
+TEST_P(AccumulationKernelsTests, Max8)
+{
+   if (Supported())
+      CompareMax<uint8_t>(AccumulationKernels::Max8, 255);
+}
+
+TEST_P(AccumulationKernelsTests, Max16)
+{
+   if (Supported())
+      CompareMax<uint16_t>(AccumulationKernels::Max16, 65535);
+}
+
+TEST_P(AccumulationKernelsTests, Blend8)
+{
+   if (Supported())
+      CompareBlend<uint8_t>(AccumulationKernels::Blend8, 255);
+}
+
+TEST_P(AccumulationKernelsTests, Blend16)
+{
+   if (Supported())
+      CompareBlend<uint16_t>(AccumulationKernels::Blend16, 65535);
+}
+
+TEST_P(AccumulationKernelsTests, Round8)
+{
+   if (Supported())
+      CompareRound<uint8_t>(AccumulationKernels::Round8, 255);
+}
+
+TEST_P(AccumulationKernelsTests, Round16)
+{
+   if (Supported())
+      CompareRound<uint16_t>(AccumulationKernels::Round16, 65535);
+}
+
+TEST_P(AccumulationKernelsTests, RoundsHalfToEven)
+{
+   if (!Supported())
+      return;
+   SetInstructionSetLimit(GetParam());
+
+   std::vector<float> average(17);
+   for (std::size_t i = 0; i < average.size(); ++i)
+      average[i] = i + 0.5f;
+   average[16] = 65535.0f;
+   std::vector<uint16_t> pixels(average.size());
+   AccumulationKernels::Round16(pixels.data(), average.data(), pixels.size());
+   for (std::size_t i = 0; i < 16; ++i)
+      EXPECT_EQ(i % 2 ? i + 1 : i, pixels[i]) << "i = " << i;
+   EXPECT_EQ(65535, pixels[16]);
+}
+
+INSTANTIATE_TEST_CASE_P(AllInstructionSets, AccumulationKernelsTests,
+   ::testing::Values(InstructionSetScalar, InstructionSetSSE2,
+      InstructionSetSSSE3, InstructionSetAVX2),
+   [](const ::testing::TestParamInfo<InstructionSet>& info)
+   { return std::string(GetInstructionSetName(info.param)); });
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
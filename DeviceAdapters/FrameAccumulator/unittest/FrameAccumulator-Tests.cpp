@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include "FrameAccumulator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+class FrameAccumulatorTests : public ::testing::Test
+{
+protected:
+   FrameAccumulator accumulator;
+
+   void SetUp() override
+   {
+      ASSERT_EQ(DEVICE_OK, accumulator.Initialize());
+   }
+
+   void TearDown() override
+   {
+      accumulator.Shutdown();
+   }
+
+   void Set(const char* name, const std::string& value)
+   {
+      ASSERT_EQ(DEVICE_OK, accumulator.SetProperty(name, value.c_str()));
+   }
+
+   long AccumulatedFrames()
+   {
+      char value[MM::MaxStrLength];
+      EXPECT_EQ(DEVICE_OK, accumulator.GetProperty("AccumulatedFrames", value));
+      return std::stol(value);
+   }
+
+   // Processes a width x 3 16-bit frame filled with value
+   int Process16(std::vector<uint16_t>& frame, uint16_t value,
+         unsigned width = 5)
+   {
+      frame.assign(width * 3, value);
+      return accumulator.Process(reinterpret_cast<unsigned char*>(frame.data()),
+            width, 3, 2);
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(FrameAccumulatorTests, MeanEmitsOneFramePerN)
+{
+   Set("Frames", "3");
+   std::vector<uint16_t> frame;
+   for (int round = 0; round < 3; ++round)
+   {
+      EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 1000));
+      EXPECT_EQ(1, AccumulatedFrames());
+      EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 65535));
+      EXPECT_EQ(2, AccumulatedFrames());
+      EXPECT_EQ(DEVICE_OK, Process16(frame, 2));
+      EXPECT_EQ(0, AccumulatedFrames());
+      // (1000 + 65535 + 2) / 3 = 22179
+      EXPECT_EQ(std::vector<uint16_t>(15, 22179), frame);
+   }
+}
+
+TEST_F(FrameAccumulatorTests, MeanOfRGBAndEightBit)
+{
+   Set("Frames", "2");
+   std::vector<unsigned char> rgb(4 * 4, 10);
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, accumulator.Process(rgb.data(), 2, 2, 4));
+   rgb.assign(rgb.size(), 255);
+   rgb[1] = 20;
+   EXPECT_EQ(DEVICE_OK, accumulator.Process(rgb.data(), 2, 2, 4));
+   EXPECT_EQ(133, rgb[0]); // Halves round up
+   EXPECT_EQ(15, rgb[1]);
+
+   // Eight-bit gray with the same byte count starts over
+   std::vector<unsigned char> gray(16, 7);
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, accumulator.Process(gray.data(), 4, 4, 1));
+   EXPECT_EQ(DEVICE_OK, accumulator.Process(gray.data(), 4, 4, 1));
+   EXPECT_EQ(std::vector<unsigned char>(16, 7), gray);
+}
+
+TEST_F(FrameAccumulatorTests, MaxEmitsOneFramePerN)
+{
+   Set("Mode", "Maximum projection");
+   Set("Frames", "4");
+   const uint16_t values[] = { 300, 60000, 7, 42 };
+   std::vector<uint16_t> frame;
+   for (int round = 0; round < 2; ++round)
+   {
+      for (int i = 0; i < 3; ++i)
+         EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, values[i]));
+      EXPECT_EQ(DEVICE_OK, Process16(frame, values[3]));
+      EXPECT_EQ(std::vector<uint16_t>(15, 60000), frame);
+   }
+}
+
+TEST_F(FrameAccumulatorTests, SingleFramePassesThrough)
+{
+   Set("Frames", "1");
+   std::vector<uint16_t> frame;
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 12345));
+   EXPECT_EQ(std::vector<uint16_t>(15, 12345), frame);
+   Set("Mode", "Maximum projection");
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 23456));
+   EXPECT_EQ(std::vector<uint16_t>(15, 23456), frame);
+}
+
+TEST_F(FrameAccumulatorTests, SequenceStartingResets)
+{
+   Set("Frames", "2");
+   std::vector<uint16_t> frame;
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 50000));
+   EXPECT_EQ(1, AccumulatedFrames());
+
+   EXPECT_EQ(DEVICE_OK, accumulator.SequenceStarting());
+   EXPECT_EQ(0, AccumulatedFrames());
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 10));
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 20));
+   EXPECT_EQ(std::vector<uint16_t>(15, 15), frame);
+}
+
+TEST_F(FrameAccumulatorTests, GeometryChangeResets)
+{
+   Set("Mode", "Maximum projection");
+   Set("Frames", "2");
+   std::vector<uint16_t> frame;
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 50000, 5));
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 10, 6));
+   EXPECT_EQ(1, AccumulatedFrames());
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 20, 6));
+   EXPECT_EQ(std::vector<uint16_t>(18, 20), frame);
+}
+
+TEST_F(FrameAccumulatorTests, SnapLeavesAccumulationAlone)
+{
+   Set("Frames", "2");
+   std::vector<uint16_t> frame;
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 100));
+   std::vector<uint16_t> snap(15, 9);
+   EXPECT_EQ(DEVICE_OK, accumulator.ProcessSnap(
+            reinterpret_cast<unsigned char*>(snap.data()), 5, 3, 2));
+   EXPECT_EQ(std::vector<uint16_t>(15, 9), snap);
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 200));
+   EXPECT_EQ(std::vector<uint16_t>(15, 150), frame);
+}
+
+TEST_F(FrameAccumulatorTests, SettingsChangeResets)
+{
+   Set("Frames", "3");
+   std::vector<uint16_t> frame;
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 100));
+   Set("Frames", "2");
+   EXPECT_EQ(0, AccumulatedFrames());
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 300));
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 500));
+   EXPECT_EQ(std::vector<uint16_t>(15, 400), frame);
+}
+
+TEST_F(FrameAccumulatorTests, RunningAverageOutputInterval)
+{
+   Set("Mode", "Running average");
+   Set("Frames", "2");
+   Set("OutputInterval", "2");
+   std::vector<uint16_t> frame;
+   // Cumulative for the first two frames, then weight 1/2
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 100));
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 300));
+   EXPECT_EQ(std::vector<uint16_t>(15, 200), frame);
+   EXPECT_EQ(DEVICE_IMAGE_CONSUMED, Process16(frame, 600));
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 1000));
+   EXPECT_EQ(std::vector<uint16_t>(15, 700), frame); // (200 + 600) / 2, then 1000
+}
+
+TEST_F(FrameAccumulatorTests, KalmanAverage)
+{
+   Set("Mode", "Kalman");
+   Set("KalmanGain", "0.75");
+   std::vector<uint16_t> frame;
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 1000));
+   EXPECT_EQ(std::vector<uint16_t>(15, 1000), frame);
+   // Weight min(1, 0.25 + 1/2) = 0.75
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 2000));
+   EXPECT_EQ(std::vector<uint16_t>(15, 1750), frame);
+   // Weight 0.25 + 1/3
+   EXPECT_EQ(DEVICE_OK, Process16(frame, 1750 + 1200));
+   EXPECT_EQ(std::vector<uint16_t>(15, 2450), frame);
+}
+
+TEST_F(FrameAccumulatorTests, UnsupportedDepth)
+{
+   std::vector<unsigned char> frame(8 * 3);
+   EXPECT_EQ(DEVICE_UNSUPPORTED_DATA_FORMAT,
+         accumulator.Process(frame.data(), 2, 1, 3));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -152,7 +152,12 @@ int ImageProcessorChain::Process(unsigned char *pBuffer, unsigned int width, uns
          {
             try
             {
-               pP->Process(pBuffer, width, height,byteDepth);
+               // A consumed image is not passed on to the later processors
+               if (pP->Process(pBuffer, width, height,byteDepth) == DEVICE_IMAGE_CONSUMED)
+               {
+                  ret = DEVICE_IMAGE_CONSUMED;
+                  break;
+               }
             }
             catch(...)
             {
@@ -170,3 +175,61 @@ int ImageProcessorChain::Process(unsigned char *pBuffer, unsigned int width, uns
 
    return ret;
 }
+
+
+int ImageProcessorChain::ProcessSnap(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
+{
+   int ret = DEVICE_OK;
+   busy_ = true;
+
+   for( int islot = 0; islot < this->nSlots_; ++islot)
+   {
+      if( processors_.end() != processors_.find(islot))
+      {
+         MM::ImageProcessor* pP = processors_[islot];
+         if( NULL != pP)
+         {
+            try
+            {
+               if (pP->ProcessSnap(pBuffer, width, height,byteDepth) == DEVICE_IMAGE_CONSUMED)
+               {
+                  ret = DEVICE_IMAGE_CONSUMED;
+                  break;
+               }
+            }
+            catch(...)
+            {
+               std::ostringstream m;
+               char name[MM::MaxStrLength];
+               pP->GetName(name);
+               m << "Error in processor " << name;
+               LogMessage(m.str().c_str(), false);
+            }
+         }
+      }
+   }
+
+   busy_ = false;
+
+   return ret;
+}
+
+
+int ImageProcessorChain::SequenceStarting()
+{
+   int ret = DEVICE_OK;
+   for( int islot = 0; islot < this->nSlots_; ++islot)
+   {
+      if( processors_.end() != processors_.find(islot))
+      {
+         MM::ImageProcessor* pP = processors_[islot];
+         if( NULL != pP)
+         {
+            int nRet = pP->SequenceStarting();
+            if (nRet != DEVICE_OK && ret == DEVICE_OK)
+               ret = nRet;
+         }
+      }
+   }
+   return ret;
+}
@@ -52,6 +52,8 @@ public:
    bool Busy(void) { return busy_;};
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int ProcessSnap(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int SequenceStarting();
 
    // action interface
    // ----------------
@@ -0,0 +1,694 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ReplayCamera.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Camera that plays back a recorded image stack from a
+//                memory-mapped file, for repeatable offline benchmarking of
+//                acquisition pipelines.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ReplayCamera.h"
+
+#include "ModuleInterface.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+const char* g_ReplayCameraName = "ReplayCamera";
+
+const char* g_Prop_DataFile = "DataFile";
+const char* g_Prop_FileFormat = "FileFormat";
+const char* g_Prop_MetadataFile = "MetadataFile";
+const char* g_Prop_RawWidth = "RawWidth";
+const char* g_Prop_RawHeight = "RawHeight";
+const char* g_Prop_RawBytesPerPixel = "RawBytesPerPixel";
+const char* g_Prop_RawHeaderBytes = "RawHeaderBytes";
+const char* g_Prop_RawFrameHeaderBytes = "RawFrameHeaderBytes";
+const char* g_Prop_RawByteOrder = "RawByteOrder";
+const char* g_Prop_Timing = "PlaybackTiming";
+const char* g_Prop_Speed = "PlaybackSpeed";
+const char* g_Prop_Loop = "Loop";
+const char* g_Prop_FrameCount = "FrameCount";
+const char* g_Prop_NextFrame = "NextFrame";
+
+const char* g_Format_TIFF = "TIFF";
+const char* g_Format_Raw = "Raw";
+const char* g_ByteOrder_Little = "LittleEndian";
+const char* g_ByteOrder_Big = "BigEndian";
+const char* g_Timing_Exposure = "Exposure";
+const char* g_Timing_Recorded = "Recorded";
+const char* g_Timing_Unthrottled = "Unthrottled";
+const char* g_Yes = "Yes";
+const char* g_No = "No";
+
+const char* g_Tag_FrameIndex = "ReplayFrameIndex";
+const char* g_Tag_RecordedTime = "ReplayRecordedTime-ms";
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Exported MMDevice API
+///////////////////////////////////////////////////////////////////////////////
+
+MODULE_API void InitializeModuleData()
+{
+   RegisterDevice(g_ReplayCameraName, MM::CameraDevice,
+         "Plays back a recorded raw or TIFF stack");
+}
+
+MODULE_API MM::Device* CreateDevice(const char* deviceName)
+{
+   if (deviceName == 0)
+      return 0;
+   if (strcmp(deviceName, g_ReplayCameraName) == 0)
+      return new ReplayCamera();
+   return 0;
+}
+
+MODULE_API void DeleteDevice(MM::Device* pDevice)
+{
+   delete pDevice;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReplayCamera implementation
+///////////////////////////////////////////////////////////////////////////////
+
+ReplayCamera::ReplayCamera() :
+   initialized_(false),
+   exposureMs_(10.0),
+   binning_(1),
+   roiX_(0),
+   roiY_(0),
+   roiWidth_(0),
+   roiHeight_(0),
+   timing_(TIMING_EXPOSURE),
+   speed_(1.0),
+   loop_(true),
+   nextFrame_(0),
+   pixels_(0),
+   sequenceFrames_(0),
+   recordedOriginMs_(0.0)
+{
+   InitializeDefaultErrorMessages();
+   SetErrorText(ERR_REPLAY_OPEN_FAILED, "Failed to open the replay data file");
+   SetErrorText(ERR_REPLAY_NOT_OPEN, "No replay data loaded");
+   SetErrorText(ERR_REPLAY_END_OF_DATA, "Reached the end of the replay data");
+   SetErrorText(ERR_REPLAY_INVALID_BINNING, "Binning must divide the image size");
+
+   // Data source (pre-initialization)
+   CreateStringProperty(g_Prop_DataFile, "", false, 0, true);
+   CreateStringProperty(g_Prop_MetadataFile, "", false, 0, true);
+   CreateStringProperty(g_Prop_FileFormat, g_Format_TIFF, false, 0, true);
+   AddAllowedValue(g_Prop_FileFormat, g_Format_TIFF);
+   AddAllowedValue(g_Prop_FileFormat, g_Format_Raw);
+
+   // Layout of raw files; ignored for TIFF
+   CreateIntegerProperty(g_Prop_RawWidth, 512, false, 0, true);
+   CreateIntegerProperty(g_Prop_RawHeight, 512, false, 0, true);
+   CreateIntegerProperty(g_Prop_RawBytesPerPixel, 2, false, 0, true);
+   AddAllowedValue(g_Prop_RawBytesPerPixel, "1");
+   AddAllowedValue(g_Prop_RawBytesPerPixel, "2");
+   AddAllowedValue(g_Prop_RawBytesPerPixel, "4");
+   CreateIntegerProperty(g_Prop_RawHeaderBytes, 0, false, 0, true);
+   CreateIntegerProperty(g_Prop_RawFrameHeaderBytes, 0, false, 0, true);
+   CreateStringProperty(g_Prop_RawByteOrder, g_ByteOrder_Little, false, 0, true);
+   AddAllowedValue(g_Prop_RawByteOrder, g_ByteOrder_Little);
+   AddAllowedValue(g_Prop_RawByteOrder, g_ByteOrder_Big);
+}
+
+ReplayCamera::~ReplayCamera()
+{
+   Shutdown();
+}
+
+void ReplayCamera::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_ReplayCameraName);
+}
+
+int ReplayCamera::Initialize()
+{
+   if (initialized_)
+      return DEVICE_OK;
+
+   int ret = OpenStack();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   CPropertyAction* pAct = new CPropertyAction(this, &ReplayCamera::OnBinning);
+   ret = CreateIntegerProperty(MM::g_Keyword_Binning, 1, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   for (int bin = 1; bin <= 8; bin *= 2)
+   {
+      if (stack_.GetWidth() % bin == 0 && stack_.GetHeight() % bin == 0)
+         AddAllowedValue(MM::g_Keyword_Binning, CDeviceUtils::ConvertToString(bin));
+   }
+
+   pAct = new CPropertyAction(this, &ReplayCamera::OnExposure);
+   ret = CreateFloatProperty(MM::g_Keyword_Exposure, exposureMs_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(MM::g_Keyword_Exposure, 0.0, 10000.0);
+
+   ret = CreateStringProperty(MM::g_Keyword_PixelType,
+         stack_.GetBytesPerPixel() == 1 ? "8bit" :
+         stack_.GetBytesPerPixel() == 2 ? "16bit" : "32bit", true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // Exposure: one frame per max(exposure, requested interval).
+   // Recorded: reproduce the stack's ElapsedTime-ms, scaled by PlaybackSpeed.
+   // Unthrottled: as fast as the core accepts frames.
+   pAct = new CPropertyAction(this, &ReplayCamera::OnTiming);
+   ret = CreateStringProperty(g_Prop_Timing, g_Timing_Exposure, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue(g_Prop_Timing, g_Timing_Exposure);
+   AddAllowedValue(g_Prop_Timing, g_Timing_Recorded);
+   AddAllowedValue(g_Prop_Timing, g_Timing_Unthrottled);
+
+   pAct = new CPropertyAction(this, &ReplayCamera::OnSpeed);
+   ret = CreateFloatProperty(g_Prop_Speed, speed_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_Prop_Speed, 0.01, 100.0);
+
+   pAct = new CPropertyAction(this, &ReplayCamera::OnLoop);
+   ret = CreateStringProperty(g_Prop_Loop, loop_ ? g_Yes : g_No, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue(g_Prop_Loop, g_Yes);
+   AddAllowedValue(g_Prop_Loop, g_No);
+
+   ret = CreateIntegerProperty(g_Prop_FrameCount, stack_.GetFrameCount(), true);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &ReplayCamera::OnNextFrame);
+   ret = CreateIntegerProperty(g_Prop_NextFrame, 0, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_Prop_NextFrame, 0, (double)(stack_.GetFrameCount() - 1));
+
+   ClearROI();
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int ReplayCamera::Shutdown()
+{
+   if (!initialized_)
+      return DEVICE_OK;
+   StopSequenceAcquisition();
+   stack_.Close();
+   pixels_ = 0;
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int ReplayCamera::OpenStack()
+{
+   char buf[MM::MaxStrLength];
+   GetProperty(g_Prop_DataFile, buf);
+   std::string dataFile(buf);
+   GetProperty(g_Prop_FileFormat, buf);
+   std::string format(buf);
+   GetProperty(g_Prop_MetadataFile, buf);
+   std::string metadataFile(buf);
+
+   if (dataFile.empty())
+      return ERR_REPLAY_NOT_OPEN;
+
+   std::string err;
+   if (format == g_Format_Raw)
+   {
+      long width = 0, height = 0, bytesPerPixel = 0, headerBytes = 0, frameHeaderBytes = 0;
+      GetProperty(g_Prop_RawWidth, width);
+      GetProperty(g_Prop_RawHeight, height);
+      GetProperty(g_Prop_RawBytesPerPixel, bytesPerPixel);
+      GetProperty(g_Prop_RawHeaderBytes, headerBytes);
+      GetProperty(g_Prop_RawFrameHeaderBytes, frameHeaderBytes);
+      GetProperty(g_Prop_RawByteOrder, buf);
+
+      RawStackLayout layout;
+      layout.width = (unsigned)std::max(0L, width);
+      layout.height = (unsigned)std::max(0L, height);
+      layout.bytesPerPixel = (unsigned)bytesPerPixel;
+      layout.headerBytes = (std::size_t)std::max(0L, headerBytes);
+      layout.frameHeaderBytes = (std::size_t)std::max(0L, frameHeaderBytes);
+      layout.bigEndian = (std::string(buf) == g_ByteOrder_Big);
+      err = stack_.OpenRaw(dataFile, layout);
+   }
+   else
+   {
+      err = stack_.OpenTiff(dataFile);
+   }
+
+   if (err.empty() && !metadataFile.empty())
+      err = stack_.LoadMetadata(metadataFile);
+
+   if (!err.empty())
+   {
+      stack_.Close();
+      SetErrorText(ERR_REPLAY_OPEN_FAILED, err.c_str());
+      return ERR_REPLAY_OPEN_FAILED;
+   }
+
+   std::ostringstream os;
+   os << "Opened " << dataFile << ": " << stack_.GetFrameCount() << " frames of " <<
+      stack_.GetWidth() << "x" << stack_.GetHeight() << "x" << stack_.GetBytesPerPixel();
+   LogMessage(os.str().c_str(), false);
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Image geometry
+
+unsigned ReplayCamera::GetImageWidth() const
+{
+   return roiWidth_;
+}
+
+unsigned ReplayCamera::GetImageHeight() const
+{
+   return roiHeight_;
+}
+
+unsigned ReplayCamera::GetImageBytesPerPixel() const
+{
+   return stack_.GetBytesPerPixel();
+}
+
+unsigned ReplayCamera::GetBitDepth() const
+{
+   return stack_.GetBitDepth();
+}
+
+long ReplayCamera::GetImageBufferSize() const
+{
+   return roiWidth_ * roiHeight_ * GetImageBytesPerPixel();
+}
+
+int ReplayCamera::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize)
+{
+   if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+   unsigned fullWidth = stack_.GetWidth() / binning_;
+   unsigned fullHeight = stack_.GetHeight() / binning_;
+   if (xSize == 0 || ySize == 0 || x + xSize > fullWidth || y + ySize > fullHeight)
+      return DEVICE_INVALID_INPUT_PARAM;
+   roiX_ = x;
+   roiY_ = y;
+   roiWidth_ = xSize;
+   roiHeight_ = ySize;
+   ResizeImageBuffer();
+   return DEVICE_OK;
+}
+
+int ReplayCamera::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize)
+{
+   x = roiX_;
+   y = roiY_;
+   xSize = roiWidth_;
+   ySize = roiHeight_;
+   return DEVICE_OK;
+}
+
+int ReplayCamera::ClearROI()
+{
+   if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+   roiX_ = 0;
+   roiY_ = 0;
+   roiWidth_ = stack_.GetWidth() / binning_;
+   roiHeight_ = stack_.GetHeight() / binning_;
+   ResizeImageBuffer();
+   return DEVICE_OK;
+}
+
+int ReplayCamera::GetBinning() const
+{
+   return binning_;
+}
+
+int ReplayCamera::SetBinning(int binSize)
+{
+   return SetProperty(MM::g_Keyword_Binning, CDeviceUtils::ConvertToString(binSize));
+}
+
+double ReplayCamera::GetExposure() const
+{
+   return exposureMs_;
+}
+
+void ReplayCamera::SetExposure(double exp)
+{
+   SetProperty(MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(exp));
+   GetCoreCallback()->OnExposureChanged(this, exp);
+}
+
+void ReplayCamera::ResizeImageBuffer()
+{
+   img_.Resize(roiWidth_, roiHeight_, stack_.GetBytesPerPixel());
+   pixels_ = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Frame production
+
+// Returns the index of the frame to play next and advances the cursor
+int ReplayCamera::TakeNextFrame(unsigned long& frame)
+{
+   if (!stack_.IsOpen())
+      return ERR_REPLAY_NOT_OPEN;
+   std::lock_guard<std::mutex> lock(nextFrameMutex_);
+   if (nextFrame_ >= stack_.GetFrameCount())
+   {
+      if (!loop_)
+         return ERR_REPLAY_END_OF_DATA;
+      nextFrame_ = 0;
+   }
+   frame = nextFrame_++;
+   return DEVICE_OK;
+}
+
+namespace {
+
+template <typename T>
+T SwapBytes(T v)
+{
+   T r;
+   const unsigned char* src = reinterpret_cast<const unsigned char*>(&v);
+   unsigned char* dst = reinterpret_cast<unsigned char*>(&r);
+   for (std::size_t i = 0; i < sizeof(T); ++i)
+      dst[i] = src[sizeof(T) - 1 - i];
+   return r;
+}
+
+// Crops and (by averaging) bins one frame into dst
+template <typename T>
+void RenderPixels(const unsigned char* src, unsigned srcWidth, bool swap,
+      unsigned binning, unsigned x0, unsigned y0, unsigned width, unsigned height,
+      unsigned char* dst)
+{
+   const T* in = reinterpret_cast<const T*>(src);
+   T* out = reinterpret_cast<T*>(dst);
+   const unsigned nBinned = binning * binning;
+   for (unsigned y = 0; y < height; ++y)
+   {
+      for (unsigned x = 0; x < width; ++x)
+      {
+         unsigned long long sum = 0;
+         for (unsigned by = 0; by < binning; ++by)
+         {
+            const T* row = in + (std::size_t)((y0 + y) * binning + by) * srcWidth +
+               (x0 + x) * binning;
+            for (unsigned bx = 0; bx < binning; ++bx)
+               sum += swap ? SwapBytes(row[bx]) : row[bx];
+         }
+         out[(std::size_t)y * width + x] = (T)(sum / nBinned);
+      }
+   }
+}
+
+} // anonymous namespace
+
+// Returns a pointer to the frame as seen through the current ROI and binning.
+// Full frames that need no conversion are served directly from the mapping.
+const unsigned char* ReplayCamera::RenderFrame(unsigned long frame)
+{
+   const unsigned char* src = stack_.GetFramePixels(frame);
+   if (!src)
+      return 0;
+
+   bool fullFrame = roiX_ == 0 && roiY_ == 0 && binning_ == 1 &&
+      roiWidth_ == stack_.GetWidth() && roiHeight_ == stack_.GetHeight();
+   if (fullFrame && !stack_.NeedsByteSwap())
+      return src;
+
+   unsigned char* dst = img_.GetPixelsRW();
+   switch (stack_.GetBytesPerPixel())
+   {
+      case 1:
+         RenderPixels<unsigned char>(src, stack_.GetWidth(), false, binning_,
+               roiX_, roiY_, roiWidth_, roiHeight_, dst);
+         break;
+      case 2:
+         RenderPixels<unsigned short>(src, stack_.GetWidth(), stack_.NeedsByteSwap(),
+               binning_, roiX_, roiY_, roiWidth_, roiHeight_, dst);
+         break;
+      case 4:
+         RenderPixels<unsigned int>(src, stack_.GetWidth(), stack_.NeedsByteSwap(),
+               binning_, roiX_, roiY_, roiWidth_, roiHeight_, dst);
+         break;
+   }
+   return dst;
+}
+
+int ReplayCamera::SnapImage()
+{
+   MM::MMTime startTime = GetCurrentMMTime();
+
+   unsigned long frame;
+   int ret = TakeNextFrame(frame);
+   if (ret != DEVICE_OK)
+      return ret;
+   pixels_ = RenderFrame(frame);
+
+   double remainingMs = exposureMs_ - (GetCurrentMMTime() - startTime).getMsec();
+   if (remainingMs > 0.0)
+      CDeviceUtils::SleepMs((long)remainingMs);
+   return DEVICE_OK;
+}
+
+const unsigned char* ReplayCamera::GetImageBuffer()
+{
+   return pixels_;
+}
+
+int ReplayCamera::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+{
+   if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+   if (!stack_.IsOpen())
+      return ERR_REPLAY_NOT_OPEN;
+
+   unsigned long firstFrame;
+   {
+      std::lock_guard<std::mutex> lock(nextFrameMutex_);
+      firstFrame = nextFrame_ < stack_.GetFrameCount() ? nextFrame_ : 0;
+      if (!loop_)
+      {
+         // Without looping the sequence ends with the last frame, rather
+         // than with an error from the sequence thread
+         if (nextFrame_ >= stack_.GetFrameCount())
+            return ERR_REPLAY_END_OF_DATA;
+         numImages = (long)(std::min)((unsigned long)(std::max)(numImages, 0L),
+               stack_.GetFrameCount() - nextFrame_);
+      }
+   }
+
+   sequenceStart_ = std::chrono::steady_clock::now();
+   sequenceFrames_ = 0;
+   recordedOriginMs_ = stack_.GetRecordedTimeMs(firstFrame);
+   return CCameraBase<ReplayCamera>::StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow);
+}
+
+// Sleeps until the frame's playback time has come
+void ReplayCamera::WaitUntilDue(unsigned long frame)
+{
+   using namespace std::chrono;
+   double dueMs;
+   if (timing_ == TIMING_UNTHROTTLED)
+   {
+      return;
+   }
+   else if (timing_ == TIMING_RECORDED && stack_.GetRecordedTimeMs(frame) >= 0.0)
+   {
+      double recordedMs = stack_.GetRecordedTimeMs(frame);
+      if (recordedMs < recordedOriginMs_)
+      {
+         // Looped back to the start: restart the clock from here
+         sequenceStart_ = steady_clock::now();
+         recordedOriginMs_ = recordedMs;
+      }
+      dueMs = (recordedMs - recordedOriginMs_) / speed_;
+   }
+   else
+   {
+      double periodMs = (std::max)(exposureMs_, GetIntervalMs());
+      dueMs = periodMs * sequenceFrames_;
+   }
+   std::this_thread::sleep_until(sequenceStart_ +
+         duration_cast<steady_clock::duration>(duration<double, std::milli>(dueMs)));
+}
+
+int ReplayCamera::ThreadRun()
+{
+   unsigned long frame;
+   int ret = TakeNextFrame(frame);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   WaitUntilDue(frame);
+   ++sequenceFrames_;
+   return InsertFrame(RenderFrame(frame), frame);
+}
+
+int ReplayCamera::InsertFrame(const unsigned char* pixels, unsigned long frame)
+{
+   char label[MM::MaxStrLength];
+   GetLabel(label);
+
+   Metadata md;
+   md.put("Camera", label);
+   const std::map<std::string, std::string>& tags = stack_.GetFrameTags(frame);
+   for (std::map<std::string, std::string>::const_iterator it = tags.begin();
+         it != tags.end(); ++it)
+      md.put(it->first, it->second);
+   md.put(g_Tag_FrameIndex, CDeviceUtils::ConvertToString((long)frame));
+   double recordedMs = stack_.GetRecordedTimeMs(frame);
+   if (recordedMs >= 0.0)
+      md.put(g_Tag_RecordedTime, CDeviceUtils::ConvertToString(recordedMs));
+
+   std::string serialized = md.Serialize();
+   int ret = GetCoreCallback()->InsertImage(this, pixels, GetImageWidth(),
+         GetImageHeight(), GetImageBytesPerPixel(), serialized.c_str());
+   if (!isStopOnOverflow() && ret == DEVICE_BUFFER_OVERFLOW)
+   {
+      // do not stop on overflow - just reset the buffer
+      GetCoreCallback()->ClearImageBuffer(this);
+      ret = GetCoreCallback()->InsertImage(this, pixels, GetImageWidth(),
+            GetImageHeight(), GetImageBytesPerPixel(), serialized.c_str());
+   }
+   return ret;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+
+int ReplayCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)binning_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      long bin;
+      pProp->Get(bin);
+      if (bin < 1 || stack_.GetWidth() % bin != 0 || stack_.GetHeight() % bin != 0)
+      {
+         pProp->Set((long)binning_);
+         return ERR_REPLAY_INVALID_BINNING;
+      }
+      binning_ = (int)bin;
+      return ClearROI();
+   }
+   return DEVICE_OK;
+}
+
+int ReplayCamera::OnExposure(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(exposureMs_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(exposureMs_);
+   return DEVICE_OK;
+}
+
+int ReplayCamera::OnTiming(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(timing_ == TIMING_RECORDED ? g_Timing_Recorded :
+            timing_ == TIMING_UNTHROTTLED ? g_Timing_Unthrottled : g_Timing_Exposure);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      std::string val;
+      pProp->Get(val);
+      if (val == g_Timing_Recorded)
+         timing_ = TIMING_RECORDED;
+      else if (val == g_Timing_Unthrottled)
+         timing_ = TIMING_UNTHROTTLED;
+      else
+         timing_ = TIMING_EXPOSURE;
+   }
+   return DEVICE_OK;
+}
+
+int ReplayCamera::OnSpeed(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(speed_);
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      pProp->Get(speed_);
+   }
+   return DEVICE_OK;
+}
+
+int ReplayCamera::OnLoop(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(loop_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      // A running sequence was sized for the setting it started with
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      std::string val;
+      pProp->Get(val);
+      loop_ = (val == g_Yes);
+   }
+   return DEVICE_OK;
+}
+
+int ReplayCamera::OnNextFrame(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::lock_guard<std::mutex> lock(nextFrameMutex_);
+      pProp->Set((long)(nextFrame_ < stack_.GetFrameCount() ? nextFrame_ : 0));
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      long frame;
+      pProp->Get(frame);
+      std::lock_guard<std::mutex> lock(nextFrameMutex_);
+      nextFrame_ = (unsigned long)std::max(0L, frame);
+   }
+   return DEVICE_OK;
+}
@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ReplayCamera.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Camera that plays back a recorded image stack from a
+//                memory-mapped file, for repeatable offline benchmarking of
+//                acquisition pipelines.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "DeviceBase.h"
+#include "ImgBuffer.h"
+#include "ReplayStack.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#define ERR_REPLAY_OPEN_FAILED       102
+#define ERR_REPLAY_NOT_OPEN          103
+#define ERR_REPLAY_END_OF_DATA       104
+#define ERR_REPLAY_INVALID_BINNING   105
+
+class ReplayCamera : public CCameraBase<ReplayCamera>
+{
+public:
+   ReplayCamera();
+   ~ReplayCamera();
+
+   // MMDevice API
+   int Initialize();
+   int Shutdown();
+   void GetName(char* name) const;
+
+   // MMCamera API
+   int SnapImage();
+   const unsigned char* GetImageBuffer();
+   unsigned GetImageWidth() const;
+   unsigned GetImageHeight() const;
+   unsigned GetImageBytesPerPixel() const;
+   unsigned GetBitDepth() const;
+   long GetImageBufferSize() const;
+   double GetExposure() const;
+   void SetExposure(double exp);
+   int SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize);
+   int GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize);
+   int ClearROI();
+   int GetBinning() const;
+   int SetBinning(int binSize);
+   int IsExposureSequenceable(bool& isSequenceable) const
+   { isSequenceable = false; return DEVICE_OK; }
+   int StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow);
+   int StartSequenceAcquisition(double interval_ms)
+   { return StartSequenceAcquisition(LONG_MAX, interval_ms, false); }
+
+   // Action handlers
+   int OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnExposure(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSpeed(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnLoop(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnNextFrame(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+protected:
+   int ThreadRun();
+
+private:
+   enum Timing { TIMING_EXPOSURE, TIMING_RECORDED, TIMING_UNTHROTTLED };
+
+   int OpenStack();
+   int TakeNextFrame(unsigned long& frame);
+   const unsigned char* RenderFrame(unsigned long frame);
+   void WaitUntilDue(unsigned long frame);
+   int InsertFrame(const unsigned char* pixels, unsigned long frame);
+   void ResizeImageBuffer();
+
+   bool initialized_;
+   ReplayStack stack_;
+
+   // Emulated sensor state; ROI is in binned pixels
+   double exposureMs_;
+   int binning_;
+   unsigned roiX_;
+   unsigned roiY_;
+   unsigned roiWidth_;
+   unsigned roiHeight_;
+
+   Timing timing_;
+   double speed_;
+   bool loop_;
+   std::mutex nextFrameMutex_; // Shared with the sequence thread
+   unsigned long nextFrame_;
+
+   ImgBuffer img_;
+   const unsigned char* pixels_; // either img_ or a frame in the mapping
+
+   std::chrono::steady_clock::time_point sequenceStart_;
+   unsigned long sequenceFrames_;
+   double recordedOriginMs_;
+};
@@ -0,0 +1,402 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ReplayStack.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Read-only, memory-mapped access to a recorded image stack
+//                (raw binary or uncompressed TIFF) and its per-frame metadata.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ReplayStack.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace {
+
+const char* const g_ElapsedTimeTag = "ElapsedTime-ms";
+
+// TIFF tags and field types we need to understand
+enum {
+   TIFF_TAG_IMAGEWIDTH = 256,
+   TIFF_TAG_IMAGELENGTH = 257,
+   TIFF_TAG_BITSPERSAMPLE = 258,
+   TIFF_TAG_COMPRESSION = 259,
+   TIFF_TAG_STRIPOFFSETS = 273,
+   TIFF_TAG_SAMPLESPERPIXEL = 277,
+   TIFF_TAG_STRIPBYTECOUNTS = 279,
+   TIFF_TAG_MICROMANAGER = 51123, // per-frame JSON written by Micro-Manager
+};
+
+enum {
+   TIFF_TYPE_BYTE = 1,
+   TIFF_TYPE_ASCII = 2,
+   TIFF_TYPE_SHORT = 3,
+   TIFF_TYPE_LONG = 4,
+};
+
+bool HostIsBigEndian()
+{
+   const unsigned short probe = 1;
+   return *reinterpret_cast<const unsigned char*>(&probe) == 0;
+}
+
+class TiffReader
+{
+public:
+   TiffReader(const unsigned char* data, std::size_t size, bool bigEndian) :
+      data_(data), size_(size), bigEndian_(bigEndian)
+   {}
+
+   bool InRange(std::size_t offset, std::size_t len) const
+   {
+      return offset <= size_ && len <= size_ - offset;
+   }
+
+   unsigned U16(std::size_t offset) const
+   {
+      const unsigned char* p = data_ + offset;
+      return bigEndian_ ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+   }
+
+   unsigned long U32(std::size_t offset) const
+   {
+      const unsigned char* p = data_ + offset;
+      if (bigEndian_)
+         return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+      return ((unsigned long)p[3] << 24) | ((unsigned long)p[2] << 16) | ((unsigned long)p[1] << 8) | p[0];
+   }
+
+   // Reads element i of an IFD entry's value array (SHORT or LONG)
+   bool Value(std::size_t entry, unsigned long i, unsigned long& value) const
+   {
+      unsigned type = U16(entry + 2);
+      unsigned long count = U32(entry + 4);
+      std::size_t elemSize = (type == TIFF_TYPE_SHORT) ? 2 : (type == TIFF_TYPE_LONG) ? 4 : 0;
+      if (elemSize == 0 || i >= count)
+         return false;
+      std::size_t base = (count * elemSize <= 4) ? entry + 8 : U32(entry + 8);
+      std::size_t offset = base + i * elemSize;
+      if (!InRange(offset, elemSize))
+         return false;
+      value = (elemSize == 2) ? U16(offset) : U32(offset);
+      return true;
+   }
+
+   std::string Ascii(std::size_t entry) const
+   {
+      unsigned type = U16(entry + 2);
+      unsigned long count = U32(entry + 4);
+      if ((type != TIFF_TYPE_ASCII && type != TIFF_TYPE_BYTE) || count == 0)
+         return std::string();
+      std::size_t offset = (count <= 4) ? entry + 8 : U32(entry + 8);
+      if (!InRange(offset, count))
+         return std::string();
+      const char* p = reinterpret_cast<const char*>(data_ + offset);
+      return std::string(p, strnlen(p, count));
+   }
+
+private:
+   const unsigned char* data_;
+   std::size_t size_;
+   bool bigEndian_;
+};
+
+// Extracts a numeric field from Micro-Manager's per-frame JSON without a
+// full JSON parser. Both "key": 12.5 and "key": "12.5" forms are accepted.
+bool FindJsonNumber(const std::string& json, const std::string& key, double& value)
+{
+   std::string::size_type pos = json.find("\"" + key + "\"");
+   if (pos == std::string::npos)
+      return false;
+   pos = json.find(':', pos);
+   if (pos == std::string::npos)
+      return false;
+   pos = json.find_first_not_of(" \t\r\n\"", pos + 1);
+   if (pos == std::string::npos)
+      return false;
+   const char* begin = json.c_str() + pos;
+   char* end = 0;
+   value = strtod(begin, &end);
+   return end != begin;
+}
+
+} // anonymous namespace
+
+
+ReplayStack::ReplayStack() :
+   data_(0),
+   size_(0),
+   width_(0),
+   height_(0),
+   bytesPerPixel_(0),
+   bitDepth_(0),
+   swapBytes_(false)
+{
+}
+
+void ReplayStack::Close()
+{
+   region_.reset();
+   file_.reset();
+   data_ = 0;
+   size_ = 0;
+   width_ = height_ = bytesPerPixel_ = bitDepth_ = 0;
+   swapBytes_ = false;
+   frameOffsets_.clear();
+   recordedTimesMs_.clear();
+   frameTags_.clear();
+}
+
+std::string ReplayStack::Map(const std::string& path)
+{
+   Close();
+   try
+   {
+      using namespace boost::interprocess;
+      file_.reset(new file_mapping(path.c_str(), read_only));
+      region_.reset(new mapped_region(*file_, read_only));
+   }
+   catch (const boost::interprocess::interprocess_exception& e)
+   {
+      Close();
+      return "Cannot map " + path + ": " + e.what();
+   }
+   data_ = static_cast<const unsigned char*>(region_->get_address());
+   size_ = region_->get_size();
+   return std::string();
+}
+
+std::string ReplayStack::OpenRaw(const std::string& path, const RawStackLayout& layout)
+{
+   std::string err = Map(path);
+   if (!err.empty())
+      return err;
+
+   if (layout.width == 0 || layout.height == 0 ||
+         (layout.bytesPerPixel != 1 && layout.bytesPerPixel != 2 && layout.bytesPerPixel != 4))
+   {
+      Close();
+      return "Invalid raw stack geometry";
+   }
+
+   std::size_t frameBytes = (std::size_t)layout.width * layout.height * layout.bytesPerPixel;
+   std::size_t stride = layout.frameHeaderBytes + frameBytes;
+   for (std::size_t offset = layout.headerBytes + layout.frameHeaderBytes;
+         offset + frameBytes <= size_; offset += stride)
+   {
+      frameOffsets_.push_back(offset);
+   }
+   if (frameOffsets_.empty())
+   {
+      Close();
+      return path + " is too small to hold a single frame";
+   }
+
+   width_ = layout.width;
+   height_ = layout.height;
+   bytesPerPixel_ = layout.bytesPerPixel;
+   bitDepth_ = 8 * layout.bytesPerPixel;
+   swapBytes_ = layout.bytesPerPixel > 1 && layout.bigEndian != HostIsBigEndian();
+   recordedTimesMs_.assign(frameOffsets_.size(), -1.0);
+   frameTags_.resize(frameOffsets_.size());
+   return std::string();
+}
+
+std::string ReplayStack::OpenTiff(const std::string& path)
+{
+   std::string err = Map(path);
+   if (!err.empty())
+      return err;
+   err = ParseTiff();
+   if (!err.empty())
+   {
+      Close();
+      return path + ": " + err;
+   }
+   return std::string();
+}
+
+// Walks the IFD chain and records where each frame's pixels start. Only
+// uncompressed grayscale images whose strips are stored contiguously are
+// supported, which covers stacks written by Micro-Manager and ImageJ.
+std::string ReplayStack::ParseTiff()
+{
+   if (size_ < 8)
+      return "Not a TIFF file";
+   bool bigEndian;
+   if (data_[0] == 'I' && data_[1] == 'I')
+      bigEndian = false;
+   else if (data_[0] == 'M' && data_[1] == 'M')
+      bigEndian = true;
+   else
+      return "Not a TIFF file";
+
+   TiffReader tiff(data_, size_, bigEndian);
+   if (tiff.U16(2) == 43)
+      return "BigTIFF is not supported";
+   if (tiff.U16(2) != 42)
+      return "Not a TIFF file";
+
+   std::size_t ifd = tiff.U32(4);
+   std::set<std::size_t> visited;
+   while (ifd != 0)
+   {
+      if (!tiff.InRange(ifd, 2))
+         return "Corrupt IFD offset";
+      if (!visited.insert(ifd).second)
+         return "Corrupt IFD chain (loop)";
+      unsigned nEntries = tiff.U16(ifd);
+      if (!tiff.InRange(ifd + 2, nEntries * 12 + 4))
+         return "Corrupt IFD";
+
+      unsigned long width = 0, height = 0, bits = 8, compression = 1, samples = 1;
+      std::size_t stripOffsets = 0, stripByteCounts = 0;
+      double elapsedMs = -1.0;
+      for (unsigned i = 0; i < nEntries; ++i)
+      {
+         std::size_t entry = ifd + 2 + i * 12;
+         switch (tiff.U16(entry))
+         {
+            case TIFF_TAG_IMAGEWIDTH: tiff.Value(entry, 0, width); break;
+            case TIFF_TAG_IMAGELENGTH: tiff.Value(entry, 0, height); break;
+            case TIFF_TAG_BITSPERSAMPLE: tiff.Value(entry, 0, bits); break;
+            case TIFF_TAG_COMPRESSION: tiff.Value(entry, 0, compression); break;
+            case TIFF_TAG_SAMPLESPERPIXEL: tiff.Value(entry, 0, samples); break;
+            case TIFF_TAG_STRIPOFFSETS: stripOffsets = entry; break;
+            case TIFF_TAG_STRIPBYTECOUNTS: stripByteCounts = entry; break;
+            case TIFF_TAG_MICROMANAGER:
+               FindJsonNumber(tiff.Ascii(entry), g_ElapsedTimeTag, elapsedMs);
+               break;
+         }
+      }
+
+      if (compression != 1)
+         return "Compressed TIFF is not supported";
+      if (samples != 1 || (bits != 8 && bits != 16))
+         return "Only 8- and 16-bit grayscale TIFF is supported";
+      if (width == 0 || height == 0 || stripOffsets == 0 || stripByteCounts == 0)
+         return "Missing required TIFF tags";
+
+      if (frameOffsets_.empty())
+      {
+         width_ = width;
+         height_ = height;
+         bytesPerPixel_ = bits / 8;
+      }
+      else if (width != width_ || height != height_ || bits / 8 != bytesPerPixel_)
+      {
+         return "All pages must have the same size and pixel type";
+      }
+
+      // Strips must follow each other so that the frame can be served
+      // straight from the mapping
+      unsigned long nStrips = tiff.U32(stripOffsets + 4);
+      unsigned long first = 0, expected = 0;
+      for (unsigned long s = 0; s < nStrips; ++s)
+      {
+         unsigned long off, count;
+         if (!tiff.Value(stripOffsets, s, off) || !tiff.Value(stripByteCounts, s, count))
+            return "Corrupt strip table";
+         if (s == 0)
+            first = expected = off;
+         if (off != expected)
+            return "Non-contiguous strips are not supported";
+         expected = off + count;
+      }
+      std::size_t frameBytes = (std::size_t)width_ * height_ * bytesPerPixel_;
+      if (expected - first < frameBytes || !tiff.InRange(first, frameBytes))
+         return "Truncated image data";
+
+      frameOffsets_.push_back(first);
+      recordedTimesMs_.push_back(elapsedMs);
+
+      std::size_t next = ifd + 2 + nEntries * 12;
+      ifd = tiff.U32(next);
+   }
+
+   if (frameOffsets_.empty())
+      return "No images found";
+
+   bitDepth_ = 8 * bytesPerPixel_;
+   swapBytes_ = bytesPerPixel_ > 1 && bigEndian != HostIsBigEndian();
+   frameTags_.resize(frameOffsets_.size());
+   return std::string();
+}
+
+std::string ReplayStack::LoadMetadata(const std::string& path)
+{
+   std::ifstream in(path.c_str());
+   if (!in)
+      return "Cannot open metadata file " + path;
+
+   std::string line;
+   std::vector<std::string> columns;
+   if (std::getline(in, line))
+   {
+      if (!line.empty() && line[line.size() - 1] == '\r')
+         line.erase(line.size() - 1);
+      std::istringstream header(line);
+      std::string name;
+      while (std::getline(header, name, '\t'))
+         columns.push_back(name);
+   }
+   if (columns.empty())
+      return "Metadata file " + path + " has no header row";
+
+   unsigned long frame = 0;
+   while (std::getline(in, line) && frame < frameOffsets_.size())
+   {
+      if (!line.empty() && line[line.size() - 1] == '\r')
+         line.erase(line.size() - 1);
+      std::istringstream row(line);
+      std::string value;
+      for (std::size_t c = 0; c < columns.size() && std::getline(row, value, '\t'); ++c)
+      {
+         if (columns[c] == g_ElapsedTimeTag)
+            recordedTimesMs_[frame] = atof(value.c_str());
+         else
+            frameTags_[frame][columns[c]] = value;
+      }
+      ++frame;
+   }
+   return std::string();
+}
+
+const unsigned char* ReplayStack::GetFramePixels(unsigned long frame) const
+{
+   if (frame >= frameOffsets_.size())
+      return 0;
+   return data_ + frameOffsets_[frame];
+}
+
+double ReplayStack::GetRecordedTimeMs(unsigned long frame) const
+{
+   if (frame >= recordedTimesMs_.size() || recordedTimesMs_[frame] < 0.0 ||
+         recordedTimesMs_[0] < 0.0)
+      return -1.0;
+   return recordedTimesMs_[frame] - recordedTimesMs_[0];
+}
+
+const std::map<std::string, std::string>& ReplayStack::GetFrameTags(unsigned long frame) const
+{
+   static const std::map<std::string, std::string> empty;
+   if (frame >= frameTags_.size())
+      return empty;
+   return frameTags_[frame];
+}
@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ReplayStack.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Read-only, memory-mapped access to a recorded image stack
+//                (raw binary or uncompressed TIFF) and its per-frame metadata.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Geometry of a headerless raw stack. Frames are stored back to back after
+// headerBytes, each preceded by frameHeaderBytes (skipped).
+struct RawStackLayout
+{
+   unsigned width;
+   unsigned height;
+   unsigned bytesPerPixel;
+   std::size_t headerBytes;
+   std::size_t frameHeaderBytes;
+   bool bigEndian;
+};
+
+class ReplayStack
+{
+public:
+   ReplayStack();
+
+   // Both return an empty string on success, otherwise an error description.
+   // On error, the previous contents are discarded.
+   std::string OpenRaw(const std::string& path, const RawStackLayout& layout);
+   std::string OpenTiff(const std::string& path);
+
+   // Tab-separated text file with a header row of tag names and one row
+   // per frame. A column named ElapsedTime-ms provides the recorded cadence.
+   std::string LoadMetadata(const std::string& path);
+
+   void Close();
+
+   bool IsOpen() const { return !frameOffsets_.empty(); }
+   unsigned long GetFrameCount() const { return (unsigned long)frameOffsets_.size(); }
+   unsigned GetWidth() const { return width_; }
+   unsigned GetHeight() const { return height_; }
+   unsigned GetBytesPerPixel() const { return bytesPerPixel_; }
+   unsigned GetBitDepth() const { return bitDepth_; }
+
+   // True if the stored byte order differs from the host's
+   bool NeedsByteSwap() const { return swapBytes_; }
+
+   // Pointer into the mapping; valid until Close() or the next Open call
+   const unsigned char* GetFramePixels(unsigned long frame) const;
+
+   // Recorded time of the frame relative to the first frame, or a negative
+   // value if the stack carries no timing information.
+   double GetRecordedTimeMs(unsigned long frame) const;
+
+   const std::map<std::string, std::string>& GetFrameTags(unsigned long frame) const;
+
+private:
+   std::string Map(const std::string& path);
+   std::string ParseTiff();
+
+   std::unique_ptr<boost::interprocess::file_mapping> file_;
+   std::unique_ptr<boost::interprocess::mapped_region> region_;
+   const unsigned char* data_;
+   std::size_t size_;
+
+   unsigned width_;
+   unsigned height_;
+   unsigned bytesPerPixel_;
+   unsigned bitDepth_;
+   bool swapBytes_;
+   std::vector<std::size_t> frameOffsets_;
+   std::vector<double> recordedTimesMs_;
+   std::vector<std::map<std::string, std::string> > frameTags_;
+};
@@ -30,6 +30,9 @@
 
 #include "Util.h"
 
+#include <algorithm>
+#include <chrono>
+
 using boost::asio::ip::tcp;
 
 const char* deviceName = "TCP/IP serial port adapter";
@@ -42,20 +45,36 @@ TCPIPPort::TCPIPPort(int index) :
 	port_(0),
 	initialized_(false),
 	sock_(ios_),
-	answerTimeoutMs_(500)
+	answerTimeoutMs_(500),
+	noDelay_(true),
+	keepAlive_(false),
+	rxBuffer_(65536),
+	rxOverrun_(false),
+	rxClosed_(false)
 {
 	SetErrorText(ERR_BUFFER_OVERRUN, "Buffer overrun occured during read");
 	SetErrorText(ERR_TERM_TIMEOUT, "Timeout occured during init or read");
 	SetErrorText(ERR_PORT_CHANGE_FORBIDDEN, "Cannot change host/port after initialization");
 	SetErrorText(ERR_PORT_NOTINITIALIZED, "Operation failed. Port not inititalized");
+	SetErrorText(ERR_CONNECTION_CLOSED, "Connection closed by the remote host");
 
 	CreateProperty("Host", "127.0.0.1", MM::String, false, new CPropertyAction(this, &TCPIPPort::OnHost), true);
 	CreateProperty("TCP Port", "0", MM::Integer, false, new CPropertyAction(this, &TCPIPPort::OnPort), true);
 	CreateProperty("Answer timeout", "500", MM::Integer, false, new CPropertyAction(this, &TCPIPPort::OnAnswerTimeout), false);
+
+	// Nagle's algorithm holds back short writes (i.e. most commands) until the
+	// previous segment is acknowledged, so it is off by default.
+	CreateProperty("TCP_NODELAY", "Yes", MM::String, false, new CPropertyAction(this, &TCPIPPort::OnNoDelay), false);
+	AddAllowedValue("TCP_NODELAY", "No");
+	AddAllowedValue("TCP_NODELAY", "Yes");
+	CreateProperty("Keepalive", "No", MM::String, false, new CPropertyAction(this, &TCPIPPort::OnKeepAlive), false);
+	AddAllowedValue("Keepalive", "No");
+	AddAllowedValue("Keepalive", "Yes");
 }
 
 TCPIPPort::~TCPIPPort()
 {
+	Shutdown();
 }
 
 bool TCPIPPort::Busy()
@@ -82,15 +101,38 @@ ERRH_START
 
 	boost::asio::deadline_timer deadline(ios_);
 	deadline.expires_from_now(boost::posix_time::millisec(answerTimeoutMs_));
-	deadline.async_wait(boost::lambda::bind(&TCPIPPort::close_sock, this));
+	deadline.async_wait([this](const boost::system::error_code& timerEc) {
+		if (timerEc != boost::asio::error::operation_aborted)
+			close_sock();
+	});
 	
 	boost::asio::async_connect(sock_, it, boost::lambda::var(ec) = boost::lambda::_1);
 
 	do ios_.run_one(); while (ec == boost::asio::error::would_block);
 
+	// Let the cancelled timer complete before the I/O thread takes over
+	deadline.cancel();
+	ios_.run();
+	ios_.reset();
+
 	if (ec || !sock_.is_open())
 		return ERR_TERM_TIMEOUT;
 
+	ApplySocketOptions(ec);
+	if (ec)
+		throw boost::system::system_error(ec);
+
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		rxBuffer_.clear();
+		rxOverrun_ = false;
+		rxClosed_ = false;
+		rxError_.clear();
+	}
+	ioWork_.reset(new boost::asio::io_service::work(ios_));
+	StartReceive();
+	ioThread_ = std::thread([this]() { ios_.run(); });
+
 	initialized_ = true;
 
 	if (index_ == GetCount())
@@ -104,13 +146,89 @@ ERRH_START
 	if (!initialized_)
 		return DEVICE_OK;
 
-	sock_.shutdown(tcp::socket::shutdown_both);
-	sock_.close();
+	StopIoThread();
 
 	initialized_ = false;
 ERRH_END
 }
 
+void TCPIPPort::StopIoThread()
+{
+	if (!ioThread_.joinable())
+		return;
+
+	ios_.post([this]() {
+		boost::system::error_code ec;
+		sock_.shutdown(tcp::socket::shutdown_both, ec);
+		sock_.close(ec);
+	});
+	// With the socket closed the pending read completes with an error and
+	// isn't renewed, so run() returns once the work guard is gone.
+	ioWork_.reset();
+	ioThread_.join();
+	ios_.reset();
+}
+
+void TCPIPPort::StartReceive()
+{
+	sock_.async_read_some(boost::asio::buffer(rxChunk_, sizeof(rxChunk_)),
+		[this](const boost::system::error_code& ec, std::size_t bytesRead) {
+			OnReceive(ec, bytesRead);
+		});
+}
+
+void TCPIPPort::OnReceive(const boost::system::error_code& ec, std::size_t bytesRead)
+{
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		for (std::size_t i = 0; i < bytesRead; ++i)
+		{
+			if (rxBuffer_.full())
+				rxOverrun_ = true; // oldest byte is overwritten
+			rxBuffer_.push_back(rxChunk_[i]);
+		}
+		if (ec)
+		{
+			rxClosed_ = true;
+			if (ec != boost::asio::error::operation_aborted)
+				rxError_ = ec.message();
+		}
+	}
+	rxCond_.notify_all();
+
+	if (!ec)
+		StartReceive();
+}
+
+void TCPIPPort::ApplySocketOptions(boost::system::error_code& ec)
+{
+	sock_.set_option(tcp::no_delay(noDelay_), ec);
+	if (!ec)
+		sock_.set_option(boost::asio::socket_base::keep_alive(keepAlive_), ec);
+}
+
+// Runs op on the I/O thread and waits for it, as the socket must not be used
+// from two threads at once. Throws boost::system::system_error on failure.
+void TCPIPPort::RunOnIoThread(const std::function<void(boost::system::error_code&)>& op)
+{
+	std::mutex doneMutex;
+	std::condition_variable doneCond;
+	bool done = false;
+	boost::system::error_code ec;
+
+	ios_.post([&]() {
+		op(ec);
+		std::lock_guard<std::mutex> lock(doneMutex);
+		done = true;
+		doneCond.notify_one();
+	});
+
+	std::unique_lock<std::mutex> lock(doneMutex);
+	doneCond.wait(lock, [&]() { return done; });
+	if (ec)
+		throw boost::system::system_error(ec);
+}
+
 void TCPIPPort::GetName(char* name) const
 {
 	strcpy(name, GetStringName().c_str());
@@ -137,13 +255,16 @@ int TCPIPPort::SetCommand(const char* command, const char* term)
 	if (term != 0)
 		cmd += term;
 
-	boost::asio::write(sock_, boost::asio::buffer(cmd));
+	RunOnIoThread([&](boost::system::error_code& ec) {
+		boost::asio::write(sock_, boost::asio::buffer(cmd), ec);
+	});
 
 	LogAsciiCommunication("SetCommand", false, cmd);
 	ERRH_END
 }
 
-//mostly copied from SerialManager.cpp (Serialport::GetAnswer)
+//semantics follow SerialManager.cpp (Serialport::GetAnswer), but instead of
+//polling the socket we wait for the I/O thread to signal new data
 int TCPIPPort::GetAnswer(char* txt, unsigned maxChars, const char* term)
 {
 ERRH_START
@@ -155,52 +276,53 @@ ERRH_START
 		LogMessage("BUFFER_OVERRUN error occured!");
 		return ERR_BUFFER_OVERRUN;
 	}
-	std::ostringstream logMsg;
-	unsigned long answerOffset = 0;
 	memset(txt, 0, maxChars);
-	char theData = 0;
-
-	MM::MMTime startTime = GetCurrentMMTime();
-	MM::MMTime answerTimeout(answerTimeoutMs_ * 1000.0);
-	MM::MMTime nonTerminatedAnswerTimeout(5.0 * 1000.0); // For bug-compatibility
-	while ((GetCurrentMMTime() - startTime) < answerTimeout)
-	{
-		boost::asio::socket_base::bytes_readable command(true);
-		sock_.io_control(command);
-		size_t bytes_readable = command.get();
 
-		if (bytes_readable > 0)
-		{
-			sock_.read_some(boost::asio::buffer(&theData, 1));
+	const std::string terminator(term ? term : "");
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	const std::chrono::steady_clock::time_point deadline = startTime + std::chrono::milliseconds(answerTimeoutMs_);
+	// For bug-compatibility
+	const std::chrono::steady_clock::time_point nonTerminatedDeadline = startTime + std::chrono::seconds(5);
 
-			if (maxChars <= answerOffset)
-			{
-				txt[answerOffset] = '\0';
-				LogMessage("BUFFER_OVERRUN error occured!");
-				return ERR_BUFFER_OVERRUN;
-			}
-			txt[answerOffset++] = theData;
-		}
-		else
-		{
-			//Yield to other threads:
-			CDeviceUtils::SleepMs(1);
-		}
+	std::unique_lock<std::mutex> lock(rxMutex_);
+	if (rxOverrun_)
+	{
+		rxOverrun_ = false;
+		LogMessage("Receive buffer overflowed; some data was lost");
+	}
 
-		// look for the terminator, if any
-		if (term && term[0])
+	std::size_t searchFrom = 0;
+	for (;;)
+	{
+		if (!terminator.empty())
 		{
-			// check for terminating sequence
-			char* termPos = strstr(txt, term);
-			if (termPos != 0) // found the terminator
+			// check for terminating sequence, resuming where the last search stopped
+			boost::circular_buffer<char>::iterator begin = rxBuffer_.begin() +
+				std::min(searchFrom, rxBuffer_.size());
+			boost::circular_buffer<char>::iterator termPos =
+				std::search(begin, rxBuffer_.end(), terminator.begin(), terminator.end());
+			if (termPos != rxBuffer_.end()) // found the terminator
 			{
-				LogAsciiCommunication("GetAnswer", true, txt);
+				std::size_t answerLength = termPos - rxBuffer_.begin();
+				std::size_t consumed = answerLength + terminator.size();
+				if (answerLength >= maxChars)
+				{
+					rxBuffer_.erase_begin(consumed);
+					LogMessage("BUFFER_OVERRUN error occured!");
+					return ERR_BUFFER_OVERRUN;
+				}
+				std::string answer(rxBuffer_.begin(), rxBuffer_.begin() + consumed);
+				rxBuffer_.erase_begin(consumed);
+				lock.unlock();
 
-				// erase the terminator from the answer:
-				*termPos = '\0';
+				LogAsciiCommunication("GetAnswer", true, answer);
 
+				// copy without the terminator
+				memcpy(txt, answer.c_str(), answerLength);
 				return DEVICE_OK;
 			}
+			if (rxBuffer_.size() >= terminator.size())
+				searchFrom = rxBuffer_.size() - terminator.size() + 1;
 		}
 		else
 		{
@@ -209,19 +331,44 @@ ERRH_START
 			// sure that no device adapter calls us without a terminator. For now,
 			// keep the behavior for the sake of bug-compatibility.
 
-			MM::MMTime elapsed = GetCurrentMMTime() - startTime;
-			if (elapsed > nonTerminatedAnswerTimeout)
+			if (std::chrono::steady_clock::now() >= nonTerminatedDeadline)
 			{
-				LogAsciiCommunication("GetAnswer", true, txt);
-				long millisecs = static_cast<long>(elapsed.getMsec());
+				std::size_t answerLength = std::min<std::size_t>(rxBuffer_.size(), maxChars - 1);
+				std::string answer(rxBuffer_.begin(), rxBuffer_.begin() + answerLength);
+				rxBuffer_.erase_begin(answerLength);
+				lock.unlock();
+
+				LogAsciiCommunication("GetAnswer", true, answer);
+				memcpy(txt, answer.c_str(), answerLength);
+				long millisecs = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::steady_clock::now() - startTime).count());
 				LogMessage(("GetAnswer without terminator returning after " +
 					boost::lexical_cast<std::string>(millisecs) +
 					"msec").c_str(), true);
 				return DEVICE_OK;
 			}
 		}
+
+		if (rxClosed_)
+		{
+			std::string error = rxError_;
+			lock.unlock();
+			LogMessage(("Connection closed: " + error).c_str());
+			return ERR_CONNECTION_CLOSED;
+		}
+
+		std::chrono::steady_clock::time_point wakeup = deadline;
+		if (terminator.empty() && nonTerminatedDeadline < wakeup)
+			wakeup = nonTerminatedDeadline;
+		if (rxCond_.wait_until(lock, wakeup) == std::cv_status::timeout &&
+			std::chrono::steady_clock::now() >= deadline)
+			break;
 	}
 
+	// what was received so far is discarded, as if it had been read
+	rxBuffer_.clear();
+	lock.unlock();
+
 	LogMessage("TERM_TIMEOUT error occured!");
 	return ERR_TERM_TIMEOUT;
 	ERRH_END
@@ -233,24 +380,29 @@ int TCPIPPort::Write(const unsigned char* buf, unsigned long bufLen)
 		if (!initialized_)
 			return ERR_PORT_NOTINITIALIZED;
 
-	boost::asio::write(sock_, boost::asio::buffer(buf, bufLen));
+	RunOnIoThread([&](boost::system::error_code& ec) {
+		boost::asio::write(sock_, boost::asio::buffer(buf, bufLen), ec);
+	});
 
 	LogBinaryCommunication("Write", false, buf, bufLen);
 	ERRH_END
 }
 
+// Returns whatever has been received so far (up to bufLen), without waiting
 int TCPIPPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead)
 {
 	ERRH_START
 		if (!initialized_)
 			return ERR_PORT_NOTINITIALIZED;
 
-	if (bufLen < 0)
-		return ERR_BUFFER_OVERRUN;
-
 	memset(buf, 0, bufLen);
 
-	charsRead = (unsigned long)boost::asio::read(sock_, boost::asio::buffer(buf, bufLen));
+	{
+		std::lock_guard<std::mutex> lock(rxMutex_);
+		charsRead = (unsigned long)std::min<std::size_t>(bufLen, rxBuffer_.size());
+		std::copy(rxBuffer_.begin(), rxBuffer_.begin() + charsRead, buf);
+		rxBuffer_.erase_begin(charsRead);
+	}
 
 	if (charsRead > 0)
 		LogBinaryCommunication("Read", true, buf, charsRead);
@@ -259,6 +411,8 @@ int TCPIPPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& cha
 
 int TCPIPPort::Purge()
 {
+	std::lock_guard<std::mutex> lock(rxMutex_);
+	rxBuffer_.clear();
 	return DEVICE_OK;
 }
 
@@ -320,6 +474,42 @@ int TCPIPPort::OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
+int TCPIPPort::OnNoDelay(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+ERRH_START
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(noDelay_ ? "Yes" : "No");
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		std::string s;
+		pProp->Get(s);
+		noDelay_ = (s == "Yes");
+		if (initialized_)
+			RunOnIoThread([this](boost::system::error_code& ec) { ApplySocketOptions(ec); });
+	}
+ERRH_END
+}
+
+int TCPIPPort::OnKeepAlive(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+ERRH_START
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(keepAlive_ ? "Yes" : "No");
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		std::string s;
+		pProp->Get(s);
+		keepAlive_ = (s == "Yes");
+		if (initialized_)
+			RunOnIoThread([this](boost::system::error_code& ec) { ApplySocketOptions(ec); });
+	}
+ERRH_END
+}
+
 int TCPIPPort::GetCount()
 {
 	return count_;
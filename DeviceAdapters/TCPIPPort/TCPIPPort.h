@@ -24,8 +24,15 @@
 #pragma once
 
 #include "boost/asio.hpp"
+#include "boost/circular_buffer.hpp"
 
+#include <condition_variable>
+#include <functional>
 #include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "MMDevice.h"
 #include "DeviceBase.h"
@@ -38,6 +45,7 @@
 #define ERR_TERM_TIMEOUT 107
 #define ERR_PORT_CHANGE_FORBIDDEN 109
 #define ERR_PORT_NOTINITIALIZED 111
+#define ERR_CONNECTION_CLOSED 112
 
 extern const char* deviceName;
 
@@ -67,6 +75,8 @@ public:
 	int OnHost(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnPort(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnNoDelay(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnKeepAlive(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 	void close_sock();
 
@@ -84,6 +94,27 @@ private:
 	std::string host_;
 	unsigned short port_;
 	unsigned int answerTimeoutMs_;
+	bool noDelay_;
+	bool keepAlive_;
+
+	// All socket operations run on ioThread_, which always keeps a read
+	// pending. Received bytes are appended to rxBuffer_ and waiters in
+	// GetAnswer()/Read() are woken through rxCond_ as soon as data arrives.
+	std::thread ioThread_;
+	std::unique_ptr<boost::asio::io_service::work> ioWork_;
+	std::mutex rxMutex_;
+	std::condition_variable rxCond_;
+	boost::circular_buffer<char> rxBuffer_;
+	bool rxOverrun_;
+	bool rxClosed_;
+	std::string rxError_;
+	char rxChunk_[4096];
+
+	void StartReceive();
+	void OnReceive(const boost::system::error_code& ec, std::size_t bytesRead);
+	void ApplySocketOptions(boost::system::error_code& ec);
+	void RunOnIoThread(const std::function<void(boost::system::error_code&)>& op);
+	void StopIoThread();
 
 	void LogAsciiCommunication(const char * prefix, bool isInput, const std::string & data);
 	void LogBinaryCommunication(const char* prefix, bool isInput, const unsigned char* content, std::size_t length);
@@ -0,0 +1,268 @@
+// Tests for the TCP/IP serial port, run against a loopback server
+
+#include <gtest/gtest.h>
+
+#include "TCPIPPort.h"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+
+// Accepts one connection and echoes back everything received, optionally
+// splitting each reply into single-byte writes. All socket operations run on
+// the server's own thread.
+class LoopbackServer
+{
+public:
+   explicit LoopbackServer(bool splitReplies = false) :
+      acceptor_(ios_, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+      client_(ios_),
+      splitReplies_(splitReplies)
+   {
+      acceptor_.async_accept(client_, [this](const boost::system::error_code& ec) {
+         if (!ec)
+            StartRead();
+      });
+      thread_ = std::thread([this]() { ios_.run(); });
+   }
+
+   ~LoopbackServer()
+   {
+      Close();
+      thread_.join();
+   }
+
+   unsigned short GetPort() const { return port_; }
+
+   void Send(const std::string& data)
+   {
+      ios_.post([this, data]() {
+         boost::system::error_code ec;
+         boost::asio::write(client_, boost::asio::buffer(data), ec);
+      });
+   }
+
+   void Close()
+   {
+      ios_.post([this]() {
+         boost::system::error_code ec;
+         acceptor_.close(ec);
+         client_.shutdown(tcp::socket::shutdown_both, ec);
+         client_.close(ec);
+      });
+   }
+
+private:
+   void StartRead()
+   {
+      client_.async_read_some(boost::asio::buffer(buf_),
+         [this](const boost::system::error_code& ec, std::size_t n) {
+            if (ec)
+               return;
+            boost::system::error_code writeEc;
+            if (splitReplies_)
+            {
+               for (std::size_t i = 0; i < n; ++i)
+                  boost::asio::write(client_, boost::asio::buffer(buf_ + i, 1), writeEc);
+            }
+            else
+            {
+               boost::asio::write(client_, boost::asio::buffer(buf_, n), writeEc);
+            }
+            StartRead();
+         });
+   }
+
+   boost::asio::io_service ios_;
+   tcp::acceptor acceptor_;
+   const unsigned short port_ = acceptor_.local_endpoint().port();
+   tcp::socket client_;
+   bool splitReplies_;
+   char buf_[1024];
+   std::thread thread_;
+};
+
+
+class TCPIPPortTest : public ::testing::Test
+{
+protected:
+   void Connect(LoopbackServer& server, const char* answerTimeoutMs = "500")
+   {
+      port_.reset(new TCPIPPort(1));
+      ASSERT_EQ(DEVICE_OK, port_->SetProperty("TCP Port",
+         std::to_string(server.GetPort()).c_str()));
+      ASSERT_EQ(DEVICE_OK, port_->SetProperty("Answer timeout", answerTimeoutMs));
+      ASSERT_EQ(DEVICE_OK, port_->Initialize());
+   }
+
+   void TearDown()
+   {
+      if (port_)
+         port_->Shutdown();
+   }
+
+   std::unique_ptr<TCPIPPort> port_;
+};
+
+
+TEST_F(TCPIPPortTest, CommandAndAnswer)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("HELLO", "\r\n"));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\r\n"));
+   EXPECT_STREQ("HELLO", answer);
+}
+
+TEST_F(TCPIPPortTest, AnswerArrivingBytewise)
+{
+   LoopbackServer server(true);
+   Connect(server);
+
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("ABC\r\nDEF", "\r\n"));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\r\n"));
+   EXPECT_STREQ("ABC", answer);
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\r\n"));
+   EXPECT_STREQ("DEF", answer);
+}
+
+TEST_F(TCPIPPortTest, AnswerTooLong)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   char answer[4];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("TOOLONG\rOK", "\r"));
+   EXPECT_EQ(ERR_BUFFER_OVERRUN, port_->GetAnswer(answer, sizeof(answer), "\r"));
+   // The oversized answer is consumed; the next one is intact
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\r"));
+   EXPECT_STREQ("OK", answer);
+}
+
+TEST_F(TCPIPPortTest, TimeoutWithoutTerminator)
+{
+   LoopbackServer server;
+   Connect(server, "100");
+
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("PARTIAL", 0));
+   auto start = std::chrono::steady_clock::now();
+   EXPECT_EQ(ERR_TERM_TIMEOUT, port_->GetAnswer(answer, sizeof(answer), "\r"));
+   EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+}
+
+TEST_F(TCPIPPortTest, UnsolicitedDataIsBuffered)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   // Make sure the server has accepted before it pushes data
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("SYNC", "\n"));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\n"));
+
+   server.Send("EVENT\n");
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\n"));
+   EXPECT_STREQ("EVENT", answer);
+}
+
+TEST_F(TCPIPPortTest, ReadDoesNotBlock)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   unsigned char buf[16];
+   unsigned long n = 99;
+   ASSERT_EQ(DEVICE_OK, port_->Read(buf, sizeof(buf), n));
+   EXPECT_EQ(0u, n);
+
+   const unsigned char data[] = { 0x00, 0x01, 0xff };
+   ASSERT_EQ(DEVICE_OK, port_->Write(data, sizeof(data)));
+   unsigned long total = 0;
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+   while (total < sizeof(data) && std::chrono::steady_clock::now() < deadline)
+   {
+      ASSERT_EQ(DEVICE_OK, port_->Read(buf + total, sizeof(buf) - total, n));
+      total += n;
+   }
+   ASSERT_EQ(sizeof(data), total);
+   EXPECT_EQ(0, std::memcmp(data, buf, sizeof(data)));
+}
+
+TEST_F(TCPIPPortTest, PurgeDiscardsPendingData)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("STALE", "\n"));
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+   ASSERT_EQ(DEVICE_OK, port_->Purge());
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("FRESH", "\n"));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\n"));
+   EXPECT_STREQ("FRESH", answer);
+}
+
+TEST_F(TCPIPPortTest, RemoteCloseIsReported)
+{
+   LoopbackServer server;
+   Connect(server, "2000");
+
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("SYNC", "\n"));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\n"));
+
+   server.Close();
+   // Reported as a closed connection, not as an answer timeout
+   EXPECT_EQ(ERR_CONNECTION_CLOSED, port_->GetAnswer(answer, sizeof(answer), "\n"));
+}
+
+TEST_F(TCPIPPortTest, NoDelayCanBeToggled)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   char value[MM::MaxStrLength];
+   ASSERT_EQ(DEVICE_OK, port_->GetProperty("TCP_NODELAY", value));
+   EXPECT_STREQ("Yes", value);
+   ASSERT_EQ(DEVICE_OK, port_->SetProperty("TCP_NODELAY", "No"));
+   ASSERT_EQ(DEVICE_OK, port_->SetProperty("Keepalive", "Yes"));
+
+   char answer[64];
+   ASSERT_EQ(DEVICE_OK, port_->SetCommand("STILL OK", "\n"));
+   ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\n"));
+   EXPECT_STREQ("STILL OK", answer);
+}
+
+// The round-trip latency is measured by MMCore-Benchmarks (serial_round_trip)
+TEST_F(TCPIPPortTest, RepeatedRoundTrips)
+{
+   LoopbackServer server;
+   Connect(server);
+
+   char answer[64];
+   for (int i = 0; i < 200; ++i)
+   {
+      const std::string command = "PING " + std::to_string(i);
+      ASSERT_EQ(DEVICE_OK, port_->SetCommand(command.c_str(), "\r"));
+      ASSERT_EQ(DEVICE_OK, port_->GetAnswer(answer, sizeof(answer), "\r"));
+      ASSERT_STREQ(command.c_str(), answer);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
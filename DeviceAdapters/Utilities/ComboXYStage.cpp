@@ -43,7 +43,8 @@ extern const char* g_Undefined;
 ComboXYStage::ComboXYStage() :
    simulatedXStepSizeUm_(0.01),
    simulatedYStepSizeUm_(0.01),
-   initialized_(0)
+   initialized_(0),
+   precomputeSequence_(false)
 {
    InitializeDefaultErrorMessages();
    SetErrorText(ERR_INVALID_DEVICE_NAME, "Invalid stage device");
@@ -121,6 +122,16 @@ int ComboXYStage::Initialize()
          new CPropertyActionEx(this, &ComboXYStage::OnTranslationUm, i));
    }
 
+   CreateStringProperty("ConcurrentDispatch", "Yes", false,
+      new CPropertyAction(this, &ComboXYStage::OnConcurrentDispatch));
+   AddAllowedValue("ConcurrentDispatch", "No");
+   AddAllowedValue("ConcurrentDispatch", "Yes");
+
+   CreateStringProperty("PrecomputeSequence", "No", false,
+      new CPropertyAction(this, &ComboXYStage::OnPrecomputeSequence));
+   AddAllowedValue("PrecomputeSequence", "No");
+   AddAllowedValue("PrecomputeSequence", "Yes");
+
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -134,6 +145,7 @@ int ComboXYStage::Shutdown()
    usedStages_.clear();
    stageScalings_.clear();
    stageTranslations_.clear();
+   pendingSequences_.clear();
 
    return DEVICE_OK;
 }
@@ -141,19 +153,13 @@ int ComboXYStage::Shutdown()
 
 bool ComboXYStage::Busy()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      if (stage->Busy())
-         return true;
-   }
-   return false;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<char> busy(stages.size(), 0);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      busy[i] = stages[i]->Busy() ? 1 : 0;
+      return DEVICE_OK;
+   });
+   return std::find(busy.begin(), busy.end(), 1) != busy.end();
 }
 
 
@@ -161,42 +167,29 @@ int ComboXYStage::Stop()
 {
    // Return last error encountered, but make sure Stop() is attempted on both
    // axes.
-   int ret = DEVICE_OK;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<int> errors(stages.size(), DEVICE_OK);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      errors[i] = static_cast<MM::Stage*>(stages[i])->Stop();
+      return DEVICE_OK;
+   });
 
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
+   int lastErr = DEVICE_OK;
+   for (std::size_t i = 0; i < errors.size(); ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Stop();
-      if (err != DEVICE_OK)
-         ret = err;
+      if (errors[i] != DEVICE_OK)
+         lastErr = errors[i];
    }
-
-   return ret;
+   return lastErr;
 }
 
 
 int ComboXYStage::Home()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Home();
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
+      return static_cast<MM::Stage*>(stages[i])->Home();
+   });
 }
 
 
@@ -204,51 +197,43 @@ int ComboXYStage::SetPositionSteps(long x, long y)
 {
    LogMessage(("SetPositionSteps(" + boost::lexical_cast<std::string>(x) + ", " + boost::lexical_cast<std::string>(y) + ")").c_str(), true);
 
-   for (int i = 0; i < 2; ++i)
-   {
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
       const long posSteps = (i == 0) ? x : y;
-
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
       const double& simulatedStepSizeUm = (i == 0) ?
          simulatedXStepSizeUm_ : simulatedYStepSizeUm_;
       double logicalPosUm = static_cast<double>(posSteps) * simulatedStepSizeUm;
       double physicalPosUm = stageScalings_[i] * logicalPosUm + stageTranslations_[i];
-      int err = stage->SetPositionUm(physicalPosUm);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+      return static_cast<MM::Stage*>(stages[i])->SetPositionUm(physicalPosUm);
+   });
 }
 
 
 int ComboXYStage::GetPositionSteps(long& x, long& y)
 {
-   for (int i = 0; i < 2; ++i)
-   {
-      long& posSteps = (i == 0) ? x : y;
+   // We can't make a missing stage an error because stage position is
+   // frequently requested before anybody has a chance to set the physical
+   // stages.
+   long posSteps[2] = { 0, 0 };
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   int err = fanOut_.Run(stages, [&](std::size_t i) {
       const double& simulatedStepSizeUm = (i == 0) ?
          simulatedXStepSizeUm_ : simulatedYStepSizeUm_;
 
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-      {
-         // We can't make this an error because stage position is frequently
-         // requested before anybody has a chance to set the physical stages.
-         posSteps = 0;
-         continue;
-      }
-
       double physicalPosUm;
-      int err = stage->GetPositionUm(physicalPosUm);
-      if (err != DEVICE_OK)
-         return err;
+      int ret = static_cast<MM::Stage*>(stages[i])->GetPositionUm(physicalPosUm);
+      if (ret != DEVICE_OK)
+         return ret;
 
       double logicalPosUm = (physicalPosUm - stageTranslations_[i]) / stageScalings_[i];
-      posSteps = Round(logicalPosUm / simulatedStepSizeUm);
-   }
+      posSteps[i] = Round(logicalPosUm / simulatedStepSizeUm);
+      return DEVICE_OK;
+   });
+   if (err != DEVICE_OK)
+      return err;
+
+   x = posSteps[0];
+   y = posSteps[1];
 
    LogMessage(("GetPositionSteps() -> (" + boost::lexical_cast<std::string>(x) + ", " + boost::lexical_cast<std::string>(y) + ")").c_str(), true);
    return DEVICE_OK;
@@ -347,29 +332,28 @@ int ComboXYStage::GetXYStageSequenceMaxLength(long& nrEvents) const
 
 int ComboXYStage::StartXYStageSequence()
 {
-   int startedStages = 0;
-   int err;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
    for (int i = 0; i < 2; ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-      {
-         err = ERR_NO_PHYSICAL_STAGE;
-         goto error;
-      }
-
-      err = stage->StartStageSequence();
-      if (err != DEVICE_OK)
-         goto error;
-      ++startedStages;
+      if (!stages[i])
+         return ERR_NO_PHYSICAL_STAGE;
    }
-   return DEVICE_OK;
 
-error:
-   while (startedStages > 0)
+   // Keep track of started stages in order to stop upon error
+   std::vector<char> started(stages.size(), 0);
+   int err = fanOut_.Run(stages, [&](std::size_t i) {
+      int ret = static_cast<MM::Stage*>(stages[i])->StartStageSequence();
+      if (ret == DEVICE_OK)
+         started[i] = 1;
+      return ret;
+   });
+   if (err == DEVICE_OK)
+      return DEVICE_OK;
+
+   for (std::size_t i = stages.size(); i > 0; --i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[--startedStages].c_str());
-      stage->StopStageSequence();
+      if (started[i - 1])
+         static_cast<MM::Stage*>(stages[i - 1])->StopStageSequence();
    }
    return err;
 }
@@ -377,17 +361,19 @@ error:
 
 int ComboXYStage::StopXYStageSequence()
 {
+   // Try to stop all even after error or missing stage
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<int> errors(stages.size(), DEVICE_OK);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      errors[i] = static_cast<MM::Stage*>(stages[i])->StopStageSequence();
+      return DEVICE_OK;
+   });
+
    int lastErr = DEVICE_OK;
-   for (int i = 0; i < 2; ++i)
+   for (std::size_t i = 0; i < errors.size(); ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->StopStageSequence();
-      if (err != DEVICE_OK)
-         lastErr = err;
-      // Try to stop all even after error or missing stage
+      if (errors[i] != DEVICE_OK)
+         lastErr = errors[i];
    }
    return lastErr;
 }
@@ -395,16 +381,21 @@ int ComboXYStage::StopXYStageSequence()
 
 int ComboXYStage::ClearXYStageSequence()
 {
+   for (std::size_t i = 0; i < pendingSequences_.size(); ++i)
+      pendingSequences_[i].clear();
+
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<int> errors(stages.size(), DEVICE_OK);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      errors[i] = static_cast<MM::Stage*>(stages[i])->ClearStageSequence();
+      return DEVICE_OK;
+   });
+
    int lastErr = DEVICE_OK;
-   for (int i = 0; i < 2; ++i)
+   for (std::size_t i = 0; i < errors.size(); ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->ClearStageSequence();
-      if (err != DEVICE_OK)
-         lastErr = err;
+      if (errors[i] != DEVICE_OK)
+         lastErr = errors[i];
    }
    return lastErr;
 }
@@ -412,41 +403,75 @@ int ComboXYStage::ClearXYStageSequence()
 
 int ComboXYStage::AddToXYStageSequence(double positionX, double positionY)
 {
+   std::vector<MM::Device*> stages = GetPhysicalStages();
    for (int i = 0; i < 2; ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
+      if (!stages[i])
          return ERR_NO_PHYSICAL_STAGE;
    }
-   for (int i = 0; i < 2; ++i)
+
+   if (precomputeSequence_)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
+      pendingSequences_.resize(2);
+      for (int i = 0; i < 2; ++i)
+      {
+         const double& logicalPos = (i == 0) ? positionX : positionY;
+         pendingSequences_[i].push_back(stageScalings_[i] * logicalPos + stageTranslations_[i]);
+      }
+      return DEVICE_OK;
+   }
+
+   return fanOut_.Run(stages, [&](std::size_t i) {
       const double& logicalPos = (i == 0) ? positionX : positionY;
       double physicalPos = stageScalings_[i] * logicalPos + stageTranslations_[i];
-      int err = stage->AddToStageSequence(physicalPos);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+      return static_cast<MM::Stage*>(stages[i])->AddToStageSequence(physicalPos);
+   });
 }
 
 
 int ComboXYStage::SendXYStageSequence()
 {
+   std::vector<MM::Device*> stages = GetPhysicalStages();
    for (int i = 0; i < 2; ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
+      if (!stages[i])
          return ERR_NO_PHYSICAL_STAGE;
    }
-   for (int i = 0; i < 2; ++i)
+
+   return fanOut_.Run(stages, [&](std::size_t i) {
+      MM::Stage* stage = static_cast<MM::Stage*>(stages[i]);
+      if (precomputeSequence_ && i < pendingSequences_.size())
+      {
+         // Load the whole precomputed sequence for this axis
+         int err = stage->ClearStageSequence();
+         if (err != DEVICE_OK)
+            return err;
+         for (std::vector<double>::const_iterator it = pendingSequences_[i].begin(),
+            end = pendingSequences_[i].end(); it != end; ++it)
+         {
+            err = stage->AddToStageSequence(*it);
+            if (err != DEVICE_OK)
+               return err;
+         }
+      }
+      return stage->SendStageSequence();
+   });
+}
+
+
+std::vector<MM::Device*> ComboXYStage::GetPhysicalStages() const
+{
+   // Null for unassigned axes, so that indices match usedStages_
+   std::vector<MM::Device*> stages;
+   stages.reserve(usedStages_.size());
+   for (std::vector<std::string>::const_iterator it = usedStages_.begin(),
+      end = usedStages_.end();
+      it != end;
+      ++it)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      int err = stage->SendStageSequence();
-      if (err != DEVICE_OK)
-         return err;
+      stages.push_back(GetDevice((*it).c_str()));
    }
-   return DEVICE_OK;
+   return stages;
 }
 
 
@@ -458,6 +483,7 @@ int ComboXYStage::OnPhysicalStage(MM::PropertyBase* pProp, MM::ActionType eAct,
    }
    else if (eAct == MM::AfterSet)
    {
+      fanOut_.InvalidateGroupKeys();
       std::string stageLabel;
       pProp->Get(stageLabel);
 
@@ -529,3 +555,36 @@ int ComboXYStage::OnTranslationUm(MM::PropertyBase* pProp, MM::ActionType eAct,
    }
    return DEVICE_OK;
 }
+
+
+int ComboXYStage::OnConcurrentDispatch(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(fanOut_.IsConcurrent() ? "Yes" : "No");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string s;
+      pProp->Get(s);
+      fanOut_.SetConcurrent(s == "Yes");
+   }
+   return DEVICE_OK;
+}
+
+
+int ComboXYStage::OnPrecomputeSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(precomputeSequence_ ? "Yes" : "No");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string s;
+      pProp->Get(s);
+      precomputeSequence_ = (s == "Yes");
+      pendingSequences_.clear();
+   }
+   return DEVICE_OK;
+}
@@ -32,20 +32,47 @@
 
 #include "Utilities.h"
 
+#include <algorithm>
 #include <chrono>
+#include <sstream>
 #include <thread>
 
 
 extern const char* g_NoDevice;
 extern const char* g_DeviceNameDAGalvoDevice;
 
+const char* const g_TimingAuto = "Auto";
+const char* const g_TimingHardware = "Hardware";
+const char* const g_TimingSoftware = "Software";
+const char* const g_FillOutline = "Outline";
+const char* const g_FillRaster = "Raster";
+
+// Guards against runaway memory use from a tiny point or line spacing
+const std::size_t g_MaxWaveformSamples = 16 * 1024 * 1024;
+
 DAGalvo::DAGalvo() :
    daXDevice_(g_NoDevice),
    daYDevice_(g_NoDevice),
+   initialized_(false),
+   nrRepetitions_(1),
    shutter_(g_NoDevice),
-   pulseIntervalUs_(100000),
-   initialized_(false)
+   timing_(g_TimingAuto),
+   sampleIntervalUs_(10.0),
+   rasterFill_(false),
+   pointSpacing_(0.0),
+   lineSpacing_(0.05),
+   dwellSamples_(1),
+   waveformInHardware_(false),
+   running_(false),
+   stopRequested_(false)
 {
+   InitializeDefaultErrorMessages();
+   SetErrorText(ERR_NO_DA_DEVICE_FOUND, "No DA device found for X and/or Y");
+   SetErrorText(ERR_NO_SHUTTER_DEVICE_FOUND, "No shutter device found");
+   SetErrorText(ERR_DA_NOT_SEQUENCEABLE,
+      "Timing is Hardware, but the X and Y DA devices are not both sequenceable");
+   SetErrorText(ERR_WAVEFORM_TOO_LONG,
+      "The polygons compile to more samples than the DA devices can hold");
 }
 
 DAGalvo::~DAGalvo()
@@ -103,11 +130,53 @@ int DAGalvo::Initialize()
          break;
    }
 
+   // Polygon waveform settings. With Hardware timing, both DA devices must
+   // be sequenceable and clocked together at the sample interval (e.g. by a
+   // common trigger); with Software timing, samples are written one by one
+   // from a timer thread.
+   pAct = new CPropertyAction(this, &DAGalvo::OnTiming);
+   ret = CreateStringProperty("Polygon Timing", timing_.c_str(), false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue("Polygon Timing", g_TimingAuto);
+   AddAllowedValue("Polygon Timing", g_TimingHardware);
+   AddAllowedValue("Polygon Timing", g_TimingSoftware);
+
+   pAct = new CPropertyAction(this, &DAGalvo::OnSampleInterval);
+   ret = CreateFloatProperty("Sample Interval (us)", sampleIntervalUs_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &DAGalvo::OnFillMode);
+   ret = CreateStringProperty("Polygon Fill", g_FillOutline, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue("Polygon Fill", g_FillOutline);
+   AddAllowedValue("Polygon Fill", g_FillRaster);
+
+   pAct = new CPropertyAction(this, &DAGalvo::OnPointSpacing);
+   ret = CreateFloatProperty("Point Spacing", pointSpacing_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &DAGalvo::OnLineSpacing);
+   ret = CreateFloatProperty("Raster Line Spacing", lineSpacing_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pAct = new CPropertyAction(this, &DAGalvo::OnDwellSamples);
+   ret = CreateIntegerProperty("Dwell Samples Per Point", dwellSamples_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("Dwell Samples Per Point", 1, 1000);
+
+   initialized_ = true;
    return DEVICE_OK;
 }
 
 int DAGalvo::Shutdown()
 {
+   StopRun();
    initialized_ = false;
    return DEVICE_OK;
 }
@@ -119,6 +188,9 @@ void DAGalvo::GetName(char* name) const
 
 bool DAGalvo::Busy()
 {
+   if (running_)
+      return true;
+
    MM::SignalIO* dax = static_cast<MM::SignalIO*>(GetDevice(daXDevice_.c_str()));
    if (dax && dax->Busy())
       return true;
@@ -149,11 +221,21 @@ int DAGalvo::PointAndFire(double x, double y, double timeUs)
 }
 
 /*
-* This appears to set the time a single spot should be illuminated
+* This appears to set the time a single spot should be illuminated.
+* It sets the dwell per point, rounded to whole samples at the current
+* sample interval.
 */
 int DAGalvo::SetSpotInterval(double pulseIntervalUs)
 {
-   pulseIntervalUs_ = pulseIntervalUs;
+   if (!(pulseIntervalUs > 0.0))
+      return DEVICE_INVALID_INPUT_PARAM;
+   const long dwell = std::min(1000L, std::max(1L,
+      static_cast<long>(pulseIntervalUs / sampleIntervalUs_ + 0.5)));
+   if (dwell != dwellSamples_)
+   {
+      InvalidateWaveform();
+      dwellSamples_ = dwell;
+   }
    return DEVICE_OK;
 }
 
@@ -167,6 +249,9 @@ int DAGalvo::SetIlluminationState(bool on)
 
 int DAGalvo::SetPosition(double x, double y)
 {
+   // A running polygon sequence would move the galvo right away
+   StopRun();
+
    MM::SignalIO* dax = static_cast<MM::SignalIO*>(GetDevice(daXDevice_.c_str()));
    if (!dax)
       return ERR_NO_DA_DEVICE_FOUND;
@@ -236,21 +321,114 @@ double DAGalvo::GetYMinimum()
    return yMin;
 }
 
-int DAGalvo::AddPolygonVertex(int /* polygonIndex */, double /* x */, double /* y */)
+int DAGalvo::AddPolygonVertex(int polygonIndex, double x, double y)
 {
-   return DEVICE_NOT_YET_IMPLEMENTED;
+   if (polygonIndex < 0)
+      return DEVICE_INVALID_INPUT_PARAM;
+   InvalidateWaveform();
+   if (polygons_.size() <= static_cast<std::size_t>(polygonIndex))
+      polygons_.resize(polygonIndex + 1);
+   polygons_[polygonIndex].push_back(std::make_pair(x, y));
+   return DEVICE_OK;
 }
+
 int DAGalvo::DeletePolygons()
 {
-   return DEVICE_NOT_YET_IMPLEMENTED;
+   InvalidateWaveform();
+   polygons_.clear();
+   return DEVICE_OK;
 }
-int DAGalvo::RunSequence()
+
+/*
+ * Compiles the polygons into X and Y waveforms of equal length and, unless
+ * timing is Software, uploads them as DA sequences. Auto timing falls back
+ * to software timing if either DA device cannot hold the sequence.
+ */
+int DAGalvo::LoadPolygons()
 {
-   return DEVICE_NOT_YET_IMPLEMENTED;
+   StopRun();
+
+   MM::SignalIO* dax = static_cast<MM::SignalIO*>(GetDevice(daXDevice_.c_str()));
+   MM::SignalIO* day = static_cast<MM::SignalIO*>(GetDevice(daYDevice_.c_str()));
+   if (!dax || !day)
+      return ERR_NO_DA_DEVICE_FOUND;
+
+   GalvoWaveformSettings settings;
+   settings.rasterFill = rasterFill_;
+   settings.pointSpacing = pointSpacing_;
+   settings.lineSpacing = lineSpacing_;
+   settings.dwellSamples = dwellSamples_;
+   settings.maxSamples = g_MaxWaveformSamples;
+
+   waveformX_.clear();
+   waveformY_.clear();
+   waveformInHardware_ = false;
+   if (!CompileGalvoWaveform(polygons_, settings, waveformX_, waveformY_))
+   {
+      waveformX_.clear();
+      waveformY_.clear();
+      return ERR_WAVEFORM_TOO_LONG;
+   }
+
+   std::ostringstream os;
+   os << "Compiled " << polygons_.size() << " polygon(s) into " <<
+      waveformX_.size() << " samples";
+   LogMessage(os.str().c_str(), true);
+
+   if (timing_ == g_TimingSoftware || waveformX_.empty())
+      return DEVICE_OK;
+
+   bool xSeq = false, ySeq = false;
+   int ret = dax->IsDASequenceable(xSeq);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = day->IsDASequenceable(ySeq);
+   if (ret != DEVICE_OK)
+      return ret;
+   long xMax = 0, yMax = 0;
+   if (xSeq && ySeq)
+   {
+      ret = dax->GetDASequenceMaxLength(xMax);
+      if (ret != DEVICE_OK)
+         return ret;
+      ret = day->GetDASequenceMaxLength(yMax);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   const long needed = static_cast<long>(waveformX_.size());
+   if (!xSeq || !ySeq || xMax < needed || yMax < needed)
+   {
+      if (timing_ == g_TimingHardware)
+         return (xSeq && ySeq) ? ERR_WAVEFORM_TOO_LONG : ERR_DA_NOT_SEQUENCEABLE;
+      LogMessage("DA sequencing unavailable for this waveform; "
+         "polygons will be software-timed", true);
+      return DEVICE_OK;
+   }
+
+   ret = UploadWaveform(dax, waveformX_);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = UploadWaveform(day, waveformY_);
+   if (ret != DEVICE_OK)
+      return ret;
+   waveformInHardware_ = true;
+   return DEVICE_OK;
 }
-int DAGalvo::LoadPolygons()
+
+int DAGalvo::UploadWaveform(MM::SignalIO* da, const std::vector<double>& samples)
 {
-   return DEVICE_NOT_YET_IMPLEMENTED;
+   int ret = da->ClearDASequence();
+   if (ret != DEVICE_OK)
+      return ret;
+   for (std::vector<double>::const_iterator it = samples.begin(),
+      end = samples.end(); it != end; ++it)
+   {
+      ret = da->AddToDASequence(*it);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   return da->SendDASequence();
 }
 
 int DAGalvo::SetPolygonRepetitions(int repetitions)
@@ -262,11 +440,197 @@ int DAGalvo::SetPolygonRepetitions(int repetitions)
 
 int DAGalvo::RunPolygons()
 {
-   return DEVICE_NOT_YET_IMPLEMENTED;
+   return StartRun(std::max(1L, nrRepetitions_));
 }
+
+/*
+ * A sequence of points is given as polygons with a single vertex each, so
+ * it runs the same waveform as RunPolygons(), once.
+ */
+int DAGalvo::RunSequence()
+{
+   return StartRun(1);
+}
+
 int DAGalvo::StopSequence()
 {
-   return DEVICE_NOT_YET_IMPLEMENTED;
+   StopRun();
+   return DEVICE_OK;
+}
+
+int DAGalvo::StartRun(long repetitions)
+{
+   StopRun();
+
+   if (waveformX_.empty() && !polygons_.empty())
+   {
+      int ret = LoadPolygons();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   if (waveformX_.empty())
+      return DEVICE_OK;
+
+   MM::SignalIO* dax = static_cast<MM::SignalIO*>(GetDevice(daXDevice_.c_str()));
+   MM::SignalIO* day = static_cast<MM::SignalIO*>(GetDevice(daYDevice_.c_str()));
+   if (!dax || !day)
+      return ERR_NO_DA_DEVICE_FOUND;
+
+   // Position on the first sample before illuminating
+   int ret = SetPosition(waveformX_[0], waveformY_[0]);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   MM::Shutter* s = static_cast<MM::Shutter*>(GetDevice(shutter_.c_str()));
+   if (s)
+   {
+      ret = s->SetOpen(true);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   if (waveformInHardware_)
+   {
+      // Both sequences are armed before either is clocked, keeping X and Y
+      // sample-aligned
+      ret = day->StartDASequence();
+      if (ret == DEVICE_OK)
+      {
+         ret = dax->StartDASequence();
+         if (ret != DEVICE_OK)
+            day->StopDASequence();
+      }
+      if (ret != DEVICE_OK)
+      {
+         if (s)
+            s->SetOpen(false);
+         return ret;
+      }
+   }
+
+   stopRequested_ = false;
+   running_ = true;
+   if (waveformInHardware_)
+      runThread_ = std::thread(&DAGalvo::RunHardwareTimed, this, repetitions);
+   else
+      runThread_ = std::thread(&DAGalvo::RunSoftwareTimed, this, repetitions);
+   return DEVICE_OK;
+}
+
+void DAGalvo::StopRun()
+{
+   stopRequested_ = true;
+   if (runThread_.joinable())
+      runThread_.join();
+   stopRequested_ = false;
+}
+
+/*
+ * Discards the compiled waveform after a change to the polygons or to the
+ * waveform settings; the next run compiles it again.
+ */
+void DAGalvo::InvalidateWaveform()
+{
+   StopRun();
+   waveformX_.clear();
+   waveformY_.clear();
+   waveformInHardware_ = false;
+}
+
+/*
+ * The DA devices play the sequences on their own clock; this thread only
+ * waits for the expected duration (the sequences wrap around for repeated
+ * runs) and then stops them.
+ */
+void DAGalvo::RunHardwareTimed(long repetitions)
+{
+   const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::microseconds(
+         static_cast<long long>(sampleIntervalUs_ *
+            static_cast<double>(waveformX_.size()) * repetitions));
+   WaitUntil(deadline);
+
+   MM::SignalIO* dax = static_cast<MM::SignalIO*>(GetDevice(daXDevice_.c_str()));
+   MM::SignalIO* day = static_cast<MM::SignalIO*>(GetDevice(daYDevice_.c_str()));
+   if (dax)
+      dax->StopDASequence();
+   if (day)
+      day->StopDASequence();
+   MM::Shutter* s = static_cast<MM::Shutter*>(GetDevice(shutter_.c_str()));
+   if (s)
+      s->SetOpen(false);
+   running_ = false;
+}
+
+/*
+ * Fallback when the DA devices cannot sequence: each sample is written at
+ * its scheduled time. Deadlines are absolute, so a late sample does not
+ * delay the ones after it.
+ */
+void DAGalvo::RunSoftwareTimed(long repetitions)
+{
+   MM::SignalIO* dax = static_cast<MM::SignalIO*>(GetDevice(daXDevice_.c_str()));
+   MM::SignalIO* day = static_cast<MM::SignalIO*>(GetDevice(daYDevice_.c_str()));
+   const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+   const double intervalUs = std::max(0.0, sampleIntervalUs_);
+   const std::size_t n = waveformX_.size();
+
+   long long sampleNr = 0;
+   for (long rep = 0; rep < repetitions && !stopRequested_; ++rep)
+   {
+      for (std::size_t i = 0; i < n && !stopRequested_; ++i, ++sampleNr)
+      {
+         WaitUntil(start + std::chrono::microseconds(
+            static_cast<long long>(intervalUs * sampleNr)));
+         if (stopRequested_)
+            break;
+         // Consecutive samples often repeat a coordinate (dwell, raster lines)
+         if (i == 0 || waveformX_[i] != waveformX_[i - 1])
+         {
+            if (dax->SetSignal(waveformX_[i]) != DEVICE_OK)
+               stopRequested_ = true;
+         }
+         if (i == 0 || waveformY_[i] != waveformY_[i - 1])
+         {
+            if (day->SetSignal(waveformY_[i]) != DEVICE_OK)
+               stopRequested_ = true;
+         }
+      }
+   }
+
+   MM::Shutter* s = static_cast<MM::Shutter*>(GetDevice(shutter_.c_str()));
+   if (s)
+      s->SetOpen(false);
+   running_ = false;
+}
+
+/*
+ * Sleeps until shortly before the deadline, then spins, because sleep
+ * granularity can be a millisecond or more. Returns early on stop.
+ */
+void DAGalvo::WaitUntil(std::chrono::steady_clock::time_point deadline)
+{
+   const std::chrono::microseconds spinMargin(1000);
+   const std::chrono::milliseconds maxSleep(50);
+   for (;;)
+   {
+      if (stopRequested_)
+         return;
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (now >= deadline)
+         return;
+      if (deadline - now > spinMargin)
+      {
+         std::chrono::steady_clock::duration sleep = deadline - now - spinMargin;
+         std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            sleep, maxSleep));
+      }
+      else
+      {
+         std::this_thread::yield();
+      }
+   }
 }
 
 // TODO: once we control illumination, this can be used to provide feedback
@@ -335,3 +699,96 @@ int DAGalvo::OnShutter(MM::PropertyBase* pProp, MM::ActionType eAct)
    }
    return DEVICE_OK;
 }
+
+int DAGalvo::OnTiming(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(timing_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      InvalidateWaveform();
+      pProp->Get(timing_);
+   }
+   return DEVICE_OK;
+}
+
+int DAGalvo::OnSampleInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(sampleIntervalUs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double interval;
+      pProp->Get(interval);
+      if (interval <= 0.0)
+      {
+         pProp->Set(sampleIntervalUs_);
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      StopRun();
+      sampleIntervalUs_ = interval;
+   }
+   return DEVICE_OK;
+}
+
+int DAGalvo::OnFillMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(rasterFill_ ? g_FillRaster : g_FillOutline);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      InvalidateWaveform();
+      std::string fill;
+      pProp->Get(fill);
+      rasterFill_ = (fill == g_FillRaster);
+   }
+   return DEVICE_OK;
+}
+
+int DAGalvo::OnPointSpacing(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(pointSpacing_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      InvalidateWaveform();
+      pProp->Get(pointSpacing_);
+   }
+   return DEVICE_OK;
+}
+
+int DAGalvo::OnLineSpacing(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(lineSpacing_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      InvalidateWaveform();
+      pProp->Get(lineSpacing_);
+   }
+   return DEVICE_OK;
+}
+
+int DAGalvo::OnDwellSamples(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(dwellSamples_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      InvalidateWaveform();
+      pProp->Get(dwellSamples_);
+   }
+   return DEVICE_OK;
+}
@@ -0,0 +1,229 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceFanOut.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Concurrent dispatch of calls to the physical devices behind
+//                the combining 'Meta-Devices'.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include "DeviceFanOut.h"
+
+#include "MMDeviceConstants.h"
+
+
+struct DeviceFanOut::Batch
+{
+   explicit Batch(std::size_t n, const CallFunction& f) :
+      results(n, DEVICE_OK), call(f), remaining(0)
+   {}
+
+   std::vector<int> results;
+   const CallFunction& call;
+
+   std::mutex mutex;
+   std::condition_variable done;
+   std::size_t remaining; // Groups still running on workers
+};
+
+
+DeviceFanOut::DeviceFanOut() :
+   concurrent_(true),
+   stopping_(false)
+{
+}
+
+
+DeviceFanOut::~DeviceFanOut()
+{
+   {
+      std::lock_guard<std::mutex> lock(queueMutex_);
+      stopping_ = true;
+   }
+   queueCond_.notify_all();
+   for (std::vector<std::thread>::iterator it = workers_.begin(),
+      end = workers_.end(); it != end; ++it)
+   {
+      it->join();
+   }
+}
+
+
+int DeviceFanOut::Run(const std::vector<MM::Device*>& devices,
+   const CallFunction& call)
+{
+   // Group device indices, keeping the groups in order of first appearance
+   std::vector<std::vector<std::size_t> > groups;
+   std::map<std::string, std::size_t> groupIndexForKey;
+   for (std::size_t i = 0; i < devices.size(); ++i)
+   {
+      if (!devices[i])
+         continue;
+      if (!concurrent_)
+      {
+         if (groups.empty())
+            groups.resize(1);
+         groups[0].push_back(i);
+         continue;
+      }
+      const std::string key = GroupKey(devices[i]);
+      std::map<std::string, std::size_t>::iterator found =
+         groupIndexForKey.find(key);
+      if (found == groupIndexForKey.end())
+      {
+         groupIndexForKey[key] = groups.size();
+         groups.push_back(std::vector<std::size_t>(1, i));
+      }
+      else
+      {
+         groups[found->second].push_back(i);
+      }
+   }
+
+   if (groups.empty())
+      return DEVICE_OK;
+
+   Batch batch(devices.size(), call);
+   if (groups.size() > 1)
+   {
+      batch.remaining = groups.size() - 1;
+      for (std::size_t g = 1; g < groups.size(); ++g)
+      {
+         const std::vector<std::size_t>& indices = groups[g];
+         Submit([this, &batch, &indices]() {
+            RunGroup(batch, indices);
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            if (--batch.remaining == 0)
+               batch.done.notify_one();
+         }, groups.size() - 1);
+      }
+   }
+
+   // The first group runs on the calling thread, saving a hand-off
+   RunGroup(batch, groups[0]);
+
+   {
+      std::unique_lock<std::mutex> lock(batch.mutex);
+      batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+   }
+
+   for (std::size_t i = 0; i < batch.results.size(); ++i)
+   {
+      if (batch.results[i] != DEVICE_OK)
+         return batch.results[i];
+   }
+   return DEVICE_OK;
+}
+
+
+void DeviceFanOut::InvalidateGroupKeys()
+{
+   std::lock_guard<std::mutex> lock(keyMutex_);
+   groupKeys_.clear();
+}
+
+
+std::string DeviceFanOut::GroupKey(MM::Device* device)
+{
+   std::lock_guard<std::mutex> lock(keyMutex_);
+   std::map<MM::Device*, std::string>::iterator found =
+      groupKeys_.find(device);
+   if (found != groupKeys_.end())
+      return found->second;
+
+   // Both the parent hub and the port are fixed once the device has been
+   // initialized, so the key can be cached.
+   std::string key;
+   char buf[MM::MaxStrLength];
+   buf[0] = '\0';
+   device->GetParentID(buf);
+   if (buf[0] != '\0')
+   {
+      key = std::string("hub:") + buf;
+   }
+   else if (device->HasProperty(MM::g_Keyword_Port))
+   {
+      buf[0] = '\0';
+      if (device->GetProperty(MM::g_Keyword_Port, buf) == DEVICE_OK &&
+         buf[0] != '\0' && std::string(buf) != "Undefined")
+      {
+         key = std::string("port:") + buf;
+      }
+   }
+   if (key.empty())
+   {
+      // Devices of the same module may share unprotected state (globals,
+      // a vendor library), so without further information only devices
+      // from different modules are assumed independent.
+      buf[0] = '\0';
+      device->GetModuleName(buf);
+      key = std::string("module:") + buf;
+   }
+
+   groupKeys_[device] = key;
+   return key;
+}
+
+
+void DeviceFanOut::RunGroup(Batch& batch,
+   const std::vector<std::size_t>& indices)
+{
+   for (std::vector<std::size_t>::const_iterator it = indices.begin(),
+      end = indices.end(); it != end; ++it)
+   {
+      int err;
+      try
+      {
+         err = batch.call(*it);
+      }
+      catch (...)
+      {
+         err = DEVICE_ERR;
+      }
+      batch.results[*it] = err;
+      if (err != DEVICE_OK)
+         break;
+   }
+}
+
+
+void DeviceFanOut::Submit(std::function<void()> task,
+   std::size_t workersNeeded)
+{
+   {
+      std::lock_guard<std::mutex> lock(queueMutex_);
+      while (workers_.size() < workersNeeded)
+         workers_.push_back(std::thread([this]() { WorkerLoop(); }));
+      queue_.push_back(std::move(task));
+   }
+   queueCond_.notify_one();
+}
+
+
+void DeviceFanOut::WorkerLoop()
+{
+   std::unique_lock<std::mutex> lock(queueMutex_);
+   for (;;)
+   {
+      queueCond_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty())
+         return; // stopping_
+      std::function<void()> task = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+   }
+}
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceFanOut.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Concurrent dispatch of calls to the physical devices behind
+//                the combining 'Meta-Devices'.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#pragma once
+
+#include "MMDevice.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Calls a function for each of several physical devices, concurrently where
+ * it is safe to do so, on a small set of persistent worker threads.
+ *
+ * Devices that share a parent hub or a communication port are called one
+ * after another on the same thread, because their adapters generally cannot
+ * handle two calls at once (the Core normally prevents this with its
+ * per-module lock, which is bypassed when one device calls another). Devices
+ * with neither are grouped by device adapter module, so that only devices
+ * from different modules, or on different ports, run in parallel.
+ *
+ * Worker threads are started on first need and stopped in the destructor.
+ */
+class DeviceFanOut
+{
+public:
+   typedef std::function<int(std::size_t)> CallFunction;
+
+   DeviceFanOut();
+   ~DeviceFanOut();
+
+   DeviceFanOut(const DeviceFanOut&) = delete;
+   DeviceFanOut& operator=(const DeviceFanOut&) = delete;
+
+   void SetConcurrent(bool concurrent) { concurrent_ = concurrent; }
+   bool IsConcurrent() const { return concurrent_; }
+
+   /**
+    * Discards the cached grouping of devices. Must be called whenever the
+    * set of physical devices may have changed (for example when a physical
+    * device label property is set), since cached entries are keyed by device
+    * pointer.
+    */
+   void InvalidateGroupKeys();
+
+   /**
+    * Calls call(i) for each i such that devices[i] is not null, and waits for
+    * all calls to complete. Returns the error from the lowest-indexed failing
+    * call, or DEVICE_OK.
+    *
+    * Unlike a sequential loop, a failing call does not prevent calls to
+    * devices in other groups. Within a group, calls stop at the first error.
+    */
+   int Run(const std::vector<MM::Device*>& devices, const CallFunction& call);
+
+private:
+   struct Batch;
+
+   std::string GroupKey(MM::Device* device);
+   void RunGroup(Batch& batch, const std::vector<std::size_t>& indices);
+   void Submit(std::function<void()> task, std::size_t workersNeeded);
+   void WorkerLoop();
+
+   std::atomic<bool> concurrent_;
+
+   std::mutex keyMutex_;
+   std::map<MM::Device*, std::string> groupKeys_;
+
+   std::mutex queueMutex_;
+   std::condition_variable queueCond_;
+   std::deque<std::function<void()> > queue_;
+   std::vector<std::thread> workers_;
+   bool stopping_;
+};
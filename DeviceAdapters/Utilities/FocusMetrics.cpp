@@ -0,0 +1,423 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusMetrics.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image sharpness metrics for software autofocus.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "FocusMetrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <functional>
+#include <thread>
+
+
+// The inner loops below keep several independent partial sums instead of a
+// single accumulator. Without -ffast-math a compiler may not reorder a
+// floating-point reduction, so a single accumulator would prevent
+// vectorization. Differences of pixel values are exact in float, but their
+// squares and sums are not (16-bit pixels square to 32 bits), so they are
+// accumulated in double.
+
+namespace {
+
+const std::size_t kLanes = 8;
+
+double SumSquaredDiff(const float* a, const float* b, std::size_t n)
+{
+   double acc[kLanes] = { 0 };
+   std::size_t i = 0;
+   for (; i + kLanes <= n; i += kLanes)
+   {
+      for (std::size_t k = 0; k < kLanes; ++k)
+      {
+         const double d = a[i + k] - b[i + k];
+         acc[k] += d * d;
+      }
+   }
+   double sum = 0.0;
+   for (; i < n; ++i)
+   {
+      const double d = a[i] - b[i];
+      sum += d * d;
+   }
+   for (std::size_t k = 0; k < kLanes; ++k)
+      sum += acc[k];
+   return sum;
+}
+
+
+double Sum(const float* p, std::size_t n)
+{
+   double acc[kLanes] = { 0 };
+   std::size_t i = 0;
+   for (; i + kLanes <= n; i += kLanes)
+   {
+      for (std::size_t k = 0; k < kLanes; ++k)
+         acc[k] += p[i + k];
+   }
+   double sum = 0.0;
+   for (; i < n; ++i)
+      sum += p[i];
+   for (std::size_t k = 0; k < kLanes; ++k)
+      sum += acc[k];
+   return sum;
+}
+
+
+// Sum of squared deviations from mean. Computing the variance from the sum of
+// squares instead would cancel catastrophically for bright, low-contrast
+// images.
+double SumSquaredDeviation(const float* p, std::size_t n, double mean)
+{
+   double acc[kLanes] = { 0 };
+   std::size_t i = 0;
+   for (; i + kLanes <= n; i += kLanes)
+   {
+      for (std::size_t k = 0; k < kLanes; ++k)
+      {
+         const double d = p[i + k] - mean;
+         acc[k] += d * d;
+      }
+   }
+   double sum = 0.0;
+   for (; i < n; ++i)
+   {
+      const double d = p[i] - mean;
+      sum += d * d;
+   }
+   for (std::size_t k = 0; k < kLanes; ++k)
+      sum += acc[k];
+   return sum;
+}
+
+
+// Sum of squared Sobel gradient magnitudes for the interior of row r1
+double SobelRow(const float* r0, const float* r1, const float* r2,
+   std::size_t w)
+{
+   if (w < 3)
+      return 0.0;
+   const std::size_t n = w - 2;
+   double acc[kLanes] = { 0 };
+   std::size_t i = 0;
+   for (; i + kLanes <= n; i += kLanes)
+   {
+      for (std::size_t k = 0; k < kLanes; ++k)
+      {
+         const std::size_t x = i + k; // Left column of the 3x3 window
+         const double gx = (r0[x + 2] - r0[x]) + 2.0f * (r1[x + 2] - r1[x]) +
+            (r2[x + 2] - r2[x]);
+         const double gy = (r2[x] + 2.0f * r2[x + 1] + r2[x + 2]) -
+            (r0[x] + 2.0f * r0[x + 1] + r0[x + 2]);
+         acc[k] += gx * gx + gy * gy;
+      }
+   }
+   double sum = 0.0;
+   for (; i < n; ++i)
+   {
+      const double gx = (r0[i + 2] - r0[i]) + 2.0f * (r1[i + 2] - r1[i]) +
+         (r2[i + 2] - r2[i]);
+      const double gy = (r2[i] + 2.0f * r2[i + 1] + r2[i + 2]) -
+         (r0[i] + 2.0f * r0[i + 1] + r0[i + 2]);
+      sum += gx * gx + gy * gy;
+   }
+   for (std::size_t k = 0; k < kLanes; ++k)
+      sum += acc[k];
+   return sum;
+}
+
+
+// Rows are split into at most one chunk per thread, and not below 16 rows
+// per chunk, where threading would cost more than it saves.
+std::size_t NrChunks(std::size_t n, unsigned nrThreads)
+{
+   return std::max<std::size_t>(1, std::min<std::size_t>(nrThreads, n / 16));
+}
+
+
+// Splits [0, n) into NrChunks(n, nrThreads) chunks and runs fn on each, the
+// first on the calling thread. fn(begin, end, chunk) must write only its own
+// chunk's results.
+void ParallelFor(std::size_t n, unsigned nrThreads,
+   const std::function<void(std::size_t, std::size_t, std::size_t)>& fn)
+{
+   const std::size_t chunks = NrChunks(n, nrThreads);
+   std::vector<std::thread> threads;
+   threads.reserve(chunks - 1);
+   for (std::size_t c = 1; c < chunks; ++c)
+   {
+      const std::size_t begin = n * c / chunks;
+      const std::size_t end = n * (c + 1) / chunks;
+      threads.push_back(std::thread(fn, begin, end, c));
+   }
+   fn(0, n / chunks, 0);
+   for (std::size_t t = 0; t < threads.size(); ++t)
+      threads[t].join();
+}
+
+
+// Sums per-row partial results computed in parallel
+double ParallelRowSum(std::size_t nrRows, unsigned nrThreads,
+   const std::function<double(std::size_t)>& rowFn)
+{
+   std::vector<double> partial(NrChunks(nrRows, nrThreads), 0.0);
+   ParallelFor(nrRows, nrThreads,
+      [&](std::size_t begin, std::size_t end, std::size_t chunk) {
+         double s = 0.0;
+         for (std::size_t r = begin; r < end; ++r)
+            s += rowFn(r);
+         partial[chunk] = s;
+      });
+   double sum = 0.0;
+   for (std::size_t c = 0; c < partial.size(); ++c)
+      sum += partial[c];
+   return sum;
+}
+
+
+double NormalizedVariance(const FocusImage& img, unsigned nrThreads)
+{
+   const std::size_t w = img.width;
+   const std::size_t n = w * img.height;
+   if (n == 0)
+      return 0.0;
+
+   const double mean = ParallelRowSum(img.height, nrThreads,
+      [&](std::size_t r) { return Sum(&img.pixels[r * w], w); }) / n;
+   if (mean <= 0.0)
+      return 0.0;
+   const double variance = ParallelRowSum(img.height, nrThreads,
+      [&](std::size_t r) {
+         return SumSquaredDeviation(&img.pixels[r * w], w, mean);
+      }) / n;
+   return variance / mean;
+}
+
+
+double Brenner(const FocusImage& img, unsigned nrThreads)
+{
+   const std::size_t w = img.width;
+   if (w < 3)
+      return 0.0;
+   return ParallelRowSum(img.height, nrThreads, [&](std::size_t r) {
+      const float* row = &img.pixels[r * w];
+      return SumSquaredDiff(row + 2, row, w - 2);
+   });
+}
+
+
+double Tenengrad(const FocusImage& img, unsigned nrThreads)
+{
+   const std::size_t w = img.width;
+   if (img.height < 3 || w < 3)
+      return 0.0;
+   return ParallelRowSum(img.height - 2, nrThreads, [&](std::size_t r) {
+      const float* r0 = &img.pixels[r * w];
+      return SobelRow(r0, r0 + w, r0 + 2 * w, w);
+   });
+}
+
+
+// In-place iterative radix-2 FFT; n must be a power of two
+void FFT(std::complex<float>* data, std::size_t n,
+   const std::vector<std::complex<float> >& twiddles)
+{
+   for (std::size_t i = 1, j = 0; i < n; ++i)
+   {
+      std::size_t bit = n >> 1;
+      for (; j & bit; bit >>= 1)
+         j ^= bit;
+      j ^= bit;
+      if (i < j)
+         std::swap(data[i], data[j]);
+   }
+   for (std::size_t len = 2; len <= n; len <<= 1)
+   {
+      const std::size_t stride = n / len;
+      for (std::size_t i = 0; i < n; i += len)
+      {
+         for (std::size_t k = 0; k < len / 2; ++k)
+         {
+            const std::complex<float> t = twiddles[k * stride] * data[i + k + len / 2];
+            data[i + k + len / 2] = data[i + k] - t;
+            data[i + k] += t;
+         }
+      }
+   }
+}
+
+
+double FFTBandPass(const FocusImage& img, unsigned nrThreads,
+   double bandLow, double bandHigh)
+{
+   std::size_t n = 1;
+   const std::size_t maxSize = std::min<std::size_t>(512,
+      std::min(img.width, img.height));
+   while (n * 2 <= maxSize)
+      n *= 2;
+   if (n < 8)
+      return 0.0;
+
+   const float pi = 3.14159265358979f;
+   std::vector<std::complex<float> > twiddles(n / 2);
+   for (std::size_t k = 0; k < n / 2; ++k)
+      twiddles[k] = std::polar(1.0f, -2.0f * pi * k / n);
+
+   // Hann window suppresses the edge discontinuity, which would otherwise
+   // add high-frequency power regardless of focus
+   std::vector<float> window(n);
+   for (std::size_t i = 0; i < n; ++i)
+      window[i] = 0.5f - 0.5f * std::cos(2.0f * pi * i / (n - 1));
+
+   const std::size_t x0 = (img.width - n) / 2;
+   const std::size_t y0 = (img.height - n) / 2;
+   std::vector<std::complex<float> > data(n * n);
+
+   ParallelFor(n, nrThreads,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+         for (std::size_t y = begin; y < end; ++y)
+         {
+            const float* src = &img.pixels[(y0 + y) * img.width + x0];
+            std::complex<float>* row = &data[y * n];
+            for (std::size_t x = 0; x < n; ++x)
+               row[x] = src[x] * window[x] * window[y];
+            FFT(row, n, twiddles);
+         }
+      });
+
+   // Columns, transformed via a per-thread scratch copy. Each thread also
+   // accumulates the power of its own columns.
+   const double nyquist = n / 2.0;
+   std::vector<double> bandPower(NrChunks(n, nrThreads), 0.0);
+   std::vector<double> totalPower(bandPower.size(), 0.0);
+   ParallelFor(n, nrThreads,
+      [&](std::size_t begin, std::size_t end, std::size_t chunk) {
+         std::vector<std::complex<float> > column(n);
+         double band = 0.0, total = 0.0;
+         for (std::size_t u = begin; u < end; ++u)
+         {
+            for (std::size_t v = 0; v < n; ++v)
+               column[v] = data[v * n + u];
+            FFT(&column[0], n, twiddles);
+
+            const double fu = (u <= n / 2) ? double(u) : double(u) - n;
+            for (std::size_t v = 0; v < n; ++v)
+            {
+               if (u == 0 && v == 0)
+                  continue;
+               const double fv = (v <= n / 2) ? double(v) : double(v) - n;
+               const double r = std::sqrt(fu * fu + fv * fv) / nyquist;
+               const double p = std::norm(column[v]);
+               total += p;
+               if (r >= bandLow && r <= bandHigh)
+                  band += p;
+            }
+         }
+         bandPower[chunk] = band;
+         totalPower[chunk] = total;
+      });
+
+   double band = 0.0, total = 0.0;
+   for (std::size_t c = 0; c < bandPower.size(); ++c)
+   {
+      band += bandPower[c];
+      total += totalPower[c];
+   }
+   return total > 0.0 ? band / total : 0.0;
+}
+
+} // anonymous namespace
+
+
+bool ExtractFocusROI(const unsigned char* buf, unsigned width, unsigned height,
+   unsigned bytesPerPixel, unsigned nrComponents, double roiFraction,
+   FocusImage& out)
+{
+   if (!buf)
+      return false;
+   const bool gray8 = (bytesPerPixel == 1);
+   const bool gray16 = (bytesPerPixel == 2);
+   const bool rgb32 = (bytesPerPixel == 4 && nrComponents == 4);
+   if (!gray8 && !gray16 && !rgb32)
+      return false;
+
+   roiFraction = std::min(1.0, std::max(0.0, roiFraction));
+   const unsigned w = static_cast<unsigned>(width * roiFraction + 0.5);
+   const unsigned h = static_cast<unsigned>(height * roiFraction + 0.5);
+   if (w == 0 || h == 0)
+      return false;
+   const unsigned x0 = (width - w) / 2;
+   const unsigned y0 = (height - h) / 2;
+
+   out.width = w;
+   out.height = h;
+   out.pixels.resize(static_cast<std::size_t>(w) * h);
+   for (unsigned y = 0; y < h; ++y)
+   {
+      float* dst = &out.pixels[static_cast<std::size_t>(y) * w];
+      const std::size_t srcOffset =
+         (static_cast<std::size_t>(y0 + y) * width + x0) * bytesPerPixel;
+      if (gray8)
+      {
+         const unsigned char* src = buf + srcOffset;
+         for (unsigned x = 0; x < w; ++x)
+            dst[x] = src[x];
+      }
+      else if (gray16)
+      {
+         const unsigned short* src =
+            reinterpret_cast<const unsigned short*>(buf + srcOffset);
+         for (unsigned x = 0; x < w; ++x)
+            dst[x] = src[x];
+      }
+      else
+      {
+         // BGRA byte order, as used by Micro-Manager RGB cameras
+         const unsigned char* src = buf + srcOffset;
+         for (unsigned x = 0; x < w; ++x)
+            dst[x] = 0.114f * src[4 * x] + 0.587f * src[4 * x + 1] +
+               0.299f * src[4 * x + 2];
+      }
+   }
+   return true;
+}
+
+
+double ComputeFocusMetric(FocusMetricType type, const FocusImage& image,
+   unsigned nrThreads, double bandLow, double bandHigh)
+{
+   nrThreads = std::max(1u, nrThreads);
+   switch (type)
+   {
+      case FocusMetricNormalizedVariance:
+         return NormalizedVariance(image, nrThreads);
+      case FocusMetricBrenner:
+         return Brenner(image, nrThreads);
+      case FocusMetricTenengrad:
+         return Tenengrad(image, nrThreads);
+      case FocusMetricFFTBandPass:
+         return FFTBandPass(image, nrThreads, bandLow, bandHigh);
+   }
+   return 0.0;
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusMetrics.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Image sharpness metrics for software autofocus.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#pragma once
+
+#include <vector>
+
+enum FocusMetricType
+{
+   FocusMetricNormalizedVariance,
+   FocusMetricBrenner,
+   FocusMetricTenengrad,
+   FocusMetricFFTBandPass,
+};
+
+// Grayscale image, row-major
+struct FocusImage
+{
+   FocusImage() : width(0), height(0) {}
+
+   std::vector<float> pixels;
+   unsigned width;
+   unsigned height;
+};
+
+/**
+ * Copies the centered region covering roiFraction of each dimension of a
+ * camera image into out, converting to grayscale. Supports 8- and 16-bit
+ * grayscale and 32-bit RGB (4 components of 1 byte). Returns false for other
+ * formats or an empty ROI.
+ */
+bool ExtractFocusROI(const unsigned char* buf, unsigned width, unsigned height,
+   unsigned bytesPerPixel, unsigned nrComponents, double roiFraction,
+   FocusImage& out);
+
+/**
+ * Computes a sharpness score (higher is sharper) using up to nrThreads
+ * threads, including the calling thread.
+ *
+ * The FFT band-pass metric uses the largest centered power-of-two square in
+ * the image (at most 512 pixels) and returns the fraction of non-DC power
+ * between bandLow and bandHigh, given as fractions of the Nyquist frequency.
+ */
+double ComputeFocusMetric(FocusMetricType type, const FocusImage& image,
+   unsigned nrThreads, double bandLow = 0.1, double bandHigh = 0.5);
@@ -0,0 +1,186 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          GalvoWaveform.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Compiles galvo polygons into sample-aligned X/Y waveforms
+//                for playback as DA sequences.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "GalvoWaveform.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+class WaveformWriter
+{
+public:
+   WaveformWriter(const GalvoWaveformSettings& settings,
+         std::vector<double>& xs, std::vector<double>& ys) :
+      settings_(settings),
+      xs_(xs),
+      ys_(ys),
+      overflow_(false)
+   {}
+
+   bool Overflowed() const { return overflow_; }
+
+   void AddPoint(double x, double y)
+   {
+      const std::size_t dwell = static_cast<std::size_t>(
+            std::max(1L, settings_.dwellSamples));
+      if (settings_.maxSamples > 0 &&
+            xs_.size() + dwell > settings_.maxSamples)
+      {
+         overflow_ = true;
+         return;
+      }
+      xs_.insert(xs_.end(), dwell, x);
+      ys_.insert(ys_.end(), dwell, y);
+   }
+
+   // Points along the segment, excluding (x0, y0) and including (x1, y1)
+   void AddLineTo(double x0, double y0, double x1, double y1)
+   {
+      long steps = 1;
+      if (settings_.pointSpacing > 0.0)
+      {
+         const double length = std::sqrt((x1 - x0) * (x1 - x0) +
+               (y1 - y0) * (y1 - y0));
+         steps = std::max(1L,
+               static_cast<long>(std::ceil(length / settings_.pointSpacing)));
+      }
+      for (long i = 1; i <= steps && !overflow_; ++i)
+      {
+         const double f = static_cast<double>(i) / steps;
+         AddPoint(x0 + f * (x1 - x0), y0 + f * (y1 - y0));
+      }
+   }
+
+private:
+   const GalvoWaveformSettings& settings_;
+   std::vector<double>& xs_;
+   std::vector<double>& ys_;
+   bool overflow_;
+};
+
+
+void AddOutline(const GalvoPolygon& polygon, WaveformWriter& writer)
+{
+   if (polygon.empty())
+      return;
+
+   writer.AddPoint(polygon[0].first, polygon[0].second);
+   if (polygon.size() == 1)
+      return;
+
+   // A 2-vertex polygon is a line, traced out and back
+   for (std::size_t i = 0; i < polygon.size() && !writer.Overflowed(); ++i)
+   {
+      const std::pair<double, double>& a = polygon[i];
+      const std::pair<double, double>& b = polygon[(i + 1) % polygon.size()];
+      writer.AddLineTo(a.first, a.second, b.first, b.second);
+   }
+}
+
+
+void AddRaster(const GalvoPolygon& polygon, double lineSpacing,
+   WaveformWriter& writer)
+{
+   double yMin = polygon[0].second;
+   double yMax = yMin;
+   for (std::size_t i = 1; i < polygon.size(); ++i)
+   {
+      yMin = std::min(yMin, polygon[i].second);
+      yMax = std::max(yMax, polygon[i].second);
+   }
+
+   // Center the lines within the polygon's extent, with at least one line.
+   // Lines on the top and bottom edges would cross nothing.
+   long nrLines = 1;
+   if (lineSpacing > 0.0)
+      nrLines = std::max(1L,
+            static_cast<long>(std::ceil((yMax - yMin) / lineSpacing - 1e-9)));
+   const double usedHeight = (nrLines - 1) * lineSpacing;
+   const double yFirst = yMin + 0.5 * ((yMax - yMin) - usedHeight);
+
+   bool haveLast = false;
+   double lastX = 0.0, lastY = 0.0;
+   std::vector<double> crossings;
+   for (long line = 0; line < nrLines && !writer.Overflowed(); ++line)
+   {
+      const double y = yFirst + line * lineSpacing;
+
+      // Even-odd rule; half-open edges so that vertices are counted once
+      crossings.clear();
+      for (std::size_t i = 0; i < polygon.size(); ++i)
+      {
+         const std::pair<double, double>& a = polygon[i];
+         const std::pair<double, double>& b = polygon[(i + 1) % polygon.size()];
+         if ((a.second <= y && y < b.second) || (b.second <= y && y < a.second))
+         {
+            crossings.push_back(a.first +
+                  (y - a.second) * (b.first - a.first) / (b.second - a.second));
+         }
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      // Serpentine: every other line is scanned right to left
+      const bool reverse = (line % 2) == 1;
+      if (reverse)
+         std::reverse(crossings.begin(), crossings.end());
+
+      for (std::size_t i = 0; i + 1 < crossings.size() &&
+            !writer.Overflowed(); i += 2)
+      {
+         const double xStart = crossings[i];
+         const double xEnd = crossings[i + 1];
+         if (!haveLast)
+            writer.AddPoint(xStart, y);
+         else
+            writer.AddLineTo(lastX, lastY, xStart, y);
+         writer.AddLineTo(xStart, y, xEnd, y);
+         haveLast = true;
+         lastX = xEnd;
+         lastY = y;
+      }
+   }
+}
+
+} // anonymous namespace
+
+
+bool CompileGalvoWaveform(const std::vector<GalvoPolygon>& polygons,
+   const GalvoWaveformSettings& settings,
+   std::vector<double>& xs, std::vector<double>& ys)
+{
+   WaveformWriter writer(settings, xs, ys);
+   for (std::vector<GalvoPolygon>::const_iterator it = polygons.begin(),
+      end = polygons.end(); it != end && !writer.Overflowed(); ++it)
+   {
+      if (settings.rasterFill && it->size() >= 3)
+         AddRaster(*it, settings.lineSpacing, writer);
+      else
+         AddOutline(*it, writer);
+   }
+   return !writer.Overflowed();
+}
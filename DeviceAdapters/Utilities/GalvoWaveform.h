@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          GalvoWaveform.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Compiles galvo polygons into sample-aligned X/Y waveforms
+//                for playback as DA sequences.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Vertices in DA units (x, y)
+typedef std::vector<std::pair<double, double> > GalvoPolygon;
+
+struct GalvoWaveformSettings
+{
+   GalvoWaveformSettings() :
+      rasterFill(false),
+      pointSpacing(0.0),
+      lineSpacing(0.0),
+      dwellSamples(1),
+      maxSamples(0)
+   {}
+
+   // Fill polygon interiors with a serpentine raster instead of tracing
+   // their outlines. Polygons with fewer than 3 vertices are always traced.
+   bool rasterFill;
+
+   // Largest step between consecutive samples, in DA units. Zero visits only
+   // the vertices (outline) or the ends of each raster segment.
+   double pointSpacing;
+
+   // Distance between raster lines, in DA units
+   double lineSpacing;
+
+   // Number of consecutive samples spent on each point
+   long dwellSamples;
+
+   // Compilation fails if the waveform would be longer; zero for no limit
+   std::size_t maxSamples;
+};
+
+/**
+ * Appends the samples for all polygons, in order, to xs and ys. Sample i of
+ * xs and sample i of ys form one galvo position, so the two vectors always
+ * have the same length.
+ *
+ * Returns false (leaving xs and ys in an unspecified state) if the waveform
+ * would exceed settings.maxSamples.
+ */
+bool CompileGalvoWaveform(const std::vector<GalvoPolygon>& polygons,
+   const GalvoWaveformSettings& settings,
+   std::vector<double>& xs, std::vector<double>& ys);
@@ -0,0 +1,548 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageAutoFocus.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Software autofocus using the Core's camera and focus stage.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifdef _WIN32
+// Prevent windows.h from defining min and max macros,
+// which clash with std::min and std::max.
+#define NOMINMAX
+#endif
+
+#include "Utilities.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <sstream>
+#include <thread>
+
+extern const char* g_DeviceNameImageAutoFocus;
+
+namespace {
+
+const char* const g_PropSearch = "Search";
+const char* const g_SearchCoarseToFine = "Coarse to fine";
+const char* const g_SearchGoldenSection = "Golden section";
+const char* const g_PropMetric = "Metric";
+const char* const g_MetricNormalizedVariance = "Normalized variance";
+const char* const g_MetricBrenner = "Brenner";
+const char* const g_MetricTenengrad = "Tenengrad";
+const char* const g_MetricFFTBandPass = "FFT band-pass";
+const char* const g_PropRange = "Search Range (um)";
+const char* const g_PropCoarseStep = "Coarse Step (um)";
+const char* const g_PropFineStep = "Fine Step (um)";
+const char* const g_PropROI = "ROI (%)";
+const char* const g_PropThreads = "Metric Threads";
+const char* const g_PropStageSequence = "Use Stage Sequence";
+
+const long g_MaxScanPositions = 1000;
+const long g_DeviceTimeoutMs = 10000;
+
+} // anonymous namespace
+
+
+ImageAutoFocus::ImageAutoFocus() :
+   camera_(0),
+   stage_(0),
+   lastScore_(0.0),
+   offsetUm_(0.0),
+   initialized_(false)
+{
+   InitializeDefaultErrorMessages();
+
+   SetErrorText(ERR_NO_PHYSICAL_CAMERA, "No camera set in the Core");
+   SetErrorText(ERR_NO_PHYSICAL_STAGE, "No focus stage set in the Core");
+   SetErrorText(ERR_AUTOFOCUS_NOT_SUPPORTED,
+      "The focus stage is a continuous focus drive and cannot be scanned");
+   SetErrorText(ERR_UNSUPPORTED_IMAGE_FORMAT,
+      "Image AutoFocus supports 8- and 16-bit grayscale and 32-bit RGB images");
+   SetErrorText(ERR_TIMEOUT, "Timed out waiting for the camera or focus stage");
+
+   // Name
+   CreateProperty(MM::g_Keyword_Name, g_DeviceNameImageAutoFocus, MM::String, true);
+
+   // Description
+   CreateProperty(MM::g_Keyword_Description,
+      "Image-based software autofocus using the Core camera and focus stage",
+      MM::String, true);
+}
+
+ImageAutoFocus::~ImageAutoFocus()
+{
+   Shutdown();
+}
+
+void ImageAutoFocus::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameImageAutoFocus);
+}
+
+int ImageAutoFocus::Initialize()
+{
+   if (initialized_)
+      return DEVICE_OK;
+
+   CreateStringProperty(g_PropSearch, g_SearchCoarseToFine, false);
+   AddAllowedValue(g_PropSearch, g_SearchCoarseToFine);
+   AddAllowedValue(g_PropSearch, g_SearchGoldenSection);
+
+   CreateStringProperty(g_PropMetric, g_MetricNormalizedVariance, false);
+   AddAllowedValue(g_PropMetric, g_MetricNormalizedVariance);
+   AddAllowedValue(g_PropMetric, g_MetricBrenner);
+   AddAllowedValue(g_PropMetric, g_MetricTenengrad);
+   AddAllowedValue(g_PropMetric, g_MetricFFTBandPass);
+
+   CreateFloatProperty(g_PropRange, 20.0, false);
+   CreateFloatProperty(g_PropCoarseStep, 2.0, false);
+   CreateFloatProperty(g_PropFineStep, 0.25, false);
+
+   CreateIntegerProperty(g_PropROI, 50, false);
+   SetPropertyLimits(g_PropROI, 5, 100);
+
+   const long nrCores = std::max(1L,
+      static_cast<long>(std::thread::hardware_concurrency()));
+   CreateIntegerProperty(g_PropThreads, std::min(nrCores, 8L), false);
+   SetPropertyLimits(g_PropThreads, 1, 64);
+
+   // The camera's trigger output must advance the stage sequence
+   CreateStringProperty(g_PropStageSequence, "No", false);
+   AddAllowedValue(g_PropStageSequence, "No");
+   AddAllowedValue(g_PropStageSequence, "Yes");
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::Shutdown()
+{
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::SetContinuousFocusing(bool state)
+{
+   return state ? DEVICE_UNSUPPORTED_COMMAND : DEVICE_OK;
+}
+
+int ImageAutoFocus::GetContinuousFocusing(bool& state)
+{
+   state = false;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::FullFocus()
+{
+   Settings settings;
+   int ret = ReadSettings(settings);
+   if (ret != DEVICE_OK)
+      return ret;
+   return Focus(settings, settings.rangeUm, true);
+}
+
+/*
+ * Fine search only, over one coarse step either side of the current
+ * position.
+ */
+int ImageAutoFocus::IncrementalFocus()
+{
+   Settings settings;
+   int ret = ReadSettings(settings);
+   if (ret != DEVICE_OK)
+      return ret;
+   return Focus(settings, 2.0 * settings.coarseStepUm, false);
+}
+
+int ImageAutoFocus::GetLastFocusScore(double& score)
+{
+   score = lastScore_;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::GetCurrentFocusScore(double& score)
+{
+   Settings settings;
+   int ret = ReadSettings(settings);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = GetDevices(camera_, stage_);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   FocusImage roi;
+   ret = SnapROI(settings, roi);
+   if (ret != DEVICE_OK)
+      return ret;
+   score = ComputeFocusMetric(settings.metric, roi, settings.nrThreads);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::GetOffset(double& offset)
+{
+   offset = offsetUm_;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::SetOffset(double offset)
+{
+   offsetUm_ = offset;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::ReadSettings(Settings& settings)
+{
+   char buf[MM::MaxStrLength];
+   int ret = GetProperty(g_PropSearch, buf);
+   if (ret != DEVICE_OK)
+      return ret;
+   settings.goldenSection = (strcmp(buf, g_SearchGoldenSection) == 0);
+
+   ret = GetProperty(g_PropMetric, buf);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (strcmp(buf, g_MetricBrenner) == 0)
+      settings.metric = FocusMetricBrenner;
+   else if (strcmp(buf, g_MetricTenengrad) == 0)
+      settings.metric = FocusMetricTenengrad;
+   else if (strcmp(buf, g_MetricFFTBandPass) == 0)
+      settings.metric = FocusMetricFFTBandPass;
+   else
+      settings.metric = FocusMetricNormalizedVariance;
+
+   ret = GetProperty(g_PropRange, settings.rangeUm);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = GetProperty(g_PropCoarseStep, settings.coarseStepUm);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = GetProperty(g_PropFineStep, settings.fineStepUm);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (settings.rangeUm <= 0.0 || settings.coarseStepUm <= 0.0 ||
+      settings.fineStepUm <= 0.0 ||
+      settings.rangeUm / settings.fineStepUm > g_MaxScanPositions)
+      return DEVICE_INVALID_PROPERTY_VALUE;
+
+   long roiPercent, nrThreads;
+   ret = GetProperty(g_PropROI, roiPercent);
+   if (ret != DEVICE_OK)
+      return ret;
+   settings.roiFraction = roiPercent / 100.0;
+   ret = GetProperty(g_PropThreads, nrThreads);
+   if (ret != DEVICE_OK)
+      return ret;
+   settings.nrThreads = static_cast<unsigned>(std::max(1L, nrThreads));
+
+   ret = GetProperty(g_PropStageSequence, buf);
+   if (ret != DEVICE_OK)
+      return ret;
+   settings.useStageSequence = (strcmp(buf, "Yes") == 0);
+   return DEVICE_OK;
+}
+
+/*
+ * Looks up the Core's current camera and focus stage. These may change
+ * between calls, so they are not cached beyond a single operation.
+ */
+int ImageAutoFocus::GetDevices(MM::Camera*& camera, MM::Stage*& stage)
+{
+   MM::Core* core = GetCoreCallback();
+   if (!core)
+      return DEVICE_NO_CALLBACK_REGISTERED;
+
+   char label[MM::MaxStrLength];
+   label[0] = '\0';
+   core->GetDeviceProperty(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, label);
+   camera = static_cast<MM::Camera*>(GetDevice(label));
+   if (!camera || camera->GetType() != MM::CameraDevice)
+      return ERR_NO_PHYSICAL_CAMERA;
+
+   label[0] = '\0';
+   core->GetDeviceProperty(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, label);
+   stage = static_cast<MM::Stage*>(GetDevice(label));
+   if (!stage || stage->GetType() != MM::StageDevice)
+      return ERR_NO_PHYSICAL_STAGE;
+   if (stage->IsContinuousFocusDrive())
+      return ERR_AUTOFOCUS_NOT_SUPPORTED;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::Focus(const Settings& settings, double rangeUm, bool coarse)
+{
+   int ret = GetDevices(camera_, stage_);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (camera_->IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+   double startZ;
+   ret = stage_->GetPositionUm(startZ);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   const double center = startZ - offsetUm_;
+   double bestZ = center;
+   double bestScore = 0.0;
+   if (settings.goldenSection)
+   {
+      ret = SearchGoldenSection(settings, center - rangeUm / 2.0,
+         center + rangeUm / 2.0, bestZ, bestScore);
+   }
+   else
+   {
+      // Coarse scan over the range, then a fine scan over one coarse step
+      // either side of the best coarse position
+      double fineCenter = center;
+      double fineHalfWidth = rangeUm / 2.0;
+      if (coarse)
+      {
+         std::vector<double> positions, scores;
+         const long n = static_cast<long>(rangeUm / settings.coarseStepUm) + 1;
+         for (long i = 0; i < n; ++i)
+            positions.push_back(center - rangeUm / 2.0 + i * settings.coarseStepUm);
+         ret = Scan(settings, positions, scores);
+         if (ret == DEVICE_OK)
+         {
+            const std::size_t best = std::max_element(scores.begin(),
+               scores.end()) - scores.begin();
+            fineCenter = positions[best];
+            fineHalfWidth = settings.coarseStepUm;
+         }
+      }
+      if (ret == DEVICE_OK)
+      {
+         std::vector<double> positions, scores;
+         const long n = static_cast<long>(2.0 * fineHalfWidth / settings.fineStepUm) + 1;
+         for (long i = 0; i < n; ++i)
+            positions.push_back(fineCenter - fineHalfWidth + i * settings.fineStepUm);
+         ret = Scan(settings, positions, scores);
+         if (ret == DEVICE_OK)
+         {
+            const std::size_t best = std::max_element(scores.begin(),
+               scores.end()) - scores.begin();
+            bestZ = positions[best];
+            bestScore = scores[best];
+         }
+      }
+   }
+
+   if (ret != DEVICE_OK)
+   {
+      MoveStage(startZ);
+      return ret;
+   }
+
+   std::ostringstream os;
+   os << "Best focus at " << bestZ << " um (score " << bestScore << ")";
+   LogMessage(os.str().c_str(), true);
+
+   lastScore_ = bestScore;
+   return MoveStage(bestZ + offsetUm_);
+}
+
+/*
+ * Acquires an image at each position and scores it. Scoring of image i runs
+ * on another thread while the stage moves to, and the camera acquires,
+ * position i + 1, so that scanning is limited by the hardware.
+ */
+int ImageAutoFocus::Scan(const Settings& settings,
+   const std::vector<double>& positions, std::vector<double>& scores)
+{
+   scores.assign(positions.size(), 0.0);
+   if (positions.empty())
+      return DEVICE_OK;
+
+   bool sequenced = false;
+   if (settings.useStageSequence && positions.size() > 1)
+   {
+      bool sequenceable = false;
+      long maxLength = 0;
+      if (stage_->IsStageSequenceable(sequenceable) == DEVICE_OK &&
+         sequenceable &&
+         stage_->GetStageSequenceMaxLength(maxLength) == DEVICE_OK &&
+         maxLength >= static_cast<long>(positions.size()))
+      {
+         sequenced = true;
+      }
+   }
+
+   int ret = MoveStage(positions[0]);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   if (sequenced)
+   {
+      ret = stage_->ClearStageSequence();
+      for (std::size_t i = 0; i < positions.size() && ret == DEVICE_OK; ++i)
+         ret = stage_->AddToStageSequence(positions[i]);
+      if (ret == DEVICE_OK)
+         ret = stage_->SendStageSequence();
+      if (ret == DEVICE_OK)
+         ret = stage_->StartStageSequence();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   FocusImage frames[2];
+   std::future<double> pending;
+   for (std::size_t i = 0; i < positions.size() && ret == DEVICE_OK; ++i)
+   {
+      if (i > 0)
+      {
+         // When sequenced, the camera's trigger output advanced the stage
+         ret = sequenced ? WaitForDevice(stage_) : MoveStage(positions[i]);
+         if (ret != DEVICE_OK)
+            break;
+      }
+
+      // The buffer being filled is never the one still being scored
+      FocusImage& frame = frames[i % 2];
+      ret = SnapROI(settings, frame);
+      if (ret != DEVICE_OK)
+         break;
+
+      if (pending.valid())
+         scores[i - 1] = pending.get();
+      const FocusImage* toScore = &frame;
+      pending = std::async(std::launch::async, [&settings, toScore]() {
+         return ComputeFocusMetric(settings.metric, *toScore, settings.nrThreads);
+      });
+   }
+   if (pending.valid())
+   {
+      // Also on error, so that no task outlives the frame buffers
+      double lastScore = pending.get();
+      if (ret == DEVICE_OK)
+         scores.back() = lastScore;
+   }
+
+   if (sequenced)
+   {
+      int stopRet = stage_->StopStageSequence();
+      if (ret == DEVICE_OK)
+         ret = stopRet;
+   }
+   return ret;
+}
+
+/*
+ * Golden-section search for the maximum, assuming the score is unimodal
+ * within [lower, upper]. Each step depends on the previous score, so images
+ * are scored before the next move.
+ */
+int ImageAutoFocus::SearchGoldenSection(const Settings& settings,
+   double lower, double upper, double& bestZ, double& bestScore)
+{
+   const double invPhi = (std::sqrt(5.0) - 1.0) / 2.0;
+   double a = lower;
+   double b = upper;
+   double c = b - invPhi * (b - a);
+   double d = a + invPhi * (b - a);
+   double fc, fd;
+   int ret = Measure(settings, c, fc);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = Measure(settings, d, fd);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   while (b - a > settings.fineStepUm)
+   {
+      if (fc > fd)
+      {
+         b = d;
+         d = c;
+         fd = fc;
+         c = b - invPhi * (b - a);
+         ret = Measure(settings, c, fc);
+      }
+      else
+      {
+         a = c;
+         c = d;
+         fc = fd;
+         d = a + invPhi * (b - a);
+         ret = Measure(settings, d, fd);
+      }
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   if (fc > fd)
+   {
+      bestZ = c;
+      bestScore = fc;
+   }
+   else
+   {
+      bestZ = d;
+      bestScore = fd;
+   }
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::Measure(const Settings& settings, double z, double& score)
+{
+   int ret = MoveStage(z);
+   if (ret != DEVICE_OK)
+      return ret;
+   FocusImage roi;
+   ret = SnapROI(settings, roi);
+   if (ret != DEVICE_OK)
+      return ret;
+   score = ComputeFocusMetric(settings.metric, roi, settings.nrThreads);
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::SnapROI(const Settings& settings, FocusImage& roi)
+{
+   int ret = camera_->SnapImage();
+   if (ret != DEVICE_OK)
+      return ret;
+   const unsigned char* pixels = camera_->GetImageBuffer();
+   if (!pixels)
+      return DEVICE_ERR;
+   if (!ExtractFocusROI(pixels, camera_->GetImageWidth(),
+      camera_->GetImageHeight(), camera_->GetImageBytesPerPixel(),
+      camera_->GetNumberOfComponents(), settings.roiFraction, roi))
+      return ERR_UNSUPPORTED_IMAGE_FORMAT;
+   return DEVICE_OK;
+}
+
+int ImageAutoFocus::MoveStage(double z)
+{
+   int ret = stage_->SetPositionUm(z);
+   if (ret != DEVICE_OK)
+      return ret;
+   return WaitForDevice(stage_);
+}
+
+int ImageAutoFocus::WaitForDevice(MM::Device* device)
+{
+   const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(g_DeviceTimeoutMs);
+   while (device->Busy())
+   {
+      if (std::chrono::steady_clock::now() > deadline)
+         return ERR_TIMEOUT;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+   }
+   return DEVICE_OK;
+}
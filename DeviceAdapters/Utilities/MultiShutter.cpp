@@ -116,6 +116,11 @@ int MultiShutter::Initialize()
    AddAllowedValue("State", "0");
    AddAllowedValue("State", "1");
 
+   CreateStringProperty("ConcurrentDispatch", "Yes", false,
+      new CPropertyAction(this, &MultiShutter::OnConcurrentDispatch));
+   AddAllowedValue("ConcurrentDispatch", "No");
+   AddAllowedValue("ConcurrentDispatch", "Yes");
+
    int ret = UpdateStatus();
    if (ret != DEVICE_OK)
       return ret;
@@ -129,14 +134,13 @@ bool MultiShutter::Busy()
 {
    MMThreadGuard g(physicalShutterLock_);
 
-   std::vector<std::string>::iterator iter;
-   for (iter = usedShutters_.begin(); iter != usedShutters_.end(); iter++) {
-      MM::Shutter* shutter = (MM::Shutter*)GetDevice((*iter).c_str());
-      if ((shutter != 0) && shutter->Busy())
-         return true;
-   }
-
-   return false;
+   std::vector<MM::Device*> shutters = GetPhysicalShutters();
+   std::vector<char> busy(shutters.size(), 0);
+   fanOut_.Run(shutters, [&](std::size_t i) {
+      busy[i] = shutters[i]->Busy() ? 1 : 0;
+      return DEVICE_OK;
+   });
+   return std::find(busy.begin(), busy.end(), 1) != busy.end();
 }
 
 /*
@@ -146,15 +150,13 @@ int MultiShutter::SetOpen(bool open)
 {
    MMThreadGuard g(physicalShutterLock_);
 
-   std::vector<std::string>::iterator iter;
-   for (iter = usedShutters_.begin(); iter != usedShutters_.end(); iter++) {
-      MM::Shutter* shutter = (MM::Shutter*)GetDevice((*iter).c_str());
-      if (shutter != 0) {
-         int ret = shutter->SetOpen(open);
-         if (ret != DEVICE_OK)
-            return ret;
-      }
-   }
+   // Shutters on different controllers are switched concurrently
+   std::vector<MM::Device*> shutters = GetPhysicalShutters();
+   int ret = fanOut_.Run(shutters, [&](std::size_t i) {
+      return static_cast<MM::Shutter*>(shutters[i])->SetOpen(open);
+   });
+   if (ret != DEVICE_OK)
+      return ret;
    open_ = open;
    return DEVICE_OK;
 }
@@ -168,6 +170,17 @@ int MultiShutter::GetOpen(bool& open)
    return DEVICE_OK;
 }
 
+std::vector<MM::Device*> MultiShutter::GetPhysicalShutters() const
+{
+   std::vector<MM::Device*> shutters;
+   shutters.reserve(usedShutters_.size());
+   std::vector<std::string>::const_iterator iter;
+   for (iter = usedShutters_.begin(); iter != usedShutters_.end(); iter++) {
+      shutters.push_back(GetDevice((*iter).c_str()));
+   }
+   return shutters;
+}
+
 ///////////////////////////////////////
 // Action Interface
 //////////////////////////////////////
@@ -181,6 +194,7 @@ int MultiShutter::OnPhysicalShutter(MM::PropertyBase* pProp, MM::ActionType eAct
    }
    else if (eAct == MM::AfterSet)
    {
+      fanOut_.InvalidateGroupKeys();
       std::string shutterName;
       pProp->Get(shutterName);
       if (shutterName == g_Undefined) {
@@ -224,3 +238,19 @@ int MultiShutter::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
    }
    return DEVICE_OK;
 }
+
+
+int MultiShutter::OnConcurrentDispatch(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(fanOut_.IsConcurrent() ? "Yes" : "No");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string s;
+      pProp->Get(s);
+      fanOut_.SetConcurrent(s == "Yes");
+   }
+   return DEVICE_OK;
+}
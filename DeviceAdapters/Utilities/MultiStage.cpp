@@ -43,7 +43,8 @@ extern const char* g_SyncNow;
 MultiStage::MultiStage() :
    nrPhysicalStages_(2),
    simulatedStepSizeUm_(0.1),
-   initialized_(false)
+   initialized_(false),
+   precomputeSequence_(false)
 {
    InitializeDefaultErrorMessages();
    SetErrorText(ERR_INVALID_DEVICE_NAME, "Invalid stage device");
@@ -136,6 +137,16 @@ int MultiStage::Initialize()
    AddAllowedValue("BringPositionsIntoSync", "");
    AddAllowedValue("BringPositionsIntoSync", g_SyncNow);
 
+   CreateStringProperty("ConcurrentDispatch", "Yes", false,
+      new CPropertyAction(this, &MultiStage::OnConcurrentDispatch));
+   AddAllowedValue("ConcurrentDispatch", "No");
+   AddAllowedValue("ConcurrentDispatch", "Yes");
+
+   CreateStringProperty("PrecomputeSequence", "No", false,
+      new CPropertyAction(this, &MultiStage::OnPrecomputeSequence));
+   AddAllowedValue("PrecomputeSequence", "No");
+   AddAllowedValue("PrecomputeSequence", "Yes");
+
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -149,6 +160,7 @@ int MultiStage::Shutdown()
    usedStages_.clear();
    stageScalings_.clear();
    stageTranslations_.clear();
+   pendingSequences_.clear();
 
    return DEVICE_OK;
 }
@@ -156,19 +168,15 @@ int MultiStage::Shutdown()
 
 bool MultiStage::Busy()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      if (stage->Busy())
-         return true;
-   }
-   return false;
+   // Query all stages in one pass rather than stopping at the first busy one,
+   // so that stages on different controllers are polled concurrently.
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<char> busy(stages.size(), 0);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      busy[i] = stages[i]->Busy() ? 1 : 0;
+      return DEVICE_OK;
+   });
+   return std::find(busy.begin(), busy.end(), 1) != busy.end();
 }
 
 
@@ -176,76 +184,49 @@ int MultiStage::Stop()
 {
    // Return last error encountered, but make sure Stop() is attempted on all
    // stages.
-   int ret = DEVICE_OK;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<int> errors(stages.size(), DEVICE_OK);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      errors[i] = static_cast<MM::Stage*>(stages[i])->Stop();
+      return DEVICE_OK;
+   });
 
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
+   int ret = DEVICE_OK;
+   for (std::size_t i = 0; i < errors.size(); ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Stop();
-      if (err != DEVICE_OK)
-         ret = err;
+      if (errors[i] != DEVICE_OK)
+         ret = errors[i];
    }
-
    return ret;
 }
 
 
 int MultiStage::Home()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Home();
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
+      return static_cast<MM::Stage*>(stages[i])->Home();
+   });
 }
 
 
 int MultiStage::SetPositionUm(double pos)
 {
-   for (unsigned i = 0; i < nrPhysicalStages_; ++i)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
       double physicalPos = stageScalings_[i] * pos + stageTranslations_[i];
-      int err = stage->SetPositionUm(physicalPos);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+      return static_cast<MM::Stage*>(stages[i])->SetPositionUm(physicalPos);
+   });
 }
 
 
 int MultiStage::SetRelativePositionUm(double d)
 {
-   for (unsigned i = 0; i < nrPhysicalStages_; ++i)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
       double physicalRelPos = stageScalings_[i] * d;
-      int err = stage->SetRelativePositionUm(physicalRelPos);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+      return static_cast<MM::Stage*>(stages[i])->SetRelativePositionUm(physicalRelPos);
+   });
 }
 
 
@@ -410,31 +391,21 @@ int MultiStage::GetStageSequenceMaxLength(long& nrEvents) const
 int MultiStage::StartStageSequence()
 {
    // Keep track of started stages in order to stop upon error
-   std::vector<MM::Stage*> startedStages;
-
-   int err;
-   for (std::vector<std::string>::const_iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      err = stage->StartStageSequence();
-      if (err != DEVICE_OK)
-         goto error;
-
-      startedStages.push_back(stage);
-   }
-   return DEVICE_OK;
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<char> started(stages.size(), 0);
+   int err = fanOut_.Run(stages, [&](std::size_t i) {
+      int ret = static_cast<MM::Stage*>(stages[i])->StartStageSequence();
+      if (ret == DEVICE_OK)
+         started[i] = 1;
+      return ret;
+   });
+   if (err == DEVICE_OK)
+      return DEVICE_OK;
 
-error:
-   while (!startedStages.empty())
+   for (std::size_t i = stages.size(); i > 0; --i)
    {
-      startedStages.back()->StopStageSequence();
-      startedStages.pop_back();
+      if (started[i - 1])
+         static_cast<MM::Stage*>(stages[i - 1])->StopStageSequence();
    }
    return err;
 }
@@ -442,20 +413,19 @@ error:
 
 int MultiStage::StopStageSequence()
 {
+   // Try to stop all even after error
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<int> errors(stages.size(), DEVICE_OK);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      errors[i] = static_cast<MM::Stage*>(stages[i])->StopStageSequence();
+      return DEVICE_OK;
+   });
+
    int lastErr = DEVICE_OK;
-   for (std::vector<std::string>::const_iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
+   for (std::size_t i = 0; i < errors.size(); ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->StopStageSequence();
-      if (err != DEVICE_OK)
-         lastErr = err;
-      // Try to stop all even after error
+      if (errors[i] != DEVICE_OK)
+         lastErr = errors[i];
    }
    return lastErr;
 }
@@ -463,19 +433,21 @@ int MultiStage::StopStageSequence()
 
 int MultiStage::ClearStageSequence()
 {
+   for (std::size_t i = 0; i < pendingSequences_.size(); ++i)
+      pendingSequences_[i].clear();
+
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   std::vector<int> errors(stages.size(), DEVICE_OK);
+   fanOut_.Run(stages, [&](std::size_t i) {
+      errors[i] = static_cast<MM::Stage*>(stages[i])->ClearStageSequence();
+      return DEVICE_OK;
+   });
+
    int lastErr = DEVICE_OK;
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-      end = usedStages_.end();
-      it != end;
-      ++it)
+   for (std::size_t i = 0; i < errors.size(); ++i)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->ClearStageSequence();
-      if (err != DEVICE_OK)
-         lastErr = err;
+      if (errors[i] != DEVICE_OK)
+         lastErr = errors[i];
    }
    return lastErr;
 }
@@ -483,37 +455,59 @@ int MultiStage::ClearStageSequence()
 
 int MultiStage::AddToStageSequence(double pos)
 {
-   for (unsigned i = 0; i < nrPhysicalStages_; ++i)
+   if (precomputeSequence_)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
+      pendingSequences_.resize(nrPhysicalStages_);
+      for (unsigned i = 0; i < nrPhysicalStages_; ++i)
+         pendingSequences_[i].push_back(stageScalings_[i] * pos + stageTranslations_[i]);
+      return DEVICE_OK;
+   }
 
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
       double physicalPos = stageScalings_[i] * pos + stageTranslations_[i];
-      int err = stage->AddToStageSequence(physicalPos);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+      return static_cast<MM::Stage*>(stages[i])->AddToStageSequence(physicalPos);
+   });
 }
 
 
 int MultiStage::SendStageSequence()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
+   std::vector<MM::Device*> stages = GetPhysicalStages();
+   return fanOut_.Run(stages, [&](std::size_t i) {
+      MM::Stage* stage = static_cast<MM::Stage*>(stages[i]);
+      if (precomputeSequence_ && i < pendingSequences_.size())
+      {
+         // Load the whole precomputed sequence for this stage
+         int err = stage->ClearStageSequence();
+         if (err != DEVICE_OK)
+            return err;
+         for (std::vector<double>::const_iterator it = pendingSequences_[i].begin(),
+            end = pendingSequences_[i].end(); it != end; ++it)
+         {
+            err = stage->AddToStageSequence(*it);
+            if (err != DEVICE_OK)
+               return err;
+         }
+      }
+      return stage->SendStageSequence();
+   });
+}
+
+
+std::vector<MM::Device*> MultiStage::GetPhysicalStages() const
+{
+   // Null for unassigned stages, so that indices match usedStages_
+   std::vector<MM::Device*> stages;
+   stages.reserve(usedStages_.size());
+   for (std::vector<std::string>::const_iterator it = usedStages_.begin(),
       end = usedStages_.end();
       it != end;
       ++it)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->SendStageSequence();
-      if (err != DEVICE_OK)
-         return err;
+      stages.push_back(GetDevice((*it).c_str()));
    }
-   return DEVICE_OK;
+   return stages;
 }
 
 
@@ -555,6 +549,7 @@ int MultiStage::OnPhysicalStage(MM::PropertyBase* pProp, MM::ActionType eAct, lo
    }
    else if (eAct == MM::AfterSet)
    {
+      fanOut_.InvalidateGroupKeys();
       std::string stageLabel;
       pProp->Get(stageLabel);
 
@@ -636,3 +631,35 @@ int MultiStage::OnBringIntoSync(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
+
+int MultiStage::OnConcurrentDispatch(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(fanOut_.IsConcurrent() ? "Yes" : "No");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string s;
+      pProp->Get(s);
+      fanOut_.SetConcurrent(s == "Yes");
+   }
+   return DEVICE_OK;
+}
+
+
+int MultiStage::OnPrecomputeSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(precomputeSequence_ ? "Yes" : "No");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string s;
+      pProp->Get(s);
+      precomputeSequence_ = (s == "Yes");
+      pendingSequences_.clear();
+   }
+   return DEVICE_OK;
+}
@@ -54,6 +54,7 @@ const char* g_DeviceNameDATTLStateDevice = "DA TTL State Device";
 const char* g_DeviceNameDAGalvoDevice = "DA Galvo";
 const char* g_DeviceNameMultiDAStateDevice = "Multi DA State Device";
 const char* g_DeviceNameAutoFocusStage = "AutoFocus Stage";
+const char* g_DeviceNameImageAutoFocus = "Image AutoFocus";
 const char* g_DeviceNameStateDeviceShutter = "State Device Shutter";
 const char* g_DeviceNameSerialDTRShutter = "Serial port DTR Shutter";
 
@@ -84,6 +85,7 @@ MODULE_API void InitializeModuleData()
    RegisterDevice(g_DeviceNameDAGalvoDevice, MM::GalvoDevice, "Two DAs operating a Galvo pair");
    RegisterDevice(g_DeviceNameMultiDAStateDevice, MM::StateDevice, "Several DAs as a single state device allowing digital masking");
    RegisterDevice(g_DeviceNameAutoFocusStage, MM::StageDevice, "AutoFocus offset acting as a Z-stage");
+   RegisterDevice(g_DeviceNameImageAutoFocus, MM::AutoFocusDevice, "Image-based software autofocus");
    RegisterDevice(g_DeviceNameStateDeviceShutter, MM::ShutterDevice, "State device used as a shutter");
    RegisterDevice(g_DeviceNameSerialDTRShutter, MM::ShutterDevice, "Serial port DTR used as a shutter");
 }
@@ -119,6 +121,8 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
       return new MultiDAStateDevice();
    } else if (strcmp(deviceName, g_DeviceNameAutoFocusStage) == 0) { 
       return new AutoFocusStage();
+   } else if (strcmp(deviceName, g_DeviceNameImageAutoFocus) == 0) {
+      return new ImageAutoFocus();
    } else if (strcmp(deviceName, g_DeviceNameStateDeviceShutter) == 0) {
       return new StateDeviceShutter();
    } else if (strcmp(deviceName, g_DeviceNameSerialDTRShutter) == 0) {
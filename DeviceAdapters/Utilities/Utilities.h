@@ -27,8 +27,14 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
+#include "DeviceFanOut.h"
+#include "FocusMetrics.h"
+#include "GalvoWaveform.h"
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <map>
+#include <thread>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -48,6 +54,9 @@
 #define ERR_AUTOFOCUS_NOT_SUPPORTED        10012
 #define ERR_NO_PHYSICAL_STAGE              10013
 #define ERR_NO_SHUTTER_DEVICE_FOUND        10014
+#define ERR_DA_NOT_SEQUENCEABLE            10015
+#define ERR_WAVEFORM_TOO_LONG              10016
+#define ERR_UNSUPPORTED_IMAGE_FORMAT       10017
 #define ERR_TIMEOUT                        10021
 
 
@@ -95,13 +104,17 @@ public:
    // ----------------
    int OnPhysicalShutter(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
    int OnState(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnConcurrentDispatch(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   std::vector<MM::Device*> GetPhysicalShutters() const;
+
    std::vector<std::string> availableShutters_;
    std::vector<std::string> usedShutters_;
    long nrPhysicalShutters_;
    bool open_;
    bool initialized_;
+   DeviceFanOut fanOut_;
 
    // Synchronize access to physical shutters. This is needed because
    // MultiShutter could be called from multiple threads at the same time if
@@ -237,8 +250,12 @@ private:
    int OnScaling(MM::PropertyBase* pProp, MM::ActionType eAct, long nr);
    int OnTranslationUm(MM::PropertyBase* pProp, MM::ActionType eAct, long nr);
    int OnBringIntoSync(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnConcurrentDispatch(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPrecomputeSequence(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   std::vector<MM::Device*> GetPhysicalStages() const;
+
    unsigned nrPhysicalStages_; // constant while initialized
    double simulatedStepSizeUm_;
    bool initialized_;
@@ -248,6 +265,13 @@ private:
    std::vector<std::string> usedStages_;
    std::vector<double> stageScalings_;
    std::vector<double> stageTranslations_;
+
+   // When precomputeSequence_ is set, AddToStageSequence() only records the
+   // physical positions, and SendStageSequence() loads each stage in one go.
+   bool precomputeSequence_;
+   std::vector<std::vector<double> > pendingSequences_;
+
+   DeviceFanOut fanOut_;
 };
 
 
@@ -296,8 +320,12 @@ private:
    int OnStepSize(MM::PropertyBase* pProp, MM::ActionType eAct, long xy);
    int OnScaling(MM::PropertyBase* pProp, MM::ActionType eAct, long xy);
    int OnTranslationUm(MM::PropertyBase* pProp, MM::ActionType eAct, long xy);
+   int OnConcurrentDispatch(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPrecomputeSequence(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   std::vector<MM::Device*> GetPhysicalStages() const;
+
    double simulatedXStepSizeUm_;
    double simulatedYStepSizeUm_;
    bool initialized_;
@@ -307,6 +335,12 @@ private:
    std::vector<std::string> usedStages_;
    std::vector<double> stageScalings_;
    std::vector<double> stageTranslations_;
+
+   // See MultiStage
+   bool precomputeSequence_;
+   std::vector<std::vector<double> > pendingSequences_;
+
+   DeviceFanOut fanOut_;
 };
 
 
@@ -666,14 +700,44 @@ private:
    int OnDAX(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnDAY(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnShutter(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSampleInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFillMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPointSpacing(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnLineSpacing(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDwellSamples(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   int UploadWaveform(MM::SignalIO* da, const std::vector<double>& samples);
+   int StartRun(long repetitions);
+   void StopRun();
+   void InvalidateWaveform();
+   void RunHardwareTimed(long repetitions);
+   void RunSoftwareTimed(long repetitions);
+   void WaitUntil(std::chrono::steady_clock::time_point deadline);
 
    std::string daXDevice_;
    std::string daYDevice_;
    bool initialized_;
    long nrRepetitions_;
-   double pulseIntervalUs_;
    std::string shutter_;
 
+   // Waveform settings
+   std::string timing_;
+   double sampleIntervalUs_;
+   bool rasterFill_;
+   double pointSpacing_;
+   double lineSpacing_;
+   long dwellSamples_;
+
+   // Polygons as added; compiled into waveformX_/Y_ by LoadPolygons()
+   std::vector<GalvoPolygon> polygons_;
+   std::vector<double> waveformX_;
+   std::vector<double> waveformY_;
+   bool waveformInHardware_;
+
+   std::thread runThread_;
+   std::atomic<bool> running_;
+   std::atomic<bool> stopRequested_;
 };
 
 // Use several DA (SignalIO) devices as a state device with adjustable voltage
@@ -762,6 +826,71 @@ private:
    bool initialized_;
 };
 
+/**
+ * Software autofocus: moves the Core's focus stage through a search range,
+ * snaps images with the Core's camera, and maximizes a sharpness metric
+ * computed on a central region of each image. The metric for one image is
+ * computed while the stage moves and the camera acquires the next.
+ */
+class ImageAutoFocus : public CAutoFocusBase<ImageAutoFocus>
+{
+public:
+   ImageAutoFocus();
+   ~ImageAutoFocus();
+
+   // Device API
+   // ----------
+   int Initialize();
+   int Shutdown();
+
+   void GetName(char* pszName) const;
+   bool Busy() { return false; }
+
+   // AutoFocus API
+   // -------------
+   int SetContinuousFocusing(bool state);
+   int GetContinuousFocusing(bool& state);
+   bool IsContinuousFocusLocked() { return false; }
+   int FullFocus();
+   int IncrementalFocus();
+   int GetLastFocusScore(double& score);
+   int GetCurrentFocusScore(double& score);
+   int AutoSetParameters() { return DEVICE_OK; }
+   int GetOffset(double& offset);
+   int SetOffset(double offset);
+
+private:
+   struct Settings
+   {
+      bool goldenSection;
+      FocusMetricType metric;
+      double rangeUm;
+      double coarseStepUm;
+      double fineStepUm;
+      double roiFraction;
+      unsigned nrThreads;
+      bool useStageSequence;
+   };
+
+   int ReadSettings(Settings& settings);
+   int GetDevices(MM::Camera*& camera, MM::Stage*& stage);
+   int Focus(const Settings& settings, double rangeUm, bool coarse);
+   int Scan(const Settings& settings, const std::vector<double>& positions,
+      std::vector<double>& scores);
+   int SearchGoldenSection(const Settings& settings, double lower,
+      double upper, double& bestZ, double& bestScore);
+   int Measure(const Settings& settings, double z, double& score);
+   int SnapROI(const Settings& settings, FocusImage& roi);
+   int MoveStage(double z);
+   int WaitForDevice(MM::Device* device);
+
+   MM::Camera* camera_;
+   MM::Stage* stage_;
+   double lastScore_;
+   double offsetUm_;
+   bool initialized_;
+};
+
 /**
  * StateDeviceShutter: Adds shuttering capabilities to a State Device
  */
@@ -834,4 +963,4 @@ private:
 };
 
 
-#endif //_UTILITIES_H_
\ No newline at end of file
+#endif //_UTILITIES_H_
\ No newline at end of file
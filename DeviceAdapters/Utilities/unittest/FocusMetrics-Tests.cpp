@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include "FocusMetrics.h"
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+
+namespace
+{
+
+FocusImage NoiseImage(unsigned width, unsigned height, double mean, double sd)
+{
+   std::mt19937 rng(12345);
+   std::normal_distribution<double> noise(mean, sd);
+   FocusImage img;
+   img.width = width;
+   img.height = height;
+   img.pixels.resize(static_cast<std::size_t>(width) * height);
+   for (std::size_t i = 0; i < img.pixels.size(); ++i)
+   {
+      const double v = std::round(noise(rng));
+      img.pixels[i] = static_cast<float>(std::min(65535.0, std::max(0.0, v)));
+   }
+   return img;
+}
+
+double Pixel(const FocusImage& img, std::size_t x, std::size_t y)
+{
+   return img.pixels[y * img.width + x];
+}
+
+// Straightforward double-precision references
+
+double ReferenceNormalizedVariance(const FocusImage& img)
+{
+   const std::size_t n = img.pixels.size();
+   double sum = 0.0;
+   for (std::size_t i = 0; i < n; ++i)
+      sum += img.pixels[i];
+   const double mean = sum / n;
+   double sq = 0.0;
+   for (std::size_t i = 0; i < n; ++i)
+      sq += (img.pixels[i] - mean) * (img.pixels[i] - mean);
+   return sq / n / mean;
+}
+
+double ReferenceBrenner(const FocusImage& img)
+{
+   double sum = 0.0;
+   for (std::size_t y = 0; y < img.height; ++y)
+      for (std::size_t x = 0; x + 2 < img.width; ++x)
+      {
+         const double d = Pixel(img, x + 2, y) - Pixel(img, x, y);
+         sum += d * d;
+      }
+   return sum;
+}
+
+double ReferenceTenengrad(const FocusImage& img)
+{
+   double sum = 0.0;
+   for (std::size_t y = 1; y + 1 < img.height; ++y)
+      for (std::size_t x = 1; x + 1 < img.width; ++x)
+      {
+         const double gx =
+            (Pixel(img, x + 1, y - 1) - Pixel(img, x - 1, y - 1)) +
+            2.0 * (Pixel(img, x + 1, y) - Pixel(img, x - 1, y)) +
+            (Pixel(img, x + 1, y + 1) - Pixel(img, x - 1, y + 1));
+         const double gy =
+            (Pixel(img, x - 1, y + 1) + 2.0 * Pixel(img, x, y + 1) +
+               Pixel(img, x + 1, y + 1)) -
+            (Pixel(img, x - 1, y - 1) + 2.0 * Pixel(img, x, y - 1) +
+               Pixel(img, x + 1, y - 1));
+         sum += gx * gx + gy * gy;
+      }
+   return sum;
+}
+
+struct NoiseParams
+{
+   unsigned width;
+   unsigned height;
+   double mean;
+   double sd;
+};
+
+class FocusMetricAccuracyTest : public ::testing::TestWithParam<NoiseParams>
+{
+};
+
+} // anonymous namespace
+
+
+TEST_P(FocusMetricAccuracyTest, MatchesDoubleReference)
+{
+   const NoiseParams p = GetParam();
+   const FocusImage img = NoiseImage(p.width, p.height, p.mean, p.sd);
+   const double variance = ReferenceNormalizedVariance(img);
+   const double brenner = ReferenceBrenner(img);
+   const double tenengrad = ReferenceTenengrad(img);
+
+   for (unsigned threads : { 1u, 3u, 8u })
+   {
+      SCOPED_TRACE(threads);
+      EXPECT_NEAR(variance, ComputeFocusMetric(
+            FocusMetricNormalizedVariance, img, threads), variance * 1e-9);
+      EXPECT_NEAR(brenner, ComputeFocusMetric(
+            FocusMetricBrenner, img, threads), brenner * 1e-9);
+      EXPECT_NEAR(tenengrad, ComputeFocusMetric(
+            FocusMetricTenengrad, img, threads), tenengrad * 1e-9);
+   }
+}
+
+INSTANTIATE_TEST_CASE_P(NoiseImages, FocusMetricAccuracyTest,
+   ::testing::Values(
+      NoiseParams{ 2048, 2048, 30000.0, 10.0 }, // Bright, low contrast
+      NoiseParams{ 2048, 2048, 1000.0, 20.0 },
+      NoiseParams{ 61, 37, 100.0, 30.0 } // Row lengths not a multiple of 8
+   ));
+
+TEST(FocusMetricTests, EmptyAndTinyImages)
+{
+   FocusImage img;
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricNormalizedVariance, img, 4));
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricBrenner, img, 4));
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricTenengrad, img, 4));
+
+   img = NoiseImage(2, 2, 100.0, 10.0);
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricBrenner, img, 4));
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricTenengrad, img, 4));
+}
+
+TEST(FocusMetricTests, FlatImageScoresZero)
+{
+   FocusImage img = NoiseImage(64, 64, 500.0, 0.0);
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricNormalizedVariance, img, 2));
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricBrenner, img, 2));
+   EXPECT_EQ(0.0, ComputeFocusMetric(FocusMetricTenengrad, img, 2));
+}
+
+TEST(FocusMetricTests, FFTBandPassIsThreadIndependent)
+{
+   const FocusImage img = NoiseImage(256, 256, 1000.0, 50.0);
+   const double score = ComputeFocusMetric(FocusMetricFFTBandPass, img, 1);
+   EXPECT_GT(score, 0.0);
+   EXPECT_LE(score, 1.0);
+   EXPECT_NEAR(score, ComputeFocusMetric(FocusMetricFFTBandPass, img, 4),
+      score * 1e-9);
+}
+
+TEST(FocusMetricTests, ExtractCenteredROI)
+{
+   const unsigned width = 8, height = 4;
+   std::vector<unsigned short> pixels(width * height);
+   for (unsigned i = 0; i < pixels.size(); ++i)
+      pixels[i] = static_cast<unsigned short>(1000 * i);
+
+   FocusImage roi;
+   ASSERT_TRUE(ExtractFocusROI(
+      reinterpret_cast<const unsigned char*>(pixels.data()),
+      width, height, 2, 1, 0.5, roi));
+   ASSERT_EQ(4u, roi.width);
+   ASSERT_EQ(2u, roi.height);
+   EXPECT_EQ(1000.0f * (1 * width + 2), roi.pixels[0]);
+   EXPECT_EQ(1000.0f * (2 * width + 5), roi.pixels[7]);
+
+   EXPECT_FALSE(ExtractFocusROI(
+      reinterpret_cast<const unsigned char*>(pixels.data()),
+      width, height, 2, 1, 0.0, roi));
+   EXPECT_FALSE(ExtractFocusROI(
+      reinterpret_cast<const unsigned char*>(pixels.data()),
+      width, height, 3, 1, 1.0, roi));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+
+#include "GalvoWaveform.h"
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+
+namespace
+{
+
+GalvoPolygon Square(double x0, double y0, double size)
+{
+   GalvoPolygon square;
+   square.push_back(std::make_pair(x0, y0));
+   square.push_back(std::make_pair(x0 + size, y0));
+   square.push_back(std::make_pair(x0 + size, y0 + size));
+   square.push_back(std::make_pair(x0, y0 + size));
+   return square;
+}
+
+} // anonymous namespace
+
+
+TEST(GalvoWaveformTests, NoPolygonsGiveEmptyWaveform)
+{
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(std::vector<GalvoPolygon>(),
+      GalvoWaveformSettings(), xs, ys));
+   EXPECT_TRUE(xs.empty());
+   EXPECT_TRUE(ys.empty());
+}
+
+TEST(GalvoWaveformTests, SinglePointDwells)
+{
+   std::vector<GalvoPolygon> polygons(1);
+   polygons[0].push_back(std::make_pair(1.5, -2.0));
+   GalvoWaveformSettings settings;
+   settings.dwellSamples = 3;
+
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+   ASSERT_EQ(3u, xs.size());
+   ASSERT_EQ(3u, ys.size());
+   for (std::size_t i = 0; i < 3; ++i)
+   {
+      EXPECT_EQ(1.5, xs[i]);
+      EXPECT_EQ(-2.0, ys[i]);
+   }
+}
+
+TEST(GalvoWaveformTests, OutlineVisitsVerticesAndCloses)
+{
+   std::vector<GalvoPolygon> polygons(1, Square(0.0, 0.0, 1.0));
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, GalvoWaveformSettings(),
+      xs, ys));
+
+   const double expectedX[] = { 0.0, 1.0, 1.0, 0.0, 0.0 };
+   const double expectedY[] = { 0.0, 0.0, 1.0, 1.0, 0.0 };
+   ASSERT_EQ(5u, xs.size());
+   ASSERT_EQ(5u, ys.size());
+   for (std::size_t i = 0; i < 5; ++i)
+   {
+      EXPECT_DOUBLE_EQ(expectedX[i], xs[i]);
+      EXPECT_DOUBLE_EQ(expectedY[i], ys[i]);
+   }
+}
+
+TEST(GalvoWaveformTests, LineIsTracedOutAndBack)
+{
+   std::vector<GalvoPolygon> polygons(1);
+   polygons[0].push_back(std::make_pair(0.0, 0.0));
+   polygons[0].push_back(std::make_pair(2.0, 1.0));
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, GalvoWaveformSettings(),
+      xs, ys));
+
+   ASSERT_EQ(3u, xs.size());
+   EXPECT_DOUBLE_EQ(0.0, xs[0]);
+   EXPECT_DOUBLE_EQ(2.0, xs[1]);
+   EXPECT_DOUBLE_EQ(1.0, ys[1]);
+   EXPECT_DOUBLE_EQ(0.0, xs[2]);
+   EXPECT_DOUBLE_EQ(0.0, ys[2]);
+}
+
+TEST(GalvoWaveformTests, PointSpacingLimitsStep)
+{
+   std::vector<GalvoPolygon> polygons(1, Square(0.0, 0.0, 1.0));
+   GalvoWaveformSettings settings;
+   settings.pointSpacing = 0.3;
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+
+   // Each side of length 1 takes ceil(1 / 0.3) = 4 equal steps
+   ASSERT_EQ(1u + 4 * 4, xs.size());
+   ASSERT_EQ(xs.size(), ys.size());
+   for (std::size_t i = 1; i < xs.size(); ++i)
+   {
+      const double step = std::sqrt((xs[i] - xs[i - 1]) * (xs[i] - xs[i - 1]) +
+         (ys[i] - ys[i - 1]) * (ys[i] - ys[i - 1]));
+      EXPECT_NEAR(0.25, step, 1e-12);
+   }
+   EXPECT_DOUBLE_EQ(0.0, xs.back());
+   EXPECT_DOUBLE_EQ(0.0, ys.back());
+}
+
+TEST(GalvoWaveformTests, DwellRepeatsEveryPoint)
+{
+   std::vector<GalvoPolygon> polygons(1, Square(0.0, 0.0, 1.0));
+   GalvoWaveformSettings settings;
+   settings.dwellSamples = 4;
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+
+   ASSERT_EQ(5u * 4, xs.size());
+   for (std::size_t i = 0; i < xs.size(); ++i)
+   {
+      EXPECT_EQ(xs[i - i % 4], xs[i]);
+      EXPECT_EQ(ys[i - i % 4], ys[i]);
+   }
+}
+
+TEST(GalvoWaveformTests, RasterIsSerpentineAndCentered)
+{
+   std::vector<GalvoPolygon> polygons(1, Square(0.0, 0.0, 1.0));
+   GalvoWaveformSettings settings;
+   settings.rasterFill = true;
+   settings.lineSpacing = 0.25;
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+
+   // Four lines at 0.125, 0.375, 0.625 and 0.875, each visited at both ends
+   const double expectedX[] = { 0.0, 1.0, 1.0, 0.0, 0.0, 1.0, 1.0, 0.0 };
+   const double expectedY[] = { 0.125, 0.125, 0.375, 0.375,
+      0.625, 0.625, 0.875, 0.875 };
+   ASSERT_EQ(8u, xs.size());
+   ASSERT_EQ(8u, ys.size());
+   for (std::size_t i = 0; i < 8; ++i)
+   {
+      EXPECT_DOUBLE_EQ(expectedX[i], xs[i]);
+      EXPECT_DOUBLE_EQ(expectedY[i], ys[i]);
+   }
+}
+
+TEST(GalvoWaveformTests, RasterSkipsConcaveGap)
+{
+   // A U shape: the upper half consists of two arms, x in [0, 1] and [2, 3]
+   GalvoPolygon u;
+   u.push_back(std::make_pair(0.0, 0.0));
+   u.push_back(std::make_pair(3.0, 0.0));
+   u.push_back(std::make_pair(3.0, 2.0));
+   u.push_back(std::make_pair(2.0, 2.0));
+   u.push_back(std::make_pair(2.0, 1.0));
+   u.push_back(std::make_pair(1.0, 1.0));
+   u.push_back(std::make_pair(1.0, 2.0));
+   u.push_back(std::make_pair(0.0, 2.0));
+   std::vector<GalvoPolygon> polygons(1, u);
+   GalvoWaveformSettings settings;
+   settings.rasterFill = true;
+   settings.lineSpacing = 1.0;
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+
+   // Line y = 0.5 spans the base; line y = 1.5, scanned right to left,
+   // covers each arm separately
+   const double expectedX[] = { 0.0, 3.0, 3.0, 2.0, 1.0, 0.0 };
+   const double expectedY[] = { 0.5, 0.5, 1.5, 1.5, 1.5, 1.5 };
+   ASSERT_EQ(6u, xs.size());
+   for (std::size_t i = 0; i < 6; ++i)
+   {
+      EXPECT_DOUBLE_EQ(expectedX[i], xs[i]);
+      EXPECT_DOUBLE_EQ(expectedY[i], ys[i]);
+   }
+}
+
+TEST(GalvoWaveformTests, RasterTracesPointsAndLines)
+{
+   std::vector<GalvoPolygon> polygons(2);
+   polygons[0].push_back(std::make_pair(5.0, 5.0));
+   polygons[1].push_back(std::make_pair(0.0, 0.0));
+   polygons[1].push_back(std::make_pair(1.0, 0.0));
+   GalvoWaveformSettings settings;
+   settings.rasterFill = true;
+   settings.lineSpacing = 0.1;
+   std::vector<double> xs, ys;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+
+   // Polygons are appended in order
+   ASSERT_EQ(1u + 3, xs.size());
+   EXPECT_DOUBLE_EQ(5.0, xs[0]);
+   EXPECT_DOUBLE_EQ(0.0, xs[1]);
+   EXPECT_DOUBLE_EQ(1.0, xs[2]);
+   EXPECT_DOUBLE_EQ(0.0, xs[3]);
+}
+
+TEST(GalvoWaveformTests, MaxSamplesIsEnforced)
+{
+   std::vector<GalvoPolygon> polygons(1, Square(0.0, 0.0, 1.0));
+   GalvoWaveformSettings settings;
+   settings.dwellSamples = 2;
+   std::vector<double> xs, ys;
+
+   settings.maxSamples = 10;
+   ASSERT_TRUE(CompileGalvoWaveform(polygons, settings, xs, ys));
+   EXPECT_EQ(10u, xs.size());
+
+   xs.clear();
+   ys.clear();
+   settings.maxSamples = 9;
+   EXPECT_FALSE(CompileGalvoWaveform(polygons, settings, xs, ys));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -39,6 +39,13 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 *              - USB ID 1871:7670 Aveo Technology Corp. (uvcvideo) - COLEMETER(R) USB 2.0 Digital Microscope
 *              - USB ID 046d:0826 Logitech, Inc. HD Webcam C525
 *
+*            - Streaming sequence acquisition: a capture thread polls the device, converts each
+*              dequeued mmap buffer and requeues it at once, so the driver's ring never runs dry.
+*              Frames carry the driver's timestamp and sequence number.
+*            - SSE2 conversion kernels for YUYV->BGRA and YUYV->8bit.
+*            - Can be tested without hardware using the vivid virtual driver:
+*              sudo modprobe vivid; then set DevicePath to the vivid capture node.
+*
 */
 // LICENSE:       This file is distributed under the "LGPL" license.
 //
@@ -58,6 +65,7 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 #include "DeviceBase.h"
 #include "ModuleInterface.h"
 #include "ImgBuffer.h"
+#include "PixelConversion.h"
 #include <sstream>
 #include <map>
 #include <vector>
@@ -72,8 +80,16 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 #include <cstring>
 #include <cerrno>
 #include <sys/mman.h>
+#include <poll.h>
+#include <time.h>
+
+#include <atomic>
+#include <climits>
+#include <thread>
 
-#include <pthread.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -88,6 +104,9 @@ const char
 const long gWidthDefault = 640,
            gHeightDefault = 480;
 
+// Enough mmap buffers to ride out scheduling delays while streaming
+const unsigned gBufferCount = 8;
+
 struct VidBuffer {
   void *start;
   size_t length;
@@ -102,6 +121,23 @@ struct State {
   struct v4l2_buffer *buf;
 };
 
+// Extracts the luminance of nPixels YUYV pixels
+static void convertYUYVTo8Bit(const unsigned char* in, unsigned char* out, size_t nPixels)
+{
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i lowByte = _mm_set1_epi16(0x00FF);
+  for (; i + 16 <= nPixels; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16));
+    __m128i y = _mm_packus_epi16(_mm_and_si128(a, lowByte), _mm_and_si128(b, lowByte));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), y);
+  }
+#endif
+  for (; i < nPixels; ++i)
+    out[i] = in[2 * i];
+}
+
 class PixelType {
   public:
     PixelType(string propertyValue, unsigned bytesPerPixel, unsigned numberOfComponents, unsigned bitDepth) :
@@ -135,13 +171,7 @@ class PixelType8Bit : public PixelType {
 
     virtual void convertV4l2ToOutput(
         State *state, unsigned char* in, unsigned char* output) const {
-      int i,j;
-      for (j = 0; j < state->H; j++) {
-        int wj = state->W * j;
-        for (i = 0; i < state->W; i++) {
-          output[i + wj] = in[2*i + 2*wj];
-        }
-      }
+      convertYUYVTo8Bit(in, output, (size_t) state->W * state->H);
     }
 };
 string PixelType8Bit::PROPERTY_VALUE = "8bit";
@@ -159,37 +189,7 @@ class PixelTypeYUYV : public PixelType {
         State *state, unsigned char* ptrIn, unsigned char* ptrOut) const {
       /* Convert YUYV to RGBA32, apparently mm does only display colors
        * in this format */
-      for (int i = 0;  i < state->W * state->H / 2; ++i) {
-        int y0 = ptrIn[0];
-        int u0 = ptrIn[1];
-        int y1 = ptrIn[2];
-        int v0 = ptrIn[3];
-        ptrIn += 4;
-        int c = y0 - 16;
-        int d = u0 - 128;
-        int e = v0 - 128;
-
-        ptrOut[0] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[1] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[2] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[4] = 255; // alpha
-        c = y1 - 16;
-        ptrOut[4] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[5] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[6] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[7] = 255; // alpha
-        ptrOut += 8;
-      }
-    }
-
-  private:
-    inline unsigned char clip(int val) const {
-      if (val <= 0)
-        return 0;
-      else if (val >= 255)
-        return 255;
-      else
-        return val;
+      PixelConversion::ConvertYUYVToBGRA(ptrIn, ptrOut, (size_t) state->W * state->H);
     }
 };
 string PixelTypeYUYV::PROPERTY_VALUE = "YUYV";
@@ -204,7 +204,9 @@ public:
   // little as possible, don't access hardware, do everything else in
   // Initialize()
   V4L2() :
-    pixelType(&PIXELTYPE_8BIT)
+    pixelType(&PIXELTYPE_8BIT),
+    stopCapture_(false),
+    capturing_(false)
   {
     initialized_ = 0;
   }
@@ -287,6 +289,7 @@ public:
   // afterwards, unload device, release all resources
   int Shutdown()
   {
+    StopSequenceAcquisition();
     if (initialized_) {
       VideoClose();
     }
@@ -302,6 +305,8 @@ public:
   // blocks until exposure is finished
   int SnapImage()
   {
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
     unsigned char* data = VideoTakeBuffer();
     pixelType->convertV4l2ToOutput(state, data, const_cast<unsigned char*>(imageBuffer.GetPixels()));
     VideoReturnBuffer();
@@ -482,6 +487,50 @@ public:
      isSequenceable = false; 
      return DEVICE_OK;
   }
+
+  /**
+   * Streams from the mmap buffer ring on a dedicated thread. The frame
+   * rate is set by the device; the interval is ignored.
+   */
+  int StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+  {
+    (void) interval_ms;
+    if (!initialized_)
+      return DEVICE_NOT_CONNECTED;
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+    int ret = GetCoreCallback()->PrepareForAcq(this);
+    if (ret != DEVICE_OK)
+      return ret;
+
+    // A previous sequence that ended on its own leaves a finished thread
+    if (captureThread_.joinable())
+      captureThread_.join();
+
+    seqBuffer_.Resize(state->W, state->H, pixelType->GetImageBytesPerPixel());
+    DiscardQueuedFrames();
+
+    stopCapture_ = false;
+    capturing_ = true;
+    captureThread_ = std::thread(&V4L2::CaptureLoop, this, numImages, stopOnOverflow);
+    return DEVICE_OK;
+  }
+
+  int StartSequenceAcquisition(double interval_ms)
+  {
+    return StartSequenceAcquisition(LONG_MAX, interval_ms, false);
+  }
+
+  int StopSequenceAcquisition()
+  {
+    stopCapture_ = true;
+    if (captureThread_.joinable())
+      captureThread_.join();
+    return DEVICE_OK;
+  }
+
+  bool IsCapturing() { return capturing_; }
   
 private:
 
@@ -518,7 +567,7 @@ private:
     memset(&reqbuf, 0, sizeof(reqbuf));
     reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     reqbuf.memory = V4L2_MEMORY_MMAP;
-    reqbuf.count = 4;
+    reqbuf.count = gBufferCount;
 
     if (-1 == tryIoctl(state->fd, VIDIOC_REQBUFS, &reqbuf)) {
       ostringstream msg;
@@ -534,7 +583,7 @@ private:
     }
 
     ostringstream bufMsg;
-    bufMsg << "got " << reqbuf.count << " out of 4 requested buffers";
+    bufMsg << "got " << reqbuf.count << " out of " << gBufferCount << " requested buffers";
     LogMessage(bufMsg.str().c_str());
 
     state->buffers = (struct VidBuffer*)calloc(reqbuf.count, sizeof(*(state->buffers)));
@@ -627,8 +676,8 @@ private:
     fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
     fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-    fmt.fmt.pix.height      = (unsigned) requestedWidth;
-    fmt.fmt.pix.width       = (unsigned) requestedHeight;
+    fmt.fmt.pix.height      = (unsigned) requestedHeight;
+    fmt.fmt.pix.width       = (unsigned) requestedWidth;
 
     if (-1 == tryIoctl(state->fd, VIDIOC_S_FMT, &fmt)) {
       ostringstream msg;
@@ -720,6 +769,156 @@ private:
     }
   }
 
+  /* Frames queued up while not capturing are stale; hand them back so that
+   * the sequence starts with a fresh frame. */
+  void
+  DiscardQueuedFrames()
+  {
+    for (;;) {
+      struct pollfd pfd;
+      pfd.fd = state->fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+        return;
+
+      struct v4l2_buffer buf;
+      memset(&buf, 0, sizeof(buf));
+      buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      buf.memory = V4L2_MEMORY_MMAP;
+      if (-1 == ioctl(state->fd, VIDIOC_DQBUF, &buf))
+        return;
+      ioctl(state->fd, VIDIOC_QBUF, &buf);
+    }
+  }
+
+  static double
+  TimevalToMs(const struct timeval& tv)
+  {
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+  }
+
+  void
+  CaptureLoop(long numImages, bool stopOnOverflow)
+  {
+    const int pollTimeoutMs = 100;
+    const int frameTimeoutMs = 10000;
+
+    // Driver timestamps are usually CLOCK_MONOTONIC; if so, elapsed time
+    // is measured from the start of the sequence, otherwise from the first
+    // frame.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double startMonotonicMs = now.tv_sec * 1000.0 + now.tv_nsec / 1.0e6;
+    double firstFrameMs = -1.0;
+
+    char label[MM::MaxStrLength];
+    GetLabel(label);
+
+    int ret = DEVICE_OK;
+    long count = 0;
+    int waitedMs = 0;
+    bool haveSequence = false;
+    __u32 lastSequence = 0;
+    long dropped = 0;
+    while (!stopCapture_ && count < numImages) {
+      struct pollfd pfd;
+      pfd.fd = state->fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int r = poll(&pfd, 1, pollTimeoutMs);
+      if (r < 0) {
+        if (errno == EINTR)
+          continue;
+        LogMessage(string("error: poll failed: ") + strerror(errno));
+        ret = DEVICE_ERR;
+        break;
+      }
+      if (r == 0) {
+        waitedMs += pollTimeoutMs;
+        if (waitedMs >= frameTimeoutMs) {
+          LogMessage("error: timed out waiting for a frame");
+          ret = DEVICE_SNAP_IMAGE_FAILED;
+          break;
+        }
+        continue;
+      }
+      waitedMs = 0;
+
+      struct v4l2_buffer buf;
+      memset(&buf, 0, sizeof(buf));
+      buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      buf.memory = V4L2_MEMORY_MMAP;
+      if (-1 == ioctl(state->fd, VIDIOC_DQBUF, &buf)) {
+        if (errno == EAGAIN || errno == EINTR)
+          continue;
+        LogMessage(string("error: could not dequeue buffer: ") + strerror(errno));
+        ret = DEVICE_ERR;
+        break;
+      }
+      if (buf.index >= state->buffers_count) {
+        ret = DEVICE_ERR;
+        break;
+      }
+
+      // Convert, then requeue at once so the driver keeps all but one
+      // buffer to fill
+      pixelType->convertV4l2ToOutput(state,
+          (unsigned char*) state->buffers[buf.index].start,
+          const_cast<unsigned char*>(seqBuffer_.GetPixels()));
+      if (-1 == ioctl(state->fd, VIDIOC_QBUF, &buf)) {
+        LogMessage(string("error: could not requeue buffer: ") + strerror(errno));
+        ret = DEVICE_ERR;
+        break;
+      }
+
+      if (haveSequence && buf.sequence > lastSequence + 1)
+        dropped += buf.sequence - lastSequence - 1;
+      haveSequence = true;
+      lastSequence = buf.sequence;
+
+      const double frameMs = TimevalToMs(buf.timestamp);
+      double elapsedMs;
+      if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        elapsedMs = frameMs - startMonotonicMs;
+      }
+      else {
+        if (firstFrameMs < 0.0)
+          firstFrameMs = frameMs;
+        elapsedMs = frameMs - firstFrameMs;
+      }
+
+      Metadata md;
+      md.put("Camera", label);
+      md.put(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString(elapsedMs));
+      md.put("V4L2-TimestampMs", CDeviceUtils::ConvertToString(frameMs));
+      md.put("V4L2-Sequence", CDeviceUtils::ConvertToString((long) buf.sequence));
+      md.put("V4L2-DroppedFrames", CDeviceUtils::ConvertToString(dropped));
+      md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(count));
+
+      ret = GetCoreCallback()->InsertImage(this, seqBuffer_.GetPixels(),
+          seqBuffer_.Width(), seqBuffer_.Height(), seqBuffer_.Depth(),
+          pixelType->GetNumberOfComponents(), md.Serialize().c_str());
+      if (ret == DEVICE_BUFFER_OVERFLOW && !stopOnOverflow) {
+        GetCoreCallback()->ClearImageBuffer(this);
+        ret = GetCoreCallback()->InsertImage(this, seqBuffer_.GetPixels(),
+            seqBuffer_.Width(), seqBuffer_.Height(), seqBuffer_.Depth(),
+            pixelType->GetNumberOfComponents(), md.Serialize().c_str(), false);
+      }
+      if (ret != DEVICE_OK)
+        break;
+      ++count;
+    }
+
+    if (dropped > 0) {
+      ostringstream msg;
+      msg << "driver dropped " << dropped << " frame(s) during the sequence";
+      LogMessage(msg.str());
+    }
+    capturing_ = false;
+    GetCoreCallback()->AcqFinished(this, ret);
+  }
+
   int reinitializeDeviceIfRunning() {
     if (initialized_) {
       LogMessage("closing current device");
@@ -797,6 +996,11 @@ private:
   State state[1];
   ImgBuffer imageBuffer;
   PixelType *pixelType;
+
+  std::thread captureThread_;
+  std::atomic<bool> stopCapture_;
+  std::atomic<bool> capturing_;
+  ImgBuffer seqBuffer_; // Written only by the capture thread
 };
 
 MODULE_API void InitializeModuleData()
@@ -0,0 +1,214 @@
+#include "AsyncOperations.h"
+
+#include "Error.h"
+#include "ErrorCodes.h"
+
+#include <utility>
+
+namespace mm
+{
+
+AsyncOperations::AsyncOperations(std::chrono::milliseconds pollInterval) :
+   pollInterval_(pollInterval),
+   nextHandle_(0),
+   pendingCount_(0),
+   stopRequested_(false)
+{
+}
+
+AsyncOperations::~AsyncOperations()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopRequested_ = true;
+   }
+   cv_.notify_all();
+   if (thread_.joinable())
+      thread_.join();
+}
+
+long
+AsyncOperations::Add(const std::string& description, BusyFunction busy)
+{
+   long handle;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      handle = nextHandle_++;
+      Operation& op = operations_[handle];
+      op.description = description;
+      op.busy = std::move(busy);
+      op.complete = false;
+      ++pendingCount_;
+      if (!thread_.joinable())
+         thread_ = std::thread([this]() { Run(); });
+   }
+   cv_.notify_all();
+   return handle;
+}
+
+bool
+AsyncOperations::IsComplete(long handle)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   CheckHandles(std::vector<long>(1, handle));
+   std::map<long, Operation>::iterator it = operations_.find(handle);
+   if (!it->second.complete)
+      return false;
+   const std::exception_ptr error = it->second.error;
+   operations_.erase(it);
+   if (error)
+      std::rethrow_exception(error);
+   return true;
+}
+
+bool
+AsyncOperations::WaitForAll(const std::vector<long>& handles,
+      std::chrono::milliseconds timeout)
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   CheckHandles(handles);
+
+   const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + timeout;
+   bool invalidated = false;
+   const bool finished = cv_.wait_until(lock, deadline, [&]() {
+      for (long handle : handles)
+      {
+         if (operations_.find(handle) == operations_.end())
+         {
+            invalidated = true; // Cleared while waiting
+            return true;
+         }
+      }
+      return AllComplete(handles);
+   });
+   if (invalidated)
+      CheckHandles(handles); // Throws
+   if (!finished)
+      return false;
+
+   std::exception_ptr error;
+   for (long handle : handles)
+   {
+      std::map<long, Operation>::iterator it = operations_.find(handle);
+      if (it == operations_.end())
+         continue; // Duplicate handle, already released
+      if (!error)
+         error = it->second.error;
+      operations_.erase(it);
+   }
+   if (error)
+      std::rethrow_exception(error);
+   return true;
+}
+
+std::vector<std::string>
+AsyncOperations::GetPending(const std::vector<long>& handles) const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   std::vector<std::string> pending;
+   for (long handle : handles)
+   {
+      std::map<long, Operation>::const_iterator it = operations_.find(handle);
+      if (it != operations_.end() && !it->second.complete)
+         pending.push_back(it->second.description);
+   }
+   return pending;
+}
+
+void
+AsyncOperations::Clear()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      operations_.clear();
+      pendingCount_ = 0;
+   }
+   cv_.notify_all();
+}
+
+// Caller must hold mutex_
+void
+AsyncOperations::CheckHandles(const std::vector<long>& handles) const
+{
+   for (long handle : handles)
+   {
+      if (operations_.find(handle) == operations_.end())
+         throw CMMError("Invalid asynchronous operation handle (" +
+               std::to_string(handle) + ")", MMERR_InvalidAsyncHandle);
+   }
+}
+
+// Caller must hold mutex_
+bool
+AsyncOperations::AllComplete(const std::vector<long>& handles) const
+{
+   for (long handle : handles)
+   {
+      if (!operations_.find(handle)->second.complete)
+         return false;
+   }
+   return true;
+}
+
+void
+AsyncOperations::Run()
+{
+   typedef std::pair<long, BusyFunction> PendingOperation;
+   typedef std::pair<long, std::exception_ptr> Completion;
+
+   std::unique_lock<std::mutex> lock(mutex_);
+   for (;;)
+   {
+      cv_.wait(lock, [this]() { return stopRequested_ || pendingCount_ > 0; });
+      if (stopRequested_)
+         return;
+
+      std::vector<PendingOperation> pending;
+      for (const auto& entry : operations_)
+      {
+         if (!entry.second.complete)
+            pending.push_back(PendingOperation(entry.first, entry.second.busy));
+      }
+
+      // Poll without holding the lock, as devices may take a while to answer
+      lock.unlock();
+      std::vector<Completion> completions;
+      for (const PendingOperation& op : pending)
+      {
+         try
+         {
+            if (!op.second())
+               completions.push_back(Completion(op.first, nullptr));
+         }
+         catch (...)
+         {
+            completions.push_back(Completion(op.first,
+                     std::current_exception()));
+         }
+      }
+      lock.lock();
+
+      bool changed = false;
+      for (const Completion& completion : completions)
+      {
+         std::map<long, Operation>::iterator it =
+            operations_.find(completion.first);
+         if (it == operations_.end() || it->second.complete)
+            continue; // Cleared meanwhile
+         it->second.complete = true;
+         it->second.error = completion.second;
+         it->second.busy = BusyFunction(); // Release captured device
+         --pendingCount_;
+         changed = true;
+      }
+      if (changed)
+         cv_.notify_all();
+
+      if (pendingCount_ > 0 &&
+            cv_.wait_for(lock, pollInterval_, [this]() { return stopRequested_; }))
+         return;
+   }
+}
+
+} // namespace mm
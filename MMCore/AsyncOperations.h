@@ -0,0 +1,82 @@
+// Tracking of device operations that complete asynchronously (e.g. stage
+// moves), so that callers can start several and then wait for all of them.
+//
+// Operations are identified by integer handles. A single background thread
+// polls each pending operation's busy function until it reports not busy;
+// waiters block on a condition variable instead of polling themselves.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mm
+{
+
+class AsyncOperations
+{
+public:
+   // Returns true while the operation is in progress. May throw CMMError
+   // (e.g. if the device has been unloaded), which fails the operation.
+   typedef std::function<bool()> BusyFunction;
+
+   explicit AsyncOperations(std::chrono::milliseconds pollInterval);
+   ~AsyncOperations();
+
+   AsyncOperations(const AsyncOperations&) = delete;
+   AsyncOperations& operator=(const AsyncOperations&) = delete;
+
+   // Starts tracking an operation that has already been started; the
+   // description (e.g. the device label) is used in error messages.
+   long Add(const std::string& description, BusyFunction busy);
+
+   // Returns true once the operation is complete, releasing the handle; if
+   // the operation failed, releases the handle and throws the failure.
+   // Throws CMMError if the handle is not valid.
+   bool IsComplete(long handle);
+
+   // Returns false if the timeout elapses first, in which case all handles
+   // remain valid. Otherwise releases the handles and, if any operation
+   // failed, throws the first failure. Throws CMMError without waiting or
+   // releasing if any handle is not valid.
+   bool WaitForAll(const std::vector<long>& handles,
+         std::chrono::milliseconds timeout);
+
+   // Descriptions of the given operations that are still in progress
+   std::vector<std::string> GetPending(const std::vector<long>& handles) const;
+
+   // Forgets all operations; any waiters see their handles as invalid
+   void Clear();
+
+private:
+   struct Operation
+   {
+      std::string description;
+      BusyFunction busy;
+      bool complete;
+      std::exception_ptr error;
+   };
+
+   void Run();
+   void CheckHandles(const std::vector<long>& handles) const;
+   bool AllComplete(const std::vector<long>& handles) const;
+
+   const std::chrono::milliseconds pollInterval_;
+
+   mutable std::mutex mutex_;
+   std::condition_variable cv_; // Signaled on add, completion, and stop
+   std::map<long, Operation> operations_;
+   long nextHandle_;
+   std::size_t pendingCount_;
+   bool stopRequested_;
+   std::thread thread_; // Started on first Add()
+};
+
+} // namespace mm
@@ -0,0 +1,65 @@
+#include "CameraBufferLanes.h"
+
+#include "CircularBuffer.h"
+
+namespace mm
+{
+
+CameraBufferLanes::CameraBufferLanes()
+{
+}
+
+void
+CameraBufferLanes::Add(const std::string& cameraLabel,
+      std::shared_ptr<CircularBuffer> buffer)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   lanes_[cameraLabel] = buffer;
+}
+
+bool
+CameraBufferLanes::Remove(const std::string& cameraLabel)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return lanes_.erase(cameraLabel) > 0;
+}
+
+void
+CameraBufferLanes::Clear()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   lanes_.clear();
+}
+
+std::shared_ptr<CircularBuffer>
+CameraBufferLanes::Find(const std::string& cameraLabel) const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (lanes_.empty())
+      return std::shared_ptr<CircularBuffer>();
+   std::map<std::string, std::shared_ptr<CircularBuffer> >::const_iterator it =
+      lanes_.find(cameraLabel);
+   if (it == lanes_.end())
+      return std::shared_ptr<CircularBuffer>();
+   return it->second;
+}
+
+std::vector<std::string>
+CameraBufferLanes::GetCameraLabels() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   std::vector<std::string> labels;
+   labels.reserve(lanes_.size());
+   for (const auto& lane : lanes_)
+      labels.push_back(lane.first);
+   return labels;
+}
+
+bool
+CameraBufferLanes::IsEmpty() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return lanes_.empty();
+}
+
+} // namespace mm
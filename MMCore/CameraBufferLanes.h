@@ -0,0 +1,51 @@
+// Per-camera sequence buffers ("lanes").
+//
+// By default all cameras insert into the core's single circular buffer, which
+// has one image geometry and serializes inserts. A camera that has a lane
+// inserts into its own CircularBuffer instead, with its own geometry,
+// capacity, overflow state and locks, so that cameras of different image
+// sizes can stream concurrently without contending with each other.
+//
+// Lanes are looked up on every image insert; the registry lock is only held
+// for the lookup, never while images are copied.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class CircularBuffer;
+
+namespace mm
+{
+
+class CameraBufferLanes
+{
+public:
+   CameraBufferLanes();
+
+   CameraBufferLanes(const CameraBufferLanes&) = delete;
+   CameraBufferLanes& operator=(const CameraBufferLanes&) = delete;
+
+   // Replaces any existing lane for the camera
+   void Add(const std::string& cameraLabel,
+         std::shared_ptr<CircularBuffer> buffer);
+   bool Remove(const std::string& cameraLabel);
+   void Clear();
+
+   // Returns null if the camera has no lane. The lane stays valid for as long
+   // as the caller holds on to it, even if it is removed meanwhile.
+   std::shared_ptr<CircularBuffer> Find(const std::string& cameraLabel) const;
+
+   std::vector<std::string> GetCameraLabels() const;
+   bool IsEmpty() const;
+
+private:
+   mutable std::mutex mutex_;
+   std::map<std::string, std::shared_ptr<CircularBuffer> > lanes_;
+};
+
+} // namespace mm
@@ -25,13 +25,16 @@
 // 
 #include "CircularBuffer.h"
 #include "CoreUtils.h"
+#include "Tracing.h"
 
 #include "TaskSet_CopyMemory.h"
+#include "TaskSet_FrameCodec.h"
 
 #include "../MMDevice/DeviceUtils.h"
 
 #include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <memory>
 #include <string>
@@ -45,6 +48,9 @@ const long adjustThreshold = LONG_MAX / 2;
 // division by zero can be added.
 const unsigned long maxCBSize = 10000000;
 
+// Number of decompressed frames kept alive for the pointers handed out
+const size_t decompressedFramesKept = 8;
+
 CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    width_(0), 
    height_(0), 
@@ -54,8 +60,17 @@ CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    saveIndex_(0), 
    memorySizeMB_(memorySizeMB), 
    overflow_(false),
+   pinnedSlotPolicy_(PinnedSlotSkip),
+   pinState_(std::make_shared<PinState>()),
+   compressionRequested_(false),
+   compressed_(false),
+   rawBytesInserted_(0),
+   compressedBytesInserted_(0),
+   framesInserted_(0),
    threadPool_(std::make_shared<ThreadPool>()),
-   tasksMemCopy_(std::make_shared<TaskSet_CopyMemory>(threadPool_))
+   tasksMemCopy_(std::make_shared<TaskSet_CopyMemory>(threadPool_)),
+   tasksCompress_(std::make_shared<TaskSet_FrameCodec>(threadPool_)),
+   tasksDecompress_(std::make_shared<TaskSet_FrameCodec>(threadPool_))
 {
 }
 
@@ -64,6 +79,7 @@ CircularBuffer::~CircularBuffer() {}
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
 {
    MMThreadGuard guard(g_bufferLock);
+   WakeBlockedInsert(); // Its frame is about to be discarded
    imageNumbers_.clear();
    startTime_ = std::chrono::steady_clock::now();
 
@@ -73,8 +89,9 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (w == 0 || h==0 || pixDepth == 0 || channels == 0)
          return false; // does not make sense
 
-      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_)
-         if (frameArray_.size() > 0)
+      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_ &&
+            compressed_ == compressionRequested_)
+         if (compressed_ ? compressedFrames_.GetCapacityBytes() > 0 : frameArray_.size() > 0)
             return true; // nothing to change
 
       width_ = w;
@@ -86,6 +103,27 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       saveIndex_ = 0;
       overflow_ = false;
 
+      rawBytesInserted_ = 0;
+      compressedBytesInserted_ = 0;
+      framesInserted_ = 0;
+      decompressedFrames_.clear();
+      compressed_ = compressionRequested_;
+      if (compressed_)
+      {
+         frameArray_.clear();
+         compressedFrames_.Initialize(0);
+
+         // At least one incompressible frame must fit
+         const size_t maxFrameBytes = numChannels_ *
+            TaskSet_FrameCodec::MaxCompressedSize((size_t)w * h * pixDepth);
+         if (maxFrameBytes > memorySizeMB_ * bytesInMB)
+            return false; // memory footprint too small
+
+         compressedFrames_.Initialize(memorySizeMB_ * bytesInMB);
+         return true;
+      }
+      compressedFrames_.Initialize(0);
+
       // calculate the size of the entire buffer array once all images get allocated
       // the actual size at the time of the creation is going to be less, because
       // images are not allocated until pixels become available
@@ -104,21 +142,22 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
 
       // TODO: verify if we have enough RAM to satisfy this request
 
-      for (unsigned long i=0; i<frameArray_.size(); i++)
-         frameArray_[i].Clear();
+      // Release the old frames (those still pinned stay with their readers)
+      frameArray_.clear();
 
       // allocate buffers  - could conceivably throw an out-of-memory exception
       frameArray_.resize(cbSize);
       for (unsigned long i=0; i<frameArray_.size(); i++)
       {
-         frameArray_[i].Resize(w, h, pixDepth);
-         frameArray_[i].Preallocate(numChannels_);
+         frameArray_[i] = std::make_shared<mm::FrameBuffer>(w, h, pixDepth);
+         frameArray_[i]->Preallocate(numChannels_);
       }
    }
 
    catch( ... /* std::bad_alloc& ex */)
    {
       frameArray_.resize(0);
+      compressedFrames_.Initialize(0);
       ret = false;
    }
    return ret;
@@ -127,22 +166,31 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
 void CircularBuffer::Clear() 
 {
    MMThreadGuard guard(g_bufferLock); 
+   WakeBlockedInsert(); // It will fail, as its slot is no longer next
    insertIndex_=0; 
    saveIndex_=0; 
    overflow_ = false;
    startTime_ = std::chrono::steady_clock::now();
    imageNumbers_.clear();
+   compressedFrames_.Clear();
 }
 
 unsigned long CircularBuffer::GetSize() const
 {
    MMThreadGuard guard(g_bufferLock);
+   if (compressed_)
+   {
+      unsigned long size = (unsigned long)compressedFrames_.GetFrameCount() + EstimatedFreeFrames();
+      return size > maxCBSize ? maxCBSize : size;
+   }
    return (unsigned long)frameArray_.size();
 }
 
 unsigned long CircularBuffer::GetFreeSize() const
 {
    MMThreadGuard guard(g_bufferLock);
+   if (compressed_)
+      return EstimatedFreeFrames();
    long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
    if (freeSize < 0)
       return 0;
@@ -153,6 +201,8 @@ unsigned long CircularBuffer::GetFreeSize() const
 unsigned long CircularBuffer::GetRemainingImageCount() const
 {
    MMThreadGuard guard(g_bufferLock);
+   if (compressed_)
+      return (unsigned long)compressedFrames_.GetFrameCount();
    return (unsigned long)(insertIndex_ - saveIndex_);
 }
 
@@ -212,10 +262,18 @@ bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int wid
 */
 bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
 {
+    const mm::tracing::Span span(mm::tracing::CategoryBuffer, __func__);
     MMThreadGuard insertGuard(g_insertLock);
  
     mm::ImgBuffer* pImg;
     unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+    unsigned long slot;
+    long insertIndex;
+    std::size_t arraySize;
+    std::shared_ptr<mm::FrameBuffer> frame;
+    PinnedSlotPolicy pinnedSlotPolicy;
+    unsigned channelsToAllocate;
+    bool compressed;
  
     {
        MMThreadGuard guard(g_bufferLock);
@@ -224,11 +282,62 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
        if (width != width_ || height != height_ || byteDepth != pixDepth_)
           throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
  
+       compressed = compressed_;
+    }
+    if (compressed)
+    {
+       const bool inserted = InsertCompressed(pixArray, numChannels, width, height, byteDepth, nComponents, pMd);
+       if (inserted)
+          NotifyImageInserted();
+       return inserted;
+    }
+
+    {
+       MMThreadGuard guard(g_bufferLock);
+
        bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
        if (overflowed) {
           overflow_ = true;
           return false;
        }
+
+       insertIndex = insertIndex_;
+       arraySize = frameArray_.size();
+       slot = insertIndex % arraySize;
+       frame = frameArray_[slot];
+       pinnedSlotPolicy = pinnedSlotPolicy_;
+       channelsToAllocate = numChannels_;
+    }
+
+    // g_bufferLock is released while we wait or copy; if the buffer was
+    // cleared or reinitialized meanwhile, the slot is no longer ours and the
+    // insert fails. Caller must hold g_bufferLock.
+    auto slotIsOurs = [&]() {
+       return frameArray_.size() == arraySize && insertIndex_ == insertIndex &&
+          frameArray_[slot] == frame;
+    };
+
+    // The frame was already read; readers may still have it pinned (besides
+    // frameArray_ and ourselves). No new pins can be taken until we insert.
+    if (frame.use_count() > 2 && pinnedSlotPolicy == PinnedSlotBlock)
+       WaitForRelease(frame);
+    if (frame.use_count() > 2)
+    {
+       std::shared_ptr<mm::FrameBuffer> replacement;
+       try
+       {
+          replacement = std::make_shared<mm::FrameBuffer>(width, height, byteDepth);
+          replacement->Preallocate(channelsToAllocate);
+       }
+       catch (const std::bad_alloc&)
+       {
+          throw CMMError("Out of memory replacing a pinned frame in the circular buffer", MMERR_OutOfMemory);
+       }
+       MMThreadGuard guard(g_bufferLock);
+       if (!slotIsOurs())
+          return false;
+       frameArray_[slot] = replacement;
+       frame = replacement;
     }
  
     for (unsigned i=0; i<numChannels; i++)
@@ -236,8 +345,10 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
        Metadata md;
        {
           MMThreadGuard guard(g_bufferLock);
+          if (!slotIsOurs())
+             return false;
           // we assume that all buffers are pre-allocated
-          pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
+          pImg = frame->FindImage(i);
           if (!pImg)
              return false;
  
@@ -247,50 +358,9 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
              // Perhaps we need to add specific tags to each channel
              md = *pMd;
           }
-
-         std::string cameraName = md.GetSingleTag("Camera").GetValue();
-         if (imageNumbers_.end() == imageNumbers_.find(cameraName))
-         {
-            imageNumbers_[cameraName] = 0;
-         }
-
-         // insert image number. 
-         md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
-         ++imageNumbers_[cameraName];
-      }
-
-      if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
-      {
-         // if time tag was not supplied by the camera insert current timestamp
-         using namespace std::chrono;
-         auto elapsed = steady_clock::now() - startTime_;
-         md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms,
-            std::to_string(duration_cast<milliseconds>(elapsed).count()));
-      }
-
-      // Note: It is not ideal to use local time. I think this tag is rarely
-      // used. Consider replacing with UTC (micro)seconds-since-epoch (with
-      // different tag key) after addressing current usage.
-      auto now = std::chrono::system_clock::now();
-      md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, FormatLocalTime(now));
-
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
-      if (byteDepth == 1)
-         md.PutImageTag("PixelType","GRAY8");
-      else if (byteDepth == 2)
-         md.PutImageTag("PixelType","GRAY16");
-      else if (byteDepth == 4)
-      {
-         if (nComponents == 1)
-            md.PutImageTag("PixelType","GRAY32");
-         else
-            md.PutImageTag("PixelType","RGB32");
+          NumberImage(md);
       }
-      else if (byteDepth == 8)
-         md.PutImageTag("PixelType","RGB64");
-      else
-         md.PutImageTag("PixelType","Unknown"); 
+      TagImage(md, width, height, byteDepth, nComponents);
 
       pImg->SetMetadata(md);
       //pImg->SetPixels(pixArray + i * singleChannelSize);
@@ -304,6 +374,8 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
 
    {
       MMThreadGuard guard(g_bufferLock);
+      if (!slotIsOurs())
+         return false;
 
       imageCounter_++;
       insertIndex_++;
@@ -314,9 +386,116 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
          saveIndex_ -= adjustThreshold;
       }
    }
+   NotifyImageInserted();
 
    return true;
 }
+
+bool CircularBuffer::InsertCompressed(const unsigned char* pixArray, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd) throw (CMMError)
+{
+   const size_t singleChannelSize = (size_t)width * height * byteDepth;
+   std::vector<size_t> channelBytes(numChannels);
+   size_t totalBytes = 0;
+   try
+   {
+      compressScratch_.resize(numChannels * TaskSet_FrameCodec::MaxCompressedSize(singleChannelSize));
+   }
+   catch (const std::bad_alloc&)
+   {
+      throw CMMError("Out of memory compressing an image for the circular buffer", MMERR_OutOfMemory);
+   }
+
+   // Compress outside of the buffer lock, so that readers are not held up
+   for (unsigned i = 0; i < numChannels; i++)
+   {
+      channelBytes[i] = tasksCompress_->Compress(pixArray + i * singleChannelSize,
+            singleChannelSize, byteDepth, compressScratch_.data() + totalBytes);
+      totalBytes += channelBytes[i];
+   }
+
+   std::vector<Metadata> metadata(numChannels);
+   {
+      MMThreadGuard guard(g_bufferLock);
+      if (numChannels > numChannels_)
+         return false; // like the preallocated frames of the uncompressed buffer
+
+      if (!compressedFrames_.HasRoom(totalBytes))
+      {
+         overflow_ = true;
+         return false;
+      }
+      for (unsigned i = 0; i < numChannels; i++)
+      {
+         if (pMd)
+            metadata[i] = *pMd;
+         NumberImage(metadata[i]);
+      }
+   }
+   for (unsigned i = 0; i < numChannels; i++)
+      TagImage(metadata[i], width, height, byteDepth, nComponents);
+
+   MMThreadGuard guard(g_bufferLock);
+   if (!compressedFrames_.Push(compressScratch_.data(), channelBytes, metadata))
+   {
+      overflow_ = true; // Cannot happen unless cleared or reinitialized meanwhile
+      return false;
+   }
+   imageCounter_++;
+   rawBytesInserted_ += numChannels * singleChannelSize;
+   compressedBytesInserted_ += totalBytes;
+   framesInserted_++;
+   return true;
+}
+
+// Adds the image number, counting the images of each camera
+void CircularBuffer::NumberImage(Metadata& md)
+{
+   std::string cameraName = md.GetSingleTag("Camera").GetValue();
+   if (imageNumbers_.end() == imageNumbers_.find(cameraName))
+   {
+      imageNumbers_[cameraName] = 0;
+   }
+
+   // insert image number. 
+   md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
+   ++imageNumbers_[cameraName];
+}
+
+void CircularBuffer::TagImage(Metadata& md, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents) const
+{
+   if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+   {
+      // if time tag was not supplied by the camera insert current timestamp
+      using namespace std::chrono;
+      auto elapsed = steady_clock::now() - startTime_;
+      md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms,
+         std::to_string(duration_cast<milliseconds>(elapsed).count()));
+   }
+
+   // Note: It is not ideal to use local time. I think this tag is rarely
+   // used. Consider replacing with UTC (micro)seconds-since-epoch (with
+   // different tag key) after addressing current usage.
+   auto now = std::chrono::system_clock::now();
+   md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, FormatLocalTime(now));
+
+   md.PutImageTag("Width",width);
+   md.PutImageTag("Height",height);
+   if (byteDepth == 1)
+      md.PutImageTag("PixelType","GRAY8");
+   else if (byteDepth == 2)
+      md.PutImageTag("PixelType","GRAY16");
+   else if (byteDepth == 4)
+   {
+      if (nComponents == 1)
+         md.PutImageTag("PixelType","GRAY32");
+      else
+         md.PutImageTag("PixelType","RGB32");
+   }
+   else if (byteDepth == 8)
+      md.PutImageTag("PixelType","RGB64");
+   else
+      md.PutImageTag("PixelType","Unknown"); 
+}
  
 
 const unsigned char* CircularBuffer::GetTopImage() const
@@ -341,17 +520,33 @@ const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(long n,
       unsigned channel) const
 {
    MMThreadGuard guard(g_bufferLock);
+   const std::shared_ptr<mm::FrameBuffer> frame = NthFromTopFrame(n);
+   if (!frame)
+      return 0;
+   return frame->FindImage(channel);
+}
+
+std::shared_ptr<mm::FrameBuffer> CircularBuffer::NthFromTopFrame(long n) const
+{
+   if (compressed_)
+   {
+      const mm::CompressedFrameQueue::Entry* entry =
+         n < 0 ? 0 : compressedFrames_.NthFromBack((size_t)n);
+      if (!entry)
+         return std::shared_ptr<mm::FrameBuffer>();
+      return DecompressFrame(*entry);
+   }
 
    long availableImages = insertIndex_ - saveIndex_;
    if (n + 1 > availableImages)
-      return 0;
+      return std::shared_ptr<mm::FrameBuffer>();
 
    long targetIndex = insertIndex_ - n - 1L;
    while (targetIndex < 0)
       targetIndex += (long) frameArray_.size();
    targetIndex %= frameArray_.size();
 
-   return frameArray_[targetIndex].FindImage(channel);
+   return frameArray_[targetIndex];
 }
 
 const unsigned char* CircularBuffer::GetNextImage()
@@ -364,13 +559,291 @@ const unsigned char* CircularBuffer::GetNextImage()
 
 const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryBuffer, __func__);
    MMThreadGuard guard(g_bufferLock);
+   const std::shared_ptr<mm::FrameBuffer> frame = TakeNextFrame();
+   if (!frame)
+      return 0;
+   return frame->FindImage(channel);
+}
+
+std::shared_ptr<mm::FrameBuffer> CircularBuffer::TakeNextFrame()
+{
+   if (compressed_)
+   {
+      const mm::CompressedFrameQueue::Entry* entry = compressedFrames_.Front();
+      if (!entry)
+         return std::shared_ptr<mm::FrameBuffer>();
+      std::shared_ptr<mm::FrameBuffer> frame = DecompressFrame(*entry);
+      compressedFrames_.PopFront();
+      return frame;
+   }
 
    long availableImages = insertIndex_ - saveIndex_;
    if (availableImages < 1)
-      return 0;
+      return std::shared_ptr<mm::FrameBuffer>();
 
    long targetIndex = saveIndex_ % frameArray_.size();
    ++saveIndex_;
-   return frameArray_[targetIndex].FindImage(channel);
+   return frameArray_[targetIndex];
+}
+
+std::shared_ptr<const mm::ImgBuffer> CircularBuffer::PinNthFromTopImage(long n,
+      unsigned channel) const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return Pin(NthFromTopFrame(n), channel);
+}
+
+std::shared_ptr<const mm::ImgBuffer> CircularBuffer::PinNextImage(unsigned channel)
+{
+   const mm::tracing::Span span(mm::tracing::CategoryBuffer, __func__);
+   MMThreadGuard guard(g_bufferLock);
+   return Pin(TakeNextFrame(), channel);
+}
+
+unsigned CircularBuffer::PinNextImages(unsigned maxCount, unsigned channel,
+      std::vector<std::shared_ptr<const mm::ImgBuffer> >& images,
+      std::size_t imageBytes) throw (CMMError)
+{
+   const mm::tracing::Span span(mm::tracing::CategoryBuffer, __func__);
+   unsigned count = 0;
+   bool done = false;
+   while (count < maxCount && !done)
+   {
+      MMThreadGuard guard(g_bufferLock);
+      // All frames in the buffer have its current geometry
+      if (imageBytes != 0 && (std::size_t)width_ * height_ * pixDepth_ != imageBytes)
+      {
+         if (count == 0)
+            throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+         break;
+      }
+
+      // Let inserts in between decompressions
+      const unsigned batch = compressed_ ? 1 : maxCount - count;
+      for (unsigned taken = 0; taken < batch && !done; ++taken)
+      {
+         std::shared_ptr<mm::FrameBuffer> frame;
+         try
+         {
+            frame = TakeNextFrame(); // Leaves the frame if it throws
+         }
+         catch (const CMMError&)
+         {
+            if (count == 0)
+               throw;
+            done = true;
+            break;
+         }
+         if (!frame)
+         {
+            done = true;
+            break;
+         }
+         std::shared_ptr<const mm::ImgBuffer> image = Pin(frame, channel);
+         if (!image)
+            continue; // Consumed without a result, like PinNextImage()
+         images.push_back(std::move(image));
+         ++count;
+      }
+   }
+   return count;
+}
+
+unsigned CircularBuffer::CopyNextImages(unsigned maxCount, unsigned channel,
+      std::chrono::microseconds timeout, void* buffer,
+      std::size_t bufferBytes, std::vector<Metadata>& md) throw (CMMError)
+{
+   std::size_t imageBytes;
+   {
+      MMThreadGuard guard(g_bufferLock);
+      imageBytes = (std::size_t)width_ * height_ * pixDepth_;
+   }
+   if (imageBytes == 0)
+      throw CMMError("The circular buffer holds no images", MMERR_CircularBufferEmpty);
+   if (maxCount == 0)
+      return 0;
+   if (!buffer)
+      throw CMMError("Null image buffer", MMERR_NullPointerException);
+   const std::size_t fit = bufferBytes / imageBytes;
+   if (fit == 0)
+      throw CMMError("Buffer is too small for an image in the circular buffer");
+   if (fit < maxCount)
+      maxCount = static_cast<unsigned>(fit);
+
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images;
+   images.reserve(maxCount);
+   if (PinNextImages(maxCount, channel, images, imageBytes) == 0 &&
+         WaitForImage(timeout))
+      PinNextImages(maxCount, channel, images, imageBytes);
+
+   unsigned char* dest = static_cast<unsigned char*>(buffer);
+   for (const std::shared_ptr<const mm::ImgBuffer>& image : images)
+   {
+      memcpy(dest, image->GetPixels(), imageBytes);
+      dest += imageBytes;
+      md.push_back(image->GetMetadata());
+   }
+   return static_cast<unsigned>(images.size());
+}
+
+// Inserts notify under waitMutex_ after updating the indices, so an image
+// inserted after the predicate is checked always wakes the waiter.
+bool CircularBuffer::WaitForImage(std::chrono::microseconds timeout) const
+{
+   std::unique_lock<std::mutex> lock(waitMutex_);
+   return imageInserted_.wait_for(lock, timeout,
+         [this]() { return GetRemainingImageCount() > 0; });
+}
+
+void CircularBuffer::NotifyImageInserted()
+{
+   {
+      std::lock_guard<std::mutex> lock(waitMutex_);
+   }
+   imageInserted_.notify_all();
+}
+
+// The pin holds a reference to the frame, which keeps the frame's use count
+// above 1 (see InsertMultiChannel()). The reference is dropped under the pin
+// state mutex, so that a blocked insert can wait for it.
+std::shared_ptr<const mm::ImgBuffer> CircularBuffer::Pin(
+      const std::shared_ptr<mm::FrameBuffer>& frame, unsigned channel) const
+{
+   if (!frame)
+      return std::shared_ptr<const mm::ImgBuffer>();
+   const mm::ImgBuffer* image = frame->FindImage(channel);
+   if (!image)
+      return std::shared_ptr<const mm::ImgBuffer>();
+
+   std::shared_ptr<PinState> state = pinState_;
+   std::shared_ptr<mm::FrameBuffer> held = frame;
+   std::shared_ptr<const mm::FrameBuffer> pin(frame.get(),
+         [state, held](const mm::FrameBuffer*) mutable {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            held.reset();
+            state->released.notify_all();
+         });
+   return std::shared_ptr<const mm::ImgBuffer>(pin, image);
+}
+
+void CircularBuffer::SuspendPinnedSlotBlocking()
+{
+   std::lock_guard<std::mutex> lock(pinState_->mutex);
+   ++pinState_->blockingSuspended;
+   pinState_->released.notify_all();
+}
+
+void CircularBuffer::ResumePinnedSlotBlocking()
+{
+   std::lock_guard<std::mutex> lock(pinState_->mutex);
+   if (pinState_->blockingSuspended > 0)
+      --pinState_->blockingSuspended;
+}
+
+void CircularBuffer::WakeBlockedInsert()
+{
+   std::lock_guard<std::mutex> lock(pinState_->mutex);
+   ++pinState_->wakeups;
+   pinState_->released.notify_all();
+}
+
+bool CircularBuffer::WaitForRelease(const std::shared_ptr<mm::FrameBuffer>& frame)
+{
+   PinState& state = *pinState_;
+   std::unique_lock<std::mutex> lock(state.mutex);
+   const unsigned long long wakeups = state.wakeups;
+   state.released.wait(lock, [&]() {
+      return frame.use_count() <= 2 || state.blockingSuspended > 0 ||
+         state.wakeups != wakeups;
+   });
+   return frame.use_count() <= 2;
+}
+
+void CircularBuffer::SetPinnedSlotPolicy(PinnedSlotPolicy policy)
+{
+   MMThreadGuard guard(g_bufferLock);
+   pinnedSlotPolicy_ = policy;
+}
+
+CircularBuffer::PinnedSlotPolicy CircularBuffer::GetPinnedSlotPolicy() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return pinnedSlotPolicy_;
+}
+
+std::shared_ptr<mm::FrameBuffer> CircularBuffer::DecompressFrame(
+      const mm::CompressedFrameQueue::Entry& entry) const
+{
+   for (const auto& decompressed : decompressedFrames_)
+   {
+      if (decompressed.first == entry.id)
+         return decompressed.second;
+   }
+
+   const mm::tracing::Span span(mm::tracing::CategoryBuffer, __func__);
+   const size_t singleChannelSize = (size_t)width_ * height_ * pixDepth_;
+   std::shared_ptr<mm::FrameBuffer> frame;
+   try
+   {
+      frame = std::make_shared<mm::FrameBuffer>(width_, height_, pixDepth_);
+      frame->Preallocate((unsigned)entry.channelBytes.size());
+   }
+   catch (const std::bad_alloc&)
+   {
+      throw CMMError("Out of memory decompressing an image from the circular buffer", MMERR_OutOfMemory);
+   }
+
+   const unsigned char* data = compressedFrames_.GetData(entry);
+   for (unsigned i = 0; i < entry.channelBytes.size(); i++)
+   {
+      mm::ImgBuffer* img = frame->FindImage(i);
+      // See the note on ImgBuffer::GetPixels() in InsertMultiChannel()
+      if (!tasksDecompress_->Decompress(data, entry.channelBytes[i],
+               (unsigned char*)img->GetPixels(), singleChannelSize, pixDepth_))
+         throw CMMError("Corrupt compressed image in the circular buffer");
+      img->SetMetadata(entry.metadata[i]);
+      data += entry.channelBytes[i];
+   }
+
+   decompressedFrames_.emplace_back(entry.id, frame);
+   if (decompressedFrames_.size() > decompressedFramesKept)
+      decompressedFrames_.pop_front();
+   return frame;
+}
+
+// Caller must hold g_bufferLock
+unsigned long CircularBuffer::EstimatedFreeFrames() const
+{
+   const size_t freeBytes = compressedFrames_.GetCapacityBytes() - compressedFrames_.GetUsedBytes();
+   unsigned long long frameBytes;
+   if (framesInserted_ > 0)
+      frameBytes = (compressedBytesInserted_ + framesInserted_ - 1) / framesInserted_;
+   else // Assume the worst until there is data
+      frameBytes = numChannels_ * TaskSet_FrameCodec::MaxCompressedSize((size_t)width_ * height_ * pixDepth_);
+   if (frameBytes == 0)
+      return 0;
+   unsigned long long frames = freeBytes / frameBytes;
+   return frames > maxCBSize ? maxCBSize : (unsigned long)frames;
+}
+
+void CircularBuffer::SetCompression(bool compress)
+{
+   MMThreadGuard guard(g_bufferLock);
+   compressionRequested_ = compress;
+}
+
+bool CircularBuffer::GetCompression() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return compressionRequested_;
+}
+
+double CircularBuffer::GetCompressionRatio() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   if (!compressed_ || compressedBytesInserted_ == 0)
+      return 1.0;
+   return (double)rawBytesInserted_ / (double)compressedBytesInserted_;
 }
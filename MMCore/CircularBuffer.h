@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include "CompressedFrameQueue.h"
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "FrameBuffer.h"
@@ -32,7 +33,11 @@
 #include "../MMDevice/MMDevice.h"
 
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -42,6 +47,7 @@
 
 class ThreadPool;
 class TaskSet_CopyMemory;
+class TaskSet_FrameCodec;
 
 class CircularBuffer
 {
@@ -51,6 +57,20 @@ public:
 
    unsigned GetMemorySizeMB() const { return memorySizeMB_; }
 
+   // In compressed mode, frames are compressed losslessly on insert and
+   // decompressed when read, so that more of them fit in the memory. The
+   // capacity (GetSize(), GetFreeSize()) is then an estimate based on the
+   // compression ratio so far. Takes effect at the next Initialize().
+   //
+   // Pixel pointers returned in compressed mode point to decompressed copies,
+   // which stay valid until several more images have been read. Pins hold
+   // their own copy and are never waited for.
+   void SetCompression(bool compress);
+   bool GetCompression() const;
+   // Raw over compressed size of the images inserted since Initialize(); 1.0
+   // if uncompressed or none were inserted
+   double GetCompressionRatio() const;
+
    bool Initialize(unsigned channels, unsigned int xSize, unsigned int ySize, unsigned int pixDepth);
    unsigned long GetSize() const;
    unsigned long GetFreeSize() const;
@@ -72,12 +92,104 @@ public:
    const mm::ImgBuffer* GetNextImageBuffer(unsigned channel);
    void Clear(); 
 
+   // Like GetNthFromTopImageBuffer() and GetNextImageBuffer(), but the image
+   // is pinned: its frame is not overwritten for as long as any copy of the
+   // returned pointer exists, even if the buffer is cleared, reinitialized or
+   // destroyed. Return null if there is no such image.
+   std::shared_ptr<const mm::ImgBuffer> PinNthFromTopImage(long n,
+         unsigned channel) const;
+   std::shared_ptr<const mm::ImgBuffer> PinNextImage(unsigned channel);
+   // Removes up to maxCount images and appends them, pinned, to images.
+   // Returns the number appended. Uncompressed images are taken under a
+   // single lock; compressed ones are taken one per lock, because each is
+   // decompressed while the lock is held. If imageBytes is nonzero, stops
+   // before images of any other size. Throws only if no image was taken, so
+   // that images already taken are never lost.
+   unsigned PinNextImages(unsigned maxCount, unsigned channel,
+         std::vector<std::shared_ptr<const mm::ImgBuffer> >& images,
+         std::size_t imageBytes = 0) throw (CMMError);
+
+   // Removes up to maxCount images, at most as many as fit in bufferBytes,
+   // and copies them contiguously into buffer, oldest first, appending their
+   // metadata to md. Waits up to timeout if the buffer is empty. The pixels
+   // are copied without holding the buffer lock. Returns the number copied;
+   // throws only if none was taken.
+   unsigned CopyNextImages(unsigned maxCount, unsigned channel,
+         std::chrono::microseconds timeout, void* buffer,
+         std::size_t bufferBytes, std::vector<Metadata>& md) throw (CMMError);
+
+   // Blocks until an image is available or the timeout expires. Returns
+   // whether an image is available.
+   bool WaitForImage(std::chrono::microseconds timeout) const;
+
+   // What an insert does when the frame it would overwrite is pinned
+   enum PinnedSlotPolicy
+   {
+      // Leave the frame to its readers and allocate a new one for the slot
+      PinnedSlotSkip,
+      // Wait until the readers release the frame
+      PinnedSlotBlock,
+   };
+   void SetPinnedSlotPolicy(PinnedSlotPolicy policy);
+   PinnedSlotPolicy GetPinnedSlotPolicy() const;
+
+   // While suspended (calls nest), inserts do not wait for pinned frames but
+   // replace them as with PinnedSlotSkip, and inserts already waiting stop
+   // waiting. Used while stopping a sequence, which may have to wait for the
+   // camera's insert to return.
+   void SuspendPinnedSlotBlocking();
+   void ResumePinnedSlotBlocking();
+
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
 
    mutable MMThreadLock g_bufferLock;
    mutable MMThreadLock g_insertLock;
 
 private:
+   // Shared with the pins, which may outlive the buffer
+   struct PinState
+   {
+      PinState() : wakeups(0), blockingSuspended(0) {}
+
+      std::mutex mutex;
+      std::condition_variable released;
+      // Bumped to make waiting inserts give up (see WakeBlockedInsert())
+      unsigned long long wakeups;
+      unsigned blockingSuspended;
+   };
+
+   // Caller must hold g_bufferLock; return null if there is no such frame
+   std::shared_ptr<mm::FrameBuffer> NthFromTopFrame(long n) const;
+   std::shared_ptr<mm::FrameBuffer> TakeNextFrame();
+
+   // Caller must hold g_insertLock
+   bool InsertCompressed(const unsigned char* pixArray, unsigned numChannels,
+         unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, const Metadata* pMd) throw (CMMError);
+   // Caller must hold g_bufferLock
+   std::shared_ptr<mm::FrameBuffer> DecompressFrame(
+         const mm::CompressedFrameQueue::Entry& entry) const;
+   unsigned long EstimatedFreeFrames() const;
+
+   // Caller must hold g_bufferLock
+   void NumberImage(Metadata& md);
+
+   void TagImage(Metadata& md, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents) const;
+
+   std::shared_ptr<const mm::ImgBuffer> Pin(
+         const std::shared_ptr<mm::FrameBuffer>& frame,
+         unsigned channel) const;
+
+   // Caller must not hold g_bufferLock
+   void NotifyImageInserted();
+
+   // Makes an insert waiting for a pinned frame give up waiting
+   void WakeBlockedInsert();
+   // Waits until frame is released, unless woken or suspended; returns
+   // whether it was released
+   bool WaitForRelease(const std::shared_ptr<mm::FrameBuffer>& frame);
+
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
@@ -94,8 +206,28 @@ private:
    unsigned long memorySizeMB_;
    unsigned int numChannels_;
    bool overflow_;
-   std::vector<mm::FrameBuffer> frameArray_;
+   PinnedSlotPolicy pinnedSlotPolicy_;
+   // A frame is pinned while its use count exceeds 1 (outside of inserts)
+   std::vector<std::shared_ptr<mm::FrameBuffer> > frameArray_;
+   std::shared_ptr<PinState> pinState_;
+
+   // Wakes WaitForImage(); taken before g_bufferLock, never after
+   mutable std::mutex waitMutex_;
+   mutable std::condition_variable imageInserted_;
+
+   bool compressionRequested_;
+   bool compressed_;
+   mm::CompressedFrameQueue compressedFrames_;
+   unsigned long long rawBytesInserted_;
+   unsigned long long compressedBytesInserted_;
+   unsigned long long framesInserted_;
+   std::vector<unsigned char> compressScratch_; // Guarded by g_insertLock
+   // Keeps the most recently decompressed frames alive, by frame id
+   mutable std::deque<std::pair<unsigned long long,
+      std::shared_ptr<mm::FrameBuffer> > > decompressedFrames_;
 
    std::shared_ptr<ThreadPool> threadPool_;
    std::shared_ptr<TaskSet_CopyMemory> tasksMemCopy_;
+   std::shared_ptr<TaskSet_FrameCodec> tasksCompress_;
+   std::shared_ptr<TaskSet_FrameCodec> tasksDecompress_;
 };
@@ -0,0 +1,132 @@
+#include "CompressedFrameQueue.h"
+
+#include <cstring>
+
+namespace mm
+{
+
+size_t
+CompressedFrameQueue::Entry::TotalBytes() const
+{
+   size_t total = 0;
+   for (size_t bytes : channelBytes)
+      total += bytes;
+   return total;
+}
+
+void
+CompressedFrameQueue::Initialize(size_t capacityBytes)
+{
+   entries_.clear();
+   ring_.reset();
+   capacity_ = 0;
+   if (capacityBytes > 0)
+      ring_.reset(new unsigned char[capacityBytes]);
+   capacity_ = capacityBytes;
+}
+
+void
+CompressedFrameQueue::Clear()
+{
+   entries_.clear();
+}
+
+size_t
+CompressedFrameQueue::GetUsedBytes() const
+{
+   if (entries_.empty())
+      return 0;
+   const size_t begin = entries_.front().offset;
+   const size_t end = entries_.back().offset + entries_.back().TotalBytes();
+   if (end > begin)
+      return end - begin;
+   // Wrapped; count the unusable space left at the end of the ring as used
+   return capacity_ - begin + end;
+}
+
+bool
+CompressedFrameQueue::HasRoom(size_t bytes) const
+{
+   size_t offset;
+   return Allocate(bytes, offset);
+}
+
+bool
+CompressedFrameQueue::Allocate(size_t bytes, size_t& offset) const
+{
+   if (bytes == 0 || bytes > capacity_)
+      return false;
+   if (entries_.empty())
+   {
+      offset = 0;
+      return true;
+   }
+
+   // Frames have nonzero size, so the end of the newest frame equals the start
+   // of the oldest only when the ring is full
+   const size_t begin = entries_.front().offset;
+   const size_t end = entries_.back().offset + entries_.back().TotalBytes();
+   if (end > begin)
+   {
+      if (capacity_ - end >= bytes)
+      {
+         offset = end;
+         return true;
+      }
+      if (begin >= bytes)
+      {
+         offset = 0;
+         return true;
+      }
+      return false;
+   }
+   if (begin - end >= bytes)
+   {
+      offset = end;
+      return true;
+   }
+   return false;
+}
+
+bool
+CompressedFrameQueue::Push(const unsigned char* data,
+      const std::vector<size_t>& channelBytes,
+      const std::vector<Metadata>& metadata)
+{
+   Entry entry;
+   entry.id = nextId_;
+   entry.channelBytes = channelBytes;
+   if (!Allocate(entry.TotalBytes(), entry.offset))
+      return false;
+   entry.metadata = metadata;
+
+   std::memcpy(ring_.get() + entry.offset, data, entry.TotalBytes());
+   entries_.push_back(std::move(entry));
+   ++nextId_;
+   return true;
+}
+
+void
+CompressedFrameQueue::PopFront()
+{
+   if (!entries_.empty())
+      entries_.pop_front();
+}
+
+const CompressedFrameQueue::Entry*
+CompressedFrameQueue::Front() const
+{
+   if (entries_.empty())
+      return nullptr;
+   return &entries_.front();
+}
+
+const CompressedFrameQueue::Entry*
+CompressedFrameQueue::NthFromBack(size_t n) const
+{
+   if (n >= entries_.size())
+      return nullptr;
+   return &entries_[entries_.size() - 1 - n];
+}
+
+} // namespace mm
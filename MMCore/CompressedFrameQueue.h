@@ -0,0 +1,68 @@
+// Storage of compressed frames for the compressed mode of CircularBuffer.
+//
+// Frames are variable in size and are always removed oldest first, so they are
+// stored back to back in a preallocated ring of bytes: a frame that does not
+// fit before the end of the ring starts over at the beginning.
+//
+// Not thread-safe; CircularBuffer serializes access.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace mm
+{
+
+class CompressedFrameQueue
+{
+public:
+   struct Entry
+   {
+      unsigned long long id; // Increases with every push
+      size_t offset;
+      std::vector<size_t> channelBytes; // Compressed size of each channel
+      std::vector<Metadata> metadata; // Per channel
+      size_t TotalBytes() const;
+   };
+
+   // Throws std::bad_alloc
+   void Initialize(size_t capacityBytes);
+   void Clear();
+
+   size_t GetCapacityBytes() const { return capacity_; }
+   size_t GetUsedBytes() const;
+   size_t GetFrameCount() const { return entries_.size(); }
+
+   // Whether a frame of this many compressed bytes would fit
+   bool HasRoom(size_t bytes) const;
+
+   // Copies the concatenated compressed channels. Returns false, leaving the
+   // queue unchanged, if there is no room.
+   bool Push(const unsigned char* data, const std::vector<size_t>& channelBytes,
+         const std::vector<Metadata>& metadata);
+   void PopFront();
+
+   // Return null if there is no such frame
+   const Entry* Front() const;
+   const Entry* NthFromBack(size_t n) const;
+
+   // Start of the frame's compressed data (channels back to back)
+   const unsigned char* GetData(const Entry& entry) const
+   { return ring_.get() + entry.offset; }
+
+private:
+   bool Allocate(size_t bytes, size_t& offset) const;
+
+   // Left uninitialized, like the frames of the uncompressed buffer
+   std::unique_ptr<unsigned char[]> ring_;
+   size_t capacity_ = 0;
+   std::deque<Entry> entries_;
+   unsigned long long nextId_ = 0;
+};
+
+} // namespace mm
@@ -28,9 +28,17 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImgBuffer.h"
+#include "CameraBufferLanes.h"
 #include "CircularBuffer.h"
 #include "CoreCallback.h"
 #include "DeviceManager.h"
+#include "EventDispatcher.h"
+#include "ImageProcessingPipeline.h"
+#include "PerformanceMetrics.h"
+#include "PreviewTap.h"
+#include "PropertyConfigIndex.h"
+#include "StateCache.h"
+#include "Tracing.h"
 
 #include <cassert>
 #include <chrono>
@@ -250,25 +258,17 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd, bool doProcess)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    try 
    {
+      mm::metrics::ScopedTimer timer(core_->metrics_->imageInsertSeconds.get());
       Metadata md = AddCameraMetadata(caller, pMd);
-
-      if(doProcess)
-      {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
-      }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
-         return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
+      return ProcessAndInsert(caller, buf, 1, width, height, byteDepth, 1,
+            md, doProcess);
    }
    catch (CMMError& /*e*/)
    {
+      core_->metrics_->imageInsertFailures->Increment();
       return DEVICE_INCOMPATIBLE_IMAGE;
    }
 }
@@ -282,25 +282,17 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd, bool doProcess)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    try 
    {
+      mm::metrics::ScopedTimer timer(core_->metrics_->imageInsertSeconds.get());
       Metadata md = AddCameraMetadata(caller, pMd);
-
-      if(doProcess)
-      {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
-      }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md))
-         return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
+      return ProcessAndInsert(caller, buf, 1, width, height, byteDepth,
+            nComponents, md, doProcess);
    }
    catch (CMMError& /*e*/)
    {
+      core_->metrics_->imageInsertFailures->Increment();
       return DEVICE_INCOMPATIBLE_IMAGE;
    }
 }
@@ -312,16 +304,19 @@ int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf
    MM::ImageProcessor* ip = GetImageProcessor(caller);
    if( NULL != ip)
    {
-      ip->Process(p, imgBuf.Width(), imgBuf.Height(), imgBuf.Depth());
+      if (ip->Process(p, imgBuf.Width(), imgBuf.Height(), imgBuf.Depth()) ==
+            DEVICE_IMAGE_CONSUMED)
+         return DEVICE_OK;
    }
 
    return InsertImage(caller, imgBuf.GetPixels(), imgBuf.Width(), 
       imgBuf.Height(), imgBuf.Depth(), &md);
 }
 
-void CoreCallback::ClearImageBuffer(const MM::Device* /*caller*/)
+void CoreCallback::ClearImageBuffer(const MM::Device* caller)
 {
-   core_->cbuf_->Clear();
+   std::shared_ptr<CircularBuffer> lane;
+   GetImageBuffer(caller, lane)->Clear();
 }
 
 bool CoreCallback::InitializeImageBuffer(unsigned channels, unsigned slices,
@@ -342,29 +337,151 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
                               unsigned byteDepth,
                               Metadata* pMd)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    try
    {
+      mm::metrics::ScopedTimer timer(core_->metrics_->imageInsertSeconds.get());
       Metadata md = AddCameraMetadata(caller, pMd);
+      return ProcessAndInsert(caller, buf, numChannels, width, height,
+            byteDepth, 1, md, true);
+   }
+   catch (CMMError& /*e*/)
+   {
+      core_->metrics_->imageInsertFailures->Increment();
+      return DEVICE_INCOMPATIBLE_IMAGE;
+   }
+
+}
 
-      MM::ImageProcessor* ip = GetImageProcessor(caller);
-      if( NULL != ip)
+// Runs the image processor, if any, on the image and inserts it. If the
+// processing pipeline is running, both happen later on its worker threads.
+int CoreCallback::ProcessAndInsert(const MM::Device* caller,
+      const unsigned char* buf, unsigned numChannels, unsigned width,
+      unsigned height, unsigned byteDepth, unsigned nComponents,
+      const Metadata& md, bool doProcess)
+{
+   MM::ImageProcessor* ip = doProcess ? GetImageProcessor(caller) : 0;
+   if (ip)
+   {
+      // Report an overflow right away, as the camera would otherwise keep
+      // acquiring into a buffer that rejects every image
+      std::shared_ptr<CircularBuffer> lane;
+      if (GetImageBuffer(caller, lane)->Overflow())
       {
-         ip->Process( const_cast<unsigned char*>(buf), width, height, byteDepth);
+         core_->metrics_->imageInsertFailures->Increment();
+         return DEVICE_BUFFER_OVERFLOW;
       }
-      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
+      if (core_->processingPipeline_->Submit(caller, ip, buf, numChannels,
+               width, height, byteDepth, nComponents, md))
+         return DEVICE_OK;
+
+      if (ip->Process(const_cast<unsigned char*>(buf), width, height,
+               byteDepth) == DEVICE_IMAGE_CONSUMED)
          return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
    }
-   catch (CMMError& /*e*/)
+   return InsertIntoBuffer(caller, buf, numChannels, width, height, byteDepth,
+         nComponents, md);
+}
+
+int CoreCallback::InsertIntoBuffer(const MM::Device* caller,
+      const unsigned char* buf, unsigned numChannels, unsigned width,
+      unsigned height, unsigned byteDepth, unsigned nComponents,
+      const Metadata& md)
+{
+   std::shared_ptr<CircularBuffer> lane;
+   CircularBuffer* buffer = GetImageBuffer(caller, lane);
+   const bool inserted = buffer->InsertMultiChannel(buf, numChannels, width,
+         height, byteDepth, nComponents, &md);
+   if (inserted)
+      FeedPreviewTap(caller, md, buf, width, height, byteDepth, nComponents);
+   return RecordImageInsert(inserted, *buffer);
+}
+
+void CoreCallback::InsertProcessedImage(
+      const mm::ImageProcessingPipeline::Frame& frame)
+{
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
+   try
    {
-      return DEVICE_INCOMPATIBLE_IMAGE;
+      InsertIntoBuffer(frame.camera, frame.pixels.data(), frame.numChannels,
+            frame.width, frame.height, frame.byteDepth, frame.nComponents,
+            frame.metadata);
+   }
+   catch (const CMMError&)
+   {
+      core_->metrics_->imageInsertFailures->Increment();
+   }
+}
+
+// Returns the buffer that receives images from the camera: its own lane if it
+// has one (which is returned in lane, keeping it alive while in use),
+// otherwise the shared circular buffer
+CircularBuffer* CoreCallback::GetImageBuffer(const MM::Device* caller,
+      std::shared_ptr<CircularBuffer>& lane)
+{
+   if (caller && !core_->cameraBufferLanes_->IsEmpty())
+   {
+      char label[MM::MaxStrLength];
+      caller->GetLabel(label);
+      lane = core_->cameraBufferLanes_->Find(label);
+      if (lane)
+         return lane.get();
    }
+   return core_->cbuf_;
+}
+
+// Updates the image insertion metrics and returns the result code for
+// InsertImage()
+int CoreCallback::RecordImageInsert(bool inserted, const CircularBuffer& buffer)
+{
+   mm::metrics::CoreMetrics& metrics = *core_->metrics_;
+   if (!inserted)
+   {
+      metrics.imageInsertFailures->Increment();
+      return DEVICE_BUFFER_OVERFLOW;
+   }
+   metrics.imagesInserted->Increment();
+
+   const unsigned long capacity = buffer.GetSize();
+   const unsigned long held = buffer.GetRemainingImageCount();
+   metrics.bufferImages->Set(static_cast<double>(held));
+   metrics.bufferCapacityImages->Set(static_cast<double>(capacity));
+   metrics.bufferCompressionRatio->Set(buffer.GetCompressionRatio());
+   if (capacity > 0)
+      metrics.bufferFillFractionOnInsert->Observe(
+            static_cast<double>(held) / capacity);
+   return DEVICE_OK;
+}
+
+// Passes an inserted image to the preview tap, if a preview is due
+void CoreCallback::FeedPreviewTap(const MM::Device* caller, const Metadata& md,
+      const unsigned char* buf, unsigned width, unsigned height,
+      unsigned byteDepth, unsigned nComponents)
+{
+   mm::PreviewTap& tap = *core_->previewTap_;
+   if (!tap.IsDue())
+      return;
 
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
+   unsigned bitDepth;
+   try
+   {
+      std::shared_ptr<CameraInstance> camera =
+         std::static_pointer_cast<CameraInstance>(
+               core_->deviceManager_->GetDevice(caller));
+      bitDepth = camera->GetBitDepth();
+   }
+   catch (const CMMError&)
+   {
+      bitDepth = 8 * byteDepth; // The image was inserted regardless
+   }
+   tap.Feed(md.GetSingleTag("Camera").GetValue(), buf, width, height,
+         byteDepth, nComponents, bitDepth);
 }
 
 int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    std::shared_ptr<DeviceInstance> camera;
    try
    {
@@ -377,6 +494,9 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
       return DEVICE_ERR;
    }
 
+   // The sequence is not finished until its last image is in the buffer
+   core_->processingPipeline_->Flush();
+
    std::shared_ptr<DeviceInstance> currentCamera =
       core_->currentCameraDevice_.lock();
 
@@ -428,6 +548,7 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
 
 int CoreCallback::PrepareForAcq(const MM::Device* /*caller*/)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->autoShutter_)
    {
       std::shared_ptr<ShutterInstance> shutter =
@@ -449,8 +570,10 @@ int CoreCallback::PrepareForAcq(const MM::Device* /*caller*/)
  */
 int CoreCallback::OnPropertiesChanged(const MM::Device* /* caller */)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_)
-      core_->externalCallback_->onPropertiesChanged();
+      core_->eventDispatcher_->Post("",
+            [](MMEventCallback& cb) { cb.onPropertiesChanged(); });
 
    // TODO It is inconsistent that we do not update the system state cache in
    // this case. However, doing so would be time-consuming (if not unsafe).
@@ -463,6 +586,7 @@ int CoreCallback::OnPropertiesChanged(const MM::Device* /* caller */)
  */
 int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propName, const char* value)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) 
    {
       MMThreadGuard g(*pValueChangeLock_);
@@ -470,66 +594,44 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
       device->GetLabel(label);
       bool readOnly;
       device->GetPropertyReadOnly(propName, readOnly);
-      const PropertySetting* ps = new PropertySetting(label, propName, value, readOnly);
-      {
-         MMThreadGuard scg(core_->stateCacheLock_);
-         core_->stateCache_.addSetting(*ps);
-      }
-      core_->externalCallback_->onPropertyChanged(label, propName, value);
-
-      // Find all configs that contain this property and callback to indicate 
-      // that the config group changed
-      // TODO: Assess whether performance is better by maintaining a map tying
-      // property to configurations
-      std::vector<std::string> configGroups = 
-         core_->getAvailableConfigGroups ();
+      core_->stateCache_->Set(PropertySetting(label, propName, value, readOnly));
+      const std::string labelStr(label), propNameStr(propName), valueStr(value);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("PropertyChanged", labelStr, propNameStr),
+            [labelStr, propNameStr, valueStr](MMEventCallback& cb) {
+               cb.onPropertyChanged(labelStr.c_str(), propNameStr.c_str(),
+                     valueStr.c_str());
+            });
+
+      // Find all config groups that contain this property and callback to
+      // indicate that the config group changed. Only groups with a preset of
+      // more than 1 property are included, since the UI treats groups with
+      // one property differently, whereas the core does not....
+      std::vector<std::string> configGroups;
+      const bool inPixelSizeConfig = core_->propertyConfigIndex_->Lookup(
+            label, propName, configGroups);
       for (std::vector<std::string>::iterator it = configGroups.begin(); 
             it != configGroups.end(); ++it) 
       {
-         std::vector<std::string> configs = 
-            core_->getAvailableConfigs((*it).c_str());
-         bool found = false;
-         for (std::vector<std::string>::iterator itc = configs.begin();
-               itc != configs.end() && !found; itc++) 
-         {
-            Configuration config = 
-               core_->getConfigData((*it).c_str(), (*itc).c_str());
-            // only callback when there is more than 1 property in a group
-            // This is needed, since the UI treats groups with one 
-            // property differently, whereas the core does not....
-            if (config.size() > 1 && config.isPropertyIncluded(label, propName)) {
-               found = true;
-               // If we are part of this configuration, notify that it 
-               // was changed. Get the new config from cache rather 
-               // than by querying the hardware
-               std::string currentConfig = 
-                  core_->getCurrentConfigFromCache( (*it).c_str() );
-               OnConfigGroupChanged((*it).c_str(), currentConfig.c_str());
-            }
-         }
+         // Get the new config from cache rather than by querying the hardware
+         std::string currentConfig = 
+            core_->getCurrentConfigFromCache( (*it).c_str() );
+         OnConfigGroupChanged((*it).c_str(), currentConfig.c_str());
       }
-          
 
       // Check if pixel size was potentially affected.  If so, update from cache
-      std::vector<std::string> pixelSizeConfigs = core_->getAvailablePixelSizeConfigs();
-      bool found = false;
-      for (std::vector<std::string>::iterator itpsc = pixelSizeConfigs.begin();
-            itpsc != pixelSizeConfigs.end() && !found; itpsc++) 
+      if (inPixelSizeConfig)
       {
-         Configuration pixelSizeConfig = core_->getPixelSizeConfigData( (*itpsc).c_str());
-         if (pixelSizeConfig.isPropertyIncluded(label, propName)) {
-            found = true;
-            double pixSizeUm;
-            try {
-               // update pixel size from cache
-               pixSizeUm = core_->getPixelSizeUm(true);
-               OnPixelSizeAffineChanged(core_->getPixelSizeAffine(true));
-            }
-            catch (const CMMError&) {
-               pixSizeUm = 0.0;
-            }
-            OnPixelSizeChanged(pixSizeUm);
+         double pixSizeUm;
+         try {
+            // update pixel size from cache
+            pixSizeUm = core_->getPixelSizeUm(true);
+            OnPixelSizeAffineChanged(core_->getPixelSizeAffine(true));
+         }
+         catch (const CMMError&) {
+            pixSizeUm = 0.0;
          }
+         OnPixelSizeChanged(pixSizeUm);
       }
    }
 
@@ -541,8 +643,14 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
  */
 int CoreCallback::OnConfigGroupChanged(const char* groupName, const char* newConfigName)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) {
-      core_->externalCallback_->onConfigGroupChanged(groupName, newConfigName);
+      const std::string group(groupName), config(newConfigName);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("ConfigGroupChanged", group),
+            [group, config](MMEventCallback& cb) {
+               cb.onConfigGroupChanged(group.c_str(), config.c_str());
+            });
    }
 
    return DEVICE_OK;
@@ -553,8 +661,13 @@ int CoreCallback::OnConfigGroupChanged(const char* groupName, const char* newCon
  */
 int CoreCallback::OnPixelSizeChanged(double newPixelSizeUm)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) {
-      core_->externalCallback_->onPixelSizeChanged(newPixelSizeUm);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("PixelSizeChanged"),
+            [newPixelSizeUm](MMEventCallback& cb) {
+               cb.onPixelSizeChanged(newPixelSizeUm);
+            });
    }
 
    return DEVICE_OK;
@@ -566,13 +679,18 @@ int CoreCallback::OnPixelSizeChanged(double newPixelSizeUm)
  */
 int CoreCallback::OnPixelSizeAffineChanged(std::vector<double> newPixelSizeAffine)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_ && newPixelSizeAffine.size() == 6) {
-      core_->externalCallback_->onPixelSizeAffineChanged(newPixelSizeAffine[0],
-            newPixelSizeAffine[1],
-            newPixelSizeAffine[2],
-            newPixelSizeAffine[3],
-            newPixelSizeAffine[4],
-            newPixelSizeAffine[5]);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("PixelSizeAffineChanged"),
+            [newPixelSizeAffine](MMEventCallback& cb) {
+               cb.onPixelSizeAffineChanged(newPixelSizeAffine[0],
+                     newPixelSizeAffine[1],
+                     newPixelSizeAffine[2],
+                     newPixelSizeAffine[3],
+                     newPixelSizeAffine[4],
+                     newPixelSizeAffine[5]);
+            });
    }
 
    return DEVICE_OK;
@@ -583,10 +701,17 @@ int CoreCallback::OnPixelSizeAffineChanged(std::vector<double> newPixelSizeAffin
  */
 int CoreCallback::OnStagePositionChanged(const MM::Device* device, double pos)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onStagePositionChanged(label, pos);
+      const std::string labelStr(label);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("StagePositionChanged", labelStr),
+            [labelStr, pos](MMEventCallback& cb) {
+               std::string name(labelStr);
+               cb.onStagePositionChanged(&name[0], pos);
+            });
    }
 
    return DEVICE_OK;
@@ -597,10 +722,17 @@ int CoreCallback::OnStagePositionChanged(const MM::Device* device, double pos)
  */
 int CoreCallback::OnXYStagePositionChanged(const MM::Device* device, double xPos, double yPos)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onXYStagePositionChanged(label, xPos, yPos);
+      const std::string labelStr(label);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("XYStagePositionChanged", labelStr),
+            [labelStr, xPos, yPos](MMEventCallback& cb) {
+               std::string name(labelStr);
+               cb.onXYStagePositionChanged(&name[0], xPos, yPos);
+            });
    }
 
    return DEVICE_OK;
@@ -612,10 +744,17 @@ int CoreCallback::OnXYStagePositionChanged(const MM::Device* device, double xPos
  */
 int CoreCallback::OnExposureChanged(const MM::Device* device, double newExposure)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onExposureChanged(label, newExposure);
+      const std::string labelStr(label);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("ExposureChanged", labelStr),
+            [labelStr, newExposure](MMEventCallback& cb) {
+               std::string name(labelStr);
+               cb.onExposureChanged(&name[0], newExposure);
+            });
    }
    return DEVICE_OK;
 }
@@ -626,11 +765,18 @@ int CoreCallback::OnExposureChanged(const MM::Device* device, double newExposure
  */
 int CoreCallback::OnSLMExposureChanged(const MM::Device* device, double newExposure)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) {
       MMThreadGuard g(*pValueChangeLock_);
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onSLMExposureChanged(label, newExposure);
+      const std::string labelStr(label);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("SLMExposureChanged", labelStr),
+            [labelStr, newExposure](MMEventCallback& cb) {
+               std::string name(labelStr);
+               cb.onSLMExposureChanged(&name[0], newExposure);
+            });
    }
    return DEVICE_OK;
 }
@@ -641,6 +787,7 @@ int CoreCallback::OnSLMExposureChanged(const MM::Device* device, double newExpos
  */
 int CoreCallback::OnMagnifierChanged(const MM::Device* /* device */)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    if (core_->externalCallback_) 
    {
       double pixSizeUm;
@@ -686,6 +833,7 @@ int CoreCallback::SetSerialProperties(const char* portName,
  */
 int CoreCallback::WriteToSerial(const MM::Device* caller, const char* portName, const unsigned char* buf, unsigned long length)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__, portName);
    std::shared_ptr<SerialInstance> pSerial;
    try
    {
@@ -712,6 +860,7 @@ int CoreCallback::WriteToSerial(const MM::Device* caller, const char* portName,
   */
 int CoreCallback::ReadFromSerial(const MM::Device* caller, const char* portName, unsigned char* buf, unsigned long bufLength, unsigned long &bytesRead)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__, portName);
    std::shared_ptr<SerialInstance> pSerial;
    try
    {
@@ -738,6 +887,7 @@ int CoreCallback::ReadFromSerial(const MM::Device* caller, const char* portName,
  */
 int CoreCallback::PurgeSerial(const MM::Device* caller, const char* portName)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__, portName);
    std::shared_ptr<SerialInstance> pSerial;
    try
    {
@@ -764,6 +914,7 @@ int CoreCallback::PurgeSerial(const MM::Device* caller, const char* portName)
  */
 int CoreCallback::SetSerialCommand(const MM::Device*, const char* portName, const char* command, const char* term)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__, portName);
    try {
       core_->setSerialPortCommand(portName, command, term);
    }
@@ -782,6 +933,7 @@ int CoreCallback::SetSerialCommand(const MM::Device*, const char* portName, cons
  */
 int CoreCallback::GetSerialAnswer(const MM::Device*, const char* portName, unsigned long ansLength, char* answerTxt, const char* term)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__, portName);
    std::string answer;
    try {
       answer = core_->getSerialPortAnswer(portName, term);
@@ -988,6 +1140,7 @@ int CoreCallback::GetChannelConfig(char* channelConfigName, const unsigned int c
 
 int CoreCallback::GetDeviceProperty(const char* deviceName, const char* propName, char* value)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    try
    {
       std::string propVal = core_->getProperty(deviceName, propName);
@@ -1003,6 +1156,7 @@ int CoreCallback::GetDeviceProperty(const char* deviceName, const char* propName
 
 int CoreCallback::SetDeviceProperty(const char* deviceName, const char* propName, const char* value)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryCallback, __func__);
    try
    {
       std::string propVal(value);
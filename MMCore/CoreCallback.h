@@ -27,6 +27,7 @@
 
 #include "Devices/DeviceInstances.h"
 #include "CoreUtils.h"
+#include "ImageProcessingPipeline.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
 #include "../MMDevice/DeviceUtils.h"
@@ -95,6 +96,9 @@ public:
    void ClearImageBuffer(const MM::Device* caller);
    bool InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth);
 
+   // Not part of MM::Core; the commit function of the processing pipeline
+   void InsertProcessedImage(const mm::ImageProcessingPipeline::Frame& frame);
+
    int AcqFinished(const MM::Device* caller, int statusCode);
    int PrepareForAcq(const MM::Device* caller);
 
@@ -142,6 +146,19 @@ private:
    MMThreadLock* pValueChangeLock_;
 
    Metadata AddCameraMetadata(const MM::Device* caller, const Metadata* pMd);
+   CircularBuffer* GetImageBuffer(const MM::Device* caller,
+         std::shared_ptr<CircularBuffer>& lane);
+   int ProcessAndInsert(const MM::Device* caller, const unsigned char* buf,
+         unsigned numChannels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata& md,
+         bool doProcess);
+   int InsertIntoBuffer(const MM::Device* caller, const unsigned char* buf,
+         unsigned numChannels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata& md);
+   int RecordImageInsert(bool inserted, const CircularBuffer& buffer);
+   void FeedPreviewTap(const MM::Device* caller, const Metadata& md,
+         const unsigned char* buf, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents);
 
    int OnConfigGroupChanged(const char* groupName, const char* newConfigName);
    int OnPixelSizeChanged(double newPixelSizeUm);
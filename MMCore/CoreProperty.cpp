@@ -26,6 +26,7 @@
 
 #include "CoreProperty.h"
 #include "CoreUtils.h"
+#include "EventDispatcher.h"
 #include "MMCore.h"
 #include "Error.h"
 #include "../MMDevice/DeviceUtils.h"
@@ -169,7 +170,13 @@ void CorePropertyCollection::Execute(const char* propName, const char* value)
 
    if (core_->externalCallback_)
    {
-      core_->externalCallback_->onPropertyChanged("Core", propName, value); 
+      const std::string propNameStr(propName), valueStr(value);
+      core_->eventDispatcher_->Post(
+            mm::EventDispatcher::Key("PropertyChanged", "Core", propNameStr),
+            [propNameStr, valueStr](MMEventCallback& cb) {
+               cb.onPropertyChanged("Core", propNameStr.c_str(),
+                     valueStr.c_str());
+            });
    }
 }
 
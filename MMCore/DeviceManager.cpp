@@ -22,6 +22,8 @@
 #include "Devices/DeviceInstance.h"
 #include "Error.h"
 #include "LoadableModules/LoadedDeviceAdapter.h"
+#include "PerformanceMetrics.h"
+#include "Tracing.h"
 
 #include <algorithm>
 
@@ -293,8 +295,19 @@ DeviceManager::GetParentDevice(std::shared_ptr<DeviceInstance> device) const
 
 
 DeviceModuleLockGuard::DeviceModuleLockGuard(std::shared_ptr<DeviceInstance> device) :
+   waitStart_(std::chrono::steady_clock::now()),
    g_(device->GetAdapterModule()->GetLock())
-{}
+{
+   const std::chrono::steady_clock::time_point acquired =
+      std::chrono::steady_clock::now();
+   std::shared_ptr<metrics::DeviceMetrics> deviceMetrics = device->GetMetrics();
+   if (deviceMetrics)
+      deviceMetrics->moduleLockWaitSeconds->Observe(
+            std::chrono::duration<double>(acquired - waitStart_).count());
+   if (tracing::IsEnabled())
+      tracing::RecordSpan(tracing::CategoryLock, "ModuleLockWait",
+            device->GetLabel().c_str(), waitStart_, acquired);
+}
 
 
 } // namespace mm
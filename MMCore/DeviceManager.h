@@ -24,6 +24,7 @@
 #include "Error.h"
 #include "Logging/Logger.h"
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
@@ -135,6 +136,7 @@ public:
 // Scoped acquisition of a device's module's lock
 class DeviceModuleLockGuard
 {
+   std::chrono::steady_clock::time_point waitStart_; // Must precede g_
    MMThreadGuard g_;
 public:
    explicit DeviceModuleLockGuard(std::shared_ptr<DeviceInstance> device);
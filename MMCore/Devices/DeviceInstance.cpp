@@ -27,6 +27,7 @@
 #include "../LoadableModules/LoadedDeviceAdapter.h"
 #include "../Logging/Logger.h"
 #include "../MMCore.h"
+#include "../PerformanceMetrics.h"
 
 
 int
@@ -162,6 +163,10 @@ DeviceInstance::GetNumberOfProperties() const
 std::string
 DeviceInstance::GetProperty(const std::string& name) const
 {
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
+   mm::metrics::ScopedTimer timer(metrics_ ?
+         metrics_->getPropertySeconds.get() : nullptr);
    DeviceStringBuffer valueBuf(this, "GetProperty");
    int err = pImpl_->GetProperty(name.c_str(), valueBuf.GetBuffer());
    ThrowIfError(err, "Cannot get value of property " +
@@ -179,7 +184,14 @@ DeviceInstance::SetProperty(const std::string& name,
    LOG_DEBUG(Logger()) << "Will set property \"" << name << "\" to \"" <<
       value << "\"";
 
-   int err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   int err;
+   {
+      const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+            TraceDetail());
+      mm::metrics::ScopedTimer timer(metrics_ ?
+            metrics_->setPropertySeconds.get() : nullptr);
+      err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   }
 
    ThrowIfError(err, "Cannot set property " + ToQuotedString(name) +
          " to " + ToQuotedString(value));
@@ -289,33 +301,121 @@ DeviceInstance::GetPropertySequenceMaxLength(const char* propertyName) const
 void
 DeviceInstance::StartPropertySequence(const char* propertyName)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->StartPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::StopPropertySequence(const char* propertyName)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->StopPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::ClearPropertySequence(const char* propertyName)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->ClearPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::AddToPropertySequence(const char* propertyName, const char* value)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->AddToPropertySequence(propertyName, value));
 }
 
 void
 DeviceInstance::SendPropertySequence(const char* propertyName)
 {
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->SendPropertySequence(propertyName));
 }
 
+long
+DeviceInstance::GetPropertyHandle(const char* name) const
+{
+   long handle;
+   int err = pImpl_->GetPropertyHandle(name, handle);
+   ThrowIfError(err, "Cannot get handle for property " +
+         ToQuotedString(name));
+   return handle;
+}
+
+double
+DeviceInstance::GetPropertyDouble(long handle) const
+{
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
+   double value;
+   int err;
+   {
+      mm::metrics::ScopedTimer timer(metrics_ ?
+            metrics_->getPropertySeconds.get() : nullptr);
+      err = pImpl_->GetPropertyDouble(handle, value);
+   }
+   if (err != DEVICE_OK) // Avoid composing the message on the fast path
+      ThrowIfError(err, "Cannot get value of property (handle " +
+            ToString(handle) + ")");
+   return value;
+}
+
+void
+DeviceInstance::SetPropertyDouble(long handle, double value) const
+{
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
+   int err;
+   {
+      mm::metrics::ScopedTimer timer(metrics_ ?
+            metrics_->setPropertySeconds.get() : nullptr);
+      err = pImpl_->SetPropertyDouble(handle, value);
+   }
+   if (err != DEVICE_OK)
+      ThrowIfError(err, "Cannot set property (handle " + ToString(handle) +
+            ") to " + ToString(value));
+}
+
+long
+DeviceInstance::GetPropertyLong(long handle) const
+{
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
+   long value;
+   int err;
+   {
+      mm::metrics::ScopedTimer timer(metrics_ ?
+            metrics_->getPropertySeconds.get() : nullptr);
+      err = pImpl_->GetPropertyLong(handle, value);
+   }
+   if (err != DEVICE_OK)
+      ThrowIfError(err, "Cannot get value of property (handle " +
+            ToString(handle) + ")");
+   return value;
+}
+
+void
+DeviceInstance::SetPropertyLong(long handle, long value) const
+{
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
+   int err;
+   {
+      mm::metrics::ScopedTimer timer(metrics_ ?
+            metrics_->setPropertySeconds.get() : nullptr);
+      err = pImpl_->SetPropertyLong(handle, value);
+   }
+   if (err != DEVICE_OK)
+      ThrowIfError(err, "Cannot set property (handle " + ToString(handle) +
+            ") to " + ToString(value));
+}
+
 std::string
 DeviceInstance::GetErrorText(int code) const
 {
@@ -333,7 +433,7 @@ DeviceInstance::GetErrorText(int code) const
 bool
 DeviceInstance::Busy()
 {
-   RequireInitialized(__func__);
+   MM_DEVICE_CALL();
    return pImpl_->Busy();
 }
 
@@ -356,6 +456,8 @@ DeviceInstance::Initialize()
    if (initializeCalled_)
       ThrowError("Device already initialized (or initialization already attempted)");
    initializeCalled_ = true;
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->Initialize());
    initialized_ = true;
 }
@@ -365,6 +467,8 @@ DeviceInstance::Shutdown()
 {
    // Note we do not require device to be initialized before calling Shutdown().
    initialized_ = false;
+   const mm::tracing::Span span(mm::tracing::CategoryDevice, __func__,
+         TraceDetail());
    ThrowIfError(pImpl_->Shutdown());
 }
 
@@ -22,6 +22,7 @@
 #include "../../MMDevice/MMDeviceConstants.h"
 #include "../Error.h"
 #include "../Logging/Logger.h"
+#include "../Tracing.h"
 
 #include <cstring>
 #include <functional>
@@ -37,9 +38,24 @@ namespace MM
    class Core;
    class Device;
 }
+namespace mm
+{
+   namespace metrics
+   {
+      struct DeviceMetrics;
+   }
+}
 
 typedef std::function<void (MM::Device*)> DeleteDeviceFunction;
 
+// For use at the start of DeviceInstance member functions that call the
+// device: checks that the device is initialized, and traces the rest of the
+// function if tracing is enabled.
+#define MM_DEVICE_CALL() \
+   RequireInitialized(__func__); \
+   const mm::tracing::Span mmDeviceCallSpan_(mm::tracing::CategoryDevice, \
+         __func__, TraceDetail())
+
 
 /// Device instance wrapper class
 /**
@@ -73,6 +89,7 @@ private:
    mm::logging::Logger coreLogger_;
    bool initializeCalled_ = false;
    bool initialized_ = false;
+   std::shared_ptr<mm::metrics::DeviceMetrics> metrics_;
 
 public:
    DeviceInstance(const DeviceInstance&) = delete;
@@ -83,6 +100,10 @@ public:
    std::string GetDescription() const /* final */ { return description_; }
    void SetDescription(const std::string& description) /* final */ { description_ = description; }
 
+   // Null until set by the Core after loading
+   std::shared_ptr<mm::metrics::DeviceMetrics> GetMetrics() const /* final */ { return metrics_; }
+   void SetMetrics(std::shared_ptr<mm::metrics::DeviceMetrics> metrics) /* final */ { metrics_ = metrics; }
+
    // It would be nice to get rid of the need for raw pointers, but for now we
    // need it for the few CoreCallback methods that return a device pointer.
    MM::Device* GetRawPtr() const /* final */ { return pImpl_; }
@@ -118,6 +139,7 @@ protected:
    void ThrowIfError(int code) const;
    void ThrowIfError(int code, const std::string& message) const;
    void RequireInitialized(const char *) const;
+   const char* TraceDetail() const { return label_.c_str(); }
 
    /// Utility class for getting fixed-length strings from the device interface.
    /**
@@ -206,6 +228,11 @@ public:
    void ClearPropertySequence(const char* propertyName);
    void AddToPropertySequence(const char* propertyName, const char* value);
    void SendPropertySequence(const char* propertyName);
+   long GetPropertyHandle(const char* name) const;
+   double GetPropertyDouble(long handle) const;
+   void SetPropertyDouble(long handle, double value) const;
+   long GetPropertyLong(long handle) const;
+   void SetPropertyLong(long handle, long value) const;
    std::string GetErrorText(int code) const;
    bool Busy();
    double GetDelayMs() const;
@@ -22,4 +22,6 @@
 #include "ImageProcessorInstance.h"
 
 
-int ImageProcessorInstance::Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) { RequireInitialized(__func__); return GetImpl()->Process(buffer, width, height, byteDepth); }
+int ImageProcessorInstance::Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) { MM_DEVICE_CALL(); return GetImpl()->Process(buffer, width, height, byteDepth); }
+int ImageProcessorInstance::ProcessSnap(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) { MM_DEVICE_CALL(); return GetImpl()->ProcessSnap(buffer, width, height, byteDepth); }
+int ImageProcessorInstance::SequenceStarting() { MM_DEVICE_CALL(); return GetImpl()->SequenceStarting(); }
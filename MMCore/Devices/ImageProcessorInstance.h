@@ -37,4 +37,6 @@ public:
    {}
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int ProcessSnap(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int SequenceStarting();
 };
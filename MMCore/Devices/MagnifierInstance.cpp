@@ -22,4 +22,4 @@
 #include "MagnifierInstance.h"
 
 
-double MagnifierInstance::GetMagnification() { RequireInitialized(__func__); return GetImpl()->GetMagnification(); }
+double MagnifierInstance::GetMagnification() { MM_DEVICE_CALL(); return GetImpl()->GetMagnification(); }
@@ -22,26 +22,26 @@
 #include "SLMInstance.h"
 
 
-int SLMInstance::SetImage(unsigned char* pixels) { RequireInitialized(__func__); return GetImpl()->SetImage(pixels); }
-int SLMInstance::SetImage(unsigned int* pixels) { RequireInitialized(__func__); return GetImpl()->SetImage(pixels); }
-int SLMInstance::DisplayImage() { RequireInitialized(__func__); return GetImpl()->DisplayImage(); }
-int SLMInstance::SetPixelsTo(unsigned char intensity) { RequireInitialized(__func__); return GetImpl()->SetPixelsTo(intensity); }
-int SLMInstance::SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue) { RequireInitialized(__func__); return GetImpl()->SetPixelsTo(red, green, blue); }
-int SLMInstance::SetExposure(double interval_ms) { RequireInitialized(__func__); return GetImpl()->SetExposure(interval_ms); }
-double SLMInstance::GetExposure() { RequireInitialized(__func__); return GetImpl()->GetExposure(); }
-unsigned SLMInstance::GetWidth() { RequireInitialized(__func__); return GetImpl()->GetWidth(); }
-unsigned SLMInstance::GetHeight() { RequireInitialized(__func__); return GetImpl()->GetHeight(); }
-unsigned SLMInstance::GetNumberOfComponents() { RequireInitialized(__func__); return GetImpl()->GetNumberOfComponents(); }
-unsigned SLMInstance::GetBytesPerPixel() { RequireInitialized(__func__); return GetImpl()->GetBytesPerPixel(); }
+int SLMInstance::SetImage(unsigned char* pixels) { MM_DEVICE_CALL(); return GetImpl()->SetImage(pixels); }
+int SLMInstance::SetImage(unsigned int* pixels) { MM_DEVICE_CALL(); return GetImpl()->SetImage(pixels); }
+int SLMInstance::DisplayImage() { MM_DEVICE_CALL(); return GetImpl()->DisplayImage(); }
+int SLMInstance::SetPixelsTo(unsigned char intensity) { MM_DEVICE_CALL(); return GetImpl()->SetPixelsTo(intensity); }
+int SLMInstance::SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue) { MM_DEVICE_CALL(); return GetImpl()->SetPixelsTo(red, green, blue); }
+int SLMInstance::SetExposure(double interval_ms) { MM_DEVICE_CALL(); return GetImpl()->SetExposure(interval_ms); }
+double SLMInstance::GetExposure() { MM_DEVICE_CALL(); return GetImpl()->GetExposure(); }
+unsigned SLMInstance::GetWidth() { MM_DEVICE_CALL(); return GetImpl()->GetWidth(); }
+unsigned SLMInstance::GetHeight() { MM_DEVICE_CALL(); return GetImpl()->GetHeight(); }
+unsigned SLMInstance::GetNumberOfComponents() { MM_DEVICE_CALL(); return GetImpl()->GetNumberOfComponents(); }
+unsigned SLMInstance::GetBytesPerPixel() { MM_DEVICE_CALL(); return GetImpl()->GetBytesPerPixel(); }
 int SLMInstance::IsSLMSequenceable(bool& isSequenceable)
-{ RequireInitialized(__func__); return GetImpl()->IsSLMSequenceable(isSequenceable); }
+{ MM_DEVICE_CALL(); return GetImpl()->IsSLMSequenceable(isSequenceable); }
 int SLMInstance::GetSLMSequenceMaxLength(long& nrEvents)
-{ RequireInitialized(__func__); return GetImpl()->GetSLMSequenceMaxLength(nrEvents); }
-int SLMInstance::StartSLMSequence() { RequireInitialized(__func__); return GetImpl()->StartSLMSequence(); }
-int SLMInstance::StopSLMSequence() { RequireInitialized(__func__); return GetImpl()->StopSLMSequence(); }
-int SLMInstance::ClearSLMSequence() { RequireInitialized(__func__); return GetImpl()->ClearSLMSequence(); }
+{ MM_DEVICE_CALL(); return GetImpl()->GetSLMSequenceMaxLength(nrEvents); }
+int SLMInstance::StartSLMSequence() { MM_DEVICE_CALL(); return GetImpl()->StartSLMSequence(); }
+int SLMInstance::StopSLMSequence() { MM_DEVICE_CALL(); return GetImpl()->StopSLMSequence(); }
+int SLMInstance::ClearSLMSequence() { MM_DEVICE_CALL(); return GetImpl()->ClearSLMSequence(); }
 int SLMInstance::AddToSLMSequence(const unsigned char * pixels)
-{ RequireInitialized(__func__); return GetImpl()->AddToSLMSequence(pixels); }
+{ MM_DEVICE_CALL(); return GetImpl()->AddToSLMSequence(pixels); }
 int SLMInstance::AddToSLMSequence(const unsigned int * pixels)
-{ RequireInitialized(__func__); return GetImpl()->AddToSLMSequence(pixels); }
-int SLMInstance::SendSLMSequence() { RequireInitialized(__func__); return GetImpl()->SendSLMSequence(); }
+{ MM_DEVICE_CALL(); return GetImpl()->AddToSLMSequence(pixels); }
+int SLMInstance::SendSLMSequence() { MM_DEVICE_CALL(); return GetImpl()->SendSLMSequence(); }
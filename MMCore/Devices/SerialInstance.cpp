@@ -22,9 +22,9 @@
 #include "SerialInstance.h"
 
 
-MM::PortType SerialInstance::GetPortType() const { RequireInitialized(__func__); return GetImpl()->GetPortType(); }
-int SerialInstance::SetCommand(const char* command, const char* term) { RequireInitialized(__func__); return GetImpl()->SetCommand(command, term); }
-int SerialInstance::GetAnswer(char* txt, unsigned maxChars, const char* term) { RequireInitialized(__func__); return GetImpl()->GetAnswer(txt, maxChars, term); }
-int SerialInstance::Write(const unsigned char* buf, unsigned long bufLen) { RequireInitialized(__func__); return GetImpl()->Write(buf, bufLen); }
-int SerialInstance::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead) { RequireInitialized(__func__); return GetImpl()->Read(buf, bufLen, charsRead); }
-int SerialInstance::Purge() { RequireInitialized(__func__); return GetImpl()->Purge(); }
+MM::PortType SerialInstance::GetPortType() const { MM_DEVICE_CALL(); return GetImpl()->GetPortType(); }
+int SerialInstance::SetCommand(const char* command, const char* term) { MM_DEVICE_CALL(); return GetImpl()->SetCommand(command, term); }
+int SerialInstance::GetAnswer(char* txt, unsigned maxChars, const char* term) { MM_DEVICE_CALL(); return GetImpl()->GetAnswer(txt, maxChars, term); }
+int SerialInstance::Write(const unsigned char* buf, unsigned long bufLen) { MM_DEVICE_CALL(); return GetImpl()->Write(buf, bufLen); }
+int SerialInstance::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead) { MM_DEVICE_CALL(); return GetImpl()->Read(buf, bufLen, charsRead); }
+int SerialInstance::Purge() { MM_DEVICE_CALL(); return GetImpl()->Purge(); }
@@ -22,17 +22,17 @@
 #include "StageInstance.h"
 
 
-int StageInstance::SetPositionUm(double pos) { RequireInitialized(__func__); return GetImpl()->SetPositionUm(pos); }
-int StageInstance::SetRelativePositionUm(double d) { RequireInitialized(__func__); return GetImpl()->SetRelativePositionUm(d); }
-int StageInstance::Move(double velocity) { RequireInitialized(__func__); return GetImpl()->Move(velocity); }
-int StageInstance::Stop() { RequireInitialized(__func__); return GetImpl()->Stop(); }
-int StageInstance::Home() { RequireInitialized(__func__); return GetImpl()->Home(); }
-int StageInstance::SetAdapterOriginUm(double d) { RequireInitialized(__func__); return GetImpl()->SetAdapterOriginUm(d); }
-int StageInstance::GetPositionUm(double& pos) { RequireInitialized(__func__); return GetImpl()->GetPositionUm(pos); }
-int StageInstance::SetPositionSteps(long steps) { RequireInitialized(__func__); return GetImpl()->SetPositionSteps(steps); }
-int StageInstance::GetPositionSteps(long& steps) { RequireInitialized(__func__); return GetImpl()->GetPositionSteps(steps); }
-int StageInstance::SetOrigin() { RequireInitialized(__func__); return GetImpl()->SetOrigin(); }
-int StageInstance::GetLimits(double& lower, double& upper) { RequireInitialized(__func__); return GetImpl()->GetLimits(lower, upper); }
+int StageInstance::SetPositionUm(double pos) { MM_DEVICE_CALL(); return GetImpl()->SetPositionUm(pos); }
+int StageInstance::SetRelativePositionUm(double d) { MM_DEVICE_CALL(); return GetImpl()->SetRelativePositionUm(d); }
+int StageInstance::Move(double velocity) { MM_DEVICE_CALL(); return GetImpl()->Move(velocity); }
+int StageInstance::Stop() { MM_DEVICE_CALL(); return GetImpl()->Stop(); }
+int StageInstance::Home() { MM_DEVICE_CALL(); return GetImpl()->Home(); }
+int StageInstance::SetAdapterOriginUm(double d) { MM_DEVICE_CALL(); return GetImpl()->SetAdapterOriginUm(d); }
+int StageInstance::GetPositionUm(double& pos) { MM_DEVICE_CALL(); return GetImpl()->GetPositionUm(pos); }
+int StageInstance::SetPositionSteps(long steps) { MM_DEVICE_CALL(); return GetImpl()->SetPositionSteps(steps); }
+int StageInstance::GetPositionSteps(long& steps) { MM_DEVICE_CALL(); return GetImpl()->GetPositionSteps(steps); }
+int StageInstance::SetOrigin() { MM_DEVICE_CALL(); return GetImpl()->SetOrigin(); }
+int StageInstance::GetLimits(double& lower, double& upper) { MM_DEVICE_CALL(); return GetImpl()->GetLimits(lower, upper); }
 
 MM::FocusDirection
 StageInstance::GetFocusDirection()
@@ -57,14 +57,14 @@ StageInstance::SetFocusDirection(MM::FocusDirection direction)
    focusDirectionHasBeenSet_ = true;
 }
 
-int StageInstance::IsStageSequenceable(bool& isSequenceable) const { RequireInitialized(__func__); return GetImpl()->IsStageSequenceable(isSequenceable); }
-int StageInstance::IsStageLinearSequenceable(bool& isSequenceable) const { RequireInitialized(__func__); return GetImpl()->IsStageLinearSequenceable(isSequenceable); }
-bool StageInstance::IsContinuousFocusDrive() const { RequireInitialized(__func__); return GetImpl()->IsContinuousFocusDrive(); }
-int StageInstance::GetStageSequenceMaxLength(long& nrEvents) const { RequireInitialized(__func__); return GetImpl()->GetStageSequenceMaxLength(nrEvents); }
-int StageInstance::StartStageSequence() { RequireInitialized(__func__); return GetImpl()->StartStageSequence(); }
-int StageInstance::StopStageSequence() { RequireInitialized(__func__); return GetImpl()->StopStageSequence(); }
-int StageInstance::ClearStageSequence() { RequireInitialized(__func__); return GetImpl()->ClearStageSequence(); }
-int StageInstance::AddToStageSequence(double position) { RequireInitialized(__func__); return GetImpl()->AddToStageSequence(position); }
-int StageInstance::SendStageSequence() { RequireInitialized(__func__); return GetImpl()->SendStageSequence(); }
+int StageInstance::IsStageSequenceable(bool& isSequenceable) const { MM_DEVICE_CALL(); return GetImpl()->IsStageSequenceable(isSequenceable); }
+int StageInstance::IsStageLinearSequenceable(bool& isSequenceable) const { MM_DEVICE_CALL(); return GetImpl()->IsStageLinearSequenceable(isSequenceable); }
+bool StageInstance::IsContinuousFocusDrive() const { MM_DEVICE_CALL(); return GetImpl()->IsContinuousFocusDrive(); }
+int StageInstance::GetStageSequenceMaxLength(long& nrEvents) const { MM_DEVICE_CALL(); return GetImpl()->GetStageSequenceMaxLength(nrEvents); }
+int StageInstance::StartStageSequence() { MM_DEVICE_CALL(); return GetImpl()->StartStageSequence(); }
+int StageInstance::StopStageSequence() { MM_DEVICE_CALL(); return GetImpl()->StopStageSequence(); }
+int StageInstance::ClearStageSequence() { MM_DEVICE_CALL(); return GetImpl()->ClearStageSequence(); }
+int StageInstance::AddToStageSequence(double position) { MM_DEVICE_CALL(); return GetImpl()->AddToStageSequence(position); }
+int StageInstance::SendStageSequence() { MM_DEVICE_CALL(); return GetImpl()->SendStageSequence(); }
 int StageInstance::SetStageLinearSequence(double dZ_um, long nSlices)
-{ RequireInitialized(__func__); return GetImpl()->SetStageLinearSequence(dZ_um, nSlices); }
\ No newline at end of file
+{ MM_DEVICE_CALL(); return GetImpl()->SetStageLinearSequence(dZ_um, nSlices); }
\ No newline at end of file
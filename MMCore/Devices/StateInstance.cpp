@@ -22,13 +22,13 @@
 #include "StateInstance.h"
 
 
-int StateInstance::SetPosition(long pos) { RequireInitialized(__func__); return GetImpl()->SetPosition(pos); }
-int StateInstance::SetPosition(const char* label) { RequireInitialized(__func__); return GetImpl()->SetPosition(label); }
-int StateInstance::GetPosition(long& pos) const { RequireInitialized(__func__); return GetImpl()->GetPosition(pos); }
+int StateInstance::SetPosition(long pos) { MM_DEVICE_CALL(); return GetImpl()->SetPosition(pos); }
+int StateInstance::SetPosition(const char* label) { MM_DEVICE_CALL(); return GetImpl()->SetPosition(label); }
+int StateInstance::GetPosition(long& pos) const { MM_DEVICE_CALL(); return GetImpl()->GetPosition(pos); }
 
 std::string StateInstance::GetPositionLabel() const
 {
-   RequireInitialized(__func__);
+   MM_DEVICE_CALL();
    DeviceStringBuffer labelBuf(this, "GetPosition");
    int err = GetImpl()->GetPosition(labelBuf.GetBuffer());
    ThrowIfError(err, "Cannot get current position label");
@@ -37,15 +37,15 @@ std::string StateInstance::GetPositionLabel() const
 
 std::string StateInstance::GetPositionLabel(long pos) const
 {
-   RequireInitialized(__func__);
+   MM_DEVICE_CALL();
    DeviceStringBuffer labelBuf(this, "GetPositionLabel");
    int err = GetImpl()->GetPositionLabel(pos, labelBuf.GetBuffer());
    ThrowIfError(err, "Cannot get position label at index " + ToString(pos));
    return labelBuf.Get();
 }
 
-int StateInstance::GetLabelPosition(const char* label, long& pos) const { RequireInitialized(__func__); return GetImpl()->GetLabelPosition(label, pos); }
-int StateInstance::SetPositionLabel(long pos, const char* label) { RequireInitialized(__func__); return GetImpl()->SetPositionLabel(pos, label); }
-unsigned long StateInstance::GetNumberOfPositions() const { RequireInitialized(__func__); return GetImpl()->GetNumberOfPositions(); }
-int StateInstance::SetGateOpen(bool open) { RequireInitialized(__func__); return GetImpl()->SetGateOpen(open); }
-int StateInstance::GetGateOpen(bool& open) { RequireInitialized(__func__); return GetImpl()->GetGateOpen(open); }
+int StateInstance::GetLabelPosition(const char* label, long& pos) const { MM_DEVICE_CALL(); return GetImpl()->GetLabelPosition(label, pos); }
+int StateInstance::SetPositionLabel(long pos, const char* label) { MM_DEVICE_CALL(); return GetImpl()->SetPositionLabel(pos, label); }
+unsigned long StateInstance::GetNumberOfPositions() const { MM_DEVICE_CALL(); return GetImpl()->GetNumberOfPositions(); }
+int StateInstance::SetGateOpen(bool open) { MM_DEVICE_CALL(); return GetImpl()->SetGateOpen(open); }
+int StateInstance::GetGateOpen(bool& open) { MM_DEVICE_CALL(); return GetImpl()->GetGateOpen(open); }
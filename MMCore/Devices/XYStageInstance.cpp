@@ -22,27 +22,27 @@
 #include "XYStageInstance.h"
 
 
-int XYStageInstance::SetPositionUm(double x, double y) { RequireInitialized(__func__); return GetImpl()->SetPositionUm(x, y); }
-int XYStageInstance::SetRelativePositionUm(double dx, double dy) { RequireInitialized(__func__); return GetImpl()->SetRelativePositionUm(dx, dy); }
-int XYStageInstance::SetAdapterOriginUm(double x, double y) { RequireInitialized(__func__); return GetImpl()->SetAdapterOriginUm(x, y); }
-int XYStageInstance::GetPositionUm(double& x, double& y) { RequireInitialized(__func__); return GetImpl()->GetPositionUm(x, y); }
-int XYStageInstance::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax) { RequireInitialized(__func__); return GetImpl()->GetLimitsUm(xMin, xMax, yMin, yMax); }
-int XYStageInstance::Move(double vx, double vy) { RequireInitialized(__func__); return GetImpl()->Move(vx, vy); }
-int XYStageInstance::SetPositionSteps(long x, long y) { RequireInitialized(__func__); return GetImpl()->SetPositionSteps(x, y); }
-int XYStageInstance::GetPositionSteps(long& x, long& y) { RequireInitialized(__func__); return GetImpl()->GetPositionSteps(x, y); }
-int XYStageInstance::SetRelativePositionSteps(long x, long y) { RequireInitialized(__func__); return GetImpl()->SetRelativePositionSteps(x, y); }
-int XYStageInstance::Home() { RequireInitialized(__func__); return GetImpl()->Home(); }
-int XYStageInstance::Stop() { RequireInitialized(__func__); return GetImpl()->Stop(); }
-int XYStageInstance::SetOrigin() { RequireInitialized(__func__); return GetImpl()->SetOrigin(); }
-int XYStageInstance::SetXOrigin() { RequireInitialized(__func__); return GetImpl()->SetXOrigin(); }
-int XYStageInstance::SetYOrigin() { RequireInitialized(__func__); return GetImpl()->SetYOrigin(); }
-int XYStageInstance::GetStepLimits(long& xMin, long& xMax, long& yMin, long& yMax) { RequireInitialized(__func__); return GetImpl()->GetStepLimits(xMin, xMax, yMin, yMax); }
-double XYStageInstance::GetStepSizeXUm() { RequireInitialized(__func__); return GetImpl()->GetStepSizeXUm(); }
-double XYStageInstance::GetStepSizeYUm() { RequireInitialized(__func__); return GetImpl()->GetStepSizeYUm(); }
-int XYStageInstance::IsXYStageSequenceable(bool& isSequenceable) const { RequireInitialized(__func__); return GetImpl()->IsXYStageSequenceable(isSequenceable); }
-int XYStageInstance::GetXYStageSequenceMaxLength(long& nrEvents) const { RequireInitialized(__func__); return GetImpl()->GetXYStageSequenceMaxLength(nrEvents); }
-int XYStageInstance::StartXYStageSequence() { RequireInitialized(__func__); return GetImpl()->StartXYStageSequence(); }
-int XYStageInstance::StopXYStageSequence() { RequireInitialized(__func__); return GetImpl()->StopXYStageSequence(); }
-int XYStageInstance::ClearXYStageSequence() { RequireInitialized(__func__); return GetImpl()->ClearXYStageSequence(); }
-int XYStageInstance::AddToXYStageSequence(double positionX, double positionY) { RequireInitialized(__func__); return GetImpl()->AddToXYStageSequence(positionX, positionY); }
-int XYStageInstance::SendXYStageSequence() { RequireInitialized(__func__); return GetImpl()->SendXYStageSequence(); }
+int XYStageInstance::SetPositionUm(double x, double y) { MM_DEVICE_CALL(); return GetImpl()->SetPositionUm(x, y); }
+int XYStageInstance::SetRelativePositionUm(double dx, double dy) { MM_DEVICE_CALL(); return GetImpl()->SetRelativePositionUm(dx, dy); }
+int XYStageInstance::SetAdapterOriginUm(double x, double y) { MM_DEVICE_CALL(); return GetImpl()->SetAdapterOriginUm(x, y); }
+int XYStageInstance::GetPositionUm(double& x, double& y) { MM_DEVICE_CALL(); return GetImpl()->GetPositionUm(x, y); }
+int XYStageInstance::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax) { MM_DEVICE_CALL(); return GetImpl()->GetLimitsUm(xMin, xMax, yMin, yMax); }
+int XYStageInstance::Move(double vx, double vy) { MM_DEVICE_CALL(); return GetImpl()->Move(vx, vy); }
+int XYStageInstance::SetPositionSteps(long x, long y) { MM_DEVICE_CALL(); return GetImpl()->SetPositionSteps(x, y); }
+int XYStageInstance::GetPositionSteps(long& x, long& y) { MM_DEVICE_CALL(); return GetImpl()->GetPositionSteps(x, y); }
+int XYStageInstance::SetRelativePositionSteps(long x, long y) { MM_DEVICE_CALL(); return GetImpl()->SetRelativePositionSteps(x, y); }
+int XYStageInstance::Home() { MM_DEVICE_CALL(); return GetImpl()->Home(); }
+int XYStageInstance::Stop() { MM_DEVICE_CALL(); return GetImpl()->Stop(); }
+int XYStageInstance::SetOrigin() { MM_DEVICE_CALL(); return GetImpl()->SetOrigin(); }
+int XYStageInstance::SetXOrigin() { MM_DEVICE_CALL(); return GetImpl()->SetXOrigin(); }
+int XYStageInstance::SetYOrigin() { MM_DEVICE_CALL(); return GetImpl()->SetYOrigin(); }
+int XYStageInstance::GetStepLimits(long& xMin, long& xMax, long& yMin, long& yMax) { MM_DEVICE_CALL(); return GetImpl()->GetStepLimits(xMin, xMax, yMin, yMax); }
+double XYStageInstance::GetStepSizeXUm() { MM_DEVICE_CALL(); return GetImpl()->GetStepSizeXUm(); }
+double XYStageInstance::GetStepSizeYUm() { MM_DEVICE_CALL(); return GetImpl()->GetStepSizeYUm(); }
+int XYStageInstance::IsXYStageSequenceable(bool& isSequenceable) const { MM_DEVICE_CALL(); return GetImpl()->IsXYStageSequenceable(isSequenceable); }
+int XYStageInstance::GetXYStageSequenceMaxLength(long& nrEvents) const { MM_DEVICE_CALL(); return GetImpl()->GetXYStageSequenceMaxLength(nrEvents); }
+int XYStageInstance::StartXYStageSequence() { MM_DEVICE_CALL(); return GetImpl()->StartXYStageSequence(); }
+int XYStageInstance::StopXYStageSequence() { MM_DEVICE_CALL(); return GetImpl()->StopXYStageSequence(); }
+int XYStageInstance::ClearXYStageSequence() { MM_DEVICE_CALL(); return GetImpl()->ClearXYStageSequence(); }
+int XYStageInstance::AddToXYStageSequence(double positionX, double positionY) { MM_DEVICE_CALL(); return GetImpl()->AddToXYStageSequence(positionX, positionY); }
+int XYStageInstance::SendXYStageSequence() { MM_DEVICE_CALL(); return GetImpl()->SendXYStageSequence(); }
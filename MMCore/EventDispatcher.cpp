@@ -0,0 +1,269 @@
+#include "EventDispatcher.h"
+
+#include "MMEventCallback.h"
+#include "PerformanceMetrics.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace mm
+{
+
+namespace
+{
+
+// Dispatchers whose callback is running on this thread, innermost last
+thread_local std::vector<const EventDispatcher*> deliveringDispatchers;
+
+} // anonymous namespace
+
+EventDispatcher::EventDispatcher(std::shared_ptr<metrics::CoreMetrics> metrics) :
+   metrics_(metrics),
+   callback_(0),
+   async_(false),
+   coalescing_(true),
+   window_(0),
+   generation_(0),
+   delivering_(false),
+   stopRequested_(false)
+{
+}
+
+EventDispatcher::~EventDispatcher()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopRequested_ = true;
+   }
+   cv_.notify_all();
+   if (thread_.joinable())
+      thread_.join();
+}
+
+std::string
+EventDispatcher::Key(const char* type, const std::string& name1,
+      const std::string& name2)
+{
+   // Labels and property names cannot contain the separator
+   std::string key(type);
+   key += '\n';
+   key += name1;
+   key += '\n';
+   key += name2;
+   return key;
+}
+
+void
+EventDispatcher::SetCallback(MMEventCallback* callback)
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   callback_ = callback;
+   const unsigned long generation = ++generation_;
+   queue_.clear();
+   queuedByKey_.clear();
+   UpdateQueueGauge();
+   // Deliveries to the new callback, which may keep starting, are not waited
+   // for
+   if (!InCallback())
+      cv_.wait(lock, [&]() {
+         return inFlight_.empty() || inFlight_.begin()->first >= generation;
+      });
+}
+
+void
+EventDispatcher::SetAsync(bool async)
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   async_ = async;
+   if (!async && !OnDispatcherThread())
+   {
+      // Deliver queued events without waiting for the coalescing window
+      for (const std::shared_ptr<Event>& event : queue_)
+         event->deliverAfter = std::chrono::steady_clock::time_point();
+      cv_.notify_all();
+      cv_.wait(lock, [this]() { return queue_.empty() && !delivering_; });
+   }
+}
+
+bool
+EventDispatcher::IsAsync() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return async_;
+}
+
+void
+EventDispatcher::SetCoalescing(bool enable)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   coalescing_ = enable;
+   if (!enable)
+      queuedByKey_.clear();
+}
+
+bool
+EventDispatcher::IsCoalescing() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return coalescing_;
+}
+
+void
+EventDispatcher::SetCoalescingWindow(std::chrono::microseconds window)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   window_ = window;
+}
+
+std::chrono::microseconds
+EventDispatcher::GetCoalescingWindow() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return window_;
+}
+
+void
+EventDispatcher::Post(const std::string& key, Delivery delivery)
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   if (!callback_)
+      return;
+   metrics_->callbackEventsPosted->Increment();
+
+   if (!async_)
+   {
+      MMEventCallback* callback = callback_;
+      const unsigned long generation = generation_;
+      ++inFlight_[generation];
+      lock.unlock();
+      Deliver(callback, delivery);
+      lock.lock();
+      EndDelivery(generation);
+      return;
+   }
+
+   const bool coalesce = coalescing_ && !key.empty();
+   if (coalesce)
+   {
+      std::unordered_map<std::string, std::shared_ptr<Event> >::iterator it =
+         queuedByKey_.find(key);
+      if (it != queuedByKey_.end())
+      {
+         // Keep the queue position (and delivery time) of the earlier event
+         it->second->delivery = std::move(delivery);
+         metrics_->callbackEventsCoalesced->Increment();
+         return;
+      }
+   }
+
+   std::shared_ptr<Event> event = std::make_shared<Event>();
+   event->key = key;
+   event->delivery = std::move(delivery);
+   event->deliverAfter = std::chrono::steady_clock::now();
+   if (coalesce)
+   {
+      event->deliverAfter += window_;
+      queuedByKey_[key] = event;
+   }
+   queue_.push_back(event);
+   UpdateQueueGauge();
+
+   if (!thread_.joinable())
+      thread_ = std::thread([this]() { Run(); });
+   lock.unlock();
+   cv_.notify_all();
+}
+
+bool
+EventDispatcher::OnDispatcherThread() const
+{
+   return std::this_thread::get_id() == thread_.get_id();
+}
+
+bool
+EventDispatcher::InCallback() const
+{
+   return std::find(deliveringDispatchers.begin(),
+         deliveringDispatchers.end(), this) != deliveringDispatchers.end();
+}
+
+void
+EventDispatcher::UpdateQueueGauge()
+{
+   metrics_->callbackQueueEvents->Set(static_cast<double>(queue_.size()));
+}
+
+void
+EventDispatcher::Deliver(MMEventCallback* callback, const Delivery& delivery)
+{
+   metrics::ScopedTimer timer(metrics_->callbackDeliverySeconds.get());
+   deliveringDispatchers.push_back(this);
+   try
+   {
+      delivery(*callback);
+   }
+   catch (...)
+   {
+      // The listener's exceptions must not escape into device threads (or
+      // terminate the dispatcher thread)
+   }
+   deliveringDispatchers.pop_back();
+}
+
+void
+EventDispatcher::EndDelivery(unsigned long generation)
+{
+   std::map<unsigned long, unsigned>::iterator it = inFlight_.find(generation);
+   if (--it->second == 0)
+   {
+      inFlight_.erase(it);
+      cv_.notify_all();
+   }
+}
+
+void
+EventDispatcher::Run()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   for (;;)
+   {
+      cv_.wait(lock, [this]() { return stopRequested_ || !queue_.empty(); });
+      if (stopRequested_)
+         return;
+
+      const std::shared_ptr<Event> event = queue_.front();
+      if (event->deliverAfter > std::chrono::steady_clock::now())
+      {
+         cv_.wait_until(lock, event->deliverAfter, [&]() {
+            return stopRequested_ || queue_.empty() ||
+               queue_.front() != event ||
+               event->deliverAfter <= std::chrono::steady_clock::now();
+         });
+         continue;
+      }
+
+      queue_.pop_front();
+      if (!event->key.empty())
+      {
+         std::unordered_map<std::string, std::shared_ptr<Event> >::iterator it =
+            queuedByKey_.find(event->key);
+         if (it != queuedByKey_.end() && it->second == event)
+            queuedByKey_.erase(it);
+      }
+      UpdateQueueGauge();
+
+      MMEventCallback* callback = callback_;
+      const unsigned long generation = generation_;
+      ++inFlight_[generation];
+      delivering_ = true;
+      lock.unlock();
+      Deliver(callback, event->delivery);
+      lock.lock();
+      delivering_ = false;
+      EndDelivery(generation);
+      cv_.notify_all();
+   }
+}
+
+} // namespace mm
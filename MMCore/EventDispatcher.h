@@ -0,0 +1,103 @@
+// Delivery of notifications to the registered MMEventCallback, either
+// synchronously on the posting thread (the default) or asynchronously on a
+// dedicated dispatcher thread, so that device threads never wait for the
+// listener.
+//
+// In asynchronous mode, events that carry a key (e.g. the position of a given
+// stage) can be coalesced: while an event is still queued, a newer event with
+// the same key replaces its payload instead of being queued separately. An
+// optional coalescing window holds keyed events back for a while so that
+// high-rate updates are merged even when the listener keeps up.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+class MMEventCallback;
+
+namespace mm
+{
+
+namespace metrics
+{
+class CoreMetrics;
+} // namespace metrics
+
+class EventDispatcher
+{
+public:
+   typedef std::function<void(MMEventCallback&)> Delivery;
+
+   explicit EventDispatcher(std::shared_ptr<metrics::CoreMetrics> metrics);
+   ~EventDispatcher();
+
+   EventDispatcher(const EventDispatcher&) = delete;
+   EventDispatcher& operator=(const EventDispatcher&) = delete;
+
+   // Builds a coalescing key from an event type and the names it applies to
+   static std::string Key(const char* type, const std::string& name1 = "",
+         const std::string& name2 = "");
+
+   // Discards queued events. Once this returns, the previous callback is no
+   // longer called: this waits for its deliveries in progress, synchronous
+   // ones on posting threads included (unless this is called from within a
+   // callback, in which case it does not wait).
+   void SetCallback(MMEventCallback* callback);
+
+   // Switching to synchronous mode waits until queued events are delivered
+   // (unless called from within the callback).
+   void SetAsync(bool async);
+   bool IsAsync() const;
+
+   void SetCoalescing(bool enable);
+   bool IsCoalescing() const;
+   void SetCoalescingWindow(std::chrono::microseconds window);
+   std::chrono::microseconds GetCoalescingWindow() const;
+
+   // Events with an empty key are never coalesced. Does nothing if no
+   // callback is registered.
+   void Post(const std::string& key, Delivery delivery);
+
+private:
+   struct Event
+   {
+      std::string key;
+      Delivery delivery;
+      std::chrono::steady_clock::time_point deliverAfter;
+   };
+
+   void Run();
+   bool OnDispatcherThread() const;
+   bool InCallback() const;
+   void UpdateQueueGauge(); // Caller must hold mutex_
+   void Deliver(MMEventCallback* callback, const Delivery& delivery);
+   void EndDelivery(unsigned long generation); // Caller must hold mutex_
+
+   const std::shared_ptr<metrics::CoreMetrics> metrics_;
+
+   mutable std::mutex mutex_;
+   std::condition_variable cv_;
+   MMEventCallback* callback_;
+   bool async_;
+   bool coalescing_;
+   std::chrono::microseconds window_;
+   std::deque<std::shared_ptr<Event> > queue_;
+   std::unordered_map<std::string, std::shared_ptr<Event> > queuedByKey_;
+   unsigned long generation_; // Incremented by SetCallback()
+   // Deliveries in progress on any thread, by callback generation
+   std::map<unsigned long, unsigned> inFlight_;
+   bool delivering_; // On the dispatcher thread
+   bool stopRequested_;
+   std::thread thread_; // Started when first needed
+};
+
+} // namespace mm
@@ -0,0 +1,221 @@
+#include "FrameCodec.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace mm
+{
+namespace codec
+{
+
+namespace
+{
+
+// Run-length encoding: a control byte below 128 is followed by (control + 1)
+// literal bytes; a control byte c >= 128 is followed by one byte to be
+// repeated (c - 128 + MinRun) times.
+const size_t MinRun = 3;
+const size_t MaxRun = 127 + MinRun;
+const size_t MaxLiterals = 128;
+
+// Transposes the 8x8 bit matrix whose rows are the bytes of x (Hacker's
+// Delight, 7-3). The transposition is its own inverse.
+inline uint64_t Transpose8x8(uint64_t x)
+{
+   uint64_t t;
+   t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+   x = x ^ t ^ (t << 7);
+   t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+   x = x ^ t ^ (t << 14);
+   t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+   x = x ^ t ^ (t << 28);
+   return x;
+}
+
+// Stores bit j of byte b of the elements as plane (8 * b + j). Elements beyond
+// the last multiple of 8 are appended unchanged.
+template <unsigned ElementSize>
+void BitShuffle(const unsigned char* src, size_t bytes, unsigned char* dst)
+{
+   const size_t groups = bytes / ElementSize / 8;
+   for (unsigned b = 0; b < ElementSize; ++b)
+   {
+      unsigned char* planes = dst + 8 * b * groups;
+      for (size_t g = 0; g < groups; ++g)
+      {
+         const unsigned char* in = src + g * 8 * ElementSize + b;
+         uint64_t x = 0;
+         for (unsigned i = 0; i < 8; ++i)
+            x |= static_cast<uint64_t>(in[i * ElementSize]) << (8 * i);
+         x = Transpose8x8(x);
+         for (unsigned j = 0; j < 8; ++j)
+            planes[j * groups + g] = static_cast<unsigned char>(x >> (8 * j));
+      }
+   }
+   const size_t shuffled = groups * 8 * ElementSize;
+   std::memcpy(dst + shuffled, src + shuffled, bytes - shuffled);
+}
+
+template <unsigned ElementSize>
+void BitUnshuffle(const unsigned char* src, size_t bytes, unsigned char* dst)
+{
+   const size_t groups = bytes / ElementSize / 8;
+   for (unsigned b = 0; b < ElementSize; ++b)
+   {
+      const unsigned char* planes = src + 8 * b * groups;
+      for (size_t g = 0; g < groups; ++g)
+      {
+         uint64_t x = 0;
+         for (unsigned j = 0; j < 8; ++j)
+            x |= static_cast<uint64_t>(planes[j * groups + g]) << (8 * j);
+         x = Transpose8x8(x);
+         unsigned char* out = dst + g * 8 * ElementSize + b;
+         for (unsigned i = 0; i < 8; ++i)
+            out[i * ElementSize] = static_cast<unsigned char>(x >> (8 * i));
+      }
+   }
+   const size_t shuffled = groups * 8 * ElementSize;
+   std::memcpy(dst + shuffled, src + shuffled, bytes - shuffled);
+}
+
+// The element size is a template parameter so that the loops above unroll
+bool BitShuffle(const unsigned char* src, size_t bytes, unsigned elementSize,
+      unsigned char* dst, bool inverse)
+{
+   switch (elementSize)
+   {
+      case 1:
+         inverse ? BitUnshuffle<1>(src, bytes, dst) : BitShuffle<1>(src, bytes, dst);
+         return true;
+      case 2:
+         inverse ? BitUnshuffle<2>(src, bytes, dst) : BitShuffle<2>(src, bytes, dst);
+         return true;
+      case 4:
+         inverse ? BitUnshuffle<4>(src, bytes, dst) : BitShuffle<4>(src, bytes, dst);
+         return true;
+      case 8:
+         inverse ? BitUnshuffle<8>(src, bytes, dst) : BitShuffle<8>(src, bytes, dst);
+         return true;
+      default:
+         return false;
+   }
+}
+
+// Returns the encoded size, or capacity + 1 if it would exceed capacity
+size_t RunLengthEncode(const unsigned char* src, size_t bytes,
+      unsigned char* dst, size_t capacity)
+{
+   size_t out = 0;
+   size_t literalStart = 0;
+   size_t i = 0;
+
+   auto flushLiterals = [&](size_t end) -> bool {
+      while (literalStart < end)
+      {
+         const size_t count = end - literalStart < MaxLiterals ?
+            end - literalStart : MaxLiterals;
+         if (out + 1 + count > capacity)
+            return false;
+         dst[out++] = static_cast<unsigned char>(count - 1);
+         std::memcpy(dst + out, src + literalStart, count);
+         out += count;
+         literalStart += count;
+      }
+      return true;
+   };
+
+   while (i < bytes)
+   {
+      const unsigned char value = src[i];
+      size_t run = 1;
+      while (i + run < bytes && run < MaxRun && src[i + run] == value)
+         ++run;
+
+      if (run < MinRun)
+      {
+         i += run;
+         continue;
+      }
+      if (!flushLiterals(i) || out + 2 > capacity)
+         return capacity + 1;
+      dst[out++] = static_cast<unsigned char>(128 + run - MinRun);
+      dst[out++] = value;
+      i += run;
+      literalStart = i;
+   }
+   if (!flushLiterals(bytes))
+      return capacity + 1;
+   return out;
+}
+
+bool RunLengthDecode(const unsigned char* src, size_t srcBytes,
+      unsigned char* dst, size_t bytes)
+{
+   size_t in = 0;
+   size_t out = 0;
+   while (in < srcBytes)
+   {
+      const unsigned control = src[in++];
+      if (control < 128)
+      {
+         const size_t count = control + 1;
+         if (in + count > srcBytes || out + count > bytes)
+            return false;
+         std::memcpy(dst + out, src + in, count);
+         in += count;
+         out += count;
+      }
+      else
+      {
+         const size_t count = control - 128 + MinRun;
+         if (in >= srcBytes || out + count > bytes)
+            return false;
+         std::memset(dst + out, src[in++], count);
+         out += count;
+      }
+   }
+   return out == bytes;
+}
+
+} // anonymous namespace
+
+size_t
+CompressChunk(const unsigned char* src, size_t bytes, unsigned elementSize,
+      unsigned char* dst, std::vector<unsigned char>& scratch)
+{
+   if (scratch.size() < bytes)
+      scratch.resize(bytes);
+
+   // Encoding to exactly the raw size would be ambiguous with raw storage
+   if (bytes > 0 && BitShuffle(src, bytes, elementSize, scratch.data(), false))
+   {
+      const size_t encoded =
+         RunLengthEncode(scratch.data(), bytes, dst, bytes - 1);
+      if (encoded < bytes)
+         return encoded;
+   }
+   std::memcpy(dst, src, bytes);
+   return bytes;
+}
+
+bool
+DecompressChunk(const unsigned char* src, size_t srcBytes, unsigned char* dst,
+      size_t bytes, unsigned elementSize, std::vector<unsigned char>& scratch)
+{
+   if (srcBytes == bytes)
+   {
+      std::memcpy(dst, src, bytes);
+      return true;
+   }
+   if (srcBytes > bytes)
+      return false;
+
+   if (scratch.size() < bytes)
+      scratch.resize(bytes);
+   if (!RunLengthDecode(src, srcBytes, scratch.data(), bytes))
+      return false;
+   return BitShuffle(scratch.data(), bytes, elementSize, dst, true);
+}
+
+} // namespace codec
+} // namespace mm
@@ -0,0 +1,40 @@
+// Lossless compression of image data for the compressed sequence buffer.
+//
+// A chunk of pixels is bit-shuffled (bit plane k of all pixels is stored
+// together), so that the high bits of dim images form long runs of zero bytes,
+// and is then run-length encoded. A chunk that does not compress is stored
+// raw, so the compressed size never exceeds the raw size.
+//
+// Chunks are independent of each other and can be processed in parallel; see
+// TaskSet_FrameCodec for whole frames.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace mm
+{
+namespace codec
+{
+
+// Raw size of the chunks frames are split into (a multiple of 8 pixels of
+// any supported pixel size)
+const size_t ChunkBytes = 256 * 1024;
+
+// Compresses bytes (a multiple of elementSize) from src into dst, which must
+// have room for bytes. Returns the compressed size; equal to bytes if the
+// chunk is stored raw, as are chunks with element sizes other than 1, 2, 4
+// and 8. The scratch vector is reused between calls.
+size_t CompressChunk(const unsigned char* src, size_t bytes,
+      unsigned elementSize, unsigned char* dst,
+      std::vector<unsigned char>& scratch);
+
+// Decompresses srcBytes from src into bytes (the raw size) at dst. Returns
+// false if the data is corrupt.
+bool DecompressChunk(const unsigned char* src, size_t srcBytes,
+      unsigned char* dst, size_t bytes, unsigned elementSize,
+      std::vector<unsigned char>& scratch);
+
+} // namespace codec
+} // namespace mm
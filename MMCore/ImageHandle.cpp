@@ -0,0 +1,56 @@
+#include "ImageHandle.h"
+
+#include "FrameBuffer.h"
+
+#include <utility>
+
+ImageHandle::ImageHandle()
+{
+}
+
+ImageHandle::ImageHandle(std::shared_ptr<const mm::ImgBuffer> image) :
+   image_(std::move(image))
+{
+}
+
+bool
+ImageHandle::isValid() const
+{
+   return static_cast<bool>(image_);
+}
+
+void
+ImageHandle::release()
+{
+   image_.reset();
+}
+
+const void*
+ImageHandle::getPixels() const
+{
+   return image_ ? image_->GetPixels() : 0;
+}
+
+unsigned
+ImageHandle::getWidth() const
+{
+   return image_ ? image_->Width() : 0;
+}
+
+unsigned
+ImageHandle::getHeight() const
+{
+   return image_ ? image_->Height() : 0;
+}
+
+unsigned
+ImageHandle::getBytesPerPixel() const
+{
+   return image_ ? image_->Depth() : 0;
+}
+
+Metadata
+ImageHandle::getMetadata() const
+{
+   return image_ ? image_->GetMetadata() : Metadata();
+}
@@ -0,0 +1,45 @@
+// A pinned, read-only view of an image in a sequence buffer.
+//
+// The pixels are not copied out of the buffer. Instead, the image's slot is
+// pinned for as long as the handle, or any copy of it, exists: the camera
+// does not overwrite the pixels meanwhile (see
+// CMMCore::setBlockOnPinnedImages() for what it does instead). Copies of a
+// handle share the same pin, and may be passed to and released on any thread.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <memory>
+
+namespace mm
+{
+class ImgBuffer;
+} // namespace mm
+
+class CMMCore;
+
+class ImageHandle
+{
+public:
+   /// Creates an invalid handle.
+   ImageHandle();
+
+   /// Whether the handle refers to an image (i.e. has not been released).
+   bool isValid() const;
+   /// Unpins the image. The handle becomes invalid.
+   void release();
+
+   /// Returns the pixels, or null if the handle is invalid.
+   const void* getPixels() const;
+   unsigned getWidth() const;
+   unsigned getHeight() const;
+   unsigned getBytesPerPixel() const;
+   Metadata getMetadata() const;
+
+private:
+   friend class CMMCore;
+   explicit ImageHandle(std::shared_ptr<const mm::ImgBuffer> image);
+
+   std::shared_ptr<const mm::ImgBuffer> image_;
+};
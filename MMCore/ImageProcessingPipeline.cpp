@@ -0,0 +1,282 @@
+#include "ImageProcessingPipeline.h"
+
+#include "../MMDevice/MMDevice.h"
+#include "PerformanceMetrics.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace mm
+{
+
+namespace
+{
+
+double
+Seconds(std::chrono::steady_clock::duration d)
+{
+   return std::chrono::duration<double>(d).count();
+}
+
+} // anonymous namespace
+
+ImageProcessingPipeline::ImageProcessingPipeline(CommitFunction commit,
+      std::shared_ptr<metrics::CoreMetrics> metrics) :
+   commit_(std::move(commit)),
+   metrics_(std::move(metrics))
+{
+}
+
+ImageProcessingPipeline::~ImageProcessingPipeline()
+{
+   Stop();
+}
+
+void
+ImageProcessingPipeline::Start(unsigned workerThreads,
+      unsigned maxFramesInFlight, unsigned tilesPerImage)
+{
+   std::lock_guard<std::mutex> control(controlMutex_);
+   StopWorkers();
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   maxFramesInFlight_ = (std::max)(maxFramesInFlight, 1u);
+   tilesPerImage_ = (std::max)(tilesPerImage, 1u);
+   for (unsigned i = 0; i < (std::max)(workerThreads, 1u); ++i)
+      workers_.emplace_back(&ImageProcessingPipeline::WorkerLoop, this);
+   running_ = true;
+}
+
+void
+ImageProcessingPipeline::Stop()
+{
+   std::lock_guard<std::mutex> control(controlMutex_);
+   StopWorkers();
+}
+
+void
+ImageProcessingPipeline::StopWorkers()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!running_)
+         return;
+      running_ = false;
+   }
+
+   // Submissions that passed the running check before this point still
+   // complete
+   Flush();
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+   }
+   workAvailable_.notify_all();
+   for (std::thread& worker : workers_)
+      worker.join();
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   workers_.clear();
+   spareBuffers_.clear();
+   accumulating_.clear();
+   stopping_ = false;
+}
+
+bool
+ImageProcessingPipeline::IsRunning() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return running_;
+}
+
+bool
+ImageProcessingPipeline::Submit(const MM::Device* camera,
+      MM::ImageProcessor* processor, const unsigned char* pixels,
+      unsigned numChannels, unsigned width, unsigned height,
+      unsigned byteDepth, unsigned nComponents, const Metadata& metadata)
+{
+   std::unique_ptr<Stage> stage(new Stage);
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!running_)
+         return false;
+
+      if (framesInFlight_ >= maxFramesInFlight_)
+      {
+         const Clock::time_point start = Clock::now();
+         progress_.wait(lock, [&] {
+            return framesInFlight_ < maxFramesInFlight_;
+         });
+         metrics_->pipelineStallSeconds->Observe(
+               Seconds(Clock::now() - start));
+      }
+      ++framesInFlight_;
+      UpdateDepthGauge();
+      if (!spareBuffers_.empty())
+      {
+         stage->frame.pixels.swap(spareBuffers_.back());
+         spareBuffers_.pop_back();
+      }
+   }
+
+   // Copy outside the lock; the slot is reserved
+   Frame& frame = stage->frame;
+   frame.camera = camera;
+   frame.processor = processor;
+   frame.numChannels = numChannels;
+   frame.width = width;
+   frame.height = height;
+   frame.byteDepth = byteDepth;
+   frame.nComponents = nComponents;
+   frame.metadata = metadata;
+   frame.pixels.assign(pixels,
+         pixels + std::size_t(numChannels) * width * height * byteDepth);
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stage->tiles = (std::max)(1u, (std::min)(tilesPerImage_, height));
+      stage->tilesLeft = stage->tiles;
+      stage->staged = Clock::now();
+      stages_.push_back(std::move(stage));
+   }
+   workAvailable_.notify_all();
+   return true;
+}
+
+void
+ImageProcessingPipeline::Flush()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   progress_.wait(lock, [&] {
+      return framesInFlight_ == 0 && !committing_;
+   });
+}
+
+std::size_t
+ImageProcessingPipeline::GetFramesInFlight() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return framesInFlight_;
+}
+
+void
+ImageProcessingPipeline::WorkerLoop()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   for (;;)
+   {
+      unsigned tile = 0;
+      Stage* stage = NextWork(tile);
+      if (!stage)
+      {
+         if (stopping_)
+            return;
+         workAvailable_.wait(lock);
+         continue;
+      }
+      if (tile == 0)
+         metrics_->pipelineQueueSeconds->Observe(
+               Seconds(Clock::now() - stage->staged));
+
+      // The stage stays in stages_ (and thus alive) until all of its tiles
+      // are done
+      lock.unlock();
+      const int ret = ProcessTile(*stage, tile);
+      lock.lock();
+
+      if (ret == DEVICE_IMAGE_CONSUMED)
+      {
+         stage->consumed = true;
+         accumulating_.insert(stage->frame.processor);
+      }
+      if (--stage->tilesLeft == 0)
+      {
+         stage->processed = true;
+         stage->done = Clock::now();
+         CommitProcessed(lock);
+      }
+   }
+}
+
+// Returns the oldest stage with a tile not yet taken by a worker, or null.
+// Images for an accumulating processor are taken whole, and only once all
+// earlier images are processed; the worker that completes the last of those
+// picks it up.
+ImageProcessingPipeline::Stage*
+ImageProcessingPipeline::NextWork(unsigned& tile)
+{
+   bool earlierPending = false;
+   for (const std::unique_ptr<Stage>& stage : stages_)
+   {
+      if (stage->nextTile == 0 &&
+            accumulating_.count(stage->frame.processor) != 0)
+      {
+         stage->serial = true;
+         stage->tiles = 1;
+         stage->tilesLeft = 1;
+      }
+      if (stage->nextTile < stage->tiles &&
+            !(stage->serial && earlierPending))
+      {
+         tile = stage->nextTile++;
+         return stage.get();
+      }
+      if (!stage->processed)
+         earlierPending = true;
+   }
+   return nullptr;
+}
+
+int
+ImageProcessingPipeline::ProcessTile(Stage& stage, unsigned tile)
+{
+   metrics::ScopedTimer timer(metrics_->pipelineProcessSeconds.get());
+   Frame& frame = stage.frame;
+   const unsigned firstRow = static_cast<unsigned>(
+         std::size_t(frame.height) * tile / stage.tiles);
+   const unsigned endRow = static_cast<unsigned>(
+         std::size_t(frame.height) * (tile + 1) / stage.tiles);
+   const std::size_t rowBytes = std::size_t(frame.width) * frame.byteDepth;
+   return frame.processor->Process(frame.pixels.data() + firstRow * rowBytes,
+         frame.width, endRow - firstRow, frame.byteDepth);
+}
+
+// Commits the processed stages at the front of the ring, unless another
+// thread is already doing so (it will pick up any that become ready)
+void
+ImageProcessingPipeline::CommitProcessed(std::unique_lock<std::mutex>& lock)
+{
+   if (committing_)
+      return;
+   committing_ = true;
+   while (!stages_.empty() && stages_.front()->processed)
+   {
+      std::unique_ptr<Stage> stage = std::move(stages_.front());
+      stages_.pop_front();
+
+      lock.unlock();
+      metrics_->pipelineReorderSeconds->Observe(
+            Seconds(Clock::now() - stage->done));
+      if (!stage->consumed)
+         commit_(stage->frame);
+      lock.lock();
+
+      --framesInFlight_;
+      UpdateDepthGauge();
+      if (spareBuffers_.size() < maxFramesInFlight_)
+         spareBuffers_.push_back(std::move(stage->frame.pixels));
+      progress_.notify_all();
+   }
+   committing_ = false;
+   progress_.notify_all();
+}
+
+void
+ImageProcessingPipeline::UpdateDepthGauge()
+{
+   metrics_->pipelineFramesInFlight->Set(
+         static_cast<double>(framesInFlight_));
+}
+
+} // namespace mm
@@ -0,0 +1,144 @@
+// Asynchronous image processing for images inserted by cameras.
+//
+// When running, images that have an image processor are copied into a
+// bounded staging ring and returned to the camera immediately. Worker threads
+// run the processor, on several images in parallel, and optionally on
+// horizontal strips ("tiles") of each image in parallel. Processed images are
+// committed (inserted into the sequence buffer) strictly in submission order.
+//
+// Processing several images or tiles at once requires the processor to be
+// reentrant; with a single worker and a single tile, the processor is called
+// exactly as on the camera thread, only later. A tile is passed to the
+// processor as an image of its own, so tiles must only be used with
+// processors that treat every pixel alike, regardless of its neighbors and
+// position. Images for which the processor returns DEVICE_IMAGE_CONSUMED are
+// dropped instead of committed. Processors that accumulate images this way
+// depend on seeing whole images, one at a time and in order: once a processor
+// has returned DEVICE_IMAGE_CONSUMED, its later images are processed whole, by
+// one worker at a time, each after all earlier images are processed. The
+// images processed before that are not protected, so such processors should
+// still be run with one worker and one tile.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace MM
+{
+   class Device;
+   class ImageProcessor;
+} // namespace MM
+
+namespace mm
+{
+
+namespace metrics
+{
+   class CoreMetrics;
+} // namespace metrics
+
+class ImageProcessingPipeline
+{
+public:
+   struct Frame
+   {
+      const MM::Device* camera = nullptr;
+      MM::ImageProcessor* processor = nullptr;
+      std::vector<unsigned char> pixels; // All channels
+      unsigned numChannels = 0;
+      unsigned width = 0;
+      unsigned height = 0;
+      unsigned byteDepth = 0;
+      unsigned nComponents = 0;
+      Metadata metadata;
+   };
+
+   // Called on a worker thread, for one frame at a time, in order; must not
+   // throw
+   typedef std::function<void(const Frame&)> CommitFunction;
+
+   ImageProcessingPipeline(CommitFunction commit,
+         std::shared_ptr<metrics::CoreMetrics> metrics);
+   ~ImageProcessingPipeline(); // Stops
+
+   ImageProcessingPipeline(const ImageProcessingPipeline&) = delete;
+   ImageProcessingPipeline& operator=(const ImageProcessingPipeline&) = delete;
+
+   // All arguments must be positive. Restarts if already running.
+   void Start(unsigned workerThreads, unsigned maxFramesInFlight,
+         unsigned tilesPerImage);
+   // Commits the images in flight, then stops the workers
+   void Stop();
+   bool IsRunning() const;
+
+   // Copies the image (numChannels consecutive images) and queues it for
+   // processing, waiting while maxFramesInFlight images are in flight.
+   // Returns false, without copying, if not running. Only the first channel
+   // is processed, as when processing on the camera thread.
+   bool Submit(const MM::Device* camera, MM::ImageProcessor* processor,
+         const unsigned char* pixels, unsigned numChannels, unsigned width,
+         unsigned height, unsigned byteDepth, unsigned nComponents,
+         const Metadata& metadata);
+
+   // Waits until every image submitted so far has been committed
+   void Flush();
+
+   // Images submitted but not yet committed
+   std::size_t GetFramesInFlight() const;
+
+private:
+   typedef std::chrono::steady_clock Clock;
+
+   struct Stage
+   {
+      Frame frame;
+      unsigned tiles = 1;
+      unsigned nextTile = 0;
+      unsigned tilesLeft = 1;
+      bool processed = false;
+      bool consumed = false; // The processor absorbed the image
+      bool serial = false; // Processed whole, alone and in order
+      Clock::time_point staged;
+      Clock::time_point done;
+   };
+
+   void StopWorkers();
+   void WorkerLoop();
+   Stage* NextWork(unsigned& tile);
+   int ProcessTile(Stage& stage, unsigned tile);
+   void CommitProcessed(std::unique_lock<std::mutex>& lock);
+   void UpdateDepthGauge();
+
+   const CommitFunction commit_;
+   const std::shared_ptr<metrics::CoreMetrics> metrics_;
+
+   std::mutex controlMutex_; // Serializes Start() and Stop()
+
+   mutable std::mutex mutex_;
+   std::condition_variable workAvailable_;
+   std::condition_variable progress_; // Room in the ring, or a commit
+   bool running_ = false;
+   bool stopping_ = false;
+   unsigned maxFramesInFlight_ = 0;
+   unsigned tilesPerImage_ = 1;
+   std::size_t framesInFlight_ = 0; // From reserving a slot to commit
+   bool committing_ = false; // Only one thread commits at a time
+   std::deque<std::unique_ptr<Stage>> stages_; // In submission order
+   // Processors that have returned DEVICE_IMAGE_CONSUMED since Start()
+   std::set<const MM::ImageProcessor*> accumulating_;
+   std::vector<std::vector<unsigned char>> spareBuffers_;
+   std::vector<std::thread> workers_;
+};
+
+} // namespace mm
@@ -42,6 +42,8 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "AsyncOperations.h"
+#include "CameraBufferLanes.h"
 #include "CircularBuffer.h"
 #include "ConfigGroup.h"
 #include "Configuration.h"
@@ -50,10 +52,17 @@
 #include "CoreUtils.h"
 #include "DeviceManager.h"
 #include "Devices/DeviceInstances.h"
+#include "EventDispatcher.h"
+#include "ImageProcessingPipeline.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
+#include "PerformanceMetrics.h"
 #include "PluginManager.h"
+#include "PreviewTap.h"
+#include "PropertyConfigIndex.h"
+#include "StateCache.h"
+#include "Tracing.h"
 
 #include <algorithm>
 #include <cassert>
@@ -101,7 +110,24 @@ using namespace std;
  * (Keep the 3 numbers on one line to make it easier to look at diffs when
  * merging/rebasing.)
  */
-const int MMCore_versionMajor = 11, MMCore_versionMinor = 0, MMCore_versionPatch = 0;
+const int MMCore_versionMajor = 11, MMCore_versionMinor = 12, MMCore_versionPatch = 0;
+
+
+namespace mm {
+
+// A resolved typed property handle (see CMMCore::getPropertyHandle()).
+// Immutable once created.
+struct PropertyHandle
+{
+   std::weak_ptr<DeviceInstance> device;
+   std::string label;
+   std::string propName;
+   long deviceHandle; // The handle used by the device itself
+   StateCache::KeyId cacheKey;
+   bool preInit;
+};
+
+} // namespace mm
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -117,6 +143,8 @@ CMMCore::CMMCore() :
    logManager_(new mm::LogManager()),
    appLogger_(logManager_->NewLogger("App")),
    coreLogger_(logManager_->NewLogger("Core")),
+   metrics_(std::make_shared<mm::metrics::CoreMetrics>()),
+   eventDispatcher_(new mm::EventDispatcher(metrics_)),
    everSnapped_(false),
    pollingIntervalMs_(10),
    timeoutMs_(5000),
@@ -127,17 +155,31 @@ CMMCore::CMMCore() :
    externalCallback_(0),
    pixelSizeGroup_(0),
    cbuf_(0),
+   blockOnPinnedImages_(false),
+   compressCircularBuffer_(false),
+   cameraBufferLanes_(new mm::CameraBufferLanes()),
+   previewTap_(new mm::PreviewTap()),
    pluginManager_(new CPluginManager()),
    deviceManager_(new mm::DeviceManager()),
+   stateCache_(new mm::StateCache()),
+   asyncOperations_(new mm::AsyncOperations(
+            std::chrono::milliseconds(pollingIntervalMs_))),
    pPostedErrorsLock_(NULL)
 {
    configGroups_ = new ConfigGroupCollection();
    pixelSizeGroup_ = new PixelSizeConfigGroup();
+   propertyConfigIndex_.reset(new mm::PropertyConfigIndex(*configGroups_,
+            *pixelSizeGroup_));
    pPostedErrorsLock_ = new MMThreadLock();
 
    InitializeErrorMessages();
 
    callback_ = new CoreCallback(this);
+   processingPipeline_.reset(new mm::ImageProcessingPipeline(
+            [this](const mm::ImageProcessingPipeline::Frame& frame) {
+               static_cast<CoreCallback*>(callback_)->
+                  InsertProcessedImage(frame);
+            }, metrics_));
 
    const unsigned seqBufMegabytes = (sizeof(void*) > 4) ? 250 : 25;
    cbuf_ = new CircularBuffer(seqBufMegabytes);
@@ -156,6 +198,10 @@ CMMCore::CMMCore() :
  */
 CMMCore::~CMMCore()
 {
+   metricsExporter_.reset();
+   asyncOperations_.reset();
+   processingPipeline_->Stop();
+
    try
    {
       // TODO We should attempt to continue cleanup beyond the first device
@@ -168,6 +214,7 @@ CMMCore::~CMMCore()
    }
 
    delete callback_;
+   propertyConfigIndex_.reset();
    delete configGroups_;
    delete properties_;
    delete cbuf_;
@@ -297,6 +344,146 @@ void CMMCore::stopSecondaryLogFile(int handle) throw (CMMError)
    logManager_->RemoveSecondaryLogFile(h);
 }
 
+/**
+ * Returns the Core's performance metrics in the Prometheus text exposition
+ * format (version 0.0.4).
+ *
+ * Metrics include image insertion counts and latency, sequence buffer fill
+ * level, and per-device property access latency, waitForDevice() durations,
+ * and time spent waiting for device adapter module locks. Durations are in
+ * seconds. Values accumulate from startup or the last call to
+ * resetPerformanceMetrics().
+ */
+std::string CMMCore::getPerformanceMetrics()
+{
+   // The buffer gauges are otherwise only updated when images are inserted
+   if (cbuf_)
+   {
+      metrics_->bufferImages->Set(
+            static_cast<double>(cbuf_->GetRemainingImageCount()));
+      metrics_->bufferCapacityImages->Set(
+            static_cast<double>(cbuf_->GetSize()));
+      metrics_->bufferCompressionRatio->Set(cbuf_->GetCompressionRatio());
+   }
+   return metrics_->GetRegistry().RenderText();
+}
+
+/**
+ * Clears all accumulated performance metrics.
+ */
+void CMMCore::resetPerformanceMetrics()
+{
+   metrics_->GetRegistry().ResetAll();
+}
+
+/**
+ * Periodically write the performance metrics to a file.
+ *
+ * The file contains the same text as returned by getPerformanceMetrics() and
+ * is replaced atomically, so it can be collected by e.g. the textfile
+ * collector of the Prometheus node exporter. Any previously started export is
+ * stopped.
+ *
+ * @param filename The file to write to; a temporary file with ".tmp" appended
+ * is created in the same directory.
+ * @param intervalMs The interval between updates.
+ */
+void CMMCore::startPerformanceMetricsExport(const char* filename,
+      double intervalMs) throw (CMMError)
+{
+   if (!filename || !*filename)
+      throw CMMError("Null or empty filename");
+   if (!(intervalMs >= 1.0))
+      throw CMMError("Metrics export interval must be at least 1 ms");
+
+   metricsExporter_.reset();
+   metricsExporter_.reset(new mm::metrics::TextFileExporter(filename,
+            std::chrono::milliseconds(static_cast<long long>(intervalMs)),
+            [this]() { return metrics_->GetRegistry().RenderText(); }));
+   LOG_INFO(coreLogger_) << "Exporting performance metrics to " << filename <<
+      " every " << intervalMs << " ms";
+}
+
+/**
+ * Stop writing performance metrics to a file.
+ *
+ * The last written file is left in place.
+ */
+void CMMCore::stopPerformanceMetricsExport()
+{
+   if (!metricsExporter_)
+      return;
+   metricsExporter_.reset();
+   LOG_INFO(coreLogger_) << "Stopped exporting performance metrics";
+}
+
+/**
+ * Start recording a trace of device calls, with the default limit of 32768
+ * spans per thread.
+ *
+ * See startTrace(long).
+ */
+void CMMCore::startTrace() throw (CMMError)
+{
+   startTrace(32768);
+}
+
+/**
+ * Start recording a trace of device calls.
+ *
+ * Each call into a device adapter, wait for a device adapter module lock,
+ * callback from a device, and sequence buffer insert or pop is recorded as a
+ * span with its thread, start time, duration, and (where applicable) device
+ * label. Only the most recent spans of each thread are kept.
+ *
+ * Tracing is process-wide: it covers all instances of CMMCore, and starting
+ * a trace discards any previously recorded one.
+ *
+ * @param maxEventsPerThread The number of spans to keep for each thread,
+ *        from 1 to 1048576. Each span takes about 80 bytes, allocated when
+ *        the thread records its first span.
+ */
+void CMMCore::startTrace(long maxEventsPerThread) throw (CMMError)
+{
+   if (maxEventsPerThread < 1)
+      throw CMMError("Trace must hold at least one event per thread");
+   if (static_cast<unsigned long>(maxEventsPerThread) >
+         mm::tracing::MaxEventsPerThread)
+      throw CMMError("Trace cannot hold more than " +
+            ToString(mm::tracing::MaxEventsPerThread) + " events per thread");
+   mm::tracing::Start(static_cast<std::size_t>(maxEventsPerThread));
+   LOG_INFO(coreLogger_) << "Started tracing (" << maxEventsPerThread <<
+      " events per thread)";
+}
+
+/**
+ * Stop recording the trace and save it to a file.
+ *
+ * The file is in the Chrome trace event JSON format, which can be viewed in
+ * chrome://tracing or Perfetto (ui.perfetto.dev). Times are in microseconds
+ * from the start of the trace.
+ *
+ * @param filename The file to write to. It is overwritten if it exists.
+ */
+void CMMCore::stopTrace(const char* filename) throw (CMMError)
+{
+   if (!filename || !*filename)
+      throw CMMError("Null or empty filename");
+   if (!mm::tracing::IsEnabled())
+      throw CMMError("Tracing is not running");
+   mm::tracing::Stop();
+
+   std::ofstream out(filename);
+   if (!out)
+      throw CMMError("Cannot open trace file " + ToQuotedString(filename));
+   const std::size_t spans = mm::tracing::WriteChromeTrace(out);
+   out.close();
+   if (!out)
+      throw CMMError("Cannot write trace file " + ToQuotedString(filename));
+   LOG_INFO(coreLogger_) << "Stopped tracing; wrote " << spans <<
+      " spans to " << filename;
+}
+
 /**
  * Displays core version.
  */
@@ -440,8 +627,7 @@ Configuration CMMCore::getSystemState()
  */
 Configuration CMMCore::getSystemStateCache() const
 {
-   MMThreadGuard scg(stateCacheLock_);
-   return stateCache_;
+   return stateCache_->GetSnapshot();
 }
 
 /**
@@ -633,6 +819,8 @@ void CMMCore::loadDevice(const char* label, const char* moduleName, const char*
          deviceManager_->LoadDevice(module, deviceName, label, this,
                deviceLogger, coreLogger);
       pDevice->SetCallback(callback_);
+      metrics_->RemoveDeviceMetrics(label); // Don't inherit stale data
+      pDevice->SetMetrics(metrics_->CreateDeviceMetrics(label));
    }
    catch (const CMMError& e)
    {
@@ -705,10 +893,15 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
 {
    std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
+   // Images in flight may refer to the device (as camera or processor)
+   processingPipeline_->Flush();
+
    try {
       mm::DeviceModuleLockGuard guard(pDevice);
       LOG_DEBUG(coreLogger_) << "Will unload device " << label;
       deviceManager_->UnloadDevice(pDevice);
+      metrics_->RemoveDeviceMetrics(label);
+      cameraBufferLanes_->Remove(label);
       LOG_DEBUG(coreLogger_) << "Did unload device " << label;
    }
    catch (CMMError& err) {
@@ -741,7 +934,14 @@ void CMMCore::unloadAllDevices() throw (CMMError)
       }
 
       LOG_DEBUG(coreLogger_) << "Will unload all devices";
+      processingPipeline_->Flush();
+      std::vector<std::string> labels = deviceManager_->GetDeviceList();
       deviceManager_->UnloadAllDevices();
+      for (const std::string& label : labels)
+         metrics_->RemoveDeviceMetrics(label);
+      cameraBufferLanes_->Clear();
+      if (asyncOperations_) // Already stopped when called from the destructor
+         asyncOperations_->Clear();
       LOG_INFO(coreLogger_) << "Did unload all devices";
 
 	   properties_->Refresh();
@@ -901,11 +1101,7 @@ CMMCore::getDeviceInitializationState(const char* label) const throw (CMMError)
 void CMMCore::updateSystemStateCache()
 {
    LOG_DEBUG(coreLogger_) << "Will update system state cache";
-   Configuration wk = getSystemState();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_ = wk;
-   }
+   stateCache_->Replace(getSystemState());
    LOG_INFO(coreLogger_) << "Did update system state cache";
 }
 
@@ -1130,6 +1326,34 @@ void CMMCore::waitForDevice(const char* label) throw (CMMError)
 }
 
 
+// Throws if the handle is invalid or its device has been unloaded
+std::shared_ptr<const mm::PropertyHandle>
+CMMCore::lookupPropertyHandle(long handle,
+      std::shared_ptr<DeviceInstance>& pDevice) const throw (CMMError)
+{
+   std::shared_ptr<const mm::PropertyHandle> h;
+   {
+      MMThreadGuard g(propertyHandlesLock_);
+      if (handle >= 0 && handle < static_cast<long>(propertyHandles_.size()))
+         h = propertyHandles_[handle];
+   }
+   if (!h)
+      throw CMMError(getCoreErrorText(MMERR_InvalidPropertyHandle),
+            MMERR_InvalidPropertyHandle);
+   pDevice = h->device.lock();
+   if (!pDevice)
+      throw CMMError(getCoreErrorText(MMERR_InvalidPropertyHandle) +
+            " (device " + ToQuotedString(h->label) + " has been unloaded)",
+            MMERR_InvalidPropertyHandle);
+   return h;
+}
+
+void CMMCore::cacheTypedPropertyValue(const mm::PropertyHandle& handle,
+      const std::string& value)
+{
+   stateCache_->Set(handle.cacheKey, value);
+}
+
 /**
  * Waits (blocks the calling thread) until the specified device becomes
  * @param device   the device label
@@ -1138,6 +1362,9 @@ void CMMCore::waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMErro
 {
    LOG_DEBUG(coreLogger_) << "Waiting for device " << pDev->GetLabel() << "...";
 
+   mm::metrics::ScopedTimer timer(pDev->GetMetrics() ?
+         pDev->GetMetrics()->waitForDeviceSeconds.get() : nullptr);
+
    auto now = std::chrono::steady_clock::now();
    auto timeout = std::chrono::duration<long long, std::milli>(timeoutMs_);
    auto deadline = now + timeout;
@@ -1168,6 +1395,94 @@ void CMMCore::waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMErro
    LOG_DEBUG(coreLogger_) << "Finished waiting for device " << pDev->GetLabel();
 }
 
+// Returns a handle for waiting until the device becomes non-busy
+long CMMCore::addAsyncDeviceWait(std::shared_ptr<DeviceInstance> pDev)
+{
+   const std::string label = pDev->GetLabel();
+   std::weak_ptr<DeviceInstance> weakDev = pDev;
+   return asyncOperations_->Add(label, [weakDev, label]() {
+      std::shared_ptr<DeviceInstance> dev = weakDev.lock();
+      if (!dev)
+         throw CMMError("Device " + ToQuotedString(label) +
+               " was unloaded during an asynchronous operation");
+      mm::DeviceModuleLockGuard guard(dev);
+      return dev->Busy();
+   });
+}
+
+/**
+ * Checks whether an asynchronous operation, such as a stage move started with
+ * setPositionAsync() or setXYPositionAsync(), has finished. Does not block.
+ *
+ * Once this has returned true (or thrown the operation's failure), the handle
+ * is released and can no longer be used, as after waitForAll(). All handles
+ * are also released by unloadAllDevices().
+ *
+ * @param handle   a handle returned by one of the asynchronous functions
+ * @return true if the device is no longer busy
+ * @throws CMMError if the handle is invalid or checking whether the device is
+ * busy failed
+ */
+bool CMMCore::isAsyncOperationComplete(long handle) throw (CMMError)
+{
+   return asyncOperations_->IsComplete(handle);
+}
+
+/**
+ * Waits (blocks the calling thread) until all of the given asynchronous
+ * operations have finished, or until the Core timeout (see setTimeoutMs())
+ * elapses.
+ *
+ * The operations proceed in parallel; the Core polls the devices
+ * involved on a background thread. Once the operations have finished, their
+ * handles are released and can no longer be used.
+ *
+ * @param handles   handles returned by the asynchronous functions
+ * @throws CMMError if the wait times out, a handle is invalid, or checking
+ * whether a device is busy failed (in which case all handles are released)
+ */
+void CMMCore::waitForAll(const std::vector<long>& handles) throw (CMMError)
+{
+   if (waitForAll(handles, static_cast<double>(timeoutMs_)))
+      return;
+
+   std::vector<std::string> pending = asyncOperations_->GetPending(handles);
+   std::string labels;
+   for (size_t i = 0; i < pending.size(); ++i)
+      labels += (i > 0 ? ", " : "") + ToQuotedString(pending[i]);
+   logError("waitForAll", ("wait timed out after " + ToString(timeoutMs_) +
+            " ms for " + labels).c_str());
+   throw CMMError("Wait for devices " + labels + " timed out after " +
+         ToString(timeoutMs_) + "ms", MMERR_DevicePollingTimeout);
+}
+
+/**
+ * Waits (blocks the calling thread) until all of the given asynchronous
+ * operations have finished, or until the timeout elapses.
+ *
+ * If the operations finish, their handles are released and can no longer be
+ * used. After a timeout the handles remain valid and can be waited on again.
+ *
+ * @param handles   handles returned by the asynchronous functions
+ * @param timeoutMs   the maximum time to wait, in milliseconds
+ * @return false if the timeout elapsed before all operations finished
+ * @throws CMMError if a handle is invalid or checking whether a device is
+ * busy failed (in which case all handles are released)
+ */
+bool CMMCore::waitForAll(const std::vector<long>& handles,
+      double timeoutMs) throw (CMMError)
+{
+   if (!(timeoutMs >= 0.0))
+      throw CMMError("Timeout must not be negative");
+   LOG_DEBUG(coreLogger_) << "Waiting for " << handles.size() <<
+      " asynchronous operations...";
+   const bool finished = asyncOperations_->WaitForAll(handles,
+         std::chrono::milliseconds(static_cast<long long>(timeoutMs + 0.5)));
+   LOG_DEBUG(coreLogger_) << (finished ? "Finished" : "Timed out") <<
+      " waiting for asynchronous operations";
+   return finished;
+}
+
 /**
  * Checks the busy status of the entire system. The system will report busy if any
  * of the devices is busy.
@@ -1279,6 +1594,35 @@ void CMMCore::setPosition(double position) throw (CMMError)
     setPosition(getFocusDevice().c_str(), position);
 }
 
+/**
+ * Starts moving the stage to a position in microns and returns without
+ * waiting for the move to finish.
+ *
+ * The returned handle can be passed to waitForAll(), together with handles
+ * for other moves, to wait until all of the devices have stopped.
+ *
+ * @param label     the stage device label
+ * @param position  the desired stage position, in microns
+ * @return a handle for the move
+ */
+long CMMCore::setPositionAsync(const char* label, double position) throw (CMMError)
+{
+   setPosition(label, position);
+   return addAsyncDeviceWait(deviceManager_->GetDeviceOfType<StageInstance>(label));
+}
+
+/**
+ * Starts moving the current Z positioner (focus) device to a position in
+ * microns and returns without waiting for the move to finish.
+ *
+ * @param position  the desired stage position, in microns
+ * @return a handle for the move; see setPositionAsync(const char*, double)
+ */
+long CMMCore::setPositionAsync(double position) throw (CMMError)
+{
+   return setPositionAsync(getFocusDevice().c_str(), position);
+}
+
 /**
  * Sets the relative position of the stage in microns.
  * @param label    the single-axis drive device label
@@ -1378,6 +1722,38 @@ void CMMCore::setXYPosition(double x, double y) throw (CMMError)
     setXYPosition(getXYStageDevice().c_str(), x, y);
 }
 
+/**
+ * Starts moving the XY stage to a position in microns and returns without
+ * waiting for the move to finish.
+ *
+ * The returned handle can be passed to waitForAll(), together with handles
+ * for other moves, to wait until all of the devices have stopped.
+ *
+ * @param label  the XY stage device label
+ * @param x      the X axis position in microns
+ * @param y      the Y axis position in microns
+ * @return a handle for the move
+ */
+long CMMCore::setXYPositionAsync(const char* label, double x, double y) throw (CMMError)
+{
+   setXYPosition(label, x, y);
+   return addAsyncDeviceWait(
+         deviceManager_->GetDeviceOfType<XYStageInstance>(label));
+}
+
+/**
+ * Starts moving the current XY stage device to a position in microns and
+ * returns without waiting for the move to finish.
+ *
+ * @param x      the X axis position in microns
+ * @param y      the Y axis position in microns
+ * @return a handle for the move; see setXYPositionAsync(const char*, double, double)
+ */
+long CMMCore::setXYPositionAsync(double x, double y) throw (CMMError)
+{
+   return setXYPositionAsync(getXYStageDevice().c_str(), x, y);
+}
+
 /**
  * Sets the relative position of the XY stage in microns.
  * @param label  the xy stage device label
@@ -2365,10 +2741,7 @@ void CMMCore::setAutoShutter(bool state)
 {
    properties_->Set(MM::g_Keyword_CoreAutoShutter, state ? "1" : "0");
    autoShutter_ = state;
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0");
    LOG_DEBUG(coreLogger_) << "Autoshutter turned " << (state ? "on" : "off");
 }
 
@@ -2400,10 +2773,7 @@ void CMMCore::setShutterOpen(const char* shutterLabel, bool state) throw (CMMErr
 
       if (pShutter->HasProperty(MM::g_Keyword_State))
       {
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
-         }
+         stateCache_->Set(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state));
       }
    }
 }
@@ -2507,7 +2877,12 @@ void* CMMCore::getImage() throw (CMMError)
             currentImageProcessor_.lock();
          if (imageProcessor)
 	      {
-            imageProcessor->Process((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
+            int ret = imageProcessor->ProcessSnap((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
+            // Returning the unprocessed image instead would go unnoticed
+            if (ret == DEVICE_IMAGE_CONSUMED)
+               throw CMMError("Image processor " +
+                     ToQuotedString(imageProcessor->GetLabel()) +
+                     " did not return the snapped image", MMERR_DEVICE_GENERIC);
 	      }
 		} catch( CMMError& e){
 			throw e;
@@ -2554,7 +2929,12 @@ void* CMMCore::getImage(unsigned channelNr) throw (CMMError)
             currentImageProcessor_.lock();
          if (imageProcessor)
 	      {
-            imageProcessor->Process((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
+            int ret = imageProcessor->ProcessSnap((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
+            // Returning the unprocessed image instead would go unnoticed
+            if (ret == DEVICE_IMAGE_CONSUMED)
+               throw CMMError("Image processor " +
+                     ToQuotedString(imageProcessor->GetLabel()) +
+                     " did not return the snapped image", MMERR_DEVICE_GENERIC);
 	      }
 		} catch( CMMError& e){
 			throw e;
@@ -2623,12 +3003,8 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
 
 		try
 		{
-			if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-			{
-				logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-			}
-			cbuf_->Clear();
+			initializeSequenceBuffer(camera);
+         notifySequenceStarting();
          mm::DeviceModuleLockGuard guard(camera);
 
          LOG_DEBUG(coreLogger_) << "Will start sequence acquisition from default camera";
@@ -2654,8 +3030,8 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
 /**
  * Starts streaming camera sequence acquisition for a specified camera.
  * This command does not block the calling thread for the duration of the acquisition.
- * The difference between this method and the one with the same name but operating on the "default"
- * camera is that it does not automatically initialize the circular buffer.
+ * Images go to the camera's buffer lane if it has one (see
+ * enableCameraBufferLane()), otherwise to the shared circular buffer.
  */
 void CMMCore::startSequenceAcquisition(const char* label, long numImages, double intervalMs, bool stopOnOverflow) throw (CMMError)
 {
@@ -2667,12 +3043,8 @@ void CMMCore::startSequenceAcquisition(const char* label, long numImages, double
       throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
                      MMERR_NotAllowedDuringSequenceAcquisition);
 
-   if (!cbuf_->Initialize(pCam->GetNumberOfChannels(), pCam->GetImageWidth(), pCam->GetImageHeight(), pCam->GetImageBytesPerPixel()))
-   {
-      logError(getDeviceName(pCam).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-      throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-   }
-   cbuf_->Clear();
+   initializeSequenceBuffer(pCam);
+   notifySequenceStarting();
 	
    LOG_DEBUG(coreLogger_) <<
       "Will start sequence acquisition from camera " << label;
@@ -2718,12 +3090,7 @@ void CMMCore::initializeCircularBuffer() throw (CMMError)
    if (camera)
    {
       mm::DeviceModuleLockGuard guard(camera);
-      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-      {
-         logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-      }
-      cbuf_->Clear();
+      initializeSequenceBuffer(camera);
    }
    else
    {
@@ -2732,6 +3099,34 @@ void CMMCore::initializeCircularBuffer() throw (CMMError)
    LOG_DEBUG(coreLogger_) << "Circular buffer initialized based on current camera";
 }
 
+namespace
+{
+
+// While a sequence is stopped, the camera's insert must not wait for pinned
+// images (see setBlockOnPinnedImages()), since stopping waits for the camera
+class PinnedSlotBlockingSuspension
+{
+public:
+   PinnedSlotBlockingSuspension(std::shared_ptr<CircularBuffer> lane,
+         CircularBuffer* buffer) :
+      lane_(lane),
+      buffer_(lane ? lane.get() : buffer)
+   {
+      buffer_->SuspendPinnedSlotBlocking();
+   }
+
+   ~PinnedSlotBlockingSuspension()
+   {
+      buffer_->ResumePinnedSlotBlocking();
+   }
+
+private:
+   std::shared_ptr<CircularBuffer> lane_;
+   CircularBuffer* buffer_;
+};
+
+} // anonymous namespace
+
 /**
  * Stops streaming camera sequence acquisition for a specified camera.
  * @param label   The camera name
@@ -2741,6 +3136,8 @@ void CMMCore::stopSequenceAcquisition(const char* label) throw (CMMError)
    std::shared_ptr<CameraInstance> pCam =
       deviceManager_->GetDeviceOfType<CameraInstance>(label);
 
+   PinnedSlotBlockingSuspension suspension(cameraBufferLanes_->Find(label),
+         cbuf_);
    mm::DeviceModuleLockGuard guard(pCam);
    LOG_DEBUG(coreLogger_) << "Will stop sequence acquisition from camera " << label;
    int nRet = pCam->StopSequenceAcquisition();
@@ -2751,6 +3148,7 @@ void CMMCore::stopSequenceAcquisition(const char* label) throw (CMMError)
    }
 
    LOG_DEBUG(coreLogger_) << "Did stop sequence acquisition from camera " << label;
+   processingPipeline_->Flush();
 }
 
 /**
@@ -2770,12 +3168,8 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
             ,MMERR_NotAllowedDuringSequenceAcquisition);
       }
 
-      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-      {
-         logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-      }
-      cbuf_->Clear();
+      initializeSequenceBuffer(camera);
+      notifySequenceStarting();
       LOG_DEBUG(coreLogger_) << "Will start continuous sequence acquisition from current camera";
       int nRet = camera->StartSequenceAcquisition(intervalMs);
       if (nRet != DEVICE_OK)
@@ -2795,6 +3189,9 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
 void CMMCore::stopSequenceAcquisition() throw (CMMError)
 {
    std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   PinnedSlotBlockingSuspension suspension(camera ?
+         cameraBufferLanes_->Find(camera->GetLabel()) :
+         std::shared_ptr<CircularBuffer>(), cbuf_);
    if (camera)
    {
       mm::DeviceModuleLockGuard guard(camera);
@@ -2813,6 +3210,7 @@ void CMMCore::stopSequenceAcquisition() throw (CMMError)
    }
 
    LOG_DEBUG(coreLogger_) << "Did stop sequence acquisition from current camera";
+   processingPipeline_->Flush();
 }
 
 /**
@@ -2981,128 +3379,844 @@ void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) th
 }
 
 /**
- * Gets and removes the next image (and metadata) from the circular buffer
+ * Gets and removes the next image (and metadata) from the circular buffer
+ */
+void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
+{
+   return popNextImageMD(0, 0, md);
+}
+
+/**
+ * Removes all images from the circular buffer.
+ *
+ * It is rarely necessary to call this directly since starting a sequence
+ * acquisition or changing the ROI will always clear the buffer.
+ */
+void CMMCore::clearCircularBuffer() throw (CMMError)
+{
+   cbuf_->Clear();
+}
+
+/**
+ * Reserve memory for the circular buffer.
+ */
+void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
+                                               ) throw (CMMError)
+{
+   delete cbuf_; // discard old buffer
+   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
+      sizeMB << " MB";
+	try
+	{
+		cbuf_ = new CircularBuffer(sizeMB);
+      cbuf_->SetPinnedSlotPolicy(blockOnPinnedImages_ ?
+            CircularBuffer::PinnedSlotBlock : CircularBuffer::PinnedSlotSkip);
+      cbuf_->SetCompression(compressCircularBuffer_);
+	}
+	catch(bad_alloc& ex)
+	{
+      // This is an out-of-memory error before even allocating the buffers.
+		ostringstream messs;
+		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+	}
+	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+
+
+	try
+	{
+
+		// attempt to initialize based on the current camera settings
+      std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+      if (camera)
+		{
+         mm::DeviceModuleLockGuard guard(camera);
+         if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+		}
+
+      LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
+         sizeMB << " MB";
+	}
+	catch(bad_alloc& ex)
+	{
+		ostringstream messs;
+		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+	}
+	if (NULL == cbuf_)
+      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+}
+
+/**
+ * Returns the size of the Circular Buffer in MB
+ */
+unsigned CMMCore::getCircularBufferMemoryFootprint()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetMemorySizeMB();
+   }
+   return 0;
+}
+
+/**
+ * Returns number ofimages available in the Circular Buffer
+ */
+long CMMCore::getRemainingImageCount()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetRemainingImageCount();
+   }
+   return 0;
+}
+
+/**
+ * Returns the total number of images that can be stored in the buffer
+ *
+ * With circular buffer compression, this is an estimate based on the
+ * compression ratio of the images inserted so far.
+ */
+long CMMCore::getBufferTotalCapacity()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetSize();
+   }
+   return 0;
+}
+
+
+/**
+ * Returns the number of images that can be added to the buffer
+ * without overflowing
+ */
+long CMMCore::getBufferFreeCapacity()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetFreeSize();
+   }
+   return 0;
+}
+
+/**
+ * Indicates whether the circular buffer is overflowed
+ */
+bool CMMCore::isBufferOverflowed() const
+{
+   return cbuf_->Overflow();
+}
+
+/**
+ * Gives a camera its own sequence buffer ("lane").
+ *
+ * Images from the camera then go to the lane instead of the shared circular
+ * buffer, and are retrieved with the variants of popNextImage(),
+ * getLastImage(), etc. that take the camera label. Each lane has its own image
+ * size, capacity and overflow state, and cameras inserting into different
+ * lanes do not wait for each other, so that cameras with different image
+ * sizes can run sequence acquisitions at the same time.
+ *
+ * The lane is sized for the camera's current settings and is reinitialized
+ * whenever a sequence acquisition is started. Any existing lane for the
+ * camera is replaced.
+ *
+ * @param cameraLabel   the camera label
+ * @param sizeMB        memory footprint of the lane in megabytes
+ */
+void CMMCore::enableCameraBufferLane(const char* cameraLabel, unsigned sizeMB)
+   throw (CMMError)
+{
+   std::shared_ptr<CameraInstance> camera =
+      deviceManager_->GetDeviceOfType<CameraInstance>(cameraLabel);
+
+   mm::DeviceModuleLockGuard guard(camera);
+   if (camera->IsCapturing())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+                     MMERR_NotAllowedDuringSequenceAcquisition);
+
+   std::shared_ptr<CircularBuffer> lane;
+   try
+   {
+      lane = std::make_shared<CircularBuffer>(sizeMB);
+      lane->SetPinnedSlotPolicy(blockOnPinnedImages_ ?
+            CircularBuffer::PinnedSlotBlock : CircularBuffer::PinnedSlotSkip);
+      lane->SetCompression(compressCircularBuffer_);
+      if (!lane->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+   }
+   catch (bad_alloc& ex)
+   {
+      ostringstream messs;
+      messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+      throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+   }
+   cameraBufferLanes_->Add(cameraLabel, lane);
+   LOG_DEBUG(coreLogger_) << "Did enable " << sizeMB <<
+      " MB buffer lane for camera " << cameraLabel;
+}
+
+/**
+ * Removes a camera's buffer lane, discarding any images it holds.
+ *
+ * Images from the camera go to the shared circular buffer again. Does nothing
+ * if the camera has no lane.
+ */
+void CMMCore::disableCameraBufferLane(const char* cameraLabel) throw (CMMError)
+{
+   std::shared_ptr<CameraInstance> camera =
+      deviceManager_->GetDeviceOfType<CameraInstance>(cameraLabel);
+
+   mm::DeviceModuleLockGuard guard(camera);
+   if (camera->IsCapturing())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+                     MMERR_NotAllowedDuringSequenceAcquisition);
+
+   if (cameraBufferLanes_->Remove(cameraLabel))
+      LOG_DEBUG(coreLogger_) << "Did disable buffer lane for camera " <<
+         cameraLabel;
+}
+
+/**
+ * Returns whether the camera has its own buffer lane.
+ */
+bool CMMCore::hasCameraBufferLane(const char* cameraLabel)
+{
+   return cameraLabel && cameraBufferLanes_->Find(cameraLabel);
+}
+
+/**
+ * Returns the labels of the cameras that have their own buffer lane.
+ */
+std::vector<std::string> CMMCore::getCameraBufferLanes()
+{
+   return cameraBufferLanes_->GetCameraLabels();
+}
+
+/**
+ * Gets the last image from the camera's buffer lane.
+ */
+void* CMMCore::getLastImage(const char* cameraLabel) throw (CMMError)
+{
+   unsigned char* pBuf = const_cast<unsigned char*>(
+         getCameraBufferLane(cameraLabel)->GetTopImage());
+   if (pBuf != 0)
+      return pBuf;
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image from the camera's buffer lane.
+ */
+void* CMMCore::popNextImage(const char* cameraLabel) throw (CMMError)
+{
+   unsigned char* pBuf = const_cast<unsigned char*>(
+         getCameraBufferLane(cameraLabel)->GetNextImage());
+   if (pBuf != 0)
+      return pBuf;
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets the last image (and metadata) from the camera's buffer lane.
+ */
+void* CMMCore::getLastImageMD(const char* cameraLabel, Metadata& md) const
+   throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf =
+      getCameraBufferLane(cameraLabel)->GetTopImageBuffer(0);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image (and metadata) from the camera's buffer
+ * lane.
+ */
+void* CMMCore::popNextImageMD(const char* cameraLabel, Metadata& md)
+   throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf =
+      getCameraBufferLane(cameraLabel)->GetNextImageBuffer(0);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Returns the number of images available in the camera's buffer lane.
+ */
+long CMMCore::getRemainingImageCount(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->GetRemainingImageCount();
+}
+
+/**
+ * Returns the total number of images that can be stored in the camera's
+ * buffer lane.
+ */
+long CMMCore::getBufferTotalCapacity(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->GetSize();
+}
+
+/**
+ * Returns the number of images that can be added to the camera's buffer lane
+ * without overflowing.
+ */
+long CMMCore::getBufferFreeCapacity(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->GetFreeSize();
+}
+
+/**
+ * Indicates whether the camera's buffer lane is overflowed.
+ */
+bool CMMCore::isBufferOverflowed(const char* cameraLabel) const
+   throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->Overflow();
+}
+
+/**
+ * Returns the size of the camera's buffer lane in MB.
+ */
+unsigned CMMCore::getCircularBufferMemoryFootprint(const char* cameraLabel)
+   throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->GetMemorySizeMB();
+}
+
+/**
+ * Removes all images from the camera's buffer lane.
+ */
+void CMMCore::clearCircularBuffer(const char* cameraLabel) throw (CMMError)
+{
+   getCameraBufferLane(cameraLabel)->Clear();
+}
+
+/**
+ * Returns a handle to the last image in the circular buffer, without copying
+ * the pixels.
+ *
+ * Unlike the pointer returned by getLastImage(), the image is not overwritten
+ * for as long as the handle (or a copy of it) exists. See
+ * setBlockOnPinnedImages() for what happens when the camera reaches it.
+ */
+ImageHandle CMMCore::getLastImageHandle() throw (CMMError)
+{
+   std::shared_ptr<const mm::ImgBuffer> image = cbuf_->PinNthFromTopImage(0, 0);
+   if (!image)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return ImageHandle(image);
+}
+
+/**
+ * Returns a handle to the image that was inserted n images ago, without
+ * copying the pixels.
+ */
+ImageHandle CMMCore::getNBeforeLastImageHandle(unsigned long n) throw (CMMError)
+{
+   std::shared_ptr<const mm::ImgBuffer> image =
+      cbuf_->PinNthFromTopImage(static_cast<long>(n), 0);
+   if (!image)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return ImageHandle(image);
+}
+
+/**
+ * Removes the next image from the circular buffer and returns a handle to it,
+ * without copying the pixels.
+ *
+ * Unlike the pointer returned by popNextImage(), the image remains valid for
+ * as long as the handle (or a copy of it) exists.
+ */
+ImageHandle CMMCore::popNextImageHandle() throw (CMMError)
+{
+   std::shared_ptr<const mm::ImgBuffer> image = cbuf_->PinNextImage(0);
+   if (!image)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return ImageHandle(image);
+}
+
+/**
+ * Returns a handle to the last image in the camera's buffer lane.
+ */
+ImageHandle CMMCore::getLastImageHandle(const char* cameraLabel) throw (CMMError)
+{
+   std::shared_ptr<const mm::ImgBuffer> image =
+      getCameraBufferLane(cameraLabel)->PinNthFromTopImage(0, 0);
+   if (!image)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return ImageHandle(image);
+}
+
+/**
+ * Removes the next image from the camera's buffer lane and returns a handle
+ * to it.
+ */
+ImageHandle CMMCore::popNextImageHandle(const char* cameraLabel) throw (CMMError)
+{
+   std::shared_ptr<const mm::ImgBuffer> image =
+      getCameraBufferLane(cameraLabel)->PinNextImage(0);
+   if (!image)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return ImageHandle(image);
+}
+
+namespace
+{
+
+std::chrono::microseconds WaitTimeout(double timeoutMs)
+{
+   if (!(timeoutMs > 0.0))
+      return std::chrono::microseconds(0);
+   return std::chrono::microseconds(static_cast<long long>(timeoutMs * 1000.0));
+}
+
+std::vector<std::shared_ptr<const mm::ImgBuffer> > PinNextImages(
+      CircularBuffer& buffer, unsigned maxCount, double timeoutMs)
+{
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images;
+   if (maxCount == 0)
+      return images;
+   images.reserve(maxCount);
+   if (buffer.PinNextImages(maxCount, 0, images) == 0 &&
+         buffer.WaitForImage(WaitTimeout(timeoutMs)))
+      buffer.PinNextImages(maxCount, 0, images);
+   return images;
+}
+
+} // anonymous namespace
+
+/**
+ * Removes up to maxCount images from the circular buffer and returns handles
+ * to them, oldest first, without copying the pixels.
+ *
+ * If the buffer is empty, waits up to timeoutMs for an image to arrive, and
+ * then returns the images that are available. Returns an empty vector if none
+ * arrived. This takes the buffer lock once per call rather than once per
+ * image, and replaces polling getRemainingImageCount().
+ *
+ * Must not be called concurrently with setCircularBufferMemoryFootprint().
+ */
+std::vector<ImageHandle> CMMCore::popNextImages(unsigned maxCount,
+      double timeoutMs) throw (CMMError)
+{
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images =
+      PinNextImages(*cbuf_, maxCount, timeoutMs);
+   std::vector<ImageHandle> handles;
+   handles.reserve(images.size());
+   for (std::shared_ptr<const mm::ImgBuffer>& image : images)
+      handles.push_back(ImageHandle(std::move(image)));
+   return handles;
+}
+
+/**
+ * Removes up to maxCount images from the camera's buffer lane and returns
+ * handles to them. See popNextImages(unsigned, double).
+ */
+std::vector<ImageHandle> CMMCore::popNextImages(const char* cameraLabel,
+      unsigned maxCount, double timeoutMs) throw (CMMError)
+{
+   std::shared_ptr<CircularBuffer> lane = getCameraBufferLane(cameraLabel);
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images =
+      PinNextImages(*lane, maxCount, timeoutMs);
+   std::vector<ImageHandle> handles;
+   handles.reserve(images.size());
+   for (std::shared_ptr<const mm::ImgBuffer>& image : images)
+      handles.push_back(ImageHandle(std::move(image)));
+   return handles;
+}
+
+/**
+ * Removes up to maxCount images from the circular buffer and copies them,
+ * oldest first, contiguously into the caller's buffer; md receives their
+ * metadata. At most as many images as fit in bufferBytes are removed.
+ *
+ * Waits up to timeoutMs if the circular buffer is empty, like
+ * popNextImages(unsigned, double). Returns the number of images copied.
+ * The pixels are copied outside of the buffer lock. Throws only if no image
+ * was removed, so that images already removed are always returned.
+ */
+unsigned CMMCore::popNextImages(unsigned maxCount, double timeoutMs, void* buffer,
+      unsigned long bufferBytes, std::vector<Metadata>& md) throw (CMMError)
+{
+   md.clear();
+   return cbuf_->CopyNextImages(maxCount, 0, WaitTimeout(timeoutMs), buffer,
+         bufferBytes, md);
+}
+
+/**
+ * Removes up to maxCount images from the camera's buffer lane and copies
+ * them into the caller's buffer. See
+ * popNextImages(unsigned, double, void*, unsigned long, std::vector<Metadata>&).
+ */
+unsigned CMMCore::popNextImages(const char* cameraLabel, unsigned maxCount,
+      double timeoutMs, void* buffer, unsigned long bufferBytes,
+      std::vector<Metadata>& md) throw (CMMError)
+{
+   std::shared_ptr<CircularBuffer> lane = getCameraBufferLane(cameraLabel);
+   md.clear();
+   return lane->CopyNextImages(maxCount, 0, WaitTimeout(timeoutMs), buffer,
+         bufferBytes, md);
+}
+
+/**
+ * Waits until the circular buffer holds an image, for at most timeoutMs.
+ * Returns whether an image is available.
+ *
+ * Must not be called concurrently with setCircularBufferMemoryFootprint().
+ */
+bool CMMCore::waitForImage(double timeoutMs)
+{
+   return cbuf_->WaitForImage(WaitTimeout(timeoutMs));
+}
+
+/**
+ * Waits until the camera's buffer lane holds an image, for at most
+ * timeoutMs. Returns whether an image is available.
+ */
+bool CMMCore::waitForImage(const char* cameraLabel, double timeoutMs)
+   throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->WaitForImage(WaitTimeout(timeoutMs));
+}
+
+/**
+ * Sets what a camera does when it would overwrite an image that is pinned by
+ * an ImageHandle.
+ *
+ * By default (false), the camera leaves the pinned image alone and the buffer
+ * allocates new memory for that slot, so that the buffer can temporarily use
+ * more memory than its footprint. If true, the camera waits until the image
+ * is released; holding on to handles can then stall the acquisition.
+ *
+ * Applies to the circular buffer and all camera buffer lanes.
+ */
+void CMMCore::setBlockOnPinnedImages(bool block)
+{
+   blockOnPinnedImages_ = block;
+   const CircularBuffer::PinnedSlotPolicy policy = block ?
+      CircularBuffer::PinnedSlotBlock : CircularBuffer::PinnedSlotSkip;
+   cbuf_->SetPinnedSlotPolicy(policy);
+   std::vector<std::string> cameras = cameraBufferLanes_->GetCameraLabels();
+   for (const std::string& camera : cameras)
+   {
+      std::shared_ptr<CircularBuffer> lane = cameraBufferLanes_->Find(camera);
+      if (lane)
+         lane->SetPinnedSlotPolicy(policy);
+   }
+}
+
+/**
+ * Returns whether cameras wait for pinned images to be released.
+ */
+bool CMMCore::getBlockOnPinnedImages() const
+{
+   return blockOnPinnedImages_;
+}
+
+/**
+ * Enables or disables lossless compression of the images in the circular
+ * buffer.
+ *
+ * Compressed images are decompressed when retrieved. Images with mostly dark
+ * or uniform background compress several-fold, so that the same memory
+ * footprint holds correspondingly more images; the buffer capacity is then
+ * estimated from the compression ratio achieved so far. Compression costs
+ * processor time on every insert and retrieval.
+ *
+ * Applies to the circular buffer and all camera buffer lanes, and takes
+ * effect when they are next initialized (at the start of a sequence
+ * acquisition, or by initializeCircularBuffer()).
+ */
+void CMMCore::setCircularBufferCompression(bool compress)
+{
+   compressCircularBuffer_ = compress;
+   cbuf_->SetCompression(compress);
+   std::vector<std::string> cameras = cameraBufferLanes_->GetCameraLabels();
+   for (const std::string& camera : cameras)
+   {
+      std::shared_ptr<CircularBuffer> lane = cameraBufferLanes_->Find(camera);
+      if (lane)
+         lane->SetCompression(compress);
+   }
+}
+
+/**
+ * Returns whether circular buffer compression is enabled.
+ */
+bool CMMCore::getCircularBufferCompression() const
+{
+   return compressCircularBuffer_;
+}
+
+/**
+ * Returns the ratio of the raw to the compressed size of the images inserted
+ * into the circular buffer since it was initialized.
+ *
+ * Returns 1.0 when the buffer is not compressed or no images have been
+ * inserted.
+ */
+double CMMCore::getCircularBufferCompressionRatio() const
+{
+   return cbuf_->GetCompressionRatio();
+}
+
+/**
+ * Returns the compression ratio of a camera's buffer lane.
+ */
+double CMMCore::getCircularBufferCompressionRatio(const char* cameraLabel)
+   throw (CMMError)
+{
+   return getCameraBufferLane(cameraLabel)->GetCompressionRatio();
+}
+
+/**
+ * Starts making downsampled previews of the images acquired by cameras, for
+ * live display.
+ *
+ * Previews are made as images are inserted into the sequence buffer (or a
+ * camera buffer lane), at most at the given rate, and are retrieved with
+ * getLastPreviewImage(). Retrieving a preview instead of the full image with
+ * getLastImage() saves copying and scaling most of the pixels. The statistics
+ * of the full-resolution image are computed along with the preview.
+ *
+ * Images are binned by the smallest integer factor that makes them fit in
+ * the given size; see setImagePreviewBinning(). Only 8- and 16-bit grayscale
+ * and 32-bit RGB images are previewed.
+ *
+ * @param maxWidth     maximum preview width in pixels
+ * @param maxHeight    maximum preview height in pixels
+ * @param maxFramesPerSecond   maximum rate of previews; 0 to preview every
+ *                     image
+ */
+void CMMCore::enableImagePreview(unsigned maxWidth, unsigned maxHeight,
+      double maxFramesPerSecond) throw (CMMError)
+{
+   if (maxWidth == 0 || maxHeight == 0)
+      throw CMMError("Preview size must not be zero");
+   if (maxFramesPerSecond < 0.0)
+      throw CMMError("Preview rate must not be negative");
+   previewTap_->Enable(maxWidth, maxHeight, maxFramesPerSecond);
+}
+
+/**
+ * Stops making previews and discards the last one.
+ */
+void CMMCore::disableImagePreview()
+{
+   previewTap_->Disable();
+}
+
+/**
+ * Returns whether previews are being made.
+ */
+bool CMMCore::isImagePreviewEnabled() const
+{
+   return previewTap_->IsEnabled();
+}
+
+/**
+ * Sets how blocks of camera pixels are reduced to preview pixels.
+ *
+ * @param binning   "Mean" (the default), "Max" (keeps isolated bright
+ *                  features visible) or "Decimate" (fastest; takes one pixel
+ *                  of each block)
+ */
+void CMMCore::setImagePreviewBinning(const char* binning) throw (CMMError)
+{
+   const std::string mode = binning ? binning : "";
+   if (mode == "Mean")
+      previewTap_->SetBinning(mm::PreviewTap::BinningMean);
+   else if (mode == "Max")
+      previewTap_->SetBinning(mm::PreviewTap::BinningMax);
+   else if (mode == "Decimate")
+      previewTap_->SetBinning(mm::PreviewTap::BinningDecimate);
+   else
+      throw CMMError("Unknown preview binning " + ToQuotedString(mode));
+}
+
+/**
+ * Returns the preview binning mode.
+ */
+std::string CMMCore::getImagePreviewBinning() const
+{
+   switch (previewTap_->GetBinning())
+   {
+      case mm::PreviewTap::BinningMax:
+         return "Max";
+      case mm::PreviewTap::BinningDecimate:
+         return "Decimate";
+      default:
+         return "Mean";
+   }
+}
+
+/**
+ * Returns the most recent preview.
+ *
+ * The preview is invalid (see PreviewImage::isValid()) if previews are
+ * disabled or no image has been previewed yet.
+ */
+PreviewImage CMMCore::getLastPreviewImage() const
+{
+   return PreviewImage(previewTap_->GetLast());
+}
+
+/**
+ * Returns the histogram of the most recently previewed image.
+ *
+ * The histogram has 256 bins, covering the camera's bit depth for 16-bit
+ * images, and counts the color components of RGB images. It is empty if there
+ * is no preview. See PreviewImage for the bin width and other statistics.
  */
-void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
+std::vector<long> CMMCore::getLastImageHistogram() const
 {
-   return popNextImageMD(0, 0, md);
+   return getLastPreviewImage().getHistogram();
 }
 
 /**
- * Removes all images from the circular buffer.
+ * Moves image processing off the camera threads.
  *
- * It is rarely necessary to call this directly since starting a sequence
- * acquisition or changing the ROI will always clear the buffer.
+ * Normally the image processor (see setImageProcessorDevice()) runs on the
+ * camera's thread as each image is inserted, so that a processor slower than
+ * the frame period slows down the acquisition. With the pipeline enabled,
+ * images are instead copied into a staging ring of the given depth and
+ * processed by worker threads; processed images enter the sequence buffer in
+ * the order in which they were acquired. Cameras wait only when the ring is
+ * full.
+ *
+ * More than one worker thread processes several images at once, and more
+ * than one tile splits each image into that many horizontal strips that are
+ * processed at once. Both require a processor that can be called
+ * concurrently; tiles also require one that treats every pixel alike,
+ * independently of its neighbors and of its position in the image (e.g. a
+ * lookup table, but neither filtering nor flat-field correction, because a
+ * strip is passed to the processor as an image of its own). Images that are
+ * not processed bypass the pipeline.
+ *
+ * Processors that combine several images into one (such as frame averaging)
+ * need whole images, one at a time and in acquisition order, so they must be
+ * used with one worker thread and one tile. With more tiles, the strips of an
+ * image would be combined as if they were separate images, and the image is
+ * dropped if any of its strips is absorbed. As a safeguard, once the
+ * processor has absorbed an image (returned DEVICE_IMAGE_CONSUMED), the
+ * pipeline processes its later images whole, one at a time and in order; the
+ * images processed before that are not protected.
+ *
+ * The images in flight are committed before stopSequenceAcquisition() returns
+ * and when the camera finishes a sequence. The depth and the time spent in
+ * each stage are reported by getPerformanceMetrics().
+ *
+ * @param workerThreads    number of processing threads
+ * @param maxFramesInFlight   depth of the staging ring in images
+ * @param tilesPerImage    number of strips processed in parallel per image
  */
-void CMMCore::clearCircularBuffer() throw (CMMError)
+void CMMCore::enableImageProcessingPipeline(unsigned workerThreads,
+      unsigned maxFramesInFlight, unsigned tilesPerImage) throw (CMMError)
 {
-   cbuf_->Clear();
+   if (workerThreads == 0 || maxFramesInFlight == 0 || tilesPerImage == 0)
+      throw CMMError("Image processing pipeline parameters must not be zero");
+   processingPipeline_->Start(workerThreads, maxFramesInFlight, tilesPerImage);
+   LOG_INFO(coreLogger_) << "Image processing pipeline enabled with " <<
+      workerThreads << " worker(s), depth " << maxFramesInFlight << ", " <<
+      tilesPerImage << " tile(s) per image";
 }
 
 /**
- * Reserve memory for the circular buffer.
+ * Commits the images in flight and returns to processing images on the camera
+ * threads.
  */
-void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
-                                               ) throw (CMMError)
+void CMMCore::disableImageProcessingPipeline()
 {
-   delete cbuf_; // discard old buffer
-   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
-      sizeMB << " MB";
-	try
-	{
-		cbuf_ = new CircularBuffer(sizeMB);
-	}
-	catch(bad_alloc& ex)
-	{
-      // This is an out-of-memory error before even allocating the buffers.
-		ostringstream messs;
-		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
-		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
-	}
-	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
-
-
-	try
-	{
-
-		// attempt to initialize based on the current camera settings
-      std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
-      if (camera)
-		{
-         mm::DeviceModuleLockGuard guard(camera);
-         if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-		}
-
-      LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
-         sizeMB << " MB";
-	}
-	catch(bad_alloc& ex)
-	{
-		ostringstream messs;
-		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
-		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
-	}
-	if (NULL == cbuf_)
-      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+   processingPipeline_->Stop();
+   LOG_INFO(coreLogger_) << "Image processing pipeline disabled";
 }
 
 /**
- * Returns the size of the Circular Buffer in MB
+ * Returns whether images are processed by the pipeline.
  */
-unsigned CMMCore::getCircularBufferMemoryFootprint()
+bool CMMCore::isImageProcessingPipelineEnabled() const
 {
-   if (cbuf_)
-   {
-      return cbuf_->GetMemorySizeMB();
-   }
-   return 0;
+   return processingPipeline_->IsRunning();
 }
 
 /**
- * Returns number ofimages available in the Circular Buffer
+ * Returns the number of images inserted by cameras that are in the
+ * processing pipeline and not yet in the sequence buffer.
  */
-long CMMCore::getRemainingImageCount()
+long CMMCore::getImageProcessingPipelineDepth() const
 {
-   if (cbuf_)
-   {
-      return cbuf_->GetRemainingImageCount();
-   }
-   return 0;
+   return static_cast<long>(processingPipeline_->GetFramesInFlight());
 }
 
 /**
- * Returns the total number of images that can be stored in the buffer
+ * Waits until all images in the processing pipeline are in the sequence
+ * buffer.
  */
-long CMMCore::getBufferTotalCapacity()
+void CMMCore::flushImageProcessingPipeline()
 {
-   if (cbuf_)
-   {
-      return cbuf_->GetSize();
-   }
-   return 0;
+   processingPipeline_->Flush();
 }
 
-
-/**
- * Returns the number of images that can be added to the buffer
- * without overflowing
- */
-long CMMCore::getBufferFreeCapacity()
+// Initializes the buffer that receives images from the camera (its lane, if it
+// has one, otherwise the shared circular buffer) for the camera's current
+// settings, and discards any images it holds
+void CMMCore::initializeSequenceBuffer(std::shared_ptr<CameraInstance> camera)
+   throw (CMMError)
 {
-   if (cbuf_)
+   std::shared_ptr<CircularBuffer> lane =
+      cameraBufferLanes_->Find(camera->GetLabel());
+   CircularBuffer* buffer = lane ? lane.get() : cbuf_;
+   if (!buffer->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
    {
-      return cbuf_->GetFreeSize();
+      logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
    }
-   return 0;
+   buffer->Clear();
 }
 
 /**
- * Indicates whether the circular buffer is overflowed
+ * Lets the image processor discard any state from a previous sequence.
+ * Called without the processor's module lock, like Process() on the camera
+ * thread.
  */
-bool CMMCore::isBufferOverflowed() const
+void CMMCore::notifySequenceStarting() throw (CMMError)
 {
-   return cbuf_->Overflow();
+   std::shared_ptr<ImageProcessorInstance> imageProcessor =
+      currentImageProcessor_.lock();
+   if (!imageProcessor)
+      return;
+   int nRet = imageProcessor->SequenceStarting();
+   if (nRet != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(nRet, imageProcessor).c_str(),
+            MMERR_DEVICE_GENERIC);
+}
+
+std::shared_ptr<CircularBuffer> CMMCore::getCameraBufferLane(const char* label)
+   const throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   std::shared_ptr<CircularBuffer> lane = cameraBufferLanes_->Find(label);
+   if (!lane)
+      throw CMMError("Camera " + ToQuotedString(label) + ": " +
+            getCoreErrorText(MMERR_NoCameraBufferLane), MMERR_NoCameraBufferLane);
+   return lane;
 }
 
 /**
@@ -3192,10 +4306,7 @@ void CMMCore::setAutoFocusDevice(const char* autofocusLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newAutofocusLabel = getAutoFocusDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel);
 }
 
 /**
@@ -3246,6 +4357,8 @@ string CMMCore::getGalvoDevice()
  */
 void CMMCore::setImageProcessorDevice(const char* procLabel) throw (CMMError)
 {
+   // Images in flight are processed by the processor they were inserted with
+   processingPipeline_->Flush();
    if (procLabel && strlen(procLabel)>0)
    {
       currentImageProcessor_ =
@@ -3259,10 +4372,7 @@ void CMMCore::setImageProcessorDevice(const char* procLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newProcLabel = getImageProcessorDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel);
 }
 
 /**
@@ -3283,10 +4393,7 @@ void CMMCore::setSLMDevice(const char* slmLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newSLMLabel = getSLMDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel);
 }
 
 
@@ -3308,10 +4415,7 @@ void CMMCore::setGalvoDevice(const char* galvoLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newGalvoLabel = getGalvoDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel);
 }
 
 /**
@@ -3335,13 +4439,14 @@ void CMMCore::setChannelGroup(const char* chGroup) throw (CMMError)
    channelGroup_ = chGroup;
    LOG_INFO(coreLogger_) << "Channel group set to " << chGroup;
 
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_);
    if (externalCallback_ != 0) 
    {
-      externalCallback_->onChannelGroupChanged(channelGroup_.c_str());
+      const std::string group = channelGroup_;
+      eventDispatcher_->Post(mm::EventDispatcher::Key("ChannelGroupChanged"),
+            [group](MMEventCallback& cb) {
+               cb.onChannelGroupChanged(group.c_str());
+            });
    }
 }
 
@@ -3397,10 +4502,7 @@ void CMMCore::setShutterDevice(const char* shutterLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newShutterLabel = getShutterDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel);
 }
 
 /**
@@ -3422,10 +4524,7 @@ void CMMCore::setFocusDevice(const char* focusLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newFocusLabel = getFocusDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel);
 }
 
 /**
@@ -3445,10 +4544,7 @@ void CMMCore::setXYStageDevice(const char* xyDeviceLabel) throw (CMMError)
       LOG_INFO(coreLogger_) << "Default xy stage unset";
    }
    std::string newXYStageLabel = getXYStageDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel);
 }
 
 /**
@@ -3484,10 +4580,7 @@ void CMMCore::setCameraDevice(const char* cameraLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newCameraLabel = getCameraDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
-   }
+   stateCache_->Set(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel);
 }
 
 /**
@@ -3586,12 +4679,7 @@ string CMMCore::getProperty(const char* label, const char* propName) throw (CMME
    std::string value = pDevice->GetProperty(propName);
 
    // use the opportunity to update the cache
-   // Note, stateCache is mutable so that we can update it from this const function
-   PropertySetting s(label, propName, value.c_str());
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(s);
-   }
+   stateCache_->Set(label, propName, value);
 
    return value;
 }
@@ -3610,15 +4698,69 @@ string CMMCore::getPropertyFromCache(const char* label, const char* propName) co
    CheckDeviceLabel(label);
    CheckPropertyName(propName);
 
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      if (!stateCache_.isPropertyIncluded(label, propName))
-         throw CMMError("Property " + ToQuotedString(propName) + " of device " +
-               ToQuotedString(label) + " not found in cache",
-               MMERR_PropertyNotInCache);
-      PropertySetting s = stateCache_.getSetting(label, propName);
-      return s.getPropertyValue();
+   std::string value;
+   if (!stateCache_->Get(label, propName, value))
+      throw CMMError("Property " + ToQuotedString(propName) + " of device " +
+            ToQuotedString(label) + " not found in cache",
+            MMERR_PropertyNotInCache);
+   return value;
+}
+
+/**
+ * Returns the cached values of several properties in one call.
+ *
+ * The i-th value is that of property propNames[i] of device deviceLabels[i].
+ * This is equivalent to calling getPropertyFromCache() for each pair, but
+ * cheaper. The values are not guaranteed to form a consistent snapshot if
+ * properties are being changed concurrently; to detect changes, call
+ * getSystemStateCacheRevision() before calling this function.
+ *
+ * @return the property values
+ * @param deviceLabels   the device labels
+ * @param propNames      the property names (same length as deviceLabels)
+ */
+std::vector<std::string>
+CMMCore::getPropertiesFromCache(const std::vector<std::string>& deviceLabels,
+      const std::vector<std::string>& propNames) const throw (CMMError)
+{
+   if (deviceLabels.size() != propNames.size())
+      throw CMMError("Numbers of device labels (" +
+            ToString(deviceLabels.size()) + ") and property names (" +
+            ToString(propNames.size()) + ") differ");
+
+   std::vector<std::string> values;
+   std::vector<bool> found;
+   stateCache_->GetMany(deviceLabels, propNames, values, found);
+   for (size_t i = 0; i < values.size(); ++i)
+   {
+      const char* label = deviceLabels[i].c_str();
+      const char* propName = propNames[i].c_str();
+      if (IsCoreDeviceLabel(label))
+      {
+         values[i] = properties_->Get(propName);
+         continue;
+      }
+      if (found[i])
+         continue;
+      CheckDeviceLabel(label);
+      CheckPropertyName(propName);
+      throw CMMError("Property " + ToQuotedString(propName) + " of device " +
+            ToQuotedString(label) + " not found in cache",
+            MMERR_PropertyNotInCache);
    }
+   return values;
+}
+
+/**
+ * Returns the revision number of the system state cache.
+ *
+ * The revision is incremented whenever a cached value changes (including
+ * when updateSystemStateCache() changes any value). Clients that display
+ * cached values can skip refreshing them while the revision is unchanged.
+ */
+long long CMMCore::getSystemStateCacheRevision() const
+{
+   return static_cast<long long>(stateCache_->GetRevision());
 }
 
 /**
@@ -3641,10 +4783,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
          propName << " = " << propValue;
 
       properties_->Execute(propName, propValue);
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
-      }
+      stateCache_->Set(MM::g_Keyword_CoreDevice, propName, propValue);
 
       LOG_DEBUG(coreLogger_) << "Did set Core property: " <<
          propName << " = " << propValue;
@@ -3657,10 +4796,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
 
       pDevice->SetProperty(propName, propValue);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(label, propName, propValue));
-      }
+      stateCache_->Set(label, propName, propValue);
    }
 }
 
@@ -3911,6 +5047,138 @@ void CMMCore::loadPropertySequence(const char* label, const char* propName, std:
    pDevice->SendPropertySequence(propName);
 }
 
+/**
+ * Returns a handle for fast typed access to a Float or Integer property.
+ *
+ * Getting and setting the property through the handle (with
+ * getPropertyDouble(), setPropertyDouble(), etc.) avoids looking up the
+ * device and property by name and converting the value to and from a string
+ * on every call, which matters in tight control loops.
+ *
+ * Calling this again for the same device and property returns the same
+ * handle. If the device is unloaded, the handle becomes invalid; after the
+ * device is loaded again, call this function again to revalidate it.
+ *
+ * @param label       the device label
+ * @param propName    the property name
+ * @return the handle
+ */
+long CMMCore::getPropertyHandle(const char* label, const char* propName) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      throw CMMError("Typed property access is not available for Core properties",
+            MMERR_InvalidCoreProperty);
+   std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   std::shared_ptr<mm::PropertyHandle> handle =
+      std::make_shared<mm::PropertyHandle>();
+   handle->device = pDevice;
+   handle->label = label;
+   handle->propName = propName;
+   handle->cacheKey = stateCache_->Intern(label, propName);
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      if (pDevice->GetPropertyType(propName) == MM::String)
+         throw CMMError("Property " + ToQuotedString(propName) + " of device " +
+               ToQuotedString(label) +
+               " is a string property and cannot be accessed as a number");
+      handle->deviceHandle = pDevice->GetPropertyHandle(propName);
+      handle->preInit = pDevice->GetPropertyInitStatus(propName);
+   }
+
+   MMThreadGuard g(propertyHandlesLock_);
+   std::pair<std::string, std::string> key(label, propName);
+   std::map<std::pair<std::string, std::string>, long>::iterator found =
+      propertyHandleIndex_.find(key);
+   if (found != propertyHandleIndex_.end())
+   {
+      // Also refreshes the entry if the device has been reloaded
+      propertyHandles_[found->second] = handle;
+      return found->second;
+   }
+   long id = static_cast<long>(propertyHandles_.size());
+   propertyHandles_.push_back(handle);
+   propertyHandleIndex_[key] = id;
+   return id;
+}
+
+/**
+ * Returns the value of a Float or Integer property, given its handle.
+ *
+ * Unlike getProperty(), this does not update the system state cache.
+ *
+ * @param handle    a handle obtained from getPropertyHandle()
+ */
+double CMMCore::getPropertyDouble(long handle) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> pDevice;
+   std::shared_ptr<const mm::PropertyHandle> h =
+      lookupPropertyHandle(handle, pDevice);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   return pDevice->GetPropertyDouble(h->deviceHandle);
+}
+
+/**
+ * Changes the value of a Float or Integer property, given its handle.
+ *
+ * @param handle    a handle obtained from getPropertyHandle()
+ * @param value     the new property value
+ */
+void CMMCore::setPropertyDouble(long handle, double value) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> pDevice;
+   std::shared_ptr<const mm::PropertyHandle> h =
+      lookupPropertyHandle(handle, pDevice);
+   if (h->preInit && pDevice->IsInitialized())
+      throw CMMError("Cannot set pre-init property after initialization");
+
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      pDevice->SetPropertyDouble(h->deviceHandle, value);
+   }
+   cacheTypedPropertyValue(*h, ToString(value));
+}
+
+/**
+ * Returns the value of a Float or Integer property, given its handle.
+ *
+ * Unlike getProperty(), this does not update the system state cache.
+ *
+ * @param handle    a handle obtained from getPropertyHandle()
+ */
+long CMMCore::getPropertyLong(long handle) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> pDevice;
+   std::shared_ptr<const mm::PropertyHandle> h =
+      lookupPropertyHandle(handle, pDevice);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   return pDevice->GetPropertyLong(h->deviceHandle);
+}
+
+/**
+ * Changes the value of a Float or Integer property, given its handle.
+ *
+ * @param handle    a handle obtained from getPropertyHandle()
+ * @param value     the new property value
+ */
+void CMMCore::setPropertyLong(long handle, long value) throw (CMMError)
+{
+   std::shared_ptr<DeviceInstance> pDevice;
+   std::shared_ptr<const mm::PropertyHandle> h =
+      lookupPropertyHandle(handle, pDevice);
+   if (h->preInit && pDevice->IsInitialized())
+      throw CMMError("Cannot set pre-init property after initialization");
+
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      pDevice->SetPropertyLong(h->deviceHandle, value);
+   }
+   cacheTypedPropertyValue(*h, ToString(value));
+}
+
 /**
  * Returns the intrinsic property type.
  */
@@ -4124,10 +5392,7 @@ void CMMCore::setExposure(const char* label, double dExp) throw (CMMError)
       pCamera->SetExposure(dExp);
       if (pCamera->HasProperty(MM::g_Keyword_Exposure))
       {
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
-         }
+         stateCache_->Set(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp));
       }
    }
 
@@ -4206,6 +5471,10 @@ void CMMCore::setROI(int x, int y, int xSize, int ySize) throw (CMMError)
       // popNextImage() to handle this correctly, so we need to make sure we
       // discard such images.
       cbuf_->Clear();
+      std::shared_ptr<CircularBuffer> lane =
+         cameraBufferLanes_->Find(camera->GetLabel());
+      if (lane)
+         lane->Clear();
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(), MMERR_CameraNotAvailable);
@@ -4285,6 +5554,9 @@ void CMMCore::setROI(const char* label, int x, int y, int xSize, int ySize) thro
      // popNextImage() to handle this correctly, so we need to make sure we
      // discard such images.
      cbuf_->Clear();
+     std::shared_ptr<CircularBuffer> lane = cameraBufferLanes_->Find(label);
+     if (lane)
+        lane->Clear();
   }
   else
      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(), MMERR_CameraNotAvailable);
@@ -4344,6 +5616,10 @@ void CMMCore::clearROI() throw (CMMError)
       // popNextImage() to handle this correctly, so we need to make sure we
       // discard such images.
       cbuf_->Clear();
+      std::shared_ptr<CircularBuffer> lane =
+         cameraBufferLanes_->Find(camera->GetLabel());
+      if (lane)
+         lane->Clear();
    }
 }
 
@@ -4507,19 +5783,13 @@ void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
 
    if (pStateDev->HasProperty(MM::g_Keyword_State))
    {
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
-      }
+      stateCache_->Set(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state));
    }
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
    {
       std::string posLbl = pStateDev->GetPositionLabel(state);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
-      }
+      stateCache_->Set(deviceLabel, MM::g_Keyword_Label, posLbl);
    }
 
    LOG_DEBUG(coreLogger_) << "Did set " << deviceLabel << " to state " << state;
@@ -4588,19 +5858,13 @@ void CMMCore::setStateLabel(const char* deviceLabel, const char* stateLabel) thr
 
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
    {
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
-      }
+      stateCache_->Set(deviceLabel, MM::g_Keyword_Label, stateLabel);
    }
    if (pStateDev->HasProperty(MM::g_Keyword_State))
    {
       long state = getStateFromLabel(deviceLabel, stateLabel);
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State,
-                  CDeviceUtils::ConvertToString(state)));
-      }
+      stateCache_->Set(deviceLabel, MM::g_Keyword_State,
+            CDeviceUtils::ConvertToString(state));
    }
 }
 
@@ -5302,8 +6566,7 @@ string CMMCore::getCurrentPixelSizeConfig(bool cached) throw (CMMError)
 				}
 				else
 				{
-               MMThreadGuard scg(stateCacheLock_);
-               value = stateCache_.getSetting(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str()).getPropertyValue();
+               value = getPropertyFromCache(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str());
 				}
                PropertySetting ss(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str(), value.c_str()); // state setting
                curState.addSetting(ss);
@@ -6723,7 +7986,9 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
          catch (CMMError& err)
          {
             if (externalCallback_)
-               externalCallback_->onSystemConfigurationLoaded();
+               eventDispatcher_->Post("", [](MMEventCallback& cb) {
+                  cb.onSystemConfigurationLoaded();
+               });
             std::ostringstream errorText;
             errorText << "Line " << lineCount << ": " << line << endl;
             errorText << err.getFullMsg() << endl << endl;
@@ -6750,7 +8015,9 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 
    if (externalCallback_)
    {
-      externalCallback_->onSystemConfigurationLoaded();
+      eventDispatcher_->Post("", [](MMEventCallback& cb) {
+         cb.onSystemConfigurationLoaded();
+      });
    }
 }
 
@@ -6758,10 +8025,99 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 /**
  * Register a callback (listener class).
  * MMCore will send notifications on internal events using this interface
+ *
+ * Once this returns, the previously registered callback is no longer called:
+ * notifications being delivered to it, synchronously or asynchronously, are
+ * waited for. When called from within a callback method, this does not wait.
  */
 void CMMCore::registerCallback(MMEventCallback* cb)
 {
    externalCallback_ = cb;
+   eventDispatcher_->SetCallback(cb);
+}
+
+/**
+ * Enable or disable asynchronous delivery of notifications to the registered
+ * callback.
+ *
+ * By default, callback methods are called synchronously on the thread that
+ * caused the event, which may be a device adapter's own thread (e.g. a
+ * camera or stage polling thread), so that a slow callback delays the
+ * device. When asynchronous delivery is enabled, events are queued and
+ * delivered, in order, on a dedicated Core thread; see also
+ * enableCallbackCoalescing().
+ *
+ * Disabling asynchronous delivery waits until queued events have been
+ * delivered.
+ *
+ * @param enable   true to deliver notifications on a dedicated thread
+ */
+void CMMCore::enableAsyncCallbacks(bool enable)
+{
+   eventDispatcher_->SetAsync(enable);
+   LOG_INFO(coreLogger_) << "Asynchronous callback delivery " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Indicates if notifications are delivered to the registered callback on a
+ * dedicated thread.
+ */
+bool CMMCore::asyncCallbacksEnabled() const
+{
+   return eventDispatcher_->IsAsync();
+}
+
+/**
+ * Enable or disable coalescing of queued notifications (enabled by default).
+ *
+ * Only applies to asynchronous delivery (see enableAsyncCallbacks()). When
+ * enabled, a notification that supersedes one still waiting in the queue
+ * (e.g. a new position for the same stage, a new value for the same
+ * property, or a new preset for the same configuration group) replaces the
+ * queued one, which keeps its place in the queue. Notifications without
+ * such a relationship (e.g. onPropertiesChanged()) are always delivered.
+ *
+ * @param enable   true to coalesce notifications
+ */
+void CMMCore::enableCallbackCoalescing(bool enable)
+{
+   eventDispatcher_->SetCoalescing(enable);
+}
+
+/**
+ * Indicates if queued notifications are coalesced.
+ */
+bool CMMCore::callbackCoalescingEnabled() const
+{
+   return eventDispatcher_->IsCoalescing();
+}
+
+/**
+ * Set how long notifications that can be coalesced are held back before
+ * delivery.
+ *
+ * With the default of zero, notifications are only coalesced while the
+ * callback is busy with earlier ones. A positive window limits the rate at
+ * which, for example, stage position updates reach the callback, to about
+ * one per window per stage, at the cost of delaying them by up to the window.
+ *
+ * @param windowMs   the coalescing window in milliseconds
+ */
+void CMMCore::setCallbackCoalescingWindowMs(double windowMs) throw (CMMError)
+{
+   if (!(windowMs >= 0.0))
+      throw CMMError("Coalescing window must not be negative");
+   eventDispatcher_->SetCoalescingWindow(std::chrono::microseconds(
+            static_cast<long long>(windowMs * 1000.0 + 0.5)));
+}
+
+/**
+ * Returns the coalescing window in milliseconds.
+ */
+double CMMCore::getCallbackCoalescingWindowMs() const
+{
+   return eventDispatcher_->GetCoalescingWindow().count() / 1000.0;
 }
 
 
@@ -7065,6 +8421,9 @@ void CMMCore::InitializeErrorMessages()
    errorText_[MMERR_NullPointerException] = "Null Pointer Exception.";
    errorText_[MMERR_CreatePeripheralFailed] = "Hub failed to create specified peripheral device.";
    errorText_[MMERR_BadAffineTransform] = "Bad affine transform.  Affine transforms need to have 6 numbers; 2 rows of 3 column.";
+   errorText_[MMERR_InvalidPropertyHandle] = "Invalid property handle.";
+   errorText_[MMERR_InvalidAsyncHandle] = "Invalid asynchronous operation handle.";
+   errorText_[MMERR_NoCameraBufferLane] = "Camera has no buffer lane.";
 }
 
 void CMMCore::CreateCoreProperties()
@@ -7217,10 +8576,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
       if (setting.getDeviceLabel().compare(MM::g_Keyword_CoreDevice) == 0)
       {
          properties_->Execute(setting.getPropertyName().c_str(), setting.getPropertyValue().c_str());
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
-         }
+         stateCache_->Set(MM::g_Keyword_CoreDevice, setting.getPropertyName(), setting.getPropertyValue());
       }
       else
       {
@@ -7233,10 +8589,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
             pDevice->SetProperty(setting.getPropertyName(),
                   setting.getPropertyValue());
 
-            {
-               MMThreadGuard scg(stateCacheLock_);
-               stateCache_.addSetting(setting);
-            }
+            stateCache_->Set(setting);
          }
          catch (const CMMError&)
          {
@@ -7280,10 +8633,7 @@ int CMMCore::applyProperties(vector<PropertySetting>& props, string& lastError)
          pDevice->SetProperty(props[i].getPropertyName(),
                props[i].getPropertyValue());
 
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(props[i]);
-         }
+         stateCache_->Set(props[i]);
       }
       catch (const CMMError& e)
       {
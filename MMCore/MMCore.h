@@ -60,7 +60,9 @@
 #include "CoreUtils.h"
 #include "Error.h"
 #include "ErrorCodes.h"
+#include "ImageHandle.h"
 #include "Logging/Logger.h"
+#include "PreviewImage.h"
 
 #include <cstring>
 #include <deque>
@@ -107,6 +109,18 @@ class CMMCore;
 namespace mm {
    class DeviceManager;
    class LogManager;
+   struct PropertyHandle;
+   class AsyncOperations;
+   class CameraBufferLanes;
+   class EventDispatcher;
+   class ImageProcessingPipeline;
+   class PreviewTap;
+   class PropertyConfigIndex;
+   class StateCache;
+   namespace metrics {
+      class CoreMetrics;
+      class TextFileExporter;
+   } // namespace metrics
 } // namespace mm
 
 typedef unsigned int* imgRGB32;
@@ -174,6 +188,16 @@ public:
    void registerCallback(MMEventCallback* cb);
    ///@}
 
+   /** \name Event callback delivery. */
+   ///@{
+   void enableAsyncCallbacks(bool enable);
+   bool asyncCallbacksEnabled() const;
+   void enableCallbackCoalescing(bool enable);
+   bool callbackCoalescingEnabled() const;
+   void setCallbackCoalescingWindowMs(double windowMs) throw (CMMError);
+   double getCallbackCoalescingWindowMs() const;
+   ///@}
+
    /** \name Logging and log management. */
    ///@{
    void setPrimaryLogFile(const char* filename, bool truncate = false) throw (CMMError);
@@ -192,6 +216,22 @@ public:
 
    ///@}
 
+   /** \name Performance metrics. */
+   ///@{
+   std::string getPerformanceMetrics();
+   void resetPerformanceMetrics();
+   void startPerformanceMetricsExport(const char* filename,
+         double intervalMs) throw (CMMError);
+   void stopPerformanceMetricsExport();
+   ///@}
+
+   /** \name Tracing. */
+   ///@{
+   void startTrace() throw (CMMError);
+   void startTrace(long maxEventsPerThread) throw (CMMError);
+   void stopTrace(const char* filename) throw (CMMError);
+   ///@}
+
    /** \name Device listing. */
    ///@{
    std::vector<std::string> getDeviceAdapterSearchPaths();
@@ -239,6 +279,12 @@ public:
    long getPropertySequenceMaxLength(const char* label, const char* propName) throw (CMMError);
    void loadPropertySequence(const char* label, const char* propName, std::vector<std::string> eventSequence) throw (CMMError);
 
+   long getPropertyHandle(const char* label, const char* propName) throw (CMMError);
+   double getPropertyDouble(long handle) throw (CMMError);
+   void setPropertyDouble(long handle, double value) throw (CMMError);
+   long getPropertyLong(long handle) throw (CMMError);
+   void setPropertyLong(long handle, long value) throw (CMMError);
+
    bool deviceBusy(const char* label) throw (CMMError);
    void waitForDevice(const char* label) throw (CMMError);
    void waitForConfig(const char* group, const char* configName) throw (CMMError);
@@ -247,6 +293,11 @@ public:
    bool deviceTypeBusy(MM::DeviceType devType) throw (CMMError);
    void waitForDeviceType(MM::DeviceType devType) throw (CMMError);
 
+   bool isAsyncOperationComplete(long handle) throw (CMMError);
+   void waitForAll(const std::vector<long>& handles) throw (CMMError);
+   bool waitForAll(const std::vector<long>& handles,
+         double timeoutMs) throw (CMMError);
+
    double getDeviceDelayMs(const char* label) throw (CMMError);
    void setDeviceDelayMs(const char* label, double delayMs) throw (CMMError);
    bool usesDeviceDelay(const char* label) throw (CMMError);
@@ -289,6 +340,10 @@ public:
    void updateSystemStateCache();
    std::string getPropertyFromCache(const char* deviceLabel,
          const char* propName) const throw (CMMError);
+   std::vector<std::string> getPropertiesFromCache(
+         const std::vector<std::string>& deviceLabels,
+         const std::vector<std::string>& propNames) const throw (CMMError);
+   long long getSystemStateCacheRevision() const;
    std::string getCurrentConfigFromCache(const char* groupName) throw (CMMError);
    Configuration getConfigGroupStateFromCache(const char* group) throw (CMMError);
    ///@}
@@ -417,6 +472,67 @@ public:
    void initializeCircularBuffer() throw (CMMError);
    void clearCircularBuffer() throw (CMMError);
 
+   void enableCameraBufferLane(const char* cameraLabel, unsigned sizeMB)
+      throw (CMMError);
+   void disableCameraBufferLane(const char* cameraLabel) throw (CMMError);
+   bool hasCameraBufferLane(const char* cameraLabel);
+   std::vector<std::string> getCameraBufferLanes();
+   void* getLastImage(const char* cameraLabel) throw (CMMError);
+   void* popNextImage(const char* cameraLabel) throw (CMMError);
+   void* getLastImageMD(const char* cameraLabel, Metadata& md)
+      const throw (CMMError);
+   void* popNextImageMD(const char* cameraLabel, Metadata& md)
+      throw (CMMError);
+   long getRemainingImageCount(const char* cameraLabel) throw (CMMError);
+   long getBufferTotalCapacity(const char* cameraLabel) throw (CMMError);
+   long getBufferFreeCapacity(const char* cameraLabel) throw (CMMError);
+   bool isBufferOverflowed(const char* cameraLabel) const throw (CMMError);
+   unsigned getCircularBufferMemoryFootprint(const char* cameraLabel)
+      throw (CMMError);
+   void clearCircularBuffer(const char* cameraLabel) throw (CMMError);
+
+   ImageHandle getLastImageHandle() throw (CMMError);
+   ImageHandle getNBeforeLastImageHandle(unsigned long n) throw (CMMError);
+   ImageHandle popNextImageHandle() throw (CMMError);
+   ImageHandle getLastImageHandle(const char* cameraLabel) throw (CMMError);
+   ImageHandle popNextImageHandle(const char* cameraLabel) throw (CMMError);
+   std::vector<ImageHandle> popNextImages(unsigned maxCount,
+         double timeoutMs) throw (CMMError);
+   std::vector<ImageHandle> popNextImages(const char* cameraLabel,
+         unsigned maxCount, double timeoutMs) throw (CMMError);
+   unsigned popNextImages(unsigned maxCount, double timeoutMs, void* buffer,
+         unsigned long bufferBytes, std::vector<Metadata>& md)
+      throw (CMMError);
+   unsigned popNextImages(const char* cameraLabel, unsigned maxCount,
+         double timeoutMs, void* buffer, unsigned long bufferBytes,
+         std::vector<Metadata>& md) throw (CMMError);
+   bool waitForImage(double timeoutMs);
+   bool waitForImage(const char* cameraLabel, double timeoutMs)
+      throw (CMMError);
+   void setBlockOnPinnedImages(bool block);
+   bool getBlockOnPinnedImages() const;
+   void setCircularBufferCompression(bool compress);
+   bool getCircularBufferCompression() const;
+   double getCircularBufferCompressionRatio() const;
+   double getCircularBufferCompressionRatio(const char* cameraLabel)
+      throw (CMMError);
+
+   void enableImagePreview(unsigned maxWidth, unsigned maxHeight,
+         double maxFramesPerSecond) throw (CMMError);
+   void disableImagePreview();
+   bool isImagePreviewEnabled() const;
+   void setImagePreviewBinning(const char* binning) throw (CMMError);
+   std::string getImagePreviewBinning() const;
+   PreviewImage getLastPreviewImage() const;
+   std::vector<long> getLastImageHistogram() const;
+
+   void enableImageProcessingPipeline(unsigned workerThreads,
+         unsigned maxFramesInFlight, unsigned tilesPerImage) throw (CMMError);
+   void disableImageProcessingPipeline();
+   bool isImageProcessingPipelineEnabled() const;
+   long getImageProcessingPipelineDepth() const;
+   void flushImageProcessingPipeline();
+
    bool isExposureSequenceable(const char* cameraLabel) throw (CMMError);
    void startExposureSequence(const char* cameraLabel) throw (CMMError);
    void stopExposureSequence(const char* cameraLabel) throw (CMMError);
@@ -459,6 +575,9 @@ public:
    ///@{
    void setPosition(const char* stageLabel, double position) throw (CMMError);
    void setPosition(double position) throw (CMMError);
+   long setPositionAsync(const char* stageLabel,
+         double position) throw (CMMError);
+   long setPositionAsync(double position) throw (CMMError);
    double getPosition(const char* stageLabel) throw (CMMError);
    double getPosition() throw (CMMError);
    void setRelativePosition(const char* stageLabel, double d) throw (CMMError);
@@ -486,6 +605,9 @@ public:
    void setXYPosition(const char* xyStageLabel,
          double x, double y) throw (CMMError);
    void setXYPosition(double x, double y) throw (CMMError);
+   long setXYPositionAsync(const char* xyStageLabel,
+         double x, double y) throw (CMMError);
+   long setXYPositionAsync(double x, double y) throw (CMMError);
    void setRelativeXYPosition(const char* xyStageLabel,
          double dx, double dy) throw (CMMError);
    void setRelativeXYPosition(double dx, double dy) throw (CMMError);
@@ -627,6 +749,13 @@ private:
    mm::logging::Logger appLogger_;
    mm::logging::Logger coreLogger_;
 
+   // Outlives devices, which hold on to their own metrics
+   std::shared_ptr<mm::metrics::CoreMetrics> metrics_;
+   std::unique_ptr<mm::metrics::TextFileExporter> metricsExporter_;
+
+   // Outlives devices, which may post events until they are unloaded
+   std::unique_ptr<mm::EventDispatcher> eventDispatcher_;
+
    bool everSnapped_;
 
    std::weak_ptr<CameraInstance> currentCameraDevice_;
@@ -649,19 +778,41 @@ private:
    MMEventCallback* externalCallback_;  // notification hook to the higher layer (e.g. GUI)
    PixelSizeConfigGroup* pixelSizeGroup_;
    CircularBuffer* cbuf_;
+   bool blockOnPinnedImages_;
+   bool compressCircularBuffer_;
+
+   // Per-camera buffers that take the place of cbuf_ for their cameras
+   std::unique_ptr<mm::CameraBufferLanes> cameraBufferLanes_;
+
+   // Fed by cameras on insertion; internally synchronized
+   std::unique_ptr<mm::PreviewTap> previewTap_;
+
+   // Processes images off the camera threads when running; internally
+   // synchronized
+   std::unique_ptr<mm::ImageProcessingPipeline> processingPipeline_;
 
    std::shared_ptr<CPluginManager> pluginManager_;
    std::shared_ptr<mm::DeviceManager> deviceManager_;
    std::map<int, std::string> errorText_;
 
-   // Must be unlocked when calling MMEventCallback or calling device methods
-   // or acquiring a module lock
-   mutable MMThreadLock stateCacheLock_;
-   mutable Configuration stateCache_; // Synchronized by stateCacheLock_
+   // Internally synchronized; never calls out while holding its lock
+   std::unique_ptr<mm::StateCache> stateCache_;
+
+   // Polls devices for asynchronous operations on its own thread
+   std::unique_ptr<mm::AsyncOperations> asyncOperations_;
+
+   // Maps properties to the groups to notify when they change
+   std::unique_ptr<mm::PropertyConfigIndex> propertyConfigIndex_;
 
    MMThreadLock* pPostedErrorsLock_;
    mutable std::deque<std::pair< int, std::string> > postedErrors_;
 
+   // Typed property handles; the handle is the index. Entries are never
+   // removed, so that a handle cannot come to refer to another property.
+   mutable MMThreadLock propertyHandlesLock_;
+   std::vector<std::shared_ptr<const mm::PropertyHandle> > propertyHandles_;
+   std::map<std::pair<std::string, std::string>, long> propertyHandleIndex_;
+
 private:
    void InitializeErrorMessages();
    void CreateCoreProperties();
@@ -678,6 +829,16 @@ private:
    void applyConfiguration(const Configuration& config) throw (CMMError);
    int applyProperties(std::vector<PropertySetting>& props, std::string& lastError);
    void waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMError);
+   long addAsyncDeviceWait(std::shared_ptr<DeviceInstance> pDev);
+   void initializeSequenceBuffer(std::shared_ptr<CameraInstance> camera)
+      throw (CMMError);
+   void notifySequenceStarting() throw (CMMError);
+   std::shared_ptr<CircularBuffer> getCameraBufferLane(const char* label)
+      const throw (CMMError);
+   std::shared_ptr<const mm::PropertyHandle> lookupPropertyHandle(long handle,
+         std::shared_ptr<DeviceInstance>& pDevice) const throw (CMMError);
+   void cacheTypedPropertyValue(const mm::PropertyHandle& handle,
+         const std::string& value);
    Configuration getConfigGroupState(const char* group, bool fromCache) throw (CMMError);
    std::string getDeviceErrorText(int deviceCode, std::shared_ptr<DeviceInstance> pDevice);
    std::string getDeviceName(std::shared_ptr<DeviceInstance> pDev);
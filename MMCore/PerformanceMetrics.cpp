@@ -0,0 +1,474 @@
+#include "PerformanceMetrics.h"
+
+#include "CoreUtils.h"
+#include "Error.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace mm
+{
+namespace metrics
+{
+
+namespace
+{
+
+void AtomicAdd(std::atomic<double>& target, double delta)
+{
+   double current = target.load(std::memory_order_relaxed);
+   while (!target.compare_exchange_weak(current, current + delta,
+            std::memory_order_relaxed))
+      ;
+}
+
+std::string EscapeLabelValue(const std::string& value)
+{
+   std::string result;
+   result.reserve(value.size());
+   for (char ch : value)
+   {
+      switch (ch)
+      {
+         case '\\': result += "\\\\"; break;
+         case '"': result += "\\\""; break;
+         case '\n': result += "\\n"; break;
+         default: result += ch; break;
+      }
+   }
+   return result;
+}
+
+std::string EscapeHelp(const std::string& help)
+{
+   std::string result;
+   result.reserve(help.size());
+   for (char ch : help)
+   {
+      switch (ch)
+      {
+         case '\\': result += "\\\\"; break;
+         case '\n': result += "\\n"; break;
+         default: result += ch; break;
+      }
+   }
+   return result;
+}
+
+// Renders {a="x",b="y"}, with an optional extra label appended; empty
+// string if there are no labels at all.
+std::string FormatLabels(const Labels& labels,
+      const std::string& extraName = std::string(),
+      const std::string& extraValue = std::string())
+{
+   if (labels.empty() && extraName.empty())
+      return std::string();
+   std::string result = "{";
+   bool first = true;
+   for (const auto& label : labels)
+   {
+      if (!first)
+         result += ",";
+      first = false;
+      result += label.first + "=\"" + EscapeLabelValue(label.second) + "\"";
+   }
+   if (!extraName.empty())
+   {
+      if (!first)
+         result += ",";
+      result += extraName + "=\"" + EscapeLabelValue(extraValue) + "\"";
+   }
+   result += "}";
+   return result;
+}
+
+std::string FormatValue(double value)
+{
+   if (value == std::numeric_limits<double>::infinity())
+      return "+Inf";
+   std::ostringstream strm;
+   strm << std::setprecision(std::numeric_limits<double>::max_digits10 - 2) <<
+      value;
+   return strm.str();
+}
+
+} // anonymous namespace
+
+
+void
+Gauge::RaiseTo(double v)
+{
+   double current = value_.load(std::memory_order_relaxed);
+   while (current < v && !value_.compare_exchange_weak(current, v,
+            std::memory_order_relaxed))
+      ;
+}
+
+
+Histogram::Histogram(std::vector<double> upperBounds) :
+   upperBounds_(std::move(upperBounds)),
+   buckets_(new std::atomic<std::uint64_t>[upperBounds_.size() + 1])
+{
+   for (size_t i = 0; i <= upperBounds_.size(); ++i)
+      buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+void
+Histogram::Observe(double value)
+{
+   size_t bucket = std::lower_bound(upperBounds_.begin(), upperBounds_.end(),
+         value) - upperBounds_.begin();
+   buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+   AtomicAdd(sum_, value);
+}
+
+Histogram::Snapshot
+Histogram::GetSnapshot() const
+{
+   // Buckets are read individually, so a snapshot taken during concurrent
+   // updates may miss observations in flight; the count is derived from the
+   // buckets so that the two are at least consistent.
+   Snapshot snap;
+   snap.upperBounds = upperBounds_;
+   snap.cumulativeCounts.reserve(upperBounds_.size() + 1);
+   std::uint64_t cumulative = 0;
+   for (size_t i = 0; i <= upperBounds_.size(); ++i)
+   {
+      cumulative += buckets_[i].load(std::memory_order_relaxed);
+      snap.cumulativeCounts.push_back(cumulative);
+   }
+   snap.count = cumulative;
+   snap.sum = sum_.load(std::memory_order_relaxed);
+   return snap;
+}
+
+void
+Histogram::Reset()
+{
+   for (size_t i = 0; i <= upperBounds_.size(); ++i)
+      buckets_[i].store(0, std::memory_order_relaxed);
+   sum_.store(0.0, std::memory_order_relaxed);
+}
+
+
+std::vector<double>
+LatencyBuckets()
+{
+   return std::vector<double>{
+      10e-6, 25e-6, 50e-6, 100e-6, 250e-6, 500e-6,
+      1e-3, 2.5e-3, 5e-3, 10e-3, 25e-3, 50e-3, 100e-3, 250e-3, 500e-3,
+      1.0, 2.5, 5.0, 10.0 };
+}
+
+std::vector<double>
+FractionBuckets()
+{
+   return std::vector<double>{
+      0.0, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 0.95, 0.99, 1.0 };
+}
+
+
+Registry::Series&
+Registry::GetSeries(const std::string& name, const std::string& help,
+      MetricType type, const Labels& labels)
+{
+   auto familyIt = families_.find(name);
+   if (familyIt == families_.end())
+   {
+      Family family;
+      family.help = help;
+      family.type = type;
+      familyIt = families_.insert(std::make_pair(name, std::move(family))).first;
+   }
+   else if (familyIt->second.type != type)
+   {
+      throw CMMError("Metric " + ToQuotedString(name) +
+            " is already registered with a different type");
+   }
+
+   Series& series = familyIt->second.series[FormatLabels(labels)];
+   series.labels = labels;
+   return series;
+}
+
+std::shared_ptr<Counter>
+Registry::GetCounter(const std::string& name, const std::string& help,
+      const Labels& labels)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   Series& series = GetSeries(name, help, COUNTER, labels);
+   if (!series.counter)
+      series.counter = std::make_shared<Counter>();
+   return series.counter;
+}
+
+std::shared_ptr<Gauge>
+Registry::GetGauge(const std::string& name, const std::string& help,
+      const Labels& labels)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   Series& series = GetSeries(name, help, GAUGE, labels);
+   if (!series.gauge)
+      series.gauge = std::make_shared<Gauge>();
+   return series.gauge;
+}
+
+std::shared_ptr<Histogram>
+Registry::GetHistogram(const std::string& name, const std::string& help,
+      const std::vector<double>& upperBounds, const Labels& labels)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   Series& series = GetSeries(name, help, HISTOGRAM, labels);
+   if (!series.histogram)
+      series.histogram = std::make_shared<Histogram>(upperBounds);
+   return series.histogram;
+}
+
+void
+Registry::RemoveSeries(const std::string& labelName,
+      const std::string& labelValue)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   for (auto& family : families_)
+   {
+      auto& series = family.second.series;
+      for (auto it = series.begin(); it != series.end(); )
+      {
+         const Labels& labels = it->second.labels;
+         bool matches = std::find(labels.begin(), labels.end(),
+               std::make_pair(labelName, labelValue)) != labels.end();
+         if (matches)
+            it = series.erase(it);
+         else
+            ++it;
+      }
+   }
+}
+
+void
+Registry::ResetAll()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   for (auto& family : families_)
+   {
+      for (auto& series : family.second.series)
+      {
+         if (series.second.counter)
+            series.second.counter->Reset();
+         if (series.second.gauge)
+            series.second.gauge->Reset();
+         if (series.second.histogram)
+            series.second.histogram->Reset();
+      }
+   }
+}
+
+std::string
+Registry::RenderText() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   std::ostringstream strm;
+   for (const auto& family : families_)
+   {
+      const std::string& name = family.first;
+      if (family.second.series.empty())
+         continue;
+
+      strm << "# HELP " << name << ' ' << EscapeHelp(family.second.help) << '\n';
+      switch (family.second.type)
+      {
+         case COUNTER: strm << "# TYPE " << name << " counter\n"; break;
+         case GAUGE: strm << "# TYPE " << name << " gauge\n"; break;
+         case HISTOGRAM: strm << "# TYPE " << name << " histogram\n"; break;
+      }
+
+      for (const auto& seriesEntry : family.second.series)
+      {
+         const std::string& labelText = seriesEntry.first;
+         const Series& series = seriesEntry.second;
+         switch (family.second.type)
+         {
+            case COUNTER:
+               strm << name << labelText << ' ' << series.counter->Get() << '\n';
+               break;
+            case GAUGE:
+               strm << name << labelText << ' ' <<
+                  FormatValue(series.gauge->Get()) << '\n';
+               break;
+            case HISTOGRAM:
+            {
+               Histogram::Snapshot snap = series.histogram->GetSnapshot();
+               for (size_t i = 0; i < snap.cumulativeCounts.size(); ++i)
+               {
+                  double bound = i < snap.upperBounds.size() ?
+                     snap.upperBounds[i] :
+                     std::numeric_limits<double>::infinity();
+                  strm << name << "_bucket" <<
+                     FormatLabels(series.labels, "le", FormatValue(bound)) <<
+                     ' ' << snap.cumulativeCounts[i] << '\n';
+               }
+               strm << name << "_sum" << labelText << ' ' <<
+                  FormatValue(snap.sum) << '\n';
+               strm << name << "_count" << labelText << ' ' <<
+                  snap.count << '\n';
+               break;
+            }
+         }
+      }
+   }
+   return strm.str();
+}
+
+
+CoreMetrics::CoreMetrics() :
+   imagesInserted(registry_.GetCounter("mmcore_images_inserted_total",
+            "Images inserted into the sequence buffer by cameras")),
+   imageInsertFailures(registry_.GetCounter("mmcore_image_insert_failures_total",
+            "Images rejected by the sequence buffer (overflow or size mismatch)")),
+   imageInsertSeconds(registry_.GetHistogram("mmcore_image_insert_seconds",
+            "Time spent in InsertImage, including image processors",
+            LatencyBuckets())),
+   bufferFillFractionOnInsert(registry_.GetHistogram(
+            "mmcore_buffer_fill_fraction",
+            "Fraction of the sequence buffer in use, sampled after each insert",
+            FractionBuckets())),
+   bufferImages(registry_.GetGauge("mmcore_buffer_images",
+            "Images currently held in the sequence buffer")),
+   bufferCapacityImages(registry_.GetGauge("mmcore_buffer_capacity_images",
+            "Capacity of the sequence buffer in images")),
+   bufferCompressionRatio(registry_.GetGauge(
+            "mmcore_buffer_compression_ratio",
+            "Raw over stored size of the images in the sequence buffer")),
+   callbackEventsPosted(registry_.GetCounter(
+            "mmcore_callback_events_posted_total",
+            "Notifications posted for the registered event callback")),
+   callbackEventsCoalesced(registry_.GetCounter(
+            "mmcore_callback_events_coalesced_total",
+            "Queued notifications replaced by a newer one with the same key")),
+   callbackQueueEvents(registry_.GetGauge("mmcore_callback_queue_events",
+            "Notifications waiting for asynchronous delivery")),
+   callbackDeliverySeconds(registry_.GetHistogram(
+            "mmcore_callback_delivery_seconds",
+            "Time spent in the registered event callback per notification",
+            LatencyBuckets())),
+   pipelineFramesInFlight(registry_.GetGauge(
+            "mmcore_pipeline_frames_in_flight",
+            "Images in the image processing pipeline, not yet committed")),
+   pipelineQueueSeconds(registry_.GetHistogram(
+            "mmcore_pipeline_queue_seconds",
+            "Time from staging an image to the start of its processing",
+            LatencyBuckets())),
+   pipelineProcessSeconds(registry_.GetHistogram(
+            "mmcore_pipeline_process_seconds",
+            "Time spent in the image processor per image or tile",
+            LatencyBuckets())),
+   pipelineReorderSeconds(registry_.GetHistogram(
+            "mmcore_pipeline_reorder_seconds",
+            "Time a processed image waits for earlier images to be committed",
+            LatencyBuckets())),
+   pipelineStallSeconds(registry_.GetHistogram(
+            "mmcore_pipeline_stall_seconds",
+            "Time cameras wait for room in the full pipeline",
+            LatencyBuckets()))
+{
+}
+
+std::shared_ptr<DeviceMetrics>
+CoreMetrics::CreateDeviceMetrics(const std::string& label)
+{
+   const Labels labels{ std::make_pair(std::string("device"), label) };
+   std::shared_ptr<DeviceMetrics> device = std::make_shared<DeviceMetrics>();
+   device->getPropertySeconds = registry_.GetHistogram(
+         "mmcore_device_get_property_seconds",
+         "Latency of device GetProperty calls", LatencyBuckets(), labels);
+   device->setPropertySeconds = registry_.GetHistogram(
+         "mmcore_device_set_property_seconds",
+         "Latency of device SetProperty calls", LatencyBuckets(), labels);
+   device->waitForDeviceSeconds = registry_.GetHistogram(
+         "mmcore_wait_for_device_seconds",
+         "Time spent in waitForDevice until the device was no longer busy",
+         LatencyBuckets(), labels);
+   device->moduleLockWaitSeconds = registry_.GetHistogram(
+         "mmcore_module_lock_wait_seconds",
+         "Time spent waiting to acquire the device adapter module lock",
+         LatencyBuckets(), labels);
+   return device;
+}
+
+void
+CoreMetrics::RemoveDeviceMetrics(const std::string& label)
+{
+   registry_.RemoveSeries("device", label);
+}
+
+
+TextFileExporter::TextFileExporter(const std::string& filename,
+      std::chrono::milliseconds interval, RenderFunction render) :
+   filename_(filename),
+   interval_(interval),
+   render_(std::move(render))
+{
+   WriteNow(); // Report an unwritable path right away
+   thread_ = std::thread([this]() { Run(); });
+}
+
+TextFileExporter::~TextFileExporter()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopRequested_ = true;
+   }
+   cv_.notify_one();
+   thread_.join();
+}
+
+void
+TextFileExporter::WriteNow()
+{
+   const std::string text = render_();
+   const std::string tempFilename = filename_ + ".tmp";
+   {
+      std::ofstream file(tempFilename.c_str(),
+            std::ios::out | std::ios::trunc | std::ios::binary);
+      file << text;
+      file.close();
+      if (!file)
+         throw CMMError("Cannot write metrics to file " +
+               ToQuotedString(tempFilename));
+   }
+#ifdef _WIN32
+   // rename() does not replace an existing file on Windows
+   std::remove(filename_.c_str());
+#endif
+   if (std::rename(tempFilename.c_str(), filename_.c_str()) != 0)
+      throw CMMError("Cannot replace metrics file " +
+            ToQuotedString(filename_));
+}
+
+void
+TextFileExporter::Run()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   for (;;)
+   {
+      if (cv_.wait_for(lock, interval_, [this]() { return stopRequested_; }))
+         return;
+      lock.unlock();
+      try
+      {
+         WriteNow();
+      }
+      catch (const CMMError&)
+      {
+         // Keep trying; the directory may become writable again
+      }
+      lock.lock();
+   }
+}
+
+} // namespace metrics
+} // namespace mm
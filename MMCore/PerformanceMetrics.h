@@ -0,0 +1,242 @@
+// Lightweight performance metrics for the Core: counters, gauges, and
+// histograms that can be updated from any thread without locking, plus a
+// registry that renders them in the Prometheus text exposition format.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mm
+{
+namespace metrics
+{
+
+class Counter
+{
+   std::atomic<std::uint64_t> value_{ 0 };
+
+public:
+   void Increment(std::uint64_t n = 1)
+   { value_.fetch_add(n, std::memory_order_relaxed); }
+   std::uint64_t Get() const { return value_.load(std::memory_order_relaxed); }
+   void Reset() { value_.store(0, std::memory_order_relaxed); }
+};
+
+
+class Gauge
+{
+   std::atomic<double> value_{ 0.0 };
+
+public:
+   void Set(double v) { value_.store(v, std::memory_order_relaxed); }
+   void RaiseTo(double v); // Set to max(current, v)
+   double Get() const { return value_.load(std::memory_order_relaxed); }
+   void Reset() { Set(0.0); }
+};
+
+
+class Histogram
+{
+public:
+   // upperBounds must be sorted ascending; an implicit +Inf bucket is added.
+   explicit Histogram(std::vector<double> upperBounds);
+
+   Histogram(const Histogram&) = delete;
+   Histogram& operator=(const Histogram&) = delete;
+
+   void Observe(double value);
+
+   struct Snapshot
+   {
+      std::vector<double> upperBounds;
+      std::vector<std::uint64_t> cumulativeCounts; // Last entry is +Inf
+      std::uint64_t count;
+      double sum;
+   };
+   Snapshot GetSnapshot() const;
+   void Reset();
+
+private:
+   const std::vector<double> upperBounds_;
+   std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+   std::atomic<double> sum_{ 0.0 };
+};
+
+// Bucket bounds for durations in seconds, from 10 us to 10 s
+std::vector<double> LatencyBuckets();
+
+// Bucket bounds for fractions between 0 and 1
+std::vector<double> FractionBuckets();
+
+
+// Records the time from construction to destruction in a histogram, in
+// seconds. Does nothing if the histogram is null.
+class ScopedTimer
+{
+   Histogram* histogram_;
+   std::chrono::steady_clock::time_point start_;
+
+public:
+   explicit ScopedTimer(Histogram* histogram) :
+      histogram_(histogram),
+      start_(histogram ? std::chrono::steady_clock::now() :
+            std::chrono::steady_clock::time_point())
+   {}
+
+   ScopedTimer(const ScopedTimer&) = delete;
+   ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+   ~ScopedTimer()
+   {
+      if (histogram_)
+         histogram_->Observe(std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start_).count());
+   }
+};
+
+
+typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+/**
+ * Owns named metrics and renders them as text.
+ *
+ * Lookup and creation take a lock, so callers on hot paths should obtain the
+ * metric once and keep the returned pointer. Metrics stay valid while any
+ * pointer to them is held, even after being removed from the registry.
+ */
+class Registry
+{
+public:
+   std::shared_ptr<Counter> GetCounter(const std::string& name,
+         const std::string& help, const Labels& labels = Labels());
+   std::shared_ptr<Gauge> GetGauge(const std::string& name,
+         const std::string& help, const Labels& labels = Labels());
+   std::shared_ptr<Histogram> GetHistogram(const std::string& name,
+         const std::string& help, const std::vector<double>& upperBounds,
+         const Labels& labels = Labels());
+
+   // Drop all series carrying the given label
+   void RemoveSeries(const std::string& labelName,
+         const std::string& labelValue);
+
+   void ResetAll();
+
+   // Prometheus text exposition format (version 0.0.4)
+   std::string RenderText() const;
+
+private:
+   enum MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+   struct Series
+   {
+      Labels labels;
+      std::shared_ptr<Counter> counter;
+      std::shared_ptr<Gauge> gauge;
+      std::shared_ptr<Histogram> histogram;
+   };
+
+   struct Family
+   {
+      std::string help;
+      MetricType type;
+      std::map<std::string, Series> series; // Keyed by rendered labels
+   };
+
+   Series& GetSeries(const std::string& name, const std::string& help,
+         MetricType type, const Labels& labels);
+
+   mutable std::mutex mutex_;
+   std::map<std::string, Family> families_;
+};
+
+
+// Metrics kept for each loaded device
+struct DeviceMetrics
+{
+   std::shared_ptr<Histogram> getPropertySeconds;
+   std::shared_ptr<Histogram> setPropertySeconds;
+   std::shared_ptr<Histogram> waitForDeviceSeconds;
+   std::shared_ptr<Histogram> moduleLockWaitSeconds;
+};
+
+
+// The fixed set of metrics maintained by the Core
+class CoreMetrics
+{
+   Registry registry_; // Must be initialized before the metrics below
+
+public:
+   CoreMetrics();
+
+   Registry& GetRegistry() { return registry_; }
+
+   std::shared_ptr<DeviceMetrics> CreateDeviceMetrics(const std::string& label);
+   void RemoveDeviceMetrics(const std::string& label);
+
+   const std::shared_ptr<Counter> imagesInserted;
+   const std::shared_ptr<Counter> imageInsertFailures;
+   const std::shared_ptr<Histogram> imageInsertSeconds;
+   const std::shared_ptr<Histogram> bufferFillFractionOnInsert;
+   const std::shared_ptr<Gauge> bufferImages;
+   const std::shared_ptr<Gauge> bufferCapacityImages;
+   const std::shared_ptr<Gauge> bufferCompressionRatio;
+   const std::shared_ptr<Counter> callbackEventsPosted;
+   const std::shared_ptr<Counter> callbackEventsCoalesced;
+   const std::shared_ptr<Gauge> callbackQueueEvents;
+   const std::shared_ptr<Histogram> callbackDeliverySeconds;
+   const std::shared_ptr<Gauge> pipelineFramesInFlight;
+   const std::shared_ptr<Histogram> pipelineQueueSeconds;
+   const std::shared_ptr<Histogram> pipelineProcessSeconds;
+   const std::shared_ptr<Histogram> pipelineReorderSeconds;
+   const std::shared_ptr<Histogram> pipelineStallSeconds;
+};
+
+
+/**
+ * Periodically writes metrics text to a file, for collection by e.g. the
+ * Prometheus node exporter's textfile collector.
+ *
+ * The file is replaced atomically (write to a temporary file, then rename),
+ * so readers never see a partial file.
+ */
+class TextFileExporter
+{
+public:
+   typedef std::function<std::string()> RenderFunction;
+
+   TextFileExporter(const std::string& filename,
+         std::chrono::milliseconds interval, RenderFunction render);
+   ~TextFileExporter();
+
+   TextFileExporter(const TextFileExporter&) = delete;
+   TextFileExporter& operator=(const TextFileExporter&) = delete;
+
+   // Throws CMMError if the file cannot be written
+   void WriteNow();
+
+private:
+   void Run();
+
+   const std::string filename_;
+   const std::chrono::milliseconds interval_;
+   const RenderFunction render_;
+
+   std::mutex mutex_;
+   std::condition_variable cv_;
+   bool stopRequested_ = false;
+   std::thread thread_;
+};
+
+} // namespace metrics
+} // namespace mm
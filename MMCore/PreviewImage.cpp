@@ -0,0 +1,88 @@
+#include "PreviewImage.h"
+
+#include "PreviewTap.h"
+
+#include <utility>
+
+PreviewImage::PreviewImage()
+{
+}
+
+PreviewImage::PreviewImage(std::shared_ptr<const mm::PreviewFrame> frame) :
+   frame_(std::move(frame))
+{
+}
+
+bool
+PreviewImage::isValid() const
+{
+   return static_cast<bool>(frame_);
+}
+
+void*
+PreviewImage::getPixels() const
+{
+   if (!frame_)
+      return 0;
+   return const_cast<unsigned char*>(frame_->pixels.data());
+}
+
+unsigned
+PreviewImage::getImageWidth() const
+{
+   return frame_ ? frame_->width : 0;
+}
+
+unsigned
+PreviewImage::getImageHeight() const
+{
+   return frame_ ? frame_->height : 0;
+}
+
+unsigned
+PreviewImage::getBytesPerPixel() const
+{
+   return frame_ ? frame_->bytesPerPixel : 0;
+}
+
+unsigned
+PreviewImage::getNumberOfComponents() const
+{
+   return frame_ ? frame_->components : 0;
+}
+
+unsigned
+PreviewImage::getBinning() const
+{
+   return frame_ ? frame_->binning : 0;
+}
+
+std::string
+PreviewImage::getCameraLabel() const
+{
+   return frame_ ? frame_->camera : std::string();
+}
+
+unsigned
+PreviewImage::getMinimum() const
+{
+   return frame_ ? frame_->minimum : 0;
+}
+
+unsigned
+PreviewImage::getMaximum() const
+{
+   return frame_ ? frame_->maximum : 0;
+}
+
+std::vector<long>
+PreviewImage::getHistogram() const
+{
+   return frame_ ? frame_->histogram : std::vector<long>();
+}
+
+unsigned
+PreviewImage::getHistogramBinWidth() const
+{
+   return frame_ ? frame_->histogramBinWidth : 0;
+}
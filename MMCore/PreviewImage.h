@@ -0,0 +1,53 @@
+// A downsampled preview of a camera image, for live display, and the
+// statistics of the full-resolution image.
+//
+// Previews are immutable; copies share the same pixels.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mm
+{
+struct PreviewFrame;
+} // namespace mm
+
+class CMMCore;
+
+class PreviewImage
+{
+public:
+   /// Creates an invalid preview.
+   PreviewImage();
+
+   bool isValid() const;
+
+   // Named like the CMMCore image getters, so that language bindings convert
+   // the pixels in the same way. The pixels must not be modified.
+   /// Returns the pixels, or null if the preview is invalid.
+   void* getPixels() const;
+   unsigned getImageWidth() const;
+   unsigned getImageHeight() const;
+   unsigned getBytesPerPixel() const;
+   unsigned getNumberOfComponents() const;
+
+   /// Returns the number of camera pixels per preview pixel along each axis.
+   unsigned getBinning() const;
+   std::string getCameraLabel() const;
+
+   /// Statistics of the full-resolution image, over the color components
+   /// for RGB images.
+   unsigned getMinimum() const;
+   unsigned getMaximum() const;
+   std::vector<long> getHistogram() const;
+   /// Returns the range of pixel values counted in each histogram bin.
+   unsigned getHistogramBinWidth() const;
+
+private:
+   friend class CMMCore;
+   explicit PreviewImage(std::shared_ptr<const mm::PreviewFrame> frame);
+
+   std::shared_ptr<const mm::PreviewFrame> frame_;
+};
@@ -0,0 +1,221 @@
+#include "PreviewTap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace mm
+{
+
+namespace
+{
+
+// Bins a grayscale (C == 1) or BGRA (C == 4; alpha is binned like the
+// colors but left out of the statistics) image, row by row, while gathering
+// the statistics of every row.
+template <typename T, unsigned C>
+void PreviewPixels(const T* src, unsigned width, unsigned height,
+      unsigned factor, PreviewTap::Binning binning, unsigned histogramShift,
+      PreviewFrame& frame)
+{
+   const unsigned outWidth = frame.width;
+   const unsigned outHeight = frame.height;
+   const unsigned statsComponents = C == 4 ? 3 : C;
+   T* dst = reinterpret_cast<T*>(frame.pixels.data());
+
+   std::vector<uint64_t> acc(outWidth * C);
+   long* histogram = frame.histogram.data();
+   const unsigned lastBin = PreviewTap::HistogramBins - 1;
+   T minimum = src[0];
+   T maximum = src[0];
+
+   for (unsigned y = 0; y < height; ++y)
+   {
+      const T* row = src + static_cast<size_t>(y) * width * C;
+
+      for (unsigned x = 0; x < width; ++x)
+      {
+         for (unsigned c = 0; c < statsComponents; ++c)
+         {
+            const T v = row[x * C + c];
+            minimum = std::min(minimum, v);
+            maximum = std::max(maximum, v);
+            ++histogram[std::min<unsigned>(v >> histogramShift, lastBin)];
+         }
+      }
+
+      const unsigned outY = y / factor;
+      if (outY >= outHeight)
+         continue;
+      const unsigned dy = y % factor;
+      T* outRow = dst + static_cast<size_t>(outY) * outWidth * C;
+
+      if (binning == PreviewTap::BinningDecimate)
+      {
+         if (dy == 0)
+         {
+            for (unsigned x = 0; x < outWidth; ++x)
+               for (unsigned c = 0; c < C; ++c)
+                  outRow[x * C + c] = row[x * factor * C + c];
+         }
+         continue;
+      }
+
+      for (unsigned x = 0; x < outWidth; ++x)
+      {
+         const T* block = row + x * factor * C;
+         for (unsigned c = 0; c < C; ++c)
+         {
+            uint64_t& a = acc[x * C + c];
+            if (binning == PreviewTap::BinningMean)
+            {
+               for (unsigned dx = 0; dx < factor; ++dx)
+                  a += block[dx * C + c];
+            }
+            else
+            {
+               for (unsigned dx = 0; dx < factor; ++dx)
+                  a = std::max<uint64_t>(a, block[dx * C + c]);
+            }
+         }
+      }
+      if (dy == factor - 1)
+      {
+         const uint64_t count = static_cast<uint64_t>(factor) * factor;
+         for (unsigned i = 0; i < outWidth * C; ++i)
+         {
+            outRow[i] = static_cast<T>(binning == PreviewTap::BinningMean ?
+                  (acc[i] + count / 2) / count : acc[i]);
+            acc[i] = 0;
+         }
+      }
+   }
+
+   frame.minimum = minimum;
+   frame.maximum = maximum;
+}
+
+} // anonymous namespace
+
+void
+PreviewTap::Enable(unsigned maxWidth, unsigned maxHeight,
+      double maxFramesPerSecond)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   maxWidth_ = maxWidth;
+   maxHeight_ = maxHeight;
+   minInterval_ = std::chrono::steady_clock::duration::zero();
+   if (maxFramesPerSecond > 0.0)
+      minInterval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / maxFramesPerSecond));
+   nextDue_ = std::chrono::steady_clock::time_point();
+   enabled_.store(true);
+}
+
+void
+PreviewTap::Disable()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   enabled_.store(false);
+   last_.reset();
+}
+
+void
+PreviewTap::SetBinning(Binning binning)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   binning_ = binning;
+}
+
+PreviewTap::Binning
+PreviewTap::GetBinning() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return binning_;
+}
+
+bool
+PreviewTap::IsDue()
+{
+   if (!enabled_.load())
+      return false;
+   const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!enabled_.load() || now < nextDue_)
+      return false;
+   nextDue_ = now + minInterval_;
+   return true;
+}
+
+void
+PreviewTap::Feed(const std::string& camera, const unsigned char* pixels,
+      unsigned width, unsigned height, unsigned bytesPerPixel,
+      unsigned components, unsigned bitDepth)
+{
+   const bool gray8 = bytesPerPixel == 1 && components == 1;
+   const bool gray16 = bytesPerPixel == 2 && components == 1;
+   const bool rgb32 = bytesPerPixel == 4 && components == 4;
+   if (!(gray8 || gray16 || rgb32) || width == 0 || height == 0)
+      return;
+
+   unsigned maxWidth, maxHeight;
+   Binning binning;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      maxWidth = maxWidth_;
+      maxHeight = maxHeight_;
+      binning = binning_;
+   }
+
+   // Smallest integer factor that fits, keeping the aspect ratio (but not
+   // larger than the image, for extremely elongated images)
+   const unsigned factor = std::min(std::min(width, height), std::max(1u,
+            std::max((width + maxWidth - 1) / maxWidth,
+               (height + maxHeight - 1) / maxHeight)));
+
+   std::shared_ptr<PreviewFrame> frame = std::make_shared<PreviewFrame>();
+   frame->width = width / factor;
+   frame->height = height / factor;
+   frame->bytesPerPixel = bytesPerPixel;
+   frame->components = components;
+   frame->binning = factor;
+   frame->camera = camera;
+   frame->pixels.resize(static_cast<size_t>(frame->width) * frame->height *
+         bytesPerPixel);
+   frame->histogram.assign(HistogramBins, 0);
+
+   if (gray16)
+   {
+      const unsigned depth = std::min(16u, std::max(8u, bitDepth));
+      const unsigned shift = depth - 8;
+      frame->histogramBinWidth = 1u << shift;
+      PreviewPixels<uint16_t, 1>(reinterpret_cast<const uint16_t*>(pixels),
+            width, height, factor, binning, shift, *frame);
+   }
+   else if (gray8)
+   {
+      frame->histogramBinWidth = 1;
+      PreviewPixels<uint8_t, 1>(pixels, width, height, factor, binning,
+            0, *frame);
+   }
+   else
+   {
+      frame->histogramBinWidth = 1;
+      PreviewPixels<uint8_t, 4>(pixels, width, height, factor, binning,
+            0, *frame);
+   }
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (enabled_.load())
+      last_ = frame;
+}
+
+std::shared_ptr<const PreviewFrame>
+PreviewTap::GetLast() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return last_;
+}
+
+} // namespace mm
@@ -0,0 +1,88 @@
+// Downsampled previews of the images inserted by cameras, for live display.
+//
+// Producing a preview is cheap compared to copying the full image to the
+// application, and is rate-limited, so it is done on the camera thread as the
+// image is inserted. The image statistics (minimum, maximum and histogram)
+// are gathered in the same pass over the pixels.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mm
+{
+
+// Immutable once published
+struct PreviewFrame
+{
+   std::vector<unsigned char> pixels;
+   unsigned width = 0;
+   unsigned height = 0;
+   unsigned bytesPerPixel = 0;
+   unsigned components = 0;
+   unsigned binning = 0; // Source pixels per preview pixel, along each axis
+   std::string camera;
+
+   // Of the full-resolution image (over the color components for RGB)
+   unsigned minimum = 0;
+   unsigned maximum = 0;
+   std::vector<long> histogram;
+   unsigned histogramBinWidth = 0;
+};
+
+class PreviewTap
+{
+public:
+   enum Binning
+   {
+      BinningDecimate, // Take one pixel of each block
+      BinningMean,
+      BinningMax,
+   };
+
+   static const unsigned HistogramBins = 256;
+
+   // A preview fits in maxWidth x maxHeight (both positive); a nonpositive
+   // rate means every image is previewed. Enabling resets the rate limit.
+   void Enable(unsigned maxWidth, unsigned maxHeight,
+         double maxFramesPerSecond);
+   // Also discards the last preview
+   void Disable();
+   bool IsEnabled() const { return enabled_.load(); }
+
+   void SetBinning(Binning binning);
+   Binning GetBinning() const;
+
+   // Returns whether the next image should be previewed. If so, the next
+   // interval of the rate limit starts now, so that concurrent cameras do
+   // not both preview.
+   bool IsDue();
+
+   // Makes a preview of the image (the first channel, for multi-channel
+   // images). Pixel formats other than 8- and 16-bit grayscale and 32-bit
+   // RGB are skipped. The bit depth sets the histogram range.
+   void Feed(const std::string& camera, const unsigned char* pixels,
+         unsigned width, unsigned height, unsigned bytesPerPixel,
+         unsigned components, unsigned bitDepth);
+
+   // Returns null if there is no preview
+   std::shared_ptr<const PreviewFrame> GetLast() const;
+
+private:
+   std::atomic<bool> enabled_{ false };
+
+   mutable std::mutex mutex_;
+   unsigned maxWidth_ = 0;
+   unsigned maxHeight_ = 0;
+   std::chrono::steady_clock::duration minInterval_{};
+   std::chrono::steady_clock::time_point nextDue_{};
+   Binning binning_ = BinningMean;
+   std::shared_ptr<const PreviewFrame> last_;
+};
+
+} // namespace mm
@@ -0,0 +1,93 @@
+#include "PropertyConfigIndex.h"
+
+#include "ConfigGroup.h"
+
+namespace mm
+{
+
+PropertyConfigIndex::PropertyConfigIndex(ConfigGroupCollection& configGroups,
+      PixelSizeConfigGroup& pixelSizeGroup) :
+   configGroups_(configGroups),
+   pixelSizeGroup_(pixelSizeGroup),
+   built_(false),
+   configGroupsRevision_(0),
+   pixelSizeGroupRevision_(0)
+{
+}
+
+bool
+PropertyConfigIndex::Lookup(const std::string& device,
+      const std::string& property, std::vector<std::string>& groups)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   RebuildIfStale();
+
+   std::map<Key, Entry>::const_iterator it =
+      entries_.find(Key(device, property));
+   if (it == entries_.end())
+   {
+      groups.clear();
+      return false;
+   }
+   groups = it->second.groups;
+   return it->second.inPixelSizeConfig;
+}
+
+void
+PropertyConfigIndex::RebuildIfStale()
+{
+   const unsigned long groupsRevision = configGroups_.GetRevision();
+   const unsigned long pixelSizeRevision = pixelSizeGroup_.GetRevision();
+   if (built_ && groupsRevision == configGroupsRevision_ &&
+         pixelSizeRevision == pixelSizeGroupRevision_)
+      return;
+
+   entries_.clear();
+
+   // Groups come out sorted, so each entry's group list is sorted and can be
+   // checked for duplicates by looking at its last element
+   const std::vector<std::string> groups = configGroups_.GetAvailableGroups();
+   for (const std::string& group : groups)
+   {
+      const std::vector<std::string> presets =
+         configGroups_.GetAvailableConfigs(group.c_str());
+      for (const std::string& preset : presets)
+      {
+         const Configuration* config =
+            configGroups_.Find(group.c_str(), preset.c_str());
+         // Groups with a single setting are not reported as changed, since
+         // the UI handles them differently
+         if (!config || config->size() <= 1)
+            continue;
+         for (size_t i = 0; i < config->size(); ++i)
+         {
+            const PropertySetting setting = config->getSetting(i);
+            Entry& entry = entries_[Key(setting.getDeviceLabel(),
+                  setting.getPropertyName())];
+            if (entry.groups.empty() || entry.groups.back() != group)
+               entry.groups.push_back(group);
+         }
+      }
+   }
+
+   const std::vector<std::string> pixelSizePresets =
+      pixelSizeGroup_.GetAvailable();
+   for (const std::string& preset : pixelSizePresets)
+   {
+      const Configuration* config = pixelSizeGroup_.Find(preset.c_str());
+      if (!config)
+         continue;
+      for (size_t i = 0; i < config->size(); ++i)
+      {
+         const PropertySetting setting = config->getSetting(i);
+         entries_[Key(setting.getDeviceLabel(),
+               setting.getPropertyName())].inPixelSizeConfig = true;
+      }
+   }
+
+   built_ = true;
+   configGroupsRevision_ = groupsRevision;
+   pixelSizeGroupRevision_ = pixelSizeRevision;
+}
+
+} // namespace mm
@@ -0,0 +1,62 @@
+// Reverse index from device properties to the configuration groups and pixel
+// size presets that include them, so that a property change notification
+// can find the affected groups without scanning every preset.
+//
+// The index is rebuilt lazily, on the first lookup after the groups or pixel
+// size presets have changed (as detected by their revision numbers).
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ConfigGroupCollection;
+class PixelSizeConfigGroup;
+
+namespace mm
+{
+
+class PropertyConfigIndex
+{
+public:
+   // The collections must outlive this object
+   PropertyConfigIndex(ConfigGroupCollection& configGroups,
+         PixelSizeConfigGroup& pixelSizeGroup);
+
+   PropertyConfigIndex(const PropertyConfigIndex&) = delete;
+   PropertyConfigIndex& operator=(const PropertyConfigIndex&) = delete;
+
+   // Sets groups to the (sorted) names of the configuration groups with a
+   // preset of more than one setting that includes the property, and
+   // returns whether any pixel size preset includes the property.
+   bool Lookup(const std::string& device, const std::string& property,
+         std::vector<std::string>& groups);
+
+private:
+   struct Entry
+   {
+      Entry() : inPixelSizeConfig(false) {}
+
+      std::vector<std::string> groups;
+      bool inPixelSizeConfig;
+   };
+
+   typedef std::pair<std::string, std::string> Key; // Device, property
+
+   // Caller must hold mutex_
+   void RebuildIfStale();
+
+   ConfigGroupCollection& configGroups_;
+   PixelSizeConfigGroup& pixelSizeGroup_;
+
+   std::mutex mutex_;
+   bool built_;
+   unsigned long configGroupsRevision_;
+   unsigned long pixelSizeGroupRevision_;
+   std::map<Key, Entry> entries_;
+};
+
+} // namespace mm
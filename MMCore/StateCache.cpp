@@ -0,0 +1,230 @@
+#include "StateCache.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace mm
+{
+
+StateCache::StateCache() :
+   index_(std::make_shared<Index>()),
+   nextOrder_(0),
+   revision_(0)
+{
+}
+
+
+StateCache::KeyId
+StateCache::Intern(const std::string& device, const std::string& property)
+{
+   KeyId key;
+   if (FindKey(*LoadIndex(), device, property, key))
+      return key;
+
+   std::lock_guard<std::mutex> lock(writeMutex_);
+   std::shared_ptr<Index> newIndex;
+   key = InternLocked(newIndex, device, property);
+   if (newIndex)
+      std::atomic_store(&index_, std::shared_ptr<const Index>(newIndex));
+   return key;
+}
+
+
+void StateCache::Set(const std::string& device, const std::string& property,
+      const std::string& value, bool readOnly)
+{
+   std::lock_guard<std::mutex> lock(writeMutex_);
+   std::shared_ptr<Index> newIndex;
+   KeyId key = InternLocked(newIndex, device, property);
+   if (newIndex)
+      std::atomic_store(&index_, std::shared_ptr<const Index>(newIndex));
+   if (SetLocked(*index_->slots[key], value, readOnly))
+      revision_.fetch_add(1, std::memory_order_release);
+}
+
+
+void StateCache::Set(const PropertySetting& setting)
+{
+   Set(setting.getDeviceLabel(), setting.getPropertyName(),
+         setting.getPropertyValue(), setting.getReadOnly());
+}
+
+
+void StateCache::Set(KeyId key, const std::string& value, bool readOnly)
+{
+   std::lock_guard<std::mutex> lock(writeMutex_);
+   if (key >= index_->slots.size())
+      return;
+   if (SetLocked(*index_->slots[key], value, readOnly))
+      revision_.fetch_add(1, std::memory_order_release);
+}
+
+
+void StateCache::Replace(const Configuration& config)
+{
+   std::lock_guard<std::mutex> lock(writeMutex_);
+   std::shared_ptr<Index> newIndex;
+   std::vector<KeyId> keys;
+   keys.reserve(config.size());
+   for (std::size_t i = 0; i < config.size(); ++i)
+   {
+      const PropertySetting setting = config.getSetting(i);
+      keys.push_back(InternLocked(newIndex, setting.getDeviceLabel(),
+               setting.getPropertyName()));
+   }
+   const Index& index = newIndex ? *newIndex : *index_;
+
+   bool changed = false;
+   std::vector<bool> present(index.slots.size(), false);
+   for (std::size_t i = 0; i < config.size(); ++i)
+   {
+      const PropertySetting setting = config.getSetting(i);
+      Slot& slot = *index.slots[keys[i]];
+      std::shared_ptr<const Value> old = std::atomic_load(&slot.value);
+      if (!old || old->value != setting.getPropertyValue() ||
+            old->readOnly != setting.getReadOnly())
+         changed = true;
+      // Renumber all, so that the snapshot follows the new order
+      std::shared_ptr<Value> v = std::make_shared<Value>();
+      v->value = setting.getPropertyValue();
+      v->readOnly = setting.getReadOnly();
+      v->order = nextOrder_++;
+      std::atomic_store(&slot.value, std::shared_ptr<const Value>(v));
+      present[keys[i]] = true;
+   }
+   for (std::size_t k = 0; k < index.slots.size(); ++k)
+   {
+      if (present[k])
+         continue;
+      Slot& slot = *index.slots[k];
+      if (std::atomic_load(&slot.value))
+      {
+         std::atomic_store(&slot.value, std::shared_ptr<const Value>());
+         changed = true;
+      }
+   }
+
+   if (newIndex)
+      std::atomic_store(&index_, std::shared_ptr<const Index>(newIndex));
+   if (changed)
+      revision_.fetch_add(1, std::memory_order_release);
+}
+
+
+bool StateCache::Get(const std::string& device, const std::string& property,
+      std::string& value) const
+{
+   std::shared_ptr<const Index> index = LoadIndex();
+   KeyId key;
+   if (!FindKey(*index, device, property, key))
+      return false;
+   std::shared_ptr<const Value> v = std::atomic_load(&index->slots[key]->value);
+   if (!v)
+      return false;
+   value = v->value;
+   return true;
+}
+
+
+std::uint64_t StateCache::GetMany(const std::vector<std::string>& devices,
+      const std::vector<std::string>& properties,
+      std::vector<std::string>& values, std::vector<bool>& found) const
+{
+   // Read the revision first, so that the values are at least that recent
+   const std::uint64_t revision = GetRevision();
+   std::shared_ptr<const Index> index = LoadIndex();
+
+   const std::size_t n = std::min(devices.size(), properties.size());
+   values.assign(n, std::string());
+   found.assign(n, false);
+   for (std::size_t i = 0; i < n; ++i)
+   {
+      KeyId key;
+      if (!FindKey(*index, devices[i], properties[i], key))
+         continue;
+      std::shared_ptr<const Value> v = std::atomic_load(&index->slots[key]->value);
+      if (!v)
+         continue;
+      values[i] = v->value;
+      found[i] = true;
+   }
+   return revision;
+}
+
+
+Configuration StateCache::GetSnapshot() const
+{
+   std::shared_ptr<const Index> index = LoadIndex();
+   typedef std::pair<std::shared_ptr<const Value>, const Slot*> Entry;
+   std::vector<Entry> entries;
+   entries.reserve(index->slots.size());
+   for (std::size_t k = 0; k < index->slots.size(); ++k)
+   {
+      std::shared_ptr<const Value> v = std::atomic_load(&index->slots[k]->value);
+      if (v)
+         entries.push_back(Entry(v, index->slots[k].get()));
+   }
+   std::sort(entries.begin(), entries.end(),
+         [](const Entry& a, const Entry& b)
+         { return a.first->order < b.first->order; });
+
+   Configuration config;
+   for (std::size_t i = 0; i < entries.size(); ++i)
+   {
+      const Value& v = *entries[i].first;
+      const Slot& slot = *entries[i].second;
+      config.addSetting(PropertySetting(slot.device.c_str(),
+               slot.property.c_str(), v.value.c_str(), v.readOnly));
+   }
+   return config;
+}
+
+
+bool StateCache::FindKey(const Index& index, const std::string& device,
+      const std::string& property, KeyId& key)
+{
+   std::unordered_map<std::string, PropertyIds>::const_iterator dev =
+      index.ids.find(device);
+   if (dev == index.ids.end())
+      return false;
+   PropertyIds::const_iterator prop = dev->second.find(property);
+   if (prop == dev->second.end())
+      return false;
+   key = prop->second;
+   return true;
+}
+
+
+StateCache::KeyId
+StateCache::InternLocked(std::shared_ptr<Index>& newIndex,
+      const std::string& device, const std::string& property)
+{
+   KeyId key;
+   if (FindKey(newIndex ? *newIndex : *index_, device, property, key))
+      return key;
+
+   // Readers may be using the published index, so add to a copy
+   if (!newIndex)
+      newIndex = std::make_shared<Index>(*index_);
+   key = newIndex->slots.size();
+   newIndex->slots.push_back(std::make_shared<Slot>(device, property));
+   newIndex->ids[device][property] = key;
+   return key;
+}
+
+
+bool StateCache::SetLocked(Slot& slot, const std::string& value,
+      bool readOnly)
+{
+   std::shared_ptr<const Value> old = std::atomic_load(&slot.value);
+   if (old && old->value == value && old->readOnly == readOnly)
+      return false;
+   std::shared_ptr<Value> v = std::make_shared<Value>();
+   v->value = value;
+   v->readOnly = readOnly;
+   v->order = old ? old->order : nextOrder_++;
+   std::atomic_store(&slot.value, std::shared_ptr<const Value>(v));
+   return true;
+}
+
+} // namespace mm
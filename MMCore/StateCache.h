@@ -0,0 +1,110 @@
+// The system state cache: the last-set or last-read value of each device
+// property, with a revision number that is incremented whenever a value
+// changes.
+//
+// Keys (device label and property name) are interned into slots that are
+// never removed. Readers find a slot through an immutable index and read its
+// current value without taking the writer lock, so that frequent cache
+// reads from the GUI or scripts do not contend with each other or with
+// property updates from device threads.
+
+#pragma once
+
+#include "Configuration.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mm
+{
+
+class StateCache
+{
+public:
+   typedef std::size_t KeyId;
+
+   StateCache();
+
+   StateCache(const StateCache&) = delete;
+   StateCache& operator=(const StateCache&) = delete;
+
+   // Returns the id for the key, creating it (with no value) if new. Ids
+   // stay valid for the lifetime of the cache.
+   KeyId Intern(const std::string& device, const std::string& property);
+
+   void Set(const std::string& device, const std::string& property,
+         const std::string& value, bool readOnly = false);
+   void Set(const PropertySetting& setting);
+   void Set(KeyId key, const std::string& value, bool readOnly = false);
+
+   // Replaces the whole contents, as a single revision
+   void Replace(const Configuration& config);
+
+   bool Get(const std::string& device, const std::string& property,
+         std::string& value) const;
+
+   // Looks up devices.size() keys; found[i] is false for keys with no
+   // value. Returns the revision current before the values were read.
+   std::uint64_t GetMany(const std::vector<std::string>& devices,
+         const std::vector<std::string>& properties,
+         std::vector<std::string>& values, std::vector<bool>& found) const;
+
+   // All values, in order of first insertion (like Configuration::addSetting)
+   Configuration GetSnapshot() const;
+
+   std::uint64_t GetRevision() const
+   { return revision_.load(std::memory_order_acquire); }
+
+private:
+   struct Value
+   {
+      std::string value;
+      bool readOnly;
+      std::uint64_t order; // Position in GetSnapshot()
+   };
+
+   struct Slot
+   {
+      Slot(const std::string& d, const std::string& p) :
+         device(d), property(p)
+      {}
+
+      const std::string device;
+      const std::string property;
+      // Null if the key has no value; access with std::atomic_load/store
+      std::shared_ptr<const Value> value;
+   };
+
+   typedef std::unordered_map<std::string, KeyId> PropertyIds;
+
+   // Immutable once published; copied to add keys
+   struct Index
+   {
+      std::unordered_map<std::string, PropertyIds> ids;
+      std::vector<std::shared_ptr<Slot> > slots;
+   };
+
+   std::shared_ptr<const Index> LoadIndex() const
+   { return std::atomic_load(&index_); }
+
+   static bool FindKey(const Index& index, const std::string& device,
+         const std::string& property, KeyId& key);
+
+   // Caller must hold writeMutex_
+   KeyId InternLocked(std::shared_ptr<Index>& newIndex,
+         const std::string& device, const std::string& property);
+   bool SetLocked(Slot& slot, const std::string& value, bool readOnly);
+
+   std::mutex writeMutex_;
+   std::shared_ptr<const Index> index_; // Access with std::atomic_load/store
+   std::uint64_t nextOrder_; // Guarded by writeMutex_
+   std::atomic<std::uint64_t> revision_;
+};
+
+} // namespace mm
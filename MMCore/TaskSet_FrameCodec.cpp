@@ -0,0 +1,157 @@
+#include "TaskSet_FrameCodec.h"
+
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+
+size_t ChunkCount(size_t bytes)
+{
+    return (bytes + mm::codec::ChunkBytes - 1) / mm::codec::ChunkBytes;
+}
+
+size_t HeaderSize(size_t chunkCount)
+{
+    return sizeof(uint32_t) * (1 + chunkCount);
+}
+
+void PutUInt32(unsigned char* dst, size_t value)
+{
+    const uint32_t v = static_cast<uint32_t>(value);
+    std::memcpy(dst, &v, sizeof(v));
+}
+
+size_t GetUInt32(const unsigned char* src)
+{
+    uint32_t v;
+    std::memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+} // anonymous namespace
+
+TaskSet_FrameCodec::ATask::ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount)
+    : Task(semDone, taskIndex, totalTaskCount)
+{
+}
+
+void TaskSet_FrameCodec::ATask::SetUp(bool compress, unsigned elementSize, std::vector<Chunk>* chunks, size_t usedTaskCount)
+{
+    compress_ = compress;
+    elementSize_ = elementSize;
+    chunks_ = chunks;
+    usedTaskCount_ = usedTaskCount;
+}
+
+void TaskSet_FrameCodec::ATask::Execute()
+{
+    if (taskIndex_ >= usedTaskCount_)
+        return;
+
+    for (size_t i = taskIndex_; i < chunks_->size(); i += usedTaskCount_)
+    {
+        Chunk& chunk = (*chunks_)[i];
+        if (compress_)
+            chunk.result = mm::codec::CompressChunk(chunk.src, chunk.srcBytes, elementSize_, chunk.dst, scratch_);
+        else
+            chunk.result = mm::codec::DecompressChunk(chunk.src, chunk.srcBytes, chunk.dst, chunk.dstBytes, elementSize_, scratch_);
+    }
+}
+
+TaskSet_FrameCodec::TaskSet_FrameCodec(std::shared_ptr<ThreadPool> pool)
+    : TaskSet(pool)
+{
+    CreateTasks<ATask>();
+}
+
+size_t TaskSet_FrameCodec::MaxCompressedSize(size_t bytes)
+{
+    return HeaderSize(ChunkCount(bytes)) + bytes;
+}
+
+size_t TaskSet_FrameCodec::Compress(const unsigned char* src, size_t bytes, unsigned elementSize, unsigned char* dst)
+{
+    assert(elementSize > 0 && bytes % elementSize == 0);
+
+    // Each chunk is compressed in place of its raw-size slot, then the
+    // chunks are moved together
+    const size_t chunkCount = ChunkCount(bytes);
+    const size_t header = HeaderSize(chunkCount);
+    chunks_.resize(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        const size_t offset = i * mm::codec::ChunkBytes;
+        Chunk& chunk = chunks_[i];
+        chunk.src = src + offset;
+        chunk.srcBytes = std::min(mm::codec::ChunkBytes, bytes - offset);
+        chunk.dst = dst + header + offset;
+        chunk.dstBytes = chunk.srcBytes;
+        chunk.result = 0;
+    }
+    Run(true, elementSize);
+
+    PutUInt32(dst, chunkCount);
+    size_t size = header;
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        PutUInt32(dst + sizeof(uint32_t) * (1 + i), chunks_[i].result);
+        if (dst + size != chunks_[i].dst)
+            std::memmove(dst + size, chunks_[i].dst, chunks_[i].result);
+        size += chunks_[i].result;
+    }
+    return size;
+}
+
+bool TaskSet_FrameCodec::Decompress(const unsigned char* src, size_t srcBytes, unsigned char* dst, size_t bytes, unsigned elementSize)
+{
+    const size_t chunkCount = ChunkCount(bytes);
+    const size_t header = HeaderSize(chunkCount);
+    if (srcBytes < header || GetUInt32(src) != chunkCount)
+        return false;
+
+    chunks_.resize(chunkCount);
+    size_t offset = header;
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        Chunk& chunk = chunks_[i];
+        chunk.src = src + offset;
+        chunk.srcBytes = GetUInt32(src + sizeof(uint32_t) * (1 + i));
+        chunk.dst = dst + i * mm::codec::ChunkBytes;
+        chunk.dstBytes = std::min(mm::codec::ChunkBytes, bytes - i * mm::codec::ChunkBytes);
+        chunk.result = 0;
+        offset += chunk.srcBytes;
+        if (offset > srcBytes)
+            return false;
+    }
+    Run(false, elementSize);
+
+    for (const Chunk& chunk : chunks_)
+    {
+        if (!chunk.result)
+            return false;
+    }
+    return true;
+}
+
+void TaskSet_FrameCodec::Run(bool compress, unsigned elementSize)
+{
+    usedTaskCount_ = std::min(chunks_.size(), tasks_.size());
+    if (usedTaskCount_ == 0)
+        return;
+
+    for (Task* task : tasks_)
+        static_cast<ATask*>(task)->SetUp(compress, elementSize, &chunks_, usedTaskCount_);
+
+    if (usedTaskCount_ == 1)
+    {
+        tasks_[0]->Execute(); // Not worth a thread switch
+        return;
+    }
+    TaskSet::Execute();
+    TaskSet::Wait();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TaskSet.h"
+
+#include <vector>
+
+// Compresses and decompresses whole frames with the chunk codec in
+// FrameCodec.h, processing chunks in parallel on the thread pool.
+//
+// A compressed frame starts with the chunk count and the compressed size of
+// each chunk (32-bit integers), followed by the compressed chunks.
+class TaskSet_FrameCodec : public TaskSet
+{
+private:
+    struct Chunk
+    {
+        const unsigned char* src;
+        size_t srcBytes;
+        unsigned char* dst;
+        size_t dstBytes;
+        size_t result; // Compressed size, or whether decompression succeeded
+    };
+
+    class ATask : public Task
+    {
+    public:
+        explicit ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount);
+
+        void SetUp(bool compress, unsigned elementSize, std::vector<Chunk>* chunks, size_t usedTaskCount);
+
+        virtual void Execute() override;
+
+    private:
+        bool compress_{ true };
+        unsigned elementSize_{ 1 };
+        std::vector<Chunk>* chunks_{ nullptr };
+        std::vector<unsigned char> scratch_{};
+    };
+
+public:
+    explicit TaskSet_FrameCodec(std::shared_ptr<ThreadPool> pool);
+
+    static size_t MaxCompressedSize(size_t bytes);
+
+    // Blocking; dst must have room for MaxCompressedSize(bytes). Returns the
+    // compressed size.
+    size_t Compress(const unsigned char* src, size_t bytes, unsigned elementSize, unsigned char* dst);
+
+    // Blocking; bytes is the raw size. Returns false if the data is corrupt.
+    bool Decompress(const unsigned char* src, size_t srcBytes, unsigned char* dst, size_t bytes, unsigned elementSize);
+
+private:
+    void Run(bool compress, unsigned elementSize);
+
+    std::vector<Chunk> chunks_{};
+};
@@ -0,0 +1,264 @@
+#include "Tracing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace mm
+{
+namespace tracing
+{
+
+const char* const CategoryDevice = "device";
+const char* const CategoryLock = "lock";
+const char* const CategoryCallback = "callback";
+const char* const CategoryBuffer = "buffer";
+
+namespace detail
+{
+std::atomic<bool> enabled(false);
+} // namespace detail
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Event
+{
+   const char* category;
+   const char* name;
+   std::int64_t beginNs; // Relative to the trace origin
+   std::int64_t durationNs;
+   char detail[40];
+};
+
+// Written only by its thread; read by WriteChromeTrace() after Stop()
+struct ThreadBuffer
+{
+   ThreadBuffer(std::uint32_t gen, int id, std::size_t capacity) :
+      generation(gen), threadId(id), events(capacity), count(0), writing(false)
+   {}
+
+   const std::uint32_t generation;
+   const int threadId;
+   std::vector<Event> events;
+   std::atomic<std::uint64_t> count; // Total recorded, including overwritten
+   std::atomic<bool> writing; // An event is being written at events[count]
+};
+
+struct State
+{
+   std::mutex mutex; // Guards the members below, not the buffer contents
+   std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+   std::size_t eventsPerThread = 0;
+   int nextThreadId = 1;
+};
+
+State& GetState()
+{
+   static State state;
+   return state;
+}
+
+// Written under State::mutex while tracing is disabled; read by recording
+// threads after observing detail::enabled
+std::atomic<std::uint32_t> generation(0);
+std::atomic<Clock::rep> origin(0); // Clock ticks since the epoch
+
+thread_local std::shared_ptr<ThreadBuffer> threadBuffer;
+
+ThreadBuffer* GetThreadBuffer()
+{
+   const std::uint32_t gen = generation.load(std::memory_order_acquire);
+   if (!threadBuffer || threadBuffer->generation != gen)
+   {
+      State& state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (generation.load(std::memory_order_relaxed) != gen)
+         return nullptr; // Restarted meanwhile; drop this span
+      try
+      {
+         std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>(
+               gen, state.nextThreadId, state.eventsPerThread);
+         state.buffers.push_back(buffer);
+         ++state.nextThreadId;
+         threadBuffer = buffer;
+      }
+      catch (const std::bad_alloc&)
+      {
+         // Called from Span destructors, which must not throw; drop the span
+         return nullptr;
+      }
+   }
+   return threadBuffer.get();
+}
+
+std::int64_t NsSinceOrigin(Clock::time_point t)
+{
+   const Clock::time_point start(Clock::duration(
+            origin.load(std::memory_order_relaxed)));
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         t - start).count();
+}
+
+void WriteJsonString(std::ostream& out, const char* s)
+{
+   out << '"';
+   for (; *s; ++s)
+   {
+      const unsigned char ch = static_cast<unsigned char>(*s);
+      if (ch == '"' || ch == '\\')
+         out << '\\' << *s;
+      else if (ch < 0x20)
+      {
+         char buf[8];
+         std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+         out << buf;
+      }
+      else
+         out << *s;
+   }
+   out << '"';
+}
+
+// Microseconds with nanosecond resolution, as used by the trace format
+void WriteMicroseconds(std::ostream& out, std::int64_t ns)
+{
+   char buf[32];
+   std::snprintf(buf, sizeof(buf), "%lld.%03d",
+         static_cast<long long>(ns / 1000), static_cast<int>(ns % 1000));
+   out << buf;
+}
+
+} // anonymous namespace
+
+
+void Start(std::size_t eventsPerThread)
+{
+   State& state = GetState();
+   std::lock_guard<std::mutex> lock(state.mutex);
+   detail::enabled.store(false, std::memory_order_relaxed);
+   state.buffers.clear();
+   state.eventsPerThread = std::min(std::max<std::size_t>(eventsPerThread, 1),
+         MaxEventsPerThread);
+   state.nextThreadId = 1;
+   origin.store(Clock::now().time_since_epoch().count(),
+         std::memory_order_relaxed);
+   generation.fetch_add(1, std::memory_order_release);
+   detail::enabled.store(true, std::memory_order_release);
+}
+
+
+void Stop()
+{
+   // Sequentially consistent, so that a span being recorded concurrently
+   // either sees tracing disabled or is seen by WriteChromeTrace() as writing
+   detail::enabled.store(false);
+}
+
+
+std::size_t WriteChromeTrace(std::ostream& out)
+{
+   State& state = GetState();
+   std::lock_guard<std::mutex> lock(state.mutex);
+   const std::uint32_t gen = generation.load(std::memory_order_relaxed);
+
+   std::size_t spans = 0;
+   std::uint64_t overwritten = 0;
+   bool first = true;
+   out << "{\"traceEvents\":[";
+   for (std::size_t b = 0; b < state.buffers.size(); ++b)
+   {
+      const ThreadBuffer& buffer = *state.buffers[b];
+      if (buffer.generation != gen)
+         continue;
+      // Read before the count: if no span is being written now, none can
+      // start after Stop()
+      const bool writing = buffer.writing.load();
+      const std::uint64_t count = buffer.count.load(std::memory_order_acquire);
+      const std::uint64_t cap = buffer.events.size();
+      std::uint64_t begin = 0;
+      if (count > cap)
+      {
+         // A span that was being recorded at Stop() may still be overwriting
+         // the oldest slot, so skip it
+         begin = count - cap + (writing ? 1 : 0);
+         overwritten += begin;
+      }
+
+      if (!first)
+         out << ',';
+      first = false;
+      out << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" <<
+         buffer.threadId << ",\"args\":{\"name\":\"Thread " <<
+         buffer.threadId << "\"}}";
+
+      for (std::uint64_t i = begin; i < count; ++i)
+      {
+         const Event& e = buffer.events[i % cap];
+         out << ",\n{\"ph\":\"X\",\"cat\":";
+         WriteJsonString(out, e.category);
+         out << ",\"name\":";
+         WriteJsonString(out, e.name);
+         out << ",\"pid\":1,\"tid\":" << buffer.threadId << ",\"ts\":";
+         WriteMicroseconds(out, e.beginNs);
+         out << ",\"dur\":";
+         WriteMicroseconds(out, e.durationNs);
+         if (e.detail[0] != '\0')
+         {
+            out << ",\"args\":{\"device\":";
+            WriteJsonString(out, e.detail);
+            out << '}';
+         }
+         out << '}';
+         ++spans;
+      }
+   }
+   out << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"overwrittenSpans\":" <<
+      overwritten << "}}\n";
+   return spans;
+}
+
+
+void RecordSpan(const char* category, const char* name, const char* detail,
+      Clock::time_point begin, Clock::time_point end)
+{
+   if (!detail::enabled.load(std::memory_order_acquire))
+      return;
+   ThreadBuffer* buffer = GetThreadBuffer();
+   if (!buffer)
+      return;
+
+   // Clip spans that began before Start()
+   std::int64_t beginNs = NsSinceOrigin(begin);
+   std::int64_t endNs = NsSinceOrigin(end);
+   if (endNs < 0)
+      return;
+   beginNs = std::max<std::int64_t>(beginNs, 0);
+
+   buffer->writing.store(true);
+   if (!detail::enabled.load())
+   {
+      buffer->writing.store(false, std::memory_order_release);
+      return; // Stopped meanwhile
+   }
+
+   const std::uint64_t index = buffer->count.load(std::memory_order_relaxed);
+   Event& e = buffer->events[index % buffer->events.size()];
+   e.category = category;
+   e.name = name;
+   e.beginNs = beginNs;
+   e.durationNs = endNs - beginNs;
+   std::strncpy(e.detail, detail ? detail : "", sizeof(e.detail) - 1);
+   e.detail[sizeof(e.detail) - 1] = '\0';
+   buffer->count.store(index + 1, std::memory_order_release);
+   buffer->writing.store(false, std::memory_order_release);
+}
+
+} // namespace tracing
+} // namespace mm
@@ -0,0 +1,98 @@
+// Opt-in, process-wide tracing of time spent in device calls, module locks,
+// device callbacks, and the sequence buffer, for export in the Chrome trace
+// event format (viewable in chrome://tracing or Perfetto).
+//
+// Each thread records completed spans into its own fixed-size ring buffer,
+// without locking; when a buffer is full, the oldest spans are overwritten.
+// When tracing is off, a span costs one relaxed atomic load.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace mm
+{
+namespace tracing
+{
+
+// Span categories
+extern const char* const CategoryDevice; // Calls into device adapters
+extern const char* const CategoryLock; // Waiting for a module lock
+extern const char* const CategoryCallback; // Calls from devices to the Core
+extern const char* const CategoryBuffer; // Sequence buffer insert and pop
+
+namespace detail
+{
+extern std::atomic<bool> enabled;
+} // namespace detail
+
+inline bool IsEnabled()
+{ return detail::enabled.load(std::memory_order_relaxed); }
+
+// Upper limit for Start()'s eventsPerThread (about 80 MB per thread)
+const std::size_t MaxEventsPerThread = 1 << 20;
+
+// Discards any previous trace and starts recording, keeping up to
+// eventsPerThread (at most MaxEventsPerThread) of the most recent spans for
+// each thread.
+void Start(std::size_t eventsPerThread);
+
+// Stops recording; the recorded spans are kept until the next Start().
+void Stop();
+
+// Writes the spans recorded since the last Start() as a Chrome trace event
+// JSON object. Call after Stop(). Returns the number of spans written.
+std::size_t WriteChromeTrace(std::ostream& out);
+
+// Records a span that has already completed. name and category must point
+// to strings with static storage duration; detail (e.g. a device label) is
+// copied and may be truncated.
+void RecordSpan(const char* category, const char* name, const char* detail,
+      std::chrono::steady_clock::time_point begin,
+      std::chrono::steady_clock::time_point end);
+
+
+// Records the time from construction to destruction, if tracing is enabled
+// at construction. The strings must remain valid until destruction (name
+// and category must be static).
+class Span
+{
+   const char* category_;
+   const char* name_;
+   const char* detail_;
+   std::chrono::steady_clock::time_point begin_;
+   bool active_;
+
+public:
+   Span(const char* category, const char* name, const char* detail = "") :
+      category_(category),
+      name_(name),
+      detail_(detail),
+      active_(IsEnabled())
+   {
+      if (active_)
+         begin_ = std::chrono::steady_clock::now();
+   }
+
+   Span(const char* category, const char* name, const std::string& detail) :
+      Span(category, name, detail.c_str())
+   {}
+
+   Span(const Span&) = delete;
+   Span& operator=(const Span&) = delete;
+
+   ~Span()
+   {
+      if (active_)
+         RecordSpan(category_, name_, detail_, begin_,
+               std::chrono::steady_clock::now());
+   }
+};
+
+} // namespace tracing
+} // namespace mm
@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include "AsyncOperations.h"
+#include "Error.h"
+#include "ErrorCodes.h"
+#include "MMCore.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using mm::AsyncOperations;
+
+namespace
+{
+
+const std::chrono::milliseconds pollInterval(1);
+const std::chrono::milliseconds longTimeout(5000);
+
+// A fake device that stays busy until released
+struct FakeMove
+{
+   std::shared_ptr<std::atomic<bool> > busy =
+      std::make_shared<std::atomic<bool> >(true);
+
+   AsyncOperations::BusyFunction BusyFunction() const
+   {
+      std::shared_ptr<std::atomic<bool> > b = busy;
+      return [b]() { return b->load(); };
+   }
+
+   void Finish() { *busy = false; }
+};
+
+} // anonymous namespace
+
+
+TEST(AsyncOperationsTests, CompletesWhenNotBusy)
+{
+   AsyncOperations ops(pollInterval);
+   FakeMove move;
+   long handle = ops.Add("Stage", move.BusyFunction());
+   EXPECT_FALSE(ops.IsComplete(handle));
+   EXPECT_FALSE(ops.WaitForAll(std::vector<long>(1, handle),
+            std::chrono::milliseconds(20)));
+   EXPECT_EQ(std::vector<std::string>(1, "Stage"),
+         ops.GetPending(std::vector<long>(1, handle)));
+
+   move.Finish();
+   EXPECT_TRUE(ops.WaitForAll(std::vector<long>(1, handle), longTimeout));
+   EXPECT_THROW(ops.IsComplete(handle), CMMError); // Released
+}
+
+TEST(AsyncOperationsTests, WaitsForAllInParallel)
+{
+   AsyncOperations ops(pollInterval);
+   FakeMove xy, z;
+   std::vector<long> handles;
+   handles.push_back(ops.Add("XY", xy.BusyFunction()));
+   handles.push_back(ops.Add("Z", z.BusyFunction()));
+   EXPECT_NE(handles[0], handles[1]);
+
+   z.Finish();
+   EXPECT_FALSE(ops.WaitForAll(handles, std::chrono::milliseconds(20)));
+   EXPECT_EQ(std::vector<std::string>(1, "XY"), ops.GetPending(handles));
+
+   xy.Finish();
+   EXPECT_TRUE(ops.WaitForAll(handles, longTimeout));
+}
+
+TEST(AsyncOperationsTests, ReportedCompletionReleasesHandle)
+{
+   AsyncOperations ops(pollInterval);
+   FakeMove move;
+   long handle = ops.Add("Stage", move.BusyFunction());
+   EXPECT_FALSE(ops.IsComplete(handle));
+   EXPECT_FALSE(ops.IsComplete(handle)); // Still valid
+
+   move.Finish();
+   while (!ops.IsComplete(handle))
+      std::this_thread::sleep_for(pollInterval);
+   EXPECT_THROW(ops.IsComplete(handle), CMMError); // Released
+   EXPECT_THROW(ops.WaitForAll(std::vector<long>(1, handle), longTimeout),
+         CMMError);
+
+   long failing = ops.Add("Bad", []() -> bool {
+      throw CMMError("Device went away");
+   });
+   bool threw = false;
+   for (int i = 0; i < 5000 && !threw; ++i)
+   {
+      try
+      {
+         EXPECT_FALSE(ops.IsComplete(failing));
+         std::this_thread::sleep_for(pollInterval);
+      }
+      catch (const CMMError& e)
+      {
+         EXPECT_EQ("Device went away", e.getMsg());
+         threw = true;
+      }
+   }
+   EXPECT_TRUE(threw);
+   EXPECT_THROW(ops.IsComplete(failing), CMMError); // Released
+}
+
+TEST(AsyncOperationsTests, FailureIsRethrown)
+{
+   AsyncOperations ops(pollInterval);
+   long failing = ops.Add("Bad", []() -> bool {
+      throw CMMError("Device went away");
+   });
+   FakeMove other;
+   other.Finish();
+   long ok = ops.Add("Good", other.BusyFunction());
+
+   std::vector<long> handles;
+   handles.push_back(ok);
+   handles.push_back(failing);
+   try
+   {
+      ops.WaitForAll(handles, longTimeout);
+      FAIL() << "Expected CMMError";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ("Device went away", e.getMsg());
+   }
+   EXPECT_THROW(ops.IsComplete(ok), CMMError); // Released despite failure
+}
+
+TEST(AsyncOperationsTests, InvalidHandle)
+{
+   AsyncOperations ops(pollInterval);
+   try
+   {
+      ops.IsComplete(42);
+      FAIL() << "Expected CMMError";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_InvalidAsyncHandle, e.getCode());
+   }
+   EXPECT_THROW(ops.WaitForAll(std::vector<long>(1, 42), longTimeout),
+         CMMError);
+   EXPECT_TRUE(ops.WaitForAll(std::vector<long>(), longTimeout));
+}
+
+TEST(AsyncOperationsTests, ClearWhilePending)
+{
+   AsyncOperations ops(pollInterval);
+   FakeMove move;
+   long handle = ops.Add("Stage", move.BusyFunction());
+   ops.Clear();
+   EXPECT_THROW(ops.IsComplete(handle), CMMError);
+}
+
+TEST(AsyncOperationsTests, CoreRejectsInvalidHandles)
+{
+   CMMCore c;
+   EXPECT_THROW(c.isAsyncOperationComplete(0), CMMError);
+   EXPECT_THROW(c.waitForAll(std::vector<long>(1, 0)), CMMError);
+   EXPECT_THROW(c.waitForAll(std::vector<long>(), -1.0), CMMError);
+   EXPECT_TRUE(c.waitForAll(std::vector<long>(), 0.0));
+   EXPECT_THROW(c.setXYPositionAsync(1.0, 2.0), CMMError); // No XY stage
+   c.unloadAllDevices();
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
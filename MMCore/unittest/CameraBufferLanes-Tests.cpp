@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "CameraBufferLanes.h"
+#include "CircularBuffer.h"
+#include "MMCore.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mm::CameraBufferLanes;
+
+
+namespace
+{
+
+// The circular buffer numbers images per camera, so requires the tag that
+// the core adds
+Metadata CameraMetadata(const std::string& label)
+{
+   Metadata md;
+   md.put("Camera", label);
+   return md;
+}
+
+} // anonymous namespace
+
+
+TEST(CameraBufferLanesTests, AddFindRemove)
+{
+   CameraBufferLanes lanes;
+   EXPECT_TRUE(lanes.IsEmpty());
+   EXPECT_FALSE(lanes.Find("Cam"));
+
+   std::shared_ptr<CircularBuffer> buffer = std::make_shared<CircularBuffer>(1);
+   lanes.Add("Cam", buffer);
+   EXPECT_FALSE(lanes.IsEmpty());
+   EXPECT_EQ(buffer, lanes.Find("Cam"));
+   EXPECT_FALSE(lanes.Find("Other"));
+   EXPECT_EQ(std::vector<std::string>(1, "Cam"), lanes.GetCameraLabels());
+
+   std::shared_ptr<CircularBuffer> replacement =
+      std::make_shared<CircularBuffer>(1);
+   lanes.Add("Cam", replacement);
+   EXPECT_EQ(replacement, lanes.Find("Cam"));
+
+   EXPECT_TRUE(lanes.Remove("Cam"));
+   EXPECT_FALSE(lanes.Remove("Cam"));
+   EXPECT_TRUE(lanes.IsEmpty());
+}
+
+TEST(CameraBufferLanesTests, LaneOutlivesRemoval)
+{
+   CameraBufferLanes lanes;
+   lanes.Add("Cam", std::make_shared<CircularBuffer>(1));
+   std::shared_ptr<CircularBuffer> lane = lanes.Find("Cam");
+   lanes.Clear();
+   ASSERT_TRUE(lane->Initialize(1, 16, 16, 1));
+   EXPECT_GT(lane->GetSize(), 0u);
+}
+
+TEST(CameraBufferLanesTests, LanesHaveIndependentGeometry)
+{
+   CameraBufferLanes lanes;
+   lanes.Add("Small", std::make_shared<CircularBuffer>(1));
+   lanes.Add("Large", std::make_shared<CircularBuffer>(4));
+   ASSERT_TRUE(lanes.Find("Small")->Initialize(1, 32, 16, 1));
+   ASSERT_TRUE(lanes.Find("Large")->Initialize(1, 256, 128, 2));
+
+   const unsigned imagesPerCamera = 8;
+   std::vector<std::thread> cameras;
+   cameras.emplace_back([&]() {
+      std::vector<unsigned char> pixels(32 * 16, 1);
+      const Metadata md = CameraMetadata("Small");
+      for (unsigned i = 0; i < imagesPerCamera; ++i)
+         lanes.Find("Small")->InsertImage(pixels.data(), 32, 16, 1, &md);
+   });
+   cameras.emplace_back([&]() {
+      std::vector<unsigned char> pixels(256 * 128 * 2, 2);
+      const Metadata md = CameraMetadata("Large");
+      for (unsigned i = 0; i < imagesPerCamera; ++i)
+         lanes.Find("Large")->InsertImage(pixels.data(), 256, 128, 2, &md);
+   });
+   for (std::thread& t : cameras)
+      t.join();
+
+   std::shared_ptr<CircularBuffer> small = lanes.Find("Small");
+   std::shared_ptr<CircularBuffer> large = lanes.Find("Large");
+   EXPECT_EQ(imagesPerCamera, small->GetRemainingImageCount());
+   EXPECT_EQ(imagesPerCamera, large->GetRemainingImageCount());
+   EXPECT_EQ(1, small->GetNextImage()[0]);
+   EXPECT_EQ(2, large->GetNextImage()[0]);
+
+   // An image of the wrong size is rejected by its lane only
+   std::vector<unsigned char> pixels(256 * 128 * 2);
+   const Metadata md = CameraMetadata("Large");
+   EXPECT_THROW(small->InsertImage(pixels.data(), 256, 128, 2, &md), CMMError);
+   EXPECT_TRUE(large->InsertImage(pixels.data(), 256, 128, 2, &md));
+}
+
+TEST(CameraBufferLanesTests, OverflowIsPerLane)
+{
+   CameraBufferLanes lanes;
+   lanes.Add("A", std::make_shared<CircularBuffer>(1));
+   lanes.Add("B", std::make_shared<CircularBuffer>(1));
+   std::shared_ptr<CircularBuffer> a = lanes.Find("A");
+   std::shared_ptr<CircularBuffer> b = lanes.Find("B");
+   ASSERT_TRUE(a->Initialize(1, 512, 512, 2)); // 2 images in 1 MB
+   ASSERT_TRUE(b->Initialize(1, 64, 64, 1));
+
+   std::vector<unsigned char> pixels(512 * 512 * 2);
+   const Metadata md = CameraMetadata("A");
+   bool inserted = true;
+   for (int i = 0; i < 4 && inserted; ++i)
+      inserted = a->InsertImage(pixels.data(), 512, 512, 2, &md);
+   EXPECT_FALSE(inserted);
+   EXPECT_TRUE(a->Overflow());
+   EXPECT_FALSE(b->Overflow());
+   EXPECT_EQ(b->GetSize(), b->GetFreeSize());
+}
+
+TEST(CameraBufferLanesTests, CoreRequiresLane)
+{
+   CMMCore c;
+   EXPECT_TRUE(c.getCameraBufferLanes().empty());
+   EXPECT_FALSE(c.hasCameraBufferLane("Cam"));
+   EXPECT_THROW(c.enableCameraBufferLane("Cam", 16), CMMError);
+   EXPECT_THROW(c.disableCameraBufferLane("Cam"), CMMError);
+
+   try
+   {
+      c.popNextImage("Cam");
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_NoCameraBufferLane, e.getCode());
+   }
+   EXPECT_THROW(c.getRemainingImageCount("Cam"), CMMError);
+   EXPECT_THROW(c.isBufferOverflowed("Cam"), CMMError);
+   EXPECT_THROW(c.clearCircularBuffer("Cam"), CMMError);
+   EXPECT_THROW(c.popNextImage(static_cast<const char*>(0)), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
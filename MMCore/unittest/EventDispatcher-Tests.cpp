@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+
+#include "EventDispatcher.h"
+#include "MMCore.h"
+#include "MMEventCallback.h"
+#include "PerformanceMetrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mm::EventDispatcher;
+
+
+namespace
+{
+
+// Records events; can be blocked to simulate a slow listener
+class RecordingCallback : public MMEventCallback
+{
+   std::mutex mutex_;
+   std::condition_variable cv_;
+   bool blocked_ = false;
+   bool inCallback_ = false;
+   std::vector<std::string> events_;
+   std::vector<std::thread::id> threads_;
+
+   void Record(const std::string& event)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      inCallback_ = true;
+      cv_.notify_all();
+      cv_.wait(lock, [this]() { return !blocked_; });
+      inCallback_ = false;
+      events_.push_back(event);
+      threads_.push_back(std::this_thread::get_id());
+      cv_.notify_all();
+   }
+
+public:
+   void onPropertyChanged(const char* name, const char* propName,
+         const char* propValue) override
+   { Record(std::string(name) + "." + propName + "=" + propValue); }
+
+   void onStagePositionChanged(char* name, double pos) override
+   { Record(std::string(name) + "@" + std::to_string(static_cast<int>(pos))); }
+
+   void onPropertiesChanged() override
+   { Record("PropertiesChanged"); }
+
+   void Block()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      blocked_ = true;
+   }
+
+   void Unblock()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      blocked_ = false;
+      cv_.notify_all();
+   }
+
+   void WaitUntilInCallback()
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return inCallback_; });
+   }
+
+   std::vector<std::string> WaitForEvents(size_t count)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, std::chrono::seconds(5),
+            [&]() { return events_.size() >= count; });
+      return events_;
+   }
+
+   std::vector<std::thread::id> Threads()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return threads_;
+   }
+};
+
+void PostStagePosition(EventDispatcher& d, const std::string& label,
+      double pos)
+{
+   d.Post(EventDispatcher::Key("StagePositionChanged", label),
+         [label, pos](MMEventCallback& cb) {
+            std::string name(label);
+            cb.onStagePositionChanged(&name[0], pos);
+         });
+}
+
+} // anonymous namespace
+
+
+class EventDispatcherTests : public ::testing::Test
+{
+protected:
+   std::shared_ptr<mm::metrics::CoreMetrics> metrics =
+      std::make_shared<mm::metrics::CoreMetrics>();
+   RecordingCallback callback;
+};
+
+TEST_F(EventDispatcherTests, SynchronousByDefault)
+{
+   EventDispatcher d(metrics);
+   EXPECT_FALSE(d.IsAsync());
+   PostStagePosition(d, "Z", 1.0); // No callback yet; dropped
+   d.SetCallback(&callback);
+   PostStagePosition(d, "Z", 2.0);
+   PostStagePosition(d, "Z", 3.0);
+   EXPECT_EQ((std::vector<std::string>{ "Z@2", "Z@3" }),
+         callback.WaitForEvents(2));
+   EXPECT_EQ(std::this_thread::get_id(), callback.Threads()[0]);
+}
+
+TEST_F(EventDispatcherTests, AsyncDeliversOnOtherThreadInOrder)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   d.SetAsync(true);
+   d.SetCoalescing(false);
+   PostStagePosition(d, "Z", 1.0);
+   PostStagePosition(d, "Z", 2.0);
+   d.Post("", [](MMEventCallback& cb) { cb.onPropertiesChanged(); });
+   EXPECT_EQ((std::vector<std::string>{ "Z@1", "Z@2", "PropertiesChanged" }),
+         callback.WaitForEvents(3));
+   EXPECT_NE(std::this_thread::get_id(), callback.Threads()[0]);
+   EXPECT_EQ(3u, metrics->callbackEventsPosted->Get());
+   EXPECT_EQ(0u, metrics->callbackEventsCoalesced->Get());
+}
+
+TEST_F(EventDispatcherTests, CoalescesWhileListenerIsBusy)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   d.SetAsync(true);
+
+   callback.Block();
+   d.Post("", [](MMEventCallback& cb) { cb.onPropertiesChanged(); });
+   callback.WaitUntilInCallback();
+
+   for (int i = 1; i <= 100; ++i)
+      PostStagePosition(d, "Z", i);
+   PostStagePosition(d, "XY", 7.0);
+   PostStagePosition(d, "Z", 200.0);
+   EXPECT_EQ(2.0, metrics->callbackQueueEvents->Get());
+   EXPECT_EQ(100u, metrics->callbackEventsCoalesced->Get());
+
+   callback.Unblock();
+   EXPECT_EQ((std::vector<std::string>{ "PropertiesChanged", "Z@200", "XY@7" }),
+         callback.WaitForEvents(3));
+}
+
+TEST_F(EventDispatcherTests, CoalescingWindow)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   d.SetAsync(true);
+   d.SetCoalescingWindow(std::chrono::milliseconds(50));
+   for (int i = 1; i <= 10; ++i)
+      PostStagePosition(d, "Z", i);
+   EXPECT_EQ(std::vector<std::string>{ "Z@10" }, callback.WaitForEvents(1));
+}
+
+TEST_F(EventDispatcherTests, SwitchingToSyncDrainsQueue)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   d.SetAsync(true);
+   d.SetCoalescingWindow(std::chrono::seconds(60));
+   PostStagePosition(d, "Z", 1.0);
+   d.SetAsync(false); // Must not wait for the window
+   EXPECT_EQ(std::vector<std::string>{ "Z@1" }, callback.WaitForEvents(1));
+}
+
+TEST_F(EventDispatcherTests, UnregisterDropsQueuedEvents)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   d.SetAsync(true);
+   d.SetCoalescingWindow(std::chrono::seconds(60));
+   PostStagePosition(d, "Z", 1.0);
+   d.SetCallback(0);
+   EXPECT_EQ(0.0, metrics->callbackQueueEvents->Get());
+
+   d.SetCallback(&callback);
+   d.SetCoalescingWindow(std::chrono::microseconds(0));
+   PostStagePosition(d, "Z", 2.0);
+   EXPECT_EQ(std::vector<std::string>{ "Z@2" }, callback.WaitForEvents(1));
+}
+
+TEST_F(EventDispatcherTests, UnregisterWaitsForSynchronousDelivery)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   callback.Block();
+   std::thread poster([&]() { PostStagePosition(d, "Z", 1.0); });
+   callback.WaitUntilInCallback();
+
+   std::future<void> unregistered = std::async(std::launch::async,
+         [&]() { d.SetCallback(0); });
+   EXPECT_EQ(std::future_status::timeout,
+         unregistered.wait_for(std::chrono::milliseconds(100)));
+
+   callback.Unblock();
+   ASSERT_EQ(std::future_status::ready,
+         unregistered.wait_for(std::chrono::seconds(5)));
+   poster.join();
+   EXPECT_EQ(std::vector<std::string>{ "Z@1" }, callback.WaitForEvents(1));
+   PostStagePosition(d, "Z", 2.0);
+   EXPECT_EQ(1u, callback.Threads().size());
+}
+
+TEST_F(EventDispatcherTests, UnregisterFromWithinSynchronousCallback)
+{
+   EventDispatcher d(metrics);
+   d.SetCallback(&callback);
+   bool called = false;
+   d.Post("", [&](MMEventCallback&) {
+      d.SetCallback(0);
+      called = true;
+   });
+   EXPECT_TRUE(called);
+   PostStagePosition(d, "Z", 1.0);
+   EXPECT_TRUE(callback.Threads().empty());
+}
+
+TEST_F(EventDispatcherTests, CoreSettings)
+{
+   CMMCore c;
+   EXPECT_FALSE(c.asyncCallbacksEnabled());
+   EXPECT_TRUE(c.callbackCoalescingEnabled());
+   EXPECT_EQ(0.0, c.getCallbackCoalescingWindowMs());
+
+   c.registerCallback(&callback);
+   c.enableAsyncCallbacks(true);
+   EXPECT_TRUE(c.asyncCallbacksEnabled());
+   c.setCallbackCoalescingWindowMs(2.5);
+   EXPECT_EQ(2.5, c.getCallbackCoalescingWindowMs());
+   EXPECT_THROW(c.setCallbackCoalescingWindowMs(-1.0), CMMError);
+
+   c.setProperty("Core", "AutoShutter", "0");
+   EXPECT_EQ(std::vector<std::string>{ "Core.AutoShutter=0" },
+         callback.WaitForEvents(1));
+   c.registerCallback(0);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,264 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "CompressedFrameQueue.h"
+#include "FrameCodec.h"
+#include "MMCore.h"
+#include "TaskSet_FrameCodec.h"
+#include "ThreadPool.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+// Dark background with a little noise and a few bright spots, like
+// fluorescence images
+std::vector<unsigned char> SparseImage(size_t bytes, unsigned elementSize,
+      unsigned seed)
+{
+   std::vector<unsigned char> image(bytes);
+   std::mt19937 rng(seed);
+   for (size_t i = 0; i + elementSize <= bytes; i += elementSize)
+   {
+      unsigned value = 100 + rng() % 4;
+      if (rng() % 1024 == 0)
+         value = rng();
+      std::memcpy(&image[i], &value, elementSize < 4 ? elementSize : 4);
+   }
+   return image;
+}
+
+std::vector<unsigned char> RandomImage(size_t bytes, unsigned seed)
+{
+   std::vector<unsigned char> image(bytes);
+   std::mt19937 rng(seed);
+   for (unsigned char& b : image)
+      b = static_cast<unsigned char>(rng());
+   return image;
+}
+
+std::vector<unsigned char> RoundTrip(TaskSet_FrameCodec& codec,
+      const std::vector<unsigned char>& image, unsigned elementSize,
+      size_t& compressedSize)
+{
+   std::vector<unsigned char> compressed(
+         TaskSet_FrameCodec::MaxCompressedSize(image.size()));
+   compressedSize = codec.Compress(image.data(), image.size(), elementSize,
+         compressed.data());
+   std::vector<unsigned char> decompressed(image.size());
+   EXPECT_TRUE(codec.Decompress(compressed.data(), compressedSize,
+            decompressed.data(), decompressed.size(), elementSize));
+   return decompressed;
+}
+
+Metadata CameraMetadata()
+{
+   Metadata md;
+   md.put("Camera", "Cam");
+   return md;
+}
+
+} // anonymous namespace
+
+
+TEST(FrameCodecTests, RoundTripsAllPixelSizes)
+{
+   TaskSet_FrameCodec codec(std::make_shared<ThreadPool>());
+   for (unsigned elementSize : { 1u, 2u, 4u, 8u })
+   {
+      // Several chunks with a partial last chunk and a partial bit-shuffle
+      // group
+      const size_t bytes = elementSize * (3 * mm::codec::ChunkBytes / 2 + 13);
+      std::vector<unsigned char> image = SparseImage(bytes, elementSize, elementSize);
+      size_t compressedSize;
+      EXPECT_EQ(image, RoundTrip(codec, image, elementSize, compressedSize));
+      EXPECT_LT(compressedSize, bytes);
+   }
+}
+
+TEST(FrameCodecTests, OtherPixelSizesAreStoredRaw)
+{
+   TaskSet_FrameCodec codec(std::make_shared<ThreadPool>());
+   std::vector<unsigned char> image(3 * 1000, 0);
+   size_t compressedSize;
+   EXPECT_EQ(image, RoundTrip(codec, image, 3, compressedSize));
+   EXPECT_EQ(TaskSet_FrameCodec::MaxCompressedSize(image.size()), compressedSize);
+}
+
+TEST(FrameCodecTests, DarkImagesCompressWell)
+{
+   TaskSet_FrameCodec codec(std::make_shared<ThreadPool>());
+   std::vector<unsigned char> image = SparseImage(1024 * 1024 * 2, 2, 1);
+   size_t compressedSize;
+   EXPECT_EQ(image, RoundTrip(codec, image, 2, compressedSize));
+   EXPECT_LT(compressedSize * 2, image.size());
+}
+
+TEST(FrameCodecTests, IncompressibleImagesAreStoredRaw)
+{
+   TaskSet_FrameCodec codec(std::make_shared<ThreadPool>());
+   std::vector<unsigned char> image = RandomImage(mm::codec::ChunkBytes + 100, 2);
+   size_t compressedSize;
+   EXPECT_EQ(image, RoundTrip(codec, image, 2, compressedSize));
+   EXPECT_EQ(TaskSet_FrameCodec::MaxCompressedSize(image.size()), compressedSize);
+}
+
+TEST(FrameCodecTests, TinyAndEmptyImages)
+{
+   TaskSet_FrameCodec codec(std::make_shared<ThreadPool>());
+   size_t compressedSize;
+   std::vector<unsigned char> tiny(3, 7);
+   EXPECT_EQ(tiny, RoundTrip(codec, tiny, 1, compressedSize));
+   std::vector<unsigned char> empty;
+   EXPECT_EQ(empty, RoundTrip(codec, empty, 1, compressedSize));
+}
+
+TEST(FrameCodecTests, CorruptDataIsRejected)
+{
+   TaskSet_FrameCodec codec(std::make_shared<ThreadPool>());
+   std::vector<unsigned char> image = SparseImage(4096, 2, 3);
+   std::vector<unsigned char> compressed(
+         TaskSet_FrameCodec::MaxCompressedSize(image.size()));
+   const size_t size = codec.Compress(image.data(), image.size(), 2,
+         compressed.data());
+   std::vector<unsigned char> out(image.size());
+
+   EXPECT_FALSE(codec.Decompress(compressed.data(), size - 1, out.data(),
+            out.size(), 2));
+   EXPECT_FALSE(codec.Decompress(compressed.data(), size, out.data(),
+            out.size() + mm::codec::ChunkBytes, 2));
+   compressed[4] ^= 0xff; // Chunk size
+   EXPECT_FALSE(codec.Decompress(compressed.data(), size, out.data(),
+            out.size(), 2));
+}
+
+TEST(CompressedFrameQueueTests, WrapsAround)
+{
+   mm::CompressedFrameQueue queue;
+   queue.Initialize(100);
+   const std::vector<unsigned char> data(60, 1);
+   const std::vector<Metadata> md(1);
+
+   ASSERT_TRUE(queue.Push(data.data(), std::vector<size_t>(1, 40), md));
+   ASSERT_TRUE(queue.Push(data.data(), std::vector<size_t>(1, 40), md));
+   EXPECT_FALSE(queue.HasRoom(30));
+   EXPECT_FALSE(queue.Push(data.data(), std::vector<size_t>(1, 30), md));
+   EXPECT_EQ(2u, queue.GetFrameCount());
+
+   queue.PopFront();
+   ASSERT_TRUE(queue.Push(data.data(), std::vector<size_t>(1, 30), md));
+   EXPECT_EQ(0u, queue.NthFromBack(0)->offset);
+   EXPECT_EQ(40u, queue.Front()->offset);
+   EXPECT_FALSE(queue.HasRoom(11));
+   EXPECT_TRUE(queue.HasRoom(10));
+   EXPECT_EQ(90u, queue.GetUsedBytes()); // Including the gap at the end
+
+   queue.Clear();
+   EXPECT_EQ(0u, queue.GetFrameCount());
+   EXPECT_EQ(nullptr, queue.Front());
+   EXPECT_FALSE(queue.HasRoom(101));
+   EXPECT_TRUE(queue.HasRoom(100));
+}
+
+TEST(CompressedBufferTests, HoldsMoreImagesThanRawBuffer)
+{
+   const unsigned width = 512, height = 512, depth = 2; // 2 raw images in 1 MB
+   CircularBuffer buffer(1);
+   buffer.SetCompression(true);
+   EXPECT_TRUE(buffer.GetCompression());
+   ASSERT_TRUE(buffer.Initialize(1, width, height, depth));
+   EXPECT_EQ(1u, buffer.GetSize()); // Assume incompressible
+   EXPECT_EQ(1.0, buffer.GetCompressionRatio());
+
+   const Metadata md = CameraMetadata();
+   std::vector<std::vector<unsigned char> > images;
+   for (unsigned i = 0; i < 6; ++i)
+   {
+      images.push_back(SparseImage(width * height * depth, depth, i));
+      ASSERT_TRUE(buffer.InsertImage(images.back().data(), width, height, depth, &md));
+   }
+   EXPECT_GT(buffer.GetCompressionRatio(), 3.0);
+   EXPECT_EQ(6u, buffer.GetRemainingImageCount());
+   EXPECT_GT(buffer.GetSize(), 6u);
+   EXPECT_EQ(buffer.GetSize() - 6, buffer.GetFreeSize());
+
+   EXPECT_EQ(0, std::memcmp(images[5].data(), buffer.GetTopImage(), images[5].size()));
+   const mm::ImgBuffer* third = buffer.GetNthFromTopImageBuffer(3, 0);
+   ASSERT_NE(nullptr, third);
+   EXPECT_EQ(0, std::memcmp(images[2].data(), third->GetPixels(), images[2].size()));
+   EXPECT_EQ("2", third->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue());
+   EXPECT_EQ("GRAY16", third->GetMetadata().GetSingleTag("PixelType").GetValue());
+
+   for (unsigned i = 0; i < 6; ++i)
+   {
+      std::shared_ptr<const mm::ImgBuffer> image = buffer.PinNextImage(0);
+      ASSERT_TRUE(image);
+      EXPECT_EQ(0, std::memcmp(images[i].data(), image->GetPixels(), images[i].size()));
+   }
+   EXPECT_EQ(nullptr, buffer.GetNextImage());
+   EXPECT_EQ(0u, buffer.GetRemainingImageCount());
+}
+
+TEST(CompressedBufferTests, Overflow)
+{
+   const unsigned width = 512, height = 512, depth = 2;
+   CircularBuffer buffer(1);
+   buffer.SetCompression(true);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, depth));
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> image = RandomImage(width * height * depth, 1);
+   ASSERT_TRUE(buffer.InsertImage(image.data(), width, height, depth, &md));
+   EXPECT_FALSE(buffer.InsertImage(image.data(), width, height, depth, &md));
+   EXPECT_TRUE(buffer.Overflow());
+   EXPECT_EQ(0u, buffer.GetFreeSize());
+
+   ASSERT_NE(nullptr, buffer.GetNextImage());
+   EXPECT_TRUE(buffer.InsertImage(image.data(), width, height, depth, &md));
+   buffer.Clear();
+   EXPECT_FALSE(buffer.Overflow());
+   EXPECT_EQ(0u, buffer.GetRemainingImageCount());
+}
+
+TEST(CompressedBufferTests, ModeChangesOnInitialize)
+{
+   CircularBuffer buffer(1);
+   ASSERT_TRUE(buffer.Initialize(1, 64, 64, 1));
+   const unsigned long rawSize = buffer.GetSize();
+   buffer.SetCompression(true);
+   EXPECT_EQ(rawSize, buffer.GetSize());
+   ASSERT_TRUE(buffer.Initialize(1, 64, 64, 1));
+   EXPECT_NE(rawSize, buffer.GetSize());
+   buffer.SetCompression(false);
+   ASSERT_TRUE(buffer.Initialize(1, 64, 64, 1));
+   EXPECT_EQ(rawSize, buffer.GetSize());
+
+   // A compressed buffer must fit at least one incompressible image
+   buffer.SetCompression(true);
+   EXPECT_FALSE(buffer.Initialize(1, 1024, 1024, 1));
+}
+
+TEST(CompressedBufferTests, CoreSetting)
+{
+   CMMCore c;
+   EXPECT_FALSE(c.getCircularBufferCompression());
+   c.setCircularBufferCompression(true);
+   EXPECT_TRUE(c.getCircularBufferCompression());
+   EXPECT_EQ(1.0, c.getCircularBufferCompressionRatio());
+   EXPECT_THROW(c.getCircularBufferCompressionRatio("Cam"), CMMError);
+   c.setCircularBufferMemoryFootprint(2);
+   EXPECT_TRUE(c.getCircularBufferCompression());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
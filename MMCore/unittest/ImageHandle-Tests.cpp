@@ -0,0 +1,370 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "ImageHandle.h"
+#include "MMCore.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+const unsigned width = 512;
+const unsigned height = 512;
+const unsigned depth = 2; // 1 MB holds 2 images
+
+class PinningTests : public ::testing::Test
+{
+protected:
+   std::unique_ptr<CircularBuffer> buffer{ new CircularBuffer(1) };
+
+   void SetUp() override
+   {
+      ASSERT_TRUE(buffer->Initialize(1, width, height, depth));
+      ASSERT_EQ(2u, buffer->GetSize());
+   }
+
+   bool Insert(unsigned char value)
+   {
+      std::vector<unsigned char> pixels(width * height * depth, value);
+      Metadata md;
+      md.put("Camera", "Cam");
+      return buffer->InsertImage(pixels.data(), width, height, depth, &md);
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(PinningTests, EmptyBuffer)
+{
+   EXPECT_FALSE(buffer->PinNextImage(0));
+   EXPECT_FALSE(buffer->PinNthFromTopImage(0, 0));
+   ASSERT_TRUE(Insert(1));
+   EXPECT_FALSE(buffer->PinNthFromTopImage(1, 0));
+   EXPECT_FALSE(buffer->PinNthFromTopImage(0, 1)); // No such channel
+}
+
+TEST_F(PinningTests, PinnedImageIsNotOverwritten)
+{
+   ASSERT_TRUE(Insert(1));
+   std::shared_ptr<const mm::ImgBuffer> pinned = buffer->PinNextImage(0);
+   ASSERT_TRUE(pinned);
+   const unsigned char* pixels = pinned->GetPixels();
+
+   // Wrap around the ring several times
+   for (unsigned char value = 2; value < 10; ++value)
+   {
+      ASSERT_TRUE(Insert(value));
+      ASSERT_NE(nullptr, buffer->GetNextImage());
+   }
+   EXPECT_EQ(pixels, pinned->GetPixels());
+   EXPECT_EQ(1, pixels[0]);
+   EXPECT_EQ(1, pixels[width * height * depth - 1]);
+   EXPECT_EQ(2u, buffer->GetSize());
+}
+
+TEST_F(PinningTests, UnpinnedSlotIsReused)
+{
+   ASSERT_TRUE(Insert(1));
+   const unsigned char* pixels = buffer->PinNextImage(0)->GetPixels();
+   ASSERT_TRUE(Insert(2));
+   ASSERT_TRUE(Insert(3));
+   EXPECT_EQ(pixels, buffer->GetTopImage());
+}
+
+TEST_F(PinningTests, PinOutlivesBuffer)
+{
+   ASSERT_TRUE(Insert(7));
+   std::shared_ptr<const mm::ImgBuffer> pinned =
+      buffer->PinNthFromTopImage(0, 0);
+   ASSERT_TRUE(pinned);
+   ASSERT_TRUE(buffer->Initialize(1, 16, 16, 1));
+   buffer.reset();
+   EXPECT_EQ(7, pinned->GetPixels()[0]);
+   EXPECT_EQ(width, pinned->Width());
+}
+
+TEST_F(PinningTests, BlockingPolicyWaitsForRelease)
+{
+   buffer->SetPinnedSlotPolicy(CircularBuffer::PinnedSlotBlock);
+   EXPECT_EQ(CircularBuffer::PinnedSlotBlock, buffer->GetPinnedSlotPolicy());
+
+   ASSERT_TRUE(Insert(1));
+   std::shared_ptr<const mm::ImgBuffer> pinned = buffer->PinNextImage(0);
+   ASSERT_TRUE(Insert(2));
+   ASSERT_NE(nullptr, buffer->GetNextImage());
+
+   // The next insert goes to the pinned slot
+   std::future<bool> inserted =
+      std::async(std::launch::async, [this]() { return Insert(3); });
+   EXPECT_EQ(std::future_status::timeout,
+         inserted.wait_for(std::chrono::milliseconds(100)));
+   EXPECT_EQ(1, pinned->GetPixels()[0]);
+
+   std::shared_ptr<const mm::ImgBuffer> copy = pinned;
+   pinned.reset();
+   EXPECT_EQ(std::future_status::timeout,
+         inserted.wait_for(std::chrono::milliseconds(50)));
+   copy.reset();
+   ASSERT_EQ(std::future_status::ready,
+         inserted.wait_for(std::chrono::seconds(5)));
+   EXPECT_TRUE(inserted.get());
+   EXPECT_EQ(3, buffer->GetTopImage()[0]);
+}
+
+class BlockedInsertTests : public PinningTests
+{
+protected:
+   std::shared_ptr<const mm::ImgBuffer> pinned;
+   std::future<bool> inserted;
+
+   // Starts an insert that waits for the pinned image
+   void SetUp() override
+   {
+      PinningTests::SetUp();
+      buffer->SetPinnedSlotPolicy(CircularBuffer::PinnedSlotBlock);
+      ASSERT_TRUE(Insert(1));
+      pinned = buffer->PinNextImage(0);
+      ASSERT_TRUE(Insert(2));
+      ASSERT_NE(nullptr, buffer->GetNextImage());
+      inserted = std::async(std::launch::async, [this]() { return Insert(3); });
+      ASSERT_EQ(std::future_status::timeout,
+            inserted.wait_for(std::chrono::milliseconds(50)));
+   }
+};
+
+TEST_F(BlockedInsertTests, SuspendingBlockingReplacesPinnedFrame)
+{
+   buffer->SuspendPinnedSlotBlocking();
+   ASSERT_EQ(std::future_status::ready,
+         inserted.wait_for(std::chrono::seconds(5)));
+   EXPECT_TRUE(inserted.get());
+   EXPECT_EQ(3, buffer->GetTopImage()[0]);
+   EXPECT_EQ(1, pinned->GetPixels()[0]);
+
+   // Inserts do not wait while suspended, and wait again once resumed
+   std::shared_ptr<const mm::ImgBuffer> second = buffer->PinNextImage(0);
+   ASSERT_TRUE(Insert(4)); // Replaces the unread slot of image 2
+   ASSERT_NE(nullptr, buffer->GetNextImage());
+   buffer->ResumePinnedSlotBlocking();
+   std::future<bool> blocked =
+      std::async(std::launch::async, [this]() { return Insert(5); });
+   EXPECT_EQ(std::future_status::timeout,
+         blocked.wait_for(std::chrono::milliseconds(50)));
+   second.reset();
+   ASSERT_EQ(std::future_status::ready,
+         blocked.wait_for(std::chrono::seconds(5)));
+   EXPECT_TRUE(blocked.get());
+}
+
+TEST_F(BlockedInsertTests, ClearFailsBlockedInsert)
+{
+   buffer->Clear();
+   ASSERT_EQ(std::future_status::ready,
+         inserted.wait_for(std::chrono::seconds(5)));
+   EXPECT_FALSE(inserted.get());
+   EXPECT_EQ(0u, buffer->GetRemainingImageCount());
+   EXPECT_EQ(1, pinned->GetPixels()[0]);
+   pinned.reset();
+   EXPECT_TRUE(Insert(4));
+   EXPECT_EQ(1u, buffer->GetRemainingImageCount());
+}
+
+TEST_F(BlockedInsertTests, ReinitializeFailsBlockedInsert)
+{
+   ASSERT_TRUE(buffer->Initialize(1, width / 2, height, depth));
+   ASSERT_EQ(std::future_status::ready,
+         inserted.wait_for(std::chrono::seconds(5)));
+   EXPECT_FALSE(inserted.get());
+   EXPECT_EQ(0u, buffer->GetRemainingImageCount());
+   EXPECT_EQ(1, pinned->GetPixels()[0]);
+}
+
+TEST_F(PinningTests, PinNextImagesTakesBatchInOrder)
+{
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images;
+   EXPECT_EQ(0u, buffer->PinNextImages(4, 0, images));
+   EXPECT_TRUE(images.empty());
+
+   ASSERT_TRUE(Insert(1));
+   ASSERT_TRUE(Insert(2));
+   EXPECT_EQ(1u, buffer->PinNextImages(1, 0, images));
+   EXPECT_EQ(1u, buffer->PinNextImages(4, 0, images));
+   ASSERT_EQ(2u, images.size());
+   EXPECT_EQ(1, images[0]->GetPixels()[0]);
+   EXPECT_EQ(2, images[1]->GetPixels()[0]);
+   EXPECT_EQ(0u, buffer->GetRemainingImageCount());
+
+   // Both slots are pinned
+   ASSERT_TRUE(Insert(3));
+   ASSERT_TRUE(Insert(4));
+   EXPECT_EQ(1, images[0]->GetPixels()[0]);
+   EXPECT_EQ(2, images[1]->GetPixels()[0]);
+}
+
+TEST_F(PinningTests, WaitForImage)
+{
+   EXPECT_FALSE(buffer->WaitForImage(std::chrono::microseconds(0)));
+   EXPECT_FALSE(buffer->WaitForImage(std::chrono::milliseconds(20)));
+
+   std::future<bool> inserted = std::async(std::launch::async, [this]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      return Insert(1);
+   });
+   const auto start = std::chrono::steady_clock::now();
+   EXPECT_TRUE(buffer->WaitForImage(std::chrono::seconds(10)));
+   EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+   EXPECT_TRUE(inserted.get());
+   EXPECT_TRUE(buffer->WaitForImage(std::chrono::microseconds(0)));
+}
+
+TEST_F(PinningTests, WaitForCompressedImage)
+{
+   buffer->SetCompression(true);
+   ASSERT_TRUE(buffer->Initialize(1, width, height, depth));
+   std::future<bool> inserted = std::async(std::launch::async, [this]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      return Insert(1);
+   });
+   EXPECT_TRUE(buffer->WaitForImage(std::chrono::seconds(10)));
+   EXPECT_TRUE(inserted.get());
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images;
+   ASSERT_EQ(1u, buffer->PinNextImages(4, 0, images));
+   EXPECT_EQ(1, images[0]->GetPixels()[0]);
+}
+
+TEST_F(PinningTests, CompressedBatchInOrder)
+{
+   buffer->SetCompression(true);
+   ASSERT_TRUE(buffer->Initialize(1, width, height, depth));
+   ASSERT_TRUE(Insert(1));
+   ASSERT_TRUE(Insert(2));
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images;
+   ASSERT_EQ(2u, buffer->PinNextImages(4, 0, images));
+   EXPECT_EQ(1, images[0]->GetPixels()[0]);
+   EXPECT_EQ(2, images[1]->GetPixels()[0]);
+   EXPECT_EQ(0u, buffer->GetRemainingImageCount());
+}
+
+TEST_F(PinningTests, PinNextImagesChecksSizeBeforeTaking)
+{
+   ASSERT_TRUE(Insert(1));
+   std::vector<std::shared_ptr<const mm::ImgBuffer> > images;
+   EXPECT_THROW(buffer->PinNextImages(4, 0, images, width * height), CMMError);
+   EXPECT_TRUE(images.empty());
+   EXPECT_EQ(1u, buffer->GetRemainingImageCount());
+   EXPECT_EQ(1u, buffer->PinNextImages(4, 0, images, width * height * depth));
+}
+
+TEST_F(PinningTests, CopyNextImagesIsContiguous)
+{
+   const std::size_t imageBytes = width * height * depth;
+   ASSERT_TRUE(Insert(1));
+   ASSERT_TRUE(Insert(2));
+   std::vector<unsigned char> pixels(2 * imageBytes, 0);
+   std::vector<Metadata> md;
+   ASSERT_EQ(2u, buffer->CopyNextImages(4, 0, std::chrono::microseconds(0),
+            pixels.data(), pixels.size(), md));
+   EXPECT_EQ(1, pixels[0]);
+   EXPECT_EQ(1, pixels[imageBytes - 1]);
+   EXPECT_EQ(2, pixels[imageBytes]);
+   EXPECT_EQ(2, pixels[2 * imageBytes - 1]);
+   ASSERT_EQ(2u, md.size());
+   EXPECT_EQ("Cam", md[0].GetSingleTag("Camera").GetValue());
+   EXPECT_EQ("Cam", md[1].GetSingleTag("Camera").GetValue());
+   EXPECT_EQ(0u, buffer->GetRemainingImageCount());
+}
+
+TEST_F(PinningTests, CopyNextImagesClampsToBufferSize)
+{
+   const std::size_t imageBytes = width * height * depth;
+   ASSERT_TRUE(Insert(1));
+   ASSERT_TRUE(Insert(2));
+   std::vector<unsigned char> pixels(imageBytes + imageBytes / 2, 0);
+   std::vector<Metadata> md;
+   ASSERT_EQ(1u, buffer->CopyNextImages(4, 0, std::chrono::microseconds(0),
+            pixels.data(), pixels.size(), md));
+   EXPECT_EQ(1, pixels[0]);
+   EXPECT_EQ(0, pixels[imageBytes]); // Not written past the images copied
+   EXPECT_EQ(1u, md.size());
+   EXPECT_EQ(1u, buffer->GetRemainingImageCount());
+}
+
+TEST_F(PinningTests, CopyNextImagesRejectsSmallBuffer)
+{
+   ASSERT_TRUE(Insert(1));
+   std::vector<unsigned char> pixels(width * height * depth - 1);
+   std::vector<Metadata> md;
+   EXPECT_THROW(buffer->CopyNextImages(1, 0, std::chrono::microseconds(0),
+            pixels.data(), pixels.size(), md), CMMError);
+   EXPECT_THROW(buffer->CopyNextImages(1, 0, std::chrono::microseconds(0),
+            nullptr, 0, md), CMMError);
+   EXPECT_TRUE(md.empty());
+   EXPECT_EQ(1u, buffer->GetRemainingImageCount());
+   EXPECT_EQ(0u, buffer->CopyNextImages(0, 0, std::chrono::microseconds(0),
+            pixels.data(), pixels.size(), md));
+}
+
+TEST(ImageHandleTests, InvalidHandle)
+{
+   ImageHandle handle;
+   EXPECT_FALSE(handle.isValid());
+   EXPECT_EQ(nullptr, handle.getPixels());
+   EXPECT_EQ(0u, handle.getWidth());
+   EXPECT_TRUE(handle.getMetadata().GetKeys().empty());
+   handle.release();
+}
+
+TEST(ImageHandleTests, CoreHandles)
+{
+   CMMCore c;
+   EXPECT_FALSE(c.getBlockOnPinnedImages());
+   c.setBlockOnPinnedImages(true);
+   EXPECT_TRUE(c.getBlockOnPinnedImages());
+
+   try
+   {
+      c.popNextImageHandle();
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_CircularBufferEmpty, e.getCode());
+   }
+   EXPECT_THROW(c.getLastImageHandle(), CMMError);
+   EXPECT_THROW(c.getNBeforeLastImageHandle(1), CMMError);
+   EXPECT_THROW(c.popNextImageHandle("Cam"), CMMError);
+}
+
+TEST(ImageHandleTests, CoreBatchPop)
+{
+   CMMCore c;
+   EXPECT_TRUE(c.popNextImages(16, 0.0).empty());
+   EXPECT_TRUE(c.popNextImages(16, 20.0).empty());
+   EXPECT_FALSE(c.waitForImage(20.0));
+   EXPECT_THROW(c.popNextImages("Cam", 16, 0.0), CMMError);
+   EXPECT_THROW(c.waitForImage("Cam", 0.0), CMMError);
+
+   // No camera, so the buffer holds no images of any size
+   std::vector<unsigned char> pixels(1024);
+   std::vector<Metadata> md(1);
+   EXPECT_THROW(c.popNextImages(1, 0.0, pixels.data(), 1024, md), CMMError);
+   EXPECT_TRUE(md.empty());
+   EXPECT_THROW(c.popNextImages("Cam", 1, 0.0, pixels.data(), 1024, md),
+         CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,264 @@
+#include <gtest/gtest.h>
+
+#include "ImageProcessingPipeline.h"
+#include "MMCore.h"
+#include "PerformanceMetrics.h"
+
+#include "../MMDevice/DeviceBase.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+// Adds 1 to every byte, taking (first byte % 4) ms for frames whose first row
+// it is given. Optionally consumes images whose first byte is odd. Records the
+// first byte of each call and the most calls seen at once.
+class IncrementProcessor : public CImageProcessorBase<IncrementProcessor>
+{
+public:
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   void GetName(char* name) const
+   {
+      CDeviceUtils::CopyLimitedString(name, "Increment");
+   }
+   bool Busy() { return false; }
+
+   int Process(unsigned char* buffer, unsigned width, unsigned height,
+         unsigned byteDepth)
+   {
+      while (blocked.load())
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      const unsigned nowActive = active.fetch_add(1) + 1;
+      unsigned previous = maxActive.load();
+      while (nowActive > previous &&
+            !maxActive.compare_exchange_weak(previous, nowActive))
+         ;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         firstBytes.push_back(buffer[0]);
+      }
+      const unsigned n = width * height * byteDepth;
+      std::this_thread::sleep_for(std::chrono::milliseconds(buffer[0] % 4));
+      for (unsigned i = 0; i < n; ++i)
+         ++buffer[i];
+      calls.fetch_add(1);
+      rows.fetch_add(height);
+      active.fetch_sub(1);
+      if (consumeOdd.load() && buffer[0] % 2 == 0)
+         return DEVICE_IMAGE_CONSUMED;
+      return DEVICE_OK;
+   }
+
+   std::atomic<bool> blocked{ false };
+   std::atomic<bool> consumeOdd{ false };
+   std::atomic<unsigned> calls{ 0 };
+   std::atomic<unsigned> rows{ 0 };
+   std::atomic<unsigned> active{ 0 };
+   std::atomic<unsigned> maxActive{ 0 };
+   std::mutex mutex;
+   std::vector<unsigned char> firstBytes;
+};
+
+const unsigned width = 16;
+const unsigned height = 10;
+
+class PipelineTests : public ::testing::Test
+{
+protected:
+   IncrementProcessor processor;
+   std::mutex mutex;
+   std::vector<mm::ImageProcessingPipeline::Frame> committed;
+   mm::ImageProcessingPipeline pipeline{
+      [this](const mm::ImageProcessingPipeline::Frame& frame) {
+         std::lock_guard<std::mutex> lock(mutex);
+         committed.push_back(frame);
+      },
+      std::make_shared<mm::metrics::CoreMetrics>() };
+
+   bool Submit(unsigned char value)
+   {
+      std::vector<unsigned char> pixels(width * height, value);
+      Metadata md;
+      md.put("Index", static_cast<long>(value));
+      return pipeline.Submit(nullptr, &processor, pixels.data(), 1, width,
+            height, 1, 1, md);
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(PipelineTests, NotRunning)
+{
+   EXPECT_FALSE(pipeline.IsRunning());
+   EXPECT_FALSE(Submit(1));
+   pipeline.Flush();
+   EXPECT_EQ(0u, pipeline.GetFramesInFlight());
+   EXPECT_EQ(0u, processor.calls.load());
+}
+
+TEST_F(PipelineTests, CommitsInSubmissionOrder)
+{
+   pipeline.Start(4, 8, 1);
+   EXPECT_TRUE(pipeline.IsRunning());
+   for (unsigned i = 0; i < 100; ++i)
+      ASSERT_TRUE(Submit(static_cast<unsigned char>(i)));
+   pipeline.Flush();
+   EXPECT_EQ(0u, pipeline.GetFramesInFlight());
+
+   ASSERT_EQ(100u, committed.size());
+   for (unsigned i = 0; i < 100; ++i)
+   {
+      EXPECT_EQ(std::to_string(i),
+            committed[i].metadata.GetSingleTag("Index").GetValue());
+      EXPECT_EQ(i + 1, committed[i].pixels[0]);
+      EXPECT_EQ(i + 1, committed[i].pixels.back());
+   }
+}
+
+TEST_F(PipelineTests, TilesCoverTheImageOnce)
+{
+   pipeline.Start(3, 4, 4);
+   for (unsigned i = 0; i < 20; ++i)
+      ASSERT_TRUE(Submit(static_cast<unsigned char>(10 * i)));
+   pipeline.Stop();
+   EXPECT_FALSE(pipeline.IsRunning());
+
+   EXPECT_EQ(20u * 4, processor.calls.load());
+   EXPECT_EQ(20u * height, processor.rows.load());
+   ASSERT_EQ(20u, committed.size());
+   for (unsigned i = 0; i < 20; ++i)
+   {
+      for (unsigned char value : committed[i].pixels)
+         ASSERT_EQ(10 * i + 1, value);
+   }
+}
+
+TEST_F(PipelineTests, MoreTilesThanRows)
+{
+   pipeline.Start(2, 2, 2 * height);
+   ASSERT_TRUE(Submit(4));
+   pipeline.Flush();
+   EXPECT_EQ(height, processor.calls.load());
+   ASSERT_EQ(1u, committed.size());
+   EXPECT_EQ(5, committed[0].pixels[width * height - 1]);
+}
+
+TEST_F(PipelineTests, FullPipelineBlocksSubmission)
+{
+   pipeline.Start(1, 2, 1);
+   processor.blocked = true;
+   ASSERT_TRUE(Submit(1));
+   ASSERT_TRUE(Submit(2));
+   EXPECT_EQ(2u, pipeline.GetFramesInFlight());
+
+   std::future<bool> submitted =
+      std::async(std::launch::async, [this]() { return Submit(3); });
+   EXPECT_EQ(std::future_status::timeout,
+         submitted.wait_for(std::chrono::milliseconds(100)));
+
+   processor.blocked = false;
+   ASSERT_EQ(std::future_status::ready,
+         submitted.wait_for(std::chrono::seconds(5)));
+   EXPECT_TRUE(submitted.get());
+   pipeline.Flush();
+   ASSERT_EQ(3u, committed.size());
+   EXPECT_EQ(4, committed[2].pixels[0]);
+}
+
+TEST_F(PipelineTests, StopCommitsFramesInFlight)
+{
+   pipeline.Start(2, 16, 1);
+   for (unsigned i = 0; i < 10; ++i)
+      ASSERT_TRUE(Submit(static_cast<unsigned char>(i)));
+   pipeline.Stop();
+   EXPECT_EQ(10u, committed.size());
+   EXPECT_FALSE(Submit(1));
+
+   pipeline.Start(1, 1, 1);
+   ASSERT_TRUE(Submit(1));
+   pipeline.Flush();
+   EXPECT_EQ(11u, committed.size());
+}
+
+TEST_F(PipelineTests, ConsumedImagesAreNotCommitted)
+{
+   processor.consumeOdd = true;
+   pipeline.Start(3, 8, 2);
+   for (unsigned i = 0; i < 20; ++i)
+      ASSERT_TRUE(Submit(static_cast<unsigned char>(i)));
+   pipeline.Flush();
+   EXPECT_EQ(0u, pipeline.GetFramesInFlight());
+
+   ASSERT_EQ(10u, committed.size());
+   for (unsigned i = 0; i < 10; ++i)
+   {
+      EXPECT_EQ(std::to_string(2 * i),
+            committed[i].metadata.GetSingleTag("Index").GetValue());
+   }
+}
+
+TEST_F(PipelineTests, AccumulatingProcessorGetsWholeImagesInOrder)
+{
+   processor.consumeOdd = true;
+   pipeline.Start(4, 16, 4);
+   ASSERT_TRUE(Submit(1)); // Consumed, in tiles
+   pipeline.Flush();
+   EXPECT_EQ(4u, processor.calls.load());
+   EXPECT_TRUE(committed.empty());
+
+   processor.calls = 0;
+   processor.rows = 0;
+   processor.maxActive = 0;
+   processor.firstBytes.clear();
+   for (unsigned i = 2; i < 42; ++i)
+      ASSERT_TRUE(Submit(static_cast<unsigned char>(i)));
+   pipeline.Flush();
+
+   EXPECT_EQ(40u, processor.calls.load());
+   EXPECT_EQ(40u * height, processor.rows.load());
+   EXPECT_EQ(1u, processor.maxActive.load());
+   ASSERT_EQ(40u, processor.firstBytes.size());
+   for (unsigned i = 0; i < 40; ++i)
+      EXPECT_EQ(i + 2, processor.firstBytes[i]);
+   ASSERT_EQ(20u, committed.size());
+   EXPECT_EQ(3, committed[0].pixels[0]);
+
+   // Restarting forgets the processor
+   pipeline.Start(2, 4, 2);
+   ASSERT_TRUE(Submit(2));
+   pipeline.Flush();
+   EXPECT_EQ(42u, processor.calls.load());
+}
+
+TEST(ImageProcessingPipelineTests, CoreSettings)
+{
+   CMMCore c;
+   EXPECT_FALSE(c.isImageProcessingPipelineEnabled());
+   EXPECT_THROW(c.enableImageProcessingPipeline(0, 4, 1), CMMError);
+   EXPECT_THROW(c.enableImageProcessingPipeline(2, 0, 1), CMMError);
+   EXPECT_THROW(c.enableImageProcessingPipeline(2, 4, 0), CMMError);
+   EXPECT_FALSE(c.isImageProcessingPipelineEnabled());
+
+   c.enableImageProcessingPipeline(2, 4, 1);
+   EXPECT_TRUE(c.isImageProcessingPipelineEnabled());
+   EXPECT_EQ(0, c.getImageProcessingPipelineDepth());
+   c.flushImageProcessingPipeline();
+   c.disableImageProcessingPipeline();
+   EXPECT_FALSE(c.isImageProcessingPipelineEnabled());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,777 @@
+// End-to-end benchmarks of MMCore, using the DemoCamera, SequenceTester and
+// TCPIPPort device adapters loaded in-process.
+//
+// Not run by 'make check', because the results depend on the machine and
+// the adapters must have been built. Build with 'make benchmarks' and run,
+// for example (on one line):
+//
+//    ./MMCore-Benchmarks --output=results.jsonl
+//       --adapter-path=../../DeviceAdapters/DemoCamera/.libs
+//       --adapter-path=../../DeviceAdapters/SequenceTester/.libs
+//       --adapter-path=../../DeviceAdapters/TCPIPPort/.libs
+//
+// Each result is written as one JSON object per line (JSON Lines), keyed by
+// "config", "benchmark" and "params", so that results from two builds can be
+// joined and compared. Durations are in microseconds. Configurations whose
+// adapter cannot be loaded are reported with "skipped"; the run fails only if
+// a benchmark fails or none was run at all. All parameters (frame sizes,
+// exposures, iteration counts) are fixed, so that runs are comparable.
+
+#include "MMCore.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double MicrosecondsSince(Clock::time_point start)
+{
+   return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+
+std::string JsonString(const std::string& s)
+{
+   std::ostringstream os;
+   os << '"';
+   for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+   {
+      const unsigned char ch = static_cast<unsigned char>(*it);
+      switch (ch)
+      {
+         case '"': os << "\\\""; break;
+         case '\\': os << "\\\\"; break;
+         case '\n': os << "\\n"; break;
+         case '\r': os << "\\r"; break;
+         case '\t': os << "\\t"; break;
+         default:
+            if (ch < 0x20)
+            {
+               char buf[8];
+               std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+               os << buf;
+            }
+            else
+               os << *it;
+      }
+   }
+   os << '"';
+   return os.str();
+}
+
+
+// Fields of one JSON object, in insertion order
+class JsonObject
+{
+public:
+   JsonObject& Add(const std::string& key, const std::string& value)
+   { return AddRaw(key, JsonString(value)); }
+   JsonObject& Add(const std::string& key, const char* value)
+   { return AddRaw(key, JsonString(value)); }
+   JsonObject& Add(const std::string& key, double value)
+   {
+      std::ostringstream os;
+      os.precision(6);
+      os << value;
+      return AddRaw(key, os.str());
+   }
+   JsonObject& Add(const std::string& key, long value)
+   { return AddRaw(key, std::to_string(value)); }
+   JsonObject& Add(const std::string& key, int value)
+   { return AddRaw(key, std::to_string(value)); }
+   JsonObject& Add(const std::string& key, const JsonObject& value)
+   { return AddRaw(key, value.Str()); }
+
+   std::string Str() const
+   {
+      std::string s = "{";
+      for (std::size_t i = 0; i < fields_.size(); ++i)
+      {
+         if (i > 0)
+            s += ", ";
+         s += JsonString(fields_[i].first) + ": " + fields_[i].second;
+      }
+      return s + "}";
+   }
+
+private:
+   JsonObject& AddRaw(const std::string& key, const std::string& json)
+   {
+      fields_.push_back(std::make_pair(key, json));
+      return *this;
+   }
+
+   std::vector<std::pair<std::string, std::string> > fields_;
+};
+
+
+// Summary statistics of a set of durations, in microseconds
+JsonObject Summarize(std::vector<double> samples)
+{
+   JsonObject o;
+   o.Add("iterations", static_cast<long>(samples.size()));
+   if (samples.empty())
+      return o;
+   std::sort(samples.begin(), samples.end());
+   auto percentile = [&samples](double p)
+   {
+      const std::size_t i = static_cast<std::size_t>(p * (samples.size() - 1) + 0.5);
+      return samples[i];
+   };
+   double sum = 0.0;
+   for (std::size_t i = 0; i < samples.size(); ++i)
+      sum += samples[i];
+   o.Add("unit", "us")
+      .Add("min", samples.front())
+      .Add("median", percentile(0.5))
+      .Add("p90", percentile(0.9))
+      .Add("p99", percentile(0.99))
+      .Add("max", samples.back())
+      .Add("mean", sum / samples.size());
+   return o;
+}
+
+
+struct Options
+{
+   std::vector<std::string> adapterPaths;
+   std::string filter;
+   std::string output;
+   bool quick = false;
+};
+
+
+class Runner
+{
+public:
+   explicit Runner(const Options& options) :
+      options_(options),
+      runs_(0),
+      failures_(0)
+   {
+      if (!options_.output.empty())
+      {
+         file_.open(options_.output.c_str());
+         if (!file_)
+            throw std::runtime_error("Cannot open " + options_.output);
+      }
+   }
+
+   int Runs() const { return runs_; }
+   int Failures() const { return failures_; }
+
+   // Scales an iteration count for --quick
+   long Iterations(long n) const
+   { return options_.quick ? std::max(1L, n / 10) : n; }
+
+   const Options& GetOptions() const { return options_; }
+
+   void Emit(const JsonObject& o)
+   {
+      const std::string line = o.Str();
+      if (file_.is_open())
+         file_ << line << std::endl;
+      std::cout << line << std::endl;
+   }
+
+   // Runs one benchmark, unless excluded by --filter. The function returns
+   // the result fields; exceptions are reported as errors.
+   void Run(const std::string& config, const std::string& benchmark,
+         const JsonObject& params, std::function<JsonObject()> f)
+   {
+      const std::string name = config + "/" + benchmark;
+      if (!options_.filter.empty() &&
+            name.find(options_.filter) == std::string::npos)
+         return;
+
+      ++runs_;
+      JsonObject o;
+      o.Add("config", config).Add("benchmark", benchmark)
+         .Add("params", params);
+      try
+      {
+         o.Add("result", f());
+      }
+      catch (const CMMError& e)
+      {
+         o.Add("error", e.getFullMsg());
+         ++failures_;
+      }
+      catch (const std::exception& e)
+      {
+         o.Add("error", e.what());
+         ++failures_;
+      }
+      Emit(o);
+   }
+
+private:
+   Options options_;
+   std::ofstream file_;
+   int runs_;
+   int failures_;
+};
+
+
+// A set of devices loaded into a Core, with the roles used by the benchmarks
+struct Config
+{
+   std::string name;
+   std::string camera;
+   std::string stage;
+   std::string stateDevice;
+   std::vector<std::pair<long, long> > frameSizes; // Empty if fixed at load
+   std::function<void(CMMCore&)> load;
+};
+
+
+std::vector<Config> Configs()
+{
+   std::vector<Config> configs;
+
+   Config demo;
+   demo.name = "DemoCamera";
+   demo.camera = "Camera";
+   demo.stage = "Z";
+   demo.stateDevice = "Wheel";
+   demo.frameSizes.push_back(std::make_pair(512L, 512L));
+   demo.frameSizes.push_back(std::make_pair(2048L, 2048L));
+   demo.load = [](CMMCore& core)
+   {
+      core.loadDevice("Camera", "DemoCamera", "DCam");
+      core.loadDevice("Shutter", "DemoCamera", "DShutter");
+      core.loadDevice("Wheel", "DemoCamera", "DWheel");
+      core.loadDevice("Objective", "DemoCamera", "DObjective");
+      core.loadDevice("Z", "DemoCamera", "DStage");
+      core.loadDevice("XY", "DemoCamera", "DXYStage");
+      core.initializeAllDevices();
+      // Skip synthetic image generation, which would dominate
+      core.setProperty("Camera", "FastImage", "1");
+   };
+   configs.push_back(demo);
+
+   Config tester;
+   tester.name = "SequenceTester";
+   tester.camera = "Camera";
+   tester.stage = "Z";
+   tester.stateDevice = "Switcher";
+   tester.load = [](CMMCore& core)
+   {
+      core.loadDevice("Hub", "SequenceTester", "THub");
+      core.loadDevice("Camera", "SequenceTester", "TCamera");
+      core.loadDevice("Shutter", "SequenceTester", "TShutter");
+      core.loadDevice("Switcher", "SequenceTester", "TSwitcher");
+      core.loadDevice("Z", "SequenceTester", "TZStage");
+      core.loadDevice("XY", "SequenceTester", "TXYStage");
+      const char* peripherals[] = { "Camera", "Shutter", "Switcher", "Z", "XY" };
+      for (const char* label : peripherals)
+         core.setParentLabel(label, "Hub");
+      core.setProperty("Camera", "ImageMode", "MachineReadable");
+      core.setProperty("Camera", "ImageWidth", 512L);
+      core.setProperty("Camera", "ImageHeight", 512L);
+      core.initializeAllDevices();
+   };
+   configs.push_back(tester);
+
+   return configs;
+}
+
+
+void SetFrameSize(CMMCore& core, const Config& config, long width, long height)
+{
+   if (config.frameSizes.empty())
+      return;
+   core.clearROI();
+   core.setProperty(config.camera.c_str(), "OnCameraCCDXSize", width);
+   core.setProperty(config.camera.c_str(), "OnCameraCCDYSize", height);
+}
+
+
+JsonObject FrameParams(CMMCore& core, double exposureMs)
+{
+   JsonObject params;
+   params.Add("width", static_cast<long>(core.getImageWidth()))
+      .Add("height", static_cast<long>(core.getImageHeight()))
+      .Add("bytes_per_pixel", static_cast<long>(core.getBytesPerPixel()))
+      .Add("exposure_ms", exposureMs);
+   return params;
+}
+
+
+void BenchmarkSnap(Runner& runner, CMMCore& core, const Config& config)
+{
+   const double exposureMs = 1.0;
+   core.setExposure(exposureMs);
+   const long n = runner.Iterations(200);
+   runner.Run(config.name, "snap_latency", FrameParams(core, exposureMs),
+      [&]()
+      {
+         core.snapImage();
+         core.getImage();
+         std::vector<double> samples;
+         for (long i = 0; i < n; ++i)
+         {
+            const Clock::time_point start = Clock::now();
+            core.snapImage();
+            core.getImage();
+            samples.push_back(MicrosecondsSince(start));
+         }
+         return Summarize(samples);
+      });
+}
+
+
+// Acquires a finite sequence while popping images concurrently
+void BenchmarkSequence(Runner& runner, CMMCore& core, const Config& config,
+      double exposureMs, long frames)
+{
+   core.setExposure(exposureMs);
+   frames = runner.Iterations(frames);
+   JsonObject params = FrameParams(core, exposureMs);
+   params.Add("frames", frames);
+   runner.Run(config.name, "sequence_acquisition", params,
+      [&]()
+      {
+         core.clearCircularBuffer();
+         std::vector<double> popIntervals;
+         long received = 0;
+         double firstFrameUs = 0.0;
+         const Clock::time_point start = Clock::now();
+         Clock::time_point last = start;
+         core.startSequenceAcquisition(frames, 0.0, false);
+         for (;;)
+         {
+            if (core.getRemainingImageCount() > 0)
+            {
+               core.popNextImage();
+               const Clock::time_point now = Clock::now();
+               if (received++ == 0)
+                  firstFrameUs = std::chrono::duration<double, std::micro>(now - start).count();
+               else
+                  popIntervals.push_back(
+                        std::chrono::duration<double, std::micro>(now - last).count());
+               last = now;
+            }
+            else if (!core.isSequenceRunning())
+            {
+               if (core.getRemainingImageCount() == 0)
+                  break;
+            }
+            else
+            {
+               std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+         }
+         const double seconds = MicrosecondsSince(start) / 1e6;
+         const double frameBytes = static_cast<double>(core.getImageWidth()) *
+            core.getImageHeight() * core.getBytesPerPixel();
+
+         JsonObject o;
+         o.Add("frames_received", received)
+            .Add("frames_lost", frames - received)
+            .Add("seconds", seconds)
+            .Add("frames_per_s", received / seconds)
+            .Add("megabytes_per_s", received * frameBytes / seconds / 1e6)
+            .Add("first_frame_us", firstFrameUs)
+            .Add("pop_interval", Summarize(popIntervals));
+         return o;
+      });
+}
+
+
+// Fills the sequence buffer, then measures popping alone
+void BenchmarkPop(Runner& runner, CMMCore& core, const Config& config)
+{
+   const double exposureMs = 0.0;
+   core.setExposure(exposureMs);
+   core.initializeCircularBuffer(); // Capacity depends on the frame size
+   const long frames = std::min(runner.Iterations(500),
+         static_cast<long>(core.getBufferTotalCapacity()));
+   JsonObject params = FrameParams(core, exposureMs);
+   params.Add("frames", frames);
+   runner.Run(config.name, "pop_next_image", params,
+      [&]()
+      {
+         core.clearCircularBuffer();
+         core.startSequenceAcquisition(frames, 0.0, true);
+         while (core.isSequenceRunning())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         const long available = core.getRemainingImageCount();
+
+         std::vector<double> samples;
+         const Clock::time_point start = Clock::now();
+         for (long i = 0; i < available; ++i)
+         {
+            const Clock::time_point t = Clock::now();
+            core.popNextImage();
+            samples.push_back(MicrosecondsSince(t));
+         }
+         const double seconds = MicrosecondsSince(start) / 1e6;
+
+         JsonObject o = Summarize(samples);
+         o.Add("frames_per_s", available / seconds);
+         return o;
+      });
+}
+
+
+void BenchmarkSetConfig(Runner& runner, CMMCore& core, const Config& config)
+{
+   const char* group = "BenchmarkGroup";
+   core.defineConfig(group, "A", config.stateDevice.c_str(), "State", "0");
+   core.defineConfig(group, "A", config.stage.c_str(), "Position", "0");
+   core.defineConfig(group, "B", config.stateDevice.c_str(), "State", "1");
+   core.defineConfig(group, "B", config.stage.c_str(), "Position", "10");
+   const long n = runner.Iterations(500);
+   runner.Run(config.name, "set_config_latency", JsonObject().Add("settings", 2),
+      [&]()
+      {
+         std::vector<double> samples;
+         for (long i = 0; i < n; ++i)
+         {
+            const Clock::time_point start = Clock::now();
+            core.setConfig(group, (i % 2) ? "B" : "A");
+            core.waitForConfig(group, (i % 2) ? "B" : "A");
+            samples.push_back(MicrosecondsSince(start));
+         }
+         return Summarize(samples);
+      });
+   core.deleteConfigGroup(group);
+}
+
+
+void BenchmarkSystemState(Runner& runner, CMMCore& core, const Config& config)
+{
+   const long n = runner.Iterations(200);
+   const long nProps = static_cast<long>(core.getSystemStateCache().size());
+   runner.Run(config.name, "get_system_state",
+         JsonObject().Add("properties", nProps),
+      [&]()
+      {
+         std::vector<double> samples;
+         for (long i = 0; i < n; ++i)
+         {
+            const Clock::time_point start = Clock::now();
+            core.getSystemState();
+            samples.push_back(MicrosecondsSince(start));
+         }
+         return Summarize(samples);
+      });
+   runner.Run(config.name, "get_system_state_cache",
+         JsonObject().Add("properties", nProps),
+      [&]()
+      {
+         std::vector<double> samples;
+         for (long i = 0; i < n * 10; ++i)
+         {
+            const Clock::time_point start = Clock::now();
+            core.getSystemStateCache();
+            samples.push_back(MicrosecondsSince(start));
+         }
+         return Summarize(samples);
+      });
+}
+
+
+// The overhead of waiting for a device that is not busy
+void BenchmarkWaitForDevice(Runner& runner, CMMCore& core, const Config& config)
+{
+   const long n = runner.Iterations(10000);
+   runner.Run(config.name, "wait_for_device",
+         JsonObject().Add("device", config.stage),
+      [&]()
+      {
+         core.waitForDevice(config.stage.c_str());
+         std::vector<double> samples;
+         for (long i = 0; i < n; ++i)
+         {
+            const Clock::time_point start = Clock::now();
+            core.waitForDevice(config.stage.c_str());
+            samples.push_back(MicrosecondsSince(start));
+         }
+         return Summarize(samples);
+      });
+}
+
+
+void RunConfig(Runner& runner, const Config& config)
+{
+   CMMCore core;
+   core.enableStderrLog(false);
+   core.enableDebugLog(false);
+   core.setDeviceAdapterSearchPaths(runner.GetOptions().adapterPaths);
+   try
+   {
+      config.load(core);
+   }
+   catch (const CMMError& e)
+   {
+      runner.Emit(JsonObject().Add("config", config.name)
+            .Add("skipped", e.getFullMsg()));
+      return;
+   }
+   core.setCameraDevice(config.camera.c_str());
+   core.setFocusDevice(config.stage.c_str());
+   core.setAutoShutter(false);
+   core.updateSystemStateCache();
+
+   BenchmarkSnap(runner, core, config);
+
+   if (config.frameSizes.empty())
+   {
+      BenchmarkSequence(runner, core, config, 0.0, 2000);
+   }
+   else
+   {
+      for (std::size_t i = 0; i < config.frameSizes.size(); ++i)
+      {
+         SetFrameSize(core, config, config.frameSizes[i].first,
+               config.frameSizes[i].second);
+         // Free-running, and paced at 100 frames/s
+         BenchmarkSequence(runner, core, config, 0.0, 1000);
+         BenchmarkSequence(runner, core, config, 10.0, 200);
+      }
+      SetFrameSize(core, config, config.frameSizes[0].first,
+            config.frameSizes[0].second);
+   }
+
+   BenchmarkPop(runner, core, config);
+   BenchmarkSetConfig(runner, core, config);
+   BenchmarkSystemState(runner, core, config);
+   BenchmarkWaitForDevice(runner, core, config);
+
+   core.unloadAllDevices();
+}
+
+
+// Accepts one connection on 127.0.0.1 and echoes back everything received,
+// on its own thread
+class LoopbackEchoServer
+{
+public:
+   LoopbackEchoServer() :
+      listener_(socket(AF_INET, SOCK_STREAM, 0)),
+      client_(-1),
+      port_(0)
+   {
+      if (listener_ < 0)
+         throw std::runtime_error("Cannot create echo server socket");
+      sockaddr_in addr = sockaddr_in();
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t len = sizeof(addr);
+      if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+            listen(listener_, 1) != 0 ||
+            getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+      {
+         close(listener_);
+         throw std::runtime_error("Cannot listen on the loopback interface");
+      }
+      port_ = ntohs(addr.sin_port);
+      thread_ = std::thread([this]() { Serve(); });
+   }
+
+   ~LoopbackEchoServer()
+   {
+      // Wakes the thread from accept() or recv()
+      shutdown(listener_, SHUT_RDWR);
+      const int client = client_.load();
+      if (client >= 0)
+         shutdown(client, SHUT_RDWR);
+      thread_.join();
+      close(listener_);
+   }
+
+   LoopbackEchoServer(const LoopbackEchoServer&) = delete;
+   LoopbackEchoServer& operator=(const LoopbackEchoServer&) = delete;
+
+   unsigned short GetPort() const { return port_; }
+
+private:
+   void Serve()
+   {
+      const int client = accept(listener_, nullptr, nullptr);
+      if (client < 0)
+         return;
+      const int yes = 1;
+      setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+      client_.store(client);
+      char buf[4096];
+      for (;;)
+      {
+         const ssize_t n = recv(client, buf, sizeof(buf), 0);
+         if (n <= 0 || send(client, buf, static_cast<std::size_t>(n), 0) != n)
+            break;
+      }
+      close(client);
+   }
+
+   const int listener_;
+   std::atomic<int> client_;
+   unsigned short port_;
+   std::thread thread_;
+};
+
+
+// Command/answer round trips through the core's serial port API to a
+// TCPIPPort connected to a loopback echo server
+void BenchmarkSerialRoundTrip(Runner& runner, CMMCore& core, const char* port,
+      const char* noDelay, std::size_t payloadBytes)
+{
+   const long n = runner.Iterations(2000);
+   core.setProperty(port, "TCP_NODELAY", noDelay);
+   const std::string command(payloadBytes, 'x');
+   runner.Run("TCPIPPort", "serial_round_trip",
+         JsonObject().Add("payload_bytes", static_cast<long>(payloadBytes))
+            .Add("tcp_nodelay", noDelay),
+      [&]()
+      {
+         const long warmUp = 10;
+         std::vector<double> samples;
+         for (long i = 0; i < warmUp + n; ++i)
+         {
+            const Clock::time_point start = Clock::now();
+            core.setSerialPortCommand(port, command.c_str(), "\r");
+            const std::string answer = core.getSerialPortAnswer(port, "\r");
+            if (i >= warmUp)
+               samples.push_back(MicrosecondsSince(start));
+            if (answer != command)
+               throw std::runtime_error("Echo does not match the command");
+         }
+         return Summarize(samples);
+      });
+}
+
+
+void RunSerialPort(Runner& runner)
+{
+   LoopbackEchoServer server;
+   CMMCore core;
+   core.enableStderrLog(false);
+   core.enableDebugLog(false);
+   core.setDeviceAdapterSearchPaths(runner.GetOptions().adapterPaths);
+   const char* port = "Port";
+   try
+   {
+      core.loadDevice(port, "TCPIPPort", "TCP/IP serial port adapter (1)");
+      core.setProperty(port, "TCP Port", static_cast<long>(server.GetPort()));
+      core.initializeDevice(port);
+   }
+   catch (const CMMError& e)
+   {
+      runner.Emit(JsonObject().Add("config", "TCPIPPort")
+            .Add("skipped", e.getFullMsg()));
+      return;
+   }
+
+   BenchmarkSerialRoundTrip(runner, core, port, "Yes", 8);
+   BenchmarkSerialRoundTrip(runner, core, port, "Yes", 512);
+   BenchmarkSerialRoundTrip(runner, core, port, "No", 8);
+
+   core.unloadAllDevices();
+}
+
+
+bool ParseOption(const std::string& arg, const char* name, std::string& value)
+{
+   const std::string prefix = std::string("--") + name + "=";
+   if (arg.compare(0, prefix.size(), prefix) != 0)
+      return false;
+   value = arg.substr(prefix.size());
+   return true;
+}
+
+
+void Usage()
+{
+   std::cerr <<
+      "Usage: MMCore-Benchmarks [options]\n"
+      "  --adapter-path=DIR  Directory containing device adapters (repeatable;\n"
+      "                      default: $MM_BENCHMARK_ADAPTER_PATH or .)\n"
+      "  --filter=TEXT       Only run benchmarks whose config/name contains TEXT\n"
+      "  --output=FILE       Also write results to FILE\n"
+      "  --quick             Run a tenth of the iterations (for smoke testing)\n";
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   Options options;
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg = argv[i];
+      std::string value;
+      if (ParseOption(arg, "adapter-path", value))
+         options.adapterPaths.push_back(value);
+      else if (ParseOption(arg, "filter", value))
+         options.filter = value;
+      else if (ParseOption(arg, "output", value))
+         options.output = value;
+      else if (arg == "--quick")
+         options.quick = true;
+      else
+      {
+         Usage();
+         return arg == "--help" ? 0 : 2;
+      }
+   }
+   if (options.adapterPaths.empty())
+   {
+      const char* env = std::getenv("MM_BENCHMARK_ADAPTER_PATH");
+      options.adapterPaths.push_back(env ? env : ".");
+   }
+
+   try
+   {
+      Runner runner(options);
+      {
+         CMMCore core;
+         runner.Emit(JsonObject()
+               .Add("suite", "MMCore-Benchmarks")
+               .Add("mmcore_version", core.getVersionInfo())
+               .Add("api_version", core.getAPIVersionInfo())
+               .Add("hardware_threads",
+                  static_cast<long>(std::thread::hardware_concurrency()))
+               .Add("quick", options.quick ? 1 : 0));
+      }
+      const std::vector<Config> configs = Configs();
+      for (std::size_t i = 0; i < configs.size(); ++i)
+         RunConfig(runner, configs[i]);
+      RunSerialPort(runner);
+      if (runner.Runs() == 0)
+      {
+         std::cerr << "No benchmarks were run (adapters not found, or no "
+            "match for --filter)" << std::endl;
+         return 1;
+      }
+      return runner.Failures() > 0 ? 1 : 0;
+   }
+   catch (const std::exception& e)
+   {
+      std::cerr << e.what() << std::endl;
+      return 2;
+   }
+}
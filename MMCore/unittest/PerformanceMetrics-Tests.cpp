@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+#include "PerformanceMetrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mm::metrics;
+
+
+TEST(PerformanceMetricsTests, CounterRendering)
+{
+   Registry r;
+   std::shared_ptr<Counter> c = r.GetCounter("test_total", "A counter");
+   c->Increment();
+   c->Increment(41);
+
+   std::string text = r.RenderText();
+   EXPECT_NE(std::string::npos, text.find("# HELP test_total A counter\n"));
+   EXPECT_NE(std::string::npos, text.find("# TYPE test_total counter\n"));
+   EXPECT_NE(std::string::npos, text.find("test_total 42\n"));
+}
+
+TEST(PerformanceMetricsTests, SameSeriesIsShared)
+{
+   Registry r;
+   Labels labels{ { "device", "Cam" } };
+   std::shared_ptr<Counter> a = r.GetCounter("x_total", "", labels);
+   std::shared_ptr<Counter> b = r.GetCounter("x_total", "", labels);
+   EXPECT_EQ(a, b);
+   std::shared_ptr<Counter> other = r.GetCounter("x_total", "",
+         Labels{ { "device", "Stage" } });
+   EXPECT_NE(a, other);
+}
+
+TEST(PerformanceMetricsTests, TypeMismatchThrows)
+{
+   Registry r;
+   r.GetCounter("m", "");
+   EXPECT_THROW(r.GetGauge("m", ""), CMMError);
+}
+
+TEST(PerformanceMetricsTests, HistogramBuckets)
+{
+   Histogram h(std::vector<double>{ 1.0, 2.0, 5.0 });
+   h.Observe(0.5);
+   h.Observe(1.0); // Upper bounds are inclusive
+   h.Observe(1.5);
+   h.Observe(100.0);
+
+   Histogram::Snapshot snap = h.GetSnapshot();
+   ASSERT_EQ(4u, snap.cumulativeCounts.size());
+   EXPECT_EQ(2u, snap.cumulativeCounts[0]);
+   EXPECT_EQ(3u, snap.cumulativeCounts[1]);
+   EXPECT_EQ(3u, snap.cumulativeCounts[2]);
+   EXPECT_EQ(4u, snap.cumulativeCounts[3]);
+   EXPECT_EQ(4u, snap.count);
+   EXPECT_DOUBLE_EQ(103.0, snap.sum);
+
+   h.Reset();
+   EXPECT_EQ(0u, h.GetSnapshot().count);
+}
+
+TEST(PerformanceMetricsTests, HistogramRendering)
+{
+   Registry r;
+   std::shared_ptr<Histogram> h = r.GetHistogram("lat_seconds", "Latency",
+         std::vector<double>{ 0.5 }, Labels{ { "device", "A\"B" } });
+   h->Observe(0.25);
+
+   std::string text = r.RenderText();
+   EXPECT_NE(std::string::npos, text.find("# TYPE lat_seconds histogram\n"));
+   EXPECT_NE(std::string::npos,
+         text.find("lat_seconds_bucket{device=\"A\\\"B\",le=\"0.5\"} 1\n"));
+   EXPECT_NE(std::string::npos,
+         text.find("lat_seconds_bucket{device=\"A\\\"B\",le=\"+Inf\"} 1\n"));
+   EXPECT_NE(std::string::npos,
+         text.find("lat_seconds_sum{device=\"A\\\"B\"} 0.25\n"));
+   EXPECT_NE(std::string::npos,
+         text.find("lat_seconds_count{device=\"A\\\"B\"} 1\n"));
+}
+
+TEST(PerformanceMetricsTests, ConcurrentUpdates)
+{
+   Registry r;
+   std::shared_ptr<Counter> c = r.GetCounter("c_total", "");
+   std::shared_ptr<Histogram> h = r.GetHistogram("h", "", LatencyBuckets());
+
+   const int nThreads = 4;
+   const int perThread = 10000;
+   std::vector<std::thread> threads;
+   for (int t = 0; t < nThreads; ++t)
+   {
+      threads.emplace_back([&]() {
+         for (int i = 0; i < perThread; ++i)
+         {
+            c->Increment();
+            h->Observe(1e-3);
+         }
+      });
+   }
+   for (auto& t : threads)
+      t.join();
+
+   EXPECT_EQ(static_cast<std::uint64_t>(nThreads * perThread), c->Get());
+   Histogram::Snapshot snap = h->GetSnapshot();
+   EXPECT_EQ(static_cast<std::uint64_t>(nThreads * perThread), snap.count);
+   EXPECT_NEAR(nThreads * perThread * 1e-3, snap.sum, 1e-6);
+}
+
+TEST(PerformanceMetricsTests, RemovedSeriesStayUsable)
+{
+   Registry r;
+   std::shared_ptr<Counter> c = r.GetCounter("gone_total", "",
+         Labels{ { "device", "Cam" } });
+   r.RemoveSeries("device", "Cam");
+   c->Increment(); // Must not crash
+   EXPECT_EQ(std::string::npos, r.RenderText().find("gone_total"));
+}
+
+TEST(PerformanceMetricsTests, CoreReportsBufferMetrics)
+{
+   CMMCore c;
+   std::string text = c.getPerformanceMetrics();
+   EXPECT_NE(std::string::npos, text.find("mmcore_images_inserted_total 0\n"));
+   EXPECT_NE(std::string::npos, text.find("mmcore_buffer_capacity_images "));
+   c.resetPerformanceMetrics();
+}
+
+TEST(PerformanceMetricsTests, FileExport)
+{
+   const std::string filename = "PerformanceMetrics-Tests.prom";
+   std::remove(filename.c_str());
+   {
+      CMMCore c;
+      c.startPerformanceMetricsExport(filename.c_str(), 10.0);
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      c.stopPerformanceMetricsExport();
+   }
+
+   std::ifstream file(filename.c_str());
+   ASSERT_TRUE(file.good());
+   std::string text((std::istreambuf_iterator<char>(file)),
+         std::istreambuf_iterator<char>());
+   EXPECT_NE(std::string::npos, text.find("# TYPE mmcore_images_inserted_total counter"));
+   file.close();
+   std::remove(filename.c_str());
+}
+
+TEST(PerformanceMetricsTests, FileExportRejectsBadArguments)
+{
+   CMMCore c;
+   EXPECT_THROW(c.startPerformanceMetricsExport("", 100.0), CMMError);
+   EXPECT_THROW(c.startPerformanceMetricsExport("x.prom", 0.0), CMMError);
+   EXPECT_THROW(c.startPerformanceMetricsExport(
+            "no-such-directory/x.prom", 100.0), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+#include "PreviewImage.h"
+#include "PreviewTap.h"
+
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+using mm::PreviewFrame;
+using mm::PreviewTap;
+
+
+namespace
+{
+
+// 8 x 4 image whose pixel (x, y) is x + 10 * y
+std::vector<uint16_t> Ramp()
+{
+   std::vector<uint16_t> image(8 * 4);
+   for (unsigned y = 0; y < 4; ++y)
+      for (unsigned x = 0; x < 8; ++x)
+         image[y * 8 + x] = static_cast<uint16_t>(x + 10 * y);
+   return image;
+}
+
+std::shared_ptr<const PreviewFrame> PreviewRamp(PreviewTap::Binning binning)
+{
+   PreviewTap tap;
+   tap.Enable(4, 4, 0.0);
+   tap.SetBinning(binning);
+   std::vector<uint16_t> image = Ramp();
+   EXPECT_TRUE(tap.IsDue());
+   tap.Feed("Cam", reinterpret_cast<const unsigned char*>(image.data()),
+         8, 4, 2, 1, 12);
+   return tap.GetLast();
+}
+
+const uint16_t* Pixels(const PreviewFrame& frame)
+{
+   return reinterpret_cast<const uint16_t*>(frame.pixels.data());
+}
+
+} // anonymous namespace
+
+
+TEST(PreviewTapTests, MeanBinning)
+{
+   std::shared_ptr<const PreviewFrame> frame = PreviewRamp(PreviewTap::BinningMean);
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(2u, frame->binning);
+   EXPECT_EQ(4u, frame->width);
+   EXPECT_EQ(2u, frame->height);
+   EXPECT_EQ("Cam", frame->camera);
+   // Block (0, 0) holds 0, 1, 10, 11
+   EXPECT_EQ(6, Pixels(*frame)[0]);
+   EXPECT_EQ(28, Pixels(*frame)[4 + 1]);
+}
+
+TEST(PreviewTapTests, MaxBinning)
+{
+   std::shared_ptr<const PreviewFrame> frame = PreviewRamp(PreviewTap::BinningMax);
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(11, Pixels(*frame)[0]);
+   EXPECT_EQ(37, Pixels(*frame)[4 + 3]);
+}
+
+TEST(PreviewTapTests, Decimation)
+{
+   std::shared_ptr<const PreviewFrame> frame = PreviewRamp(PreviewTap::BinningDecimate);
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(0, Pixels(*frame)[0]);
+   EXPECT_EQ(22, Pixels(*frame)[4 + 1]);
+}
+
+TEST(PreviewTapTests, Statistics)
+{
+   std::shared_ptr<const PreviewFrame> frame = PreviewRamp(PreviewTap::BinningMean);
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(0u, frame->minimum);
+   EXPECT_EQ(37u, frame->maximum);
+   // 12-bit range in 256 bins
+   EXPECT_EQ(16u, frame->histogramBinWidth);
+   ASSERT_EQ(256u, frame->histogram.size());
+   EXPECT_EQ(32, std::accumulate(frame->histogram.begin(), frame->histogram.end(), 0L));
+   EXPECT_EQ(14, frame->histogram[0]); // 0-7, 10-15
+   EXPECT_EQ(12, frame->histogram[1]); // 16-17, 20-27, 30-31
+   EXPECT_EQ(6, frame->histogram[2]); // 32-37
+}
+
+TEST(PreviewTapTests, RGB)
+{
+   // 2 x 2 BGRA pixels
+   const unsigned char image[] = {
+      10, 20, 30, 255,   12, 22, 32, 255,
+      14, 24, 34, 255,   16, 26, 36, 255,
+   };
+   PreviewTap tap;
+   tap.Enable(1, 1, 0.0);
+   ASSERT_TRUE(tap.IsDue());
+   tap.Feed("Cam", image, 2, 2, 4, 4, 8);
+   std::shared_ptr<const PreviewFrame> frame = tap.GetLast();
+   ASSERT_TRUE(frame);
+   ASSERT_EQ(4u, frame->pixels.size());
+   EXPECT_EQ(13, frame->pixels[0]);
+   EXPECT_EQ(23, frame->pixels[1]);
+   EXPECT_EQ(33, frame->pixels[2]);
+   EXPECT_EQ(255, frame->pixels[3]);
+   EXPECT_EQ(36u, frame->maximum); // Alpha is not counted
+   EXPECT_EQ(12, std::accumulate(frame->histogram.begin(), frame->histogram.end(), 0L));
+}
+
+TEST(PreviewTapTests, ImageSmallerThanPreview)
+{
+   PreviewTap tap;
+   tap.Enable(640, 480, 0.0);
+   std::vector<unsigned char> image(3 * 2, 5);
+   ASSERT_TRUE(tap.IsDue());
+   tap.Feed("Cam", image.data(), 3, 2, 1, 1, 8);
+   std::shared_ptr<const PreviewFrame> frame = tap.GetLast();
+   ASSERT_TRUE(frame);
+   EXPECT_EQ(1u, frame->binning);
+   EXPECT_EQ(3u, frame->width);
+   EXPECT_EQ(image, frame->pixels);
+}
+
+TEST(PreviewTapTests, UnsupportedFormatIsSkipped)
+{
+   PreviewTap tap;
+   tap.Enable(16, 16, 0.0);
+   std::vector<unsigned char> image(4 * 4 * 4);
+   ASSERT_TRUE(tap.IsDue());
+   tap.Feed("Cam", image.data(), 4, 4, 4, 1, 32);
+   EXPECT_FALSE(tap.GetLast());
+}
+
+TEST(PreviewTapTests, RateLimit)
+{
+   PreviewTap tap;
+   EXPECT_FALSE(tap.IsEnabled());
+   EXPECT_FALSE(tap.IsDue());
+
+   tap.Enable(16, 16, 0.001);
+   EXPECT_TRUE(tap.IsEnabled());
+   EXPECT_TRUE(tap.IsDue());
+   EXPECT_FALSE(tap.IsDue());
+
+   tap.Enable(16, 16, 0.0);
+   EXPECT_TRUE(tap.IsDue());
+   EXPECT_TRUE(tap.IsDue());
+}
+
+TEST(PreviewTapTests, DisableDiscardsPreview)
+{
+   PreviewTap tap;
+   tap.Enable(16, 16, 0.0);
+   std::vector<unsigned char> image(4 * 4, 1);
+   tap.Feed("Cam", image.data(), 4, 4, 1, 1, 8);
+   EXPECT_TRUE(tap.GetLast());
+   tap.Disable();
+   EXPECT_FALSE(tap.GetLast());
+   EXPECT_FALSE(tap.IsDue());
+}
+
+TEST(PreviewTapTests, CoreSettings)
+{
+   CMMCore c;
+   EXPECT_FALSE(c.isImagePreviewEnabled());
+   EXPECT_FALSE(c.getLastPreviewImage().isValid());
+   EXPECT_EQ(nullptr, c.getLastPreviewImage().getPixels());
+   EXPECT_TRUE(c.getLastImageHistogram().empty());
+
+   EXPECT_THROW(c.enableImagePreview(0, 100, 10.0), CMMError);
+   EXPECT_THROW(c.enableImagePreview(100, 100, -1.0), CMMError);
+   c.enableImagePreview(640, 480, 30.0);
+   EXPECT_TRUE(c.isImagePreviewEnabled());
+   c.disableImagePreview();
+   EXPECT_FALSE(c.isImagePreviewEnabled());
+
+   EXPECT_EQ("Mean", c.getImagePreviewBinning());
+   c.setImagePreviewBinning("Max");
+   EXPECT_EQ("Max", c.getImagePreviewBinning());
+   c.setImagePreviewBinning("Decimate");
+   EXPECT_EQ("Decimate", c.getImagePreviewBinning());
+   EXPECT_THROW(c.setImagePreviewBinning("Median"), CMMError);
+   EXPECT_THROW(c.setImagePreviewBinning(0), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include "ConfigGroup.h"
+#include "PropertyConfigIndex.h"
+
+#include <string>
+#include <vector>
+
+using mm::PropertyConfigIndex;
+
+
+class PropertyConfigIndexTests : public ::testing::Test
+{
+protected:
+   ConfigGroupCollection groups;
+   PixelSizeConfigGroup pixelSizes;
+   PropertyConfigIndex index{ groups, pixelSizes };
+   std::vector<std::string> found;
+};
+
+TEST_F(PropertyConfigIndexTests, EmptyConfiguration)
+{
+   EXPECT_FALSE(index.Lookup("Cam", "Binning", found));
+   EXPECT_TRUE(found.empty());
+}
+
+TEST_F(PropertyConfigIndexTests, FindsGroupsWithMultiSettingPresets)
+{
+   groups.Define("Channel", "DAPI", "Filter", "State", "0");
+   groups.Define("Channel", "DAPI", "Shutter", "State", "1");
+   groups.Define("Objective", "10x", "Nosepiece", "State", "0");
+   groups.Define("Binning", "1", "Cam", "Binning", "1");
+   groups.Define("Binning", "1", "Filter", "State", "0");
+
+   EXPECT_FALSE(index.Lookup("Filter", "State", found));
+   EXPECT_EQ((std::vector<std::string>{ "Binning", "Channel" }), found);
+
+   // Single-setting presets are not reported
+   index.Lookup("Nosepiece", "State", found);
+   EXPECT_TRUE(found.empty());
+}
+
+TEST_F(PropertyConfigIndexTests, ListsGroupOnceForManyPresets)
+{
+   groups.Define("Channel", "DAPI", "Filter", "State", "0");
+   groups.Define("Channel", "DAPI", "Shutter", "State", "1");
+   groups.Define("Channel", "GFP", "Filter", "State", "1");
+   groups.Define("Channel", "GFP", "Shutter", "State", "1");
+   index.Lookup("Filter", "State", found);
+   EXPECT_EQ(std::vector<std::string>(1, "Channel"), found);
+}
+
+TEST_F(PropertyConfigIndexTests, FollowsEdits)
+{
+   groups.Define("Channel", "DAPI", "Filter", "State", "0");
+   index.Lookup("Filter", "State", found);
+   EXPECT_TRUE(found.empty());
+
+   groups.Define("Channel", "DAPI", "Shutter", "State", "1");
+   index.Lookup("Filter", "State", found);
+   EXPECT_EQ(std::vector<std::string>(1, "Channel"), found);
+
+   groups.RenameGroup("Channel", "Filters");
+   index.Lookup("Shutter", "State", found);
+   EXPECT_EQ(std::vector<std::string>(1, "Filters"), found);
+
+   groups.Delete("Filters", "DAPI", "Shutter", "State");
+   index.Lookup("Filter", "State", found);
+   EXPECT_TRUE(found.empty());
+
+   groups.Define("Filters", "DAPI", "Shutter", "State", "1");
+   groups.Delete("Filters", "DAPI");
+   index.Lookup("Filter", "State", found);
+   EXPECT_TRUE(found.empty());
+
+   groups.Define("Filters", "GFP", "Filter", "State", "1");
+   groups.Define("Filters", "GFP", "Shutter", "State", "1");
+   groups.Clear();
+   index.Lookup("Filter", "State", found);
+   EXPECT_TRUE(found.empty());
+}
+
+TEST_F(PropertyConfigIndexTests, PixelSizeConfigs)
+{
+   pixelSizes.DefinePixelSize("Res10x", "Nosepiece", "State", "0", 0.65);
+   EXPECT_TRUE(index.Lookup("Nosepiece", "State", found));
+   EXPECT_TRUE(found.empty());
+   EXPECT_FALSE(index.Lookup("Nosepiece", "Label", found));
+
+   pixelSizes.Rename("Res10x", "Res10");
+   EXPECT_TRUE(index.Lookup("Nosepiece", "State", found));
+
+   pixelSizes.Delete("Res10");
+   EXPECT_FALSE(index.Lookup("Nosepiece", "State", found));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+#include "StateCache.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mm::StateCache;
+
+
+TEST(StateCacheTests, SetAndGet)
+{
+   StateCache c;
+   std::string value;
+   EXPECT_FALSE(c.Get("Cam", "Exposure", value));
+   c.Set("Cam", "Exposure", "10");
+   ASSERT_TRUE(c.Get("Cam", "Exposure", value));
+   EXPECT_EQ("10", value);
+   EXPECT_FALSE(c.Get("Cam", "Binning", value));
+   EXPECT_FALSE(c.Get("Stage", "Exposure", value));
+}
+
+TEST(StateCacheTests, RevisionCountsChangesOnly)
+{
+   StateCache c;
+   EXPECT_EQ(0u, c.GetRevision());
+   c.Set("Cam", "Exposure", "10");
+   EXPECT_EQ(1u, c.GetRevision());
+   c.Set("Cam", "Exposure", "10");
+   EXPECT_EQ(1u, c.GetRevision());
+   c.Set("Cam", "Exposure", "20");
+   EXPECT_EQ(2u, c.GetRevision());
+   c.Intern("Cam", "Binning");
+   EXPECT_EQ(2u, c.GetRevision());
+}
+
+TEST(StateCacheTests, InternedKey)
+{
+   StateCache c;
+   StateCache::KeyId key = c.Intern("Cam", "Exposure");
+   EXPECT_EQ(key, c.Intern("Cam", "Exposure"));
+   EXPECT_NE(key, c.Intern("Cam", "Binning"));
+
+   std::string value;
+   EXPECT_FALSE(c.Get("Cam", "Exposure", value)); // Interned but no value
+   c.Set(key, "5");
+   ASSERT_TRUE(c.Get("Cam", "Exposure", value));
+   EXPECT_EQ("5", value);
+}
+
+TEST(StateCacheTests, SnapshotKeepsInsertionOrder)
+{
+   StateCache c;
+   c.Set("B", "p", "1");
+   c.Set("A", "p", "2");
+   c.Set("B", "p", "3", true);
+   Configuration config = c.GetSnapshot();
+   ASSERT_EQ(2u, config.size());
+   EXPECT_EQ("B", config.getSetting(0).getDeviceLabel());
+   EXPECT_EQ("3", config.getSetting(0).getPropertyValue());
+   EXPECT_TRUE(config.getSetting(0).getReadOnly());
+   EXPECT_EQ("A", config.getSetting(1).getDeviceLabel());
+}
+
+TEST(StateCacheTests, ReplaceRemovesMissingKeys)
+{
+   StateCache c;
+   c.Set("A", "p", "1");
+   c.Set("B", "p", "2");
+   const std::uint64_t before = c.GetRevision();
+
+   Configuration config;
+   config.addSetting(PropertySetting("C", "p", "3"));
+   config.addSetting(PropertySetting("B", "p", "2"));
+   c.Replace(config);
+   EXPECT_EQ(before + 1, c.GetRevision());
+
+   std::string value;
+   EXPECT_FALSE(c.Get("A", "p", value));
+   ASSERT_TRUE(c.Get("C", "p", value));
+   EXPECT_EQ("3", value);
+   Configuration snapshot = c.GetSnapshot();
+   ASSERT_EQ(2u, snapshot.size());
+   EXPECT_EQ("C", snapshot.getSetting(0).getDeviceLabel());
+   EXPECT_EQ("B", snapshot.getSetting(1).getDeviceLabel());
+
+   c.Replace(config);
+   EXPECT_EQ(before + 1, c.GetRevision());
+}
+
+TEST(StateCacheTests, GetMany)
+{
+   StateCache c;
+   c.Set("Cam", "Exposure", "10");
+   c.Set("Stage", "Position", "1.5");
+   std::vector<std::string> devices{ "Stage", "Cam", "Cam" };
+   std::vector<std::string> props{ "Position", "Exposure", "Binning" };
+   std::vector<std::string> values;
+   std::vector<bool> found;
+   EXPECT_EQ(c.GetRevision(), c.GetMany(devices, props, values, found));
+   ASSERT_EQ(3u, values.size());
+   EXPECT_EQ("1.5", values[0]);
+   EXPECT_EQ("10", values[1]);
+   EXPECT_TRUE(found[0]);
+   EXPECT_TRUE(found[1]);
+   EXPECT_FALSE(found[2]);
+}
+
+TEST(StateCacheTests, ConcurrentReadersAndWriter)
+{
+   StateCache c;
+   c.Set("Dev", "Prop", "0");
+   std::atomic<bool> stop(false);
+   std::atomic<int> errors(0);
+   std::vector<std::thread> readers;
+   for (int t = 0; t < 4; ++t)
+   {
+      readers.push_back(std::thread([&]() {
+         std::string value;
+         while (!stop)
+         {
+            if (!c.Get("Dev", "Prop", value) || value.empty())
+               ++errors;
+            c.GetSnapshot();
+         }
+      }));
+   }
+   for (int i = 0; i < 2000; ++i)
+   {
+      c.Set("Dev", "Prop", std::to_string(i));
+      c.Set("Dev" + std::to_string(i % 50), "Prop", "x");
+   }
+   stop = true;
+   for (std::thread& t : readers)
+      t.join();
+   EXPECT_EQ(0, errors.load());
+}
+
+TEST(StateCacheTests, CoreBulkAccessAndRevision)
+{
+   CMMCore c;
+   const long long before = c.getSystemStateCacheRevision();
+   c.setProperty("Core", "AutoShutter", "0");
+   EXPECT_GT(c.getSystemStateCacheRevision(), before);
+
+   std::vector<std::string> labels{ "Core", "Core" };
+   std::vector<std::string> props{ "AutoShutter", "TimeoutMs" };
+   std::vector<std::string> values = c.getPropertiesFromCache(labels, props);
+   ASSERT_EQ(2u, values.size());
+   EXPECT_EQ("0", values[0]);
+   EXPECT_EQ(c.getProperty("Core", "TimeoutMs"), values[1]);
+
+   EXPECT_THROW(c.getPropertiesFromCache(labels,
+            std::vector<std::string>(1, "AutoShutter")), CMMError);
+   EXPECT_THROW(c.getPropertiesFromCache(std::vector<std::string>(1, "NoSuch"),
+            std::vector<std::string>(1, "Prop")), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
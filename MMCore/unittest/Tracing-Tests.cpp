@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+#include "Tracing.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace tracing = mm::tracing;
+
+namespace
+{
+
+std::size_t CountOccurrences(const std::string& s, const std::string& what)
+{
+   std::size_t n = 0;
+   for (std::size_t pos = s.find(what); pos != std::string::npos;
+         pos = s.find(what, pos + what.size()))
+      ++n;
+   return n;
+}
+
+} // anonymous namespace
+
+
+TEST(TracingTests, DisabledRecordsNothing)
+{
+   tracing::Start(16);
+   tracing::Stop();
+   EXPECT_FALSE(tracing::IsEnabled());
+   {
+      tracing::Span span(tracing::CategoryDevice, "Snap", "Camera");
+   }
+   std::ostringstream out;
+   EXPECT_EQ(0u, tracing::WriteChromeTrace(out));
+}
+
+TEST(TracingTests, SpansAppearInTrace)
+{
+   tracing::Start(16);
+   EXPECT_TRUE(tracing::IsEnabled());
+   {
+      tracing::Span span(tracing::CategoryDevice, "Snap", "Cam\"1");
+   }
+   std::thread t([]() {
+      tracing::Span span(tracing::CategoryCallback, "InsertImage");
+   });
+   t.join();
+   tracing::Stop();
+
+   std::ostringstream out;
+   EXPECT_EQ(2u, tracing::WriteChromeTrace(out));
+   const std::string json = out.str();
+   EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+   EXPECT_NE(std::string::npos, json.find("\"name\":\"Snap\""));
+   EXPECT_NE(std::string::npos, json.find("\"cat\":\"device\""));
+   EXPECT_NE(std::string::npos, json.find("\"device\":\"Cam\\\"1\""));
+   EXPECT_NE(std::string::npos, json.find("\"name\":\"InsertImage\""));
+   EXPECT_EQ(2u, CountOccurrences(json, "\"thread_name\""));
+}
+
+TEST(TracingTests, RestartDiscardsPreviousTrace)
+{
+   tracing::Start(16);
+   {
+      tracing::Span span(tracing::CategoryDevice, "Old");
+   }
+   tracing::Start(16);
+   {
+      tracing::Span span(tracing::CategoryDevice, "New");
+   }
+   tracing::Stop();
+   std::ostringstream out;
+   EXPECT_EQ(1u, tracing::WriteChromeTrace(out));
+   EXPECT_EQ(std::string::npos, out.str().find("\"Old\""));
+}
+
+TEST(TracingTests, RingBufferKeepsMostRecent)
+{
+   tracing::Start(4);
+   const char* const names[] = { "A", "B", "C", "D", "E", "F" };
+   for (const char* name : names)
+   {
+      tracing::Span span(tracing::CategoryBuffer, name);
+   }
+   tracing::Stop();
+   std::ostringstream out;
+   const std::size_t spans = tracing::WriteChromeTrace(out);
+   EXPECT_EQ(4u, spans); // No span was being written at Stop()
+   const std::string json = out.str();
+   EXPECT_EQ(std::string::npos, json.find("\"name\":\"B\""));
+   EXPECT_NE(std::string::npos, json.find("\"name\":\"C\""));
+   EXPECT_NE(std::string::npos, json.find("\"name\":\"F\""));
+   EXPECT_NE(std::string::npos, json.find("\"overwrittenSpans\":2"));
+}
+
+TEST(TracingTests, CoreWritesTraceFile)
+{
+   CMMCore c;
+   EXPECT_THROW(c.stopTrace("unused.json"), CMMError);
+   EXPECT_THROW(c.startTrace(0), CMMError);
+   EXPECT_THROW(c.startTrace(static_cast<long>(tracing::MaxEventsPerThread) + 1),
+         CMMError);
+
+   c.startTrace();
+   {
+      tracing::Span span(tracing::CategoryLock, "ModuleLockWait", "Dev");
+   }
+   EXPECT_THROW(c.stopTrace(""), CMMError);
+
+   const std::string filename = "Tracing-Tests-trace.json";
+   c.stopTrace(filename.c_str());
+   std::ifstream in(filename.c_str());
+   ASSERT_TRUE(in.good());
+   const std::string json((std::istreambuf_iterator<char>(in)),
+         std::istreambuf_iterator<char>());
+   in.close();
+   std::remove(filename.c_str());
+   EXPECT_NE(std::string::npos, json.find("\"name\":\"ModuleLockWait\""));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
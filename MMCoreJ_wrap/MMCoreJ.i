@@ -632,6 +632,103 @@
 %ignore MetadataKeyError;
 %ignore MetadataIndexError;
 
+// The void* typemap above sizes the pixel array from the current camera, which
+// need not match a camera's buffer lane. The lane getters are instead wrapped
+// through image handles (see the CMMCore extension at the end), and the pixel
+// array is sized from the image itself.
+%ignore CMMCore::getLastImage(const char*);
+%ignore CMMCore::popNextImage(const char*);
+%ignore CMMCore::getLastImageMD(const char*, Metadata&) const;
+%ignore CMMCore::popNextImageMD(const char*, Metadata&);
+%rename(getLastImage) CMMCore::getLastLaneImage;
+%rename(popNextImage) CMMCore::popNextLaneImage;
+%rename(getLastImageMD) CMMCore::getLastLaneImageMD;
+%rename(popNextImageMD) CMMCore::popNextLaneImageMD;
+
+%typemap(jni) LaneImage    "jobject"
+%typemap(jtype) LaneImage  "Object"
+%typemap(jstype) LaneImage "Object"
+%typemap(javaout) LaneImage {
+   return $jnicall;
+}
+%typemap(out) LaneImage
+{
+   const ImageHandle& handle = $1.handle;
+   const void* pixels = handle.getPixels();
+   long lSize = handle.getWidth() * handle.getHeight();
+   jarray data;
+
+   if (handle.getBytesPerPixel() == 1)
+   {
+      data = JCALL1(NewByteArray, jenv, lSize);
+      if (data)
+         JCALL4(SetByteArrayRegion, jenv, (jbyteArray)data, 0, lSize, (const jbyte*)pixels);
+   }
+   else if (handle.getBytesPerPixel() == 2)
+   {
+      data = JCALL1(NewShortArray, jenv, lSize);
+      if (data)
+         JCALL4(SetShortArrayRegion, jenv, (jshortArray)data, 0, lSize, (const jshort*)pixels);
+   }
+   else if (handle.getBytesPerPixel() == 4 && $1.numComponents == 1)
+   {
+      data = JCALL1(NewFloatArray, jenv, lSize);
+      if (data)
+         JCALL4(SetFloatArrayRegion, jenv, (jfloatArray)data, 0, lSize, (const jfloat*)pixels);
+   }
+   else if (handle.getBytesPerPixel() == 4)
+   {
+      data = JCALL1(NewByteArray, jenv, lSize * 4);
+      if (data)
+         JCALL4(SetByteArrayRegion, jenv, (jbyteArray)data, 0, lSize * 4, (const jbyte*)pixels);
+   }
+   else if (handle.getBytesPerPixel() == 8)
+   {
+      data = JCALL1(NewShortArray, jenv, lSize * 4);
+      if (data)
+         JCALL4(SetShortArrayRegion, jenv, (jshortArray)data, 0, lSize * 4, (const jshort*)pixels);
+   }
+   else
+   {
+      // don't know how to map
+      $result = 0;
+      return $result;
+   }
+
+   if (data == 0)
+   {
+      jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+      if (excep)
+         jenv->ThrowNew(excep, "The system ran out of memory!");
+      $result = 0;
+      return $result;
+   }
+   $result = data;
+}
+
+// Pixels cannot be exposed to Java without copying; use the pixel getters
+%ignore ImageHandle::getPixels;
+
+// Batched pops copy into a direct java.nio.ByteBuffer, which Java code can
+// allocate once and reuse; the images are stored contiguously in native byte
+// order.
+%typemap(jni) (void* buffer, unsigned long bufferBytes)    "jobject"
+%typemap(jtype) (void* buffer, unsigned long bufferBytes)  "java.nio.ByteBuffer"
+%typemap(jstype) (void* buffer, unsigned long bufferBytes) "java.nio.ByteBuffer"
+%typemap(javain) (void* buffer, unsigned long bufferBytes) "$javainput"
+%typemap(in) (void* buffer, unsigned long bufferBytes)
+{
+   $1 = $input ? JCALL1(GetDirectBufferAddress, jenv, $input) : 0;
+   if (!$1)
+   {
+      jclass excep = jenv->FindClass("java/lang/IllegalArgumentException");
+      if (excep)
+         jenv->ThrowNew(excep, "A direct ByteBuffer is required.");
+      return $null;
+   }
+   $2 = (unsigned long) JCALL1(GetDirectBufferCapacity, jenv, $input);
+}
+
 
 %typemap(javaimports) CMMCore %{
    import mmcorej.org.json.JSONObject;
@@ -918,14 +1015,43 @@
 %{
 #include "../MMDevice/MMDeviceConstants.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/ImageHandle.h"
+#include "../MMCore/PreviewImage.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
+
+// An image from a camera's buffer lane, pinned until it has been copied to
+// Java. RGB images are recognized by the pixel type tag that the buffer adds.
+struct LaneImage
+{
+   LaneImage() : numComponents(1) {}
+
+   explicit LaneImage(const ImageHandle& image) :
+      handle(image),
+      numComponents(1)
+   {
+      Metadata md = image.getMetadata();
+      if (md.HasTag("PixelType"))
+      {
+         std::string pixelType = md.GetSingleTag("PixelType").GetValue();
+         if (pixelType == "RGB32" || pixelType == "RGB64")
+            numComponents = 4;
+      }
+   }
+
+   ImageHandle handle;
+   unsigned numComponents;
+};
 %}
 
 
 // instantiate STL mappings
 
+// Declared here for the vector templates; the classes are wrapped below
+class ImageHandle;
+class Metadata;
+
 namespace std {
 	%typemap(javaimports) vector<char> %{
 		import java.lang.Iterable;
@@ -1227,6 +1353,8 @@ namespace std {
     %template(UnsignedVector) vector<unsigned>;
     %template(pair_ss)      pair<string, string>;
     %template(StrMap)       map<string, string>;
+    %template(ImageHandleVector) vector<ImageHandle>;
+    %template(MetadataVector) vector<Metadata>;
 
 
 
@@ -1236,7 +1364,35 @@ namespace std {
 
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/ImageHandle.h"
+%include "../MMCore/PreviewImage.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
 
+%extend CMMCore {
+   LaneImage getLastLaneImage(const char* cameraLabel) throw (CMMError)
+   {
+      return LaneImage($self->getLastImageHandle(cameraLabel));
+   }
+
+   LaneImage popNextLaneImage(const char* cameraLabel) throw (CMMError)
+   {
+      return LaneImage($self->popNextImageHandle(cameraLabel));
+   }
+
+   LaneImage getLastLaneImageMD(const char* cameraLabel, Metadata& md) throw (CMMError)
+   {
+      LaneImage image($self->getLastImageHandle(cameraLabel));
+      md = image.handle.getMetadata();
+      return image;
+   }
+
+   LaneImage popNextLaneImageMD(const char* cameraLabel, Metadata& md) throw (CMMError)
+   {
+      LaneImage image($self->popNextImageHandle(cameraLabel));
+      md = image.handle.getMetadata();
+      return image;
+   }
+}
+
@@ -526,6 +526,55 @@ public:
       return ret;
    }
 
+   /**
+   * Obtains a handle for typed access to a property.
+   * @param name - property name
+   * @param handle - the handle, valid for the lifetime of the device
+   */
+   virtual int GetPropertyHandle(const char* name, long& handle) const
+   {
+      int ret = properties_.GetHandle(name, handle);
+      if (ret != DEVICE_OK)
+         SetMorePropertyErrorInfo(name);
+      return ret;
+   }
+
+   /**
+   * Obtains the value of a Float or Integer property, without string
+   * conversion.
+   */
+   virtual int GetPropertyDouble(long handle, double& value) const
+   {
+      return TypedPropertyResult(handle, properties_.Get(handle, value));
+   }
+
+   /**
+   * Sets the value of a Float or Integer property, without string
+   * conversion.
+   */
+   virtual int SetPropertyDouble(long handle, double value)
+   {
+      return TypedPropertyResult(handle, properties_.Set(handle, value));
+   }
+
+   /**
+   * Obtains the value of a Float or Integer property, without string
+   * conversion.
+   */
+   virtual int GetPropertyLong(long handle, long& value) const
+   {
+      return TypedPropertyResult(handle, properties_.Get(handle, value));
+   }
+
+   /**
+   * Sets the value of a Float or Integer property, without string
+   * conversion.
+   */
+   virtual int SetPropertyLong(long handle, long value)
+   {
+      return TypedPropertyResult(handle, properties_.Set(handle, value));
+   }
+
    /**
    * Checks if device supports a given property.
    */
@@ -837,6 +886,19 @@ protected:
       morePropertyErrorInfo_ = ptext;
    }
 
+   // Records the property name for error reporting, as the name-based
+   // accessors do, but only on failure so that success costs nothing
+   int TypedPropertyResult(long handle, int ret) const
+   {
+      if (ret != DEVICE_OK)
+      {
+         MM::Property* pProp = properties_.FindByHandle(handle);
+         if (pProp)
+            SetMorePropertyErrorInfo(pProp->GetName().c_str());
+      }
+      return ret;
+   }
+
    /**
    * Output the specified text message to the log stream.
    * @param msg - message text
@@ -2068,6 +2130,17 @@ class CAutoFocusBase : public CDeviceBase<MM::AutoFocus, U>
 template <class U>
 class CImageProcessorBase : public CDeviceBase<MM::ImageProcessor, U>
 {
+public:
+   /**
+    * Processes a snapped image like any other image. Processors that combine
+    * images must override this.
+    */
+   virtual int ProcessSnap(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth)
+   {
+      return this->Process(buffer, width, height, byteDepth);
+   }
+
+   virtual int SequenceStarting() {return DEVICE_OK;}
 };
 
 /**
@@ -27,7 +27,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 71
+#define DEVICE_INTERFACE_VERSION 73
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -277,6 +277,22 @@ namespace MM {
        */
       virtual int SendPropertySequence(const char* propertyName) = 0;
 
+      /**
+       * Obtain a handle for typed access to a property. The handle remains
+       * valid for the lifetime of the device.
+       */
+      virtual int GetPropertyHandle(const char* name, long& handle) const = 0;
+      /**
+       * Typed access to the value of a Float or Integer property, without
+       * conversion to or from a string. Otherwise behaves like GetProperty()
+       * and SetProperty(). Returns DEVICE_INVALID_PROPERTY_TYPE for String
+       * properties.
+       */
+      virtual int GetPropertyDouble(long handle, double& value) const = 0;
+      virtual int SetPropertyDouble(long handle, double value) = 0;
+      virtual int GetPropertyLong(long handle, long& value) const = 0;
+      virtual int SetPropertyLong(long handle, long value) = 0;
+
       virtual bool GetErrorText(int errorCode, char* errMessage) const = 0;
       virtual bool Busy() = 0;
       virtual double GetDelayMs() const = 0;
@@ -864,8 +880,23 @@ namespace MM {
       static const DeviceType Type;
 
       // image processor API
+      /**
+       * Processes the image in place. Processors that combine several images
+       * into one return DEVICE_IMAGE_CONSUMED for the images they absorb;
+       * the core then does not insert them into the sequence buffer.
+       */
       virtual int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) = 0;
-
+      /**
+       * Processes an image taken with snapImage(), which is returned to the
+       * caller on its own. Must not return DEVICE_IMAGE_CONSUMED; processors
+       * that combine images process the image by itself instead.
+       */
+      virtual int ProcessSnap(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) = 0;
+      /**
+       * Called before a sequence acquisition starts, so that processors that
+       * combine consecutive images can discard a partial combination.
+       */
+      virtual int SequenceStarting() = 0;
 
    };
 
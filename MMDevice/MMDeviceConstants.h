@@ -78,6 +78,9 @@
 #define DEVICE_SEQUENCE_TOO_LARGE      39
 #define DEVICE_OUT_OF_MEMORY           40
 #define DEVICE_NOT_YET_IMPLEMENTED     41
+// Not an error: returned by MM::ImageProcessor::Process() when the image has
+// been absorbed (e.g. into an average) and must not be inserted
+#define DEVICE_IMAGE_CONSUMED          42
 
 
 namespace MM {
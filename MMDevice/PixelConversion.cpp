@@ -0,0 +1,765 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PixelConversion.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Conversion of camera pixel formats to the formats used by
+//                Micro-Manager images, with SIMD implementations selected at
+//                run time according to the capabilities of the CPU.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include "PixelConversion.h"
+
+#include <atomic>
+
+// The SIMD kernels are compiled for their instruction set individually (with
+// GCC and Clang, via the target attribute), so the library as a whole does
+// not need any special compiler flags and still runs on any x86 CPU.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define PIXCONV_X86
+#  define PIXCONV_TARGET(isa)
+#  include <intrin.h>
+#  include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+   (defined(__x86_64__) || defined(__i386__))
+#  define PIXCONV_X86
+#  define PIXCONV_TARGET(isa) __attribute__((target(isa)))
+#  include <immintrin.h>
+#endif
+
+
+namespace PixelConversion
+{
+
+namespace
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// Instruction set selection
+///////////////////////////////////////////////////////////////////////////////
+
+InstructionSet DetectInstructionSet()
+{
+#if defined(PIXCONV_X86) && defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   const int maxLeaf = info[0];
+   __cpuid(info, 1);
+   const bool sse2 = (info[3] & (1 << 26)) != 0;
+   const bool ssse3 = (info[2] & (1 << 9)) != 0;
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   const bool avx = (info[2] & (1 << 28)) != 0;
+   bool avx2 = false;
+   if (maxLeaf >= 7 && osxsave && avx &&
+         (_xgetbv(0) & 0x6) == 0x6) // OS saves XMM and YMM state
+   {
+      __cpuidex(info, 7, 0);
+      avx2 = (info[1] & (1 << 5)) != 0;
+   }
+   if (avx2 && ssse3)
+      return InstructionSetAVX2;
+   if (ssse3 && sse2)
+      return InstructionSetSSSE3;
+   if (sse2)
+      return InstructionSetSSE2;
+   return InstructionSetScalar;
+#elif defined(PIXCONV_X86)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("ssse3"))
+      return InstructionSetAVX2;
+   if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse2"))
+      return InstructionSetSSSE3;
+   if (__builtin_cpu_supports("sse2"))
+      return InstructionSetSSE2;
+   return InstructionSetScalar;
+#else
+   return InstructionSetScalar;
+#endif
+}
+
+InstructionSet SupportedInstructionSet()
+{
+   static const InstructionSet supported = DetectInstructionSet();
+   return supported;
+}
+
+std::atomic<int> g_instructionSetLimit(InstructionSetAVX2);
+
+inline InstructionSet ActiveInstructionSet()
+{
+   const int limit = g_instructionSetLimit.load(std::memory_order_relaxed);
+   const InstructionSet supported = SupportedInstructionSet();
+   return limit < supported ? static_cast<InstructionSet>(limit) : supported;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar implementations (also used for the tails of the SIMD kernels)
+///////////////////////////////////////////////////////////////////////////////
+
+inline unsigned char ClipToByte(int v)
+{
+   return v <= 0 ? 0 : (v >= 255 ? 255 : static_cast<unsigned char>(v));
+}
+
+inline void YUVToBGRA(int y, int u, int v, unsigned char* out)
+{
+   const int c = 298 * (y - 16) + 128;
+   const int d = u - 128;
+   const int e = v - 128;
+   out[0] = ClipToByte((c + 516 * d) >> 8);
+   out[1] = ClipToByte((c - 100 * d - 208 * e) >> 8);
+   out[2] = ClipToByte((c + 409 * e) >> 8);
+   out[3] = 255;
+}
+
+// yFirst selects YUYV (true) or UYVY (false) byte order
+void YUV422ToBGRA_Scalar(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels, bool yFirst)
+{
+   const int yOff = yFirst ? 0 : 1;
+   const int cOff = yFirst ? 1 : 0;
+   for (std::size_t i = 0; i + 2 <= nPixels; i += 2)
+   {
+      const unsigned char* in = src + 2 * i;
+      const int u = in[cOff];
+      const int v = in[cOff + 2];
+      YUVToBGRA(in[yOff], u, v, dst + 4 * i);
+      YUVToBGRA(in[yOff + 2], u, v, dst + 4 * i + 4);
+   }
+}
+
+void YUV444ToBGRA_Scalar(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+   for (std::size_t i = 0; i < nPixels; ++i)
+      YUVToBGRA(src[3 * i + 1], src[3 * i], src[3 * i + 2], dst + 4 * i);
+}
+
+void YUV411ToBGRA_Scalar(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+   for (std::size_t i = 0; i + 4 <= nPixels; i += 4)
+   {
+      const unsigned char* in = src + 6 * (i / 4);
+      const int u = in[0];
+      const int v = in[3];
+      YUVToBGRA(in[1], u, v, dst + 4 * i);
+      YUVToBGRA(in[2], u, v, dst + 4 * i + 4);
+      YUVToBGRA(in[4], u, v, dst + 4 * i + 8);
+      YUVToBGRA(in[5], u, v, dst + 4 * i + 12);
+   }
+}
+
+// bgr selects B G R (true) or R G B (false) source byte order
+void RGB24ToBGRA_Scalar(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels, bool bgr)
+{
+   const int bOff = bgr ? 0 : 2;
+   const int rOff = bgr ? 2 : 0;
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      dst[4 * i] = src[3 * i + bOff];
+      dst[4 * i + 1] = src[3 * i + 1];
+      dst[4 * i + 2] = src[3 * i + rOff];
+      dst[4 * i + 3] = 255;
+   }
+}
+
+// LSB-first packing with no padding, as in GenICam Mono10p and Mono12p.
+// Every pixel (of 10 or 12 bits) spans exactly 2 bytes.
+void UnpackLSBFirst_Scalar(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels, unsigned bits)
+{
+   const unsigned mask = (1u << bits) - 1;
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      const std::size_t bit = i * bits;
+      const unsigned char* in = src + bit / 8;
+      const unsigned word = in[0] | (static_cast<unsigned>(in[1]) << 8);
+      dst[i] = static_cast<unsigned short>((word >> (bit % 8)) & mask);
+   }
+}
+
+void UnpackMono10Packed_Scalar(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 2 <= nPixels; i += 2)
+   {
+      const unsigned char* in = src + 3 * (i / 2);
+      dst[i] = static_cast<unsigned short>((in[0] << 2) | (in[1] & 0x3));
+      dst[i + 1] = static_cast<unsigned short>((in[2] << 2) | ((in[1] >> 4) & 0x3));
+   }
+   if (i < nPixels)
+   {
+      const unsigned char* in = src + 3 * (i / 2);
+      dst[i] = static_cast<unsigned short>((in[0] << 2) | (in[1] & 0x3));
+   }
+}
+
+void UnpackMono12Packed_Scalar(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 2 <= nPixels; i += 2)
+   {
+      const unsigned char* in = src + 3 * (i / 2);
+      dst[i] = static_cast<unsigned short>((in[0] << 4) | (in[1] & 0xF));
+      dst[i + 1] = static_cast<unsigned short>((in[2] << 4) | (in[1] >> 4));
+   }
+   if (i < nPixels)
+   {
+      const unsigned char* in = src + 3 * (i / 2);
+      dst[i] = static_cast<unsigned short>((in[0] << 4) | (in[1] & 0xF));
+   }
+}
+
+// Linear scaling in fixed point, so that the SIMD versions can reproduce it
+// exactly: out = (min(max(v - minValue, 0), range) * mult) >> 16, where mult
+// is 255 * 65536 / range rounded up (so that range maps to 255).
+struct ScaleParams
+{
+   unsigned short minValue;
+   unsigned short range;
+   unsigned short multHi; // mult >> 16
+   unsigned short multLo; // mult & 0xFFFF
+};
+
+ScaleParams MakeScaleParams(unsigned short minValue, unsigned short maxValue)
+{
+   ScaleParams p;
+   p.minValue = minValue;
+   p.range = static_cast<unsigned short>(maxValue - minValue);
+   const unsigned mult = (255u * 65536u + p.range - 1) / p.range;
+   p.multHi = static_cast<unsigned short>(mult >> 16);
+   p.multLo = static_cast<unsigned short>(mult & 0xFFFF);
+   return p;
+}
+
+void ScaleTo8Bit_Scalar(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, const ScaleParams& p)
+{
+   const unsigned mult = (static_cast<unsigned>(p.multHi) << 16) | p.multLo;
+   for (std::size_t i = 0; i < nPixels; ++i)
+   {
+      unsigned d = src[i] > p.minValue ? src[i] - p.minValue : 0;
+      if (d > p.range)
+         d = p.range;
+      dst[i] = static_cast<unsigned char>((d * mult) >> 16);
+   }
+}
+
+void SwapBytes16_Scalar(const unsigned short* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   for (std::size_t i = 0; i < nPixels; ++i)
+      dst[i] = static_cast<unsigned short>((src[i] << 8) | (src[i] >> 8));
+}
+
+
+#ifdef PIXCONV_X86
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE2
+///////////////////////////////////////////////////////////////////////////////
+
+PIXCONV_TARGET("sse2")
+inline __m128i Load128(const void* p)
+{
+   return _mm_loadu_si128(static_cast<const __m128i*>(p));
+}
+
+PIXCONV_TARGET("sse2")
+inline void Store128(void* p, __m128i v)
+{
+   _mm_storeu_si128(static_cast<__m128i*>(p), v);
+}
+
+// Converts 8 pixels, given as 16-bit Y, U and V lanes, to 32 bytes of BGRA.
+// Same arithmetic as YUVToBGRA(); the saturating packs do the clipping.
+PIXCONV_TARGET("sse2")
+inline void YUVToBGRA_SSE2(__m128i y, __m128i u, __m128i v,
+      unsigned char* out)
+{
+   const __m128i c = _mm_sub_epi16(y, _mm_set1_epi16(16));
+   const __m128i d = _mm_sub_epi16(u, _mm_set1_epi16(128));
+   const __m128i e = _mm_sub_epi16(v, _mm_set1_epi16(128));
+   const __m128i round = _mm_set1_epi32(128);
+   const __m128i coefCD_B = _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516);
+   const __m128i coefCD_G = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+   const __m128i coefDE_G = _mm_setr_epi16(0, -208, 0, -208, 0, -208, 0, -208);
+   const __m128i coefCE_R = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+
+   const __m128i cdLo = _mm_unpacklo_epi16(c, d), cdHi = _mm_unpackhi_epi16(c, d);
+   const __m128i ceLo = _mm_unpacklo_epi16(c, e), ceHi = _mm_unpackhi_epi16(c, e);
+   const __m128i deLo = _mm_unpacklo_epi16(d, e), deHi = _mm_unpackhi_epi16(d, e);
+
+   const __m128i bLo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cdLo, coefCD_B), round), 8);
+   const __m128i bHi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cdHi, coefCD_B), round), 8);
+   const __m128i gLo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+         _mm_madd_epi16(cdLo, coefCD_G), _mm_madd_epi16(deLo, coefDE_G)), round), 8);
+   const __m128i gHi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+         _mm_madd_epi16(cdHi, coefCD_G), _mm_madd_epi16(deHi, coefDE_G)), round), 8);
+   const __m128i rLo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ceLo, coefCE_R), round), 8);
+   const __m128i rHi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ceHi, coefCE_R), round), 8);
+
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i b8 = _mm_packus_epi16(_mm_packs_epi32(bLo, bHi), zero);
+   const __m128i g8 = _mm_packus_epi16(_mm_packs_epi32(gLo, gHi), zero);
+   const __m128i r8 = _mm_packus_epi16(_mm_packs_epi32(rLo, rHi), zero);
+
+   const __m128i bg = _mm_unpacklo_epi8(b8, g8);
+   const __m128i ra = _mm_unpacklo_epi8(r8, _mm_set1_epi8(static_cast<char>(0xFF)));
+   Store128(out, _mm_unpacklo_epi16(bg, ra));
+   Store128(out + 16, _mm_unpackhi_epi16(bg, ra));
+}
+
+PIXCONV_TARGET("sse2")
+void YUV422ToBGRA_SSE2(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels, bool yFirst)
+{
+   const __m128i lowByte = _mm_set1_epi16(0x00FF);
+   const __m128i low16 = _mm_set1_epi32(0x0000FFFF);
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+   {
+      const __m128i px = Load128(src + 2 * i);
+      const __m128i y = yFirst ? _mm_and_si128(px, lowByte) : _mm_srli_epi16(px, 8);
+      const __m128i uv = yFirst ? _mm_srli_epi16(px, 8) : _mm_and_si128(px, lowByte);
+      __m128i u = _mm_and_si128(uv, low16);
+      u = _mm_or_si128(u, _mm_slli_epi32(u, 16)); // U0 U0 U1 U1 ...
+      __m128i v = _mm_srli_epi32(uv, 16);
+      v = _mm_or_si128(v, _mm_slli_epi32(v, 16)); // V0 V0 V1 V1 ...
+      YUVToBGRA_SSE2(y, u, v, dst + 4 * i);
+   }
+   YUV422ToBGRA_Scalar(src + 2 * i, dst + 4 * i, nPixels - i, yFirst);
+}
+
+// Applies the fixed-point scaling to 8 pixels; results are in 0..255
+PIXCONV_TARGET("sse2")
+inline __m128i Scale8_SSE2(__m128i px, __m128i minValue, __m128i range,
+      __m128i multHi, __m128i multLo)
+{
+   __m128i d = _mm_subs_epu16(px, minValue);
+   d = _mm_sub_epi16(d, _mm_subs_epu16(d, range)); // Unsigned min
+   // d * multHi <= 255 because d <= range, so no overflow
+   return _mm_add_epi16(_mm_mullo_epi16(d, multHi), _mm_mulhi_epu16(d, multLo));
+}
+
+PIXCONV_TARGET("sse2")
+void ScaleTo8Bit_SSE2(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, const ScaleParams& p)
+{
+   const __m128i minValue = _mm_set1_epi16(static_cast<short>(p.minValue));
+   const __m128i range = _mm_set1_epi16(static_cast<short>(p.range));
+   const __m128i multHi = _mm_set1_epi16(static_cast<short>(p.multHi));
+   const __m128i multLo = _mm_set1_epi16(static_cast<short>(p.multLo));
+   std::size_t i = 0;
+   for (; i + 16 <= nPixels; i += 16)
+   {
+      const __m128i a = Scale8_SSE2(Load128(src + i), minValue, range, multHi, multLo);
+      const __m128i b = Scale8_SSE2(Load128(src + i + 8), minValue, range, multHi, multLo);
+      Store128(dst + i, _mm_packus_epi16(a, b));
+   }
+   ScaleTo8Bit_Scalar(src + i, dst + i, nPixels - i, p);
+}
+
+PIXCONV_TARGET("sse2")
+void SwapBytes16_SSE2(const unsigned short* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+   {
+      const __m128i v = Load128(src + i);
+      Store128(dst + i, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+   }
+   SwapBytes16_Scalar(src + i, dst + i, nPixels - i);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SSSE3 (byte shuffles for the formats whose components are not at
+// regular 16-bit positions)
+///////////////////////////////////////////////////////////////////////////////
+
+PIXCONV_TARGET("ssse3")
+void YUV444ToBGRA_SSSE3(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+   // 8 pixels occupy 24 bytes, read as bytes 0-15 and 8-23. Each mask
+   // gathers one component into 16-bit lanes, from one of the two loads.
+   const __m128i uLo = _mm_setr_epi8(0, -128, 3, -128, 6, -128, 9, -128, 12, -128, 15, -128, -128, -128, -128, -128);
+   const __m128i uHi = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 10, -128, 13, -128);
+   const __m128i yLo = _mm_setr_epi8(1, -128, 4, -128, 7, -128, 10, -128, 13, -128, -128, -128, -128, -128, -128, -128);
+   const __m128i yHi = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 8, -128, 11, -128, 14, -128);
+   const __m128i vLo = _mm_setr_epi8(2, -128, 5, -128, 8, -128, 11, -128, 14, -128, -128, -128, -128, -128, -128, -128);
+   const __m128i vHi = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 9, -128, 12, -128, 15, -128);
+   std::size_t i = 0;
+   for (; i + 8 <= nPixels; i += 8)
+   {
+      const __m128i lo = Load128(src + 3 * i);
+      const __m128i hi = Load128(src + 3 * i + 8);
+      const __m128i u = _mm_or_si128(_mm_shuffle_epi8(lo, uLo), _mm_shuffle_epi8(hi, uHi));
+      const __m128i y = _mm_or_si128(_mm_shuffle_epi8(lo, yLo), _mm_shuffle_epi8(hi, yHi));
+      const __m128i v = _mm_or_si128(_mm_shuffle_epi8(lo, vLo), _mm_shuffle_epi8(hi, vHi));
+      YUVToBGRA_SSE2(y, u, v, dst + 4 * i);
+   }
+   YUV444ToBGRA_Scalar(src + 3 * i, dst + 4 * i, nPixels - i);
+}
+
+PIXCONV_TARGET("ssse3")
+void YUV411ToBGRA_SSSE3(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+   // 8 pixels occupy 12 bytes; the 16-byte load needs 4 more to be present
+   const __m128i uMask = _mm_setr_epi8(0, -128, 0, -128, 0, -128, 0, -128, 6, -128, 6, -128, 6, -128, 6, -128);
+   const __m128i yMask = _mm_setr_epi8(1, -128, 2, -128, 4, -128, 5, -128, 7, -128, 8, -128, 10, -128, 11, -128);
+   const __m128i vMask = _mm_setr_epi8(3, -128, 3, -128, 3, -128, 3, -128, 9, -128, 9, -128, 9, -128, 9, -128);
+   std::size_t i = 0;
+   for (; i + 12 <= nPixels; i += 8)
+   {
+      const __m128i px = Load128(src + 6 * (i / 4));
+      YUVToBGRA_SSE2(_mm_shuffle_epi8(px, yMask), _mm_shuffle_epi8(px, uMask),
+            _mm_shuffle_epi8(px, vMask), dst + 4 * i);
+   }
+   YUV411ToBGRA_Scalar(src + 6 * (i / 4), dst + 4 * i, nPixels - i);
+}
+
+PIXCONV_TARGET("ssse3")
+void RGB24ToBGRA_SSSE3(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels, bool bgr)
+{
+   // 4 pixels per step; the 16-byte load needs 4 more bytes to be present
+   const __m128i mask = bgr ?
+      _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128) :
+      _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+   const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+   std::size_t i = 0;
+   for (; i + 6 <= nPixels; i += 4)
+   {
+      const __m128i px = Load128(src + 3 * i);
+      Store128(dst + 4 * i, _mm_or_si128(_mm_shuffle_epi8(px, mask), alpha));
+   }
+   RGB24ToBGRA_Scalar(src + 3 * i, dst + 4 * i, nPixels - i, bgr);
+}
+
+// The packed unpackers gather, for each pixel, the two bytes containing it
+// into a 16-bit lane, then move the pixel's bits into place with a
+// per-lane shift, done as a multiply (left shift) followed by a common
+// right shift.
+
+PIXCONV_TARGET("ssse3")
+void UnpackMono10p_SSSE3(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   // 8 pixels occupy 10 bytes; pixel k of each group of 4 starts at bit 2k
+   const __m128i gather = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+   const __m128i mult = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+   std::size_t i = 0;
+   for (; i + 16 <= nPixels; i += 8)
+   {
+      const __m128i px = _mm_shuffle_epi8(Load128(src + 10 * (i / 8)), gather);
+      Store128(dst + i, _mm_srli_epi16(_mm_mullo_epi16(px, mult), 6));
+   }
+   UnpackLSBFirst_Scalar(src + 10 * (i / 8), dst + i, nPixels - i, 10);
+}
+
+PIXCONV_TARGET("ssse3")
+void UnpackMono12p_SSSE3(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   // 8 pixels occupy 12 bytes; odd pixels start at bit 4
+   const __m128i gather = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+   const __m128i mult = _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+   std::size_t i = 0;
+   for (; i + 12 <= nPixels; i += 8)
+   {
+      const __m128i px = _mm_shuffle_epi8(Load128(src + 12 * (i / 8)), gather);
+      Store128(dst + i, _mm_srli_epi16(_mm_mullo_epi16(px, mult), 4));
+   }
+   UnpackLSBFirst_Scalar(src + 12 * (i / 8), dst + i, nPixels - i, 12);
+}
+
+// Mono10Packed and Mono12Packed: the lanes hold the middle byte (low bits)
+// in the low byte and the pixel's own byte (high bits) in the high byte.
+PIXCONV_TARGET("ssse3")
+void UnpackGigEPacked_SSSE3(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels, unsigned bits)
+{
+   const __m128i gather = _mm_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11);
+   const int lowBits = bits - 8;
+   const __m128i highMask = _mm_set1_epi16(static_cast<short>(0xFF << lowBits));
+   // Move the low bits (at bit 0 for even pixels, bit 4 for odd ones) to the
+   // top of the lane, then down to bit 0
+   const short evenMult = static_cast<short>(1 << (16 - lowBits));
+   const short oddMult = static_cast<short>(1 << (12 - lowBits));
+   const __m128i lowMult = _mm_setr_epi16(evenMult, oddMult, evenMult, oddMult,
+         evenMult, oddMult, evenMult, oddMult);
+   std::size_t i = 0;
+   for (; i + 12 <= nPixels; i += 8)
+   {
+      const __m128i px = _mm_shuffle_epi8(Load128(src + 12 * (i / 8)), gather);
+      const __m128i high = _mm_and_si128(_mm_srli_epi16(px, 8 - lowBits), highMask);
+      const __m128i low = _mm_srli_epi16(_mm_mullo_epi16(px, lowMult), 16 - lowBits);
+      Store128(dst + i, _mm_or_si128(high, low));
+   }
+   if (bits == 10)
+      UnpackMono10Packed_Scalar(src + 12 * (i / 8), dst + i, nPixels - i);
+   else
+      UnpackMono12Packed_Scalar(src + 12 * (i / 8), dst + i, nPixels - i);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AVX2
+///////////////////////////////////////////////////////////////////////////////
+
+PIXCONV_TARGET("avx2")
+void ScaleTo8Bit_AVX2(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, const ScaleParams& p)
+{
+   const __m256i minValue = _mm256_set1_epi16(static_cast<short>(p.minValue));
+   const __m256i range = _mm256_set1_epi16(static_cast<short>(p.range));
+   const __m256i multHi = _mm256_set1_epi16(static_cast<short>(p.multHi));
+   const __m256i multLo = _mm256_set1_epi16(static_cast<short>(p.multLo));
+   std::size_t i = 0;
+   for (; i + 32 <= nPixels; i += 32)
+   {
+      __m256i r[2];
+      for (int k = 0; k < 2; ++k)
+      {
+         __m256i d = _mm256_subs_epu16(_mm256_loadu_si256(
+                  reinterpret_cast<const __m256i*>(src + i + 16 * k)), minValue);
+         d = _mm256_min_epu16(d, range);
+         r[k] = _mm256_add_epi16(_mm256_mullo_epi16(d, multHi),
+               _mm256_mulhi_epu16(d, multLo));
+      }
+      // The pack works within 128-bit halves; restore the pixel order
+      const __m256i packed = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(r[0], r[1]), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+   }
+   ScaleTo8Bit_SSE2(src + i, dst + i, nPixels - i, p);
+}
+
+PIXCONV_TARGET("avx2")
+void SwapBytes16_AVX2(const unsigned short* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+   std::size_t i = 0;
+   for (; i + 16 <= nPixels; i += 16)
+   {
+      const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+            _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8)));
+   }
+   SwapBytes16_SSE2(src + i, dst + i, nPixels - i);
+}
+
+#endif // PIXCONV_X86
+
+} // anonymous namespace
+
+
+InstructionSet GetSupportedInstructionSet()
+{
+   return SupportedInstructionSet();
+}
+
+InstructionSet GetInstructionSet()
+{
+   return ActiveInstructionSet();
+}
+
+void SetInstructionSetLimit(InstructionSet limit)
+{
+   g_instructionSetLimit.store(limit, std::memory_order_relaxed);
+}
+
+const char* GetInstructionSetName(InstructionSet instructionSet)
+{
+   switch (instructionSet)
+   {
+      case InstructionSetScalar:
+         return "Scalar";
+      case InstructionSetSSE2:
+         return "SSE2";
+      case InstructionSetSSSE3:
+         return "SSSE3";
+      case InstructionSetAVX2:
+         return "AVX2";
+   }
+   return "Unknown";
+}
+
+void ConvertYUYVToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSE2)
+      return YUV422ToBGRA_SSE2(src, dst, nPixels, true);
+#endif
+   YUV422ToBGRA_Scalar(src, dst, nPixels, true);
+}
+
+void ConvertUYVYToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSE2)
+      return YUV422ToBGRA_SSE2(src, dst, nPixels, false);
+#endif
+   YUV422ToBGRA_Scalar(src, dst, nPixels, false);
+}
+
+void ConvertYUV444ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return YUV444ToBGRA_SSSE3(src, dst, nPixels);
+#endif
+   YUV444ToBGRA_Scalar(src, dst, nPixels);
+}
+
+void ConvertYUV411ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return YUV411ToBGRA_SSSE3(src, dst, nPixels);
+#endif
+   YUV411ToBGRA_Scalar(src, dst, nPixels);
+}
+
+void ConvertRGB24ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return RGB24ToBGRA_SSSE3(src, dst, nPixels, false);
+#endif
+   RGB24ToBGRA_Scalar(src, dst, nPixels, false);
+}
+
+void ConvertBGR24ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return RGB24ToBGRA_SSSE3(src, dst, nPixels, true);
+#endif
+   RGB24ToBGRA_Scalar(src, dst, nPixels, true);
+}
+
+void UnpackMono10p(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return UnpackMono10p_SSSE3(src, dst, nPixels);
+#endif
+   UnpackLSBFirst_Scalar(src, dst, nPixels, 10);
+}
+
+void UnpackMono12p(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return UnpackMono12p_SSSE3(src, dst, nPixels);
+#endif
+   UnpackLSBFirst_Scalar(src, dst, nPixels, 12);
+}
+
+void UnpackMono10Packed(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return UnpackGigEPacked_SSSE3(src, dst, nPixels, 10);
+#endif
+   UnpackMono10Packed_Scalar(src, dst, nPixels);
+}
+
+void UnpackMono12Packed(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   if (ActiveInstructionSet() >= InstructionSetSSSE3)
+      return UnpackGigEPacked_SSSE3(src, dst, nPixels, 12);
+#endif
+   UnpackMono12Packed_Scalar(src, dst, nPixels);
+}
+
+void ScaleTo8Bit(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, unsigned short minValue, unsigned short maxValue)
+{
+   if (maxValue <= minValue)
+   {
+      for (std::size_t i = 0; i < nPixels; ++i)
+         dst[i] = src[i] > minValue ? 255 : 0;
+      return;
+   }
+
+   const ScaleParams p = MakeScaleParams(minValue, maxValue);
+#ifdef PIXCONV_X86
+   const InstructionSet isa = ActiveInstructionSet();
+   if (isa >= InstructionSetAVX2)
+      return ScaleTo8Bit_AVX2(src, dst, nPixels, p);
+   if (isa >= InstructionSetSSE2)
+      return ScaleTo8Bit_SSE2(src, dst, nPixels, p);
+#endif
+   ScaleTo8Bit_Scalar(src, dst, nPixels, p);
+}
+
+void ApplyLUT(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, const unsigned char* lut, std::size_t lutSize)
+{
+   // Gathers are not faster than scalar loads on most CPUs, so there is no
+   // SIMD version; unrolling lets the loads overlap.
+   const std::size_t last = lutSize - 1;
+   std::size_t i = 0;
+   for (; i + 4 <= nPixels; i += 4)
+   {
+      const std::size_t a = src[i], b = src[i + 1], c = src[i + 2], d = src[i + 3];
+      dst[i] = lut[a < last ? a : last];
+      dst[i + 1] = lut[b < last ? b : last];
+      dst[i + 2] = lut[c < last ? c : last];
+      dst[i + 3] = lut[d < last ? d : last];
+   }
+   for (; i < nPixels; ++i)
+   {
+      const std::size_t a = src[i];
+      dst[i] = lut[a < last ? a : last];
+   }
+}
+
+void SwapBytes16(const unsigned short* src, unsigned short* dst,
+      std::size_t nPixels)
+{
+#ifdef PIXCONV_X86
+   const InstructionSet isa = ActiveInstructionSet();
+   if (isa >= InstructionSetAVX2)
+      return SwapBytes16_AVX2(src, dst, nPixels);
+   if (isa >= InstructionSetSSE2)
+      return SwapBytes16_SSE2(src, dst, nPixels);
+#endif
+   SwapBytes16_Scalar(src, dst, nPixels);
+}
+
+} // namespace PixelConversion
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PixelConversion.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Conversion of camera pixel formats to the formats used by
+//                Micro-Manager images, with SIMD implementations selected at
+//                run time according to the capabilities of the CPU.
+//
+// COPYRIGHT:     University of California, San Francisco, 2024
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifndef _PIXELCONVERSION_H_
+#define _PIXELCONVERSION_H_
+
+#include <cstddef>
+
+/**
+ * Pixel format conversions for camera adapters.
+ *
+ * All functions convert a run of nPixels pixels; for images with row padding,
+ * call them once per row. Source and destination must not overlap, except
+ * where noted. There are no alignment requirements.
+ *
+ * Every conversion has a plain C++ implementation and, on x86, one or more
+ * SIMD implementations that give bit-identical results. The fastest one
+ * supported by the CPU is used, unless limited by SetInstructionSetLimit().
+ *
+ * Color output is 32-bit BGRA with alpha set to 255, which is the layout of
+ * Micro-Manager RGB32 images. YUV is converted with the BT.601 studio-swing
+ * integer approximation.
+ */
+namespace PixelConversion
+{
+
+enum InstructionSet
+{
+   InstructionSetScalar = 0,
+   InstructionSetSSE2,
+   InstructionSetSSSE3,
+   InstructionSetAVX2
+};
+
+// The best instruction set supported by the CPU (and the compiler)
+InstructionSet GetSupportedInstructionSet();
+
+// The instruction set currently used for conversions
+InstructionSet GetInstructionSet();
+
+// Do not use instruction sets better than the given one (for testing and
+// benchmarking). Applies to all threads; not intended to be changed while
+// conversions are running.
+void SetInstructionSetLimit(InstructionSet limit);
+
+const char* GetInstructionSetName(InstructionSet instructionSet);
+
+// YUV 4:2:2, byte order Y0 U Y1 V. nPixels should be even; a trailing odd
+// pixel is left unconverted.
+void ConvertYUYVToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels);
+
+// YUV 4:2:2, byte order U Y0 V Y1 (as used by IIDC cameras)
+void ConvertUYVYToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels);
+
+// YUV 4:4:4, byte order U Y V
+void ConvertYUV444ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels);
+
+// YUV 4:1:1, byte order U Y0 Y1 V Y2 Y3. nPixels should be a multiple of 4;
+// trailing pixels are left unconverted.
+void ConvertYUV411ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels);
+
+// 24-bit RGB, byte order R G B
+void ConvertRGB24ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels);
+
+// 24-bit RGB, byte order B G R
+void ConvertBGR24ToBGRA(const unsigned char* src, unsigned char* dst,
+      std::size_t nPixels);
+
+// GenICam Mono10p: pixels packed LSB first with no padding (4 pixels in 5
+// bytes). The source holds (10 * nPixels + 7) / 8 bytes.
+void UnpackMono10p(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels);
+
+// GenICam Mono12p: pixels packed LSB first with no padding (2 pixels in 3
+// bytes). The source holds (12 * nPixels + 7) / 8 bytes.
+void UnpackMono12p(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels);
+
+// GigE Vision Mono10Packed: 2 pixels in 3 bytes; the middle byte holds the
+// low 2 bits of the first pixel in bits 0-1 and of the second in bits 4-5.
+void UnpackMono10Packed(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels);
+
+// GigE Vision Mono12Packed: 2 pixels in 3 bytes; the middle byte holds the
+// low 4 bits of the first pixel in bits 0-3 and of the second in bits 4-7.
+void UnpackMono12Packed(const unsigned char* src, unsigned short* dst,
+      std::size_t nPixels);
+
+// Linear scaling of 16-bit to 8-bit pixels: values at or below minValue map
+// to 0 and values at or above maxValue map to 255 (rounding down in
+// between). If maxValue <= minValue, the result is a threshold at minValue.
+void ScaleTo8Bit(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, unsigned short minValue, unsigned short maxValue);
+
+// Table lookup of 16-bit to 8-bit pixels; values beyond the end of the table
+// map to its last entry. lutSize must be at least 1.
+void ApplyLUT(const unsigned short* src, unsigned char* dst,
+      std::size_t nPixels, const unsigned char* lut, std::size_t lutSize);
+
+// Reverse the byte order of 16-bit pixels. src and dst may be the same.
+void SwapBytes16(const unsigned short* src, unsigned short* dst,
+      std::size_t nPixels);
+
+} // namespace PixelConversion
+
+#endif // _PIXELCONVERSION_H_
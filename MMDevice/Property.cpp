@@ -64,6 +64,25 @@ bool MM::Property::IsAllowed(const char* value) const
       return true;
 }
 
+// Numeric counterpart of IsAllowed(), comparing by value rather than by
+// string (so that e.g. "1.50" matches 1.5)
+bool MM::Property::IsAllowedNumber(double value) const
+{
+   if (values_.size() == 0)
+      return true; // any value is allowed
+
+   map<string, long>::const_iterator it;
+   for (it = values_.begin(); it != values_.end(); it++)
+   {
+      const char* str = it->first.c_str();
+      char* end;
+      double allowed = strtod(str, &end);
+      if (end != str && *end == '\0' && allowed == value)
+         return true;
+   }
+   return false;
+}
+
 bool MM::Property::GetData(const char* value, long& data) const
 {
    if (!hasData_)
@@ -310,6 +329,94 @@ MM::Property* MM::PropertyCollection::Find(const char* pszName) const
    return it->second;
 }
 
+int MM::PropertyCollection::GetHandle(const char* pszName, long& handle) const
+{
+   MM::Property* pProp = Find(pszName);
+   if (!pProp)
+      return DEVICE_INVALID_PROPERTY; // name not found
+
+   for (size_t i = 0; i < byHandle_.size(); ++i)
+   {
+      if (byHandle_[i] == pProp)
+      {
+         handle = (long)i;
+         return DEVICE_OK;
+      }
+   }
+   return DEVICE_INVALID_PROPERTY;
+}
+
+MM::Property* MM::PropertyCollection::FindByHandle(long handle) const
+{
+   if (handle < 0 || (size_t)handle >= byHandle_.size())
+      return 0;
+   return byHandle_[handle];
+}
+
+// Same checks and actions as Set(const char*, const char*)
+template <typename T>
+int MM::PropertyCollection::SetNumber(long handle, T value)
+{
+   MM::Property* pProp = FindByHandle(handle);
+   if (!pProp)
+      return DEVICE_INVALID_PROPERTY;
+
+   if (pProp->GetType() == MM::String)
+      return DEVICE_INVALID_PROPERTY_TYPE;
+
+   if (pProp->GetReadOnly())
+      return DEVICE_OK;
+
+   if (!pProp->IsAllowedNumber((double)value))
+      return DEVICE_INVALID_PROPERTY_VALUE;
+
+   if (!pProp->Set(value))
+      return DEVICE_INVALID_PROPERTY_VALUE;
+
+   return pProp->Apply();
+}
+
+int MM::PropertyCollection::Set(long handle, double value)
+{
+   return SetNumber(handle, value);
+}
+
+int MM::PropertyCollection::Set(long handle, long value)
+{
+   return SetNumber(handle, value);
+}
+
+// Same update behavior as Get(const char*, std::string&)
+template <typename T>
+int MM::PropertyCollection::GetNumber(long handle, T& value) const
+{
+   MM::Property* pProp = FindByHandle(handle);
+   if (!pProp)
+      return DEVICE_INVALID_PROPERTY;
+
+   if (pProp->GetType() == MM::String)
+      return DEVICE_INVALID_PROPERTY_TYPE;
+
+   if (!pProp->GetCached())
+   {
+      int nRet = pProp->Update();
+      if (nRet != DEVICE_OK)
+         return nRet;
+   }
+   pProp->Get(value);
+   return DEVICE_OK;
+}
+
+int MM::PropertyCollection::Get(long handle, double& value) const
+{
+   return GetNumber(handle, value);
+}
+
+int MM::PropertyCollection::Get(long handle, long& value) const
+{
+   return GetNumber(handle, value);
+}
+
 vector<string> MM::PropertyCollection::GetNames() const
 {
    vector<string> nameList;
@@ -357,6 +464,7 @@ int MM::PropertyCollection::CreateProperty(const char* pszName, const char* pszV
    pProp->SetReadOnly(bReadOnly);
    pProp->SetInitStatus(isPreInitProperty);
    properties_[pszName] = pProp;
+   byHandle_.push_back(pProp);
 
    // assign action functor
    pProp->RegisterAction(pAct);
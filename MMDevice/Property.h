@@ -182,6 +182,7 @@ public:
    void AddAllowedValue(const char* value);
    void AddAllowedValue(const char* value, long data);
    bool IsAllowed(const char* value) const;
+   bool IsAllowedNumber(double value) const;
    bool GetData(const char* value, long& data) const;
 
    bool HasLimits() const 
@@ -432,6 +433,16 @@ public:
    int Set(const char* propName, const char* Value);
    int Get(const char* propName, std::string& val) const;
    Property* Find(const char* name) const;
+
+   // Typed access to numeric properties by handle (index in order of
+   // creation), avoiding the name lookup and string conversions
+   int GetHandle(const char* name, long& handle) const;
+   Property* FindByHandle(long handle) const;
+   int Set(long handle, double value);
+   int Set(long handle, long value);
+   int Get(long handle, double& value) const;
+   int Get(long handle, long& value) const;
+
    std::vector<std::string> GetNames() const;
    unsigned GetSize() const;
    bool GetName(unsigned uIdx, std::string& strName) const;
@@ -441,8 +452,12 @@ public:
    int Apply(const char* Name);
 
 private:
+   template <typename T> int SetNumber(long handle, T value);
+   template <typename T> int GetNumber(long handle, T& value) const;
+
    typedef std::map<std::string, Property*> CPropArray;
    CPropArray properties_;
+   std::vector<Property*> byHandle_; // Same properties, in order of creation
 };
 
 
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+
+#include "PixelConversion.h"
+
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace PixelConversion;
+
+
+namespace {
+
+// Sizes around the SIMD block lengths, to exercise the scalar tails
+const std::size_t testSizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 11, 12, 13, 15,
+    16, 17, 24, 31, 32, 33, 47, 48, 63, 64, 65, 100, 1001 };
+
+std::vector<unsigned char> RandomBytes(std::size_t n, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<unsigned char> v(n);
+    for (auto& b : v)
+        b = static_cast<unsigned char>(dist(gen));
+    return v;
+}
+
+std::vector<unsigned short> RandomWords(std::size_t n, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(0, 65535);
+    std::vector<unsigned short> v(n);
+    for (auto& w : v)
+        w = static_cast<unsigned short>(dist(gen));
+    return v;
+}
+
+// Runs the test body at each instruction set; those not supported by this
+// CPU pass trivially
+class PixelConversionTests : public ::testing::TestWithParam<InstructionSet>
+{
+protected:
+    void TearDown() override
+    {
+        SetInstructionSetLimit(InstructionSetAVX2);
+    }
+
+    // Converts with the scalar code and with the instruction set under test
+    template <typename In, typename Out, typename Func>
+    void CompareWithScalar(Func convert, std::size_t inPerPixel,
+        std::size_t inDivisor, std::size_t outPerPixel)
+    {
+        if (GetParam() > GetSupportedInstructionSet())
+            return;
+        for (std::size_t n : testSizes)
+        {
+            const std::size_t inBytes = (n * inPerPixel + inDivisor - 1) / inDivisor;
+            const std::vector<unsigned char> bytes = RandomBytes(inBytes * sizeof(In), unsigned(n));
+            std::vector<In> in(inBytes);
+            if (inBytes > 0)
+                std::memcpy(in.data(), bytes.data(), bytes.size());
+
+            // Sentinel values catch writes past the end
+            std::vector<Out> expected(n * outPerPixel + 1, Out(0x5A));
+            std::vector<Out> actual(n * outPerPixel + 1, Out(0x5A));
+
+            SetInstructionSetLimit(InstructionSetScalar);
+            convert(in.data(), expected.data(), n);
+            SetInstructionSetLimit(GetParam());
+            convert(in.data(), actual.data(), n);
+            ASSERT_EQ(expected, actual) << "n = " << n;
+        }
+    }
+};
+
+} // anonymous namespace
+
+
+TEST_P(PixelConversionTests, YUYVMatchesScalar)
+{
+    CompareWithScalar<unsigned char, unsigned char>(ConvertYUYVToBGRA, 2, 1, 4);
+}
+
+TEST_P(PixelConversionTests, UYVYMatchesScalar)
+{
+    CompareWithScalar<unsigned char, unsigned char>(ConvertUYVYToBGRA, 2, 1, 4);
+}
+
+TEST_P(PixelConversionTests, YUV444MatchesScalar)
+{
+    CompareWithScalar<unsigned char, unsigned char>(ConvertYUV444ToBGRA, 3, 1, 4);
+}
+
+TEST_P(PixelConversionTests, YUV411MatchesScalar)
+{
+    CompareWithScalar<unsigned char, unsigned char>(ConvertYUV411ToBGRA, 3, 2, 4);
+}
+
+TEST_P(PixelConversionTests, RGB24MatchesScalar)
+{
+    CompareWithScalar<unsigned char, unsigned char>(ConvertRGB24ToBGRA, 3, 1, 4);
+    CompareWithScalar<unsigned char, unsigned char>(ConvertBGR24ToBGRA, 3, 1, 4);
+}
+
+TEST_P(PixelConversionTests, PackedMonoMatchesScalar)
+{
+    CompareWithScalar<unsigned char, unsigned short>(UnpackMono10p, 10, 8, 1);
+    CompareWithScalar<unsigned char, unsigned short>(UnpackMono12p, 12, 8, 1);
+    CompareWithScalar<unsigned char, unsigned short>(UnpackMono10Packed, 3, 2, 1);
+    CompareWithScalar<unsigned char, unsigned short>(UnpackMono12Packed, 3, 2, 1);
+}
+
+TEST_P(PixelConversionTests, ScaleTo8BitMatchesScalar)
+{
+    const unsigned short ranges[][2] = { { 0, 65535 }, { 0, 4095 },
+        { 100, 101 }, { 1000, 1200 }, { 30000, 30100 }, { 0, 255 } };
+    for (const auto& r : ranges)
+    {
+        CompareWithScalar<unsigned short, unsigned char>(
+            [&](const unsigned short* src, unsigned char* dst, std::size_t n)
+            { ScaleTo8Bit(src, dst, n, r[0], r[1]); }, 1, 1, 1);
+    }
+}
+
+TEST_P(PixelConversionTests, SwapBytesMatchesScalar)
+{
+    CompareWithScalar<unsigned short, unsigned short>(SwapBytes16, 1, 1, 1);
+}
+
+INSTANTIATE_TEST_CASE_P(AllInstructionSets, PixelConversionTests,
+    ::testing::Values(InstructionSetScalar, InstructionSetSSE2,
+        InstructionSetSSSE3, InstructionSetAVX2),
+    [](const ::testing::TestParamInfo<InstructionSet>& info)
+    { return std::string(GetInstructionSetName(info.param)); });
+
+
+TEST(PixelConversionValueTests, YUVGrayLevels)
+{
+    // Studio swing: Y = 16 is black, Y = 235 is white
+    const unsigned char yuyv[] = { 16, 128, 235, 128 };
+    unsigned char bgra[8];
+    ConvertYUYVToBGRA(yuyv, bgra, 2);
+    const unsigned char expected[] = { 0, 0, 0, 255, 255, 255, 255, 255 };
+    for (int i = 0; i < 8; ++i)
+        EXPECT_EQ(expected[i], bgra[i]) << i;
+
+    const unsigned char uyvy[] = { 128, 16, 128, 235 };
+    ConvertUYVYToBGRA(uyvy, bgra, 2);
+    for (int i = 0; i < 8; ++i)
+        EXPECT_EQ(expected[i], bgra[i]) << i;
+}
+
+TEST(PixelConversionValueTests, YUVRed)
+{
+    // BT.601 red (255, 0, 0) is Y = 81, U = 90, V = 240
+    const unsigned char yuv444[] = { 90, 81, 240 };
+    unsigned char bgra[4];
+    ConvertYUV444ToBGRA(yuv444, bgra, 1);
+    EXPECT_LE(bgra[0], 1);
+    EXPECT_LE(bgra[1], 1);
+    EXPECT_GE(bgra[2], 254);
+    EXPECT_EQ(255, bgra[3]);
+}
+
+TEST(PixelConversionValueTests, YUV411SharesChroma)
+{
+    const unsigned char yuv411[] = { 128, 16, 50, 128, 100, 235 };
+    unsigned char bgra[16];
+    ConvertYUV411ToBGRA(yuv411, bgra, 4);
+    EXPECT_EQ(0, bgra[0]);
+    EXPECT_EQ(255, bgra[12]);
+    EXPECT_LT(bgra[4], bgra[8]);
+}
+
+TEST(PixelConversionValueTests, RGB24)
+{
+    const unsigned char rgb[] = { 1, 2, 3, 4, 5, 6 };
+    unsigned char bgra[8];
+    ConvertRGB24ToBGRA(rgb, bgra, 2);
+    const unsigned char expected[] = { 3, 2, 1, 255, 6, 5, 4, 255 };
+    for (int i = 0; i < 8; ++i)
+        EXPECT_EQ(expected[i], bgra[i]) << i;
+
+    ConvertBGR24ToBGRA(rgb, bgra, 2);
+    const unsigned char expectedBGR[] = { 1, 2, 3, 255, 4, 5, 6, 255 };
+    for (int i = 0; i < 8; ++i)
+        EXPECT_EQ(expectedBGR[i], bgra[i]) << i;
+}
+
+TEST(PixelConversionValueTests, Mono12p)
+{
+    // 0xABC, 0x123
+    const unsigned char packed[] = { 0xBC, 0x3A, 0x12 };
+    unsigned short px[2];
+    UnpackMono12p(packed, px, 2);
+    EXPECT_EQ(0xABC, px[0]);
+    EXPECT_EQ(0x123, px[1]);
+}
+
+TEST(PixelConversionValueTests, Mono12Packed)
+{
+    // 0xABC, 0x123
+    const unsigned char packed[] = { 0xAB, 0x3C, 0x12 };
+    unsigned short px[2];
+    UnpackMono12Packed(packed, px, 2);
+    EXPECT_EQ(0xABC, px[0]);
+    EXPECT_EQ(0x123, px[1]);
+}
+
+TEST(PixelConversionValueTests, Mono10p)
+{
+    // 0x3FF, 0x000, 0x155, 0x2AA
+    const unsigned char packed[] = { 0xFF, 0x03, 0x50, 0x95, 0xAA };
+    unsigned short px[4];
+    UnpackMono10p(packed, px, 4);
+    EXPECT_EQ(0x3FF, px[0]);
+    EXPECT_EQ(0x000, px[1]);
+    EXPECT_EQ(0x155, px[2]);
+    EXPECT_EQ(0x2AA, px[3]);
+}
+
+TEST(PixelConversionValueTests, Mono10Packed)
+{
+    // 0x2AB, 0x1CD
+    const unsigned char packed[] = { 0xAA, 0x13, 0x73 };
+    unsigned short px[2];
+    UnpackMono10Packed(packed, px, 2);
+    EXPECT_EQ(0x2AB, px[0]);
+    EXPECT_EQ(0x1CD, px[1]);
+}
+
+TEST(PixelConversionValueTests, ScaleTo8Bit)
+{
+    const unsigned short in[] = { 0, 99, 100, 150, 200, 201, 65535 };
+    unsigned char out[7];
+    ScaleTo8Bit(in, out, 7, 100, 200);
+    EXPECT_EQ(0, out[0]);
+    EXPECT_EQ(0, out[1]);
+    EXPECT_EQ(0, out[2]);
+    EXPECT_EQ(127, out[3]);
+    EXPECT_EQ(255, out[4]);
+    EXPECT_EQ(255, out[5]);
+    EXPECT_EQ(255, out[6]);
+
+    ScaleTo8Bit(in, out, 7, 100, 100);
+    EXPECT_EQ(0, out[2]);
+    EXPECT_EQ(255, out[3]);
+}
+
+TEST(PixelConversionValueTests, ApplyLUT)
+{
+    std::vector<unsigned char> lut(4096);
+    for (std::size_t i = 0; i < lut.size(); ++i)
+        lut[i] = static_cast<unsigned char>(i >> 4);
+    const unsigned short in[] = { 0, 16, 4095, 4096, 65535 };
+    unsigned char out[5];
+    ApplyLUT(in, out, 5, lut.data(), lut.size());
+    EXPECT_EQ(0, out[0]);
+    EXPECT_EQ(1, out[1]);
+    EXPECT_EQ(255, out[2]);
+    EXPECT_EQ(255, out[3]);
+    EXPECT_EQ(255, out[4]);
+}
+
+TEST(PixelConversionValueTests, SwapBytesInPlace)
+{
+    std::vector<unsigned short> v = RandomWords(37, 1);
+    const std::vector<unsigned short> orig = v;
+    SwapBytes16(v.data(), v.data(), v.size());
+    for (std::size_t i = 0; i < v.size(); ++i)
+        ASSERT_EQ(static_cast<unsigned short>((orig[i] << 8) | (orig[i] >> 8)), v[i]);
+}
+
+TEST(PixelConversionValueTests, LimitDoesNotExceedSupport)
+{
+    SetInstructionSetLimit(InstructionSetScalar);
+    EXPECT_EQ(InstructionSetScalar, GetInstructionSet());
+    SetInstructionSetLimit(InstructionSetAVX2);
+    EXPECT_EQ(GetSupportedInstructionSet(), GetInstructionSet());
+}
+
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
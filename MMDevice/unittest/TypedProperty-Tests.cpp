@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include "DeviceBase.h"
+#include "Property.h"
+
+#include <string>
+
+using namespace MM;
+
+
+namespace {
+
+class TestDevice : public CGenericBase<TestDevice>
+{
+public:
+   TestDevice() : applyCount_(0)
+   {
+      CreateProperty("Power", "0.0", MM::Float, false,
+            new CPropertyAction(this, &TestDevice::OnPower));
+      SetPropertyLimits("Power", 0.0, 100.0);
+      CreateProperty("Gain", "1", MM::Integer, false);
+      AddAllowedValue("Gain", "1");
+      AddAllowedValue("Gain", "2");
+      AddAllowedValue("Gain", "4");
+      CreateProperty("Mode", "A", MM::String, false);
+      CreateProperty("Serial", "1234", MM::Integer, true);
+   }
+
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   void GetName(char* name) const { CDeviceUtils::CopyLimitedString(name, "Test"); }
+   bool Busy() { return false; }
+
+   int OnPower(MM::PropertyBase*, MM::ActionType eAct)
+   {
+      if (eAct == MM::AfterSet)
+         ++applyCount_;
+      return DEVICE_OK;
+   }
+
+   int applyCount_;
+};
+
+} // anonymous namespace
+
+
+TEST(TypedPropertyTests, HandlesFollowCreationOrder)
+{
+   TestDevice dev;
+   long handle = -1;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Power", handle));
+   EXPECT_EQ(0, handle);
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Gain", handle));
+   EXPECT_EQ(1, handle);
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY, dev.GetPropertyHandle("NoSuch", handle));
+}
+
+TEST(TypedPropertyTests, DoubleRoundTripMatchesStringPath)
+{
+   TestDevice dev;
+   long power;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Power", power));
+
+   ASSERT_EQ(DEVICE_OK, dev.SetPropertyDouble(power, 12.345678));
+   double value;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyDouble(power, value));
+   EXPECT_DOUBLE_EQ(12.3457, value); // Truncated as by the string path
+   EXPECT_EQ(1, dev.applyCount_);
+
+   char buf[MM::MaxStrLength];
+   ASSERT_EQ(DEVICE_OK, dev.GetProperty("Power", buf));
+   EXPECT_EQ(std::string("12.3457"), buf);
+
+   ASSERT_EQ(DEVICE_OK, dev.SetProperty("Power", "50"));
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyDouble(power, value));
+   EXPECT_DOUBLE_EQ(50.0, value);
+}
+
+TEST(TypedPropertyTests, LimitsAreEnforced)
+{
+   TestDevice dev;
+   long power;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Power", power));
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY_VALUE, dev.SetPropertyDouble(power, 100.5));
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY_VALUE, dev.SetPropertyLong(power, -1));
+   EXPECT_EQ(0, dev.applyCount_);
+}
+
+TEST(TypedPropertyTests, AllowedValuesCompareNumerically)
+{
+   TestDevice dev;
+   long gain;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Gain", gain));
+   EXPECT_EQ(DEVICE_OK, dev.SetPropertyLong(gain, 4));
+   EXPECT_EQ(DEVICE_OK, dev.SetPropertyDouble(gain, 2.0));
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY_VALUE, dev.SetPropertyLong(gain, 3));
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY_VALUE, dev.SetPropertyDouble(gain, 2.5));
+
+   long value;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyLong(gain, value));
+   EXPECT_EQ(2, value);
+}
+
+TEST(TypedPropertyTests, StringPropertiesAreRejected)
+{
+   TestDevice dev;
+   long mode;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Mode", mode));
+   double value;
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY_TYPE, dev.GetPropertyDouble(mode, value));
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY_TYPE, dev.SetPropertyDouble(mode, 1.0));
+}
+
+TEST(TypedPropertyTests, ReadOnlyIsSilentlyIgnored)
+{
+   TestDevice dev;
+   long serial;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyHandle("Serial", serial));
+   EXPECT_EQ(DEVICE_OK, dev.SetPropertyLong(serial, 99));
+   long value;
+   ASSERT_EQ(DEVICE_OK, dev.GetPropertyLong(serial, value));
+   EXPECT_EQ(1234, value);
+}
+
+TEST(TypedPropertyTests, InvalidHandle)
+{
+   TestDevice dev;
+   double value;
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY, dev.GetPropertyDouble(-1, value));
+   EXPECT_EQ(DEVICE_INVALID_PROPERTY, dev.SetPropertyDouble(100, 1.0));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}